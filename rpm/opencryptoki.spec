@@ -274,6 +274,7 @@ exit 0
 %{_libdir}/pkgconfig/%{name}.pc
 
 %files swtok
+%config(noreplace) %{_sysconfdir}/%{name}/swtok.conf
 %{_libdir}/opencryptoki/stdll/libpkcs11_sw.*
 %{_libdir}/opencryptoki/stdll/PKCS11_SW.so
 %dir %attr(770,root,pkcs11) %{_sharedstatedir}/%{name}/swtok/
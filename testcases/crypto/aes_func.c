@@ -2578,6 +2578,322 @@ testcase_cleanup:
     return rc;
 }
 
+/**
+ * Message-based AES-GCM: C_EncryptMessage/C_DecryptMessage must produce the
+ * same cipher text and tag as C_Encrypt with CKM_AES_GCM on the same IV and
+ * AAD, and must check the tag and the CK_GCM_MESSAGE_PARAMS.
+ */
+CK_RV do_EncryptDecryptMessageAESGCM(void)
+{
+    CK_BYTE user_pin[PKCS11_MAX_PIN_LEN];
+    CK_ULONG user_pin_len;
+    CK_SESSION_HANDLE session;
+    CK_FLAGS flags;
+    CK_SLOT_ID slot_id = SLOT_ID;
+    CK_MECHANISM mechkey = aes_keygen;
+    CK_MECHANISM mech;
+    CK_MECHANISM msg_mech = { CKM_AES_GCM, NULL, 0 };
+    CK_OBJECT_HANDLE h_key = CK_INVALID_HANDLE;
+    CK_GCM_PARAMS gcm_param;
+    CK_GCM_MESSAGE_PARAMS msg_param, bad_param;
+    CK_BYTE iv[12], iv1[12];
+    CK_BYTE aad[20], original[37];
+    CK_BYTE tag[AES_BLOCK_SIZE];
+    CK_BYTE crypt[sizeof(original)], decrypt[sizeof(original)];
+    CK_BYTE expected[sizeof(original) + AES_BLOCK_SIZE];
+    CK_ULONG crypt_len, decrypt_len, expected_len, i;
+    CK_RV rc = CKR_OK;
+    struct {
+        const char *what;
+        CK_ULONG param_len;
+        CK_BYTE_PTR pIv;
+        CK_ULONG ulIvFixedBits;
+        CK_GENERATOR_FUNCTION ivGenerator;
+        CK_ULONG ulTagBits;
+    } bad_params[] = {
+        { "short parameter", sizeof(msg_param) - 1, iv, 0, CKG_NO_GENERATE,
+          128 },
+        { "no IV", sizeof(msg_param), NULL, 0, CKG_NO_GENERATE, 128 },
+        { "tag bits 0", sizeof(msg_param), iv, 0, CKG_NO_GENERATE, 0 },
+        { "tag bits 100", sizeof(msg_param), iv, 0, CKG_NO_GENERATE, 100 },
+        { "tag bits 136", sizeof(msg_param), iv, 0, CKG_NO_GENERATE, 136 },
+        { "fixed bits 12", sizeof(msg_param), iv, 12, CKG_GENERATE_RANDOM,
+          128 },
+        { "fixed bits 96", sizeof(msg_param), iv, 96, CKG_GENERATE_RANDOM,
+          128 },
+        { "counter generator", sizeof(msg_param), iv, 32,
+          CKG_GENERATE_COUNTER, 128 },
+    };
+
+    testsuite_begin("AES_GCM message-based Encryption/Decryption.");
+    testcase_rw_session();
+    testcase_user_login();
+
+    /** skip tests if the slot doesn't support message-based encryption **/
+    if (!mech_supported_flags(slot_id, CKM_AES_GCM, CKF_MESSAGE_ENCRYPT)) {
+        testsuite_skip(4, "Slot %u doesn't support message-based %s",
+                       (unsigned int) slot_id, mech_to_str(CKM_AES_GCM));
+        goto testcase_cleanup;
+    }
+
+    rc = generate_AESKey(session, 32, CK_TRUE, &mechkey, &h_key);
+    if (rc != CKR_OK) {
+        if (rc == CKR_POLICY_VIOLATION) {
+            testsuite_skip(4, "AES key generation is not allowed by policy");
+            goto testcase_cleanup;
+        }
+
+        testcase_error("C_GenerateKey rc=%s", p11_get_ckr(rc));
+        goto testcase_cleanup;
+    }
+
+    for (i = 0; i < sizeof(aad); i++)
+        aad[i] = i;
+    for (i = 0; i < sizeof(original); i++)
+        original[i] = 0x80 + i;
+    memset(iv, 0x5a, sizeof(iv));
+
+    /** same result as single-part CKM_AES_GCM, for several messages **/
+    testcase_begin("C_EncryptMessage compared with C_Encrypt.");
+    testcase_new_assertion();
+
+    rc = funcs3->C_MessageEncryptInit(session, &msg_mech, h_key);
+    if (rc != CKR_OK) {
+        testcase_fail("C_MessageEncryptInit rc=%s", p11_get_ckr(rc));
+        goto testcase_cleanup;
+    }
+
+    for (i = 0; i < 3; i++) {
+        iv[sizeof(iv) - 1] = i;
+
+        memset(&gcm_param, 0, sizeof(gcm_param));
+        gcm_param.pIv = iv;
+        gcm_param.ulIvLen = sizeof(iv);
+        gcm_param.ulIvBits = sizeof(iv) * 8;
+        gcm_param.pAAD = aad;
+        gcm_param.ulAADLen = sizeof(aad);
+        gcm_param.ulTagBits = sizeof(tag) * 8;
+        mech.mechanism = CKM_AES_GCM;
+        mech.pParameter = &gcm_param;
+        mech.ulParameterLen = sizeof(gcm_param);
+
+        rc = funcs->C_EncryptInit(session, &mech, h_key);
+        if (rc != CKR_OK) {
+            testcase_fail("C_EncryptInit rc=%s", p11_get_ckr(rc));
+            goto encrypt_final;
+        }
+        expected_len = sizeof(expected);
+        rc = funcs->C_Encrypt(session, original, sizeof(original),
+                              expected, &expected_len);
+        if (rc != CKR_OK) {
+            testcase_fail("C_Encrypt rc=%s", p11_get_ckr(rc));
+            goto encrypt_final;
+        }
+
+        msg_param.pIv = iv;
+        msg_param.ulIvLen = sizeof(iv);
+        msg_param.ulIvFixedBits = 0;
+        msg_param.ivGenerator = CKG_NO_GENERATE;
+        msg_param.pTag = tag;
+        msg_param.ulTagBits = sizeof(tag) * 8;
+
+        crypt_len = sizeof(crypt);
+        rc = funcs3->C_EncryptMessage(session, &msg_param, sizeof(msg_param),
+                                      aad, sizeof(aad),
+                                      original, sizeof(original),
+                                      crypt, &crypt_len);
+        if (rc != CKR_OK) {
+            testcase_fail("C_EncryptMessage rc=%s", p11_get_ckr(rc));
+            goto encrypt_final;
+        }
+
+        if (expected_len != crypt_len + sizeof(tag) ||
+            memcmp(crypt, expected, crypt_len) != 0) {
+            testcase_fail("Message %lu: cipher text does not match "
+                          "C_Encrypt", i);
+            goto encrypt_final;
+        }
+        if (memcmp(tag, expected + crypt_len, sizeof(tag)) != 0) {
+            testcase_fail("Message %lu: tag does not match C_Encrypt", i);
+            goto encrypt_final;
+        }
+    }
+    testcase_pass("C_EncryptMessage matches C_Encrypt.");
+
+encrypt_final:
+    rc = funcs3->C_MessageEncryptFinal(session);
+    if (rc != CKR_OK) {
+        testcase_error("C_MessageEncryptFinal rc=%s", p11_get_ckr(rc));
+        goto testcase_cleanup;
+    }
+
+    /** decrypt the last message, then with a modified tag **/
+    testcase_begin("C_DecryptMessage with a modified tag.");
+    testcase_new_assertion();
+
+    rc = funcs3->C_MessageDecryptInit(session, &msg_mech, h_key);
+    if (rc != CKR_OK) {
+        testcase_fail("C_MessageDecryptInit rc=%s", p11_get_ckr(rc));
+        goto testcase_cleanup;
+    }
+
+    decrypt_len = sizeof(decrypt);
+    rc = funcs3->C_DecryptMessage(session, &msg_param, sizeof(msg_param),
+                                  aad, sizeof(aad), crypt, crypt_len,
+                                  decrypt, &decrypt_len);
+    if (rc != CKR_OK) {
+        testcase_fail("C_DecryptMessage rc=%s", p11_get_ckr(rc));
+        goto decrypt_final;
+    }
+    if (decrypt_len != sizeof(original) ||
+        memcmp(decrypt, original, sizeof(original)) != 0) {
+        testcase_fail("decrypted data does not match original data");
+        goto decrypt_final;
+    }
+
+    tag[0] ^= 0x01;
+    decrypt_len = sizeof(decrypt);
+    rc = funcs3->C_DecryptMessage(session, &msg_param, sizeof(msg_param),
+                                  aad, sizeof(aad), crypt, crypt_len,
+                                  decrypt, &decrypt_len);
+    if (rc != CKR_AEAD_DECRYPT_FAILED) {
+        testcase_fail("C_DecryptMessage with a modified tag rc=%s, expected "
+                      "CKR_AEAD_DECRYPT_FAILED", p11_get_ckr(rc));
+        goto decrypt_final;
+    }
+    testcase_pass("C_DecryptMessage rejects a modified tag.");
+
+decrypt_final:
+    rc = funcs3->C_MessageDecryptFinal(session);
+    if (rc != CKR_OK) {
+        testcase_error("C_MessageDecryptFinal rc=%s", p11_get_ckr(rc));
+        goto testcase_cleanup;
+    }
+
+    /** random IVs keep the fixed leading bits **/
+    testcase_begin("C_EncryptMessage with CKG_GENERATE_RANDOM.");
+    testcase_new_assertion();
+
+    rc = funcs3->C_MessageEncryptInit(session, &msg_mech, h_key);
+    if (rc != CKR_OK) {
+        testcase_fail("C_MessageEncryptInit rc=%s", p11_get_ckr(rc));
+        goto testcase_cleanup;
+    }
+
+    msg_param.ulIvFixedBits = 32;
+    msg_param.ivGenerator = CKG_GENERATE_RANDOM;
+    for (i = 0; i < 2; i++) {
+        memset(iv, 0, sizeof(iv));
+        memset(iv, 0xa5, 4);
+
+        crypt_len = sizeof(crypt);
+        rc = funcs3->C_EncryptMessage(session, &msg_param, sizeof(msg_param),
+                                      aad, sizeof(aad),
+                                      original, sizeof(original),
+                                      crypt, &crypt_len);
+        if (rc != CKR_OK) {
+            testcase_fail("C_EncryptMessage rc=%s", p11_get_ckr(rc));
+            goto random_final;
+        }
+        if (iv[0] != 0xa5 || iv[1] != 0xa5 || iv[2] != 0xa5 ||
+            iv[3] != 0xa5) {
+            testcase_fail("The fixed IV bits were changed");
+            goto random_final;
+        }
+        if (i == 0)
+            memcpy(iv1, iv, sizeof(iv));
+    }
+    if (memcmp(iv, iv1, sizeof(iv)) == 0) {
+        testcase_fail("The same IV was generated twice");
+        goto random_final;
+    }
+    testcase_pass("CKG_GENERATE_RANDOM keeps the fixed IV bits.");
+
+random_final:
+    rc = funcs3->C_MessageEncryptFinal(session);
+    if (rc != CKR_OK) {
+        testcase_error("C_MessageEncryptFinal rc=%s", p11_get_ckr(rc));
+        goto testcase_cleanup;
+    }
+
+    /** invalid message parameters **/
+    testcase_begin("C_EncryptMessage with invalid CK_GCM_MESSAGE_PARAMS.");
+    testcase_new_assertion();
+
+    mech.mechanism = CKM_AES_GCM;
+    mech.pParameter = &gcm_param;
+    mech.ulParameterLen = sizeof(gcm_param);
+    rc = funcs3->C_MessageEncryptInit(session, &mech, h_key);
+    if (rc != CKR_MECHANISM_PARAM_INVALID) {
+        testcase_fail("C_MessageEncryptInit with CK_GCM_PARAMS rc=%s, "
+                      "expected CKR_MECHANISM_PARAM_INVALID", p11_get_ckr(rc));
+        if (rc == CKR_OK)
+            funcs3->C_MessageEncryptFinal(session);
+        goto testcase_cleanup;
+    }
+
+    rc = funcs3->C_MessageEncryptInit(session, &msg_mech, h_key);
+    if (rc != CKR_OK) {
+        testcase_fail("C_MessageEncryptInit rc=%s", p11_get_ckr(rc));
+        goto testcase_cleanup;
+    }
+
+    for (i = 0; i < sizeof(bad_params) / sizeof(bad_params[0]); i++) {
+        bad_param.pIv = bad_params[i].pIv;
+        bad_param.ulIvLen = sizeof(iv);
+        bad_param.ulIvFixedBits = bad_params[i].ulIvFixedBits;
+        bad_param.ivGenerator = bad_params[i].ivGenerator;
+        bad_param.pTag = tag;
+        bad_param.ulTagBits = bad_params[i].ulTagBits;
+
+        crypt_len = sizeof(crypt);
+        rc = funcs3->C_EncryptMessage(session, &bad_param,
+                                      bad_params[i].param_len,
+                                      aad, sizeof(aad),
+                                      original, sizeof(original),
+                                      crypt, &crypt_len);
+        if (rc != CKR_MECHANISM_PARAM_INVALID) {
+            testcase_fail("C_EncryptMessage with %s rc=%s, expected "
+                          "CKR_MECHANISM_PARAM_INVALID", bad_params[i].what,
+                          p11_get_ckr(rc));
+            goto invalid_final;
+        }
+    }
+
+    /* The operation is still usable after a rejected message */
+    msg_param.ulIvFixedBits = 0;
+    msg_param.ivGenerator = CKG_NO_GENERATE;
+    crypt_len = sizeof(crypt);
+    rc = funcs3->C_EncryptMessage(session, &msg_param, sizeof(msg_param),
+                                  aad, sizeof(aad), original, sizeof(original),
+                                  crypt, &crypt_len);
+    if (rc != CKR_OK) {
+        testcase_fail("C_EncryptMessage after invalid parameters rc=%s",
+                      p11_get_ckr(rc));
+        goto invalid_final;
+    }
+    testcase_pass("Invalid CK_GCM_MESSAGE_PARAMS are rejected.");
+
+invalid_final:
+    rc = funcs3->C_MessageEncryptFinal(session);
+    if (rc != CKR_OK)
+        testcase_error("C_MessageEncryptFinal rc=%s", p11_get_ckr(rc));
+
+testcase_cleanup:
+    if (h_key != CK_INVALID_HANDLE) {
+        rc = funcs->C_DestroyObject(session, h_key);
+        if (rc != CKR_OK)
+            testcase_error("C_DestroyObject rc=%s", p11_get_ckr(rc));
+    }
+
+    testcase_user_logout();
+    rc = funcs->C_CloseAllSessions(slot_id);
+    if (rc != CKR_OK)
+        testcase_error("C_CloseAllSessions rc=%s", p11_get_ckr(rc));
+
+    return rc;
+}
+
 /**
  * Special tests for protected key support.
  */
@@ -2697,6 +3013,7 @@ int main(int argc, char **argv)
 
     pkey = CK_FALSE;
     rv = aes_funcs();
+    rv += do_EncryptDecryptMessageAESGCM();
 
     pkey = CK_TRUE;
     rv += aes_funcs();
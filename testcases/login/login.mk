@@ -1,7 +1,8 @@
 noinst_PROGRAMS +=							\
 	testcases/login/login testcases/login/init_tok			\
 	testcases/login/set_pin testcases/login/init_pin		\
-	testcases/login/digest_init testcases/login/login_flags_test
+	testcases/login/digest_init testcases/login/login_flags_test	\
+	testcases/login/login_broker
 
 testcases_login_login_CFLAGS = ${testcases_inc}
 testcases_login_login_LDADD = testcases/common/libcommon.la
@@ -28,3 +29,7 @@ testcases_login_login_flags_test_CFLAGS = ${testcases_inc}
 testcases_login_login_flags_test_LDADD = testcases/common/libcommon.la
 testcases_login_login_flags_test_SOURCES =				\
 	usr/lib/common/p11util.c testcases/login/login_flags.c
+
+testcases_login_login_broker_CFLAGS = ${testcases_inc}
+testcases_login_login_broker_LDADD = testcases/common/libcommon.la
+testcases_login_login_broker_SOURCES = testcases/login/login_broker.c
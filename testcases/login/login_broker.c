@@ -0,0 +1,474 @@
+/*
+ * COPYRIGHT (c) International Business Machines Corp. 2024
+ *
+ * This program is provided under the terms of the Common Public License,
+ * version 1.0 (CPL-1.0). Any use, reproduction or distribution for this
+ * software constitutes recipient's acceptance of CPL-1.0 terms which can be
+ * found in the file LICENSE file or at
+ * https://opensource.org/licenses/cpl1.0.php
+ */
+
+/*
+ * openCryptoki testcase
+ * - Tests the login broker (LOGIN_BROKER token option)
+ *
+ * The test process logs in as USER, which starts the login broker of the
+ * token, and runs further logins in child processes, which are served by
+ * the broker. Without the LOGIN_BROKER option the children use the regular
+ * login, and all tests must pass as well.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "pkcs11types.h"
+#include "regress.h"
+#include "common.c"
+
+#define BAD_USER_PIN        "53456634"
+#define NEW_USER_PIN        "brokPW12"
+
+#define LABEL_A             "login_broker_A"
+#define LABEL_B             "login_broker_B"
+
+/* Exit codes of the child processes */
+#define CHILD_OK            0
+#define CHILD_CHECK_FAILED  1
+#define CHILD_PIN_INCORRECT 2
+#define CHILD_PIN_LOCKED    3
+#define CHILD_ERROR         4
+
+static CK_BYTE user_pin[PKCS11_MAX_PIN_LEN];
+static CK_ULONG user_pin_len;
+
+static CK_RV count_objects(CK_SESSION_HANDLE session, const char *label,
+                           CK_ULONG *count)
+{
+    CK_OBJECT_CLASS class = CKO_DATA;
+    CK_BBOOL true = TRUE;
+    CK_ATTRIBUTE tmpl[] = {
+        {CKA_CLASS, &class, sizeof(class)},
+        {CKA_TOKEN, &true, sizeof(true)},
+        {CKA_LABEL, (CK_CHAR_PTR)label, strlen(label)},
+    };
+    CK_OBJECT_HANDLE handles[4];
+    CK_RV rc;
+
+    rc = funcs->C_FindObjectsInit(session, tmpl, 3);
+    if (rc != CKR_OK)
+        return rc;
+    rc = funcs->C_FindObjects(session, handles, 4, count);
+    funcs->C_FindObjectsFinal(session);
+
+    return rc;
+}
+
+/*
+ * Child: log in with 'pin', and check that the private token object with
+ * label 'present' exists and the one with label 'absent' does not.
+ */
+static int child_login(char *pin, char *present, char *absent)
+{
+    CK_C_INITIALIZE_ARGS cinit_args;
+    CK_SESSION_HANDLE session;
+    CK_ULONG count;
+    int ret = CHILD_OK;
+    CK_RV rc;
+
+    if (!do_GetFunctionList())
+        return CHILD_ERROR;
+
+    memset(&cinit_args, 0, sizeof(cinit_args));
+    cinit_args.flags = CKF_OS_LOCKING_OK;
+    if (funcs->C_Initialize(&cinit_args) != CKR_OK)
+        return CHILD_ERROR;
+
+    rc = funcs->C_OpenSession(SLOT_ID, CKF_SERIAL_SESSION | CKF_RW_SESSION,
+                              NULL_PTR, NULL_PTR, &session);
+    if (rc != CKR_OK) {
+        ret = CHILD_ERROR;
+        goto finalize;
+    }
+
+    rc = funcs->C_Login(session, CKU_USER, (CK_CHAR_PTR)pin, strlen(pin));
+    switch (rc) {
+    case CKR_OK:
+        break;
+    case CKR_PIN_INCORRECT:
+        ret = CHILD_PIN_INCORRECT;
+        goto finalize;
+    case CKR_PIN_LOCKED:
+        ret = CHILD_PIN_LOCKED;
+        goto finalize;
+    default:
+        show_error("C_Login", rc);
+        ret = CHILD_ERROR;
+        goto finalize;
+    }
+
+    if (strcmp(present, "-") != 0) {
+        if (count_objects(session, present, &count) != CKR_OK) {
+            ret = CHILD_ERROR;
+            goto logout;
+        }
+        if (count != 1) {
+            fprintf(stderr, "child: %lu objects with label %s\n", count,
+                    present);
+            ret = CHILD_CHECK_FAILED;
+        }
+    }
+    if (strcmp(absent, "-") != 0) {
+        if (count_objects(session, absent, &count) != CKR_OK) {
+            ret = CHILD_ERROR;
+            goto logout;
+        }
+        if (count != 0) {
+            fprintf(stderr, "child: deleted object %s still found\n", absent);
+            ret = CHILD_CHECK_FAILED;
+        }
+    }
+
+logout:
+    funcs->C_Logout(session);
+finalize:
+    funcs->C_Finalize(NULL);
+
+    return ret;
+}
+
+static int run_child(const char *pin, const char *present, const char *absent)
+{
+    char slot[32];
+    int status;
+    pid_t pid;
+
+    snprintf(slot, sizeof(slot), "%lu", SLOT_ID);
+
+    fflush(stdout);
+    fflush(stderr);
+    pid = fork();
+    if (pid < 0)
+        return CHILD_ERROR;
+    if (pid == 0) {
+        execl("/proc/self/exe", "login_broker", "-child", slot, pin,
+              present, absent, (char *)NULL);
+        _exit(CHILD_ERROR);
+    }
+
+    if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status))
+        return CHILD_ERROR;
+
+    return WEXITSTATUS(status);
+}
+
+static CK_RV create_private_object(CK_SESSION_HANDLE session,
+                                   const char *label,
+                                   CK_OBJECT_HANDLE *handle)
+{
+    CK_OBJECT_CLASS class = CKO_DATA;
+    CK_BBOOL true = TRUE;
+    CK_BYTE value[] = "login broker test object";
+    CK_ATTRIBUTE tmpl[] = {
+        {CKA_CLASS, &class, sizeof(class)},
+        {CKA_TOKEN, &true, sizeof(true)},
+        {CKA_PRIVATE, &true, sizeof(true)},
+        {CKA_LABEL, (CK_CHAR_PTR)label, strlen(label)},
+        {CKA_VALUE, value, sizeof(value)},
+    };
+
+    return funcs->C_CreateObject(session, tmpl, 5, handle);
+}
+
+static CK_RV get_token_flags(CK_FLAGS *flags)
+{
+    CK_TOKEN_INFO ti;
+    CK_RV rc;
+
+    rc = funcs->C_GetTokenInfo(SLOT_ID, &ti);
+    if (rc != CKR_OK) {
+        testcase_error("C_GetTokenInfo rc=%s", p11_get_ckr(rc));
+        return rc;
+    }
+    *flags = ti.flags;
+
+    return CKR_OK;
+}
+
+#define USER_PIN_FLAGS  (CKF_USER_PIN_COUNT_LOW | CKF_USER_PIN_FINAL_TRY | \
+                         CKF_USER_PIN_LOCKED)
+
+/* A child logs in and sees the private token objects */
+static CK_RV login_broker_attach(CK_SESSION_HANDLE session)
+{
+    CK_OBJECT_HANDLE obj_a = CK_INVALID_HANDLE, obj_b = CK_INVALID_HANDLE;
+    int ret;
+    CK_RV rc;
+
+    testcase_begin("attach and stale snapshots");
+    testcase_new_assertion();
+
+    rc = create_private_object(session, LABEL_A, &obj_a);
+    if (rc != CKR_OK) {
+        testcase_error("C_CreateObject rc=%s", p11_get_ckr(rc));
+        return rc;
+    }
+
+    ret = run_child((char *)user_pin, LABEL_A, "-");
+    if (ret != CHILD_OK) {
+        testcase_fail("login with the broker failed: %d", ret);
+        goto out;
+    }
+
+    /* Objects created and deleted after the broker took its snapshot */
+    rc = create_private_object(session, LABEL_B, &obj_b);
+    if (rc != CKR_OK) {
+        testcase_error("C_CreateObject rc=%s", p11_get_ckr(rc));
+        goto out;
+    }
+    ret = run_child((char *)user_pin, LABEL_B, "-");
+    if (ret != CHILD_OK) {
+        testcase_fail("created object not seen after login: %d", ret);
+        goto out;
+    }
+
+    rc = funcs->C_DestroyObject(session, obj_a);
+    if (rc != CKR_OK) {
+        testcase_error("C_DestroyObject rc=%s", p11_get_ckr(rc));
+        goto out;
+    }
+    obj_a = CK_INVALID_HANDLE;
+    ret = run_child((char *)user_pin, LABEL_B, LABEL_A);
+    if (ret != CHILD_OK) {
+        testcase_fail("destroyed object seen after login: %d", ret);
+        goto out;
+    }
+
+    testcase_pass("attach and stale snapshots");
+
+out:
+    if (obj_a != CK_INVALID_HANDLE)
+        funcs->C_DestroyObject(session, obj_a);
+    if (obj_b != CK_INVALID_HANDLE)
+        funcs->C_DestroyObject(session, obj_b);
+
+    return rc;
+}
+
+/* Wrong PINs are counted once, and refused once the PIN is locked */
+static CK_RV login_broker_wrong_pin(CK_SESSION_HANDLE session)
+{
+    CK_BYTE so_pin[PKCS11_MAX_PIN_LEN];
+    CK_FLAGS flags;
+    int ret, i;
+    CK_RV rc;
+
+    testcase_begin("wrong PIN");
+    testcase_new_assertion();
+
+    ret = run_child(BAD_USER_PIN, "-", "-");
+    if (ret != CHILD_PIN_INCORRECT) {
+        testcase_fail("login with a wrong PIN: %d", ret);
+        return CKR_OK;
+    }
+    rc = get_token_flags(&flags);
+    if (rc != CKR_OK)
+        return rc;
+    if ((flags & USER_PIN_FLAGS) != CKF_USER_PIN_COUNT_LOW) {
+        testcase_fail("wrong PIN not counted once, flags 0x%lx", flags);
+        return CKR_OK;
+    }
+
+    ret = run_child((char *)user_pin, "-", "-");
+    if (ret != CHILD_OK) {
+        testcase_fail("login after a wrong PIN: %d", ret);
+        return CKR_OK;
+    }
+    rc = get_token_flags(&flags);
+    if (rc != CKR_OK)
+        return rc;
+    if ((flags & USER_PIN_FLAGS) != 0) {
+        testcase_fail("flags not reset after login, flags 0x%lx", flags);
+        return CKR_OK;
+    }
+
+    if (get_so_pin(so_pin) != 0) {
+        testcase_skip("no SO PIN to unlock the user PIN");
+        return CKR_OK;
+    }
+
+    for (i = 0; i < 3; i++) {
+        ret = run_child(BAD_USER_PIN, "-", "-");
+        if (ret != CHILD_PIN_INCORRECT) {
+            testcase_fail("login #%d with a wrong PIN: %d", i, ret);
+            goto unlock;
+        }
+    }
+    rc = get_token_flags(&flags);
+    if (rc != CKR_OK)
+        goto unlock;
+    if (!(flags & CKF_USER_PIN_LOCKED)) {
+        testcase_fail("PIN not locked, flags 0x%lx", flags);
+        goto unlock;
+    }
+
+    ret = run_child((char *)user_pin, "-", "-");
+    if (ret != CHILD_PIN_LOCKED) {
+        testcase_fail("login with a locked PIN: %d", ret);
+        goto unlock;
+    }
+
+    testcase_pass("wrong PIN");
+
+unlock:
+    /* Unlock the user PIN, which also stops and restarts the broker */
+    rc = funcs->C_Logout(session);
+    if (rc == CKR_OK)
+        rc = funcs->C_Login(session, CKU_SO, so_pin,
+                            strlen((char *)so_pin));
+    if (rc == CKR_OK) {
+        rc = funcs->C_InitPIN(session, user_pin, user_pin_len);
+        funcs->C_Logout(session);
+    }
+    if (rc == CKR_OK)
+        rc = funcs->C_Login(session, CKU_USER, user_pin, user_pin_len);
+    if (rc != CKR_OK)
+        testcase_error("failed to unlock the user PIN, rc=%s",
+                       p11_get_ckr(rc));
+
+    return rc;
+}
+
+/* A PIN change makes the broker refuse requests with the old PIN */
+static CK_RV login_broker_pin_change(CK_SESSION_HANDLE session)
+{
+    CK_FLAGS flags;
+    int ret;
+    CK_RV rc;
+
+    testcase_begin("PIN change");
+    testcase_new_assertion();
+
+    rc = funcs->C_SetPIN(session, user_pin, user_pin_len,
+                         (CK_CHAR_PTR)NEW_USER_PIN, strlen(NEW_USER_PIN));
+    if (rc != CKR_OK) {
+        testcase_error("C_SetPIN rc=%s", p11_get_ckr(rc));
+        return rc;
+    }
+
+    ret = run_child(NEW_USER_PIN, "-", "-");
+    if (ret != CHILD_OK) {
+        testcase_fail("login with the new PIN: %d", ret);
+        goto restore;
+    }
+
+    ret = run_child((char *)user_pin, "-", "-");
+    if (ret != CHILD_PIN_INCORRECT) {
+        testcase_fail("login with the old PIN: %d", ret);
+        goto restore;
+    }
+    rc = get_token_flags(&flags);
+    if (rc != CKR_OK)
+        goto restore;
+    if ((flags & USER_PIN_FLAGS) != CKF_USER_PIN_COUNT_LOW) {
+        testcase_fail("old PIN not counted once, flags 0x%lx", flags);
+        goto restore;
+    }
+
+    testcase_pass("PIN change");
+
+restore:
+    rc = funcs->C_SetPIN(session, (CK_CHAR_PTR)NEW_USER_PIN,
+                         strlen(NEW_USER_PIN), user_pin, user_pin_len);
+    if (rc != CKR_OK) {
+        testcase_error("C_SetPIN rc=%s, the user PIN is now %s",
+                       p11_get_ckr(rc), NEW_USER_PIN);
+        return rc;
+    }
+
+    /* Reset the login flags */
+    if (run_child((char *)user_pin, "-", "-") != CHILD_OK)
+        testcase_error("login with the restored PIN failed");
+
+    return CKR_OK;
+}
+
+int main(int argc, char **argv)
+{
+    CK_C_INITIALIZE_ARGS cinit_args;
+    CK_SESSION_HANDLE session;
+    CK_FLAGS flags;
+    CK_RV rc;
+    int ret;
+
+    if (argc == 6 && strcmp(argv[1], "-child") == 0) {
+        SLOT_ID = strtoul(argv[2], NULL, 10);
+        return child_login(argv[3], argv[4], argv[5]);
+    }
+
+    ret = do_ParseArgs(argc, argv);
+    if (ret != 1)
+        return ret;
+
+    printf("Using slot #%lu...\n\n", SLOT_ID);
+
+    if (!do_GetFunctionList())
+        return -1;
+
+    if (get_user_pin(user_pin))
+        return CKR_FUNCTION_FAILED;
+    user_pin_len = strlen((char *)user_pin);
+
+    memset(&cinit_args, 0, sizeof(cinit_args));
+    cinit_args.flags = CKF_OS_LOCKING_OK;
+    rc = funcs->C_Initialize(&cinit_args);
+    if (rc != CKR_OK) {
+        show_error("C_Initialize", rc);
+        return rc;
+    }
+
+    testcase_setup();
+
+    rc = get_token_flags(&flags);
+    if (rc != CKR_OK)
+        goto finalize;
+    if (flags & USER_PIN_FLAGS) {
+        printf("The USER's PIN flags of the token in slot %lu are set.\n"
+               "Please log in once and re-run this test.\n", SLOT_ID);
+        rc = CKR_FUNCTION_FAILED;
+        goto finalize;
+    }
+
+    rc = funcs->C_OpenSession(SLOT_ID, CKF_SERIAL_SESSION | CKF_RW_SESSION,
+                              NULL_PTR, NULL_PTR, &session);
+    if (rc != CKR_OK) {
+        show_error("C_OpenSession", rc);
+        goto finalize;
+    }
+
+    /* Starts the login broker */
+    rc = funcs->C_Login(session, CKU_USER, user_pin, user_pin_len);
+    if (rc != CKR_OK) {
+        show_error("C_Login", rc);
+        goto close;
+    }
+
+    rc = login_broker_attach(session);
+    if (rc == CKR_OK)
+        rc = login_broker_wrong_pin(session);
+    if (rc == CKR_OK)
+        rc = login_broker_pin_change(session);
+
+    funcs->C_Logout(session);
+close:
+    funcs->C_CloseSession(session);
+finalize:
+    funcs->C_Finalize(NULL);
+
+    testcase_print_result();
+
+    return testcase_return(rc);
+}
@@ -0,0 +1,389 @@
+/*
+ * COPYRIGHT (c) International Business Machines Corp. 2024
+ *
+ * This program is provided under the terms of the Common Public License,
+ * version 1.0 (CPL-1.0). Any use, reproduction or distribution for this
+ * software constitutes recipient's acceptance of CPL-1.0 terms which can
+ * be found in the file LICENSE file or at
+ * https://opensource.org/licenses/cpl1.0.php
+ */
+
+/*
+ * Test for the dispatching of single-part operations across the APQNs of the
+ * EP11 token (ASYNC_QUEUE_DEPTH).
+ *
+ * The token must be configured with OPTIMIZE_SINGLE_PART_OPERATIONS,
+ * ASYNC_QUEUE_DEPTH and an APQN_ALLOWLIST with at least two APQNs, and use
+ * the simulated host library of the unit tests, i.e. OCK_EP11_LIBRARY must
+ * point to libep11stub.so. Without crypto adapters, the token must be built
+ * with EP11_HSMSIM, so that it does not look for them in sysfs. Pass the
+ * configured ASYNC_QUEUE_DEPTH with -depth to also check the limit of
+ * requests in flight.
+ */
+
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pkcs11types.h"
+#include "regress.h"
+#include "defs.h"
+#include "common.c"
+
+#define EP11STUB_NAME       "libep11stub.so"
+#define NUM_APQNS           (256 * 256)
+#define NUM_THREADS         8
+#define NUM_REQUESTS        50
+#define STUB_LATENCY_US     2000
+#define STUB_CONCURRENCY    64
+
+static void (*stub_set_latency)(unsigned int usecs);
+static void (*stub_set_concurrency)(unsigned int requests);
+static void (*stub_set_failed)(unsigned int adapter, unsigned int domain,
+                               int failed);
+static unsigned long (*stub_requests)(unsigned int adapter,
+                                      unsigned int domain);
+static unsigned int (*stub_peak_requests)(void);
+
+static unsigned int depth;
+static unsigned long before[NUM_APQNS], after[NUM_APQNS];
+static unsigned int used[NUM_APQNS];
+
+struct worker {
+    pthread_t thread;
+    CK_SESSION_HANDLE session;
+    CK_OBJECT_HANDLE key;
+    CK_RV rc;
+};
+
+/*
+ * Returns TRUE if the token loaded the EP11 stub as host library, and
+ * resolves its control functions.
+ */
+static CK_BBOOL find_ep11stub(void)
+{
+    const char *name;
+    void *lib;
+
+    name = getenv("OCK_EP11_LIBRARY");
+    if (name == NULL || strstr(name, EP11STUB_NAME) == NULL)
+        return FALSE;
+
+    lib = dlopen(name, RTLD_NOW | RTLD_NOLOAD);
+    if (lib == NULL)
+        return FALSE;
+
+    *(void **)(&stub_set_latency) = dlsym(lib, "ep11stub_set_latency");
+    *(void **)(&stub_set_concurrency) = dlsym(lib, "ep11stub_set_concurrency");
+    *(void **)(&stub_set_failed) = dlsym(lib, "ep11stub_set_failed");
+    *(void **)(&stub_requests) = dlsym(lib, "ep11stub_requests");
+    *(void **)(&stub_peak_requests) = dlsym(lib, "ep11stub_peak_requests");
+    dlclose(lib);
+
+    return stub_set_latency != NULL && stub_set_concurrency != NULL &&
+           stub_set_failed != NULL && stub_requests != NULL &&
+           stub_peak_requests != NULL;
+}
+
+static void snapshot(unsigned long *requests)
+{
+    unsigned int i;
+
+    for (i = 0; i < NUM_APQNS; i++)
+        requests[i] = stub_requests(i >> 8, i & 0xff);
+}
+
+static CK_RV encrypt_once(CK_SESSION_HANDLE session, CK_OBJECT_HANDLE key)
+{
+    CK_MECHANISM mech = { CKM_AES_ECB, NULL, 0 };
+    CK_BYTE clear[64] = { 0 };
+    CK_BYTE cipher[sizeof(clear)];
+    CK_ULONG cipher_len = sizeof(cipher);
+    CK_RV rc;
+
+    rc = funcs->C_EncryptInit(session, &mech, key);
+    if (rc != CKR_OK)
+        return rc;
+
+    return funcs->C_Encrypt(session, clear, sizeof(clear), cipher,
+                            &cipher_len);
+}
+
+static void *worker_thread(void *arg)
+{
+    struct worker *w = arg;
+    unsigned int i;
+
+    for (i = 0; i < NUM_REQUESTS && w->rc == CKR_OK; i++)
+        w->rc = encrypt_once(w->session, w->key);
+
+    return NULL;
+}
+
+/* Runs the workers concurrently, returns the first error of a worker */
+static CK_RV run_workers(struct worker *workers)
+{
+    CK_RV rc = CKR_OK;
+    unsigned int i, started;
+
+    for (started = 0; started < NUM_THREADS; started++) {
+        workers[started].rc = CKR_OK;
+        if (pthread_create(&workers[started].thread, NULL, worker_thread,
+                           &workers[started]) != 0) {
+            rc = CKR_FUNCTION_FAILED;
+            break;
+        }
+    }
+
+    for (i = 0; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+        if (workers[i].rc != CKR_OK && rc == CKR_OK)
+            rc = workers[i].rc;
+    }
+
+    return rc;
+}
+
+static CK_RV dispatch_tests(void)
+{
+    CK_MECHANISM keygen = { CKM_AES_KEY_GEN, NULL, 0 };
+    CK_ULONG key_len = 32;
+    CK_BBOOL true = TRUE, false = FALSE;
+    CK_ATTRIBUTE template[] = {
+        {CKA_VALUE_LEN, &key_len, sizeof(key_len)},
+        {CKA_TOKEN, &false, sizeof(false)},
+        {CKA_ENCRYPT, &true, sizeof(true)},
+    };
+    struct worker workers[NUM_THREADS];
+    CK_SESSION_HANDLE session = CK_INVALID_HANDLE;
+    CK_OBJECT_HANDLE key = CK_INVALID_HANDLE;
+    CK_FLAGS flags;
+    CK_BYTE user_pin[PKCS11_MAX_PIN_LEN];
+    CK_ULONG user_pin_len;
+    unsigned int num_used = 0, peak, i;
+    unsigned long total = 0, expected = NUM_THREADS * NUM_REQUESTS;
+    CK_RV rc;
+
+    testsuite_begin("EP11 request dispatching across APQNs");
+
+    if (!is_ep11_token(SLOT_ID)) {
+        testsuite_skip(4, "this slot is not an EP11 token");
+        return CKR_OK;
+    }
+
+    if (!find_ep11stub()) {
+        testsuite_skip(4, "the EP11 token does not use " EP11STUB_NAME);
+        return CKR_OK;
+    }
+
+    for (i = 0; i < NUM_THREADS; i++)
+        workers[i].session = CK_INVALID_HANDLE;
+
+    testcase_rw_session();
+    testcase_user_login();
+
+    rc = funcs->C_GenerateKey(session, &keygen, template,
+                              sizeof(template) / sizeof(CK_ATTRIBUTE), &key);
+    if (rc != CKR_OK) {
+        testcase_error("C_GenerateKey() rc=%s", p11_get_ckr(rc));
+        goto testcase_cleanup;
+    }
+
+    for (i = 0; i < NUM_THREADS; i++) {
+        rc = funcs->C_OpenSession(SLOT_ID, flags, NULL, NULL,
+                                  &workers[i].session);
+        if (rc != CKR_OK) {
+            testcase_error("C_OpenSession() rc=%s", p11_get_ckr(rc));
+            workers[i].session = CK_INVALID_HANDLE;
+            goto testcase_cleanup;
+        }
+        workers[i].key = key;
+    }
+
+    /*
+     * Let requests overlap, and let the APQNs accept more requests at a time
+     * than the token may send them.
+     */
+    stub_set_latency(STUB_LATENCY_US);
+    stub_set_concurrency(STUB_CONCURRENCY);
+
+    testcase_begin("Requests are spread across the APQNs");
+
+    snapshot(before);
+    stub_peak_requests();
+    rc = run_workers(workers);
+    peak = stub_peak_requests();
+    snapshot(after);
+    if (rc != CKR_OK) {
+        testcase_new_assertion();
+        testcase_fail("C_Encrypt() rc=%s", p11_get_ckr(rc));
+        goto testcase_cleanup;
+    }
+
+    for (i = 0; i < NUM_APQNS; i++) {
+        if (after[i] == before[i])
+            continue;
+        used[num_used++] = i;
+        total += after[i] - before[i];
+    }
+
+    if (num_used < 2) {
+        testsuite_skip(4, "the token uses %u APQN, at least 2 are needed",
+                       num_used);
+        goto testcase_cleanup;
+    }
+
+    testcase_new_assertion();
+
+    if (total != expected) {
+        testcase_fail("%lu requests were sent to the APQNs, expected %lu",
+                      total, expected);
+        goto testcase_cleanup;
+    }
+
+    for (i = 0; i < num_used; i++) {
+        if (after[used[i]] - before[used[i]] < total / (2 * num_used)) {
+            testcase_fail("APQN %02x.%04x processed only %lu of %lu requests",
+                          used[i] >> 8, used[i] & 0xff,
+                          after[used[i]] - before[used[i]], total);
+            goto testcase_cleanup;
+        }
+    }
+
+    testcase_pass("%lu requests spread across %u APQNs", total, num_used);
+
+    testcase_begin("Requests in flight are limited per APQN");
+
+    if (depth == 0) {
+        testcase_skip("the ASYNC_QUEUE_DEPTH of the token was not passed "
+                      "with -depth");
+    } else {
+        testcase_new_assertion();
+        if (peak > depth * num_used) {
+            testcase_fail("%u requests were in flight, at most %u expected",
+                          peak, depth * num_used);
+            goto testcase_cleanup;
+        }
+        testcase_pass("at most %u requests were in flight", peak);
+    }
+
+    testcase_begin("Requests are moved away from a failed APQN");
+    testcase_new_assertion();
+
+    stub_set_failed(used[0] >> 8, used[0] & 0xff, TRUE);
+    snapshot(before);
+    rc = run_workers(workers);
+    snapshot(after);
+    stub_set_failed(used[0] >> 8, used[0] & 0xff, FALSE);
+    if (rc != CKR_OK) {
+        testcase_fail("C_Encrypt() with a failed APQN rc=%s",
+                      p11_get_ckr(rc));
+        goto testcase_cleanup;
+    }
+
+    if (after[used[0]] != before[used[0]]) {
+        testcase_fail("the failed APQN processed %lu requests",
+                      after[used[0]] - before[used[0]]);
+        goto testcase_cleanup;
+    }
+
+    testcase_pass("APQN %02x.%04x failed, all requests succeeded",
+                  used[0] >> 8, used[0] & 0xff);
+
+    testcase_begin("Requests fail if all APQNs failed");
+    testcase_new_assertion();
+
+    for (i = 0; i < num_used; i++)
+        stub_set_failed(used[i] >> 8, used[i] & 0xff, TRUE);
+    rc = encrypt_once(session, key);
+    for (i = 0; i < num_used; i++)
+        stub_set_failed(used[i] >> 8, used[i] & 0xff, FALSE);
+    if (rc != CKR_DEVICE_ERROR) {
+        testcase_fail("C_Encrypt() with all APQNs failed rc=%s, expected "
+                      "CKR_DEVICE_ERROR", p11_get_ckr(rc));
+        goto testcase_cleanup;
+    }
+
+    rc = encrypt_once(session, key);
+    if (rc != CKR_OK) {
+        testcase_fail("C_Encrypt() after the APQNs recovered rc=%s",
+                      p11_get_ckr(rc));
+        goto testcase_cleanup;
+    }
+
+    testcase_pass("C_Encrypt() failed with CKR_DEVICE_ERROR and succeeded "
+                  "once the APQNs recovered");
+
+testcase_cleanup:
+    if (stub_set_latency != NULL)
+        stub_set_latency(0);
+    for (i = 0; i < NUM_THREADS; i++) {
+        if (workers[i].session != CK_INVALID_HANDLE)
+            funcs->C_CloseSession(workers[i].session);
+    }
+    if (key != CK_INVALID_HANDLE)
+        funcs->C_DestroyObject(session, key);
+    testcase_user_logout();
+    testcase_close_session();
+    return rc;
+}
+
+/* Removes the -depth option, which do_ParseArgs() does not know */
+static int parse_depth(int *argc, char **argv)
+{
+    int i, j;
+
+    for (i = 1; i < *argc; i++) {
+        if (strcmp(argv[i], "-depth") != 0)
+            continue;
+        if (i + 1 >= *argc) {
+            printf("Queue depth missing\n");
+            return -1;
+        }
+        depth = strtoul(argv[i + 1], NULL, 10);
+        for (j = i + 2; j < *argc; j++)
+            argv[j - 2] = argv[j];
+        *argc -= 2;
+        break;
+    }
+
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    CK_C_INITIALIZE_ARGS cinit_args;
+    int rc;
+    CK_RV rv;
+
+    rc = parse_depth(&argc, argv);
+    if (rc != 1)
+        return rc;
+
+    rc = do_ParseArgs(argc, argv);
+    if (rc != 1)
+        return rc;
+
+    printf("Using slot #%lu...\n", SLOT_ID);
+
+    rc = do_GetFunctionList();
+    if (!rc) {
+        testcase_error("do_getFunctionList(), rc=%s", p11_get_ckr(rc));
+        return rc;
+    }
+
+    memset(&cinit_args, 0x0, sizeof(cinit_args));
+    cinit_args.flags = CKF_OS_LOCKING_OK;
+
+    funcs->C_Initialize(&cinit_args);
+
+    testcase_setup();
+    rv = dispatch_tests();
+    testcase_print_result();
+
+    funcs->C_Finalize(NULL);
+
+    return testcase_return(rv);
+}
@@ -0,0 +1,503 @@
+/*
+ * COPYRIGHT (c) International Business Machines Corp. 2024
+ *
+ * This program is provided under the terms of the Common Public License,
+ * version 1.0 (CPL-1.0). Any use, reproduction or distribution for this
+ * software constitutes recipient's acceptance of CPL-1.0 terms which can
+ * be found in the file LICENSE file or at
+ * https://opensource.org/licenses/cpl1.0.php
+ */
+
+/*
+ * Test for the LOCAL_PUBLIC_KEY_OPERATIONS option of the EP11 token.
+ *
+ * The token must be configured with LOCAL_PUBLIC_KEY_OPERATIONS and use the
+ * simulated host library of the unit tests, i.e. OCK_EP11_LIBRARY must point
+ * to libep11stub.so. Without crypto adapters, the token must be built with
+ * EP11_HSMSIM, so that it does not look for them in sysfs. The stub cannot
+ * verify real signatures, so the test checks that signatures made with
+ * OpenSSL verify, that the RSA encryption can be decrypted with OpenSSL, and
+ * that the stub did not process any request for these operations.
+ */
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/opensslv.h>
+#include <openssl/bn.h>
+#include <openssl/ec.h>
+#include <openssl/evp.h>
+#include <openssl/objects.h>
+#include <openssl/rsa.h>
+
+#include "pkcs11types.h"
+#include "regress.h"
+#include "defs.h"
+#include "common.c"
+
+#if OPENSSL_VERSION_PREREQ(3, 0)
+#include <openssl/core_names.h>
+#endif
+
+#define EP11STUB_NAME       "libep11stub.so"
+
+static unsigned long (*stub_total_requests)(void);
+
+static CK_BYTE msg[] = "Public key operations are performed locally";
+
+/* DER encoded DigestInfo of a SHA-256 hash, without the hash */
+static CK_BYTE sha256_digest_info[] = {
+    0x30, 0x31, 0x30, 0x0d, 0x06, 0x09, 0x60, 0x86, 0x48, 0x01, 0x65, 0x03,
+    0x04, 0x02, 0x01, 0x05, 0x00, 0x04, 0x20
+};
+
+/*
+ * Returns TRUE if the token loaded the EP11 stub as host library, and
+ * resolves its request counter.
+ */
+static CK_BBOOL find_ep11stub(void)
+{
+    const char *name;
+    void *lib;
+
+    name = getenv("OCK_EP11_LIBRARY");
+    if (name == NULL || strstr(name, EP11STUB_NAME) == NULL)
+        return FALSE;
+
+    lib = dlopen(name, RTLD_NOW | RTLD_NOLOAD);
+    if (lib == NULL)
+        return FALSE;
+
+    *(void **)(&stub_total_requests) = dlsym(lib, "ep11stub_total_requests");
+    dlclose(lib);
+
+    return stub_total_requests != NULL;
+}
+
+static EVP_PKEY *generate_pkey(int type)
+{
+    EVP_PKEY_CTX *ctx;
+    EVP_PKEY *pkey = NULL;
+    int ok;
+
+    ctx = EVP_PKEY_CTX_new_id(type, NULL);
+    if (ctx == NULL)
+        return NULL;
+
+    ok = EVP_PKEY_keygen_init(ctx) == 1 &&
+         (type == EVP_PKEY_RSA ?
+            EVP_PKEY_CTX_set_rsa_keygen_bits(ctx, 2048) :
+            EVP_PKEY_CTX_set_ec_paramgen_curve_nid(ctx,
+                                                   NID_X9_62_prime256v1)) == 1 &&
+         EVP_PKEY_keygen(ctx, &pkey) == 1;
+    EVP_PKEY_CTX_free(ctx);
+
+    return ok ? pkey : NULL;
+}
+
+static CK_RV create_rsa_public_key(CK_SESSION_HANDLE session, EVP_PKEY *pkey,
+                                   CK_OBJECT_HANDLE *handle)
+{
+    CK_OBJECT_CLASS class = CKO_PUBLIC_KEY;
+    CK_KEY_TYPE keytype = CKK_RSA;
+    CK_BBOOL true = TRUE, false = FALSE;
+    CK_BYTE modulus[512], exponent[8];
+    CK_ATTRIBUTE template[] = {
+        {CKA_CLASS, &class, sizeof(class)},
+        {CKA_KEY_TYPE, &keytype, sizeof(keytype)},
+        {CKA_TOKEN, &false, sizeof(false)},
+        {CKA_VERIFY, &true, sizeof(true)},
+        {CKA_ENCRYPT, &true, sizeof(true)},
+        {CKA_MODULUS, modulus, 0},
+        {CKA_PUBLIC_EXPONENT, exponent, 0},
+    };
+    BIGNUM *n = NULL, *e = NULL;
+    CK_RV rc = CKR_FUNCTION_FAILED;
+
+#if !OPENSSL_VERSION_PREREQ(3, 0)
+    const BIGNUM *bn_n, *bn_e;
+
+    RSA_get0_key(EVP_PKEY_get0_RSA(pkey), &bn_n, &bn_e, NULL);
+    n = BN_dup(bn_n);
+    e = BN_dup(bn_e);
+#else
+    EVP_PKEY_get_bn_param(pkey, OSSL_PKEY_PARAM_RSA_N, &n);
+    EVP_PKEY_get_bn_param(pkey, OSSL_PKEY_PARAM_RSA_E, &e);
+#endif
+    if (n == NULL || e == NULL ||
+        BN_num_bytes(n) > (int)sizeof(modulus) ||
+        BN_num_bytes(e) > (int)sizeof(exponent))
+        goto out;
+
+    template[5].ulValueLen = BN_bn2bin(n, modulus);
+    template[6].ulValueLen = BN_bn2bin(e, exponent);
+
+    rc = funcs->C_CreateObject(session, template,
+                               sizeof(template) / sizeof(CK_ATTRIBUTE),
+                               handle);
+out:
+    BN_free(n);
+    BN_free(e);
+    return rc;
+}
+
+static CK_RV create_ec_public_key(CK_SESSION_HANDLE session, EVP_PKEY *pkey,
+                                  CK_OBJECT_HANDLE *handle)
+{
+    CK_OBJECT_CLASS class = CKO_PUBLIC_KEY;
+    CK_KEY_TYPE keytype = CKK_EC;
+    CK_BBOOL true = TRUE, false = FALSE;
+    CK_BYTE params[16], point[2 + 65];
+    CK_ATTRIBUTE template[] = {
+        {CKA_CLASS, &class, sizeof(class)},
+        {CKA_KEY_TYPE, &keytype, sizeof(keytype)},
+        {CKA_TOKEN, &false, sizeof(false)},
+        {CKA_VERIFY, &true, sizeof(true)},
+        {CKA_EC_PARAMS, params, 0},
+        {CKA_EC_POINT, point, 0},
+    };
+    unsigned char *p = params;
+    size_t len;
+    int plen;
+
+    plen = i2d_ASN1_OBJECT(OBJ_nid2obj(NID_X9_62_prime256v1), NULL);
+    if (plen <= 0 || plen > (int)sizeof(params))
+        return CKR_FUNCTION_FAILED;
+    template[4].ulValueLen = i2d_ASN1_OBJECT(OBJ_nid2obj(NID_X9_62_prime256v1),
+                                             &p);
+
+    /* CKA_EC_POINT is the DER encoded OCTET STRING of the point */
+#if !OPENSSL_VERSION_PREREQ(3, 0)
+    len = EC_POINT_point2oct(EC_KEY_get0_group(EVP_PKEY_get0_EC_KEY(pkey)),
+                             EC_KEY_get0_public_key(EVP_PKEY_get0_EC_KEY(pkey)),
+                             POINT_CONVERSION_UNCOMPRESSED, point + 2,
+                             sizeof(point) - 2, NULL);
+#else
+    if (EVP_PKEY_get_octet_string_param(pkey, OSSL_PKEY_PARAM_PUB_KEY,
+                                        point + 2, sizeof(point) - 2,
+                                        &len) != 1)
+        len = 0;
+#endif
+    if (len == 0 || len > 127)
+        return CKR_FUNCTION_FAILED;
+    point[0] = 0x04;
+    point[1] = len;
+    template[5].ulValueLen = len + 2;
+
+    return funcs->C_CreateObject(session, template,
+                                 sizeof(template) / sizeof(CK_ATTRIBUTE),
+                                 handle);
+}
+
+/* Signs msg with OpenSSL, ECDSA signatures are returned as r || s */
+static int openssl_sign(EVP_PKEY *pkey, int pss, CK_BYTE *sig,
+                        CK_ULONG *sig_len)
+{
+    EVP_MD_CTX *ctx;
+    EVP_PKEY_CTX *pctx;
+    ECDSA_SIG *ecsig;
+    const BIGNUM *r, *s;
+    const unsigned char *p;
+    unsigned char der[256];
+    size_t len = sizeof(der);
+    int ok;
+
+    ctx = EVP_MD_CTX_new();
+    if (ctx == NULL)
+        return 0;
+
+    ok = EVP_DigestSignInit(ctx, &pctx, EVP_sha256(), NULL, pkey) == 1 &&
+         (!pss ||
+          (EVP_PKEY_CTX_set_rsa_padding(pctx, RSA_PKCS1_PSS_PADDING) == 1 &&
+           EVP_PKEY_CTX_set_rsa_pss_saltlen(pctx, 32) == 1 &&
+           EVP_PKEY_CTX_set_rsa_mgf1_md(pctx, EVP_sha256()) == 1)) &&
+         EVP_DigestSign(ctx, der, &len, msg, sizeof(msg)) == 1;
+    EVP_MD_CTX_free(ctx);
+    if (!ok)
+        return 0;
+
+    if (EVP_PKEY_id(pkey) == EVP_PKEY_RSA) {
+        if (len > *sig_len)
+            return 0;
+        memcpy(sig, der, len);
+        *sig_len = len;
+        return 1;
+    }
+
+    p = der;
+    ecsig = d2i_ECDSA_SIG(NULL, &p, len);
+    if (ecsig == NULL)
+        return 0;
+    ECDSA_SIG_get0(ecsig, &r, &s);
+    ok = *sig_len >= 64 && BN_bn2binpad(r, sig, 32) == 32 &&
+         BN_bn2binpad(s, sig + 32, 32) == 32;
+    ECDSA_SIG_free(ecsig);
+    *sig_len = 64;
+
+    return ok;
+}
+
+static CK_RV verify(CK_SESSION_HANDLE session, CK_MECHANISM *mech,
+                    CK_OBJECT_HANDLE key, CK_BYTE *data, CK_ULONG data_len,
+                    CK_BYTE *sig, CK_ULONG sig_len)
+{
+    CK_RV rc;
+
+    rc = funcs->C_VerifyInit(session, mech, key);
+    if (rc != CKR_OK)
+        return rc;
+
+    return funcs->C_Verify(session, data, data_len, sig, sig_len);
+}
+
+/*
+ * The mechanisms without hashing are used, the digest of the hashing
+ * mechanisms is not a public key operation.
+ */
+static CK_RV local_verify_test(const char *tstr, int type,
+                               CK_MECHANISM *mech)
+{
+    CK_FLAGS flags;
+    CK_SESSION_HANDLE session = CK_INVALID_HANDLE;
+    CK_BYTE user_pin[PKCS11_MAX_PIN_LEN];
+    CK_ULONG user_pin_len;
+    CK_OBJECT_HANDLE key;
+    CK_BYTE sig[512];
+    CK_ULONG sig_len = sizeof(sig);
+    CK_BYTE data[sizeof(sha256_digest_info) + 32], *hash;
+    CK_ULONG data_len;
+    unsigned long requests;
+    EVP_PKEY *pkey = NULL;
+    CK_RV rc = CKR_OK;
+
+    testcase_begin("%s", tstr);
+
+    /* CKM_RSA_PKCS verifies the DigestInfo, the others the hash only */
+    if (mech->mechanism == CKM_RSA_PKCS) {
+        memcpy(data, sha256_digest_info, sizeof(sha256_digest_info));
+        hash = data + sizeof(sha256_digest_info);
+        data_len = sizeof(data);
+    } else {
+        hash = data;
+        data_len = 32;
+    }
+    if (EVP_Digest(msg, sizeof(msg), hash, NULL, EVP_sha256(), NULL) != 1) {
+        testcase_error("OpenSSL digest failed");
+        return CKR_FUNCTION_FAILED;
+    }
+
+    testcase_rw_session();
+    testcase_user_login();
+
+    pkey = generate_pkey(type);
+    if (pkey == NULL) {
+        testcase_error("OpenSSL key generation failed");
+        rc = CKR_FUNCTION_FAILED;
+        goto testcase_cleanup;
+    }
+
+    rc = type == EVP_PKEY_RSA ? create_rsa_public_key(session, pkey, &key) :
+                                create_ec_public_key(session, pkey, &key);
+    if (rc != CKR_OK) {
+        testcase_error("C_CreateObject() rc=%s", p11_get_ckr(rc));
+        goto testcase_cleanup;
+    }
+
+    if (!openssl_sign(pkey, mech->mechanism == CKM_RSA_PKCS_PSS,
+                      sig, &sig_len)) {
+        testcase_error("OpenSSL signing failed");
+        rc = CKR_FUNCTION_FAILED;
+        goto testcase_cleanup;
+    }
+
+    testcase_new_assertion();
+
+    requests = stub_total_requests();
+
+    rc = verify(session, mech, key, data, data_len, sig, sig_len);
+    if (rc != CKR_OK) {
+        testcase_fail("OpenSSL signature did not verify, rc=%s",
+                      p11_get_ckr(rc));
+        goto testcase_cleanup;
+    }
+
+    sig[sig_len / 2] ^= 0x01;
+    rc = verify(session, mech, key, data, data_len, sig, sig_len);
+    if (rc != CKR_SIGNATURE_INVALID) {
+        testcase_fail("modified signature verified, rc=%s", p11_get_ckr(rc));
+        rc = CKR_FUNCTION_FAILED;
+        goto testcase_cleanup;
+    }
+    rc = CKR_OK;
+
+    if (stub_total_requests() != requests) {
+        testcase_fail("%lu requests were sent to the adapter",
+                      stub_total_requests() - requests);
+        goto testcase_cleanup;
+    }
+
+    testcase_pass("%s: ok", tstr);
+
+testcase_cleanup:
+    EVP_PKEY_free(pkey);
+    testcase_user_logout();
+    testcase_close_session();
+    return rc;
+}
+
+static CK_RV local_rsa_encrypt_test(void)
+{
+    const char *tstr = "RSA PKCS encrypt with a public key object";
+    CK_FLAGS flags;
+    CK_SESSION_HANDLE session = CK_INVALID_HANDLE;
+    CK_BYTE user_pin[PKCS11_MAX_PIN_LEN];
+    CK_ULONG user_pin_len;
+    CK_MECHANISM mech = { CKM_RSA_PKCS, NULL, 0 };
+    CK_OBJECT_HANDLE key;
+    CK_BYTE cipher[512], plain[512];
+    CK_ULONG cipher_len = sizeof(cipher);
+    size_t plain_len = sizeof(plain);
+    unsigned long requests;
+    EVP_PKEY_CTX *ctx = NULL;
+    EVP_PKEY *pkey = NULL;
+    CK_RV rc = CKR_OK;
+
+    testcase_begin("%s", tstr);
+
+    testcase_rw_session();
+    testcase_user_login();
+
+    pkey = generate_pkey(EVP_PKEY_RSA);
+    if (pkey == NULL) {
+        testcase_error("OpenSSL key generation failed");
+        rc = CKR_FUNCTION_FAILED;
+        goto testcase_cleanup;
+    }
+
+    rc = create_rsa_public_key(session, pkey, &key);
+    if (rc != CKR_OK) {
+        testcase_error("C_CreateObject() rc=%s", p11_get_ckr(rc));
+        goto testcase_cleanup;
+    }
+
+    testcase_new_assertion();
+
+    requests = stub_total_requests();
+
+    rc = funcs->C_EncryptInit(session, &mech, key);
+    if (rc != CKR_OK) {
+        testcase_fail("C_EncryptInit() rc=%s", p11_get_ckr(rc));
+        goto testcase_cleanup;
+    }
+    rc = funcs->C_Encrypt(session, msg, sizeof(msg), cipher, &cipher_len);
+    if (rc != CKR_OK) {
+        testcase_fail("C_Encrypt() rc=%s", p11_get_ckr(rc));
+        goto testcase_cleanup;
+    }
+
+    if (stub_total_requests() != requests) {
+        testcase_fail("%lu requests were sent to the adapter",
+                      stub_total_requests() - requests);
+        goto testcase_cleanup;
+    }
+
+    ctx = EVP_PKEY_CTX_new(pkey, NULL);
+    if (ctx == NULL ||
+        EVP_PKEY_decrypt_init(ctx) != 1 ||
+        EVP_PKEY_CTX_set_rsa_padding(ctx, RSA_PKCS1_PADDING) != 1 ||
+        EVP_PKEY_decrypt(ctx, plain, &plain_len, cipher, cipher_len) != 1) {
+        testcase_fail("OpenSSL could not decrypt the encrypted data");
+        goto testcase_cleanup;
+    }
+
+    if (plain_len != sizeof(msg) || memcmp(plain, msg, plain_len) != 0) {
+        testcase_fail("decrypted data does not match the plain text");
+        goto testcase_cleanup;
+    }
+
+    testcase_pass("%s: ok", tstr);
+
+testcase_cleanup:
+    EVP_PKEY_CTX_free(ctx);
+    EVP_PKEY_free(pkey);
+    testcase_user_logout();
+    testcase_close_session();
+    return rc;
+}
+
+static CK_RV local_pubkey_tests(void)
+{
+    CK_MECHANISM rsa_pkcs = { CKM_RSA_PKCS, NULL, 0 };
+    CK_RSA_PKCS_PSS_PARAMS pss_params = { CKM_SHA256, CKG_MGF1_SHA256, 32 };
+    CK_MECHANISM rsa_pss = { CKM_RSA_PKCS_PSS, &pss_params,
+                             sizeof(pss_params) };
+    CK_MECHANISM ecdsa = { CKM_ECDSA, NULL, 0 };
+    CK_RV rc, rv = CKR_OK;
+
+    testsuite_begin("EP11 local public key operations");
+
+    if (!is_ep11_token(SLOT_ID)) {
+        testsuite_skip(4, "this slot is not an EP11 token");
+        return CKR_OK;
+    }
+
+    if (!find_ep11stub()) {
+        testsuite_skip(4, "the EP11 token does not use " EP11STUB_NAME);
+        return CKR_OK;
+    }
+
+    rc = local_verify_test("RSA PKCS verify with a public key object",
+                           EVP_PKEY_RSA, &rsa_pkcs);
+    if (rc != CKR_OK && rv == CKR_OK)
+        rv = rc;
+
+    rc = local_verify_test("RSA PSS verify with a public key object",
+                           EVP_PKEY_RSA, &rsa_pss);
+    if (rc != CKR_OK && rv == CKR_OK)
+        rv = rc;
+
+    rc = local_verify_test("ECDSA verify with a public key object",
+                           EVP_PKEY_EC, &ecdsa);
+    if (rc != CKR_OK && rv == CKR_OK)
+        rv = rc;
+
+    rc = local_rsa_encrypt_test();
+    if (rc != CKR_OK && rv == CKR_OK)
+        rv = rc;
+
+    return rv;
+}
+
+int main(int argc, char **argv)
+{
+    CK_C_INITIALIZE_ARGS cinit_args;
+    int rc;
+    CK_RV rv;
+
+    rc = do_ParseArgs(argc, argv);
+    if (rc != 1)
+        return rc;
+
+    printf("Using slot #%lu...\n", SLOT_ID);
+
+    rc = do_GetFunctionList();
+    if (!rc) {
+        testcase_error("do_getFunctionList(), rc=%s", p11_get_ckr(rc));
+        return rc;
+    }
+
+    memset(&cinit_args, 0x0, sizeof(cinit_args));
+    cinit_args.flags = CKF_OS_LOCKING_OK;
+
+    funcs->C_Initialize(&cinit_args);
+
+    testcase_setup();
+    rv = local_pubkey_tests();
+    testcase_print_result();
+
+    funcs->C_Finalize(NULL);
+
+    return testcase_return(rv);
+}
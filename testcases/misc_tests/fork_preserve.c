@@ -0,0 +1,271 @@
+/*
+ * COPYRIGHT (c) International Business Machines Corp. 2024
+ *
+ * This program is provided under the terms of the Common Public License,
+ * version 1.0 (CPL-1.0). Any use, reproduction or distribution for this
+ * software constitutes recipient's acceptance of CPL-1.0 terms which can be
+ * found in the file LICENSE file or at
+ * https://opensource.org/licenses/cpl1.0.php
+ */
+
+/* File: fork_preserve.c
+ *
+ * Test of a forked child that keeps the token state of its parent. This
+ * requires the 'fork-preserve-state' keyword in opencryptoki.conf, the test
+ * is skipped otherwise.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <memory.h>
+#include <unistd.h>
+
+#include <dlfcn.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "pkcs11types.h"
+#include "regress.h"
+#include "common.c"
+
+CK_BYTE user_pin[128];
+CK_ULONG user_pin_len;
+CK_SLOT_ID slot_id = 0;
+
+static CK_BYTE clear[16] = "fork preserve!!";
+
+static CK_RV encrypt_block(CK_SESSION_HANDLE session, CK_OBJECT_HANDLE key,
+                           CK_BYTE *cipher, CK_ULONG *cipher_len)
+{
+    CK_MECHANISM mech = { CKM_AES_ECB, NULL, 0 };
+    CK_RV rv;
+
+    rv = funcs->C_EncryptInit(session, &mech, key);
+    if (rv != CKR_OK)
+        return rv;
+
+    return funcs->C_Encrypt(session, clear, sizeof(clear), cipher, cipher_len);
+}
+
+static int do_fork(CK_SESSION_HANDLE parent_session,
+                   CK_OBJECT_HANDLE parent_key,
+                   CK_BYTE *parent_cipher, CK_ULONG parent_cipher_len)
+{
+    pid_t child_pid;
+    int status = 1;
+    CK_SESSION_INFO info;
+    CK_SESSION_HANDLE session;
+    CK_BYTE cipher[sizeof(clear)];
+    CK_ULONG cipher_len = sizeof(cipher);
+    CK_RV rv;
+
+    child_pid = fork();
+    if (child_pid != 0) {
+        // parent process: wait until child exits
+        waitpid(child_pid, &status, 0);
+        return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+    }
+
+    // child process flows here
+    testcase_setup();
+    t_ran = 0;
+    t_passed = 0;
+    t_skipped = 0;
+    t_failed = 0;
+    testcase_begin(".. in client process: %u", getpid());
+
+    rv = funcs->C_GetSessionInfo(parent_session, &info);
+    if (rv == CKR_CRYPTOKI_NOT_INITIALIZED) {
+        testcase_skip("fork-preserve-state is not configured");
+        rv = CKR_OK;
+        goto out;
+    }
+
+    // The parent session is still logged in
+    testcase_new_assertion();
+    if (rv != CKR_OK) {
+        testcase_fail("C_GetSessionInfo (client) rc = %s", p11_get_ckr(rv));
+        goto out;
+    }
+    if (info.state != CKS_RW_USER_FUNCTIONS) {
+        testcase_fail("Parent session state is %lu in client, expected "
+                      "CKS_RW_USER_FUNCTIONS", info.state);
+        rv = CKR_FUNCTION_FAILED;
+        goto finalize;
+    }
+    testcase_pass("Parent session kept its login (client)");
+
+    // The session key of the parent can be used
+    testcase_new_assertion();
+    rv = encrypt_block(parent_session, parent_key, cipher, &cipher_len);
+    if (rv != CKR_OK) {
+        testcase_fail("Encrypt with parent key (client) rc = %s",
+                      p11_get_ckr(rv));
+        goto finalize;
+    }
+    if (cipher_len != parent_cipher_len ||
+        memcmp(cipher, parent_cipher, cipher_len) != 0) {
+        testcase_fail("Encrypt with parent key (client): cipher text differs");
+        rv = CKR_FUNCTION_FAILED;
+        goto finalize;
+    }
+    testcase_pass("Encrypt with parent key (client)");
+
+    // New sessions can be opened
+    testcase_new_assertion();
+    rv = funcs->C_OpenSession(slot_id, CKF_SERIAL_SESSION | CKF_RW_SESSION,
+                              NULL, NULL, &session);
+    if (rv != CKR_OK) {
+        testcase_fail("C_OpenSession (client) rc = %s", p11_get_ckr(rv));
+        goto finalize;
+    }
+    rv = funcs->C_CloseSession(session);
+    if (rv != CKR_OK) {
+        testcase_fail("C_CloseSession (client) rc = %s", p11_get_ckr(rv));
+        goto finalize;
+    }
+    testcase_pass("C_OpenSession/C_CloseSession (client)");
+
+finalize:
+    if (funcs->C_Finalize(NULL) != CKR_OK) {
+        testcase_fail("C_Finalize (client)");
+        rv = CKR_FUNCTION_FAILED;
+    }
+out:
+    testcase_print_result();
+    exit(testcase_return(rv));
+}
+
+int main(int argc, char **argv)
+{
+    CK_C_INITIALIZE_ARGS cinit_args;
+    CK_MECHANISM mech = { CKM_AES_KEY_GEN, NULL, 0 };
+    CK_SESSION_INFO info;
+    CK_SESSION_HANDLE session;
+    CK_OBJECT_HANDLE key = CK_INVALID_HANDLE;
+    CK_BYTE cipher[sizeof(clear)], cipher2[sizeof(clear)];
+    CK_ULONG cipher_len = sizeof(cipher), cipher2_len = sizeof(cipher2);
+    int i, ret = 1;
+    CK_RV rv;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-slot") == 0) {
+            ++i;
+            if (i >= argc) {
+                printf("Slot number missing\n");
+                return -1;
+            }
+            slot_id = atoi(argv[i]);
+        }
+
+        if (strcmp(argv[i], "-h") == 0) {
+            printf("usage:  %s [-slot <num>] [-h]\n\n", argv[0]);
+            printf("By default, Slot #1 is used\n\n");
+            return -1;
+        }
+    }
+
+    if (get_user_pin(user_pin))
+        return CKR_FUNCTION_FAILED;
+    user_pin_len = (CK_ULONG) strlen((char *) user_pin);
+
+    printf("Using slot #%lu...\n\n", slot_id);
+
+    rv = do_GetFunctionList();
+    if (rv != TRUE) {
+        testcase_fail("do_GetFunctionList() rc = %s", p11_get_ckr(rv));
+        goto out;
+    }
+
+    testcase_setup();
+    testcase_begin("Starting...  Parent process: %u", getpid());
+
+    memset(&cinit_args, 0x0, sizeof(cinit_args));
+    cinit_args.flags = CKF_OS_LOCKING_OK;
+
+    if ((rv = funcs->C_Initialize(&cinit_args))) {
+        testcase_fail("C_Initialize (parent) rc = %s", p11_get_ckr(rv));
+        goto out;
+    }
+
+    if (!mech_supported(slot_id, CKM_AES_KEY_GEN) ||
+        !mech_supported(slot_id, CKM_AES_ECB)) {
+        testcase_skip("Slot %u doesn't support CKM_AES_KEY_GEN and "
+                      "CKM_AES_ECB", (unsigned int) slot_id);
+        ret = 0;
+        goto finalize;
+    }
+
+    rv = funcs->C_OpenSession(slot_id, CKF_SERIAL_SESSION | CKF_RW_SESSION,
+                              NULL, NULL, &session);
+    if (rv != CKR_OK) {
+        testcase_fail("C_OpenSession (parent) rc = %s", p11_get_ckr(rv));
+        goto finalize;
+    }
+
+    rv = funcs->C_Login(session, CKU_USER, user_pin, user_pin_len);
+    if (rv != CKR_OK) {
+        testcase_fail("C_Login (parent) rc = %s", p11_get_ckr(rv));
+        goto close_session;
+    }
+
+    rv = generate_AESKey(session, 16, TRUE, &mech, &key);
+    if (rv != CKR_OK) {
+        if (rv == CKR_POLICY_VIOLATION) {
+            testcase_skip("AES key generation is not allowed by policy");
+            ret = 0;
+        }
+        goto close_session;
+    }
+
+    rv = encrypt_block(session, key, cipher, &cipher_len);
+    if (rv != CKR_OK) {
+        testcase_fail("Encrypt (parent) rc = %s", p11_get_ckr(rv));
+        goto close_session;
+    }
+
+    testcase_new_assertion();
+    if (do_fork(session, key, cipher, cipher_len) != 0) {
+        testcase_fail("do_fork() with session and key");
+        goto close_session;
+    }
+    testcase_pass("do_fork() with session and key");
+
+    // The child did not change the state of the parent
+    testcase_new_assertion();
+    rv = funcs->C_GetSessionInfo(session, &info);
+    if (rv != CKR_OK || info.state != CKS_RW_USER_FUNCTIONS) {
+        testcase_fail("C_GetSessionInfo (parent) after fork rc = %s, "
+                      "state = %lu", p11_get_ckr(rv), info.state);
+        goto close_session;
+    }
+    rv = encrypt_block(session, key, cipher2, &cipher2_len);
+    if (rv != CKR_OK || cipher2_len != cipher_len ||
+        memcmp(cipher2, cipher, cipher_len) != 0) {
+        testcase_fail("Encrypt (parent) after fork rc = %s",
+                      p11_get_ckr(rv));
+        goto close_session;
+    }
+    testcase_pass("Parent session and key unchanged after fork");
+
+    ret = 0;
+
+close_session:
+    if (key != CK_INVALID_HANDLE)
+        funcs->C_DestroyObject(session, key);
+    rv = funcs->C_CloseSession(session);
+    if (rv != CKR_OK) {
+        testcase_fail("C_CloseSession (parent) rc = %s", p11_get_ckr(rv));
+        ret = 1;
+    }
+finalize:
+    rv = funcs->C_Finalize(NULL);
+    if (rv != CKR_OK) {
+        testcase_fail("C_Finalize (parent) rc = %s", p11_get_ckr(rv));
+        ret = 1;
+    }
+out:
+    testcase_print_result();
+    return testcase_return(ret);
+}
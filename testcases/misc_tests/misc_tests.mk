@@ -8,6 +8,9 @@ noinst_PROGRAMS +=							\
 	testcases/misc_tests/obj_lock testcases/misc_tests/tok2tok_transport \
 	testcases/misc_tests/obj_lock testcases/misc_tests/reencrypt    \
 	testcases/misc_tests/cca_export_import_test			\
+	testcases/misc_tests/ep11_local_pubkey_test			\
+	testcases/misc_tests/ep11_dispatch_test				\
+	testcases/misc_tests/fork_preserve				\
 	testcases/misc_tests/events
 
 testcases_misc_tests_obj_mgmt_tests_CFLAGS = ${testcases_inc}
@@ -49,6 +52,11 @@ testcases_misc_tests_fork_CFLAGS = ${testcases_inc}
 testcases_misc_tests_fork_LDADD = testcases/common/libcommon.la
 testcases_misc_tests_fork_SOURCES = testcases/misc_tests/fork.c
 
+testcases_misc_tests_fork_preserve_CFLAGS = ${testcases_inc}
+testcases_misc_tests_fork_preserve_LDADD = testcases/common/libcommon.la
+testcases_misc_tests_fork_preserve_SOURCES =				\
+	testcases/misc_tests/fork_preserve.c
+
 testcases_misc_tests_multi_instance_CFLAGS = ${testcases_inc}
 testcases_misc_tests_multi_instance_LDADD = testcases/common/libcommon.la
 testcases_misc_tests_multi_instance_SOURCES = 				\
@@ -75,6 +83,18 @@ testcases_misc_tests_cca_export_import_test_LDADD =			\
 testcases_misc_tests_cca_export_import_test_SOURCES =			\
 	testcases/misc_tests/cca_export_import_test.c
 	
+testcases_misc_tests_ep11_local_pubkey_test_CFLAGS = ${testcases_inc}
+testcases_misc_tests_ep11_local_pubkey_test_LDADD =			\
+	testcases/common/libcommon.la -lcrypto -ldl
+testcases_misc_tests_ep11_local_pubkey_test_SOURCES =			\
+	testcases/misc_tests/ep11_local_pubkey_test.c
+
+testcases_misc_tests_ep11_dispatch_test_CFLAGS = ${testcases_inc}
+testcases_misc_tests_ep11_dispatch_test_LDADD =				\
+	testcases/common/libcommon.la -ldl -lpthread
+testcases_misc_tests_ep11_dispatch_test_SOURCES =			\
+	testcases/misc_tests/ep11_dispatch_test.c
+
 testcases_misc_tests_events_CFLAGS = ${testcases_inc}
 testcases_misc_tests_events_LDADD = testcases/common/libcommon.la
 testcases_misc_tests_events_SOURCES = testcases/misc_tests/events.c	\
@@ -18,6 +18,10 @@
  *    DES3 encrypt and decrypt (with modes ECB and CBC)
  *    AES encrypt and decrypt (with modes ECB and CBC, with keylength 128, 192,
  *    256), SHA1, SHA256, SHA512
+ *    Multi-part SHA256 RSA PKCS and ECDSA sign and verify of a large stream
+ *    AES-GCM records with C_EncryptInit/C_Encrypt versus C_EncryptMessage
+ *    RSA PKCS and ECDSA signatures with C_SignInit/C_Sign versus C_SignMessage
+ *    C_FindObjects for the first match and for all matches of many objects
  */
 
 
@@ -30,6 +34,7 @@
 
 #include "pkcs11types.h"
 #include "regress.h"
+#include "mech_to_str.h"
 #include "common.c"
 
 #define SHA1_HASH_LEN   20
@@ -37,6 +42,21 @@
 #define SHA512_HASH_LEN 64
 #define MAX_HASH_LEN SHA512_HASH_LEN
 
+#define STREAM_CHUNK_LEN        (64 * 1024)
+#define STREAM_DEFAULT_MB       2048
+
+#define GCM_RECORDS_DEFAULT     100000
+#define GCM_AAD_LEN             13
+#define GCM_TAG_LEN             16
+#define GCM_MAX_RECORD_LEN      16384
+
+#define SIGN_MESSAGES_DEFAULT   10000
+#define SIGN_MESSAGE_LEN        256
+
+#define FIND_OBJECTS_DEFAULT    10000
+#define FIND_ITERATIONS         1000
+#define FIND_BATCH              100
+
 
 // the GetSystemTime and SYSTEMTIME implementation
 // from regress.h only has a ms resolution
@@ -1009,11 +1029,640 @@ testcase_cleanup:
     return TRUE;
 }
 
+static int stream_sign_verify(CK_SESSION_HANDLE session, CK_MECHANISM *mech,
+                              CK_OBJECT_HANDLE publ_key,
+                              CK_OBJECT_HANDLE priv_key, CK_BYTE *chunk,
+                              CK_ULONG chunks, CK_RV *rc)
+{
+    CK_BYTE signature[512];
+    CK_ULONG i, sig_len, final_us;
+    SYSTEMTIME t1, t2, t3;
+    double mb = (double) chunks * STREAM_CHUNK_LEN / (1024 * 1024);
+
+    GetSystemTime(&t1);
+    *rc = funcs->C_SignInit(session, mech, priv_key);
+    if (*rc != CKR_OK) {
+        testcase_error("C_SignInit rc=%s", p11_get_ckr(*rc));
+        return FALSE;
+    }
+    for (i = 0; i < chunks; i++) {
+        *rc = funcs->C_SignUpdate(session, chunk, STREAM_CHUNK_LEN);
+        if (*rc != CKR_OK) {
+            testcase_error("C_SignUpdate rc=%s", p11_get_ckr(*rc));
+            return FALSE;
+        }
+    }
+    GetSystemTime(&t2);
+    sig_len = sizeof(signature);
+    *rc = funcs->C_SignFinal(session, signature, &sig_len);
+    if (*rc != CKR_OK) {
+        testcase_error("C_SignFinal rc=%s", p11_get_ckr(*rc));
+        return FALSE;
+    }
+    GetSystemTime(&t3);
+
+    final_us = delta_time_us(&t2, &t3);
+    printf("sign   %.0fMB: update=%ldms %.3fMB/s final=%ldus\n", mb,
+           delta_time_us(&t1, &t2) / 1000,
+           mb * 1000 * 1000 / (double) delta_time_us(&t1, &t2), final_us);
+
+    GetSystemTime(&t1);
+    *rc = funcs->C_VerifyInit(session, mech, publ_key);
+    if (*rc != CKR_OK) {
+        testcase_error("C_VerifyInit rc=%s", p11_get_ckr(*rc));
+        return FALSE;
+    }
+    for (i = 0; i < chunks; i++) {
+        *rc = funcs->C_VerifyUpdate(session, chunk, STREAM_CHUNK_LEN);
+        if (*rc != CKR_OK) {
+            testcase_error("C_VerifyUpdate rc=%s", p11_get_ckr(*rc));
+            return FALSE;
+        }
+    }
+    GetSystemTime(&t2);
+    *rc = funcs->C_VerifyFinal(session, signature, sig_len);
+    if (*rc != CKR_OK) {
+        testcase_error("C_VerifyFinal rc=%s", p11_get_ckr(*rc));
+        return FALSE;
+    }
+    GetSystemTime(&t3);
+
+    final_us = delta_time_us(&t2, &t3);
+    printf("verify %.0fMB: update=%ldms %.3fMB/s final=%ldus\n", mb,
+           delta_time_us(&t1, &t2) / 1000,
+           mb * 1000 * 1000 / (double) delta_time_us(&t1, &t2), final_us);
+
+    return TRUE;
+}
+
+// mode: RSA ECDSA, stream_mb: total amount of data to sign in MB
+int do_Stream_SignVerify(const char *mode, CK_ULONG stream_mb)
+{
+    CK_SESSION_HANDLE session;
+    CK_MECHANISM mech, keygen_mech;
+    CK_FLAGS flags;
+    CK_BYTE user_pin[PKCS11_MAX_PIN_LEN];
+    CK_ULONG user_pin_len;
+    CK_RV rc;
+
+    CK_BYTE *chunk = NULL;
+    CK_ULONG i, chunks;
+    CK_OBJECT_HANDLE publ_key, priv_key;
+
+    CK_ULONG bits = 2048;
+    CK_BYTE pub_exp[] = { 0x01, 0x00, 0x01 };
+    CK_ATTRIBUTE rsa_tmpl[] = {
+        {CKA_MODULUS_BITS, &bits, sizeof(bits)},
+        {CKA_PUBLIC_EXPONENT, &pub_exp, sizeof(pub_exp)}
+    };
+    CK_BYTE prime256v1[] = { 0x06, 0x08, 0x2A, 0x86, 0x48, 0xCE, 0x3D, 0x03,
+                             0x01, 0x07 };
+    CK_ATTRIBUTE ec_tmpl[] = {
+        {CKA_EC_PARAMS, &prime256v1, sizeof(prime256v1)}
+    };
+    CK_ATTRIBUTE *pub_tmpl;
+    CK_ULONG pub_tmpl_len;
+
+    testcase_begin("%s SHA256 multi-part Sign/Verify with datalen=%luMB",
+                   mode, stream_mb);
+
+    mech.ulParameterLen = 0;
+    mech.pParameter = NULL;
+    keygen_mech.ulParameterLen = 0;
+    keygen_mech.pParameter = NULL;
+
+    if (strcmp(mode, "RSA") == 0) {
+        mech.mechanism = CKM_SHA256_RSA_PKCS;
+        keygen_mech.mechanism = CKM_RSA_PKCS_KEY_PAIR_GEN;
+        pub_tmpl = rsa_tmpl;
+        pub_tmpl_len = 2;
+    } else if (strcmp(mode, "ECDSA") == 0) {
+        mech.mechanism = CKM_ECDSA_SHA256;
+        keygen_mech.mechanism = CKM_EC_KEY_PAIR_GEN;
+        pub_tmpl = ec_tmpl;
+        pub_tmpl_len = 1;
+    } else {
+        testcase_error("unknown mode %s in do_Stream_SignVerify()", mode);
+        return FALSE;
+    }
+
+    if (!mech_supported(SLOT_ID, keygen_mech.mechanism)) {
+        testcase_skip("Slot %lu doesn't support %s (0x%lx)", SLOT_ID,
+                      mech_to_str(keygen_mech.mechanism),
+                      keygen_mech.mechanism);
+        return TRUE;
+    }
+    if (!mech_supported(SLOT_ID, mech.mechanism)) {
+        testcase_skip("Slot %lu doesn't support %s (0x%lx)", SLOT_ID,
+                      mech_to_str(mech.mechanism), mech.mechanism);
+        return TRUE;
+    }
+
+    testcase_new_assertion();
+
+    testcase_rw_session();
+    testcase_user_login();
+
+    rc = funcs->C_GenerateKeyPair(session, &keygen_mech, pub_tmpl,
+                                  pub_tmpl_len, NULL, 0, &publ_key, &priv_key);
+    if (rc != CKR_OK) {
+        testcase_error("C_GenerateKeyPair rc=%s", p11_get_ckr(rc));
+        goto testcase_cleanup;
+    }
+
+    chunk = malloc(STREAM_CHUNK_LEN);
+    if (chunk == NULL) {
+        testcase_error("malloc failed");
+        rc = CKR_HOST_MEMORY;
+        goto testcase_cleanup;
+    }
+    for (i = 0; i < STREAM_CHUNK_LEN; i++)
+        chunk[i] = i % 255;
+
+    chunks = stream_mb * ((1024 * 1024) / STREAM_CHUNK_LEN);
+    if (!stream_sign_verify(session, &mech, publ_key, priv_key, chunk,
+                            chunks, &rc))
+        goto testcase_cleanup;
+
+    testcase_pass("%s SHA256 multi-part Sign/Verify with datalen=%luMB",
+                  mode, stream_mb);
+
+testcase_cleanup:
+    free(chunk);
+    testcase_closeall_session();
+    if (rc != CKR_OK)
+        return FALSE;
+
+    return TRUE;
+}
+
+// record_len: bytes per record, records: number of records to encrypt
+int do_AES_GCM_Records(CK_ULONG record_len, CK_ULONG records)
+{
+    CK_SESSION_HANDLE session;
+    CK_MECHANISM mech;
+    CK_FLAGS flags;
+    CK_BYTE user_pin[PKCS11_MAX_PIN_LEN];
+    CK_ULONG user_pin_len;
+    CK_RV rc;
+
+    CK_OBJECT_HANDLE h_key;
+    CK_BYTE *original = NULL, *cipher = NULL, *clear = NULL;
+    CK_BYTE iv[12] = { 0 };
+    CK_BYTE aad[GCM_AAD_LEN] = { 0 };
+    CK_BYTE tag[GCM_TAG_LEN];
+    CK_GCM_PARAMS gcm_param = { iv, sizeof(iv), sizeof(iv) * 8,
+                                aad, sizeof(aad), GCM_TAG_LEN * 8 };
+    CK_GCM_MESSAGE_PARAMS msg_param = { iv, sizeof(iv), 0, CKG_NO_GENERATE,
+                                        tag, GCM_TAG_LEN * 8 };
+    CK_ULONG i, cipher_len, clear_len;
+    unsigned long classic_us, message_us, decrypt_us;
+    SYSTEMTIME t1, t2;
+
+    testcase_begin("AES-GCM records with reclen=%lu records=%lu",
+                   record_len, records);
+
+    if (!mech_supported(SLOT_ID, CKM_AES_KEY_GEN)) {
+        testcase_skip("Slot %lu doesn't support CKM_AES_KEY_GEN (0x%x)",
+                      SLOT_ID, CKM_AES_KEY_GEN);
+        return TRUE;
+    }
+    if (!mech_supported_flags(SLOT_ID, CKM_AES_GCM,
+                              CKF_MESSAGE_ENCRYPT | CKF_MESSAGE_DECRYPT)) {
+        testcase_skip("Slot %lu doesn't support message-based CKM_AES_GCM",
+                      SLOT_ID);
+        return TRUE;
+    }
+
+    testcase_new_assertion();
+
+    testcase_rw_session();
+    testcase_user_login();
+
+    mech.mechanism = CKM_AES_KEY_GEN;
+    mech.ulParameterLen = 0;
+    mech.pParameter = NULL;
+
+    rc = generate_AESKey(session, 32, CK_TRUE, &mech, &h_key);
+    if (rc != CKR_OK) {
+        if (rc == CKR_POLICY_VIOLATION) {
+            testcase_skip("AES key generation is not allowed by policy");
+            goto testcase_cleanup;
+        }
+        testcase_error("C_GenerateKey rc=%s", p11_get_ckr(rc));
+        goto testcase_cleanup;
+    }
+
+    original = malloc(record_len);
+    cipher = malloc(record_len + GCM_TAG_LEN);
+    clear = malloc(record_len + GCM_TAG_LEN);
+    if (original == NULL || cipher == NULL || clear == NULL) {
+        testcase_error("malloc failed");
+        rc = CKR_HOST_MEMORY;
+        goto testcase_cleanup;
+    }
+    for (i = 0; i < record_len; i++)
+        original[i] = i % 255;
+
+    /* One C_EncryptInit/C_Encrypt cycle per record */
+    mech.mechanism = CKM_AES_GCM;
+    mech.ulParameterLen = sizeof(gcm_param);
+    mech.pParameter = &gcm_param;
+
+    GetSystemTime(&t1);
+    for (i = 0; i < records; i++) {
+        iv[11] = i & 0xff;
+        aad[12] = i & 0xff;
+        rc = funcs->C_EncryptInit(session, &mech, h_key);
+        if (rc != CKR_OK) {
+            testcase_error("C_EncryptInit rc=%s", p11_get_ckr(rc));
+            goto testcase_cleanup;
+        }
+        cipher_len = record_len + GCM_TAG_LEN;
+        rc = funcs->C_Encrypt(session, original, record_len,
+                              cipher, &cipher_len);
+        if (rc != CKR_OK) {
+            testcase_error("C_Encrypt rc=%s", p11_get_ckr(rc));
+            goto testcase_cleanup;
+        }
+    }
+    GetSystemTime(&t2);
+    classic_us = delta_time_us(&t1, &t2);
+
+    /* One C_MessageEncryptInit, then only IV, AAD and tag per record */
+    mech.ulParameterLen = 0;
+    mech.pParameter = NULL;
+
+    GetSystemTime(&t1);
+    rc = funcs3->C_MessageEncryptInit(session, &mech, h_key);
+    if (rc != CKR_OK) {
+        testcase_error("C_MessageEncryptInit rc=%s", p11_get_ckr(rc));
+        goto testcase_cleanup;
+    }
+    for (i = 0; i < records; i++) {
+        iv[11] = i & 0xff;
+        aad[12] = i & 0xff;
+        cipher_len = record_len;
+        rc = funcs3->C_EncryptMessage(session, &msg_param, sizeof(msg_param),
+                                      aad, sizeof(aad), original, record_len,
+                                      cipher, &cipher_len);
+        if (rc != CKR_OK) {
+            testcase_error("C_EncryptMessage rc=%s", p11_get_ckr(rc));
+            goto testcase_cleanup;
+        }
+    }
+    rc = funcs3->C_MessageEncryptFinal(session);
+    if (rc != CKR_OK) {
+        testcase_error("C_MessageEncryptFinal rc=%s", p11_get_ckr(rc));
+        goto testcase_cleanup;
+    }
+    GetSystemTime(&t2);
+    message_us = delta_time_us(&t1, &t2);
+
+    /* Decrypt the last record repeatedly with the message API */
+    GetSystemTime(&t1);
+    rc = funcs3->C_MessageDecryptInit(session, &mech, h_key);
+    if (rc != CKR_OK) {
+        testcase_error("C_MessageDecryptInit rc=%s", p11_get_ckr(rc));
+        goto testcase_cleanup;
+    }
+    for (i = 0; i < records; i++) {
+        clear_len = record_len;
+        rc = funcs3->C_DecryptMessage(session, &msg_param, sizeof(msg_param),
+                                      aad, sizeof(aad), cipher, cipher_len,
+                                      clear, &clear_len);
+        if (rc != CKR_OK) {
+            testcase_error("C_DecryptMessage rc=%s", p11_get_ckr(rc));
+            goto testcase_cleanup;
+        }
+    }
+    rc = funcs3->C_MessageDecryptFinal(session);
+    if (rc != CKR_OK) {
+        testcase_error("C_MessageDecryptFinal rc=%s", p11_get_ckr(rc));
+        goto testcase_cleanup;
+    }
+    GetSystemTime(&t2);
+    decrypt_us = delta_time_us(&t1, &t2);
+
+    if (clear_len != record_len || memcmp(clear, original, record_len) != 0) {
+        testcase_fail("decrypted record does not match the original");
+        goto testcase_cleanup;
+    }
+
+    printf("C_EncryptInit+C_Encrypt: %.0f records/s %.3fMB/s\n",
+           (double) records * 1000 * 1000 / classic_us,
+           (double) records * record_len / classic_us);
+    printf("C_EncryptMessage:        %.0f records/s %.3fMB/s (%.2fx)\n",
+           (double) records * 1000 * 1000 / message_us,
+           (double) records * record_len / message_us,
+           (double) classic_us / message_us);
+    printf("C_DecryptMessage:        %.0f records/s %.3fMB/s\n",
+           (double) records * 1000 * 1000 / decrypt_us,
+           (double) records * record_len / decrypt_us);
+
+    testcase_pass("AES-GCM records with reclen=%lu records=%lu",
+                  record_len, records);
+
+testcase_cleanup:
+    free(original);
+    free(cipher);
+    free(clear);
+    testcase_closeall_session();
+    if (rc != CKR_OK)
+        return FALSE;
+
+    return TRUE;
+}
+
+// messages: number of messages to sign and verify
+int do_Message_SignVerify(const char *mode, CK_ULONG messages)
+{
+    CK_SESSION_HANDLE session;
+    CK_MECHANISM mech, keygen_mech;
+    CK_FLAGS flags;
+    CK_BYTE user_pin[PKCS11_MAX_PIN_LEN];
+    CK_ULONG user_pin_len;
+    CK_RV rc;
+
+    CK_BYTE data[SIGN_MESSAGE_LEN];
+    CK_BYTE signature[512];
+    CK_ULONG i, sig_len;
+    CK_OBJECT_HANDLE publ_key, priv_key;
+    unsigned long classic_us, message_us, verify_us;
+    SYSTEMTIME t1, t2;
+
+    CK_ULONG bits = 2048;
+    CK_BYTE pub_exp[] = { 0x01, 0x00, 0x01 };
+    CK_ATTRIBUTE rsa_tmpl[] = {
+        {CKA_MODULUS_BITS, &bits, sizeof(bits)},
+        {CKA_PUBLIC_EXPONENT, &pub_exp, sizeof(pub_exp)}
+    };
+    CK_BYTE prime256v1[] = { 0x06, 0x08, 0x2A, 0x86, 0x48, 0xCE, 0x3D, 0x03,
+                             0x01, 0x07 };
+    CK_ATTRIBUTE ec_tmpl[] = {
+        {CKA_EC_PARAMS, &prime256v1, sizeof(prime256v1)}
+    };
+    CK_ATTRIBUTE *pub_tmpl;
+    CK_ULONG pub_tmpl_len;
+
+    testcase_begin("%s SHA256 message-based Sign/Verify with messages=%lu",
+                   mode, messages);
+
+    mech.ulParameterLen = 0;
+    mech.pParameter = NULL;
+    keygen_mech.ulParameterLen = 0;
+    keygen_mech.pParameter = NULL;
+
+    if (strcmp(mode, "RSA") == 0) {
+        mech.mechanism = CKM_SHA256_RSA_PKCS;
+        keygen_mech.mechanism = CKM_RSA_PKCS_KEY_PAIR_GEN;
+        pub_tmpl = rsa_tmpl;
+        pub_tmpl_len = 2;
+    } else if (strcmp(mode, "ECDSA") == 0) {
+        mech.mechanism = CKM_ECDSA_SHA256;
+        keygen_mech.mechanism = CKM_EC_KEY_PAIR_GEN;
+        pub_tmpl = ec_tmpl;
+        pub_tmpl_len = 1;
+    } else {
+        testcase_error("unknown mode %s in do_Message_SignVerify()", mode);
+        return FALSE;
+    }
+
+    if (!mech_supported(SLOT_ID, keygen_mech.mechanism)) {
+        testcase_skip("Slot %lu doesn't support %s (0x%lx)", SLOT_ID,
+                      mech_to_str(keygen_mech.mechanism),
+                      keygen_mech.mechanism);
+        return TRUE;
+    }
+    if (!mech_supported_flags(SLOT_ID, mech.mechanism,
+                              CKF_MESSAGE_SIGN | CKF_MESSAGE_VERIFY)) {
+        testcase_skip("Slot %lu doesn't support message-based %s (0x%lx)",
+                      SLOT_ID, mech_to_str(mech.mechanism), mech.mechanism);
+        return TRUE;
+    }
+
+    testcase_new_assertion();
+
+    testcase_rw_session();
+    testcase_user_login();
+
+    rc = funcs->C_GenerateKeyPair(session, &keygen_mech, pub_tmpl,
+                                  pub_tmpl_len, NULL, 0, &publ_key, &priv_key);
+    if (rc != CKR_OK) {
+        testcase_error("C_GenerateKeyPair rc=%s", p11_get_ckr(rc));
+        goto testcase_cleanup;
+    }
+
+    for (i = 0; i < sizeof(data); i++)
+        data[i] = i % 255;
+
+    /* One C_SignInit/C_Sign cycle per message */
+    GetSystemTime(&t1);
+    for (i = 0; i < messages; i++) {
+        data[0] = i & 0xff;
+        rc = funcs->C_SignInit(session, &mech, priv_key);
+        if (rc != CKR_OK) {
+            testcase_error("C_SignInit rc=%s", p11_get_ckr(rc));
+            goto testcase_cleanup;
+        }
+        sig_len = sizeof(signature);
+        rc = funcs->C_Sign(session, data, sizeof(data), signature, &sig_len);
+        if (rc != CKR_OK) {
+            testcase_error("C_Sign rc=%s", p11_get_ckr(rc));
+            goto testcase_cleanup;
+        }
+    }
+    GetSystemTime(&t2);
+    classic_us = delta_time_us(&t1, &t2);
+
+    /* One C_MessageSignInit for all messages */
+    GetSystemTime(&t1);
+    rc = funcs3->C_MessageSignInit(session, &mech, priv_key);
+    if (rc != CKR_OK) {
+        testcase_error("C_MessageSignInit rc=%s", p11_get_ckr(rc));
+        goto testcase_cleanup;
+    }
+    for (i = 0; i < messages; i++) {
+        data[0] = i & 0xff;
+        sig_len = sizeof(signature);
+        rc = funcs3->C_SignMessage(session, NULL, 0, data, sizeof(data),
+                                   signature, &sig_len);
+        if (rc != CKR_OK) {
+            testcase_error("C_SignMessage rc=%s", p11_get_ckr(rc));
+            goto testcase_cleanup;
+        }
+    }
+    rc = funcs3->C_MessageSignFinal(session);
+    if (rc != CKR_OK) {
+        testcase_error("C_MessageSignFinal rc=%s", p11_get_ckr(rc));
+        goto testcase_cleanup;
+    }
+    GetSystemTime(&t2);
+    message_us = delta_time_us(&t1, &t2);
+
+    /* Verify the last signature repeatedly with the message API */
+    GetSystemTime(&t1);
+    rc = funcs3->C_MessageVerifyInit(session, &mech, publ_key);
+    if (rc != CKR_OK) {
+        testcase_error("C_MessageVerifyInit rc=%s", p11_get_ckr(rc));
+        goto testcase_cleanup;
+    }
+    for (i = 0; i < messages; i++) {
+        rc = funcs3->C_VerifyMessage(session, NULL, 0, data, sizeof(data),
+                                     signature, sig_len);
+        if (rc != CKR_OK) {
+            testcase_fail("C_VerifyMessage rc=%s", p11_get_ckr(rc));
+            goto testcase_cleanup;
+        }
+    }
+    rc = funcs3->C_MessageVerifyFinal(session);
+    if (rc != CKR_OK) {
+        testcase_error("C_MessageVerifyFinal rc=%s", p11_get_ckr(rc));
+        goto testcase_cleanup;
+    }
+    GetSystemTime(&t2);
+    verify_us = delta_time_us(&t1, &t2);
+
+    printf("C_SignInit+C_Sign: %.0f signatures/s\n",
+           (double) messages * 1000 * 1000 / classic_us);
+    printf("C_SignMessage:     %.0f signatures/s (%.2fx)\n",
+           (double) messages * 1000 * 1000 / message_us,
+           (double) classic_us / message_us);
+    printf("C_VerifyMessage:   %.0f verifications/s\n",
+           (double) messages * 1000 * 1000 / verify_us);
+
+    testcase_pass("%s SHA256 message-based Sign/Verify with messages=%lu",
+                  mode, messages);
+
+testcase_cleanup:
+    testcase_closeall_session();
+    if (rc != CKR_OK)
+        return FALSE;
+
+    return TRUE;
+}
+
+// objects: number of session objects to search through
+int do_FindObjects(CK_ULONG objects)
+{
+    CK_SESSION_HANDLE session;
+    CK_FLAGS flags;
+    CK_BYTE user_pin[PKCS11_MAX_PIN_LEN];
+    CK_ULONG user_pin_len;
+    CK_RV rc;
+
+    CK_OBJECT_CLASS class = CKO_DATA;
+    CK_BBOOL false = FALSE;
+    CK_BYTE label[] = "speed find";
+    CK_BYTE value[16];
+    CK_ATTRIBUTE tmpl[] = {
+        {CKA_CLASS, &class, sizeof(class)},
+        {CKA_TOKEN, &false, sizeof(false)},
+        {CKA_LABEL, label, sizeof(label) - 1},
+        {CKA_VALUE, value, sizeof(value)}
+    };
+    CK_OBJECT_HANDLE handles[FIND_BATCH], h_obj;
+    CK_ULONG i, count, found;
+    unsigned long first_us, all_us;
+    SYSTEMTIME t1, t2;
+
+    testcase_begin("C_FindObjects with objects=%lu", objects);
+    testcase_new_assertion();
+
+    testcase_rw_session();
+    testcase_user_login();
+
+    memset(value, 0, sizeof(value));
+    for (i = 0; i < objects; i++) {
+        memcpy(value, &i, sizeof(i));
+        rc = funcs->C_CreateObject(session, tmpl, 4, &h_obj);
+        if (rc != CKR_OK) {
+            testcase_error("C_CreateObject rc=%s", p11_get_ckr(rc));
+            goto testcase_cleanup;
+        }
+    }
+
+    /* Applications that only want one object */
+    GetSystemTime(&t1);
+    for (i = 0; i < FIND_ITERATIONS; i++) {
+        rc = funcs->C_FindObjectsInit(session, tmpl, 3);
+        if (rc != CKR_OK) {
+            testcase_error("C_FindObjectsInit rc=%s", p11_get_ckr(rc));
+            goto testcase_cleanup;
+        }
+        rc = funcs->C_FindObjects(session, handles, 1, &count);
+        if (rc != CKR_OK) {
+            testcase_error("C_FindObjects rc=%s", p11_get_ckr(rc));
+            goto testcase_cleanup;
+        }
+        rc = funcs->C_FindObjectsFinal(session);
+        if (rc != CKR_OK) {
+            testcase_error("C_FindObjectsFinal rc=%s", p11_get_ckr(rc));
+            goto testcase_cleanup;
+        }
+        if (count != 1) {
+            testcase_fail("C_FindObjects found %lu objects, expected 1",
+                          count);
+            goto testcase_cleanup;
+        }
+    }
+    GetSystemTime(&t2);
+    first_us = delta_time_us(&t1, &t2);
+
+    /* Applications that want all objects */
+    GetSystemTime(&t1);
+    rc = funcs->C_FindObjectsInit(session, tmpl, 3);
+    if (rc != CKR_OK) {
+        testcase_error("C_FindObjectsInit rc=%s", p11_get_ckr(rc));
+        goto testcase_cleanup;
+    }
+    found = 0;
+    do {
+        rc = funcs->C_FindObjects(session, handles, FIND_BATCH, &count);
+        if (rc != CKR_OK) {
+            testcase_error("C_FindObjects rc=%s", p11_get_ckr(rc));
+            goto testcase_cleanup;
+        }
+        found += count;
+    } while (count > 0);
+    rc = funcs->C_FindObjectsFinal(session);
+    if (rc != CKR_OK) {
+        testcase_error("C_FindObjectsFinal rc=%s", p11_get_ckr(rc));
+        goto testcase_cleanup;
+    }
+    GetSystemTime(&t2);
+    all_us = delta_time_us(&t1, &t2);
+
+    if (found != objects) {
+        testcase_fail("C_FindObjects found %lu objects, expected %lu",
+                      found, objects);
+        goto testcase_cleanup;
+    }
+
+    printf("First match: %.1fus per search\n",
+           (double) first_us / FIND_ITERATIONS);
+    printf("All matches: %.3fms for %lu objects\n",
+           (double) all_us / 1000, found);
+
+    testcase_pass("C_FindObjects with objects=%lu", objects);
+
+testcase_cleanup:
+    testcase_closeall_session();
+    if (rc != CKR_OK)
+        return FALSE;
+
+    return TRUE;
+}
+
 void speed_usage(char *fct)
 {
     printf("usage:  %s -slot <num>", fct);
     printf(" [-rsa_keygen] [-rsa_signverify]");
     printf(" [-rsa_endecrypt] [-des3] [-aes] [-sha]");
+    printf(" [-stream_signverify [-stream_mb <MB>]]");
+    printf(" [-gcm_records [-records <num>]]");
+    printf(" [-msg_signverify [-messages <num>]]");
+    printf(" [-find [-objects <num>]]");
     printf(" [-h] \n\n");
 
     return;
@@ -1029,6 +1678,14 @@ int main(int argc, char **argv)
     int do_des3_endecrypt = 0;
     int do_aes_endecrypt = 0;
     int do_sha = 0;
+    int do_stream_signverify = 0;
+    CK_ULONG stream_mb = STREAM_DEFAULT_MB;
+    int do_gcm_records = 0;
+    CK_ULONG records = GCM_RECORDS_DEFAULT;
+    int do_msg_signverify = 0;
+    CK_ULONG messages = SIGN_MESSAGES_DEFAULT;
+    int do_find = 0;
+    CK_ULONG objects = FIND_OBJECTS_DEFAULT;
 
     SLOT_ID = 1000;
 
@@ -1054,6 +1711,42 @@ int main(int argc, char **argv)
             do_aes_endecrypt = 1;
         } else if (strcmp(argv[i], "-sha") == 0) {
             do_sha = 1;
+        } else if (strcmp(argv[i], "-stream_signverify") == 0) {
+            do_stream_signverify = 1;
+        } else if (strcmp(argv[i], "-stream_mb") == 0) {
+            if (i + 1 >= argc) {
+                printf("Stream size missing\n");
+                return -1;
+            }
+            stream_mb = strtoul(argv[i + 1], NULL, 10);
+            i++;
+        } else if (strcmp(argv[i], "-gcm_records") == 0) {
+            do_gcm_records = 1;
+        } else if (strcmp(argv[i], "-records") == 0) {
+            if (i + 1 >= argc) {
+                printf("Number of records missing\n");
+                return -1;
+            }
+            records = strtoul(argv[i + 1], NULL, 10);
+            i++;
+        } else if (strcmp(argv[i], "-msg_signverify") == 0) {
+            do_msg_signverify = 1;
+        } else if (strcmp(argv[i], "-messages") == 0) {
+            if (i + 1 >= argc) {
+                printf("Number of messages missing\n");
+                return -1;
+            }
+            messages = strtoul(argv[i + 1], NULL, 10);
+            i++;
+        } else if (strcmp(argv[i], "-find") == 0) {
+            do_find = 1;
+        } else if (strcmp(argv[i], "-objects") == 0) {
+            if (i + 1 >= argc) {
+                printf("Number of objects missing\n");
+                return -1;
+            }
+            objects = strtoul(argv[i + 1], NULL, 10);
+            i++;
         } else if (strcmp(argv[i], "-h") == 0) {
             speed_usage(argv[0]);
             return 0;
@@ -1072,13 +1765,19 @@ int main(int argc, char **argv)
     }
 
     if (do_rsa_keygen + do_rsa_signverify + do_rsa_endecrypt
-        + do_des3_endecrypt + do_aes_endecrypt + do_sha == 0) {
+        + do_des3_endecrypt + do_aes_endecrypt + do_sha
+        + do_stream_signverify + do_gcm_records + do_msg_signverify
+        + do_find == 0) {
         do_rsa_keygen = 1;
         do_rsa_signverify = 1;
         do_rsa_endecrypt = 1;
         do_des3_endecrypt = 1;
         do_aes_endecrypt = 1;
         do_sha = 1;
+        do_stream_signverify = 1;
+        do_gcm_records = 1;
+        do_msg_signverify = 1;
+        do_find = 1;
     }
 
     printf("Using slot #%lu...\n\n", SLOT_ID);
@@ -1178,6 +1877,46 @@ int main(int argc, char **argv)
             goto out;
     }
 
+    if (do_stream_signverify) {
+        testsuite_begin("Multi-part Sign/Verify.");
+        rc = do_Stream_SignVerify("RSA", stream_mb);
+        if (!rc)
+            goto out;
+        rc = do_Stream_SignVerify("ECDSA", stream_mb);
+        if (!rc)
+            goto out;
+    }
+
+    if (do_gcm_records) {
+        testsuite_begin("AES-GCM record Encrypt/Decrypt.");
+        rc = do_AES_GCM_Records(64, records);
+        if (!rc)
+            goto out;
+        rc = do_AES_GCM_Records(1024, records);
+        if (!rc)
+            goto out;
+        rc = do_AES_GCM_Records(GCM_MAX_RECORD_LEN, records / 10);
+        if (!rc)
+            goto out;
+    }
+
+    if (do_msg_signverify) {
+        testsuite_begin("Message-based Sign/Verify.");
+        rc = do_Message_SignVerify("RSA", messages);
+        if (!rc)
+            goto out;
+        rc = do_Message_SignVerify("ECDSA", messages);
+        if (!rc)
+            goto out;
+    }
+
+    if (do_find) {
+        testsuite_begin("Find Objects.");
+        rc = do_FindObjects(objects);
+        if (!rc)
+            goto out;
+    }
+
 out:
     testcase_print_result();
 
@@ -264,6 +264,401 @@ testcase_cleanup:
     return rc;
 }
 
+/* Vendor attribute the tokens use to hide their internal objects */
+#define CKA_HIDDEN      (CKA_VENDOR_DEFINED + 0x01000000)
+
+#define MAX_FOUND       32
+
+/*
+ * Searches with the template, fetching at most max handles per C_FindObjects
+ * call, and returns the handles found. Only the last non-empty call may
+ * return fewer than max handles, and no handle may be returned twice.
+ */
+static CK_RV find_all(CK_SESSION_HANDLE session, CK_ATTRIBUTE *tmpl,
+                      CK_ULONG tmpl_count, CK_ULONG max,
+                      CK_OBJECT_HANDLE *found, CK_ULONG *found_count)
+{
+    CK_OBJECT_HANDLE obj_list[MAX_FOUND];
+    CK_ULONG count, i, j;
+    CK_BBOOL short_call = FALSE;
+    CK_RV rc, rc2;
+
+    *found_count = 0;
+
+    rc = funcs->C_FindObjectsInit(session, tmpl, tmpl_count);
+    if (rc != CKR_OK) {
+        testcase_fail("C_FindObjectsInit() rc = %s", p11_get_ckr(rc));
+        return rc;
+    }
+
+    for (;;) {
+        rc = funcs->C_FindObjects(session, obj_list, max, &count);
+        if (rc != CKR_OK) {
+            testcase_fail("C_FindObjects() rc = %s", p11_get_ckr(rc));
+            goto out;
+        }
+        if (count == 0)
+            break;
+        if (short_call) {
+            testcase_fail("C_FindObjects() returned %lu handles after a "
+                          "call that returned less than %lu", count, max);
+            rc = CKR_FUNCTION_FAILED;
+            goto out;
+        }
+        if (count < max)
+            short_call = TRUE;
+
+        for (i = 0; i < count; i++) {
+            for (j = 0; j < *found_count; j++) {
+                if (found[j] == obj_list[i]) {
+                    testcase_fail("Object %lu found twice", obj_list[i]);
+                    rc = CKR_FUNCTION_FAILED;
+                    goto out;
+                }
+            }
+            if (*found_count >= MAX_FOUND) {
+                testcase_fail("Found more than %d objects", MAX_FOUND);
+                rc = CKR_FUNCTION_FAILED;
+                goto out;
+            }
+            found[(*found_count)++] = obj_list[i];
+        }
+    }
+
+out:
+    rc2 = funcs->C_FindObjectsFinal(session);
+    if (rc2 != CKR_OK) {
+        testcase_fail("C_FindObjectsFinal() rc = %s", p11_get_ckr(rc2));
+        if (rc == CKR_OK)
+            rc = rc2;
+    }
+
+    return rc;
+}
+
+/* Checks that exactly the expected objects were found */
+static CK_BBOOL found_exactly(CK_OBJECT_HANDLE *found, CK_ULONG found_count,
+                              CK_OBJECT_HANDLE *expected,
+                              CK_ULONG expected_count)
+{
+    CK_ULONG i, j;
+
+    if (found_count != expected_count)
+        return FALSE;
+
+    for (i = 0; i < expected_count; i++) {
+        for (j = 0; j < found_count; j++) {
+            if (found[j] == expected[i])
+                break;
+        }
+        if (j == found_count)
+            return FALSE;
+    }
+
+    return TRUE;
+}
+
+/* API Routines exercised:
+ * C_FindObjectsInit
+ * C_FindObjects
+ * C_FindObjectsFinal
+ * C_CreateObject
+ * C_DestroyObject
+ *
+ * 5 TestCases
+ * Setup: Create private and public token and session data objects
+ * Testcase 1: Find them with a few handles per C_FindObjects call, across
+ *             the private and public token objects and the session objects.
+ * Testcase 2: Find hardware feature objects only when asked for.
+ * Testcase 3: Find hidden objects only when asked for.
+ * Testcase 4: End a search with C_FindObjectsFinal before all objects have
+ *             been returned, and search again.
+ * Testcase 5: Find only the public objects after logging out.
+ */
+CK_RV do_FindObjectsIncremental(void)
+{
+    CK_FLAGS flags;
+    CK_SESSION_HANDLE session = CK_INVALID_HANDLE;
+    CK_RV rc = 0;
+    CK_BYTE user_pin[PKCS11_MAX_PIN_LEN];
+    CK_ULONG user_pin_len;
+
+    CK_OBJECT_HANDLE objs[MAX_FOUND] = { 0 };
+    CK_OBJECT_HANDLE public_objs[4];
+    CK_OBJECT_HANDLE hidden_obj = CK_INVALID_HANDLE;
+    CK_OBJECT_HANDLE clock_obj = CK_INVALID_HANDLE;
+    CK_OBJECT_HANDLE found[MAX_FOUND], obj_list[MAX_FOUND];
+    CK_ULONG found_count, count = 0, max, i, j;
+    CK_ULONG num_objs = 0, num_public = 0;
+    CK_ULONG max_counts[] = { 1, 3, MAX_FOUND };
+    CK_BBOOL logged_in = FALSE;
+
+    CK_OBJECT_CLASS data_class = CKO_DATA;
+    CK_OBJECT_CLASS clock_class = CKO_HW_FEATURE;
+    CK_HW_FEATURE_TYPE clock_type = CKH_CLOCK;
+    CK_BBOOL true = TRUE;
+    CK_BBOOL token, private;
+    CK_UTF8CHAR test_label[] = "My incremental find objects";
+    CK_BYTE data_value[] = "This is some data.";
+    CK_CHAR clock_value[16] = { 0 };
+
+    CK_ATTRIBUTE data_tmpl[] = {
+        {CKA_CLASS, &data_class, sizeof(data_class)},
+        {CKA_TOKEN, &token, sizeof(token)},
+        {CKA_PRIVATE, &private, sizeof(private)},
+        {CKA_LABEL, test_label, sizeof(test_label) - 1},
+        {CKA_VALUE, &data_value, sizeof(data_value)},
+        {CKA_HIDDEN, &true, sizeof(true)}
+    };
+
+    CK_ATTRIBUTE clock_tmpl[] = {
+        {CKA_CLASS, &clock_class, sizeof(clock_class)},
+        {CKA_HW_FEATURE_TYPE, &clock_type, sizeof(clock_type)},
+        {CKA_VALUE, clock_value, sizeof(clock_value)}
+    };
+
+    CK_ATTRIBUTE search_tmpl[] = {
+        {CKA_LABEL, test_label, sizeof(test_label) - 1},
+        {CKA_HIDDEN, &true, sizeof(true)}
+    };
+
+    CK_ATTRIBUTE search_hw_tmpl[] = {
+        {CKA_CLASS, &clock_class, sizeof(clock_class)},
+        {CKA_HW_FEATURE_TYPE, &clock_type, sizeof(clock_type)}
+    };
+
+    testcase_begin("starting...");
+    testcase_rw_session();
+    testcase_user_login();
+    logged_in = TRUE;
+
+    /* Create 2 objects each as private and public token and session objects */
+    for (i = 0; i < 8; i++) {
+        token = (i < 4) ? TRUE : FALSE;
+        private = (i % 4 < 2) ? TRUE : FALSE;
+
+        rc = funcs->C_CreateObject(session, data_tmpl, 5, &objs[num_objs]);
+        if (rc != CKR_OK) {
+            if (is_rejected_by_policy(rc, session)) {
+                testcase_skip("object creation is not allowed by policy");
+                rc = CKR_OK;
+                goto testcase_cleanup;
+            }
+            testcase_error("C_CreateObject() rc = %s", p11_get_ckr(rc));
+            goto testcase_cleanup;
+        }
+        if (!private)
+            public_objs[num_public++] = objs[num_objs];
+        num_objs++;
+    }
+
+    /* Testcase 1: Find them with a few handles per C_FindObjects call */
+    testcase_new_assertion();
+
+    for (i = 0; i < sizeof(max_counts) / sizeof(max_counts[0]); i++) {
+        max = max_counts[i];
+
+        rc = find_all(session, search_tmpl, 1, max, found, &found_count);
+        if (rc != CKR_OK)
+            goto testcase_cleanup;
+
+        if (!found_exactly(found, found_count, objs, num_objs)) {
+            testcase_fail("Found %lu objects with %lu handles per call, "
+                          "expected the %lu objects created", found_count,
+                          max, num_objs);
+            goto testcase_cleanup;
+        }
+    }
+
+    testcase_pass("Found the %lu objects with 1, 3 and %d handles per call.",
+                  num_objs, MAX_FOUND);
+
+    /* Testcase 2: Find hardware feature objects only if asked for */
+    rc = funcs->C_CreateObject(session, clock_tmpl, 3, &clock_obj);
+    if (rc != CKR_OK) {
+        testcase_error("C_CreateObject() rc = %s", p11_get_ckr(rc));
+        goto testcase_cleanup;
+    }
+
+    testcase_new_assertion();
+
+    rc = find_all(session, search_hw_tmpl + 1, 1, 1, found, &found_count);
+    if (rc != CKR_OK)
+        goto testcase_cleanup;
+    for (j = 0; j < found_count; j++) {
+        if (found[j] == clock_obj) {
+            testcase_fail("Found the clock object without CKA_CLASS "
+                          "CKO_HW_FEATURE in the template");
+            goto testcase_cleanup;
+        }
+    }
+
+    rc = find_all(session, search_hw_tmpl, 2, 1, found, &found_count);
+    if (rc != CKR_OK)
+        goto testcase_cleanup;
+    for (j = 0; j < found_count; j++) {
+        if (found[j] == clock_obj)
+            break;
+    }
+    if (j == found_count) {
+        testcase_fail("Did not find the clock object with CKA_CLASS "
+                      "CKO_HW_FEATURE in the template");
+        goto testcase_cleanup;
+    }
+
+    testcase_pass("Found the clock object only with CKA_CLASS "
+                  "CKO_HW_FEATURE in the template.");
+
+    /*
+     * Testcase 3: Find hidden objects only if asked for. Only tokens that
+     * accept CKA_HIDDEN from the application can run this testcase.
+     */
+    private = FALSE;
+    token = FALSE;
+    rc = funcs->C_CreateObject(session, data_tmpl, 6, &hidden_obj);
+    if (rc == CKR_ATTRIBUTE_TYPE_INVALID) {
+        testcase_skip("Token does not accept CKA_HIDDEN in a template");
+        hidden_obj = CK_INVALID_HANDLE;
+        goto test4;
+    }
+    if (rc != CKR_OK) {
+        testcase_error("C_CreateObject() rc = %s", p11_get_ckr(rc));
+        goto testcase_cleanup;
+    }
+
+    testcase_new_assertion();
+
+    rc = find_all(session, search_tmpl, 1, 1, found, &found_count);
+    if (rc != CKR_OK)
+        goto testcase_cleanup;
+    if (!found_exactly(found, found_count, objs, num_objs)) {
+        testcase_fail("Found %lu objects without CKA_HIDDEN in the "
+                      "template, expected %lu", found_count, num_objs);
+        goto testcase_cleanup;
+    }
+
+    rc = find_all(session, search_tmpl, 2, 1, found, &found_count);
+    if (rc != CKR_OK)
+        goto testcase_cleanup;
+    if (!found_exactly(found, found_count, &hidden_obj, 1)) {
+        testcase_fail("Found %lu objects with CKA_HIDDEN in the template, "
+                      "expected the hidden object", found_count);
+        goto testcase_cleanup;
+    }
+
+    testcase_pass("Found the hidden object only with CKA_HIDDEN in the "
+                  "template.");
+
+test4:
+    /* Testcase 4: End a search before all objects have been returned */
+    testcase_new_assertion();
+
+    rc = funcs->C_FindObjectsInit(session, search_tmpl, 1);
+    if (rc != CKR_OK) {
+        testcase_fail("C_FindObjectsInit() rc = %s", p11_get_ckr(rc));
+        goto testcase_cleanup;
+    }
+
+    rc = funcs->C_FindObjects(session, obj_list, 1, &count);
+    if (rc != CKR_OK || count != 1) {
+        testcase_fail("C_FindObjects() rc = %s, count = %lu",
+                      p11_get_ckr(rc), count);
+        goto testcase_cleanup;
+    }
+
+    rc = funcs->C_FindObjectsFinal(session);
+    if (rc != CKR_OK) {
+        testcase_fail("C_FindObjectsFinal() rc = %s", p11_get_ckr(rc));
+        goto testcase_cleanup;
+    }
+
+    rc = funcs->C_FindObjects(session, obj_list, 1, &count);
+    if (rc != CKR_OPERATION_NOT_INITIALIZED) {
+        testcase_fail("C_FindObjects() after C_FindObjectsFinal() rc = %s, "
+                      "expected CKR_OPERATION_NOT_INITIALIZED",
+                      p11_get_ckr(rc));
+        rc = CKR_FUNCTION_FAILED;
+        goto testcase_cleanup;
+    }
+
+    rc = find_all(session, search_tmpl, 1, 1, found, &found_count);
+    if (rc != CKR_OK)
+        goto testcase_cleanup;
+    if (!found_exactly(found, found_count, objs, num_objs)) {
+        testcase_fail("Found %lu objects in a new search, expected %lu",
+                      found_count, num_objs);
+        goto testcase_cleanup;
+    }
+
+    testcase_pass("Started a new search after ending one early.");
+
+    /* Testcase 5: Find only the public objects after logging out */
+    testcase_new_assertion();
+
+    rc = funcs->C_Logout(session);
+    if (rc != CKR_OK) {
+        testcase_error("C_Logout() rc = %s", p11_get_ckr(rc));
+        goto testcase_cleanup;
+    }
+    logged_in = FALSE;
+
+    /* Logging out destroyed the private session objects */
+    for (i = 0, j = 0; i < num_objs; i++) {
+        if (i < 4 || i >= 6)
+            objs[j++] = objs[i];
+    }
+    num_objs = j;
+
+    for (i = 0; i < sizeof(max_counts) / sizeof(max_counts[0]); i++) {
+        max = max_counts[i];
+
+        rc = find_all(session, search_tmpl, 1, max, found, &found_count);
+        if (rc != CKR_OK)
+            goto testcase_cleanup;
+
+        if (!found_exactly(found, found_count, public_objs, num_public)) {
+            testcase_fail("Found %lu objects with %lu handles per call in "
+                          "a public session, expected the %lu public objects",
+                          found_count, max, num_public);
+            goto testcase_cleanup;
+        }
+    }
+
+    testcase_pass("Found only the %lu public objects.", num_public);
+
+testcase_cleanup:
+    /*
+     * The private token objects can only be destroyed by the user, and get
+     * new handles when they are loaded again at login. Look the objects up
+     * again, which also finds the token objects left behind by an earlier
+     * run that failed.
+     */
+    if (session != CK_INVALID_HANDLE) {
+        if (!logged_in && get_user_pin(user_pin) == 0) {
+            user_pin_len = (CK_ULONG) strlen((char *) user_pin);
+            funcs->C_Login(session, CKU_USER, user_pin, user_pin_len);
+        }
+        if (find_all(session, search_tmpl, 1, MAX_FOUND, objs,
+                     &num_objs) != CKR_OK)
+            num_objs = 0;
+    }
+    for (i = 0; i < num_objs; i++)
+        funcs->C_DestroyObject(session, objs[i]);
+    if (hidden_obj != CK_INVALID_HANDLE)
+        funcs->C_DestroyObject(session, hidden_obj);
+    if (clock_obj != CK_INVALID_HANDLE)
+        funcs->C_DestroyObject(session, clock_obj);
+
+    testcase_user_logout();
+    if (session != CK_INVALID_HANDLE) {
+        rc = funcs->C_CloseSession(session);
+        if (rc != CKR_OK)
+            testcase_error("C_CloseSession rc=%s", p11_get_ckr(rc));
+    }
+
+    return rc;
+}
+
 int main(int argc, char **argv)
 {
     int rc;
@@ -302,6 +697,8 @@ int main(int argc, char **argv)
 
     testcase_setup();
     rc = do_FindObjects();
+    if (rc == CKR_OK)
+        rc = do_FindObjectsIncremental();
     testcase_print_result();
 
     funcs->C_Finalize(NULL);
@@ -11,6 +11,7 @@
 /*
  * Testcase for
  * C_GetOperationState / C_SetOperationState
+ * of digest and HMAC operations
  */
 
 #include <stdio.h>
@@ -251,6 +252,228 @@ out:
     return rc;
 }
 
+static CK_RV create_hmac_key(CK_SESSION_HANDLE sess, CK_BBOOL sensitive,
+                             CK_OBJECT_HANDLE *key)
+{
+    CK_OBJECT_CLASS key_class = CKO_SECRET_KEY;
+    CK_KEY_TYPE key_type = CKK_GENERIC_SECRET;
+    CK_BBOOL false = FALSE, true = TRUE;
+    CK_BYTE value[32];
+    CK_ATTRIBUTE key_attribs[] = {
+        {CKA_CLASS, &key_class, sizeof(key_class)},
+        {CKA_KEY_TYPE, &key_type, sizeof(key_type)},
+        {CKA_TOKEN, &false, sizeof(false)},
+        {CKA_SIGN, &true, sizeof(true)},
+        {CKA_SENSITIVE, &sensitive, sizeof(sensitive)},
+        {CKA_VALUE, value, sizeof(value)}
+    };
+    CK_RV rc;
+
+    rc = funcs->C_GenerateRandom(sess, value, sizeof(value));
+    if (rc != CKR_OK) {
+        testcase_error("C_GenerateRandom() rc=%s", p11_get_ckr(rc));
+        return rc;
+    }
+
+    rc = funcs->C_CreateObject(sess, key_attribs, 6, key);
+    if (rc != CKR_OK)
+        testcase_error("C_CreateObject rc=%s", p11_get_ckr(rc));
+
+    return rc;
+}
+
+/*
+ * Save the state of a HMAC operation in one session after the first part of
+ * the data, and restore it in another session. Both sessions must compute
+ * the same MAC over the rest of the data as a single-part C_Sign. The state
+ * of a HMAC with a sensitive key must not be saveable.
+ */
+int sess_opstate_hmac(void)
+{
+    CK_SESSION_HANDLE s1, s2;
+    CK_SLOT_ID slot_id = SLOT_ID;
+    CK_ULONG flags;
+    CK_RV rc;
+    CK_MECHANISM mech = { CKM_SHA256_HMAC, 0, 0 };
+    CK_OBJECT_HANDLE key = CK_INVALID_HANDLE, skey = CK_INVALID_HANDLE;
+    CK_BYTE data[200];
+    CK_BYTE mac[32], mac1[32], mac2[32];
+    CK_ULONG maclen, mac1len, mac2len;
+    CK_ULONG opstatelen;
+    CK_BYTE *opstate = NULL;
+
+    testcase_begin("Get/SetOperationState HMAC test");
+
+    flags = CKF_SERIAL_SESSION | CKF_RW_SESSION;
+    rc = funcs->C_OpenSession(slot_id, flags, NULL, NULL, &s1);
+    if (rc != CKR_OK) {
+        testcase_error("C_OpenSession() rc=%s", p11_get_ckr(rc));
+        goto out;
+    }
+
+    rc = funcs->C_OpenSession(slot_id, flags, NULL, NULL, &s2);
+    if (rc != CKR_OK) {
+        testcase_error("C_OpenSession() rc=%s", p11_get_ckr(rc));
+        goto out;
+    }
+
+    if (!mech_supported(SLOT_ID, mech.mechanism)) {
+        testcase_skip("Mechanism CKM_SHA256_HMAC is not supported with slot "
+                      "%ld.", SLOT_ID);
+        goto out;
+    }
+
+    rc = funcs->C_GenerateRandom(s1, data, sizeof(data));
+    if (rc != CKR_OK) {
+        testcase_error("C_GenerateRandom() rc=%s", p11_get_ckr(rc));
+        goto out;
+    }
+
+    rc = create_hmac_key(s1, FALSE, &key);
+    if (rc != CKR_OK)
+        goto out;
+    rc = create_hmac_key(s1, TRUE, &skey);
+    if (rc != CKR_OK)
+        goto out;
+
+    /* A HMAC with a sensitive key is never saveable */
+    rc = funcs->C_SignInit(s1, &mech, skey);
+    if (rc != CKR_OK) {
+        testcase_error("C_SignInit rc=%s", p11_get_ckr(rc));
+        goto out;
+    }
+
+    rc = funcs->C_SignUpdate(s1, data, 100);
+    if (rc != CKR_OK) {
+        testcase_error("C_SignUpdate rc=%s", p11_get_ckr(rc));
+        goto out;
+    }
+
+    testcase_new_assertion();
+    opstatelen = 0;
+    rc = funcs->C_GetOperationState(s1, NULL, &opstatelen);
+    if (rc != CKR_STATE_UNSAVEABLE) {
+        testcase_fail("C_GetOperationState with a sensitive HMAC key rc=%s, "
+                      "expected CKR_STATE_UNSAVEABLE", p11_get_ckr(rc));
+        goto out;
+    }
+    testcase_pass("HMAC state with a sensitive key is unsaveable");
+
+    maclen = sizeof(mac);
+    rc = funcs->C_SignFinal(s1, mac, &maclen);
+    if (rc != CKR_OK) {
+        testcase_error("C_SignFinal rc=%s", p11_get_ckr(rc));
+        goto out;
+    }
+
+    /* Expected MAC */
+    rc = funcs->C_SignInit(s1, &mech, key);
+    if (rc != CKR_OK) {
+        testcase_error("C_SignInit rc=%s", p11_get_ckr(rc));
+        goto out;
+    }
+
+    maclen = sizeof(mac);
+    rc = funcs->C_Sign(s1, data, sizeof(data), mac, &maclen);
+    if (rc != CKR_OK) {
+        testcase_error("C_Sign rc=%s", p11_get_ckr(rc));
+        goto out;
+    }
+
+    rc = funcs->C_SignInit(s1, &mech, key);
+    if (rc != CKR_OK) {
+        testcase_error("C_SignInit rc=%s", p11_get_ckr(rc));
+        goto out;
+    }
+
+    rc = funcs->C_SignUpdate(s1, data, 100);
+    if (rc != CKR_OK) {
+        testcase_error("C_SignUpdate rc=%s", p11_get_ckr(rc));
+        goto out;
+    }
+
+    opstatelen = 0;
+    rc = funcs->C_GetOperationState(s1, NULL, &opstatelen);
+    if (rc == CKR_STATE_UNSAVEABLE) {
+        testcase_skip("Get/SetOperationState HMAC test: state unsavable");
+        rc = CKR_OK;
+        goto out;
+    }
+    if (rc != CKR_OK) {
+        testcase_error("C_GetOperationState rc=%s", p11_get_ckr(rc));
+        goto out;
+    }
+
+    opstate = malloc(opstatelen);
+    if (opstate == NULL) {
+        testcase_error("malloc(%lu) failed", opstatelen);
+        goto out;
+    }
+
+    rc = funcs->C_GetOperationState(s1, opstate, &opstatelen);
+    if (rc != CKR_OK) {
+        testcase_error("C_GetOperationState rc=%s", p11_get_ckr(rc));
+        goto out;
+    }
+
+    testcase_new_assertion();
+
+    /* The key is needed to restore a sign operation */
+    rc = funcs->C_SetOperationState(s2, opstate, opstatelen, 0, 0);
+    if (rc != CKR_KEY_NEEDED) {
+        testcase_fail("C_SetOperationState without key rc=%s, expected "
+                      "CKR_KEY_NEEDED", p11_get_ckr(rc));
+        goto out;
+    }
+
+    rc = funcs->C_SetOperationState(s2, opstate, opstatelen, 0, key);
+    if (rc != CKR_OK) {
+        testcase_error("C_SetOperationState rc=%s", p11_get_ckr(rc));
+        goto out;
+    }
+
+    rc = funcs->C_SignUpdate(s1, data + 100, sizeof(data) - 100);
+    if (rc != CKR_OK) {
+        testcase_error("C_SignUpdate rc=%s", p11_get_ckr(rc));
+        goto out;
+    }
+
+    rc = funcs->C_SignUpdate(s2, data + 100, sizeof(data) - 100);
+    if (rc != CKR_OK) {
+        testcase_error("C_SignUpdate rc=%s", p11_get_ckr(rc));
+        goto out;
+    }
+
+    mac1len = sizeof(mac1);
+    rc = funcs->C_SignFinal(s1, mac1, &mac1len);
+    if (rc != CKR_OK) {
+        testcase_error("C_SignFinal rc=%s", p11_get_ckr(rc));
+        goto out;
+    }
+
+    mac2len = sizeof(mac2);
+    rc = funcs->C_SignFinal(s2, mac2, &mac2len);
+    if (rc != CKR_OK) {
+        testcase_error("C_SignFinal rc=%s", p11_get_ckr(rc));
+        goto out;
+    }
+
+    if (mac1len != maclen || mac2len != maclen ||
+        memcmp(mac1, mac, maclen) != 0 || memcmp(mac2, mac, maclen) != 0) {
+        testcase_fail("restored HMAC differs from single-part HMAC");
+        goto out;
+    }
+
+    testcase_pass("Get/SetOperationState HMAC test");
+
+out:
+    if (opstate)
+        free(opstate);
+    funcs->C_CloseAllSessions(slot_id);
+
+    return rc;
+}
+
 int main(int argc, char **argv)
 {
     CK_C_INITIALIZE_ARGS cinit_args;
@@ -306,6 +529,8 @@ int main(int argc, char **argv)
     }
     testcase_setup();
     rc = sess_opstate_funcs(loops);
+    if (rc == CKR_OK)
+        rc = sess_opstate_hmac();
     testcase_print_result();
 
     return testcase_return(rc);
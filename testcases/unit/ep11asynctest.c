@@ -0,0 +1,329 @@
+/*
+ * COPYRIGHT (c) International Business Machines Corp. 2024
+ *
+ * This program is provided under the terms of the Common Public License,
+ * version 1.0 (CPL-1.0). Any use, reproduction or distribution for this
+ * software constitutes recipient's acceptance of CPL-1.0 terms which can be
+ * found in the file LICENSE file or at
+ * https://opensource.org/licenses/cpl1.0.php
+ */
+
+/*
+ * Test of the EP11 request dispatching against the simulated EP11 host
+ * library, which is loaded with dlopen() and called through function
+ * pointers like the EP11 token does: balancing across the APQNs, the limit
+ * of requests in flight and failover from a failing APQN. The throughput is compared to the direct
+ * submission via the group target and only reported, it depends on the
+ * machine the test runs on.
+ */
+
+#include <dlfcn.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define OCK_NO_EP11_DEFINES
+#include "pkcs11types.h"
+#include "ep11.h"
+#include "ep11_func.h"
+#include "ep11_async.h"
+#include "unittest.h"
+
+#define NUM_APQNS       4
+#define DOMAIN          0x0d
+#define DEPTH           8
+#define LIMITED_DEPTH   2
+#define NUM_CLIENTS     32
+#define NUM_REQUESTS    40
+#define LATENCY_US      2000
+
+static m_init_t dll_m_init;
+static m_add_module_t dll_m_add_module;
+static m_rm_module_t dll_m_rm_module;
+static m_SignSingle_t dll_m_SignSingle;
+
+static void (*stub_set_latency)(unsigned int usecs);
+static void (*stub_set_concurrency)(unsigned int requests);
+static void (*stub_set_failed)(unsigned int adapter, unsigned int domain,
+                               int failed);
+static unsigned long (*stub_requests)(unsigned int adapter,
+                                      unsigned int domain);
+static unsigned int (*stub_peak_requests)(void);
+
+static struct ep11_async_lane_info lanes[NUM_APQNS];
+static target_t group_target = XCP_TGT_INIT;
+
+struct client {
+    pthread_t thread;
+    struct ep11_async *async;   /* NULL for the group target */
+    unsigned long failed;
+    CK_RV last_rc;
+};
+
+struct sign_args {
+    CK_BYTE data[16];
+    CK_BYTE sig[64];
+    CK_ULONG sig_len;
+};
+
+static CK_RV sign_func(void *arg, uint64_t target)
+{
+    struct sign_args *args = arg;
+    CK_MECHANISM mech = { CKM_ECDSA, NULL, 0 };
+    static const unsigned char key[] = "stub key blob";
+
+    args->sig_len = sizeof(args->sig);
+    return dll_m_SignSingle(key, sizeof(key), &mech, args->data,
+                            sizeof(args->data), args->sig, &args->sig_len,
+                            target);
+}
+
+static void *client_thread(void *arg)
+{
+    struct client *client = arg;
+    struct sign_args args;
+    CK_RV rc;
+    int i;
+
+    memset(&args, 0, sizeof(args));
+    for (i = 0; i < NUM_REQUESTS; i++) {
+        args.data[0] = i;
+        if (client->async != NULL)
+            rc = ep11_async_call(client->async, sign_func, &args);
+        else
+            rc = sign_func(&args, group_target);
+        if (rc != CKR_OK) {
+            client->failed++;
+            client->last_rc = rc;
+        }
+    }
+
+    return NULL;
+}
+
+static double elapsed(const struct timespec *start)
+{
+    struct timespec end;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) +
+           (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* Returns the requests per second */
+static double run_clients(struct ep11_async *async, unsigned long *failed,
+                          CK_RV *last_rc)
+{
+    struct client clients[NUM_CLIENTS];
+    struct timespec start;
+    int i;
+
+    memset(clients, 0, sizeof(clients));
+    *failed = 0;
+    *last_rc = CKR_OK;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < NUM_CLIENTS; i++) {
+        clients[i].async = async;
+        pthread_create(&clients[i].thread, NULL, client_thread, &clients[i]);
+    }
+    for (i = 0; i < NUM_CLIENTS; i++) {
+        pthread_join(clients[i].thread, NULL);
+        *failed += clients[i].failed;
+        if (clients[i].failed)
+            *last_rc = clients[i].last_rc;
+    }
+
+    return NUM_CLIENTS * NUM_REQUESTS / elapsed(&start);
+}
+
+static void *load_stub(void)
+{
+    void *lib;
+
+    lib = dlopen(EP11STUB_LIBRARY, RTLD_NOW);
+    if (lib == NULL) {
+        fprintf(stderr, "dlopen failed: %s\n", dlerror());
+        return NULL;
+    }
+
+    *(void **)(&dll_m_init) = dlsym(lib, "m_init");
+    *(void **)(&dll_m_add_module) = dlsym(lib, "m_add_module");
+    *(void **)(&dll_m_rm_module) = dlsym(lib, "m_rm_module");
+    *(void **)(&dll_m_SignSingle) = dlsym(lib, "m_SignSingle");
+
+    *(void **)(&stub_set_latency) = dlsym(lib, "ep11stub_set_latency");
+    *(void **)(&stub_set_concurrency) = dlsym(lib, "ep11stub_set_concurrency");
+    *(void **)(&stub_set_failed) = dlsym(lib, "ep11stub_set_failed");
+    *(void **)(&stub_requests) = dlsym(lib, "ep11stub_requests");
+    *(void **)(&stub_peak_requests) = dlsym(lib, "ep11stub_peak_requests");
+
+    if (dll_m_init == NULL || dll_m_add_module == NULL ||
+        dll_m_rm_module == NULL || dll_m_SignSingle == NULL ||
+        stub_set_latency == NULL || stub_set_concurrency == NULL ||
+        stub_set_failed == NULL || stub_requests == NULL ||
+        stub_peak_requests == NULL) {
+        fprintf(stderr, "dlsym failed: %s\n", dlerror());
+        dlclose(lib);
+        return NULL;
+    }
+
+    return lib;
+}
+
+/* One target per APQN, and a group target of all APQNs */
+static int setup_targets(void)
+{
+    struct XCP_Module module;
+    int i;
+
+    for (i = 0; i < NUM_APQNS; i++) {
+        memset(&module, 0, sizeof(module));
+        module.version = XCP_MOD_VERSION_2;
+        module.flags = XCP_MFL_MODULE;
+        module.module_nr = i + 1;
+        XCPTGTMASK_SET_DOM(module.domainmask, DOMAIN);
+
+        lanes[i].adapter = i + 1;
+        lanes[i].domain = DOMAIN;
+        lanes[i].target = XCP_TGT_INIT;
+        if (dll_m_add_module(&module, &lanes[i].target) != 0 ||
+            dll_m_add_module(&module, &group_target) != 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+static int check_distribution(const unsigned long *before, unsigned long sent)
+{
+    unsigned long count, total = 0;
+    int i, rc = TEST_PASS;
+
+    for (i = 0; i < NUM_APQNS; i++) {
+        count = stub_requests(i + 1, DOMAIN) - before[i];
+        total += count;
+        if (count < sent / NUM_APQNS / 2) {
+            fprintf(stderr, "APQN %d got only %lu of %lu requests\n", i + 1,
+                    count, sent);
+            rc = TEST_FAIL;
+        }
+    }
+    if (total != sent) {
+        fprintf(stderr, "%lu requests sent, expected %lu\n", total, sent);
+        rc = TEST_FAIL;
+    }
+
+    return rc;
+}
+
+int main(void)
+{
+    struct ep11_async *async, *limited;
+    struct ep11_async_lane_stats stats;
+    unsigned long failed, before[NUM_APQNS];
+    double direct, dispatched;
+    unsigned int peak;
+    CK_RV last_rc;
+    void *lib;
+    int i, rc = TEST_PASS;
+
+    lib = load_stub();
+    if (lib == NULL)
+        return TEST_FAIL;
+
+    dll_m_init();
+    stub_set_latency(LATENCY_US);
+    stub_set_concurrency(DEPTH);
+
+    if (setup_targets() != 0) {
+        fprintf(stderr, "m_add_module failed\n");
+        return TEST_FAIL;
+    }
+
+    /* Direct submission via the group target, as without the dispatcher */
+    direct = run_clients(NULL, &failed, &last_rc);
+    if (failed != 0) {
+        fprintf(stderr, "%lu requests failed via the group target\n", failed);
+        rc = TEST_FAIL;
+    }
+
+    /* Requests executed on the calling threads, balanced across the APQNs */
+    if (ep11_async_create(lanes, NUM_APQNS, DEPTH, &async) != CKR_OK) {
+        fprintf(stderr, "ep11_async_create failed\n");
+        return TEST_FAIL;
+    }
+    for (i = 0; i < NUM_APQNS; i++)
+        before[i] = stub_requests(i + 1, DOMAIN);
+    dispatched = run_clients(async, &failed, &last_rc);
+    if (failed != 0) {
+        fprintf(stderr, "%lu requests failed when dispatched\n", failed);
+        rc = TEST_FAIL;
+    }
+    if (check_distribution(before, NUM_CLIENTS * NUM_REQUESTS) != TEST_PASS)
+        rc = TEST_FAIL;
+
+    /* The requests in flight are limited per APQN */
+    if (ep11_async_create(lanes, NUM_APQNS, LIMITED_DEPTH,
+                          &limited) != CKR_OK) {
+        fprintf(stderr, "ep11_async_create failed\n");
+        return TEST_FAIL;
+    }
+    stub_set_concurrency(NUM_CLIENTS);
+    stub_peak_requests();
+    run_clients(limited, &failed, &last_rc);
+    peak = stub_peak_requests();
+    stub_set_concurrency(DEPTH);
+    ep11_async_destroy(limited);
+    if (failed != 0) {
+        fprintf(stderr, "%lu requests failed when dispatched\n", failed);
+        rc = TEST_FAIL;
+    }
+    if (peak > NUM_APQNS * LIMITED_DEPTH) {
+        fprintf(stderr, "%u requests in flight, expected at most %u\n", peak,
+                NUM_APQNS * LIMITED_DEPTH);
+        rc = TEST_FAIL;
+    }
+
+    printf("%u APQNs, %u us per request: group target %.0f requests/s, "
+           "dispatched %.0f requests/s\n", NUM_APQNS, LATENCY_US, direct,
+           dispatched);
+
+    /* Requests fail over from a failing APQN */
+    stub_set_failed(2, DOMAIN, 1);
+    before[1] = stub_requests(2, DOMAIN);
+    run_clients(async, &failed, &last_rc);
+    if (failed != 0) {
+        fprintf(stderr, "%lu requests failed with one APQN failing\n",
+                failed);
+        rc = TEST_FAIL;
+    }
+    ep11_async_get_stats(async, 1, &stats);
+    if (stats.online || stats.failovers == 0 ||
+        stub_requests(2, DOMAIN) != before[1]) {
+        fprintf(stderr, "failing APQN not taken offline\n");
+        rc = TEST_FAIL;
+    }
+
+    /* With all APQNs failing the device error is returned */
+    for (i = 0; i < NUM_APQNS; i++)
+        stub_set_failed(i + 1, DOMAIN, 1);
+    run_clients(async, &failed, &last_rc);
+    if (failed != NUM_CLIENTS * NUM_REQUESTS || last_rc != CKR_DEVICE_ERROR) {
+        fprintf(stderr, "device error not returned with all APQNs failing\n");
+        rc = TEST_FAIL;
+    }
+    ep11_async_destroy(async);
+
+    for (i = 0; i < NUM_APQNS; i++)
+        dll_m_rm_module(NULL, lanes[i].target);
+    dll_m_rm_module(NULL, group_target);
+    dlclose(lib);
+
+    printf("ep11 async: %s\n", rc == TEST_PASS ? "ok" : "failed");
+
+    return rc;
+}
@@ -0,0 +1,1035 @@
+/*
+ * COPYRIGHT (c) International Business Machines Corp. 2024
+ *
+ * This program is provided under the terms of the Common Public License,
+ * version 1.0 (CPL-1.0). Any use, reproduction or distribution for this
+ * software constitutes recipient's acceptance of CPL-1.0 terms which can be
+ * found in the file LICENSE file or at
+ * https://opensource.org/licenses/cpl1.0.php
+ */
+
+/*
+ * Simulated EP11 host library.
+ *
+ * Built as the shared object libep11stub.so, which exports the functions the
+ * EP11 token resolves from the host library. It can be loaded by the token
+ * with OCK_EP11_LIBRARY=<path>/libep11stub.so, or by tests with dlopen().
+ * Only module handling, random number generation and the single-part sign,
+ * verify, encrypt and decrypt functions are simulated, plus the module and
+ * domain queries, control points, key generation, public key import and
+ * attribute queries needed by the token initialization and C_CreateObject
+ * (token built with EP11_HSMSIM). All other functions fail with
+ * CKR_FUNCTION_NOT_SUPPORTED. The simulation does no real cryptography.
+ *
+ * Every APQN processes at most EP11STUB_CONCURRENCY requests at a time, each
+ * taking EP11STUB_LATENCY_US microseconds. The APQNs listed in
+ * EP11STUB_FAILED_APQNS (e.g. "08.000d,0a.000d") fail all requests with
+ * CKR_DEVICE_ERROR. Tests can also control the stub with the functions of
+ * ep11stub.h, resolved with dlsym().
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define OCK_NO_EP11_DEFINES
+#include "pkcs11types.h"
+#include "ep11.h"
+#include "ep11adm.h"
+#include "ep11stub.h"
+
+#define STUB_MAX_TARGETS        256
+#define STUB_MAX_GROUP          256
+#define STUB_SIG_LEN            32
+#define STUB_HOST_VERSION       0x00030000
+#define STUB_FW_API             4
+#define STUB_FW_MAJOR           7
+#define STUB_FW_MINOR           15
+#define STUB_BLOB_LEN           256
+#define STUB_BLOB_WKID_OFFSET   32
+#define STUB_CSUM_LEN           4
+#define STUB_MAC_LEN            STUB_SIG_LEN
+#define STUB_WKVP_BYTE          0x11
+
+struct stub_apqn {
+    unsigned int busy;
+    CK_BBOOL failed;
+    unsigned long requests;
+    pthread_cond_t cond;
+};
+
+struct stub_target {
+    CK_BBOOL used;
+    unsigned int num_apqns;
+    unsigned short apqns[STUB_MAX_GROUP];     /* adapter << 8 | domain */
+    unsigned int next;
+};
+
+static pthread_mutex_t stub_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t stub_once = PTHREAD_ONCE_INIT;
+static struct stub_apqn stub_apqns[256 * 256];
+static struct stub_target stub_targets[STUB_MAX_TARGETS];
+static unsigned int stub_latency = 1000;
+static unsigned int stub_concurrency = 4;
+static unsigned int stub_busy;
+static unsigned int stub_peak;
+static unsigned long stub_total;
+
+static void stub_setup(void)
+{
+    unsigned int adapter, domain, i;
+    const char *val;
+    char *end;
+
+    for (i = 0; i < 256 * 256; i++)
+        pthread_cond_init(&stub_apqns[i].cond, NULL);
+
+    val = getenv("EP11STUB_LATENCY_US");
+    if (val != NULL)
+        stub_latency = strtoul(val, NULL, 0);
+
+    val = getenv("EP11STUB_CONCURRENCY");
+    if (val != NULL && strtoul(val, NULL, 0) > 0)
+        stub_concurrency = strtoul(val, NULL, 0);
+
+    val = getenv("EP11STUB_FAILED_APQNS");
+    while (val != NULL && *val != '\0') {
+        adapter = strtoul(val, &end, 16);
+        if (*end != '.')
+            break;
+        domain = strtoul(end + 1, &end, 16);
+        if (adapter < 256 && domain < 256)
+            stub_apqns[adapter << 8 | domain].failed = TRUE;
+        val = *end == ',' ? end + 1 : NULL;
+    }
+}
+
+static void stub_init(void)
+{
+    pthread_once(&stub_once, stub_setup);
+}
+
+void ep11stub_set_latency(unsigned int usecs)
+{
+    stub_init();
+    stub_latency = usecs;
+}
+
+void ep11stub_set_concurrency(unsigned int requests)
+{
+    stub_init();
+    stub_concurrency = requests > 0 ? requests : 1;
+}
+
+void ep11stub_set_failed(unsigned int adapter, unsigned int domain,
+                         int failed)
+{
+    stub_init();
+    pthread_mutex_lock(&stub_mutex);
+    stub_apqns[(adapter & 0xff) << 8 | (domain & 0xff)].failed =
+                                                        failed ? TRUE : FALSE;
+    pthread_mutex_unlock(&stub_mutex);
+}
+
+unsigned long ep11stub_requests(unsigned int adapter, unsigned int domain)
+{
+    unsigned long requests;
+
+    stub_init();
+    pthread_mutex_lock(&stub_mutex);
+    requests = stub_apqns[(adapter & 0xff) << 8 | (domain & 0xff)].requests;
+    pthread_mutex_unlock(&stub_mutex);
+
+    return requests;
+}
+
+unsigned long ep11stub_total_requests(void)
+{
+    unsigned long requests;
+
+    stub_init();
+    pthread_mutex_lock(&stub_mutex);
+    requests = stub_total;
+    pthread_mutex_unlock(&stub_mutex);
+
+    return requests;
+}
+
+unsigned int ep11stub_peak_requests(void)
+{
+    unsigned int peak;
+
+    stub_init();
+    pthread_mutex_lock(&stub_mutex);
+    peak = stub_peak;
+    stub_peak = stub_busy;
+    pthread_mutex_unlock(&stub_mutex);
+
+    return peak;
+}
+
+/*
+ * Simulates sending a request to the target: a group target forwards it to
+ * its APQNs round robin, the APQN processes it once one of its request slots
+ * is free.
+ */
+static CK_RV stub_request(target_t target)
+{
+    struct stub_target *tgt;
+    struct stub_apqn *apqn;
+    struct timespec ts;
+
+    stub_init();
+
+    if (target == 0 || target > STUB_MAX_TARGETS)
+        return CKR_ARGUMENTS_BAD;
+
+    pthread_mutex_lock(&stub_mutex);
+
+    tgt = &stub_targets[target - 1];
+    if (!tgt->used || tgt->num_apqns == 0) {
+        pthread_mutex_unlock(&stub_mutex);
+        return CKR_ARGUMENTS_BAD;
+    }
+    apqn = &stub_apqns[tgt->apqns[tgt->next++ % tgt->num_apqns]];
+
+    if (apqn->failed) {
+        pthread_mutex_unlock(&stub_mutex);
+        return CKR_DEVICE_ERROR;
+    }
+
+    while (apqn->busy >= stub_concurrency)
+        pthread_cond_wait(&apqn->cond, &stub_mutex);
+    apqn->busy++;
+    apqn->requests++;
+    stub_total++;
+    if (++stub_busy > stub_peak)
+        stub_peak = stub_busy;
+    pthread_mutex_unlock(&stub_mutex);
+
+    ts.tv_sec = stub_latency / 1000000;
+    ts.tv_nsec = (stub_latency % 1000000) * 1000;
+    nanosleep(&ts, NULL);
+
+    pthread_mutex_lock(&stub_mutex);
+    apqn->busy--;
+    stub_busy--;
+    pthread_cond_signal(&apqn->cond);
+    pthread_mutex_unlock(&stub_mutex);
+
+    return CKR_OK;
+}
+
+/* A stand-in for a signature, depending on the key and the data */
+static void stub_sign(const unsigned char *key, size_t klen,
+                      const CK_BYTE *data, CK_ULONG dlen, CK_BYTE *sig)
+{
+    CK_ULONG i;
+
+    memset(sig, 0x5a, STUB_SIG_LEN);
+    for (i = 0; i < klen; i++)
+        sig[i % STUB_SIG_LEN] ^= key[i];
+    for (i = 0; i < dlen; i++)
+        sig[(i + 7) % STUB_SIG_LEN] += data[i];
+}
+
+static void stub_crypt(const unsigned char *key, size_t klen,
+                       const CK_BYTE *in, CK_ULONG len, CK_BYTE *out)
+{
+    CK_ULONG i;
+
+    for (i = 0; i < len; i++)
+        out[i] = in[i] ^ (klen > 0 ? key[i % klen] : 0) ^ 0xa5;
+}
+
+int m_init(void)
+{
+    stub_init();
+    return 0;
+}
+
+int m_shutdown(void)
+{
+    return 0;
+}
+
+int m_add_backend(const char *name, unsigned int port)
+{
+    (void)name;
+    (void)port;
+    return 0;
+}
+
+int m_add_module(XCP_Module_t module, target_t *target)
+{
+    struct stub_target *tgt;
+    unsigned int domain, i;
+
+    stub_init();
+
+    if (module == NULL || target == NULL)
+        return CKR_ARGUMENTS_BAD;
+
+    pthread_mutex_lock(&stub_mutex);
+
+    if (*target == XCP_TGT_INIT) {
+        for (i = 0; i < STUB_MAX_TARGETS; i++) {
+            if (!stub_targets[i].used)
+                break;
+        }
+        if (i == STUB_MAX_TARGETS) {
+            pthread_mutex_unlock(&stub_mutex);
+            return CKR_HOST_MEMORY;
+        }
+        memset(&stub_targets[i], 0, sizeof(stub_targets[i]));
+        stub_targets[i].used = TRUE;
+        *target = i + 1;
+    } else if (*target == 0 || *target > STUB_MAX_TARGETS ||
+               !stub_targets[*target - 1].used) {
+        pthread_mutex_unlock(&stub_mutex);
+        return CKR_ARGUMENTS_BAD;
+    }
+
+    tgt = &stub_targets[*target - 1];
+    for (domain = 0; domain < 256 && tgt->num_apqns < STUB_MAX_GROUP;
+         domain++) {
+        if (XCPTGTMASK_DOM_IS_SET(module->domainmask, domain))
+            tgt->apqns[tgt->num_apqns++] =
+                                    (module->module_nr & 0xff) << 8 | domain;
+    }
+
+    /* An empty group (APQN_ANY) gets domain 0 of adapters 0 to 3 */
+    if (tgt->num_apqns == 0) {
+        for (i = 0; i < 4; i++)
+            tgt->apqns[tgt->num_apqns++] = i << 8;
+    }
+
+    pthread_mutex_unlock(&stub_mutex);
+    return 0;
+}
+
+int m_rm_module(XCP_Module_t module, target_t target)
+{
+    (void)module;
+
+    if (target == 0 || target > STUB_MAX_TARGETS)
+        return CKR_ARGUMENTS_BAD;
+
+    pthread_mutex_lock(&stub_mutex);
+    stub_targets[target - 1].used = FALSE;
+    pthread_mutex_unlock(&stub_mutex);
+
+    return 0;
+}
+
+CK_RV m_get_xcp_info(CK_VOID_PTR pinfo, CK_ULONG_PTR infbytes,
+                     unsigned int query, unsigned int subquery,
+                     target_t target)
+{
+    CK_IBM_XCP_INFO *module;
+    CK_IBM_DOMAIN_INFO *domain;
+
+    (void)subquery;
+    (void)target;
+
+    switch (query) {
+    case CK_IBM_XCPHQ_VERSION:
+        if (*infbytes < sizeof(unsigned int))
+            return CKR_BUFFER_TOO_SMALL;
+        *(unsigned int *)pinfo = STUB_HOST_VERSION;
+        *infbytes = sizeof(unsigned int);
+        return CKR_OK;
+    case CK_IBM_XCPQ_MODULE:
+        if (*infbytes < sizeof(*module))
+            return CKR_BUFFER_TOO_SMALL;
+        module = pinfo;
+        memset(module, 0, sizeof(*module));
+        module->firmwareApi = STUB_FW_API;
+        module->firmwareVersion.major = STUB_FW_MAJOR;
+        module->firmwareVersion.minor = STUB_FW_MINOR;
+        memcpy(module->serialNumber, "EP11STUB00000000",
+               sizeof(module->serialNumber));
+        module->domains = 256;
+        module->controlPoints = XCP_CP_BYTES * 8;
+        *infbytes = sizeof(*module);
+        return CKR_OK;
+    case CK_IBM_XCPQ_DOMAIN:
+        if (*infbytes < sizeof(*domain))
+            return CKR_BUFFER_TOO_SMALL;
+        domain = pinfo;
+        memset(domain, 0, sizeof(*domain));
+        memset(domain->wk, STUB_WKVP_BYTE, sizeof(domain->wk));
+        domain->flags = CK_IBM_DOM_ACTIVE & ~CK_IBM_DOM_NEXT_WK &
+                        ~CK_IBM_DOM_COMMITTED_NWK;
+        *infbytes = sizeof(*domain);
+        return CKR_OK;
+    default:
+        return CKR_FUNCTION_NOT_SUPPORTED;
+    }
+}
+
+CK_RV m_GenerateRandom(CK_BYTE_PTR rnd, CK_ULONG len, target_t target)
+{
+    CK_ULONG i;
+    CK_RV rc;
+
+    rc = stub_request(target);
+    if (rc != CKR_OK)
+        return rc;
+
+    for (i = 0; i < len; i++)
+        rnd[i] = random();
+
+    return CKR_OK;
+}
+
+CK_RV m_SignSingle(const unsigned char *key, size_t klen,
+                   CK_MECHANISM_PTR pmech, CK_BYTE_PTR data, CK_ULONG dlen,
+                   CK_BYTE_PTR sig, CK_ULONG_PTR slen, target_t target)
+{
+    CK_RV rc;
+
+    (void)pmech;
+
+    if (sig == NULL) {
+        *slen = STUB_SIG_LEN;
+        return CKR_OK;
+    }
+    if (*slen < STUB_SIG_LEN) {
+        *slen = STUB_SIG_LEN;
+        return CKR_BUFFER_TOO_SMALL;
+    }
+
+    rc = stub_request(target);
+    if (rc != CKR_OK)
+        return rc;
+
+    stub_sign(key, klen, data, dlen, sig);
+    *slen = STUB_SIG_LEN;
+
+    return CKR_OK;
+}
+
+CK_RV m_VerifySingle(const unsigned char *key, size_t klen,
+                     CK_MECHANISM_PTR pmech, CK_BYTE_PTR data, CK_ULONG dlen,
+                     CK_BYTE_PTR sig, CK_ULONG slen, target_t target)
+{
+    CK_BYTE expected[STUB_SIG_LEN];
+    CK_RV rc;
+
+    (void)pmech;
+
+    rc = stub_request(target);
+    if (rc != CKR_OK)
+        return rc;
+
+    stub_sign(key, klen, data, dlen, expected);
+    if (slen != STUB_SIG_LEN || memcmp(sig, expected, STUB_SIG_LEN) != 0)
+        return CKR_SIGNATURE_INVALID;
+
+    return CKR_OK;
+}
+
+CK_RV m_EncryptSingle(const unsigned char *key, size_t klen,
+                      CK_MECHANISM_PTR mech, CK_BYTE_PTR plain, CK_ULONG plen,
+                      CK_BYTE_PTR cipher, CK_ULONG_PTR clen, target_t target)
+{
+    CK_RV rc;
+
+    (void)mech;
+
+    if (cipher == NULL) {
+        *clen = plen;
+        return CKR_OK;
+    }
+    if (*clen < plen) {
+        *clen = plen;
+        return CKR_BUFFER_TOO_SMALL;
+    }
+
+    rc = stub_request(target);
+    if (rc != CKR_OK)
+        return rc;
+
+    stub_crypt(key, klen, plain, plen, cipher);
+    *clen = plen;
+
+    return CKR_OK;
+}
+
+CK_RV m_DecryptSingle(const unsigned char *key, size_t klen,
+                      CK_MECHANISM_PTR mech, CK_BYTE_PTR cipher, CK_ULONG clen,
+                      CK_BYTE_PTR plain, CK_ULONG_PTR plen, target_t target)
+{
+    return m_EncryptSingle(key, klen, mech, cipher, clen, plain, plen,
+                           target);
+}
+
+/* Key blobs are random bytes, with the WKVP of all domains at offset 32 */
+CK_RV m_GenerateKey(CK_MECHANISM_PTR pmech, CK_ATTRIBUTE_PTR ptempl,
+                    CK_ULONG templcount, const unsigned char *pin,
+                    size_t pinlen, unsigned char *key, size_t *klen,
+                    unsigned char *csum, size_t *clen, target_t target)
+{
+    size_t i;
+    CK_RV rc;
+
+    (void)pmech;
+    (void)ptempl;
+    (void)templcount;
+    (void)pin;
+    (void)pinlen;
+
+    if (*klen < STUB_BLOB_LEN || *clen < STUB_CSUM_LEN)
+        return CKR_BUFFER_TOO_SMALL;
+
+    rc = stub_request(target);
+    if (rc != CKR_OK)
+        return rc;
+
+    for (i = 0; i < STUB_BLOB_LEN; i++)
+        key[i] = random();
+    memset(key + STUB_BLOB_WKID_OFFSET, STUB_WKVP_BYTE, XCP_WKID_BYTES);
+    *klen = STUB_BLOB_LEN;
+    memset(csum, 0, STUB_CSUM_LEN);
+    *clen = STUB_CSUM_LEN;
+
+    return CKR_OK;
+}
+
+/* Only public key import is simulated: the MACed SPKI is SPKI || MAC */
+CK_RV m_UnwrapKey(const CK_BYTE_PTR wrapped, CK_ULONG wlen,
+                  const unsigned char *kek, size_t keklen,
+                  const unsigned char *mackey, size_t mklen,
+                  const unsigned char *pin, size_t pinlen,
+                  const CK_MECHANISM_PTR uwmech,
+                  const CK_ATTRIBUTE_PTR ptempl, CK_ULONG pcount,
+                  unsigned char *unwrapped, size_t *uwlen,
+                  CK_BYTE_PTR csum, CK_ULONG *cslen, target_t target)
+{
+    CK_RV rc;
+
+    (void)kek;
+    (void)keklen;
+    (void)mackey;
+    (void)mklen;
+    (void)pin;
+    (void)pinlen;
+    (void)ptempl;
+    (void)pcount;
+
+    if (uwmech == NULL || uwmech->mechanism != CKM_IBM_TRANSPORTKEY)
+        return CKR_FUNCTION_NOT_SUPPORTED;
+
+    if (*uwlen < wlen + STUB_MAC_LEN)
+        return CKR_BUFFER_TOO_SMALL;
+
+    rc = stub_request(target);
+    if (rc != CKR_OK)
+        return rc;
+
+    memcpy(unwrapped, wrapped, wlen);
+    stub_sign(wrapped, wlen, NULL, 0, unwrapped + wlen);
+    *uwlen = wlen + STUB_MAC_LEN;
+    if (csum != NULL && cslen != NULL)
+        *cslen = 0;
+
+    return CKR_OK;
+}
+
+/* Blobs carry no attributes */
+CK_RV m_GetAttributeValue(const unsigned char *obj, size_t olen,
+                          CK_ATTRIBUTE_PTR pTemplate, CK_ULONG ulCount,
+                          target_t target)
+{
+    CK_ULONG i;
+    CK_RV rc;
+
+    (void)obj;
+    (void)olen;
+
+    rc = stub_request(target);
+    if (rc != CKR_OK)
+        return rc;
+
+    for (i = 0; i < ulCount; i++)
+        pTemplate[i].ulValueLen = CK_UNAVAILABLE_INFORMATION;
+
+    return CKR_OK;
+}
+
+/* All control points are set */
+CK_RV m_admin(unsigned char *response1, size_t *r1len,
+              unsigned char *response2, size_t *r2len,
+              const unsigned char *cmd, size_t clen,
+              const unsigned char *sigs, size_t slen, target_t target)
+{
+    CK_RV rc;
+
+    (void)response2;
+    (void)r2len;
+    (void)sigs;
+    (void)slen;
+
+    if (clen < sizeof(uint32_t) ||
+        *(const uint32_t *)cmd != XCP_ADMQ_DOM_CTRLPOINTS)
+        return CKR_FUNCTION_NOT_SUPPORTED;
+
+    if (*r1len < XCP_CP_BYTES)
+        return CKR_BUFFER_TOO_SMALL;
+
+    rc = stub_request(target);
+    if (rc != CKR_OK)
+        return rc;
+
+    memset(response1, 0xff, XCP_CP_BYTES);
+    *r1len = XCP_CP_BYTES;
+
+    return CKR_OK;
+}
+
+/* The query block only holds the function, the response only the payload */
+long xcpa_queryblock(unsigned char *blk, size_t blen, unsigned int fn,
+                     target_t domain, const unsigned char *payload,
+                     size_t plen)
+{
+    (void)domain;
+    (void)payload;
+    (void)plen;
+
+    if (blen < sizeof(uint32_t))
+        return -1;
+
+    *(uint32_t *)blk = fn;
+    return sizeof(uint32_t);
+}
+
+long xcpa_internal_rv(const unsigned char *rsp, size_t rlen,
+                      struct XCPadmresp *rspblk, CK_RV *rv)
+{
+    rspblk->payload = rsp;
+    rspblk->pllen = rlen;
+    rspblk->rv = CKR_OK;
+    *rv = CKR_OK;
+
+    return rlen;
+}
+
+/* Not simulated */
+
+CK_RV m_SeedRandom(CK_BYTE_PTR pSeed, CK_ULONG ulSeedLen, target_t target)
+{
+    (void)pSeed;
+    (void)ulSeedLen;
+    (void)target;
+    return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+CK_RV m_DigestInit(unsigned char *state, size_t *len,
+                   const CK_MECHANISM_PTR pmech, target_t target)
+{
+    (void)state;
+    (void)len;
+    (void)pmech;
+    (void)target;
+    return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+CK_RV m_Digest(const unsigned char *state, size_t slen, CK_BYTE_PTR data,
+               CK_ULONG len, CK_BYTE_PTR digest, CK_ULONG_PTR dglen,
+               target_t target)
+{
+    (void)state;
+    (void)slen;
+    (void)data;
+    (void)len;
+    (void)digest;
+    (void)dglen;
+    (void)target;
+    return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+CK_RV m_DigestUpdate(unsigned char *state, size_t slen, CK_BYTE_PTR data,
+                     CK_ULONG dlen, target_t target)
+{
+    (void)state;
+    (void)slen;
+    (void)data;
+    (void)dlen;
+    (void)target;
+    return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+CK_RV m_DigestKey(unsigned char *state, size_t slen, const unsigned char *key,
+                  size_t klen, target_t target)
+{
+    (void)state;
+    (void)slen;
+    (void)key;
+    (void)klen;
+    (void)target;
+    return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+CK_RV m_DigestFinal(const unsigned char *state, size_t slen,
+                    CK_BYTE_PTR digest, CK_ULONG_PTR dlen, target_t target)
+{
+    (void)state;
+    (void)slen;
+    (void)digest;
+    (void)dlen;
+    (void)target;
+    return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+CK_RV m_DigestSingle(CK_MECHANISM_PTR pmech, CK_BYTE_PTR data, CK_ULONG len,
+                     CK_BYTE_PTR digest, CK_ULONG_PTR dlen, target_t target)
+{
+    (void)pmech;
+    (void)data;
+    (void)len;
+    (void)digest;
+    (void)dlen;
+    (void)target;
+    return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+CK_RV m_EncryptInit(unsigned char *state, size_t *slen, CK_MECHANISM_PTR pmech,
+                    const unsigned char *key, size_t klen, target_t target)
+{
+    (void)state;
+    (void)slen;
+    (void)pmech;
+    (void)key;
+    (void)klen;
+    (void)target;
+    return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+CK_RV m_DecryptInit(unsigned char *state, size_t *slen, CK_MECHANISM_PTR pmech,
+                    const unsigned char *key, size_t klen, target_t target)
+{
+    (void)state;
+    (void)slen;
+    (void)pmech;
+    (void)key;
+    (void)klen;
+    (void)target;
+    return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+CK_RV m_EncryptUpdate(unsigned char *state, size_t slen, CK_BYTE_PTR plain,
+                      CK_ULONG plen, CK_BYTE_PTR cipher, CK_ULONG_PTR clen,
+                      target_t target)
+{
+    (void)state;
+    (void)slen;
+    (void)plain;
+    (void)plen;
+    (void)cipher;
+    (void)clen;
+    (void)target;
+    return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+CK_RV m_DecryptUpdate(unsigned char *state, size_t slen, CK_BYTE_PTR cipher,
+                      CK_ULONG clen, CK_BYTE_PTR plain, CK_ULONG_PTR plen,
+                      target_t target)
+{
+    (void)state;
+    (void)slen;
+    (void)cipher;
+    (void)clen;
+    (void)plain;
+    (void)plen;
+    (void)target;
+    return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+CK_RV m_Encrypt(const unsigned char *state, size_t slen, CK_BYTE_PTR plain,
+                CK_ULONG plen, CK_BYTE_PTR cipher, CK_ULONG_PTR clen,
+                target_t target)
+{
+    (void)state;
+    (void)slen;
+    (void)plain;
+    (void)plen;
+    (void)cipher;
+    (void)clen;
+    (void)target;
+    return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+CK_RV m_Decrypt(const unsigned char *state, size_t slen, CK_BYTE_PTR cipher,
+                CK_ULONG clen, CK_BYTE_PTR plain, CK_ULONG_PTR plen,
+                target_t target)
+{
+    (void)state;
+    (void)slen;
+    (void)cipher;
+    (void)clen;
+    (void)plain;
+    (void)plen;
+    (void)target;
+    return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+CK_RV m_EncryptFinal(const unsigned char *state, size_t slen,
+                     CK_BYTE_PTR output, CK_ULONG_PTR len, target_t target)
+{
+    (void)state;
+    (void)slen;
+    (void)output;
+    (void)len;
+    (void)target;
+    return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+CK_RV m_DecryptFinal(const unsigned char *state, size_t slen,
+                     CK_BYTE_PTR output, CK_ULONG_PTR len, target_t target)
+{
+    (void)state;
+    (void)slen;
+    (void)output;
+    (void)len;
+    (void)target;
+    return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+CK_RV m_ReencryptSingle(const unsigned char *dkey, size_t dklen,
+                        const unsigned char *ekey, size_t eklen,
+                        CK_MECHANISM_PTR pdecrmech, CK_MECHANISM_PTR pencrmech,
+                        CK_BYTE_PTR in, CK_ULONG ilen,
+                        CK_BYTE_PTR out, CK_ULONG_PTR olen, target_t target)
+{
+    (void)dkey;
+    (void)dklen;
+    (void)ekey;
+    (void)eklen;
+    (void)pdecrmech;
+    (void)pencrmech;
+    (void)in;
+    (void)ilen;
+    (void)out;
+    (void)olen;
+    (void)target;
+    return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+CK_RV m_GenerateKeyPair(CK_MECHANISM_PTR pmech, CK_ATTRIBUTE_PTR ppublic,
+                        CK_ULONG pubattrs, CK_ATTRIBUTE_PTR pprivate,
+                        CK_ULONG prvattrs, const unsigned char *pin,
+                        size_t pinlen, unsigned char *key, size_t *klen,
+                        unsigned char *pubkey, size_t *pklen, target_t target)
+{
+    (void)pmech;
+    (void)ppublic;
+    (void)pubattrs;
+    (void)pprivate;
+    (void)prvattrs;
+    (void)pin;
+    (void)pinlen;
+    (void)key;
+    (void)klen;
+    (void)pubkey;
+    (void)pklen;
+    (void)target;
+    return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+CK_RV m_SignInit(unsigned char *state, size_t *slen, CK_MECHANISM_PTR alg,
+                 const unsigned char *key, size_t klen, target_t target)
+{
+    (void)state;
+    (void)slen;
+    (void)alg;
+    (void)key;
+    (void)klen;
+    (void)target;
+    return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+CK_RV m_VerifyInit(unsigned char *state, size_t *slen, CK_MECHANISM_PTR alg,
+                   const unsigned char *key, size_t klen, target_t target)
+{
+    (void)state;
+    (void)slen;
+    (void)alg;
+    (void)key;
+    (void)klen;
+    (void)target;
+    return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+CK_RV m_SignUpdate(unsigned char *state, size_t slen, CK_BYTE_PTR data,
+                   CK_ULONG dlen, target_t target)
+{
+    (void)state;
+    (void)slen;
+    (void)data;
+    (void)dlen;
+    (void)target;
+    return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+CK_RV m_VerifyUpdate(unsigned char *state, size_t slen, CK_BYTE_PTR data,
+                     CK_ULONG dlen, target_t target)
+{
+    (void)state;
+    (void)slen;
+    (void)data;
+    (void)dlen;
+    (void)target;
+    return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+CK_RV m_SignFinal(const unsigned char *state, size_t stlen, CK_BYTE_PTR sig,
+                  CK_ULONG_PTR siglen, target_t target)
+{
+    (void)state;
+    (void)stlen;
+    (void)sig;
+    (void)siglen;
+    (void)target;
+    return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+CK_RV m_VerifyFinal(const unsigned char *state, size_t stlen, CK_BYTE_PTR sig,
+                    CK_ULONG siglen, target_t target)
+{
+    (void)state;
+    (void)stlen;
+    (void)sig;
+    (void)siglen;
+    (void)target;
+    return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+CK_RV m_Sign(const unsigned char *state, size_t stlen, CK_BYTE_PTR data,
+             CK_ULONG dlen, CK_BYTE_PTR sig, CK_ULONG_PTR siglen,
+             target_t target)
+{
+    (void)state;
+    (void)stlen;
+    (void)data;
+    (void)dlen;
+    (void)sig;
+    (void)siglen;
+    (void)target;
+    return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+CK_RV m_Verify(const unsigned char *state, size_t stlen, CK_BYTE_PTR data,
+               CK_ULONG dlen, CK_BYTE_PTR sig, CK_ULONG siglen,
+               target_t target)
+{
+    (void)state;
+    (void)stlen;
+    (void)data;
+    (void)dlen;
+    (void)sig;
+    (void)siglen;
+    (void)target;
+    return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+CK_RV m_WrapKey(const unsigned char *key, size_t keylen,
+                const unsigned char *kek, size_t keklen,
+                const unsigned char *mackey, size_t mklen,
+                const CK_MECHANISM_PTR pmech, CK_BYTE_PTR wrapped,
+                CK_ULONG_PTR wlen, target_t target)
+{
+    (void)key;
+    (void)keylen;
+    (void)kek;
+    (void)keklen;
+    (void)mackey;
+    (void)mklen;
+    (void)pmech;
+    (void)wrapped;
+    (void)wlen;
+    (void)target;
+    return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+CK_RV m_DeriveKey(CK_MECHANISM_PTR pderivemech, CK_ATTRIBUTE_PTR ptempl,
+                  CK_ULONG templcount, const unsigned char *basekey,
+                  size_t bklen, const unsigned char *data, size_t dlen,
+                  const unsigned char *pin, size_t pinlen,
+                  unsigned char *newkey, size_t *nklen,
+                  unsigned char *csum, size_t *cslen, target_t target)
+{
+    (void)pderivemech;
+    (void)ptempl;
+    (void)templcount;
+    (void)basekey;
+    (void)bklen;
+    (void)data;
+    (void)dlen;
+    (void)pin;
+    (void)pinlen;
+    (void)newkey;
+    (void)nklen;
+    (void)csum;
+    (void)cslen;
+    (void)target;
+    return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+CK_RV m_GetMechanismList(CK_SLOT_ID slot, CK_MECHANISM_TYPE_PTR mechs,
+                         CK_ULONG_PTR count, target_t target)
+{
+    (void)slot;
+    (void)mechs;
+    (void)count;
+    (void)target;
+    return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+CK_RV m_GetMechanismInfo(CK_SLOT_ID slot, CK_MECHANISM_TYPE mech,
+                         CK_MECHANISM_INFO_PTR pmechinfo, target_t target)
+{
+    (void)slot;
+    (void)mech;
+    (void)pmechinfo;
+    (void)target;
+    return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+CK_RV m_SetAttributeValue(unsigned char *obj, size_t olen,
+                          CK_ATTRIBUTE_PTR pTemplate, CK_ULONG ulCount,
+                          target_t target)
+{
+    (void)obj;
+    (void)olen;
+    (void)pTemplate;
+    (void)ulCount;
+    (void)target;
+    return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+CK_RV m_Login(CK_UTF8CHAR_PTR pin, CK_ULONG pinlen, const unsigned char *nonce,
+              size_t nlen, unsigned char *pinblob, size_t *pinbloblen,
+              target_t target)
+{
+    (void)pin;
+    (void)pinlen;
+    (void)nonce;
+    (void)nlen;
+    (void)pinblob;
+    (void)pinbloblen;
+    (void)target;
+    return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
+CK_RV m_Logout(const unsigned char *pin, size_t len, target_t target)
+{
+    (void)pin;
+    (void)len;
+    (void)target;
+    return CKR_FUNCTION_NOT_SUPPORTED;
+}
+
@@ -0,0 +1,28 @@
+/*
+ * COPYRIGHT (c) International Business Machines Corp. 2024
+ *
+ * This program is provided under the terms of the Common Public License,
+ * version 1.0 (CPL-1.0). Any use, reproduction or distribution for this
+ * software constitutes recipient's acceptance of CPL-1.0 terms which can be
+ * found in the file LICENSE file or at
+ * https://opensource.org/licenses/cpl1.0.php
+ */
+
+/*
+ * Control interface of the simulated EP11 host library, see ep11stub.c.
+ */
+
+#ifndef EP11STUB_H
+#define EP11STUB_H
+
+void ep11stub_set_latency(unsigned int usecs);
+void ep11stub_set_concurrency(unsigned int requests);
+void ep11stub_set_failed(unsigned int adapter, unsigned int domain,
+                         int failed);
+unsigned long ep11stub_requests(unsigned int adapter, unsigned int domain);
+/* Number of requests processed by all APQNs */
+unsigned long ep11stub_total_requests(void);
+/* Highest number of requests processed at the same time since the last call */
+unsigned int ep11stub_peak_requests(void);
+
+#endif
@@ -16,6 +16,7 @@
 #include <unistd.h>
 #include <getopt.h>
 #include <limits.h>
+#include <time.h>
 
 static int testhashcollisionexpansion(void)
 {
@@ -148,6 +149,146 @@ static int testhashrandom(unsigned long seed, unsigned long iterations)
     return res;
 }
 
+static int testhashdelete(void)
+{
+    union hashmap_value val;
+    struct hashmap *h;
+    unsigned long i;
+    int res = 0;
+
+    h = hashmap_new();
+    if (!h) {
+        fprintf(stderr, "Could not allocate hashmap\n");
+        return -1;
+    }
+    /* Clustered keys (like vendor defined mechanisms) including the
+       largest key to exercise long probe sequences. */
+    for (i = 0; i < 1000; ++i) {
+        val.ulVal = i;
+        if (hashmap_add(h, CKM_VENDOR_DEFINED + i, val, NULL) ||
+            hashmap_add(h, ULONG_MAX - i, val, NULL)) {
+            fprintf(stderr, "Failed to add element %lu to hash\n", i);
+            res = -1;
+            goto out;
+        }
+    }
+    for (i = 0; i < 1000; i += 2) {
+        if (!hashmap_delete(h, CKM_VENDOR_DEFINED + i, &val) ||
+            val.ulVal != i) {
+            fprintf(stderr, "Failed to delete element %lu from hash\n", i);
+            res = -1;
+            goto out;
+        }
+        if (hashmap_delete(h, CKM_VENDOR_DEFINED + i, NULL)) {
+            fprintf(stderr, "Deleted element %lu twice\n", i);
+            res = -1;
+            goto out;
+        }
+    }
+    for (i = 0; i < 1000; ++i) {
+        if (hashmap_find(h, CKM_VENDOR_DEFINED + i, &val) != (int)(i & 1) ||
+            ((i & 1) && val.ulVal != i)) {
+            fprintf(stderr, "Wrong search result for %lu after delete\n", i);
+            res = -1;
+            goto out;
+        }
+        if (!hashmap_find(h, ULONG_MAX - i, &val) || val.ulVal != i) {
+            fprintf(stderr, "Lost element %lu after delete\n", ULONG_MAX - i);
+            res = -1;
+            goto out;
+        }
+    }
+ out:
+    hashmap_free(h, NULL);
+    return res;
+}
+
+static double elapsedns(const struct timespec *start)
+{
+    struct timespec end;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1e9 +
+        (end.tv_nsec - start->tv_nsec);
+}
+
+/*
+ * Compare lookup performance for clustered key sets (as found in
+ * mechanism and attribute numbers) with random keys.  With a good hash
+ * function all key sets should perform alike.  Informational only.
+ */
+static int testhashperformance(unsigned long seed, unsigned long iterations)
+{
+    static const char *names[] =
+        { "random", "consecutive", "vendor range", "stride 0x100" };
+    unsigned long i, k, r, rounds, *keys, found;
+    union hashmap_value val = { .ulVal = 0 };
+    struct timespec start;
+    double addns, findns;
+    struct hashmap *h;
+    int res = 0;
+
+    keys = calloc(iterations, sizeof(unsigned long));
+    if (!keys) {
+        fprintf(stderr, "Failed to allocate key array\n");
+        return -1;
+    }
+    rounds = 1000000 / iterations + 1;
+    srandom(seed);
+    for (k = 0; k < ARRAYSIZE(names); ++k) {
+        for (i = 0; i < iterations; ++i) {
+            switch (k) {
+            case 0:
+                keys[i] = random();
+                break;
+            case 1:
+                keys[i] = i;
+                break;
+            case 2:
+                keys[i] = CKM_VENDOR_DEFINED + 0x10000 + i;
+                break;
+            default:
+                keys[i] = i << 8;
+                break;
+            }
+        }
+        h = hashmap_new();
+        if (!h) {
+            fprintf(stderr, "Could not allocate hashmap\n");
+            res = -1;
+            break;
+        }
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (i = 0; i < iterations; ++i) {
+            if (hashmap_add(h, keys[i], val, NULL)) {
+                fprintf(stderr, "Failed to add %lu to hash\n", keys[i]);
+                res = -1;
+                break;
+            }
+        }
+        addns = elapsedns(&start) / iterations;
+        found = 0;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (r = 0; r < rounds; ++r) {
+            for (i = 0; i < iterations; ++i)
+                found += hashmap_find(h, keys[i], NULL);
+        }
+        findns = elapsedns(&start) / (rounds * iterations);
+        hashmap_free(h, NULL);
+        if (res)
+            break;
+        if (found != rounds * iterations) {
+            fprintf(stderr, "Lost elements in %s key set\n", names[k]);
+            res = -1;
+            break;
+        }
+        fprintf(stderr, "%-14s keys: add %6.1f ns/op, find %6.1f ns/op\n",
+                names[k], addns, findns);
+    }
+    free(keys);
+    return res;
+}
+
 static int parseulong(const char *str, unsigned long *res)
 {
     unsigned long tmp;
@@ -202,6 +343,9 @@ int main(int argc, char **argv)
         return TEST_FAIL;
     if (testhashrandom(seed, iterations))
         return TEST_FAIL;
-    /* hashmap_delete function is untested since it is unused so far */
+    if (testhashdelete())
+        return TEST_FAIL;
+    if (testhashperformance(seed, iterations))
+        return TEST_FAIL;
     return TEST_PASS;
 }
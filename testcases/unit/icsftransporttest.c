@@ -0,0 +1,595 @@
+/*
+ * COPYRIGHT (c) International Business Machines Corp. 2024
+ *
+ * This program is provided under the terms of the Common Public License,
+ * version 1.0 (CPL-1.0). Any use, reproduction or distribution for this
+ * software constitutes recipient's acceptance of CPL-1.0 terms which can be
+ * found in the file LICENSE file or at
+ * https://opensource.org/licenses/cpl1.0.php
+ */
+
+/*
+ * Test of the ICSF token LDAP transport against a local stand-in server.
+ *
+ * The stand-in server accepts simple binds and answers ICSF extended
+ * operations after an injected latency. Every request is answered from its
+ * own thread, so responses are returned out of order. The ICSF reason code
+ * of a response echoes a number that is encoded in the token name of the
+ * request, which allows to check that every caller receives its own
+ * response when several threads share one LDAP connection. Requests for
+ * token "ATTRS" are answered with a fixed attribute list.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include <lber.h>
+#include <ldap.h>
+
+#include "icsf.h"
+#include "unittest.h"
+
+#define LATENCY_MS          50
+#define SEQUENTIAL_CALLS    4
+#define THREADS             8
+#define CALLS_PER_THREAD    4
+
+#define LDAP_TAG_BIND_REQUEST       0x60
+#define LDAP_TAG_BIND_RESPONSE      0x61
+#define LDAP_TAG_UNBIND_REQUEST     0x42
+#define LDAP_TAG_EXTENDED_REQUEST   0x77
+#define LDAP_TAG_EXTENDED_RESPONSE  0x78
+#define LDAP_TAG_EXOP_RES_VALUE     0x8b
+
+struct server {
+    int fd;
+    int port;
+    pthread_t thread;
+};
+
+struct connection {
+    int fd;
+    pthread_mutex_t write_mutex;
+    unsigned int refs;
+};
+
+struct reply {
+    struct connection *conn;
+    int msgid;
+    int reason;
+    char handle[ICSF_HANDLE_LEN];
+};
+
+struct client {
+    LDAP *ld;
+    int first;
+    int count;
+    int errors;
+};
+
+static double elapsed_ms(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1000.0 +
+           (now.tv_nsec - start->tv_nsec) / 1000000.0;
+}
+
+static int read_full(int fd, unsigned char *buf, size_t len)
+{
+    ssize_t n;
+
+    while (len > 0) {
+        n = read(fd, buf, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        buf += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+static int write_full(int fd, const char *buf, size_t len)
+{
+    ssize_t n;
+
+    while (len > 0) {
+        n = write(fd, buf, len);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        buf += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+/* Read one BER encoded LDAP message from the connection. */
+static int read_message(int fd, struct berval *bv)
+{
+    unsigned char hdr[2 + sizeof(ber_len_t)];
+    size_t hdr_len = 2, len = 0, i;
+
+    if (read_full(fd, hdr, 2))
+        return -1;
+
+    if (hdr[1] & 0x80) {
+        size_t n = hdr[1] & 0x7f;
+
+        if (n == 0 || n > sizeof(ber_len_t) || read_full(fd, hdr + 2, n))
+            return -1;
+        for (i = 0; i < n; i++)
+            len = (len << 8) | hdr[2 + i];
+        hdr_len += n;
+    } else {
+        len = hdr[1];
+    }
+
+    bv->bv_len = hdr_len + len;
+    bv->bv_val = malloc(bv->bv_len);
+    if (bv->bv_val == NULL)
+        return -1;
+    memcpy(bv->bv_val, hdr, hdr_len);
+    if (read_full(fd, (unsigned char *)bv->bv_val + hdr_len, len)) {
+        free(bv->bv_val);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int write_message(struct connection *conn, BerElement *ber)
+{
+    struct berval *bv = NULL;
+    int rc;
+
+    if (ber_flatten(ber, &bv))
+        return -1;
+
+    pthread_mutex_lock(&conn->write_mutex);
+    rc = write_full(conn->fd, bv->bv_val, bv->bv_len);
+    pthread_mutex_unlock(&conn->write_mutex);
+
+    ber_bvfree(bv);
+    return rc;
+}
+
+static void put_connection(struct connection *conn)
+{
+    int last;
+
+    pthread_mutex_lock(&conn->write_mutex);
+    last = (--conn->refs == 0);
+    pthread_mutex_unlock(&conn->write_mutex);
+
+    if (last) {
+        close(conn->fd);
+        pthread_mutex_destroy(&conn->write_mutex);
+        free(conn);
+    }
+}
+
+/* Send the ICSF response for a request after the injected latency. */
+static void *reply_thread(void *arg)
+{
+    struct reply *reply = arg;
+    BerElement *icsf = NULL, *msg = NULL;
+    struct berval *value = NULL;
+
+    usleep(LATENCY_MS * 1000);
+
+    icsf = ber_alloc_t(LBER_USE_DER);
+    if (icsf == NULL)
+        goto out;
+    if (reply->handle[0] == 'A') {
+        /* GAV response with an integer and two octet string attributes */
+        if (ber_printf(icsf, "{iiioot{{{iti}{ito}{ito}}i}}", 1,
+                       ICSF_RC_SUCCESS, 0, "", (ber_len_t)0, reply->handle,
+                       (ber_len_t)sizeof(reply->handle),
+                       (ber_tag_t)(LBER_CLASS_CONTEXT | LBER_CONSTRUCTED |
+                                   ICSF_TAG_CSFPGAV),
+                       (ber_int_t)CKA_CLASS, (ber_tag_t)0x81,
+                       (ber_int_t)CKO_SECRET_KEY,
+                       (ber_int_t)CKA_LABEL, (ber_tag_t)0x80,
+                       "label", (ber_len_t)5,
+                       (ber_int_t)CKA_VALUE, (ber_tag_t)0x80,
+                       "0123456789abcdef", (ber_len_t)16, 3) < 0)
+            goto out;
+    } else {
+        if (ber_printf(icsf, "{iiioo}", 1, ICSF_RC_SUCCESS, reply->reason,
+                       "", (ber_len_t)0, reply->handle,
+                       (ber_len_t)sizeof(reply->handle)) < 0)
+            goto out;
+    }
+    if (ber_flatten(icsf, &value))
+        goto out;
+
+    msg = ber_alloc_t(LBER_USE_DER);
+    if (msg == NULL ||
+        ber_printf(msg, "{it{essto}}", reply->msgid,
+                   (ber_tag_t)LDAP_TAG_EXTENDED_RESPONSE, LDAP_SUCCESS, "", "",
+                   (ber_tag_t)LDAP_TAG_EXOP_RES_VALUE, value->bv_val,
+                   value->bv_len) < 0)
+        goto out;
+
+    write_message(reply->conn, msg);
+
+out:
+    if (value)
+        ber_bvfree(value);
+    if (icsf)
+        ber_free(icsf, 1);
+    if (msg)
+        ber_free(msg, 1);
+    put_connection(reply->conn);
+    free(reply);
+    return NULL;
+}
+
+static int handle_extended_request(struct connection *conn, int msgid,
+                                   BerElement *ber)
+{
+    struct berval oid = { 0, NULL }, value = { 0, NULL };
+    struct berval handle = { 0, NULL };
+    BerElement *req = NULL;
+    struct reply *reply = NULL;
+    pthread_t thread;
+    ber_int_t version;
+    int rc = -1;
+
+    if (ber_scanf(ber, "{oo}", &oid, &value) == LBER_ERROR)
+        goto out;
+
+    req = ber_init(&value);
+    if (req == NULL || ber_scanf(req, "{ixo", &version, &handle) == LBER_ERROR)
+        goto out;
+
+    reply = calloc(1, sizeof(*reply));
+    if (reply == NULL)
+        goto out;
+    reply->conn = conn;
+    reply->msgid = msgid;
+    memcpy(reply->handle, handle.bv_val,
+           handle.bv_len < sizeof(reply->handle) ?
+           handle.bv_len : sizeof(reply->handle));
+    /* The token name is "T<number>", the number is echoed as reason code */
+    if (sscanf(reply->handle, "T%d", &reply->reason) != 1)
+        reply->reason = -1;
+
+    pthread_mutex_lock(&conn->write_mutex);
+    conn->refs++;
+    pthread_mutex_unlock(&conn->write_mutex);
+
+    if (pthread_create(&thread, NULL, reply_thread, reply) != 0) {
+        put_connection(conn);
+        free(reply);
+        goto out;
+    }
+    pthread_detach(thread);
+    rc = 0;
+
+out:
+    if (req)
+        ber_free(req, 1);
+    ber_memfree(oid.bv_val);
+    ber_memfree(value.bv_val);
+    ber_memfree(handle.bv_val);
+    return rc;
+}
+
+static void *connection_thread(void *arg)
+{
+    struct connection *conn = arg;
+    struct berval bv;
+    BerElement *ber, *res;
+    ber_int_t msgid;
+    ber_tag_t tag;
+    int rc;
+
+    while (read_message(conn->fd, &bv) == 0) {
+        ber = ber_init(&bv);
+        free(bv.bv_val);
+        if (ber == NULL)
+            break;
+
+        rc = -1;
+        if (ber_scanf(ber, "{it", &msgid, &tag) != LBER_ERROR) {
+            switch (tag) {
+            case LDAP_TAG_BIND_REQUEST:
+                res = ber_alloc_t(LBER_USE_DER);
+                if (res != NULL &&
+                    ber_printf(res, "{it{ess}}", msgid,
+                               (ber_tag_t)LDAP_TAG_BIND_RESPONSE,
+                               LDAP_SUCCESS, "", "") >= 0)
+                    rc = write_message(conn, res);
+                if (res != NULL)
+                    ber_free(res, 1);
+                break;
+            case LDAP_TAG_EXTENDED_REQUEST:
+                rc = handle_extended_request(conn, msgid, ber);
+                break;
+            case LDAP_TAG_UNBIND_REQUEST:
+            default:
+                break;
+            }
+        }
+        ber_free(ber, 1);
+
+        if (rc != 0)
+            break;
+    }
+
+    shutdown(conn->fd, SHUT_RDWR);
+    put_connection(conn);
+    return NULL;
+}
+
+static void *accept_thread(void *arg)
+{
+    struct server *server = arg;
+    struct connection *conn;
+    pthread_t thread;
+    int fd;
+
+    while ((fd = accept(server->fd, NULL, NULL)) >= 0) {
+        conn = calloc(1, sizeof(*conn));
+        if (conn == NULL) {
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+        conn->refs = 1;
+        pthread_mutex_init(&conn->write_mutex, NULL);
+
+        if (pthread_create(&thread, NULL, connection_thread, conn) != 0) {
+            put_connection(conn);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+
+    return NULL;
+}
+
+static int start_server(struct server *server)
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+
+    server->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (server->fd < 0)
+        return -1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+
+    if (bind(server->fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+        listen(server->fd, 16) != 0 ||
+        getsockname(server->fd, (struct sockaddr *)&addr, &len) != 0) {
+        close(server->fd);
+        return -1;
+    }
+    server->port = ntohs(addr.sin_port);
+
+    if (pthread_create(&server->thread, NULL, accept_thread, server) != 0) {
+        close(server->fd);
+        return -1;
+    }
+
+    return 0;
+}
+
+static void stop_server(struct server *server)
+{
+    shutdown(server->fd, SHUT_RDWR);
+    pthread_join(server->thread, NULL);
+    close(server->fd);
+}
+
+static void *client_thread(void *arg)
+{
+    struct client *client = arg;
+    char token_name[ICSF_TOKEN_NAME_LEN + 1];
+    int i, rc, reason;
+
+    for (i = 0; i < client->count; i++) {
+        snprintf(token_name, sizeof(token_name), "T%d", client->first + i);
+        reason = 0;
+        rc = icsf_destroy_token(client->ld, &reason, token_name);
+        if (rc != ICSF_RC_SUCCESS || reason != client->first + i) {
+            fprintf(stderr, "call %d: rc=%d reason=%d\n",
+                    client->first + i, rc, reason);
+            client->errors++;
+        }
+    }
+
+    return NULL;
+}
+
+static int test_sequential(LDAP *ld)
+{
+    struct client client = { ld, 1000, SEQUENTIAL_CALLS, 0 };
+    struct timespec start;
+    double ms;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    client_thread(&client);
+    ms = elapsed_ms(&start);
+
+    printf("sequential: %d calls in %.1f ms (latency %d ms)\n",
+           SEQUENTIAL_CALLS, ms, LATENCY_MS);
+
+    return client.errors ? -1 : 0;
+}
+
+static int test_pipelined(LDAP *ld)
+{
+    struct client clients[THREADS];
+    pthread_t threads[THREADS];
+    struct timespec start;
+    int i, errors = 0, started;
+    double ms, serialized = (double)THREADS * CALLS_PER_THREAD * LATENCY_MS;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (started = 0; started < THREADS; started++) {
+        clients[started].ld = ld;
+        clients[started].first = started * CALLS_PER_THREAD;
+        clients[started].count = CALLS_PER_THREAD;
+        clients[started].errors = 0;
+        if (pthread_create(&threads[started], NULL, client_thread,
+                           &clients[started]) != 0) {
+            errors++;
+            break;
+        }
+    }
+    for (i = 0; i < started; i++) {
+        pthread_join(threads[i], NULL);
+        errors += clients[i].errors;
+    }
+    ms = elapsed_ms(&start);
+
+    printf("pipelined: %d threads x %d calls on one connection in %.1f ms "
+           "(%.1f ms if serialized)\n", THREADS, CALLS_PER_THREAD, ms,
+           serialized);
+
+    if (errors) {
+        fprintf(stderr, "pipelined: %d calls failed or got a wrong response\n",
+                errors);
+        return -1;
+    }
+
+    /* The requests of all threads must overlap on the connection */
+    if (ms > serialized / 2) {
+        fprintf(stderr, "pipelined: requests were not pipelined\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+static int test_get_attribute_collect(LDAP *ld)
+{
+    struct icsf_object_record object;
+    CK_OBJECT_CLASS class = 0;
+    CK_ATTRIBUTE attrs[] = {
+        { CKA_CLASS, &class, sizeof(class) },
+    };
+    CK_ATTRIBUTE_TYPE types[] = { CKA_LABEL, CKA_CLASS, CKA_ID };
+    CK_ATTRIBUTE *collected = NULL;
+    CK_ULONG collected_len = 0, i;
+    int rc, reason = 0, ok = 1;
+
+    memset(&object, 0, sizeof(object));
+    strcpy(object.token_name, "ATTRS");
+    object.id = ICSF_TOKEN_OBJECT;
+
+    rc = icsf_get_attribute_collect(ld, &reason, &object, attrs, 1, types,
+                                    ARRAYSIZE(types), &collected,
+                                    &collected_len);
+    if (rc != 0) {
+        fprintf(stderr, "get attribute: rc=%d reason=%d\n", rc, reason);
+        return -1;
+    }
+
+    if (class != CKO_SECRET_KEY || attrs[0].ulValueLen != sizeof(class))
+        ok = 0;
+
+    /* CKA_CLASS and CKA_LABEL are collected, CKA_ID does not exist */
+    if (collected_len != 2)
+        ok = 0;
+    for (i = 0; i < collected_len; i++) {
+        if (collected[i].type == CKA_CLASS) {
+            if (collected[i].ulValueLen != sizeof(CK_ULONG) ||
+                *(CK_ULONG *)collected[i].pValue != CKO_SECRET_KEY)
+                ok = 0;
+        } else if (collected[i].type == CKA_LABEL) {
+            if (collected[i].ulValueLen != 5 ||
+                memcmp(collected[i].pValue, "label", 5) != 0)
+                ok = 0;
+        } else {
+            ok = 0;
+        }
+        free(collected[i].pValue);
+    }
+    free(collected);
+
+    printf("get attribute: %s\n", ok ? "ok" : "unexpected attributes");
+
+    return ok ? 0 : -1;
+}
+
+/*
+ * A request times out after the LDAP_OPT_TIMEOUT of the handle, and the
+ * caller does not wait for the late response.
+ */
+static int test_timeout(LDAP *ld)
+{
+    struct timeval timeout = { 0, LATENCY_MS * 1000 / 5 };
+    struct timespec start;
+    int rc, reason = 0;
+    double ms;
+
+    if (ldap_set_option(ld, LDAP_OPT_TIMEOUT, &timeout) != LDAP_OPT_SUCCESS) {
+        fprintf(stderr, "timeout: failed to set the timeout\n");
+        return -1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    rc = icsf_destroy_token(ld, &reason, "T1");
+    ms = elapsed_ms(&start);
+
+    printf("timeout: call failed with rc=%d after %.1f ms\n", rc, ms);
+
+    if (rc == ICSF_RC_SUCCESS || ms >= LATENCY_MS) {
+        fprintf(stderr, "timeout: the call did not time out\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+int main(void)
+{
+    struct server server;
+    char uri[64];
+    LDAP *ld = NULL;
+    int rc = TEST_PASS;
+
+    if (start_server(&server) != 0) {
+        fprintf(stderr, "Failed to start the LDAP stand-in server\n");
+        return TEST_SKIP;
+    }
+
+    snprintf(uri, sizeof(uri), "ldap://127.0.0.1:%d", server.port);
+    if (icsf_login(&ld, uri, "cn=test", "secret") != 0) {
+        fprintf(stderr, "Failed to bind to the LDAP stand-in server\n");
+        rc = TEST_FAIL;
+        goto out;
+    }
+
+    if (test_sequential(ld) != 0 || test_pipelined(ld) != 0 ||
+        test_get_attribute_collect(ld) != 0 || test_timeout(ld) != 0)
+        rc = TEST_FAIL;
+
+    icsf_logout(ld);
+
+out:
+    stop_server(&server);
+    return rc;
+}
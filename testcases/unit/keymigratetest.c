@@ -0,0 +1,216 @@
+/*
+ * COPYRIGHT (c) International Business Machines Corp. 2024
+ *
+ * This program is provided under the terms of the Common Public License,
+ * version 1.0 (CPL-1.0). Any use, reproduction or distribution for this
+ * software constitutes recipient's acceptance of CPL-1.0 terms which can be
+ * found in the file LICENSE file or at
+ * https://opensource.org/licenses/cpl1.0.php
+ */
+
+/*
+ * Test of the parallel key migration engine against a stub function list.
+ * The re-encipher function simulates the latency of the crypto adapter.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pkcs11types.h"
+#include "key_migrate.h"
+#include "unittest.h"
+
+#define NUM_KEYS        64
+#define BLOB_LEN        64
+#define LATENCY_US      2000
+
+static CK_BYTE blobs[NUM_KEYS][BLOB_LEN];
+static unsigned long set_calls, open_sessions;
+static CK_OBJECT_HANDLE fail_handle = (CK_OBJECT_HANDLE)-1;
+
+static CK_RV stub_OpenSession(CK_SLOT_ID slot, CK_FLAGS flags, void *app,
+                              CK_NOTIFY notify, CK_SESSION_HANDLE_PTR session)
+{
+    (void)slot;
+    (void)flags;
+    (void)app;
+    (void)notify;
+
+    *session = __sync_add_and_fetch(&open_sessions, 1);
+    return CKR_OK;
+}
+
+static CK_RV stub_CloseSession(CK_SESSION_HANDLE session)
+{
+    (void)session;
+    return CKR_OK;
+}
+
+static CK_RV stub_SetAttributeValue(CK_SESSION_HANDLE session,
+                                    CK_OBJECT_HANDLE handle,
+                                    CK_ATTRIBUTE_PTR attrs, CK_ULONG count)
+{
+    (void)session;
+
+    __sync_add_and_fetch(&set_calls, 1);
+    if (count != 1 || attrs[0].type != CKA_IBM_OPAQUE ||
+        attrs[0].ulValueLen != BLOB_LEN || handle >= NUM_KEYS)
+        return CKR_ARGUMENTS_BAD;
+
+    memcpy(blobs[handle], attrs[0].pValue, BLOB_LEN);
+    return CKR_OK;
+}
+
+/* The new master key is simulated by inverting the blob */
+static int stub_reencipher(void *ctx, struct key_migrate_item *item,
+                           CK_BYTE **new_blob, CK_ULONG *new_blob_len)
+{
+    CK_ULONG i;
+
+    (void)ctx;
+
+    usleep(LATENCY_US);
+    if (item->handle == fail_handle)
+        return 1;
+
+    *new_blob = malloc(item->blob_len);
+    if (*new_blob == NULL)
+        return 1;
+    for (i = 0; i < item->blob_len; i++)
+        (*new_blob)[i] = ~item->blob[i];
+    *new_blob_len = item->blob_len;
+
+    return 0;
+}
+
+static void setup(CK_BYTE (*copies)[BLOB_LEN],
+                  struct key_migrate_item *items)
+{
+    int i;
+
+    set_calls = 0;
+    for (i = 0; i < NUM_KEYS; i++) {
+        memset(blobs[i], i, BLOB_LEN);
+        memcpy(copies[i], blobs[i], BLOB_LEN);
+        items[i].handle = i;
+        items[i].key_type = CKK_AES;
+        items[i].blob = copies[i];
+        items[i].blob_len = BLOB_LEN;
+        items[i].label = NULL;
+    }
+}
+
+int main(void)
+{
+    struct key_migrate_item items[NUM_KEYS];
+    CK_BYTE copies[NUM_KEYS][BLOB_LEN];
+    struct key_migrate_opts opts = { 1, FALSE, NULL, 0 };
+    struct key_migrate_stats stats;
+    CK_FUNCTION_LIST funcs;
+    char checkpoint[] = "/tmp/keymigratetest.XXXXXX";
+    double serial;
+    int i, fd, rc = TEST_PASS;
+
+    memset(&funcs, 0, sizeof(funcs));
+    funcs.C_OpenSession = stub_OpenSession;
+    funcs.C_CloseSession = stub_CloseSession;
+    funcs.C_SetAttributeValue = stub_SetAttributeValue;
+
+    /* Serial run as reference */
+    setup(copies, items);
+    if (key_migrate_run(&funcs, 0, items, NUM_KEYS, stub_reencipher, NULL,
+                        &opts, &stats) != 0 ||
+        stats.migrated != NUM_KEYS || set_calls != NUM_KEYS) {
+        fprintf(stderr, "serial run failed\n");
+        return TEST_FAIL;
+    }
+    serial = stats.seconds;
+
+    /* Parallel run migrates all keys and is faster */
+    setup(copies, items);
+    opts.num_workers = 8;
+    if (key_migrate_run(&funcs, 0, items, NUM_KEYS, stub_reencipher, NULL,
+                        &opts, &stats) != 0 ||
+        stats.migrated != NUM_KEYS || set_calls != NUM_KEYS) {
+        fprintf(stderr, "parallel run failed\n");
+        rc = TEST_FAIL;
+    }
+    for (i = 0; i < NUM_KEYS; i++) {
+        if (blobs[i][0] != (CK_BYTE)~i || items[i].status != KEY_MIGRATE_DONE) {
+            fprintf(stderr, "key %d not migrated\n", i);
+            rc = TEST_FAIL;
+            break;
+        }
+    }
+    if (stats.seconds * 2 > serial) {
+        fprintf(stderr, "no speedup: serial %.3fs, parallel %.3fs\n",
+                serial, stats.seconds);
+        rc = TEST_FAIL;
+    }
+
+    /* Dry run does not write back */
+    setup(copies, items);
+    opts.dry_run = TRUE;
+    if (key_migrate_run(&funcs, 0, items, NUM_KEYS, stub_reencipher, NULL,
+                        &opts, &stats) != 0 ||
+        stats.migrated != NUM_KEYS || set_calls != 0) {
+        fprintf(stderr, "dry run failed\n");
+        rc = TEST_FAIL;
+    }
+    opts.dry_run = FALSE;
+
+    /* Failures are counted and do not stop the run */
+    setup(copies, items);
+    fail_handle = 5;
+    if (key_migrate_run(&funcs, 0, items, NUM_KEYS, stub_reencipher, NULL,
+                        &opts, &stats) != 0 ||
+        stats.failed != 1 || stats.migrated != NUM_KEYS - 1 ||
+        items[5].status != KEY_MIGRATE_FAILED || blobs[5][0] != 5) {
+        fprintf(stderr, "failed key not handled\n");
+        rc = TEST_FAIL;
+    }
+    fail_handle = (CK_OBJECT_HANDLE)-1;
+
+    /* A resumed run skips the keys recorded in the checkpoint */
+    fd = mkstemp(checkpoint);
+    if (fd < 0) {
+        fprintf(stderr, "mkstemp failed\n");
+        return TEST_FAIL;
+    }
+    close(fd);
+    opts.checkpoint = checkpoint;
+
+    setup(copies, items);
+    if (key_migrate_run(&funcs, 0, items, NUM_KEYS / 2, stub_reencipher,
+                        NULL, &opts, &stats) != 0 ||
+        stats.migrated != NUM_KEYS / 2) {
+        fprintf(stderr, "first checkpoint run failed\n");
+        rc = TEST_FAIL;
+    }
+
+    /* The tool reads the current blobs again before resuming */
+    for (i = 0; i < NUM_KEYS; i++)
+        memcpy(copies[i], blobs[i], BLOB_LEN);
+    set_calls = 0;
+    if (key_migrate_run(&funcs, 0, items, NUM_KEYS, stub_reencipher, NULL,
+                        &opts, &stats) != 0 ||
+        stats.skipped != NUM_KEYS / 2 || stats.migrated != NUM_KEYS / 2 ||
+        set_calls != NUM_KEYS / 2) {
+        fprintf(stderr, "resumed run did not skip migrated keys\n");
+        rc = TEST_FAIL;
+    }
+    for (i = 0; i < NUM_KEYS; i++) {
+        if (blobs[i][0] != (CK_BYTE)~i) {
+            fprintf(stderr, "key %d migrated twice or not at all\n", i);
+            rc = TEST_FAIL;
+            break;
+        }
+    }
+    unlink(checkpoint);
+
+    printf("key migrate: %s\n", rc == TEST_PASS ? "ok" : "failed");
+
+    return rc;
+}
@@ -0,0 +1,336 @@
+/*
+ * COPYRIGHT (c) International Business Machines Corp. 2024
+ *
+ * This program is provided under the terms of the Common Public License,
+ * version 1.0 (CPL-1.0). Any use, reproduction or distribution for this
+ * software constitutes recipient's acceptance of CPL-1.0 terms which can be
+ * found in the file LICENSE file or at
+ * https://opensource.org/licenses/cpl1.0.php
+ */
+
+/*
+ * Test of the threaded object migration and the repository switch of
+ * pkcstok_migrate. pthread_create(), renameat2() and rename() are wrapped
+ * to make them fail on request.
+ */
+
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "pkcs11types.h"
+#define OCK_TOOL
+#include "pkcs_utils.h"
+#include "migrate_repo.h"
+#include "unittest.h"
+
+#define NUM_OBJECTS     100
+
+pkcs_trace_level_t trace_level = TRACE_LEVEL_NONE;
+
+static int fail_pthread_create_after = -1;
+static int fail_renameat2;
+static const char *fail_rename_to;
+
+int pthread_create(pthread_t *thread, const pthread_attr_t *attr,
+                   void *(*start_routine)(void *), void *arg)
+{
+    int (*real)(pthread_t *, const pthread_attr_t *, void *(*)(void *),
+                void *);
+
+    if (fail_pthread_create_after == 0) {
+        errno = 0;
+        return EAGAIN;
+    }
+    if (fail_pthread_create_after > 0)
+        fail_pthread_create_after--;
+
+    real = dlsym(RTLD_NEXT, "pthread_create");
+    return real(thread, attr, start_routine, arg);
+}
+
+int renameat2(int olddirfd, const char *oldpath, int newdirfd,
+              const char *newpath, unsigned int flags)
+{
+    int (*real)(int, const char *, int, const char *, unsigned int);
+
+    if (fail_renameat2) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    real = dlsym(RTLD_NEXT, "renameat2");
+    return real(olddirfd, oldpath, newdirfd, newpath, flags);
+}
+
+int rename(const char *oldpath, const char *newpath)
+{
+    int (*real)(const char *, const char *);
+
+    /* Only the first rename to the path fails */
+    if (fail_rename_to != NULL && strcmp(newpath, fail_rename_to) == 0) {
+        fail_rename_to = NULL;
+        errno = EACCES;
+        return -1;
+    }
+
+    real = dlsym(RTLD_NEXT, "rename");
+    return real(oldpath, newpath);
+}
+
+struct objects {
+    unsigned int count[NUM_OBJECTS];
+    pthread_t thread[NUM_OBJECTS];
+};
+
+static void migrate_object(void *ctx, const char *name)
+{
+    struct objects *objs = ctx;
+    unsigned int i = atoi(name);
+
+    __sync_fetch_and_add(&objs->count[i], 1);
+    objs->thread[i] = pthread_self();
+    usleep(100);
+}
+
+static int check_objects(unsigned int threads_wanted, int fail_after,
+                         unsigned int threads_expected)
+{
+    struct objects objs;
+    char *names[NUM_OBJECTS];
+    char buf[NUM_OBJECTS][8];
+    unsigned int i, j, threads, distinct = 0;
+
+    memset(&objs, 0, sizeof(objs));
+    for (i = 0; i < NUM_OBJECTS; i++) {
+        snprintf(buf[i], sizeof(buf[i]), "%u", i);
+        names[i] = buf[i];
+    }
+
+    fail_pthread_create_after = fail_after;
+    threads = migrate_repo_objects(names, NUM_OBJECTS, threads_wanted,
+                                   migrate_object, &objs);
+    fail_pthread_create_after = -1;
+
+    if (threads != threads_expected) {
+        fprintf(stderr, "%u threads wanted: used %u threads, expected %u\n",
+                threads_wanted, threads, threads_expected);
+        return TEST_FAIL;
+    }
+
+    for (i = 0; i < NUM_OBJECTS; i++) {
+        if (objs.count[i] != 1) {
+            fprintf(stderr, "%u threads: object %u migrated %u times\n",
+                    threads, i, objs.count[i]);
+            return TEST_FAIL;
+        }
+        for (j = 0; j < i; j++) {
+            if (pthread_equal(objs.thread[i], objs.thread[j]))
+                break;
+        }
+        if (j == i)
+            distinct++;
+    }
+    if (distinct > threads) {
+        fprintf(stderr, "%u threads: objects migrated by %u threads\n",
+                threads, distinct);
+        return TEST_FAIL;
+    }
+
+    return TEST_PASS;
+}
+
+static int test_objects(void)
+{
+    if (check_objects(1, -1, 1) != TEST_PASS ||
+        check_objects(4, -1, 4) != TEST_PASS ||
+        check_objects(1000, -1, MIGRATE_MAX_THREADS) != TEST_PASS)
+        return TEST_FAIL;
+
+    /* Threads that cannot be created leave their objects to the others */
+    if (check_objects(4, 1, 2) != TEST_PASS ||
+        check_objects(4, 0, 1) != TEST_PASS)
+        return TEST_FAIL;
+
+    return TEST_PASS;
+}
+
+static char dir[] = "/tmp/migraterepotestXXXXXX";
+static char data_store[PATH_MAX], data_store_new[PATH_MAX];
+static char data_store_bak[PATH_MAX];
+
+static int make_repo(const char *path, const char *marker)
+{
+    char fname[PATH_MAX + 16];
+    int fd;
+
+    if (mkdir(path, 0700) != 0)
+        return -1;
+    snprintf(fname, sizeof(fname), "%s/%s", path, marker);
+    fd = open(fname, O_CREAT | O_WRONLY, 0600);
+    if (fd < 0)
+        return -1;
+    close(fd);
+
+    return 0;
+}
+
+static int is_repo(const char *path, const char *marker)
+{
+    char fname[PATH_MAX + 16];
+
+    snprintf(fname, sizeof(fname), "%s/%s", path, marker);
+    return access(fname, F_OK) == 0;
+}
+
+static void remove_repo(const char *path)
+{
+    char fname[PATH_MAX + 16];
+
+    snprintf(fname, sizeof(fname), "%s/old", path);
+    unlink(fname);
+    snprintf(fname, sizeof(fname), "%s/new", path);
+    unlink(fname);
+    rmdir(path);
+}
+
+static void remove_repos(void)
+{
+    remove_repo(data_store);
+    remove_repo(data_store_new);
+    remove_repo(data_store_bak);
+}
+
+static int setup_repos(void)
+{
+    remove_repos();
+    if (make_repo(data_store, "old") != 0 ||
+        make_repo(data_store_new, "new") != 0) {
+        fprintf(stderr, "cannot create the repositories in %s\n", dir);
+        return TEST_FAIL;
+    }
+
+    return TEST_PASS;
+}
+
+/* The data store is the migrated repository, the old one is in backup */
+static int check_switched(CK_RV rc, const char *backup,
+                          const char *backup_expected, const char *what)
+{
+    if (rc != CKR_OK) {
+        fprintf(stderr, "%s: switch failed, rc=0x%lx\n", what, rc);
+        return TEST_FAIL;
+    }
+    if (!is_repo(data_store, "new")) {
+        fprintf(stderr, "%s: data store is not the new repository\n", what);
+        return TEST_FAIL;
+    }
+    if (strcmp(backup, backup_expected) != 0 || !is_repo(backup, "old")) {
+        fprintf(stderr, "%s: old repository reported at '%s', expected "
+                "at '%s'\n", what, backup, backup_expected);
+        return TEST_FAIL;
+    }
+
+    return TEST_PASS;
+}
+
+static int test_switch(void)
+{
+    char backup[PATH_MAX];
+    int exchange;
+    CK_RV rc;
+
+    snprintf(data_store, sizeof(data_store), "%s/TOK", dir);
+    snprintf(data_store_new, sizeof(data_store_new),
+             "%s/TOK_PKCSTOK_MIGRATE_TMP", dir);
+    snprintf(data_store_bak, sizeof(data_store_bak), "%s/TOK_BAK", dir);
+
+    /* Whether the file system supports the atomic exchange */
+    if (setup_repos() != TEST_PASS)
+        return TEST_FAIL;
+    exchange = renameat2(AT_FDCWD, data_store_new, AT_FDCWD, data_store,
+                         RENAME_EXCHANGE) == 0;
+    if (!exchange)
+        printf("atomic exchange not supported in %s\n", dir);
+
+    /* Exchange, if supported */
+    if (setup_repos() != TEST_PASS)
+        return TEST_FAIL;
+    rc = migrate_repo_switch(data_store, data_store_new, backup,
+                             sizeof(backup));
+    if (check_switched(rc, backup, data_store_bak, "switch") != TEST_PASS)
+        return TEST_FAIL;
+
+    /* Two renames if the exchange is not supported */
+    if (setup_repos() != TEST_PASS)
+        return TEST_FAIL;
+    fail_renameat2 = 1;
+    rc = migrate_repo_switch(data_store, data_store_new, backup,
+                             sizeof(backup));
+    fail_renameat2 = 0;
+    if (check_switched(rc, backup, data_store_bak, "fallback") != TEST_PASS)
+        return TEST_FAIL;
+
+    /* The second rename fails: the old repository is renamed back */
+    if (setup_repos() != TEST_PASS)
+        return TEST_FAIL;
+    fail_renameat2 = 1;
+    fail_rename_to = data_store;
+    rc = migrate_repo_switch(data_store, data_store_new, backup,
+                             sizeof(backup));
+    fail_renameat2 = 0;
+    fail_rename_to = NULL;
+    if (rc == CKR_OK || !is_repo(data_store, "old") ||
+        !is_repo(data_store_new, "new")) {
+        fprintf(stderr, "failed fallback: rc=0x%lx, repositories not "
+                "restored\n", rc);
+        return TEST_FAIL;
+    }
+
+    /*
+     * The exchange succeeds, but the old repository cannot be renamed to
+     * the backup name: it is reported where it is.
+     */
+    if (exchange) {
+        if (setup_repos() != TEST_PASS)
+            return TEST_FAIL;
+        fail_rename_to = data_store_bak;
+        rc = migrate_repo_switch(data_store, data_store_new, backup,
+                                 sizeof(backup));
+        fail_rename_to = NULL;
+        if (check_switched(rc, backup, data_store_new,
+                           "no backup rename") != TEST_PASS)
+            return TEST_FAIL;
+    }
+
+    return TEST_PASS;
+}
+
+int main(void)
+{
+    int rc;
+
+    rc = test_objects();
+
+    if (rc == TEST_PASS) {
+        if (mkdtemp(dir) == NULL) {
+            fprintf(stderr, "mkdtemp failed: %s\n", strerror(errno));
+            return TEST_FAIL;
+        }
+        rc = test_switch();
+        remove_repos();
+        rmdir(dir);
+    }
+
+    printf("repository migration: %s\n", rc == TEST_PASS ? "ok" : "failed");
+
+    return rc;
+}
@@ -0,0 +1,526 @@
+/*
+ * COPYRIGHT (c) International Business Machines Corp. 2024
+ *
+ * This program is provided under the terms of the Common Public License,
+ * version 1.0 (CPL-1.0). Any use, reproduction or distribution for this
+ * software constitutes recipient's acceptance of CPL-1.0 terms which can be
+ * found in the file LICENSE file or at
+ * https://opensource.org/licenses/cpl1.0.php
+ */
+
+/*
+ * Test of the token object handling in object.c: the cache of derived fast
+ * keys, and the formats token objects are flattened to. The test fast key
+ * is a copy of the object's CKA_LABEL, so that it shows which template it
+ * was derived from.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pkcs11types.h"
+#include "defs.h"
+#include "host_defs.h"
+#include "h_extern.h"
+#include "p11util.h"
+#include "unittest.h"
+
+struct label_key {
+    int refs;
+    char label[32];
+};
+
+static int derived, freed;
+
+static CK_RV label_key_derive(STDLL_TokData_t *tokdata, OBJECT *obj,
+                              void **fast_key)
+{
+    struct label_key *key;
+    CK_ATTRIBUTE *attr;
+
+    (void)tokdata;
+
+    if (!template_attribute_find(obj->template, CKA_LABEL, &attr) ||
+        attr->ulValueLen >= sizeof(key->label))
+        return CKR_TEMPLATE_INCOMPLETE;
+
+    key = calloc(1, sizeof(*key));
+    if (key == NULL)
+        return CKR_HOST_MEMORY;
+    memcpy(key->label, attr->pValue, attr->ulValueLen);
+    key->refs = 1;
+    derived++;
+
+    *fast_key = key;
+    return CKR_OK;
+}
+
+static void *label_key_get(void *fast_key)
+{
+    ((struct label_key *)fast_key)->refs++;
+    return fast_key;
+}
+
+static void label_key_put(void *fast_key)
+{
+    struct label_key *key = fast_key;
+
+    if (--key->refs == 0) {
+        free(key);
+        freed++;
+    }
+}
+
+static const struct fast_key_ops label_key_ops = {
+    .name = "label",
+    .derive = label_key_derive,
+    .get = label_key_get,
+    .put = label_key_put,
+};
+
+static OBJECT *make_object(const char *label)
+{
+    CK_OBJECT_CLASS class = CKO_DATA;
+    CK_BBOOL true = TRUE;
+    CK_ATTRIBUTE attrs[] = {
+        { CKA_CLASS, &class, sizeof(class) },
+        { CKA_TOKEN, &true, sizeof(true) },
+        { CKA_LABEL, (char *)label, strlen(label) },
+    };
+    OBJECT *obj;
+
+    obj = calloc(1, sizeof(*obj));
+    if (obj == NULL)
+        return NULL;
+    obj->class = class;
+    memcpy(obj->name, "OBJ00001", 8);
+
+    obj->template = calloc(1, sizeof(TEMPLATE));
+    if (obj->template == NULL ||
+        template_add_attributes(obj->template, attrs,
+                                ARRAYSIZE(attrs)) != CKR_OK ||
+        object_init_lock(obj) != CKR_OK) {
+        if (obj->template != NULL)
+            template_free(obj->template);
+        free(obj);
+        return NULL;
+    }
+
+    return obj;
+}
+
+/* Gets the fast key of obj and checks that it has the expected label */
+static struct label_key *get_key(STDLL_TokData_t *tokdata, OBJECT *obj,
+                                 const char *label)
+{
+    void *fast_key = NULL;
+    CK_RV rc;
+
+    rc = object_get_fast_key(tokdata, obj, &label_key_ops, &fast_key);
+    if (rc != CKR_OK) {
+        fprintf(stderr, "object_get_fast_key failed: rc=0x%lx\n", rc);
+        return NULL;
+    }
+    if (strcmp(((struct label_key *)fast_key)->label, label) != 0) {
+        fprintf(stderr, "fast key derived from '%s', expected '%s'\n",
+                ((struct label_key *)fast_key)->label, label);
+        object_put_fast_key(&label_key_ops, fast_key);
+        return NULL;
+    }
+
+    return fast_key;
+}
+
+static int test_fast_key(STDLL_TokData_t *tokdata)
+{
+    char label[] = "second";
+    CK_ATTRIBUTE set_attr = { CKA_LABEL, label, strlen(label) };
+    OBJECT *obj, *reload;
+    struct label_key *key1, *key2;
+    CK_BYTE *data = NULL;
+    CK_ULONG data_len;
+    int rc = TEST_FAIL;
+
+    obj = make_object("first");
+    reload = make_object("third");
+    if (obj == NULL || reload == NULL) {
+        fprintf(stderr, "cannot create the objects\n");
+        goto out;
+    }
+
+    /* The key is derived once and then reused */
+    key1 = get_key(tokdata, obj, "first");
+    if (key1 == NULL)
+        goto out;
+    key2 = get_key(tokdata, obj, "first");
+    if (key2 == NULL)
+        goto out;
+    object_put_fast_key(&label_key_ops, key2);
+    if (key2 != key1 || derived != 1) {
+        fprintf(stderr, "cached fast key not reused, %d derived\n", derived);
+        goto out;
+    }
+
+    /* C_SetAttributeValue invalidates it, references stay valid */
+    if (object_set_attribute_values(tokdata, obj, &set_attr, 1) != CKR_OK) {
+        fprintf(stderr, "object_set_attribute_values failed\n");
+        goto out;
+    }
+    if (strcmp(key1->label, "first") != 0 || freed != 0) {
+        fprintf(stderr, "referenced fast key released on invalidation\n");
+        goto out;
+    }
+    key2 = get_key(tokdata, obj, "second");
+    if (key2 == NULL)
+        goto out;
+    object_put_fast_key(&label_key_ops, key2);
+    object_put_fast_key(&label_key_ops, key1);
+    if (derived != 2 || freed != 1) {
+        fprintf(stderr, "after set: %d derived, %d freed\n", derived, freed);
+        goto out;
+    }
+
+    /* A reload of the token object invalidates it */
+    if (object_flatten(reload, &data, &data_len, TRUE) != CKR_OK) {
+        fprintf(stderr, "object_flatten failed\n");
+        goto out;
+    }
+    if (object_restore_withSize(NULL, data, &obj, TRUE, data_len,
+                                NULL) != CKR_OK) {
+        fprintf(stderr, "object_restore_withSize failed\n");
+        goto out;
+    }
+    if (freed != 2) {
+        fprintf(stderr, "fast key not released on reload\n");
+        goto out;
+    }
+    key1 = get_key(tokdata, obj, "third");
+    if (key1 == NULL)
+        goto out;
+    object_put_fast_key(&label_key_ops, key1);
+    if (derived != 3) {
+        fprintf(stderr, "after reload: %d derived\n", derived);
+        goto out;
+    }
+
+    /* Freeing the object releases the cached key */
+    object_free(obj);
+    obj = NULL;
+    if (freed != 3) {
+        fprintf(stderr, "fast key not released with the object\n");
+        goto out;
+    }
+
+    rc = TEST_PASS;
+
+out:
+    free(data);
+    if (obj != NULL)
+        object_free(obj);
+    if (reload != NULL)
+        object_free(reload);
+
+    return rc;
+}
+
+/* An object with ulong, empty and attribute array values */
+static OBJECT *make_record_object(void)
+{
+    CK_OBJECT_CLASS class = CKO_SECRET_KEY;
+    CK_KEY_TYPE key_type = CKK_AES;
+    CK_BBOOL true = TRUE;
+    char label[] = "wrapped";
+    CK_ATTRIBUTE wrap_tmpl[] = {
+        { CKA_CLASS, &class, sizeof(class) },
+        { CKA_KEY_TYPE, &key_type, sizeof(key_type) },
+        { CKA_LABEL, label, strlen(label) },
+    };
+    CK_ATTRIBUTE attrs[] = {
+        { CKA_WRAP_TEMPLATE, wrap_tmpl, sizeof(wrap_tmpl) },
+        { CKA_UNWRAP_TEMPLATE, NULL, 0 },
+        { CKA_APPLICATION, NULL, 0 },
+        { CKA_PRIVATE, &true, sizeof(true) },
+    };
+    OBJECT *obj;
+
+    obj = make_object("record");
+    if (obj == NULL)
+        return NULL;
+    if (template_add_attributes(obj->template, attrs,
+                                ARRAYSIZE(attrs)) != CKR_OK) {
+        object_free(obj);
+        return NULL;
+    }
+
+    return obj;
+}
+
+static int compare_attribute(CK_ATTRIBUTE *attr, CK_ATTRIBUTE *restored)
+{
+    CK_ULONG i;
+
+    if (attr->type != restored->type ||
+        attr->ulValueLen != restored->ulValueLen)
+        return -1;
+    if (attr->ulValueLen == 0)
+        return 0;
+
+    if (is_attribute_attr_array(attr->type)) {
+        for (i = 0; i < attr->ulValueLen / sizeof(CK_ATTRIBUTE); i++) {
+            if (compare_attribute((CK_ATTRIBUTE *)attr->pValue + i,
+                                  (CK_ATTRIBUTE *)restored->pValue + i) != 0)
+                return -1;
+        }
+        return 0;
+    }
+
+    return memcmp(attr->pValue, restored->pValue, attr->ulValueLen);
+}
+
+/* Restores data and checks that it is a copy of obj */
+static int check_restore(OBJECT *obj, CK_BYTE *data, CK_ULONG data_len,
+                         const char *what)
+{
+    OBJECT *restored = NULL;
+    CK_ATTRIBUTE *attr, *restored_attr;
+    DL_NODE *node;
+    int rc = TEST_FAIL;
+
+    if (object_restore_withSize(NULL, data, &restored, FALSE, data_len,
+                                NULL) != CKR_OK) {
+        fprintf(stderr, "%s: object_restore_withSize failed\n", what);
+        return TEST_FAIL;
+    }
+
+    if (restored->class != obj->class ||
+        memcmp(restored->name, obj->name, sizeof(obj->name)) != 0 ||
+        template_get_count(restored->template) !=
+                                        template_get_count(obj->template)) {
+        fprintf(stderr, "%s: restored object differs\n", what);
+        goto out;
+    }
+    for (node = obj->template->attribute_list; node; node = node->next) {
+        attr = (CK_ATTRIBUTE *)node->data;
+        if (!template_attribute_find(restored->template, attr->type,
+                                     &restored_attr) ||
+            compare_attribute(attr, restored_attr) != 0) {
+            fprintf(stderr, "%s: attribute 0x%lx differs\n", what, attr->type);
+            goto out;
+        }
+    }
+
+    rc = TEST_PASS;
+
+out:
+    object_free(restored);
+
+    return rc;
+}
+
+enum record_corruption {
+    TRUNCATED_HEADER,
+    TRUNCATED_HEAP,
+    BAD_VERSION,
+    BAD_NUM_ATTRS,
+    BAD_HEAP_LEN,
+    VALUE_BEYOND_HEAP,
+    VALUE_LEN_BEYOND_HEAP,
+    BAD_ULONG_LEN,
+    BAD_ARRAY_INDEX,
+    BAD_ARRAY_LEN,
+    UNREFERENCED_ENTRIES,
+    ARRAY_IN_HEAP,
+};
+
+static const char *record_corruptions[] = {
+    "truncated header", "truncated heap", "bad version", "bad attribute count",
+    "bad heap length", "value beyond the heap", "value length beyond the heap",
+    "bad ulong length", "bad array index", "bad array length",
+    "unreferenced entries", "array in the heap",
+};
+
+/* Returns the table entry of the top level attribute type */
+static OBJECT_RECORD_ATTR *record_entry(CK_BYTE *data, CK_ATTRIBUTE_TYPE type)
+{
+    OBJECT_RECORD_HDR *hdr = (OBJECT_RECORD_HDR *)data;
+    OBJECT_RECORD_ATTR *table = (OBJECT_RECORD_ATTR *)(hdr + 1);
+    CK_ULONG i;
+
+    for (i = 0; i < hdr->num_attrs; i++) {
+        if (table[i].type == type)
+            return &table[i];
+    }
+
+    return NULL;
+}
+
+static int check_corrupt_record(CK_BYTE *record, CK_ULONG record_len,
+                                enum record_corruption corruption)
+{
+    OBJECT_RECORD_HDR *hdr;
+    OBJECT_RECORD_ATTR *entry = NULL;
+    OBJECT *restored = NULL;
+    CK_BYTE *data;
+    CK_ULONG data_len = record_len;
+    CK_RV rv;
+
+    data = malloc(record_len);
+    if (data == NULL)
+        return TEST_FAIL;
+    memcpy(data, record, record_len);
+    hdr = (OBJECT_RECORD_HDR *)data;
+
+    switch (corruption) {
+    case TRUNCATED_HEADER:
+        data_len = sizeof(*hdr) - 1;
+        break;
+    case TRUNCATED_HEAP:
+        data_len = record_len - 1;
+        break;
+    case BAD_VERSION:
+        hdr->version = OBJECT_RECORD_VERSION + 1;
+        break;
+    case BAD_NUM_ATTRS:
+        hdr->num_attrs = hdr->num_entries + 1;
+        break;
+    case BAD_HEAP_LEN:
+        hdr->heap_len += 8;
+        break;
+    case VALUE_BEYOND_HEAP:
+        entry = record_entry(data, CKA_LABEL);
+        if (entry != NULL)
+            entry->offset = hdr->heap_len + 8;
+        break;
+    case VALUE_LEN_BEYOND_HEAP:
+        entry = record_entry(data, CKA_LABEL);
+        if (entry != NULL)
+            entry->len = hdr->heap_len - entry->offset + 1;
+        break;
+    case BAD_ULONG_LEN:
+        entry = record_entry(data, CKA_CLASS);
+        if (entry != NULL)
+            entry->len = sizeof(CK_ULONG_32);
+        break;
+    case BAD_ARRAY_INDEX:
+        /* The array refers to the top level attributes */
+        entry = record_entry(data, CKA_WRAP_TEMPLATE);
+        if (entry != NULL)
+            entry->offset = 0;
+        break;
+    case BAD_ARRAY_LEN:
+        entry = record_entry(data, CKA_WRAP_TEMPLATE);
+        if (entry != NULL)
+            entry->len = hdr->num_entries;
+        break;
+    case UNREFERENCED_ENTRIES:
+        entry = record_entry(data, CKA_WRAP_TEMPLATE);
+        if (entry != NULL)
+            entry->len--;
+        break;
+    case ARRAY_IN_HEAP:
+        entry = record_entry(data, CKA_UNWRAP_TEMPLATE);
+        if (entry != NULL)
+            entry->flags = 0;
+        break;
+    default:
+        entry = NULL;
+        break;
+    }
+    if (entry == NULL && corruption >= VALUE_BEYOND_HEAP) {
+        fprintf(stderr, "%s: attribute not in the record\n",
+                record_corruptions[corruption]);
+        free(data);
+        return TEST_FAIL;
+    }
+
+    rv = object_restore_withSize(NULL, data, &restored, FALSE, data_len, NULL);
+    free(data);
+    if (rv == CKR_OK) {
+        fprintf(stderr, "%s: corrupt record restored\n",
+                record_corruptions[corruption]);
+        object_free(restored);
+        return TEST_FAIL;
+    }
+
+    return TEST_PASS;
+}
+
+static int test_record(void)
+{
+    OBJECT *obj;
+    OBJECT_RECORD_HDR hdr;
+    CK_BYTE *record = NULL, *old = NULL;
+    CK_ULONG record_len, old_len;
+    CK_ULONG_32 count;
+    unsigned int i;
+    int rc = TEST_FAIL;
+
+    obj = make_record_object();
+    if (obj == NULL) {
+        fprintf(stderr, "cannot create the object\n");
+        return TEST_FAIL;
+    }
+
+    /* Round trip of an object record */
+    if (object_flatten(obj, &record, &record_len, TRUE) != CKR_OK) {
+        fprintf(stderr, "object_flatten failed\n");
+        goto out;
+    }
+    memcpy(&hdr, record, sizeof(hdr));
+    if (hdr.magic != OBJECT_RECORD_MAGIC ||
+        hdr.num_attrs != template_get_count(obj->template) ||
+        hdr.num_entries != hdr.num_attrs + 3) {
+        fprintf(stderr, "object not flattened to a record\n");
+        goto out;
+    }
+    if (check_restore(obj, record, record_len, "record") != TEST_PASS)
+        goto out;
+
+    /* Objects in the older format are written unless requested, and read */
+    if (object_flatten(obj, &old, &old_len, FALSE) != CKR_OK) {
+        fprintf(stderr, "object_flatten failed\n");
+        goto out;
+    }
+    memcpy(&count, old + sizeof(CK_OBJECT_CLASS_32), sizeof(count));
+    if (count != template_get_count(obj->template)) {
+        fprintf(stderr, "object not flattened to the old format\n");
+        goto out;
+    }
+    if (check_restore(obj, old, old_len, "old format") != TEST_PASS)
+        goto out;
+
+    /* Truncated and corrupt records are rejected */
+    for (i = 0; i < ARRAYSIZE(record_corruptions); i++) {
+        if (check_corrupt_record(record, record_len, i) != TEST_PASS)
+            goto out;
+    }
+
+    rc = TEST_PASS;
+
+out:
+    free(record);
+    free(old);
+    object_free(obj);
+
+    return rc;
+}
+
+int main(void)
+{
+    STDLL_TokData_t tokdata;
+    int rc;
+
+    memset(&tokdata, 0, sizeof(tokdata));
+
+    rc = test_fast_key(&tokdata);
+    printf("object fast key cache: %s\n", rc == TEST_PASS ? "ok" : "failed");
+    if (rc != TEST_PASS)
+        return rc;
+
+    rc = test_record();
+    printf("object records: %s\n", rc == TEST_PASS ? "ok" : "failed");
+
+    return rc;
+}
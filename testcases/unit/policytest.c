@@ -11,8 +11,10 @@
 #include "policy.h"
 #include "ec_defs.h"
 #include "unittest.h"
+#include "mechtable.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 #include <openssl/obj_mac.h>
 
 /* Inlined strength definitions */
@@ -142,6 +144,8 @@ extern CK_RV policy_load_policy_cfg(struct policy_private *pp,
 extern struct policy_private *policy_private_alloc(void);
 extern struct policy_private *policy_private_free(struct policy_private *pp);
 extern void policy_private_deactivate(struct policy_private *pp);
+extern void policy_compile_decisions(struct policy_private *pp);
+extern void policy_drop_decisions(struct policy_private *pp);
 
 struct keytest {
     CK_ULONG keytype;
@@ -968,6 +972,183 @@ static int runpolicydeepcheckkdftests(void)
     return res;
 }
 
+/* These mechanisms require a parameter for the deep check. */
+static CK_BBOOL needsparam(CK_ULONG mech)
+{
+    switch (mech) {
+    case CKM_RSA_PKCS_PSS:
+    case CKM_SHA1_RSA_PKCS_PSS:
+    case CKM_SHA224_RSA_PKCS_PSS:
+    case CKM_SHA256_RSA_PKCS_PSS:
+    case CKM_SHA384_RSA_PKCS_PSS:
+    case CKM_SHA512_RSA_PKCS_PSS:
+    case CKM_RSA_PKCS_OAEP:
+    case CKM_ECDH1_DERIVE:
+        return CK_TRUE;
+    default:
+        return CK_FALSE;
+    }
+}
+
+static int runpolicydecisiontests(void)
+{
+    static const struct {
+        const char *policy;
+        size_t policylen;
+    } policies[] =
+          {
+           { policyempty, sizeof(policyempty) },
+           { policynomechs, sizeof(policynomechs) },
+           { policyfixedmechs, sizeof(policyfixedmechs) },
+           { policystrength112, sizeof(policystrength112) },
+           { policystrength128, sizeof(policystrength128) },
+           { policystrength256, sizeof(policystrength256) }
+          };
+    static const int checks[] =
+        { POLICY_CHECK_DIGEST, POLICY_CHECK_SIGNATURE, POLICY_CHECK_VERIFY,
+          POLICY_CHECK_ENCRYPT, POLICY_CHECK_DERIVE };
+    static const CK_ULONG siglens[] = { 0, 112, 160, 256, 4096 };
+    struct objstrength strength, *s;
+    struct policy_private *pp;
+    CK_MECHANISM mech;
+    struct policy p;
+    unsigned int o, i, c, l;
+    CK_RV fast, full;
+    int res;
+
+    fprintf(stderr, "Running policydecisiontests\n");
+    res = 0;
+    policy_init_policy(&p);
+    mech.pParameter = NULL;
+    mech.ulParameterLen = 0;
+    strength.strength = 0;
+    strength.allowed = CK_TRUE;
+    for (o = 0; o < ARRAYSIZE(policies); ++o) {
+        pp = policy_private_alloc();
+        if (pp == NULL) {
+            fprintf(stderr, "Test %u: Failed to allocate policy_private\n", o);
+            return -1;
+        }
+        p.priv = pp;
+        if (test_load_strength_cfg(pp, (void *)niststrength,
+                                   sizeof(niststrength))) {
+            policy_private_free(pp);
+            fprintf(stderr, "Test %u: Failed to load strength configuration\n",
+                    o);
+            return -1;
+        }
+        if (test_load_policy_cfg(pp, (void *)policies[o].policy,
+                                 policies[o].policylen)) {
+            policy_private_free(pp);
+            fprintf(stderr, "Test %u: Failed to load policy configuration\n",
+                    o);
+            return -1;
+        }
+        for (i = 0; i < MECHTABLE_NUM_ELEMS; ++i) {
+            mech.mechanism = mechtable_rows[i].numeric;
+            if (needsparam(mech.mechanism))
+                continue;
+            for (c = 0; c < ARRAYSIZE(checks); ++c) {
+                for (l = 0; l < ARRAYSIZE(siglens); ++l) {
+                    strength.siglen = siglens[l];
+                    s = checks[c] == POLICY_CHECK_DIGEST ? NULL : &strength;
+                    policy_compile_decisions(pp);
+                    fast = p.is_mech_allowed(&p, &mech, s, checks[c], NULL);
+                    policy_drop_decisions(pp);
+                    full = p.is_mech_allowed(&p, &mech, s, checks[c], NULL);
+                    if (fast != full) {
+                        fprintf(stderr,
+                                "Test %u, %s, check %d, siglen %lu: decision table returned 0x%lx (expected 0x%lx)\n",
+                                o, mechtable_rows[i].string, checks[c],
+                                siglens[l], fast, full);
+                        res = -1;
+                    }
+                }
+            }
+        }
+        p.priv = pp = policy_private_free(pp);
+    }
+    return res;
+}
+
+#define POLICYBENCHITERATIONS 1000000
+
+static double benchelapsed(const struct timespec *start)
+{
+    struct timespec end;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return (end.tv_sec - start->tv_sec) * 1e9 +
+        (end.tv_nsec - start->tv_nsec);
+}
+
+/* Microbenchmark of the per-operation check.  Informational only. */
+static int runpolicybenchmark(void)
+{
+    static const struct {
+        CK_ULONG mech;
+        int check;
+    } cases[] =
+          {
+           { CKM_SHA256, POLICY_CHECK_DIGEST },
+           { CKM_AES_CBC, POLICY_CHECK_ENCRYPT },
+           { CKM_SHA256_RSA_PKCS, POLICY_CHECK_SIGNATURE },
+           { CKM_ECDSA, POLICY_CHECK_VERIFY }
+          };
+    struct objstrength strength, *s;
+    struct policy_private *pp;
+    struct timespec start;
+    double fast, full;
+    CK_MECHANISM mech;
+    struct policy p;
+    unsigned int i, n;
+    CK_RV rc = CKR_OK;
+
+    fprintf(stderr, "Running policybenchmark\n");
+    policy_init_policy(&p);
+    mech.pParameter = NULL;
+    mech.ulParameterLen = 0;
+    strength.strength = STRENGTH_128;
+    strength.siglen = 3072;
+    strength.allowed = CK_TRUE;
+    pp = policy_private_alloc();
+    if (pp == NULL) {
+        fprintf(stderr, "Failed to allocate policy_private\n");
+        return -1;
+    }
+    p.priv = pp;
+    if (test_load_strength_cfg(pp, (void *)niststrength,
+                               sizeof(niststrength)) ||
+        test_load_policy_cfg(pp, (void *)policystrength128,
+                             sizeof(policystrength128))) {
+        policy_private_free(pp);
+        fprintf(stderr, "Failed to load policy for benchmark\n");
+        return -1;
+    }
+    for (i = 0; i < ARRAYSIZE(cases); ++i) {
+        mech.mechanism = cases[i].mech;
+        s = cases[i].check == POLICY_CHECK_DIGEST ? NULL : &strength;
+        policy_compile_decisions(pp);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (n = 0; n < POLICYBENCHITERATIONS; ++n)
+            rc |= p.is_mech_allowed(&p, &mech, s, cases[i].check, NULL);
+        fast = benchelapsed(&start) / POLICYBENCHITERATIONS;
+        policy_drop_decisions(pp);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        for (n = 0; n < POLICYBENCHITERATIONS; ++n)
+            rc |= p.is_mech_allowed(&p, &mech, s, cases[i].check, NULL);
+        full = benchelapsed(&start) / POLICYBENCHITERATIONS;
+        fprintf(stderr, "  0x%08lx check %d: %6.1f ns/op (table), %6.1f ns/op (full)\n",
+                cases[i].mech, cases[i].check, fast, full);
+    }
+    policy_private_free(pp);
+    if (rc != CKR_OK) {
+        fprintf(stderr, "Benchmark mechanism unexpectedly rejected\n");
+        return -1;
+    }
+    return 0;
+}
+
 static int runpolicydeepchecktests(void)
 {
     return runpolicydeepcheckmgftests() | runpolicydeepcheckkdftests();
@@ -981,7 +1162,7 @@ static int runstrengthtests(void)
 static int runpolicytests(void)
 {
     return runpolicyenforcetests() | runpolicyhashtests() |
-        runpolicydeepchecktests();
+        runpolicydeepchecktests() | runpolicydecisiontests();
 }
 
 int main(void)
@@ -990,5 +1171,7 @@ int main(void)
         return TEST_FAIL;
     if (runpolicytests())
         return TEST_FAIL;
+    if (runpolicybenchmark())
+        return TEST_FAIL;
     return TEST_PASS;
 }
@@ -0,0 +1,163 @@
+/*
+ * COPYRIGHT (c) International Business Machines Corp. 2024
+ *
+ * This program is provided under the terms of the Common Public License,
+ * version 1.0 (CPL-1.0). Any use, reproduction or distribution for this
+ * software constitutes recipient's acceptance of CPL-1.0 terms which can be
+ * found in the file LICENSE file or at
+ * https://opensource.org/licenses/cpl1.0.php
+ */
+
+/*
+ * Test of the per-thread buffer that serves small random requests.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "pkcs11types.h"
+#include "defs.h"
+#include "host_defs.h"
+#include "h_extern.h"
+#include "tok_spec_struct.h"
+#include "pkcs_utils.h"
+#include "unittest.h"
+
+#define REQ_LEN     16
+#define NUM_REQS    64
+
+/* rng_generate() uses local_rng() if the token has no RNG of its own */
+token_spec_t token_specific;
+
+static int test_no_repeats(void)
+{
+    CK_BYTE out[NUM_REQS][REQ_LEN];
+    int i, j;
+
+    for (i = 0; i < NUM_REQS; i++) {
+        if (rng_generate(NULL, out[i], REQ_LEN) != CKR_OK) {
+            fprintf(stderr, "rng_generate failed\n");
+            return TEST_FAIL;
+        }
+    }
+
+    /* Every byte is handed out only once, across buffer refills */
+    for (i = 0; i < NUM_REQS; i++) {
+        for (j = i + 1; j < NUM_REQS; j++) {
+            if (memcmp(out[i], out[j], REQ_LEN) == 0) {
+                fprintf(stderr, "request %d repeated request %d\n", j, i);
+                return TEST_FAIL;
+            }
+        }
+    }
+
+    return TEST_PASS;
+}
+
+/*
+ * Parent and child continue with the buffer the parent had filled before the
+ * fork. The child must discard it, or both would return the same bytes.
+ */
+static int test_fork(void)
+{
+    CK_BYTE parent[REQ_LEN], child[REQ_LEN];
+    int fds[2], status;
+    ssize_t len;
+    pid_t pid;
+
+    /* Fill the buffer of this thread */
+    if (local_rng(parent, REQ_LEN) != CKR_OK)
+        return TEST_FAIL;
+
+    if (pipe(fds) != 0)
+        return TEST_FAIL;
+
+    pid = fork();
+    if (pid < 0)
+        return TEST_FAIL;
+    if (pid == 0) {
+        close(fds[0]);
+        if (local_rng(child, REQ_LEN) != CKR_OK ||
+            write(fds[1], child, REQ_LEN) != REQ_LEN)
+            _exit(TEST_FAIL);
+        _exit(TEST_PASS);
+    }
+    close(fds[1]);
+
+    if (local_rng(parent, REQ_LEN) != CKR_OK)
+        return TEST_FAIL;
+
+    len = read(fds[0], child, REQ_LEN);
+    close(fds[0]);
+    waitpid(pid, &status, 0);
+    if (len != REQ_LEN || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != TEST_PASS) {
+        fprintf(stderr, "child failed to get random bytes\n");
+        return TEST_FAIL;
+    }
+
+    if (memcmp(parent, child, REQ_LEN) == 0) {
+        fprintf(stderr, "parent and child returned the same random bytes\n");
+        return TEST_FAIL;
+    }
+
+    return TEST_PASS;
+}
+
+static void *thread_rng(void *arg)
+{
+    CK_BYTE *out = arg;
+
+    return local_rng(out, REQ_LEN) == CKR_OK ? out : NULL;
+}
+
+/* Threads have buffers of their own */
+static int test_threads(void)
+{
+    CK_BYTE main_out[REQ_LEN], thread_out[REQ_LEN];
+    pthread_t thread;
+    void *ret;
+
+    if (local_rng(main_out, REQ_LEN) != CKR_OK)
+        return TEST_FAIL;
+
+    if (pthread_create(&thread, NULL, thread_rng, thread_out) != 0)
+        return TEST_FAIL;
+    pthread_join(thread, &ret);
+    if (ret == NULL)
+        return TEST_FAIL;
+
+    if (local_rng(main_out, REQ_LEN) != CKR_OK)
+        return TEST_FAIL;
+
+    if (memcmp(main_out, thread_out, REQ_LEN) == 0) {
+        fprintf(stderr, "two threads returned the same random bytes\n");
+        return TEST_FAIL;
+    }
+
+    return TEST_PASS;
+}
+
+int main(void)
+{
+    CK_BYTE large[1024];
+    int rc;
+
+    rc = test_no_repeats();
+    if (rc == TEST_PASS)
+        rc = test_fork();
+    if (rc == TEST_PASS)
+        rc = test_threads();
+
+    /* Large requests bypass the buffer */
+    if (rc == TEST_PASS && local_rng(large, sizeof(large)) != CKR_OK)
+        rc = TEST_FAIL;
+
+    printf("random number buffer: %s\n", rc == TEST_PASS ? "ok" : "failed");
+
+    return rc;
+}
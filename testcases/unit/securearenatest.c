@@ -0,0 +1,287 @@
+/*
+ * COPYRIGHT (c) International Business Machines Corp. 2024
+ *
+ * This program is provided under the terms of the Common Public License,
+ * version 1.0 (CPL-1.0). Any use, reproduction or distribution for this
+ * software constitutes recipient's acceptance of CPL-1.0 terms which can be
+ * found in the file LICENSE file or at
+ * https://opensource.org/licenses/cpl1.0.php
+ */
+
+/*
+ * Test of the locked memory arena used for sensitive attribute values.
+ */
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "secure_arena.h"
+#include "unittest.h"
+
+#define NUM_BLOCKS      64
+
+static unsigned char *fork_block;
+static int fork_child_ok;
+
+/*
+ * Fork handler registered before the handlers of the arena, like the one of
+ * the API layer, which finalizes the tokens and releases their objects in
+ * the child.
+ */
+static void child_release(void)
+{
+    unsigned char *p;
+
+    if (fork_block == NULL)
+        return;
+
+    secure_arena_free(fork_block);
+    p = secure_arena_alloc(16);
+    fork_child_ok = (p != NULL);
+    secure_arena_free(p);
+}
+
+static void register_fork_handler(void) __attribute__ ((constructor(101)));
+
+static void register_fork_handler(void)
+{
+    pthread_atfork(NULL, NULL, child_release);
+}
+
+static int test_fork(void)
+{
+    int i, status;
+    pid_t pid;
+
+    fork_block = secure_arena_alloc(64);
+    if (fork_block == NULL)
+        return TEST_FAIL;
+    memset(fork_block, 0x5a, 64);
+
+    pid = fork();
+    if (pid < 0)
+        return TEST_FAIL;
+    if (pid == 0)
+        _exit(fork_child_ok ? TEST_PASS : TEST_FAIL);
+
+    /* A deadlock in the fork handler hangs the child */
+    for (i = 0; i < 1000; i++) {
+        if (waitpid(pid, &status, WNOHANG) != 0)
+            break;
+        usleep(10000);
+    }
+    if (i == 1000) {
+        kill(pid, SIGKILL);
+        waitpid(pid, &status, 0);
+    }
+    if (i == 1000 || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != TEST_PASS) {
+        fprintf(stderr, "arena not usable in the fork handler of the "
+                "child\n");
+        return TEST_FAIL;
+    }
+
+    /* The parent still owns its block */
+    if (fork_block[63] != 0x5a) {
+        fprintf(stderr, "block of the parent changed by fork\n");
+        return TEST_FAIL;
+    }
+    secure_arena_free(fork_block);
+    fork_block = NULL;
+
+    return TEST_PASS;
+}
+
+/* Checks that the page holding 'ptr' is locked into memory */
+static int page_locked(const void *ptr)
+{
+    unsigned long start, end, addr = (unsigned long)ptr, kb;
+    char line[256];
+    int found = 0, locked = 0;
+    FILE *fp;
+
+    fp = fopen("/proc/self/smaps", "r");
+    if (fp == NULL)
+        return -1;
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (sscanf(line, "%lx-%lx ", &start, &end) == 2 &&
+            strchr(line, '-') < strchr(line, ' ')) {
+            found = (addr >= start && addr < end);
+            continue;
+        }
+        if (found && sscanf(line, "Locked: %lu kB", &kb) == 1) {
+            locked = (kb > 0);
+            break;
+        }
+    }
+    fclose(fp);
+
+    return locked;
+}
+
+/*
+ * A child that keeps the token objects of its parent, see fork-preserving
+ * mode, must keep their sensitive values locked into memory.
+ */
+static int test_fork_preserve(void)
+{
+    unsigned char *key;
+    int i, status, rc;
+    pid_t pid;
+
+    key = secure_arena_alloc(32);
+    if (key == NULL)
+        return TEST_FAIL;
+    for (i = 0; i < 32; i++)
+        key[i] = i;
+
+    if (page_locked(key) != 1) {
+        fprintf(stderr, "key value not locked in the parent\n");
+        secure_arena_free(key);
+        return TEST_FAIL;
+    }
+
+    pid = fork();
+    if (pid < 0)
+        return TEST_FAIL;
+    if (pid == 0) {
+        rc = TEST_PASS;
+        for (i = 0; i < 32; i++) {
+            if (key[i] != i)
+                rc = TEST_FAIL;
+        }
+        if (page_locked(key) != 1)
+            rc = TEST_FAIL;
+        secure_arena_free(key);
+        _exit(rc);
+    }
+
+    waitpid(pid, &status, 0);
+    secure_arena_free(key);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != TEST_PASS) {
+        fprintf(stderr, "key value not kept locked in the child\n");
+        return TEST_FAIL;
+    }
+
+    return TEST_PASS;
+}
+
+static int test_release(void)
+{
+    unsigned char *blocks[8];
+    int i, rc = TEST_PASS;
+
+    for (i = 0; i < 8; i++) {
+        blocks[i] = secure_arena_alloc(40);
+        if (blocks[i] == NULL)
+            return TEST_FAIL;
+        memset(blocks[i], 0xa5, 40);
+    }
+
+    /* Released blocks are collected until the end of the release */
+    secure_arena_release_begin();
+    for (i = 7; i >= 0; i--)
+        secure_arena_free(blocks[i]);
+    if (blocks[0][0] != 0xa5) {
+        fprintf(stderr, "block released before the end of the release\n");
+        rc = TEST_FAIL;
+    }
+    secure_arena_release_end();
+
+    for (i = 0; i < 8; i++) {
+        if (blocks[i][0] != 0 || blocks[i][39] != 0) {
+            fprintf(stderr, "bulk released block %d not cleansed\n", i);
+            rc = TEST_FAIL;
+        }
+    }
+
+    return rc;
+}
+
+int main(void)
+{
+    unsigned char *blocks[NUM_BLOCKS], *p, *q;
+    int i, rc = TEST_PASS;
+
+    p = secure_arena_alloc(32);
+    if (p == NULL) {
+        /* The locked memory limit may be too small for the arena */
+        printf("secure arena not available, skipped\n");
+        return TEST_SKIP;
+    }
+    if (!secure_arena_owns(p)) {
+        fprintf(stderr, "allocated block not owned by the arena\n");
+        rc = TEST_FAIL;
+    }
+
+    q = malloc(32);
+    if (q == NULL || secure_arena_owns(q)) {
+        fprintf(stderr, "heap block owned by the arena\n");
+        rc = TEST_FAIL;
+    }
+    free(q);
+
+    /* Released blocks are cleansed */
+    memset(p, 0xa5, 32);
+    secure_arena_free(p);
+    for (i = 0; i < 32; i++) {
+        if (p[i] != 0) {
+            fprintf(stderr, "released block not cleansed\n");
+            rc = TEST_FAIL;
+            break;
+        }
+    }
+
+    /* Blocks of different sizes must not overlap */
+    for (i = 0; i < NUM_BLOCKS; i++) {
+        blocks[i] = secure_arena_alloc(i * 7 + 1);
+        if (blocks[i] == NULL) {
+            fprintf(stderr, "allocation %d failed\n", i);
+            rc = TEST_FAIL;
+            goto out;
+        }
+        memset(blocks[i], i, i * 7 + 1);
+    }
+    for (i = 0; i < NUM_BLOCKS; i++) {
+        if (blocks[i][0] != i || blocks[i][i * 7] != i) {
+            fprintf(stderr, "block %d overwritten\n", i);
+            rc = TEST_FAIL;
+        }
+    }
+
+    /* Freed space is reused */
+    p = blocks[10];
+    secure_arena_free(blocks[10]);
+    blocks[10] = secure_arena_alloc(10 * 7 + 1);
+    if (blocks[10] != p) {
+        fprintf(stderr, "freed block not reused\n");
+        rc = TEST_FAIL;
+    }
+
+    /* Requests larger than the arena fall back to the caller */
+    if (secure_arena_alloc(64 * 1024 * 1024) != NULL) {
+        fprintf(stderr, "oversized allocation succeeded\n");
+        rc = TEST_FAIL;
+    }
+
+out:
+    for (i = 0; i < NUM_BLOCKS; i++)
+        secure_arena_free(blocks[i]);
+
+    if (test_release() != TEST_PASS)
+        rc = TEST_FAIL;
+    if (test_fork() != TEST_PASS)
+        rc = TEST_FAIL;
+    if (test_fork_preserve() != TEST_PASS)
+        rc = TEST_FAIL;
+
+    printf("secure arena: %s\n", rc == TEST_PASS ? "ok" : "failed");
+
+    return rc;
+}
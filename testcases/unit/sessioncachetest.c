@@ -0,0 +1,230 @@
+/*
+ * COPYRIGHT (c) International Business Machines Corp. 2024
+ *
+ * This program is provided under the terms of the Common Public License,
+ * version 1.0 (CPL-1.0). Any use, reproduction or distribution for this
+ * software constitutes recipient's acceptance of CPL-1.0 terms which can be
+ * found in the file LICENSE file or at
+ * https://opensource.org/licenses/cpl1.0.php
+ */
+
+/*
+ * Test of the per-thread cache of session handle translations of the API
+ * layer (Valid_Session).
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pkcs11types.h"
+#include "apiclient.h"
+#include "slotmgr.h"
+#include "apictl.h"
+#include "apiproto.h"
+#include "unittest.h"
+
+API_Proc_Struct_t *Anchor = NULL;
+
+static CK_SESSION_HANDLE add_session(CK_SLOT_ID slot_id,
+                                     CK_SESSION_HANDLE sessionh)
+{
+    ST_SESSION_T *sess;
+
+    sess = calloc(1, sizeof(*sess));
+    if (sess == NULL)
+        return 0;
+    sess->slotID = slot_id;
+    sess->sessionh = sessionh;
+
+    return AddToSessionList(sess);
+}
+
+static int check_session(CK_SESSION_HANDLE handle, CK_SLOT_ID slot_id,
+                         CK_SESSION_HANDLE sessionh, const char *what)
+{
+    ST_SESSION_T rsess;
+
+    memset(&rsess, 0, sizeof(rsess));
+    if (!Valid_Session(handle, &rsess)) {
+        fprintf(stderr, "%s: session %lu not found\n", what, handle);
+        return TEST_FAIL;
+    }
+    if (rsess.slotID != slot_id || rsess.sessionh != sessionh) {
+        fprintf(stderr, "%s: session %lu translated to slot %lu session %lu, "
+                "expected slot %lu session %lu\n", what, handle, rsess.slotID,
+                rsess.sessionh, slot_id, sessionh);
+        return TEST_FAIL;
+    }
+
+    return TEST_PASS;
+}
+
+static int check_closed(CK_SESSION_HANDLE handle, const char *what)
+{
+    ST_SESSION_T rsess;
+
+    if (Valid_Session(handle, &rsess)) {
+        fprintf(stderr, "%s: closed session %lu still valid\n", what, handle);
+        return TEST_FAIL;
+    }
+
+    return TEST_PASS;
+}
+
+/* Close and handle reuse within one thread */
+static int test_close_reuse(void)
+{
+    CK_SESSION_HANDLE h1, h2;
+
+    h1 = add_session(1, 11);
+    if (h1 == 0)
+        return TEST_FAIL;
+
+    /* The second lookup is served from the cache */
+    if (check_session(h1, 1, 11, "lookup") != TEST_PASS ||
+        check_session(h1, 1, 11, "cached lookup") != TEST_PASS)
+        return TEST_FAIL;
+
+    RemoveFromSessionList(h1);
+    if (check_closed(h1, "close") != TEST_PASS)
+        return TEST_FAIL;
+
+    /* The tree hands out the freed handle again */
+    h2 = add_session(2, 22);
+    if (h2 != h1) {
+        fprintf(stderr, "handle %lu not reused, got %lu\n", h1, h2);
+        return TEST_FAIL;
+    }
+    if (check_session(h2, 2, 22, "reused handle") != TEST_PASS)
+        return TEST_FAIL;
+
+    RemoveFromSessionList(h2);
+
+    return TEST_PASS;
+}
+
+struct reader {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    int step;
+    CK_SESSION_HANDLE handle;
+    int rc;
+};
+
+static void wait_step(struct reader *r, int step)
+{
+    pthread_mutex_lock(&r->mutex);
+    while (r->step < step)
+        pthread_cond_wait(&r->cond, &r->mutex);
+    pthread_mutex_unlock(&r->mutex);
+}
+
+static void next_step(struct reader *r)
+{
+    pthread_mutex_lock(&r->mutex);
+    r->step++;
+    pthread_cond_broadcast(&r->cond);
+    pthread_mutex_unlock(&r->mutex);
+}
+
+static void *reader_thread(void *arg)
+{
+    struct reader *r = arg;
+
+    /* Step 1: cache the translation of the first session */
+    wait_step(r, 1);
+    r->rc = check_session(r->handle, 1, 11, "other thread");
+    next_step(r);
+    if (r->rc != TEST_PASS)
+        return NULL;
+
+    /* Step 3: the session was closed by the main thread */
+    wait_step(r, 3);
+    r->rc = check_closed(r->handle, "closed by other thread");
+    next_step(r);
+    if (r->rc != TEST_PASS)
+        return NULL;
+
+    /* Step 5: the handle was reused by the main thread */
+    wait_step(r, 5);
+    r->rc = check_session(r->handle, 3, 33, "reused by other thread");
+    next_step(r);
+
+    return NULL;
+}
+
+/*
+ * Another thread closes the session whose translation a thread has cached,
+ * and opens a new session with the same handle.
+ */
+static int test_other_thread(void)
+{
+    struct reader r;
+    pthread_t thread;
+    CK_SESSION_HANDLE h;
+    int rc = TEST_FAIL;
+
+    memset(&r, 0, sizeof(r));
+    pthread_mutex_init(&r.mutex, NULL);
+    pthread_cond_init(&r.cond, NULL);
+
+    r.handle = add_session(1, 11);
+    if (r.handle == 0)
+        return TEST_FAIL;
+
+    if (pthread_create(&thread, NULL, reader_thread, &r) != 0)
+        return TEST_FAIL;
+
+    next_step(&r);
+    wait_step(&r, 2);
+    if (r.rc != TEST_PASS)
+        goto out;
+
+    RemoveFromSessionList(r.handle);
+    next_step(&r);
+    wait_step(&r, 4);
+    if (r.rc != TEST_PASS)
+        goto out;
+
+    h = add_session(3, 33);
+    next_step(&r);
+    wait_step(&r, 6);
+    rc = r.rc;
+    if (h != r.handle) {
+        fprintf(stderr, "handle %lu not reused, got %lu\n", r.handle, h);
+        rc = TEST_FAIL;
+    }
+
+    RemoveFromSessionList(h);
+
+out:
+    pthread_join(thread, NULL);
+    pthread_cond_destroy(&r.cond);
+    pthread_mutex_destroy(&r.mutex);
+
+    return rc;
+}
+
+int main(void)
+{
+    int rc;
+
+    Anchor = calloc(1, sizeof(*Anchor));
+    if (Anchor == NULL)
+        return TEST_FAIL;
+    bt_init(&Anchor->sess_btree, free);
+
+    rc = test_close_reuse();
+    if (rc == TEST_PASS)
+        rc = test_other_thread();
+
+    bt_destroy(&Anchor->sess_btree);
+    free(Anchor);
+
+    printf("session cache: %s\n", rc == TEST_PASS ? "ok" : "failed");
+
+    return rc;
+}
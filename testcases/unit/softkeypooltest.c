@@ -0,0 +1,230 @@
+/*
+ * COPYRIGHT (c) International Business Machines Corp. 2024
+ *
+ * This program is provided under the terms of the Common Public License,
+ * version 1.0 (CPL-1.0). Any use, reproduction or distribution for this
+ * software constitutes recipient's acceptance of CPL-1.0 terms which can be
+ * found in the file LICENSE file or at
+ * https://opensource.org/licenses/cpl1.0.php
+ */
+
+/*
+ * Test of the soft token key pair pre-generation pool.
+ *
+ * The OpenSSL key generation functions are replaced by stubs that return
+ * small keys, so that only the queueing, refilling, storage and accounting
+ * of the pool are tested.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include <openssl/ec.h>
+#include <openssl/evp.h>
+#include <openssl/objects.h>
+#include <openssl/rsa.h>
+
+#include "pkcs11types.h"
+#include "defs.h"
+#include "host_defs.h"
+#include "h_extern.h"
+#include "secure_arena.h"
+#include "soft_keypool.h"
+#include "unittest.h"
+
+#define POOL_SIZE       4
+#define POOL_THREADS    2
+
+static pthread_mutex_t stub_mutex = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int rsa_generated, ec_generated;
+
+static CK_RV generate(int type, EVP_PKEY **pkey)
+{
+    EVP_PKEY_CTX *ctx;
+    int ok;
+
+    *pkey = NULL;
+    ctx = EVP_PKEY_CTX_new_id(type, NULL);
+    if (ctx == NULL)
+        return CKR_HOST_MEMORY;
+
+    ok = EVP_PKEY_keygen_init(ctx) == 1 &&
+         (type == EVP_PKEY_RSA ?
+            EVP_PKEY_CTX_set_rsa_keygen_bits(ctx, 512) :
+            EVP_PKEY_CTX_set_ec_paramgen_curve_nid(ctx,
+                                                   NID_X9_62_prime256v1)) == 1 &&
+         EVP_PKEY_keygen(ctx, pkey) == 1;
+    EVP_PKEY_CTX_free(ctx);
+
+    return ok ? CKR_OK : CKR_FUNCTION_FAILED;
+}
+
+CK_RV openssl_specific_rsa_generate_pkey(CK_ULONG mod_bits,
+                                         const CK_BYTE *publ_exp,
+                                         CK_ULONG publ_exp_len,
+                                         EVP_PKEY **pkey)
+{
+    UNUSED(mod_bits);
+    UNUSED(publ_exp);
+    UNUSED(publ_exp_len);
+
+    if (generate(EVP_PKEY_RSA, pkey) != CKR_OK)
+        return CKR_FUNCTION_FAILED;
+
+    pthread_mutex_lock(&stub_mutex);
+    rsa_generated++;
+    pthread_mutex_unlock(&stub_mutex);
+
+    return CKR_OK;
+}
+
+CK_RV openssl_specific_ec_generate_pkey(int nid, EVP_PKEY **pkey)
+{
+    UNUSED(nid);
+
+    if (generate(EVP_PKEY_EC, pkey) != CKR_OK)
+        return CKR_FUNCTION_FAILED;
+
+    pthread_mutex_lock(&stub_mutex);
+    ec_generated++;
+    pthread_mutex_unlock(&stub_mutex);
+
+    return CKR_OK;
+}
+
+/* Wait until all queues of the pool are filled. */
+static int wait_filled(struct soft_keypool *pool)
+{
+    struct soft_keypool_stats stats;
+    unsigned int i, filled, tries;
+
+    for (tries = 0; tries < 500; tries++) {
+        for (i = 0, filled = 0; i < pool->num_entries; i++) {
+            if (soft_keypool_get_stats(pool, i, &stats) == CKR_OK &&
+                stats.ready == stats.size)
+                filled++;
+        }
+
+        if (filled == pool->num_entries)
+            return 0;
+        usleep(10000);
+    }
+
+    return -1;
+}
+
+int main(void)
+{
+    static const CK_BYTE publ_exp[] = { 0x00, 0x01, 0x00, 0x01 };
+    static const CK_BYTE other_exp[] = { 0x03 };
+    struct soft_keypool pool;
+    struct soft_keypool_stats rsa_stats, ec_stats;
+    unsigned char params[64], *p = params, *probe;
+    int params_len, i, rc = TEST_PASS;
+    EVP_PKEY *pkey;
+
+    /* The queued keys are kept in the secure arena */
+    probe = secure_arena_alloc(1);
+    if (probe == NULL) {
+        printf("secure arena not available, skipped\n");
+        return TEST_SKIP;
+    }
+    secure_arena_free(probe);
+
+    params_len = i2d_ASN1_OBJECT(OBJ_nid2obj(NID_X9_62_prime256v1), &p);
+
+    if (soft_keypool_init(&pool) != CKR_OK)
+        return TEST_FAIL;
+    pool.size = POOL_SIZE;
+    pool.num_threads = POOL_THREADS;
+
+    if (soft_keypool_add_rsa(&pool, 2048) != CKR_OK ||
+        soft_keypool_add_ec(&pool, NID_X9_62_prime256v1) != CKR_OK) {
+        fprintf(stderr, "adding pool entries failed\n");
+        return TEST_FAIL;
+    }
+
+    /* The first request starts the workers and can not be served */
+    pkey = soft_keypool_get_rsa(&pool, 2048, publ_exp, sizeof(publ_exp));
+    if (pkey != NULL || pool.running != POOL_THREADS) {
+        fprintf(stderr, "first request: key %p, %u threads\n", (void *)pkey,
+                pool.running);
+        rc = TEST_FAIL;
+        EVP_PKEY_free(pkey);
+    }
+
+    if (wait_filled(&pool) != 0) {
+        fprintf(stderr, "pool not filled\n");
+        rc = TEST_FAIL;
+        goto out;
+    }
+
+    for (i = 0; i < POOL_SIZE; i++) {
+        if (!secure_arena_owns(pool.entries[0].keys[i]) ||
+            !secure_arena_owns(pool.entries[1].keys[i])) {
+            fprintf(stderr, "queued key not in the secure arena\n");
+            rc = TEST_FAIL;
+        }
+    }
+
+    for (i = 0; i < POOL_SIZE; i++) {
+        pkey = soft_keypool_get_rsa(&pool, 2048, publ_exp, sizeof(publ_exp));
+        if (pkey == NULL || EVP_PKEY_id(pkey) != EVP_PKEY_RSA)
+            rc = TEST_FAIL;
+        EVP_PKEY_free(pkey);
+
+        pkey = soft_keypool_get_ec(&pool, params, params_len);
+        if (pkey == NULL || EVP_PKEY_id(pkey) != EVP_PKEY_EC)
+            rc = TEST_FAIL;
+        EVP_PKEY_free(pkey);
+    }
+
+    /* Requests that do not match an entry are not served nor counted */
+    if (soft_keypool_get_rsa(&pool, 3072, publ_exp,
+                             sizeof(publ_exp)) != NULL ||
+        soft_keypool_get_rsa(&pool, 2048, other_exp,
+                             sizeof(other_exp)) != NULL ||
+        soft_keypool_get_ec(&pool, params, params_len - 1) != NULL) {
+        fprintf(stderr, "unexpected key for non-matching request\n");
+        rc = TEST_FAIL;
+    }
+
+    if (soft_keypool_get_stats(&pool, 0, &rsa_stats) != CKR_OK ||
+        soft_keypool_get_stats(&pool, 1, &ec_stats) != CKR_OK ||
+        soft_keypool_get_stats(&pool, 2, &ec_stats) != CKR_ARGUMENTS_BAD ||
+        rsa_stats.key_type != CKK_RSA || rsa_stats.mod_bits != 2048 ||
+        rsa_stats.hits != POOL_SIZE || rsa_stats.misses != 1 ||
+        rsa_stats.hit_rate != POOL_SIZE * 100 / (POOL_SIZE + 1) ||
+        ec_stats.key_type != CKK_EC || ec_stats.hits != POOL_SIZE ||
+        ec_stats.misses != 0 || ec_stats.hit_rate != 100) {
+        fprintf(stderr, "unexpected statistics: rsa %lu/%lu ec %lu/%lu\n",
+                rsa_stats.hits, rsa_stats.misses, ec_stats.hits,
+                ec_stats.misses);
+        rc = TEST_FAIL;
+    }
+
+    /* The taken keys are replaced in the background */
+    if (wait_filled(&pool) != 0) {
+        fprintf(stderr, "pool not refilled\n");
+        rc = TEST_FAIL;
+    }
+
+out:
+    soft_keypool_final(&pool, FALSE);
+
+    /* Keys are only generated to replace taken ones, up to the queue size */
+    if (rsa_generated > 2 * POOL_SIZE + POOL_THREADS ||
+        ec_generated > 2 * POOL_SIZE + POOL_THREADS) {
+        fprintf(stderr, "too many keys generated: rsa %u ec %u\n",
+                rsa_generated, ec_generated);
+        rc = TEST_FAIL;
+    }
+
+    printf("keygen pool: rsa %u ec %u keys generated, %s\n", rsa_generated,
+           ec_generated, rc == TEST_PASS ? "ok" : "failed");
+
+    return rc;
+}
@@ -0,0 +1,192 @@
+/*
+ * COPYRIGHT (c) International Business Machines Corp. 2024
+ *
+ * This program is provided under the terms of the Common Public License,
+ * version 1.0 (CPL-1.0). Any use, reproduction or distribution for this
+ * software constitutes recipient's acceptance of CPL-1.0 terms which can be
+ * found in the file LICENSE file or at
+ * https://opensource.org/licenses/cpl1.0.php
+ */
+
+/*
+ * Test of the lock-free freshness check of token objects against the token
+ * object lists in the shared memory.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pkcs11types.h"
+#include "defs.h"
+#include "host_defs.h"
+
+/* Simulates a writer that runs while the reader compares the entry */
+static void (*seq_test_hook)(LW_SHM_TYPE *global_shm);
+#define TOK_OBJ_SEQ_TEST_HOOK(shm)      \
+            do { if (seq_test_hook) seq_test_hook(shm); } while (0)
+
+#include "tok_obj_seq.h"
+#include "unittest.h"
+
+#define STRESS_WRITES   200000
+
+static const CK_BYTE obj_name[8] = "OBJ00001";
+static volatile int writer_done;
+
+static void set_entry(TOK_OBJ_ENTRY *entry, const CK_BYTE *name,
+                      CK_ULONG_32 count_hi, CK_ULONG_32 count_lo)
+{
+    memcpy(entry->name, name, 8);
+    __atomic_store_n(&entry->count_hi, count_hi, __ATOMIC_RELAXED);
+    __atomic_store_n(&entry->count_lo, count_lo, __ATOMIC_RELAXED);
+}
+
+static void concurrent_update(LW_SHM_TYPE *global_shm)
+{
+    tok_obj_seq_write_begin(global_shm);
+    set_entry(&global_shm->publ_tok_objs[0], obj_name, 0, 2);
+    tok_obj_seq_write_end(global_shm);
+}
+
+static void concurrent_noop_write(LW_SHM_TYPE *global_shm)
+{
+    tok_obj_seq_write_begin(global_shm);
+    tok_obj_seq_write_end(global_shm);
+}
+
+static int test_single(LW_SHM_TYPE *global_shm)
+{
+    CK_BYTE other[8] = "OBJ00002";
+
+    set_entry(&global_shm->publ_tok_objs[0], obj_name, 0, 1);
+    global_shm->num_publ_tok_obj = 1;
+
+    if (!tok_obj_seq_entry_unchanged(global_shm, FALSE, 0, obj_name, 0, 1)) {
+        fprintf(stderr, "unchanged entry reported as changed\n");
+        return TEST_FAIL;
+    }
+
+    if (tok_obj_seq_entry_unchanged(global_shm, FALSE, 0, obj_name, 0, 2) ||
+        tok_obj_seq_entry_unchanged(global_shm, FALSE, 0, other, 0, 1)) {
+        fprintf(stderr, "changed entry reported as unchanged\n");
+        return TEST_FAIL;
+    }
+
+    /* The object moved out of the list, or is in the other list */
+    if (tok_obj_seq_entry_unchanged(global_shm, FALSE, 1, obj_name, 0, 1) ||
+        tok_obj_seq_entry_unchanged(global_shm, TRUE, 0, obj_name, 0, 1)) {
+        fprintf(stderr, "entry out of the list reported as unchanged\n");
+        return TEST_FAIL;
+    }
+
+    /* A writer is active */
+    tok_obj_seq_write_begin(global_shm);
+    if (tok_obj_seq_entry_unchanged(global_shm, FALSE, 0, obj_name, 0, 1)) {
+        fprintf(stderr, "entry reported as unchanged during a write\n");
+        return TEST_FAIL;
+    }
+    tok_obj_seq_write_end(global_shm);
+
+    /*
+     * A write that happens while the entry is compared makes the reader fall
+     * back to the locked check, whether or not it changed the entry.
+     */
+    seq_test_hook = concurrent_update;
+    if (tok_obj_seq_entry_unchanged(global_shm, FALSE, 0, obj_name, 0, 1)) {
+        fprintf(stderr, "entry updated during the check reported as "
+                "unchanged\n");
+        return TEST_FAIL;
+    }
+    seq_test_hook = concurrent_noop_write;
+    if (tok_obj_seq_entry_unchanged(global_shm, FALSE, 0, obj_name, 0, 2)) {
+        fprintf(stderr, "write during the check not detected\n");
+        return TEST_FAIL;
+    }
+    seq_test_hook = NULL;
+
+    /* The retried check sees the new counter */
+    if (!tok_obj_seq_entry_unchanged(global_shm, FALSE, 0, obj_name, 0, 2)) {
+        fprintf(stderr, "retry after a write failed\n");
+        return TEST_FAIL;
+    }
+
+    return TEST_PASS;
+}
+
+/*
+ * The writer only ever leaves the entry with update counter 2. Counter 1 is
+ * stored in between, within the write section only, so a reader checking
+ * for counter 1 must never see the entry as unchanged.
+ */
+static void *writer_thread(void *arg)
+{
+    LW_SHM_TYPE *global_shm = arg;
+    TOK_OBJ_ENTRY *entry = &global_shm->priv_tok_objs[3];
+    int i;
+
+    for (i = 0; i < STRESS_WRITES; i++) {
+        tok_obj_seq_write_begin(global_shm);
+        set_entry(entry, obj_name, 0, 1);
+        set_entry(entry, obj_name, 0, 2);
+        tok_obj_seq_write_end(global_shm);
+    }
+    writer_done = 1;
+
+    return NULL;
+}
+
+static int test_stress(LW_SHM_TYPE *global_shm)
+{
+    pthread_t writer;
+    unsigned long checks = 0, torn = 0;
+
+    set_entry(&global_shm->priv_tok_objs[3], obj_name, 0, 2);
+    global_shm->num_priv_tok_obj = 4;
+    writer_done = 0;
+
+    if (pthread_create(&writer, NULL, writer_thread, global_shm) != 0)
+        return TEST_FAIL;
+
+    while (!writer_done) {
+        if (tok_obj_seq_entry_unchanged(global_shm, TRUE, 3, obj_name, 0, 1))
+            torn++;
+        checks++;
+    }
+    pthread_join(writer, NULL);
+
+    if (torn != 0) {
+        fprintf(stderr, "%lu of %lu checks saw an entry in the middle of a "
+                "write\n", torn, checks);
+        return TEST_FAIL;
+    }
+
+    if (!tok_obj_seq_entry_unchanged(global_shm, TRUE, 3, obj_name, 0, 2)) {
+        fprintf(stderr, "entry not unchanged after the writes\n");
+        return TEST_FAIL;
+    }
+
+    return TEST_PASS;
+}
+
+int main(void)
+{
+    LW_SHM_TYPE *global_shm;
+    int rc;
+
+    global_shm = calloc(1, sizeof(*global_shm));
+    if (global_shm == NULL)
+        return TEST_FAIL;
+
+    rc = test_single(global_shm);
+    if (rc == TEST_PASS)
+        rc = test_stress(global_shm);
+
+    free(global_shm);
+
+    printf("token object sequence counter: %s\n",
+           rc == TEST_PASS ? "ok" : "failed");
+
+    return rc;
+}
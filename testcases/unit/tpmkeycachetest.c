@@ -0,0 +1,164 @@
+/*
+ * COPYRIGHT (c) International Business Machines Corp. 2024
+ *
+ * This program is provided under the terms of the Common Public License,
+ * version 1.0 (CPL-1.0). Any use, reproduction or distribution for this
+ * software constitutes recipient's acceptance of CPL-1.0 terms which can be
+ * found in the file LICENSE file or at
+ * https://opensource.org/licenses/cpl1.0.php
+ */
+
+/*
+ * Test of the TPM token cache of loaded key handles. Loading and unloading
+ * keys is simulated, so that only hits, LRU eviction and the handling of keys
+ * in use are tested.
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "pkcs11types.h"
+#include "tpm_keycache.h"
+#include "unittest.h"
+
+#define SLOTS       3
+#define NUM_KEYS    5
+
+static int loaded[64];
+static uint32_t next_handle = 1;
+
+static void unload(void *arg, uint32_t handle)
+{
+    (void)arg;
+    loaded[handle] = 0;
+}
+
+static CK_BYTE blobs[NUM_KEYS][16];
+static unsigned char digests[NUM_KEYS][TPM_KEYCACHE_DIGEST_SIZE];
+
+/* Uses key k like token_rsa_load_key() and the RSA operations do */
+static uint32_t use_key(struct tpm_keycache *cache, int k, CK_BBOOL release)
+{
+    uint32_t handle;
+
+    if (!tpm_keycache_get(cache, &blobs[k], digests[k], &handle)) {
+        handle = next_handle++;
+        loaded[handle] = 1;
+        tpm_keycache_add(cache, &blobs[k], digests[k], handle);
+    }
+    if (release)
+        tpm_keycache_release(cache, handle);
+
+    return handle;
+}
+
+static int num_loaded(void)
+{
+    unsigned int i, n = 0;
+
+    for (i = 0; i < ARRAYSIZE(loaded); i++)
+        n += loaded[i];
+
+    return n;
+}
+
+int main(void)
+{
+    struct tpm_keycache cache;
+    struct tpm_keycache_stats stats;
+    uint32_t h0, h1, busy[SLOTS + 1];
+    int i, rc = TEST_PASS;
+
+    for (i = 0; i < NUM_KEYS; i++) {
+        memset(blobs[i], i, sizeof(blobs[i]));
+        if (tpm_keycache_digest(blobs[i], sizeof(blobs[i]), NULL, 0,
+                                digests[i]) != CKR_OK) {
+            fprintf(stderr, "tpm_keycache_digest failed\n");
+            return TEST_FAIL;
+        }
+    }
+
+    if (tpm_keycache_init(&cache, SLOTS, unload, NULL) != CKR_OK) {
+        fprintf(stderr, "tpm_keycache_init failed\n");
+        return TEST_FAIL;
+    }
+
+    /* Repeated use of a key loads it once */
+    h0 = use_key(&cache, 0, TRUE);
+    for (i = 0; i < 10; i++) {
+        if (use_key(&cache, 0, TRUE) != h0) {
+            fprintf(stderr, "cached key handle not reused\n");
+            rc = TEST_FAIL;
+            break;
+        }
+    }
+    tpm_keycache_get_stats(&cache, &stats);
+    if (stats.hits != 10 || stats.misses != 1 || !loaded[h0]) {
+        fprintf(stderr, "hits %lu misses %lu\n", stats.hits, stats.misses);
+        rc = TEST_FAIL;
+    }
+
+    /* The least recently used key is unloaded when the cache is full */
+    h1 = use_key(&cache, 1, TRUE);
+    use_key(&cache, 2, TRUE);
+    use_key(&cache, 0, TRUE);
+    use_key(&cache, 3, TRUE);
+    tpm_keycache_get_stats(&cache, &stats);
+    if (loaded[h1] || !loaded[h0] || stats.used != SLOTS ||
+        stats.evictions != 1 || num_loaded() != SLOTS) {
+        fprintf(stderr, "least recently used key not evicted\n");
+        rc = TEST_FAIL;
+    }
+
+    /* A changed key blob replaces the entry of the key object */
+    memcpy(blobs[4], blobs[0], sizeof(blobs[4]));
+    tpm_keycache_digest(blobs[4], sizeof(blobs[4]), (CK_BYTE *)"auth", 4,
+                        digests[0]);
+    if (use_key(&cache, 0, TRUE) == h0 || loaded[h0] ||
+        num_loaded() != SLOTS) {
+        fprintf(stderr, "key with changed blob not reloaded\n");
+        rc = TEST_FAIL;
+    }
+
+    /* Keys in use are not evicted, a key is unloaded after use if all
+     * entries are in use */
+    tpm_keycache_flush(&cache);
+    for (i = 0; i < SLOTS; i++)
+        busy[i] = use_key(&cache, i, FALSE);
+    busy[SLOTS] = use_key(&cache, SLOTS, FALSE);
+    for (i = 0; i < SLOTS; i++) {
+        if (!loaded[busy[i]]) {
+            fprintf(stderr, "key in use was evicted\n");
+            rc = TEST_FAIL;
+        }
+    }
+    tpm_keycache_release(&cache, busy[SLOTS]);
+    if (loaded[busy[SLOTS]]) {
+        fprintf(stderr, "uncached key not unloaded after use\n");
+        rc = TEST_FAIL;
+    }
+
+    /* Keys in use are unloaded when released after a flush */
+    tpm_keycache_flush(&cache);
+    if (!loaded[busy[0]] || use_key(&cache, 0, TRUE) == busy[0]) {
+        fprintf(stderr, "flushed key in use unloaded or reused\n");
+        rc = TEST_FAIL;
+    }
+    for (i = 0; i < SLOTS; i++)
+        tpm_keycache_release(&cache, busy[i]);
+    if (num_loaded() != 0) {
+        fprintf(stderr, "%d keys loaded after flush\n", num_loaded());
+        rc = TEST_FAIL;
+    }
+
+    tpm_keycache_final(&cache, TRUE);
+    if (num_loaded() != 0) {
+        fprintf(stderr, "keys left loaded\n");
+        rc = TEST_FAIL;
+    }
+
+    printf("tpm key cache: %s\n", rc == TEST_PASS ? "ok" : "failed");
+
+    return rc;
+}
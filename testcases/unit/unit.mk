@@ -1,10 +1,16 @@
 check_PROGRAMS = testcases/unit/policytest testcases/unit/hashmaptest	\
 	testcases/unit/mechtabletest testcases/unit/configdump		\
-	testcases/unit/buffertest testcases/unit/uritest
+	testcases/unit/buffertest testcases/unit/uritest		\
+	testcases/unit/securearenatest testcases/unit/keymigratetest	\
+	testcases/unit/sessioncachetest testcases/unit/tokobjseqtest	\
+	testcases/unit/rngbuffertest
 
 TESTS = testcases/unit/policytest testcases/unit/hashmaptest		\
 	testcases/unit/mechtabletest testcases/unit/configdump		\
-	testcases/unit/buffertest testcases/unit/uritest
+	testcases/unit/buffertest testcases/unit/uritest		\
+	testcases/unit/securearenatest testcases/unit/keymigratetest	\
+	testcases/unit/sessioncachetest testcases/unit/tokobjseqtest	\
+	testcases/unit/rngbuffertest
 
 testcases_unit_policytest_CFLAGS=-I${top_srcdir}/usr/lib/common		\
 	-I${top_srcdir}/usr/lib/api -I${top_srcdir}/usr/include		\
@@ -56,3 +62,155 @@ testcases_unit_uritest_SOURCES=testcases/unit/uritest.c		\
 
 testcases_unit_uritest_CFLAGS=-I${top_srcdir}/usr/lib/common	\
 	-I${top_srcdir}/usr/include -I${top_builddir}/usr/lib/api
+
+testcases_unit_securearenatest_SOURCES=testcases/unit/securearenatest.c \
+	usr/lib/common/secure_arena.c usr/lib/common/trace.c
+
+testcases_unit_securearenatest_CFLAGS=-I${top_srcdir}/usr/lib/common	\
+	-I${top_srcdir}/usr/include -I${top_builddir}/usr/lib/api	\
+	-DSTDLL_NAME=\"securearenatest\"
+
+testcases_unit_securearenatest_LDADD=-lcrypto -lpthread
+
+testcases_unit_keymigratetest_SOURCES=testcases/unit/keymigratetest.c \
+	usr/lib/common/key_migrate.c
+
+testcases_unit_keymigratetest_CFLAGS=-I${top_srcdir}/usr/lib/common	\
+	-I${top_srcdir}/usr/include
+
+testcases_unit_keymigratetest_LDADD=-lcrypto -lpthread
+
+testcases_unit_sessioncachetest_SOURCES=testcases/unit/sessioncachetest.c \
+	usr/lib/api/apiutil.c usr/lib/common/trace.c
+
+nodist_testcases_unit_sessioncachetest_SOURCES=usr/lib/api/mechtable.c
+
+testcases_unit_sessioncachetest_CFLAGS=-I${top_srcdir}/usr/lib/api	\
+	-I${top_srcdir}/usr/lib/common -I${top_srcdir}/usr/include	\
+	-I${top_builddir}/usr/lib/api -DAPI -DSTDLL_NAME=\"sessioncachetest\"
+
+testcases_unit_sessioncachetest_LDADD=-lpthread -ldl
+
+if ENABLE_LOCKS
+testcases_unit_sessioncachetest_SOURCES += usr/lib/common/lock_btree.c
+else
+testcases_unit_sessioncachetest_SOURCES += usr/lib/common/btree.c
+testcases_unit_sessioncachetest_LDADD += -litm
+endif
+
+testcases_unit_tokobjseqtest_SOURCES=testcases/unit/tokobjseqtest.c
+
+testcases_unit_tokobjseqtest_CFLAGS=-I${top_srcdir}/usr/lib/common	\
+	-I${top_srcdir}/usr/include -I${top_builddir}/usr/lib/api
+
+testcases_unit_tokobjseqtest_LDADD=-lpthread
+
+testcases_unit_rngbuffertest_SOURCES=testcases/unit/rngbuffertest.c	\
+	usr/lib/common/mech_rng.c usr/lib/common/trace.c
+
+testcases_unit_rngbuffertest_CFLAGS=-I${top_srcdir}/usr/lib/common	\
+	-I${top_srcdir}/usr/include -I${top_builddir}/usr/lib/api	\
+	-DSTDLL_NAME=\"rngbuffertest\"
+
+testcases_unit_rngbuffertest_LDADD=-lcrypto -lpthread
+
+if ENABLE_SWTOK
+check_PROGRAMS += testcases/unit/softkeypooltest
+TESTS += testcases/unit/softkeypooltest
+
+testcases_unit_softkeypooltest_CFLAGS=-I${top_srcdir}/usr/lib/soft_stdll	\
+	-I${top_srcdir}/usr/lib/common -I${top_srcdir}/usr/include	\
+	-I${top_builddir}/usr/lib/api -DSTDLL_NAME=\"softkeypooltest\"
+
+testcases_unit_softkeypooltest_LDADD=-lcrypto -lpthread
+
+testcases_unit_softkeypooltest_SOURCES=testcases/unit/softkeypooltest.c \
+	usr/lib/soft_stdll/soft_keypool.c usr/lib/common/secure_arena.c	\
+	usr/lib/common/trace.c
+
+check_PROGRAMS += testcases/unit/objecttest
+TESTS += testcases/unit/objecttest
+
+# object.c needs most of the token, so the test is built from the soft
+# token sources
+testcases_unit_objecttest_CFLAGS=${opencryptoki_stdll_libpkcs11_sw_la_CFLAGS}
+
+testcases_unit_objecttest_LDADD=-lpthread -lcrypto -lrt
+
+testcases_unit_objecttest_SOURCES=testcases/unit/objecttest.c		\
+	${opencryptoki_stdll_libpkcs11_sw_la_SOURCES}
+
+if !ENABLE_LOCKS
+testcases_unit_objecttest_LDADD += -litm
+endif
+endif
+
+if ENABLE_ICSFTOK
+check_PROGRAMS += testcases/unit/icsftransporttest
+TESTS += testcases/unit/icsftransporttest
+
+testcases_unit_icsftransporttest_CFLAGS=-I${top_srcdir}/usr/lib/icsf_stdll	\
+	-I${top_srcdir}/usr/lib/common -I${top_srcdir}/usr/include	\
+	-I${top_builddir}/usr/lib/api -DSTDLL_NAME=\"icsftransporttest\"
+
+testcases_unit_icsftransporttest_LDADD=-lldap -llber -lpthread
+
+testcases_unit_icsftransporttest_SOURCES=testcases/unit/icsftransporttest.c \
+	usr/lib/icsf_stdll/icsf.c usr/lib/common/trace.c
+endif
+
+if ENABLE_EP11TOK
+check_LTLIBRARIES += testcases/unit/libep11stub.la
+check_PROGRAMS += testcases/unit/ep11asynctest
+TESTS += testcases/unit/ep11asynctest
+
+testcases_unit_libep11stub_la_CFLAGS=-I${top_srcdir}/usr/lib/ep11_stdll	\
+	-I${top_srcdir}/usr/include
+
+# -rpath makes libtool build a shared object, which is never installed
+testcases_unit_libep11stub_la_LDFLAGS=-module -shared -avoid-version	\
+	-rpath ${abs_top_builddir}/testcases/unit -lpthread
+
+testcases_unit_libep11stub_la_SOURCES=testcases/unit/ep11stub.c	\
+	testcases/unit/ep11stub.h
+
+testcases_unit_ep11asynctest_CFLAGS=-I${top_srcdir}/usr/lib/ep11_stdll	\
+	-I${top_srcdir}/usr/lib/common -I${top_srcdir}/usr/include	\
+	-I${top_builddir}/usr/lib/api -DSTDLL_NAME=\"ep11asynctest\"	\
+	-DEP11STUB_LIBRARY=\"${abs_top_builddir}/testcases/unit/.libs/libep11stub.so\"
+
+testcases_unit_ep11asynctest_LDADD=-lpthread -ldl
+
+EXTRA_testcases_unit_ep11asynctest_DEPENDENCIES=testcases/unit/libep11stub.la
+
+testcases_unit_ep11asynctest_SOURCES=testcases/unit/ep11asynctest.c	\
+	usr/lib/ep11_stdll/ep11_async.c usr/lib/common/trace.c
+endif
+
+if ENABLE_TPMTOK
+check_PROGRAMS += testcases/unit/tpmkeycachetest
+TESTS += testcases/unit/tpmkeycachetest
+
+testcases_unit_tpmkeycachetest_CFLAGS=-I${top_srcdir}/usr/lib/tpm_stdll	\
+	-I${top_srcdir}/usr/lib/common -I${top_srcdir}/usr/include	\
+	-I${top_builddir}/usr/lib/api -DSTDLL_NAME=\"tpmkeycachetest\"
+
+testcases_unit_tpmkeycachetest_LDADD=-lcrypto -lpthread
+
+testcases_unit_tpmkeycachetest_SOURCES=testcases/unit/tpmkeycachetest.c \
+	usr/lib/tpm_stdll/tpm_keycache.c usr/lib/common/trace.c
+endif
+
+if ENABLE_PKCSTOK_MIGRATE
+check_PROGRAMS += testcases/unit/migraterepotest
+TESTS += testcases/unit/migraterepotest
+
+testcases_unit_migraterepotest_CFLAGS=-I${top_srcdir}/usr/sbin/pkcstok_migrate	\
+	-I${top_srcdir}/usr/lib/common -I${top_srcdir}/usr/include	\
+	-I${top_builddir}/usr/lib/api
+
+testcases_unit_migraterepotest_LDADD=-lcrypto -lpthread -ldl
+
+testcases_unit_migraterepotest_SOURCES=testcases/unit/migraterepotest.c \
+	usr/sbin/pkcstok_migrate/migrate_repo.c usr/lib/common/pkcs_utils.c
+endif
@@ -43,6 +43,8 @@ struct API_Slot {
     CK_RV (*pSTfini)(STDLL_TokData_t *, CK_SLOT_ID, SLOT_INFO *,
                      struct trace_handle_t *, CK_BBOOL);
     CK_RV(*pSTcloseall)(STDLL_TokData_t *, CK_SLOT_ID);
+    CK_RV (*pSTforkchild)(STDLL_TokData_t *, CK_SLOT_ID, SLOT_INFO *,
+                          struct trace_handle_t *, CK_BBOOL);
 };
 
 
@@ -68,6 +68,10 @@ int bt_is_empty(struct btree *t);
 void bt_for_each_node(STDLL_TokData_t *, struct btree *t,
                       void (*)(STDLL_TokData_t *, void *, unsigned long,
                                void *), void *);
+unsigned long bt_for_each_node_from(STDLL_TokData_t *, struct btree *t,
+                                    unsigned long start,
+                                    int (*)(STDLL_TokData_t *, void *,
+                                            unsigned long, void *), void *);
 unsigned long bt_nodes_in_use(struct btree *t);
 unsigned long bt_node_add(struct btree *t, void *value);
 void *bt_node_free(struct btree *t, unsigned long node_num,
@@ -1001,6 +1001,12 @@ typedef struct CK_MECHANISM_INFO {
 #define CKF_EC_NAMEDCURVE      0x00800000
 #define CKF_EC_UNCOMPRESS      0x01000000
 #define CKF_EC_COMPRESS        0x02000000
+/* The following are new for v3.0 */
+#define CKF_MESSAGE_ENCRYPT    0x00000002
+#define CKF_MESSAGE_DECRYPT    0x00000004
+#define CKF_MESSAGE_SIGN       0x00000008
+#define CKF_MESSAGE_VERIFY     0x00000010
+#define CKF_MULTI_MESSAGE      0x00000020
 
 #define CKF_EXTENSION          0x80000000       /* FALSE for 2.01 */
 
@@ -1295,6 +1301,27 @@ typedef struct CK_GCM_PARAMS {
 
 typedef CK_GCM_PARAMS CK_PTR CK_GCM_PARAMS_PTR;
 
+/* CK_GENERATOR_FUNCTION is new for v3.0 */
+typedef CK_ULONG CK_GENERATOR_FUNCTION;
+
+#define CKG_NO_GENERATE                 0x00000000UL
+#define CKG_GENERATE                    0x00000001UL
+#define CKG_GENERATE_COUNTER            0x00000002UL
+#define CKG_GENERATE_RANDOM             0x00000003UL
+#define CKG_GENERATE_COUNTER_XOR        0x00000004UL
+
+/* CK_GCM_MESSAGE_PARAMS is new for v3.0 */
+typedef struct CK_GCM_MESSAGE_PARAMS {
+    CK_BYTE_PTR pIv;
+    CK_ULONG ulIvLen;
+    CK_ULONG ulIvFixedBits;
+    CK_GENERATOR_FUNCTION ivGenerator;
+    CK_BYTE_PTR pTag;
+    CK_ULONG ulTagBits;
+} CK_GCM_MESSAGE_PARAMS;
+
+typedef CK_GCM_MESSAGE_PARAMS CK_PTR CK_GCM_MESSAGE_PARAMS_PTR;
+
 /*
  * There is a discrepancy between what the PKCS#11 v2.40 standard states in the
  * documentation and the official header file about structure CK_GCM_PARAMS:
@@ -104,6 +104,8 @@ typedef struct {
 #define FLAG_STATISTICS_ENABLED       0x02
 #define FLAG_STATISTICS_IMPLICIT      0x04
 #define FLAG_STATISTICS_INTERNAL      0x08
+#define FLAG_LAZY_SLOT_INIT           0x10
+#define FLAG_FORK_PRESERVE_STATE      0x20
 
 #ifdef PKCS64
 
@@ -350,6 +350,67 @@ typedef CK_RV (CK_PTR ST_C_IBM_ReencryptSingle)(STDLL_TokData_t *tokdata,
                                                 CK_BYTE_PTR pReencryptedData,
                                             CK_ULONG_PTR pulReencryptedDataLen);
 
+typedef CK_RV (CK_PTR ST_C_MessageEncryptInit) (STDLL_TokData_t *tokdata,
+                                               ST_SESSION_T *sSession,
+                                               CK_MECHANISM_PTR pMechanism,
+                                               CK_OBJECT_HANDLE hKey);
+typedef CK_RV (CK_PTR ST_C_EncryptMessage) (STDLL_TokData_t *tokdata,
+                                           ST_SESSION_T *sSession,
+                                           CK_VOID_PTR pParameter,
+                                           CK_ULONG ulParameterLen,
+                                           CK_BYTE_PTR pAssociatedData,
+                                           CK_ULONG ulAssociatedDataLen,
+                                           CK_BYTE_PTR pPlaintext,
+                                           CK_ULONG ulPlaintextLen,
+                                           CK_BYTE_PTR pCiphertext,
+                                           CK_ULONG_PTR pulCiphertextLen);
+typedef CK_RV (CK_PTR ST_C_MessageEncryptFinal) (STDLL_TokData_t *tokdata,
+                                                ST_SESSION_T *sSession);
+typedef CK_RV (CK_PTR ST_C_MessageDecryptInit) (STDLL_TokData_t *tokdata,
+                                               ST_SESSION_T *sSession,
+                                               CK_MECHANISM_PTR pMechanism,
+                                               CK_OBJECT_HANDLE hKey);
+typedef CK_RV (CK_PTR ST_C_DecryptMessage) (STDLL_TokData_t *tokdata,
+                                           ST_SESSION_T *sSession,
+                                           CK_VOID_PTR pParameter,
+                                           CK_ULONG ulParameterLen,
+                                           CK_BYTE_PTR pAssociatedData,
+                                           CK_ULONG ulAssociatedDataLen,
+                                           CK_BYTE_PTR pCiphertext,
+                                           CK_ULONG ulCiphertextLen,
+                                           CK_BYTE_PTR pPlaintext,
+                                           CK_ULONG_PTR pulPlaintextLen);
+typedef CK_RV (CK_PTR ST_C_MessageDecryptFinal) (STDLL_TokData_t *tokdata,
+                                                ST_SESSION_T *sSession);
+typedef CK_RV (CK_PTR ST_C_MessageSignInit) (STDLL_TokData_t *tokdata,
+                                            ST_SESSION_T *sSession,
+                                            CK_MECHANISM_PTR pMechanism,
+                                            CK_OBJECT_HANDLE hKey);
+typedef CK_RV (CK_PTR ST_C_SignMessage) (STDLL_TokData_t *tokdata,
+                                        ST_SESSION_T *sSession,
+                                        CK_VOID_PTR pParameter,
+                                        CK_ULONG ulParameterLen,
+                                        CK_BYTE_PTR pData,
+                                        CK_ULONG ulDataLen,
+                                        CK_BYTE_PTR pSignature,
+                                        CK_ULONG_PTR pulSignatureLen);
+typedef CK_RV (CK_PTR ST_C_MessageSignFinal) (STDLL_TokData_t *tokdata,
+                                             ST_SESSION_T *sSession);
+typedef CK_RV (CK_PTR ST_C_MessageVerifyInit) (STDLL_TokData_t *tokdata,
+                                              ST_SESSION_T *sSession,
+                                              CK_MECHANISM_PTR pMechanism,
+                                              CK_OBJECT_HANDLE hKey);
+typedef CK_RV (CK_PTR ST_C_VerifyMessage) (STDLL_TokData_t *tokdata,
+                                          ST_SESSION_T *sSession,
+                                          CK_VOID_PTR pParameter,
+                                          CK_ULONG ulParameterLen,
+                                          CK_BYTE_PTR pData,
+                                          CK_ULONG ulDataLen,
+                                          CK_BYTE_PTR pSignature,
+                                          CK_ULONG ulSignatureLen);
+typedef CK_RV (CK_PTR ST_C_MessageVerifyFinal) (STDLL_TokData_t *tokdata,
+                                               ST_SESSION_T *sSession);
+
 typedef CK_RV (CK_PTR ST_C_HandleEvent)(STDLL_TokData_t *tokdata,
                                         unsigned int event_type,
                                         unsigned int event_flags,
@@ -430,6 +491,19 @@ struct ST_FCN_LIST {
 
     ST_C_IBM_ReencryptSingle ST_IBM_ReencryptSingle;
 
+    ST_C_MessageEncryptInit ST_MessageEncryptInit;
+    ST_C_EncryptMessage ST_EncryptMessage;
+    ST_C_MessageEncryptFinal ST_MessageEncryptFinal;
+    ST_C_MessageDecryptInit ST_MessageDecryptInit;
+    ST_C_DecryptMessage ST_DecryptMessage;
+    ST_C_MessageDecryptFinal ST_MessageDecryptFinal;
+    ST_C_MessageSignInit ST_MessageSignInit;
+    ST_C_SignMessage ST_SignMessage;
+    ST_C_MessageSignFinal ST_MessageSignFinal;
+    ST_C_MessageVerifyInit ST_MessageVerifyInit;
+    ST_C_VerifyMessage ST_VerifyMessage;
+    ST_C_MessageVerifyFinal ST_MessageVerifyFinal;
+
     /* The functions defined below are not part of the external API */
     ST_C_HandleEvent ST_HandleEvent;
 };
@@ -270,10 +270,50 @@ static CK_FUNCTION_LIST_3_0 func_list_pkcs11_3_0 = {
 
 int slot_loaded[NUMBER_SLOTS_MANAGED];  // Array of flags to indicate
                                        // if the STDLL loaded
+static CK_BBOOL slot_load_tried[NUMBER_SLOTS_MANAGED];
+static pthread_mutex_t slot_load_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 CK_BBOOL in_child_fork_initializer = FALSE;
 CK_BBOOL in_destructor = FALSE;
 
+/*
+ * With lazy slot initialization (FLAG_LAZY_SLOT_INIT), C_Initialize does not
+ * load the STDLLs. Instead, the STDLL of a slot is loaded and initialized on
+ * the first call that targets that slot. Loading is only tried once, if it
+ * fails the slot is reported as having no token present from then on.
+ */
+static CK_RV slot_load_on_demand(CK_SLOT_ID slotID)
+{
+    API_Slot_t *sltp = &(Anchor->SltList[slotID]);
+    CK_RV rc = CKR_OK;
+
+    if ((Anchor->SocketDataP.flags & FLAG_LAZY_SLOT_INIT) == 0)
+        return CKR_OK;
+
+    if (pthread_mutex_lock(&slot_load_mutex)) {
+        TRACE_ERROR("Failed to lock mutex.\n");
+        return CKR_FUNCTION_FAILED;
+    }
+
+    if (sltp->DLLoaded == FALSE && slot_load_tried[slotID] == FALSE) {
+        slot_load_tried[slotID] = TRUE;
+
+        TRACE_DEVEL("Loading STDLL of slot %lu on first use\n", slotID);
+        BEGIN_OPENSSL_LIBCTX(Anchor->openssl_libctx, rc)
+        slot_loaded[slotID] = DL_Load_and_Init(sltp, slotID, &policy,
+                                               &statistics);
+        END_OPENSSL_LIBCTX(rc)
+
+        if (!slot_loaded[slotID])
+            Anchor->SocketDataP.slot_info[slotID].pk_slot.flags &=
+                                                        ~CKF_TOKEN_PRESENT;
+    }
+
+    pthread_mutex_unlock(&slot_load_mutex);
+
+    return rc;
+}
+
 /*
  * Ordered array of interfaces: If more than one interface matches
  * interface_get's arguments, the interface at lowest index is returned.
@@ -296,6 +336,142 @@ static CK_INTERFACE interface_list[] = {
     }
 };
 
+static void fork_child_count_session(STDLL_TokData_t *tokdata,
+                                     void *node_value,
+                                     unsigned long node_handle, void *arg)
+{
+    ST_SESSION_T *s = (ST_SESSION_T *) node_value;
+
+    UNUSED(tokdata);
+    UNUSED(node_handle);
+    UNUSED(arg);
+
+    incr_sess_counts(s->slotID);
+}
+
+/*
+ * With FLAG_FORK_PRESERVE_STATE, a forked child keeps the sessions, logins
+ * and token objects inherited from its parent. Only the per-process resources
+ * are re-established: the lock files, the connection to and the registration
+ * with pkcsslotd, and the event thread.
+ * Returns FALSE if the state can not be kept, the child must then be
+ * finalized as usual. The new connection to pkcsslotd is closed then, and
+ * the tokens that already kept their state release their own reference on
+ * the shared memory when they are finalized.
+ */
+static CK_BBOOL child_fork_preserve(void)
+{
+    Slot_Mgr_Socket_t *socket_data;
+    CK_SLOT_ID slotID;
+    API_Slot_t *sltp;
+    int socketfd;
+    CK_RV rc = CKR_OK;
+
+    if ((Anchor->SocketDataP.flags & FLAG_FORK_PRESERVE_STATE) == 0)
+        return FALSE;
+
+    /* All initialized tokens must be able to keep their state */
+    for (slotID = 0; slotID < NUMBER_SLOTS_MANAGED; slotID++) {
+        sltp = &(Anchor->SltList[slotID]);
+        if (!slot_loaded[slotID])
+            continue;
+        if (sltp->pSTforkchild == NULL ||
+            sltp->pSTforkchild(sltp->TokData, slotID,
+                               &Anchor->SocketDataP.slot_info[slotID],
+                               &trace, TRUE) != CKR_OK) {
+            TRACE_DEVEL("Slot %lu can not keep its state after fork\n",
+                        slotID);
+            return FALSE;
+        }
+    }
+
+    pthread_mutex_init(&GlobMutex, NULL);
+    pthread_mutex_init(&slot_load_mutex, NULL);
+
+    if (ProcLockForkChild() != CKR_OK) {
+        TRACE_ERROR("Failed to open the process lock.\n");
+        return FALSE;
+    }
+
+    /* Connect to pkcsslotd, only the client credentials are new */
+    socketfd = connect_socket(PROC_SOCKET_FILE_PATH);
+    if (socketfd < 0) {
+        TRACE_ERROR("Failed to connect to slot daemon\n");
+        return FALSE;
+    }
+
+    socket_data = malloc(sizeof(*socket_data));
+    if (socket_data == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
+        close(socketfd);
+        return FALSE;
+    }
+    memcpy(socket_data, &Anchor->SocketDataP, sizeof(*socket_data));
+    if (!init_socket_data(socketfd)) {
+        TRACE_ERROR("Failed to receive slot infos from socket.\n");
+        memcpy(&Anchor->SocketDataP, socket_data, sizeof(*socket_data));
+        free(socket_data);
+        close(socketfd);
+        return FALSE;
+    }
+    memcpy(&Anchor->SocketDataP, socket_data, sizeof(*socket_data));
+    free(socket_data);
+
+    /* Closing our copy does not affect the connection of the parent */
+    if (Anchor->socketfd >= 0)
+        close(Anchor->socketfd);
+    Anchor->socketfd = socketfd;
+    Anchor->event_thread = 0;
+
+    if (!API_Register()) {
+        TRACE_ERROR("Failed to register process with pkcsslotd.\n");
+        goto error;
+    }
+
+    BEGIN_OPENSSL_LIBCTX(Anchor->openssl_libctx, rc)
+    for (slotID = 0; slotID < NUMBER_SLOTS_MANAGED; slotID++) {
+        sltp = &(Anchor->SltList[slotID]);
+        if (!slot_loaded[slotID])
+            continue;
+
+        sltp->TokData->real_pid = Anchor->ClientCred.real_pid;
+        sltp->TokData->real_uid = Anchor->ClientCred.real_uid;
+        sltp->TokData->real_gid = Anchor->ClientCred.real_gid;
+        pthread_mutex_init(&sltp->TokData->login_mutex, NULL);
+
+        rc = sltp->pSTforkchild(sltp->TokData, slotID,
+                                &Anchor->SocketDataP.slot_info[slotID],
+                                &trace, FALSE);
+        if (rc != CKR_OK) {
+            TRACE_ERROR("Slot %lu failed to keep its state after fork, "
+                        "rc=0x%lx\n", slotID, rc);
+            break;
+        }
+    }
+    END_OPENSSL_LIBCTX(rc)
+    if (rc != CKR_OK)
+        goto error;
+
+    /* The inherited sessions are now also used by this process */
+    bt_for_each_node(NULL, &Anchor->sess_btree, fork_child_count_session,
+                     NULL);
+
+    if ((Anchor->SocketDataP.flags & FLAG_EVENT_SUPPORT_DISABLED) == 0 &&
+        start_event_thread() != 0) {
+        TRACE_ERROR("Failed to start event thread\n");
+        goto error;
+    }
+
+    return TRUE;
+
+error:
+    /* C_Finalize does not close the socket in the fork initializer */
+    close(Anchor->socketfd);
+    Anchor->socketfd = -1;
+
+    return FALSE;
+}
+
 void child_fork_initializer()
 {
     /*
@@ -306,6 +482,12 @@ void child_fork_initializer()
      */
     trace_finalize();
     trace_initialize();
+
+    if (Anchor != NULL && child_fork_preserve()) {
+        TRACE_INFO("Forked child keeps the token state of its parent\n");
+        return;
+    }
+
     /*
      * Terminate all slots by calling C_Finalize(). This will also free the
      * Anchor and set it to NULL.
@@ -1703,6 +1885,7 @@ CK_RV C_Finalize(CK_VOID_PTR pReserved)
     // Un register from Slot D
     API_UnRegister();
 
+    InvalidateSessionCache();
     bt_destroy(&Anchor->sess_btree);
 
 #if OPENSSL_VERSION_PREREQ(3, 0)
@@ -2262,6 +2445,10 @@ CK_RV C_GetMechanismInfo(CK_SLOT_ID slotID,
         return CKR_SLOT_ID_INVALID;
     }
 
+    rv = slot_load_on_demand(slotID);
+    if (rv != CKR_OK)
+        return rv;
+
     sltp = &(Anchor->SltList[slotID]);
     if (sltp->DLLoaded == FALSE) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
@@ -2322,6 +2509,10 @@ CK_RV C_GetMechanismList(CK_SLOT_ID slotID,
         return CKR_SLOT_ID_INVALID;
     }
 
+    rv = slot_load_on_demand(slotID);
+    if (rv != CKR_OK)
+        return rv;
+
     sltp = &(Anchor->SltList[slotID]);
     if (sltp->DLLoaded == FALSE) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
@@ -2815,6 +3006,10 @@ CK_RV C_GetTokenInfo(CK_SLOT_ID slotID, CK_TOKEN_INFO_PTR pInfo)
         return CKR_SLOT_ID_INVALID;
     }
 
+    rv = slot_load_on_demand(slotID);
+    if (rv != CKR_OK)
+        return rv;
+
     sltp = &(Anchor->SltList[slotID]);
     TRACE_DEVEL("Slot p = %p id %lu\n", (void *)sltp, slotID);
     if (sltp->DLLoaded == FALSE) {
@@ -3131,14 +3326,24 @@ CK_RV C_Initialize(CK_VOID_PTR pVoid)
         goto error_shm;
     }
     //
-    // load all the slot DLL's here
-    BEGIN_OPENSSL_LIBCTX(Anchor->openssl_libctx, rc)
-    for (slotID = 0; slotID < NUMBER_SLOTS_MANAGED; slotID++) {
-        sltp = &(Anchor->SltList[slotID]);
-        slot_loaded[slotID] = DL_Load_and_Init(sltp, slotID, &policy,
-                                               &statistics);
+    // load all the slot DLL's here, or with lazy slot initialization, just
+    // announce the present slots and load their DLL's on first use.
+    memset(slot_load_tried, 0, sizeof(slot_load_tried));
+    if (Anchor->SocketDataP.flags & FLAG_LAZY_SLOT_INIT) {
+        for (slotID = 0; slotID < NUMBER_SLOTS_MANAGED; slotID++) {
+            if (Anchor->SocketDataP.slot_info[slotID].present)
+                Anchor->SocketDataP.slot_info[slotID].pk_slot.flags |=
+                                                            CKF_TOKEN_PRESENT;
+        }
+    } else {
+        BEGIN_OPENSSL_LIBCTX(Anchor->openssl_libctx, rc)
+        for (slotID = 0; slotID < NUMBER_SLOTS_MANAGED; slotID++) {
+            sltp = &(Anchor->SltList[slotID]);
+            slot_loaded[slotID] = DL_Load_and_Init(sltp, slotID, &policy,
+                                                   &statistics);
+        }
+        END_OPENSSL_LIBCTX(rc)
     }
-    END_OPENSSL_LIBCTX(rc)
     if (rc != CKR_OK)
         goto error_shm;
 
@@ -3179,6 +3384,7 @@ error_shm:
 
 error:
     policy_unload(&policy);
+    InvalidateSessionCache();
     bt_destroy(&Anchor->sess_btree);
     if (Anchor->socketfd >= 0)
         close(Anchor->socketfd);
@@ -3315,6 +3521,10 @@ CK_RV C_InitToken(CK_SLOT_ID slotID,
         return CKR_SESSION_EXISTS;
     }
 
+    rv = slot_load_on_demand(slotID);
+    if (rv != CKR_OK)
+        return rv;
+
     sltp = &(Anchor->SltList[slotID]);
     if (sltp->DLLoaded == FALSE) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
@@ -3494,6 +3704,10 @@ CK_RV C_OpenSession(CK_SLOT_ID slotID,
         return CKR_ARGUMENTS_BAD;
     }
 
+    rv = slot_load_on_demand(slotID);
+    if (rv != CKR_OK)
+        return rv;
+
     sltp = &(Anchor->SltList[slotID]);
     if (sltp->DLLoaded == FALSE) {
         TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
@@ -4884,22 +5098,48 @@ CK_RV C_MessageEncryptInit(CK_SESSION_HANDLE hSession,
                            CK_MECHANISM *pMechanism, CK_OBJECT_HANDLE hKey)
 {
     CK_RV rv;
-
-    UNUSED(hSession);
-    UNUSED(pMechanism);
-    UNUSED(hKey);
+    API_Slot_t *sltp;
+    STDLL_FcnList_t *fcn;
+    ST_SESSION_T rSession;
 
     TRACE_INFO("C_MessageEncryptInit\n");
-
     if (API_Initialized() == FALSE) {
         TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
-        rv = CKR_CRYPTOKI_NOT_INITIALIZED;
-        goto ret;
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    if (!pMechanism) {
+        TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
+        return CKR_ARGUMENTS_BAD;
+    }
+    if (!Valid_Session(hSession, &rSession)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        TRACE_ERROR("Session handle id: %lu\n", hSession);
+        return CKR_SESSION_HANDLE_INVALID;
+    }
+    TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
+
+    sltp = &(Anchor->SltList[rSession.slotID]);
+    if (sltp->DLLoaded == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if ((fcn = sltp->FcnList) == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if (fcn->ST_MessageEncryptInit) {
+        BEGIN_OPENSSL_LIBCTX(Anchor->openssl_libctx, rv)
+        // Map the Session to the slot session
+        rv = fcn->ST_MessageEncryptInit(sltp->TokData, &rSession, pMechanism,
+                                        hKey);
+        TRACE_DEVEL("fcn->ST_MessageEncryptInit returned: 0x%lx\n", rv);
+        END_OPENSSL_LIBCTX(rv)
+    } else {
+        TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
+        rv = CKR_FUNCTION_NOT_SUPPORTED;
     }
 
-    TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
-    rv = CKR_FUNCTION_NOT_SUPPORTED;
-ret:
     return rv;
 }
 
@@ -4910,28 +5150,47 @@ CK_RV C_EncryptMessage(CK_SESSION_HANDLE hSession,
                        CK_BYTE *pCiphertext, CK_ULONG *pulCiphertextLen)
 {
     CK_RV rv;
-
-    UNUSED(hSession);
-    UNUSED(pParameter);
-    UNUSED(ulParameterLen);
-    UNUSED(pAssociatedData);
-    UNUSED(ulAssociatedDataLen);
-    UNUSED(pPlaintext);
-    UNUSED(ulPlaintextLen);
-    UNUSED(pCiphertext);
-    UNUSED(pulCiphertextLen);
+    API_Slot_t *sltp;
+    STDLL_FcnList_t *fcn;
+    ST_SESSION_T rSession;
 
     TRACE_INFO("C_EncryptMessage\n");
-
     if (API_Initialized() == FALSE) {
         TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
-        rv = CKR_CRYPTOKI_NOT_INITIALIZED;
-        goto ret;
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    if (!Valid_Session(hSession, &rSession)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        TRACE_ERROR("Session handle id: %lu\n", hSession);
+        return CKR_SESSION_HANDLE_INVALID;
+    }
+    TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
+
+    sltp = &(Anchor->SltList[rSession.slotID]);
+    if (sltp->DLLoaded == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if ((fcn = sltp->FcnList) == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if (fcn->ST_EncryptMessage) {
+        BEGIN_OPENSSL_LIBCTX(Anchor->openssl_libctx, rv)
+        // Map the Session to the slot session
+        rv = fcn->ST_EncryptMessage(sltp->TokData, &rSession,
+                                    pParameter, ulParameterLen,
+                                    pAssociatedData, ulAssociatedDataLen,
+                                    pPlaintext, ulPlaintextLen,
+                                    pCiphertext, pulCiphertextLen);
+        TRACE_DEVEL("fcn->ST_EncryptMessage returned: 0x%lx\n", rv);
+        END_OPENSSL_LIBCTX(rv)
+    } else {
+        TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
+        rv = CKR_FUNCTION_NOT_SUPPORTED;
     }
 
-    TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
-    rv = CKR_FUNCTION_NOT_SUPPORTED;
-ret:
     return rv;
 }
 
@@ -4998,20 +5257,43 @@ ret:
 CK_RV C_MessageEncryptFinal(CK_SESSION_HANDLE hSession)
 {
     CK_RV rv;
+    API_Slot_t *sltp;
+    STDLL_FcnList_t *fcn;
+    ST_SESSION_T rSession;
 
-    UNUSED(hSession);
-
-    TRACE_INFO("C_EncryptMessageFinal\n");
-
+    TRACE_INFO("C_MessageEncryptFinal\n");
     if (API_Initialized() == FALSE) {
         TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
-        rv = CKR_CRYPTOKI_NOT_INITIALIZED;
-        goto ret;
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    if (!Valid_Session(hSession, &rSession)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        TRACE_ERROR("Session handle id: %lu\n", hSession);
+        return CKR_SESSION_HANDLE_INVALID;
+    }
+    TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
+
+    sltp = &(Anchor->SltList[rSession.slotID]);
+    if (sltp->DLLoaded == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if ((fcn = sltp->FcnList) == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if (fcn->ST_MessageEncryptFinal) {
+        BEGIN_OPENSSL_LIBCTX(Anchor->openssl_libctx, rv)
+        // Map the Session to the slot session
+        rv = fcn->ST_MessageEncryptFinal(sltp->TokData, &rSession);
+        TRACE_DEVEL("fcn->ST_MessageEncryptFinal returned: 0x%lx\n", rv);
+        END_OPENSSL_LIBCTX(rv)
+    } else {
+        TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
+        rv = CKR_FUNCTION_NOT_SUPPORTED;
     }
 
-    TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
-    rv = CKR_FUNCTION_NOT_SUPPORTED;
-ret:
     return rv;
 }
 
@@ -5019,54 +5301,99 @@ CK_RV C_MessageDecryptInit(CK_SESSION_HANDLE hSession,
                            CK_MECHANISM *pMechanism, CK_OBJECT_HANDLE hKey)
 {
     CK_RV rv;
-
-    UNUSED(hSession);
-    UNUSED(pMechanism);
-    UNUSED(hKey);
+    API_Slot_t *sltp;
+    STDLL_FcnList_t *fcn;
+    ST_SESSION_T rSession;
 
     TRACE_INFO("C_MessageDecryptInit\n");
-
     if (API_Initialized() == FALSE) {
         TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
-        rv = CKR_CRYPTOKI_NOT_INITIALIZED;
-        goto ret;
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
     }
 
-    TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
-    rv = CKR_FUNCTION_NOT_SUPPORTED;
-ret:
-    return rv;
-}
-
-CK_RV C_DecryptMessage(CK_SESSION_HANDLE hSession,
-                       void *pParameter, CK_ULONG ulParameterLen,
-                       CK_BYTE *pAssociatedData, CK_ULONG ulAssociatedDataLen,
-                       CK_BYTE *pCiphertext, CK_ULONG ulCiphertextLen,
-                       CK_BYTE *pPlaintext, CK_ULONG *pulPlaintextLen)
-{
-    CK_RV rv;
+    if (!pMechanism) {
+        TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
+        return CKR_ARGUMENTS_BAD;
+    }
+    if (!Valid_Session(hSession, &rSession)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        TRACE_ERROR("Session handle id: %lu\n", hSession);
+        return CKR_SESSION_HANDLE_INVALID;
+    }
+    TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
 
-    UNUSED(hSession);
-    UNUSED(pParameter);
-    UNUSED(ulParameterLen);
-    UNUSED(pAssociatedData);
-    UNUSED(ulAssociatedDataLen);
-    UNUSED(pCiphertext);
-    UNUSED(ulCiphertextLen);
-    UNUSED(pPlaintext);
-    UNUSED(pulPlaintextLen);
+    sltp = &(Anchor->SltList[rSession.slotID]);
+    if (sltp->DLLoaded == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if ((fcn = sltp->FcnList) == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if (fcn->ST_MessageDecryptInit) {
+        BEGIN_OPENSSL_LIBCTX(Anchor->openssl_libctx, rv)
+        // Map the Session to the slot session
+        rv = fcn->ST_MessageDecryptInit(sltp->TokData, &rSession, pMechanism,
+                                        hKey);
+        TRACE_DEVEL("fcn->ST_MessageDecryptInit returned: 0x%lx\n", rv);
+        END_OPENSSL_LIBCTX(rv)
+    } else {
+        TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
+        rv = CKR_FUNCTION_NOT_SUPPORTED;
+    }
 
-    TRACE_INFO("C_DecryptMessage\n");
+    return rv;
+}
 
+CK_RV C_DecryptMessage(CK_SESSION_HANDLE hSession,
+                       void *pParameter, CK_ULONG ulParameterLen,
+                       CK_BYTE *pAssociatedData, CK_ULONG ulAssociatedDataLen,
+                       CK_BYTE *pCiphertext, CK_ULONG ulCiphertextLen,
+                       CK_BYTE *pPlaintext, CK_ULONG *pulPlaintextLen)
+{
+    CK_RV rv;
+    API_Slot_t *sltp;
+    STDLL_FcnList_t *fcn;
+    ST_SESSION_T rSession;
+
+    TRACE_INFO("C_DecryptMessage\n");
     if (API_Initialized() == FALSE) {
         TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
-        rv = CKR_CRYPTOKI_NOT_INITIALIZED;
-        goto ret;
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    if (!Valid_Session(hSession, &rSession)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        TRACE_ERROR("Session handle id: %lu\n", hSession);
+        return CKR_SESSION_HANDLE_INVALID;
+    }
+    TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
+
+    sltp = &(Anchor->SltList[rSession.slotID]);
+    if (sltp->DLLoaded == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if ((fcn = sltp->FcnList) == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if (fcn->ST_DecryptMessage) {
+        BEGIN_OPENSSL_LIBCTX(Anchor->openssl_libctx, rv)
+        // Map the Session to the slot session
+        rv = fcn->ST_DecryptMessage(sltp->TokData, &rSession,
+                                    pParameter, ulParameterLen,
+                                    pAssociatedData, ulAssociatedDataLen,
+                                    pCiphertext, ulCiphertextLen,
+                                    pPlaintext, pulPlaintextLen);
+        TRACE_DEVEL("fcn->ST_DecryptMessage returned: 0x%lx\n", rv);
+        END_OPENSSL_LIBCTX(rv)
+    } else {
+        TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
+        rv = CKR_FUNCTION_NOT_SUPPORTED;
     }
 
-    TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
-    rv = CKR_FUNCTION_NOT_SUPPORTED;
-ret:
     return rv;
 }
 
@@ -5133,20 +5460,43 @@ ret:
 CK_RV C_MessageDecryptFinal(CK_SESSION_HANDLE hSession)
 {
     CK_RV rv;
-
-    UNUSED(hSession);
+    API_Slot_t *sltp;
+    STDLL_FcnList_t *fcn;
+    ST_SESSION_T rSession;
 
     TRACE_INFO("C_MessageDecryptFinal\n");
-
     if (API_Initialized() == FALSE) {
         TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
-        rv = CKR_CRYPTOKI_NOT_INITIALIZED;
-        goto ret;
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    if (!Valid_Session(hSession, &rSession)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        TRACE_ERROR("Session handle id: %lu\n", hSession);
+        return CKR_SESSION_HANDLE_INVALID;
+    }
+    TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
+
+    sltp = &(Anchor->SltList[rSession.slotID]);
+    if (sltp->DLLoaded == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if ((fcn = sltp->FcnList) == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if (fcn->ST_MessageDecryptFinal) {
+        BEGIN_OPENSSL_LIBCTX(Anchor->openssl_libctx, rv)
+        // Map the Session to the slot session
+        rv = fcn->ST_MessageDecryptFinal(sltp->TokData, &rSession);
+        TRACE_DEVEL("fcn->ST_MessageDecryptFinal returned: 0x%lx\n", rv);
+        END_OPENSSL_LIBCTX(rv)
+    } else {
+        TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
+        rv = CKR_FUNCTION_NOT_SUPPORTED;
     }
 
-    TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
-    rv = CKR_FUNCTION_NOT_SUPPORTED;
-ret:
     return rv;
 }
 
@@ -5154,22 +5504,47 @@ CK_RV C_MessageSignInit(CK_SESSION_HANDLE hSession,
                         CK_MECHANISM *pMechanism, CK_OBJECT_HANDLE hKey)
 {
     CK_RV rv;
-
-    UNUSED(hSession);
-    UNUSED(pMechanism);
-    UNUSED(hKey);
+    API_Slot_t *sltp;
+    STDLL_FcnList_t *fcn;
+    ST_SESSION_T rSession;
 
     TRACE_INFO("C_MessageSignInit\n");
-
     if (API_Initialized() == FALSE) {
         TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
-        rv = CKR_CRYPTOKI_NOT_INITIALIZED;
-        goto ret;
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    if (!pMechanism) {
+        TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
+        return CKR_ARGUMENTS_BAD;
+    }
+    if (!Valid_Session(hSession, &rSession)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        TRACE_ERROR("Session handle id: %lu\n", hSession);
+        return CKR_SESSION_HANDLE_INVALID;
+    }
+    TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
+
+    sltp = &(Anchor->SltList[rSession.slotID]);
+    if (sltp->DLLoaded == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if ((fcn = sltp->FcnList) == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if (fcn->ST_MessageSignInit) {
+        BEGIN_OPENSSL_LIBCTX(Anchor->openssl_libctx, rv)
+        // Map the Session to the slot session
+        rv = fcn->ST_MessageSignInit(sltp->TokData, &rSession, pMechanism, hKey);
+        TRACE_DEVEL("fcn->ST_MessageSignInit returned: 0x%lx\n", rv);
+        END_OPENSSL_LIBCTX(rv)
+    } else {
+        TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
+        rv = CKR_FUNCTION_NOT_SUPPORTED;
     }
 
-    TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
-    rv = CKR_FUNCTION_NOT_SUPPORTED;
-ret:
     return rv;
 }
 
@@ -5179,26 +5554,45 @@ CK_RV C_SignMessage(CK_SESSION_HANDLE hSession,
                     CK_BYTE *pSignature, CK_ULONG *pulSignatureLen)
 {
     CK_RV rv;
-
-    UNUSED(hSession);
-    UNUSED(pParameter);
-    UNUSED(ulParameterLen);
-    UNUSED(pData);
-    UNUSED(ulDataLen);
-    UNUSED(pSignature);
-    UNUSED(pulSignatureLen);
+    API_Slot_t *sltp;
+    STDLL_FcnList_t *fcn;
+    ST_SESSION_T rSession;
 
     TRACE_INFO("C_SignMessage\n");
-
     if (API_Initialized() == FALSE) {
         TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
-        rv = CKR_CRYPTOKI_NOT_INITIALIZED;
-        goto ret;
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    if (!Valid_Session(hSession, &rSession)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        TRACE_ERROR("Session handle id: %lu\n", hSession);
+        return CKR_SESSION_HANDLE_INVALID;
+    }
+    TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
+
+    sltp = &(Anchor->SltList[rSession.slotID]);
+    if (sltp->DLLoaded == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if ((fcn = sltp->FcnList) == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if (fcn->ST_SignMessage) {
+        BEGIN_OPENSSL_LIBCTX(Anchor->openssl_libctx, rv)
+        // Map the Session to the slot session
+        rv = fcn->ST_SignMessage(sltp->TokData, &rSession, pParameter,
+                                 ulParameterLen, pData, ulDataLen, pSignature,
+                                 pulSignatureLen);
+        TRACE_DEVEL("fcn->ST_SignMessage returned: 0x%lx\n", rv);
+        END_OPENSSL_LIBCTX(rv)
+    } else {
+        TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
+        rv = CKR_FUNCTION_NOT_SUPPORTED;
     }
 
-    TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
-    rv = CKR_FUNCTION_NOT_SUPPORTED;
-ret:
     return rv;
 }
 
@@ -5257,20 +5651,43 @@ ret:
 CK_RV C_MessageSignFinal(CK_SESSION_HANDLE hSession)
 {
     CK_RV rv;
-
-    UNUSED(hSession);
+    API_Slot_t *sltp;
+    STDLL_FcnList_t *fcn;
+    ST_SESSION_T rSession;
 
     TRACE_INFO("C_MessageSignFinal\n");
-
     if (API_Initialized() == FALSE) {
         TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
-        rv = CKR_CRYPTOKI_NOT_INITIALIZED;
-        goto ret;
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    if (!Valid_Session(hSession, &rSession)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        TRACE_ERROR("Session handle id: %lu\n", hSession);
+        return CKR_SESSION_HANDLE_INVALID;
+    }
+    TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
+
+    sltp = &(Anchor->SltList[rSession.slotID]);
+    if (sltp->DLLoaded == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if ((fcn = sltp->FcnList) == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if (fcn->ST_MessageSignFinal) {
+        BEGIN_OPENSSL_LIBCTX(Anchor->openssl_libctx, rv)
+        // Map the Session to the slot session
+        rv = fcn->ST_MessageSignFinal(sltp->TokData, &rSession);
+        TRACE_DEVEL("fcn->ST_MessageSignFinal returned: 0x%lx\n", rv);
+        END_OPENSSL_LIBCTX(rv)
+    } else {
+        TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
+        rv = CKR_FUNCTION_NOT_SUPPORTED;
     }
 
-    TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
-    rv = CKR_FUNCTION_NOT_SUPPORTED;
-ret:
     return rv;
 }
 
@@ -5278,22 +5695,48 @@ CK_RV C_MessageVerifyInit(CK_SESSION_HANDLE hSession,
                           CK_MECHANISM *pMechanism, CK_OBJECT_HANDLE hKey)
 {
     CK_RV rv;
-
-    UNUSED(hSession);
-    UNUSED(pMechanism);
-    UNUSED(hKey);
+    API_Slot_t *sltp;
+    STDLL_FcnList_t *fcn;
+    ST_SESSION_T rSession;
 
     TRACE_INFO("C_MessageVerifyInit\n");
-
     if (API_Initialized() == FALSE) {
         TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
-        rv = CKR_CRYPTOKI_NOT_INITIALIZED;
-        goto ret;
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    if (!pMechanism) {
+        TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
+        return CKR_ARGUMENTS_BAD;
+    }
+    if (!Valid_Session(hSession, &rSession)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        TRACE_ERROR("Session handle id: %lu\n", hSession);
+        return CKR_SESSION_HANDLE_INVALID;
+    }
+    TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
+
+    sltp = &(Anchor->SltList[rSession.slotID]);
+    if (sltp->DLLoaded == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if ((fcn = sltp->FcnList) == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if (fcn->ST_MessageVerifyInit) {
+        BEGIN_OPENSSL_LIBCTX(Anchor->openssl_libctx, rv)
+        // Map the Session to the slot session
+        rv = fcn->ST_MessageVerifyInit(sltp->TokData, &rSession, pMechanism,
+                                       hKey);
+        TRACE_DEVEL("fcn->ST_MessageVerifyInit returned: 0x%lx\n", rv);
+        END_OPENSSL_LIBCTX(rv)
+    } else {
+        TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
+        rv = CKR_FUNCTION_NOT_SUPPORTED;
     }
 
-    TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
-    rv = CKR_FUNCTION_NOT_SUPPORTED;
-ret:
     return rv;
 }
 
@@ -5303,26 +5746,45 @@ CK_RV C_VerifyMessage(CK_SESSION_HANDLE hSession,
                       CK_BYTE *pSignature, CK_ULONG ulSignatureLen)
 {
     CK_RV rv;
-
-    UNUSED(hSession);
-    UNUSED(pParameter);
-    UNUSED(ulParameterLen);
-    UNUSED(pData);
-    UNUSED(ulDataLen);
-    UNUSED(pSignature);
-    UNUSED(ulSignatureLen);
+    API_Slot_t *sltp;
+    STDLL_FcnList_t *fcn;
+    ST_SESSION_T rSession;
 
     TRACE_INFO("C_VerifyMessage\n");
-
     if (API_Initialized() == FALSE) {
         TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
-        rv = CKR_CRYPTOKI_NOT_INITIALIZED;
-        goto ret;
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    if (!Valid_Session(hSession, &rSession)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        TRACE_ERROR("Session handle id: %lu\n", hSession);
+        return CKR_SESSION_HANDLE_INVALID;
+    }
+    TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
+
+    sltp = &(Anchor->SltList[rSession.slotID]);
+    if (sltp->DLLoaded == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if ((fcn = sltp->FcnList) == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if (fcn->ST_VerifyMessage) {
+        BEGIN_OPENSSL_LIBCTX(Anchor->openssl_libctx, rv)
+        // Map the Session to the slot session
+        rv = fcn->ST_VerifyMessage(sltp->TokData, &rSession, pParameter,
+                                   ulParameterLen, pData, ulDataLen,
+                                   pSignature, ulSignatureLen);
+        TRACE_DEVEL("fcn->ST_VerifyMessage returned: 0x%lx\n", rv);
+        END_OPENSSL_LIBCTX(rv)
+    } else {
+        TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
+        rv = CKR_FUNCTION_NOT_SUPPORTED;
     }
 
-    TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
-    rv = CKR_FUNCTION_NOT_SUPPORTED;
-ret:
     return rv;
 }
 
@@ -5382,20 +5844,43 @@ ret:
 CK_RV C_MessageVerifyFinal(CK_SESSION_HANDLE hSession)
 {
     CK_RV rv;
+    API_Slot_t *sltp;
+    STDLL_FcnList_t *fcn;
+    ST_SESSION_T rSession;
 
-    UNUSED(hSession);
-
-    TRACE_INFO("C_VerifyMessageFinal\n");
-
+    TRACE_INFO("C_MessageVerifyFinal\n");
     if (API_Initialized() == FALSE) {
         TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
-        rv = CKR_CRYPTOKI_NOT_INITIALIZED;
-        goto ret;
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    if (!Valid_Session(hSession, &rSession)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        TRACE_ERROR("Session handle id: %lu\n", hSession);
+        return CKR_SESSION_HANDLE_INVALID;
+    }
+    TRACE_INFO("Valid Session handle id: %lu\n", rSession.sessionh);
+
+    sltp = &(Anchor->SltList[rSession.slotID]);
+    if (sltp->DLLoaded == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if ((fcn = sltp->FcnList) == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TOKEN_NOT_PRESENT));
+        return CKR_TOKEN_NOT_PRESENT;
+    }
+    if (fcn->ST_MessageVerifyFinal) {
+        BEGIN_OPENSSL_LIBCTX(Anchor->openssl_libctx, rv)
+        // Map the Session to the slot session
+        rv = fcn->ST_MessageVerifyFinal(sltp->TokData, &rSession);
+        TRACE_DEVEL("fcn->ST_MessageVerifyFinal returned: 0x%lx\n", rv);
+        END_OPENSSL_LIBCTX(rv)
+    } else {
+        TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
+        rv = CKR_FUNCTION_NOT_SUPPORTED;
     }
 
-    TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
-    rv = CKR_FUNCTION_NOT_SUPPORTED;
-ret:
     return rv;
 }
 
@@ -37,6 +37,7 @@ CK_RV CreateProcLock();
 CK_RV ProcLock(void);
 CK_RV ProcUnLock(void);
 CK_RV ProcClose(void);
+CK_RV ProcLockForkChild(void);
 
 void _init(void);
 void get_sess_count(CK_SLOT_ID, CK_ULONG *);
@@ -44,6 +45,7 @@ void incr_sess_counts(CK_SLOT_ID);
 void decr_sess_counts(CK_SLOT_ID);
 unsigned long AddToSessionList(ST_SESSION_T *);
 void RemoveFromSessionList(CK_SESSION_HANDLE);
+void InvalidateSessionCache(void);
 int Valid_Session(CK_SESSION_HANDLE, ST_SESSION_T *);
 void DL_UnLoad(API_Slot_t *, CK_SLOT_ID, CK_BBOOL inchildforkinit);
 void DL_Unload(API_Slot_t *);
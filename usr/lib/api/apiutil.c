@@ -105,14 +105,50 @@ CK_RV ProcUnLock(void)
 
 CK_RV ProcClose(void)
 {
-    if (xplfd != -1)
+    if (xplfd != -1) {
         close(xplfd);
-    else
+        xplfd = -1;
+    } else {
         TRACE_DEVEL("ProcClose: No file descriptor open to close.\n");
+    }
 
     return CKR_OK;
 }
 
+/*
+ * In a forked child the lock file descriptor is shared with the parent, and
+ * so would be its flock. Open the lock file again to get a lock of our own.
+ */
+CK_RV ProcLockForkChild(void)
+{
+    pthread_rwlock_init(&xplfd_rwlock, NULL);
+    ProcClose();
+
+    return CreateProcLock();
+}
+
+/*
+ * Per-thread cache of the last session handle that was translated by
+ * Valid_Session(), so that consecutive calls of a thread on the same session
+ * do not need to lock the API-level session tree. Handles of closed sessions
+ * are reused by the tree, so every removal of a session bumps the session
+ * generation, which invalidates the cached translations of all threads.
+ */
+struct session_cache {
+    unsigned long generation;
+    CK_SESSION_HANDLE handle;
+    CK_SLOT_ID slotID;
+    CK_SESSION_HANDLE sessionh;
+};
+
+static unsigned long session_generation = 1;
+static __thread struct session_cache session_cache;
+
+void InvalidateSessionCache(void)
+{
+    __atomic_add_fetch(&session_generation, 1, __ATOMIC_RELEASE);
+}
+
 unsigned long AddToSessionList(ST_SESSION_T *pSess)
 {
     unsigned long handle;
@@ -124,6 +160,8 @@ unsigned long AddToSessionList(ST_SESSION_T *pSess)
 
 void RemoveFromSessionList(CK_SESSION_HANDLE handle)
 {
+    /* Invalidate first, so no cached lookup can see the freed session */
+    InvalidateSessionCache();
     bt_node_free(&(Anchor->sess_btree), handle, TRUE);
 }
 
@@ -157,6 +195,7 @@ void CloseMe(STDLL_TokData_t *tokdata, void *node_value,
                                   closeme_arg->in_fork_initializer);
         if (rv == CKR_OK) {
             decr_sess_counts(closeme_arg->slot_id);
+            InvalidateSessionCache();
             bt_node_free(&(Anchor->sess_btree), node_handle, TRUE);
         }
     }
@@ -186,12 +225,30 @@ void CloseAllSessions(CK_SLOT_ID slot_id, CK_BBOOL in_fork_initializer)
 int Valid_Session(CK_SESSION_HANDLE handle, ST_SESSION_T *rSession)
 {
     ST_SESSION_T *tmp;
+    unsigned long generation;
     int rc;
 
+    /*
+     * The generation is read before the tree lookup, so that a session that
+     * is closed concurrently never stays in the cache.
+     */
+    generation = __atomic_load_n(&session_generation, __ATOMIC_ACQUIRE);
+    if (session_cache.generation == generation &&
+        session_cache.handle == handle && handle != 0) {
+        rSession->slotID = session_cache.slotID;
+        rSession->sessionh = session_cache.sessionh;
+        return TRUE;
+    }
+
     tmp = bt_get_node_value(&(Anchor->sess_btree), handle);
     if (tmp) {
         rSession->slotID = tmp->slotID;
         rSession->sessionh = tmp->sessionh;
+
+        session_cache.generation = generation;
+        session_cache.handle = handle;
+        session_cache.slotID = tmp->slotID;
+        session_cache.sessionh = tmp->sessionh;
     }
     rc = tmp ? TRUE : FALSE;
     bt_put_node_value(&(Anchor->sess_btree), tmp);
@@ -551,6 +608,7 @@ void DL_Unload(API_Slot_t *sltp)
     sltp->dlop_p = NULL;
     sltp->pSTfini = NULL;
     sltp->pSTcloseall = NULL;
+    sltp->pSTforkchild = NULL;
 }
 
 int DL_Load_and_Init(API_Slot_t *sltp, CK_SLOT_ID slotID, policy_t policy,
@@ -650,6 +708,8 @@ int DL_Load_and_Init(API_Slot_t *sltp, CK_SLOT_ID slotID, policy_t policy,
         *(void **)(&sltp->pSTfini) = dlsym(sltp->dlop_p, "SC_Finalize");
         *(void **)(&sltp->pSTcloseall) =
             dlsym(sltp->dlop_p, "SC_CloseAllSessions");
+        *(void **)(&sltp->pSTforkchild) =
+            dlsym(sltp->dlop_p, "SC_ForkChild");
         return TRUE;
     }
 
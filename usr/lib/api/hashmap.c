@@ -9,70 +9,58 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 
 #include <pkcs11types.h>
 #include "hashmap.h"
 
 /*
- * Hash map for mechanisms.  It stores the mechanism number in a
- * linked hash map.  Note that it does not directly store the
- * mechanism number, but the mechanism number plus one.  This is done
- * to have 0 represent an empty bucket.  The structure is optimized
- * for the non-chaining case in which case the value is directly
- * stored in the root of the bucket chain.  Only further chain
- * elements are allocated separately.
+ * Hash map for mechanisms and attribute types.  It is an open
+ * addressing hash map using Robin Hood hashing with linear probing.
+ * All entries are stored inline in one array, so no allocation is
+ * done per entry.  Every entry stores its probe distance plus one.
+ * A distance of 0 marks an empty slot.  On insertion, an entry that
+ * is further away from its home slot takes the slot of an entry that
+ * is closer to its home slot.  This keeps the probe sequences short
+ * and allows to terminate unsuccessful searches early.  Deletion uses
+ * backward shifting, so no tombstones are needed.
  *
- * Furthermore, we use a size optimization to not pre-allocate buckets
- * when creating a new hash.  Only on first addition to the hash do we
- * create the bucket list.
+ * Mechanism and attribute numbers are heavily clustered (e.g. the
+ * vendor defined range 0x8000xxxx).  Hence the key is run through an
+ * integer mixer before it is reduced to the power of 2 capacity.
  *
- * The hash is a power of 2 hash to speed up hash value computation
- * (subtraction + binary and versus modulo computation).
+ * Furthermore, we use a size optimization to not pre-allocate entries
+ * when creating a new hash.  Only on first addition to the hash do we
+ * create the entry array.
  */
 
 /* Default hash size has to be a power of 2. */
 #define HASH_DEFAULT_CAPA 16
 
-static unsigned int hash(unsigned int capa, CK_ULONG value)
+static inline unsigned int hash(unsigned int capa, CK_ULONG value)
 {
-#ifdef HASHMAP_FULL_JENKINS
-    /* Full Jenkins hash */
-    unsigned char *key = (unsigned char *)&value;
-    size_t i = 0;
-    unsigned int hash = 0;
-
-    while (i != 8) {
-        hash += key[i++];
-        hash += hash << 10;
-        hash ^= hash >> 6;
-    }
-    hash += hash << 3;
-    hash ^= hash >> 11;
-    hash += hash << 15;
-    return hash & (capa - 1);
-#else
-#  ifdef HASHMAP_JENKINS_MIX
-    /* Jenkins hash mix function */
-    value += value << 3;
-    value ^= value >> 11;
-    value += value << 15;
-#  endif
-    return value & (capa - 1);
-#endif
+    /* splitmix64 finalizer */
+    uint64_t x = value;
+
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ull;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebull;
+    x ^= x >> 31;
+    return (unsigned int)x & (capa - 1);
 }
 
-struct hashmap_bucket;
-struct hashmap_bucket {
+struct hashmap_entry {
     CK_ULONG key;
     union hashmap_value value;
-    struct hashmap_bucket *next;
+    /* probe distance plus one; 0 if the slot is empty */
+    unsigned int dist;
 };
 
 struct hashmap {
-    struct hashmap_bucket *buckets;
+    struct hashmap_entry *entries;
     unsigned int size;
     unsigned int capa;
-    freefunc_t freefunc;
 };
 
 /* Create size-optimized empty hash.  First add will expand the hash to its
@@ -83,144 +71,116 @@ struct hashmap *hashmap_new()
     struct hashmap *res = malloc(sizeof(struct hashmap));
     if (!res)
         return res;
-    res->buckets = NULL;
+    res->entries = NULL;
     res->size = 0;
     res->capa = 0;
     return res;
 }
 
-static void freebucketchain(struct hashmap_bucket *b, freefunc_t f)
-{
-    struct hashmap_bucket *n;
-    
-    while (b) {
-        n = b->next;
-        if (f)
-            f(b->value);
-        free(b);
-        b = n;
-    }
-}
-
-static void freebuckets(struct hashmap_bucket *buckets, unsigned int size,
-                        freefunc_t f)
+void hashmap_free(struct hashmap *h, freefunc_t f)
 {
     unsigned int i;
-    
-    for (i = 0; i < size; ++i)
-        freebucketchain(buckets[i].next, f);
-}
 
-void hashmap_free(struct hashmap *h, freefunc_t f)
-{
     if (h) {
-        if (h->buckets) {
-            freebuckets(h->buckets, h->capa, f);
-            free(h->buckets);
+        if (h->entries) {
+            if (f) {
+                for (i = 0; i < h->capa; ++i) {
+                    if (h->entries[i].dist)
+                        f(h->entries[i].value);
+                }
+            }
+            free(h->entries);
         }
         free(h);
     }
 }
 
-static int do_add(struct hashmap_bucket *buckets, unsigned int size,
-                  CK_ULONG key, union hashmap_value val)
+static void do_add(struct hashmap_entry *entries, unsigned int capa,
+                   CK_ULONG key, union hashmap_value val)
 {
-    unsigned int hval;
-    struct hashmap_bucket *newbucket;
-    
-    hval = hash(size, key);
-    if (buckets[hval].key) {
-        newbucket = malloc(sizeof(struct hashmap_bucket));
-        if (!newbucket)
-            return 1;
-        newbucket->next = buckets[hval].next;
-        newbucket->key = key;
-        newbucket->value = val;
-        buckets[hval].next = newbucket;
-    } else {
-        buckets[hval].key = key;
-        buckets[hval].value = val;
+    struct hashmap_entry cur, tmp;
+    unsigned int idx;
+
+    cur.key = key;
+    cur.value = val;
+    cur.dist = 1;
+    idx = hash(capa, key);
+    while (entries[idx].dist) {
+        if (entries[idx].dist < cur.dist) {
+            /* Rob the rich: displace the entry closer to its home. */
+            tmp = entries[idx];
+            entries[idx] = cur;
+            cur = tmp;
+        }
+        cur.dist++;
+        idx = (idx + 1) & (capa - 1);
     }
-    return 0;
+    entries[idx] = cur;
 }
 
 static int grow(struct hashmap *h)
 {
     unsigned int i;
     unsigned int newcapa;
-    struct hashmap_bucket *newarr, *walk;
-    
+    struct hashmap_entry *newarr;
+
     newcapa = h->capa ? h->capa << 1 : HASH_DEFAULT_CAPA;
     if (newcapa < h->capa)
         return 1;
-    newarr = calloc(newcapa, sizeof(struct hashmap_bucket));
+    newarr = calloc(newcapa, sizeof(struct hashmap_entry));
     if (!newarr)
         return 1;
     for (i = 0; i < h->capa; ++i) {
-        if (h->buckets[i].key) {
-            walk = &h->buckets[i];
-            while (walk) {
-                if (do_add(newarr, newcapa, walk->key, walk->value)) {
-                    /* Pass no free function here since the values are
-                       still in the old hash buckets that remain in
-                       the hash. */
-                    freebuckets(newarr, newcapa, NULL);
-                    free(newarr);
-                    return 1;
-                }
-                walk = walk->next;
-            }
-        }
-    }
-    if (h->buckets) {
-        /* Pass no free function here since we copied the values into
-           the new bucket array. */
-        freebuckets(h->buckets, h->capa, NULL);
-        free(h->buckets);
+        if (h->entries[i].dist)
+            do_add(newarr, newcapa, h->entries[i].key, h->entries[i].value);
     }
-    h->buckets = newarr;
+    free(h->entries);
+    h->entries = newarr;
     h->capa = newcapa;
     return 0;
 }
 
-static struct hashmap_bucket *hashmap_findbucket(struct hashmap *h,
-                                                 CK_ULONG key)
+static struct hashmap_entry *hashmap_findentry(struct hashmap *h,
+                                               CK_ULONG key)
 {
-    unsigned int hval;
-    struct hashmap_bucket *b = NULL;
-
-    if (h->buckets) {
-        hval = hash(h->capa, key + 1);
-        b = &h->buckets[hval];
-        while (b && b->key != key + 1)
-            b = b->next;
+    unsigned int idx, dist;
+
+    if (h->entries) {
+        idx = hash(h->capa, key);
+        /* An entry closer to its home than we are to ours ends the
+           search since our key would have displaced it. */
+        for (dist = 1; h->entries[idx].dist >= dist; ++dist) {
+            if (h->entries[idx].key == key)
+                return &h->entries[idx];
+            idx = (idx + 1) & (h->capa - 1);
+        }
     }
-    return b;
+    return NULL;
 }
 
 int hashmap_find(struct hashmap *h, CK_ULONG key, union hashmap_value *val)
 {
-    struct hashmap_bucket *b = 0;
+    struct hashmap_entry *e;
 
     if (!h)
         /* The non-existing hash is universal. */
         return 1;
-    b = hashmap_findbucket(h, key);
-    if (b && val)
-        *val = b->value;
-    return !!b;
+    e = hashmap_findentry(h, key);
+    if (e && val)
+        *val = e->value;
+    return !!e;
 }
 
 int hashmap_add(struct hashmap *h, CK_ULONG key, union hashmap_value val,
                 union hashmap_value *oldval)
 {
-    struct hashmap_bucket *b;
+    struct hashmap_entry *e;
 
-    b = hashmap_findbucket(h, key);
-    if (b) {
+    e = hashmap_findentry(h, key);
+    if (e) {
         if (oldval)
-            *oldval = b->value;
-        b->value = val;
+            *oldval = e->value;
+        e->value = val;
         return 0;
     }
     /* 0.75 fill factor */
@@ -228,48 +188,31 @@ int hashmap_add(struct hashmap *h, CK_ULONG key, union hashmap_value val,
         if (grow(h))
             return 1;
     }
-    if (do_add(h->buckets, h->capa, key + 1, val))
-        return 1;
+    do_add(h->entries, h->capa, key, val);
     h->size++;
     return 0;
 }
 
 int hashmap_delete(struct hashmap *h, CK_ULONG key, union hashmap_value *val)
 {
-    int retval = 0;
-    unsigned int hval;
-    struct hashmap_bucket *b, **indirect;
-    
-    if (h->buckets) {
-        hval = hash(h->capa, key + 1);
-        if (h->buckets[hval].key == key + 1) {
-            if (val)
-                *val = h->buckets[hval].value;
-            if ((b = h->buckets[hval].next) != NULL) {
-                h->buckets[hval].key = b->key;
-                h->buckets[hval].value = b->value;
-                h->buckets[hval].next = b->next;
-                free(b);
-            } else {
-                h->buckets[hval].key = 0;
-            }
-            retval = 1;
-        } else {
-            b = h->buckets[hval].next;
-            indirect = &h->buckets[hval].next;
-            while (b && b->key != key + 1) {
-                indirect = &b->next;
-                b = b->next;
-            }
-            if (b) {
-                if (val)
-                    *val = b->value;
-                *indirect = b->next;
-                free(b);
-                retval = 1;
-            }
-        }
+    struct hashmap_entry *e;
+    unsigned int idx, next;
+
+    e = hashmap_findentry(h, key);
+    if (!e)
+        return 0;
+    if (val)
+        *val = e->value;
+    /* Shift the following entries of the probe sequence back by one. */
+    idx = e - h->entries;
+    next = (idx + 1) & (h->capa - 1);
+    while (h->entries[next].dist > 1) {
+        h->entries[idx] = h->entries[next];
+        h->entries[idx].dist--;
+        idx = next;
+        next = (idx + 1) & (h->capa - 1);
     }
-    h->size -= retval;
-    return retval;
+    h->entries[idx].dist = 0;
+    h->size--;
+    return 1;
 }
@@ -46,6 +46,22 @@ extern CK_RV get_sha_size(CK_ULONG mech, CK_ULONG *hsize);
 
 #define OCK_POLICY_PERMS (0640u)
 
+/*
+ * Flags of the precompiled per-mechanism decision table.  The table
+ * is indexed by the mechanism table index.  An entry of 0 means that
+ * the decision was not compiled and the full check has to be done.
+ */
+#define POLICY_DECISION_COMPILED   (1u << 0)
+#define POLICY_DECISION_ALLOWED    (1u << 1)
+#define POLICY_DECISION_DIGEST_OK  (1u << 2)
+/* Signature size does not depend on the mechanism parameter. */
+#define POLICY_DECISION_SIG_KNOWN  (1u << 3)
+#define POLICY_DECISION_SIG_OK     (1u << 4)
+/* Signature size is additionally bounded by the key (objstrength.siglen). */
+#define POLICY_DECISION_SIG_KEYDEP (1u << 5)
+/* Mechanism parameter has to be inspected (PSS, OAEP, ECDH, ...) */
+#define POLICY_DECISION_DEEPCHECK  (1u << 6)
+
 struct strength {
     union {
         CK_ULONG arr[5];
@@ -73,8 +89,13 @@ struct policy_private {
     CK_ULONG           maxcurvesize;
     /* Strength struct ordered from highest to lowest. */
     struct strength strengths[NUM_SUPPORTED_STRENGTHS];
+    /* Immutable decisions compiled from the loaded policy. */
+    unsigned char      decisions[MECHTABLE_NUM_ELEMS];
+    CK_ULONG           minsiglen;
 };
 
+void policy_compile_decisions(struct policy_private *pp);
+
 struct policy_private *policy_private_alloc(void)
 {
     return calloc(1, sizeof(struct policy_private));
@@ -106,6 +127,7 @@ void policy_private_deactivate(struct policy_private *pp)
     pp->allowedkdfs = ~0lu;
     pp->allowedprfs = ~0lu;
     pp->maxcurvesize = 521u;
+    policy_compile_decisions(pp);
 }
 
 static void policy_compute_strength(struct policy_private *pp,
@@ -644,6 +666,98 @@ static CK_RV policy_check_signature_size(struct policy_private *pp,
     return CKR_OK;
 }
 
+static CK_BBOOL policy_needs_deep_check(CK_MECHANISM_TYPE mech)
+{
+    switch (mech) {
+        /* POLICY: New CKM Deep Check */
+    case CKM_RSA_PKCS_PSS:
+    case CKM_SHA1_RSA_PKCS_PSS:
+    case CKM_SHA224_RSA_PKCS_PSS:
+    case CKM_SHA256_RSA_PKCS_PSS:
+    case CKM_SHA384_RSA_PKCS_PSS:
+    case CKM_SHA512_RSA_PKCS_PSS:
+    case CKM_RSA_PKCS_OAEP:
+    case CKM_ECDH1_DERIVE:
+        return CK_TRUE;
+    default:
+        return CK_FALSE;
+    }
+}
+
+static unsigned char policy_compile_decision(struct policy_private *pp,
+                                             const struct mechrow *row)
+{
+    unsigned char dec = POLICY_DECISION_COMPILED;
+    /* Key-dependent sizes are capped by the hash.  Query the cap. */
+    struct objstrength s = { 0, ~0ul, CK_TRUE };
+    CK_MECHANISM mech = { row->numeric, NULL, 0 };
+    CK_ULONG size;
+
+    if (hashmap_find(pp->allowedmechs, row->numeric, NULL) == 0)
+        return dec;
+    dec |= POLICY_DECISION_ALLOWED;
+    if (policy_get_digest_size(row->numeric, &size) == CKR_OK &&
+        (pp->minstrengthidx >= NUM_SUPPORTED_STRENGTHS ||
+         size >= pp->strengths[pp->minstrengthidx].strength.details.digests))
+        dec |= POLICY_DECISION_DIGEST_OK;
+    if (!(row->flags & MCF_MAC_GENERAL)) {
+        dec |= POLICY_DECISION_SIG_KNOWN;
+        if (row->outputsize == MC_KEY_DEPENDENT)
+            dec |= POLICY_DECISION_SIG_KEYDEP;
+        if (policy_get_sig_size(&mech, &s, &size) == CKR_OK &&
+            size >= pp->minsiglen)
+            dec |= POLICY_DECISION_SIG_OK;
+    }
+    if (policy_needs_deep_check(row->numeric))
+        dec |= POLICY_DECISION_DEEPCHECK;
+    return dec;
+}
+
+/*
+ * Compile the currently loaded policy into the decision table.  Has
+ * to be called whenever the allowed mechanisms or the minimal strength
+ * change (externalized for testing purpose).
+ */
+void policy_compile_decisions(struct policy_private *pp)
+{
+    unsigned int i;
+
+    if (pp->minstrengthidx < NUM_SUPPORTED_STRENGTHS)
+        pp->minsiglen =
+            pp->strengths[pp->minstrengthidx].strength.details.signatures;
+    else
+        pp->minsiglen = 0;
+    for (i = 0; i < MECHTABLE_NUM_ELEMS; ++i)
+        pp->decisions[i] = policy_compile_decision(pp, &mechtable_rows[i]);
+}
+
+/*
+ * Drop the decision table such that every check takes the full path
+ * (externalized for testing purpose).
+ */
+void policy_drop_decisions(struct policy_private *pp)
+{
+    memset(pp->decisions, 0, sizeof(pp->decisions));
+}
+
+static inline unsigned char policy_get_decision(struct policy_private *pp,
+                                                CK_MECHANISM_TYPE mech)
+{
+    int idx = mechtable_idx_from_numeric(mech);
+
+    return idx < 0 ? 0 : pp->decisions[idx];
+}
+
+static CK_BBOOL policy_is_mech_listed(struct policy_private *pp,
+                                      CK_MECHANISM_TYPE mech)
+{
+    unsigned char dec = policy_get_decision(pp, mech);
+
+    if (dec & POLICY_DECISION_COMPILED)
+        return (dec & POLICY_DECISION_ALLOWED) ? CK_TRUE : CK_FALSE;
+    return hashmap_find(pp->allowedmechs, mech, NULL) ? CK_TRUE : CK_FALSE;
+}
+
 /* main functions (exported via function pointers) */
 
 static CK_RV policy_is_key_allowed(policy_t p, struct objstrength *s,
@@ -730,6 +844,8 @@ static CK_RV policy_is_mech_allowed(policy_t p, CK_MECHANISM_PTR mech,
                                     SESSION *sess)
 {
     struct policy_private *pp = p->priv;
+    CK_BBOOL sizechecked = CK_FALSE;
+    unsigned char dec;
     CK_ULONG size;
     CK_RV rv = CKR_OK;
 
@@ -738,13 +854,46 @@ static CK_RV policy_is_mech_allowed(policy_t p, CK_MECHANISM_PTR mech,
             rv = CKR_FUNCTION_FAILED;
             goto out;
         }
-        if (hashmap_find(pp->allowedmechs, mech->mechanism, NULL) == 0) {
+        dec = policy_get_decision(pp, mech->mechanism);
+        if (dec & POLICY_DECISION_COMPILED) {
+            /* Fast path: use the precompiled decision table. */
+            if (!(dec & POLICY_DECISION_ALLOWED)) {
+                TRACE_WARNING("Mechanism 0x%lx not allowed by policy\n",
+                              mech->mechanism);
+                rv = CKR_FUNCTION_FAILED;
+                goto out;
+            }
+            if (check == POLICY_CHECK_DIGEST) {
+                if (!(dec & POLICY_DECISION_DIGEST_OK)) {
+                    TRACE_WARNING("Digest output too small for policy.\n");
+                    rv = CKR_FUNCTION_FAILED;
+                    goto out;
+                }
+                sizechecked = CK_TRUE;
+            } else if (check == POLICY_CHECK_SIGNATURE ||
+                       check == POLICY_CHECK_VERIFY) {
+                if (s && (dec & POLICY_DECISION_SIG_KNOWN)) {
+                    if (!(dec & POLICY_DECISION_SIG_OK) ||
+                        ((dec & POLICY_DECISION_SIG_KEYDEP) &&
+                         s->siglen < pp->minsiglen)) {
+                        TRACE_WARNING("Signature too small for policy.\n");
+                        rv = CKR_FUNCTION_FAILED;
+                        goto out;
+                    }
+                    sizechecked = CK_TRUE;
+                }
+            } else {
+                sizechecked = CK_TRUE;
+            }
+            if (sizechecked && !(dec & POLICY_DECISION_DEEPCHECK))
+                goto out;
+        } else if (hashmap_find(pp->allowedmechs, mech->mechanism, NULL) == 0) {
             TRACE_WARNING("Mechanism 0x%lx not allowed by policy\n",
                           mech->mechanism);
             rv = CKR_FUNCTION_FAILED;
             goto out;
         }
-        if (check == POLICY_CHECK_DIGEST) {
+        if (!sizechecked && check == POLICY_CHECK_DIGEST) {
             if (policy_get_digest_size(mech->mechanism, &size) != CKR_OK) {
                 TRACE_WARNING("POLICY ERROR: Failed to retrieve digest size.\n");
                 rv = CKR_FUNCTION_FAILED;
@@ -757,8 +906,8 @@ static CK_RV policy_is_mech_allowed(policy_t p, CK_MECHANISM_PTR mech,
                 rv = CKR_FUNCTION_FAILED;
                 goto out;
             }
-        } else if (check == POLICY_CHECK_SIGNATURE ||
-                check == POLICY_CHECK_VERIFY) {
+        } else if (!sizechecked && (check == POLICY_CHECK_SIGNATURE ||
+                                    check == POLICY_CHECK_VERIFY)) {
             if (policy_get_sig_size(mech, s, &size) != CKR_OK) {
                 TRACE_WARNING("POLICY ERROR: Failed to retrieve signature size.\n");
                 rv = CKR_FUNCTION_FAILED;
@@ -780,8 +929,8 @@ static CK_RV policy_is_mech_allowed(policy_t p, CK_MECHANISM_PTR mech,
         case CKM_SHA256_RSA_PKCS_PSS:
         case CKM_SHA384_RSA_PKCS_PSS:
         case CKM_SHA512_RSA_PKCS_PSS:
-            if (hashmap_find(pp->allowedmechs,
-                             ((CK_RSA_PKCS_PSS_PARAMS *)mech->pParameter)->hashAlg, NULL) == 0) {
+            if (!policy_is_mech_listed(pp,
+                                       ((CK_RSA_PKCS_PSS_PARAMS *)mech->pParameter)->hashAlg)) {
                 TRACE_WARNING("POLICY VIOLATION: PSS hash algorithm not allowed by policy.\n");
                 rv = CKR_FUNCTION_FAILED;
             } else if (policy_is_mgf_allowed(pp,
@@ -790,8 +939,8 @@ static CK_RV policy_is_mech_allowed(policy_t p, CK_MECHANISM_PTR mech,
             }
             break;
         case CKM_RSA_PKCS_OAEP:
-            if (hashmap_find(pp->allowedmechs,
-                             ((CK_RSA_PKCS_OAEP_PARAMS *)mech->pParameter)->hashAlg, NULL) == 0) {
+            if (!policy_is_mech_listed(pp,
+                                       ((CK_RSA_PKCS_OAEP_PARAMS *)mech->pParameter)->hashAlg)) {
                 TRACE_WARNING("POLICY VIOLATION: OAEP hash algorithm not allowed by policy.\n");
                 rv = CKR_FUNCTION_FAILED;
             } else if (policy_is_mgf_allowed(pp,
@@ -823,7 +972,7 @@ static CK_RV policy_update_mech_info(policy_t p, CK_MECHANISM_TYPE mech,
     const struct mechrow *row;
 
     if (pp) {
-        if (hashmap_find(pp->allowedmechs, mech, NULL) == 0)
+        if (!policy_is_mech_listed(pp, mech))
             return CKR_MECHANISM_INVALID;
         switch (mech) {
             /* POLICY: New CKM */
@@ -1656,6 +1805,8 @@ CK_RV policy_load_policy_cfg(struct policy_private *pp,
  out:
     if (rc == CKR_OK)
         rc = policy_check_unmarked(cfg);
+    if (rc == CKR_OK)
+        policy_compile_decisions(pp);
     if (rc == CKR_FUNCTION_FAILED)
         rc = CKR_GENERAL_ERROR;
     confignode_deepfree(cfg);
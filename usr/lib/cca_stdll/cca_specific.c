@@ -280,10 +280,12 @@ struct cca_private_data {
     unsigned int num_usagedoms;
     unsigned short usage_domains[256];
     CK_BBOOL inconsistent;
+    CK_BBOOL local_pubkey_ops;
     char serialno[9];
 };
 
 #define CCA_CFG_EXPECTED_MKVPS  "EXPECTED_MKVPS"
+#define CCA_CFG_LOCAL_PUBKEY    "LOCAL_PUBLIC_KEY_OPERATIONS"
 #define CCA_CFG_SYM_MKVP        "SYM"
 #define CCA_CFG_AES_MKVP        "AES"
 #define CCA_CFG_APKA_MKVP       "APKA"
@@ -1329,6 +1331,13 @@ CK_RV cca_load_config_file(STDLL_TokData_t *tokdata, char *conf_name)
             break;
         }
 
+        if (confignode_hastype(c, CT_BARECONST) &&
+            strcasecmp(c->key, CCA_CFG_LOCAL_PUBKEY) == 0) {
+            ((struct cca_private_data *)tokdata->private_data)->
+                                                    local_pubkey_ops = TRUE;
+            continue;
+        }
+
         OCK_SYSLOG(LOG_ERR, "Error parsing config file '%s': unexpected token "
                    "'%s' at line %d\n", fname, c->key, c->line);
         TRACE_ERROR("Error parsing config file '%s': unexpected token '%s' "
@@ -2105,6 +2114,25 @@ CK_RV token_specific_rsa_generate_keypair(STDLL_TokData_t * tokdata,
     return CKR_OK;
 }
 
+/*
+ * Returns true if public key operations with the given key are performed
+ * locally with OpenSSL from the public key attributes, instead of on the
+ * CCA adapter (LOCAL_PUBLIC_KEY_OPERATIONS config option).
+ */
+static CK_BBOOL cca_local_pubkey(STDLL_TokData_t *tokdata, OBJECT *key_obj)
+{
+    struct cca_private_data *cca_private = tokdata->private_data;
+    CK_OBJECT_CLASS class;
+
+    if (!cca_private->local_pubkey_ops)
+        return FALSE;
+
+    if (template_attribute_get_ulong(key_obj->template, CKA_CLASS,
+                                     &class) != CKR_OK)
+        return FALSE;
+
+    return class == CKO_PUBLIC_KEY;
+}
 
 CK_RV token_specific_rsa_encrypt(STDLL_TokData_t * tokdata,
                                  CK_BYTE * in_data,
@@ -2122,6 +2150,11 @@ CK_RV token_specific_rsa_encrypt(STDLL_TokData_t * tokdata,
         return CKR_DEVICE_ERROR;
     }
 
+    if (cca_local_pubkey(tokdata, key_obj))
+        return openssl_specific_rsa_pkcs_public_encrypt(tokdata, in_data,
+                                                        in_data_len, out_data,
+                                                        out_data_len, key_obj);
+
     /* Find the secure key token */
     rc = template_attribute_get_non_empty(key_obj->template, CKA_IBM_OPAQUE,
                                           &attr);
@@ -2537,13 +2570,17 @@ CK_RV token_specific_rsa_verify(STDLL_TokData_t * tokdata,
     CK_ATTRIBUTE *attr;
     CK_RV rc;
 
-    UNUSED(sess);
-
     if (((struct cca_private_data *)tokdata->private_data)->inconsistent) {
         TRACE_ERROR("%s\n", ock_err(ERR_DEVICE_ERROR));
         return CKR_DEVICE_ERROR;
     }
 
+    if (cca_local_pubkey(tokdata, key_obj))
+        return openssl_specific_rsa_pkcs_verify(tokdata, sess, in_data,
+                                                in_data_len, out_data,
+                                                out_data_len, key_obj,
+                                                openssl_specific_rsa_encrypt);
+
     /* Find the secure key token */
     rc = template_attribute_get_non_empty(key_obj->template, CKA_IBM_OPAQUE,
                                           &attr);
@@ -2751,8 +2788,6 @@ CK_RV token_specific_rsa_pss_verify(STDLL_TokData_t *tokdata,
     CK_BYTE *message = NULL;
     CK_RV rc;
 
-    UNUSED(sess);
-
     if (((struct cca_private_data *)tokdata->private_data)->inconsistent) {
         TRACE_ERROR("%s\n", ock_err(ERR_DEVICE_ERROR));
         return CKR_DEVICE_ERROR;
@@ -2764,6 +2799,15 @@ CK_RV token_specific_rsa_pss_verify(STDLL_TokData_t *tokdata,
         goto done;
     }
 
+    if (cca_local_pubkey(tokdata, key_obj)) {
+        object_put(tokdata, key_obj, TRUE);
+        key_obj = NULL;
+        return openssl_specific_rsa_pss_verify(tokdata, sess, ctx, in_data,
+                                               in_data_len, out_data,
+                                               out_data_len,
+                                               openssl_specific_rsa_encrypt);
+    }
+
     /* Find the secure key token */
     rc = template_attribute_get_non_empty(key_obj->template, CKA_IBM_OPAQUE,
                                           &attr);
@@ -3624,13 +3668,15 @@ CK_RV token_specific_ec_verify(STDLL_TokData_t * tokdata,
     CK_ATTRIBUTE *attr;
     CK_RV rc;
 
-    UNUSED(sess);
-
     if (((struct cca_private_data *)tokdata->private_data)->inconsistent) {
         TRACE_ERROR("%s\n", ock_err(ERR_DEVICE_ERROR));
         return CKR_DEVICE_ERROR;
     }
 
+    if (cca_local_pubkey(tokdata, key_obj))
+        return openssl_specific_ec_verify(tokdata, sess, in_data, in_data_len,
+                                          out_data, out_data_len, key_obj);
+
     /* Find the secure key token */
     rc = template_attribute_get_non_empty(key_obj->template, CKA_IBM_OPAQUE,
                                           &attr);
@@ -27,6 +27,7 @@ opencryptoki_stdll_libpkcs11_cca_la_SOURCES = usr/lib/common/asn1.c	\
 	usr/lib/common/dp_obj.c usr/lib/common/mech_aes.c		\
 	usr/lib/common/mech_rsa.c usr/lib/common/mech_ec.c		\
 	usr/lib/common/obj_mgr.c usr/lib/common/template.c		\
+	usr/lib/common/secure_arena.c usr/lib/common/login_broker.c	\
 	usr/lib/common/data_obj.c usr/lib/common/encr_mgr.c		\
 	usr/lib/common/key_mgr.c usr/lib/common/mech_md2.c		\
 	usr/lib/common/mech_sha.c usr/lib/common/object.c		\
@@ -39,6 +40,7 @@ opencryptoki_stdll_libpkcs11_cca_la_SOURCES = usr/lib/common/asn1.c	\
 	usr/lib/common/profile_obj.c usr/lib/cca_stdll/cca_specific.c	\
 	usr/lib/common/attributes.c usr/lib/common/dlist.c		\
 	usr/lib/common/utility_common.c usr/lib/common/ec_supported.c	\
+	usr/lib/common/mech_openssl.c					\
 	usr/lib/api/policyhelper.c usr/lib/config/configuration.c	\
 	usr/lib/config/cfgparse.y usr/lib/config/cfglex.l
 
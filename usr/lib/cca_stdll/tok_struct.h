@@ -49,6 +49,7 @@ token_spec_t token_specific = {
     NULL,                       // save_token_data
     &token_specific_rng,
     &token_specific_final,
+    NULL,                       // fork_child
     NULL,                       // init_token
     NULL,                       // login
     NULL,                       // logout
@@ -81,6 +82,7 @@ token_spec_t token_specific = {
     &token_specific_rsa_pss_sign,
     &token_specific_rsa_pss_verify,
     &token_specific_rsa_generate_keypair,
+    NULL,                       // msg_sign_key_init
     // Elliptic Curve
     &token_specific_ec_sign,
     &token_specific_ec_verify,
@@ -93,6 +95,9 @@ token_spec_t token_specific = {
     token_specific_sha,
     token_specific_sha_update,
     token_specific_sha_final,
+    NULL,                       // sha_stream_init
+    NULL,                       // sha_stream_update
+    NULL,                       // sha_stream_final
     // HMAC
     &token_specific_hmac_sign_init,
     &token_specific_hmac_sign,
@@ -118,6 +123,8 @@ token_spec_t token_specific = {
     NULL,                       // aes_gcm
     NULL,                       // aes_gcm_update
     NULL,                       // aes_gcm_final
+    NULL,                       // aes_gcm_msg_init
+    NULL,                       // aes_gcm_msg
     NULL,                       // aes_ofb
     NULL,                       // aes_cfb
     NULL,                       // aes_mac
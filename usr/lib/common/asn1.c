@@ -1209,7 +1209,7 @@ CK_RV ber_encode_RSAPrivateKey(CK_BBOOL length_only,
     }
 
     rc = ber_encode_INTEGER(FALSE, &buf2, &len,
-                            (CK_BYTE *) modulus + sizeof(CK_ATTRIBUTE),
+                            modulus->pValue,
                             modulus->ulValueLen);
     if (rc != CKR_OK) {
         TRACE_DEVEL("ber_encode_INTEGER failed\n");
@@ -1223,7 +1223,7 @@ CK_RV ber_encode_RSAPrivateKey(CK_BBOOL length_only,
     }
 
     rc = ber_encode_INTEGER(FALSE, &buf2, &len,
-                            (CK_BYTE *) publ_exp + sizeof(CK_ATTRIBUTE),
+                            publ_exp->pValue,
                             publ_exp->ulValueLen);
     if (rc != CKR_OK) {
         TRACE_DEVEL("ber_encode_INTEGER failed\n");
@@ -1237,7 +1237,7 @@ CK_RV ber_encode_RSAPrivateKey(CK_BBOOL length_only,
     }
 
     rc = ber_encode_INTEGER(FALSE, &buf2, &len,
-                            (CK_BYTE *) priv_exp + sizeof(CK_ATTRIBUTE),
+                            priv_exp->pValue,
                             priv_exp->ulValueLen);
     if (rc != CKR_OK) {
         TRACE_DEVEL("ber_encode_INTEGER failed\n");
@@ -1251,7 +1251,7 @@ CK_RV ber_encode_RSAPrivateKey(CK_BBOOL length_only,
     }
 
     rc = ber_encode_INTEGER(FALSE, &buf2, &len,
-                            (CK_BYTE *) prime1 + sizeof(CK_ATTRIBUTE),
+                            prime1->pValue,
                             prime1->ulValueLen);
     if (rc != CKR_OK) {
         TRACE_DEVEL("ber_encode_INTEGER failed\n");
@@ -1265,7 +1265,7 @@ CK_RV ber_encode_RSAPrivateKey(CK_BBOOL length_only,
     }
 
     rc = ber_encode_INTEGER(FALSE, &buf2, &len,
-                            (CK_BYTE *) prime2 + sizeof(CK_ATTRIBUTE),
+                            prime2->pValue,
                             prime2->ulValueLen);
     if (rc != CKR_OK) {
         TRACE_DEVEL("ber_encode_INTEGER failed\n");
@@ -1279,7 +1279,7 @@ CK_RV ber_encode_RSAPrivateKey(CK_BBOOL length_only,
     }
 
     rc = ber_encode_INTEGER(FALSE, &buf2, &len,
-                            (CK_BYTE *) exponent1 + sizeof(CK_ATTRIBUTE),
+                            exponent1->pValue,
                             exponent1->ulValueLen);
     if (rc != CKR_OK) {
         TRACE_DEVEL("ber_encode_INTEGER failed\n");
@@ -1293,7 +1293,7 @@ CK_RV ber_encode_RSAPrivateKey(CK_BBOOL length_only,
     }
 
     rc = ber_encode_INTEGER(FALSE, &buf2, &len,
-                            (CK_BYTE *) exponent2 + sizeof(CK_ATTRIBUTE),
+                            exponent2->pValue,
                             exponent2->ulValueLen);
     if (rc != CKR_OK) {
         TRACE_DEVEL("ber_encode_INTEGER failed\n");
@@ -1307,7 +1307,7 @@ CK_RV ber_encode_RSAPrivateKey(CK_BBOOL length_only,
     }
 
     rc = ber_encode_INTEGER(FALSE, &buf2, &len,
-                            (CK_BYTE *) coeff + sizeof(CK_ATTRIBUTE),
+                            coeff->pValue,
                             coeff->ulValueLen);
     if (rc != CKR_OK) {
         TRACE_DEVEL("ber_encode_INTEGER failed\n");
@@ -1681,7 +1681,7 @@ CK_RV ber_encode_RSAPublicKey(CK_BBOOL length_only, CK_BYTE **data,
     offset = 0;
 
     rc = ber_encode_INTEGER(FALSE, &buf2, &len,
-                            (CK_BYTE *) modulus + sizeof(CK_ATTRIBUTE),
+                            modulus->pValue,
                             modulus->ulValueLen);
     if (rc != CKR_OK) {
         TRACE_DEVEL("%s ber_encode_Int failed with rc=0x%lx\n", __func__, rc);
@@ -1693,7 +1693,7 @@ CK_RV ber_encode_RSAPublicKey(CK_BBOOL length_only, CK_BYTE **data,
     free(buf2);
 
     rc = ber_encode_INTEGER(FALSE, &buf2, &len,
-                            (CK_BYTE *) publ_exp + sizeof(CK_ATTRIBUTE),
+                            publ_exp->pValue,
                             publ_exp->ulValueLen);
     if (rc != CKR_OK) {
         TRACE_DEVEL("%s ber_encode_Int failed with rc=0x%lx\n", __func__, rc);
@@ -1933,7 +1933,7 @@ CK_RV ber_encode_DSAPrivateKey(CK_BBOOL length_only,
     offset = 0;
 
     rc = ber_encode_INTEGER(FALSE, &tmp, &len,
-                            (CK_BYTE *) prime1 + sizeof(CK_ATTRIBUTE),
+                            prime1->pValue,
                             prime1->ulValueLen);
     if (rc != CKR_OK) {
         TRACE_DEVEL("ber_encode_INTEGER failed\n");
@@ -1947,7 +1947,7 @@ CK_RV ber_encode_DSAPrivateKey(CK_BBOOL length_only,
     }
 
     rc = ber_encode_INTEGER(FALSE, &tmp, &len,
-                            (CK_BYTE *) prime2 + sizeof(CK_ATTRIBUTE),
+                            prime2->pValue,
                             prime2->ulValueLen);
     if (rc != CKR_OK) {
         TRACE_DEVEL("ber_encode_INTEGER failed\n");
@@ -1961,7 +1961,7 @@ CK_RV ber_encode_DSAPrivateKey(CK_BBOOL length_only,
     }
 
     rc = ber_encode_INTEGER(FALSE, &tmp, &len,
-                            (CK_BYTE *) base + sizeof(CK_ATTRIBUTE),
+                            base->pValue,
                             base->ulValueLen);
     if (rc != CKR_OK) {
         TRACE_DEVEL("ber_encode_INTEGER failed\n");
@@ -2014,7 +2014,7 @@ CK_RV ber_encode_DSAPrivateKey(CK_BBOOL length_only,
     // build the private key INTEGER
     //
     rc = ber_encode_INTEGER(FALSE, &buf, &len,
-                            (CK_BYTE *) priv_key + sizeof(CK_ATTRIBUTE),
+                            priv_key->pValue,
                             priv_key->ulValueLen);
     if (rc != CKR_OK) {
         TRACE_DEVEL("ber_encode_INTEGER failed\n");
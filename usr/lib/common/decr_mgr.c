@@ -1150,3 +1150,172 @@ CK_RV decr_mgr_decrypt_final(STDLL_TokData_t *tokdata,
 
     return CKR_FUNCTION_FAILED;
 }
+
+//
+// Message-based decryption: the key is set up once by decr_mgr_msg_init,
+// each decr_mgr_decrypt_msg call only passes the per-message parameters
+// (IV, tag) and the associated data.
+//
+CK_RV decr_mgr_msg_init(STDLL_TokData_t *tokdata, SESSION *sess,
+                        ENCR_DECR_CONTEXT *ctx, CK_MECHANISM *mech,
+                        CK_OBJECT_HANDLE key_handle, CK_BBOOL checkpolicy)
+{
+    OBJECT *key_obj = NULL;
+    CK_KEY_TYPE keytype;
+    CK_BBOOL flag;
+    CK_ULONG strength = POLICY_STRENGTH_IDX_0;
+    CK_RV rc;
+
+    if (!sess || !ctx || !mech) {
+        TRACE_ERROR("Invalid function arguments.\n");
+        return CKR_FUNCTION_FAILED;
+    }
+    if (ctx->active != FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_ACTIVE));
+        return CKR_OPERATION_ACTIVE;
+    }
+
+    rc = object_mgr_find_in_map1(tokdata, key_handle, &key_obj, READ_LOCK);
+    if (rc != CKR_OK) {
+        TRACE_ERROR("Failed to acquire key from specified handle.\n");
+        if (rc == CKR_OBJECT_HANDLE_INVALID)
+            return CKR_KEY_HANDLE_INVALID;
+        else
+            return rc;
+    }
+
+    rc = template_attribute_get_bool(key_obj->template, CKA_DECRYPT, &flag);
+    if (rc != CKR_OK) {
+        TRACE_ERROR("Could not find CKA_DECRYPT for the key.\n");
+        rc = CKR_KEY_FUNCTION_NOT_PERMITTED;
+        goto done;
+    }
+
+    if (flag != TRUE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_KEY_FUNCTION_NOT_PERMITTED));
+        rc = CKR_KEY_FUNCTION_NOT_PERMITTED;
+        goto done;
+    }
+
+    if (checkpolicy) {
+        rc = tokdata->policy->is_mech_allowed(tokdata->policy, mech,
+                                              &key_obj->strength,
+                                              POLICY_CHECK_DECRYPT, sess);
+        if (rc != CKR_OK) {
+            TRACE_ERROR("POLICY VIOLATION: message decrypt init\n");
+            goto done;
+        }
+    }
+    if (!key_object_is_mechanism_allowed(key_obj->template, mech->mechanism)) {
+        TRACE_ERROR("Mechanism not allwed per CKA_ALLOWED_MECHANISMS.\n");
+        rc = CKR_MECHANISM_INVALID;
+        goto done;
+    }
+
+    switch (mech->mechanism) {
+#ifndef NOAES
+    case CKM_AES_GCM:
+        /* The GCM parameters are passed with each message */
+        if (mech->ulParameterLen != 0 || mech->pParameter != NULL) {
+            TRACE_ERROR("%s\n", ock_err(ERR_MECHANISM_PARAM_INVALID));
+            rc = CKR_MECHANISM_PARAM_INVALID;
+            goto done;
+        }
+
+        rc = template_attribute_get_ulong(key_obj->template, CKA_KEY_TYPE,
+                                          &keytype);
+        if (rc != CKR_OK) {
+            TRACE_ERROR("Could not find CKA_KEY_TYPE for the key.\n");
+            goto done;
+        }
+
+        if (keytype != CKK_AES) {
+            TRACE_ERROR("%s\n", ock_err(ERR_KEY_TYPE_INCONSISTENT));
+            rc = CKR_KEY_TYPE_INCONSISTENT;
+            goto done;
+        }
+
+        ctx->context_len = sizeof(AES_GCM_CONTEXT);
+        ctx->context = (CK_BYTE *) calloc(1, sizeof(AES_GCM_CONTEXT));
+        if (!ctx->context) {
+            TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
+            rc = CKR_HOST_MEMORY;
+            goto done;
+        }
+
+        strength = key_obj->strength.strength;
+
+        /* Release obj lock, token specific aes-gcm may re-acquire the lock */
+        object_put(tokdata, key_obj, TRUE);
+        key_obj = NULL;
+
+        rc = aes_gcm_msg_init(tokdata, sess, ctx, key_handle, 0);
+        if (rc != CKR_OK) {
+            TRACE_ERROR("Could not initialize message-based AES_GCM.\n");
+            goto done;
+        }
+        break;
+#endif
+    default:
+        TRACE_ERROR("%s\n", ock_err(ERR_MECHANISM_INVALID));
+        rc = CKR_MECHANISM_INVALID;
+        goto done;
+    }
+
+    ctx->key = key_handle;
+    ctx->mech.mechanism = mech->mechanism;
+    ctx->mech.pParameter = NULL;
+    ctx->mech.ulParameterLen = 0;
+    ctx->multi_init = TRUE;
+    ctx->multi = FALSE;
+    ctx->active = TRUE;
+    ctx->pkey_active = FALSE;
+
+done:
+    if (ctx->count_statistics == TRUE && rc == CKR_OK)
+        INC_COUNTER(tokdata, sess, mech, key_obj, strength);
+
+    if (rc != CKR_OK)
+        decr_mgr_cleanup(tokdata, sess, ctx);
+
+    object_put(tokdata, key_obj, TRUE);
+    key_obj = NULL;
+
+    return rc;
+}
+
+//
+//
+CK_RV decr_mgr_decrypt_msg(STDLL_TokData_t *tokdata, SESSION *sess,
+                           CK_BBOOL length_only, ENCR_DECR_CONTEXT *ctx,
+                          void *param, CK_ULONG param_len,
+                           CK_BYTE *aad, CK_ULONG aad_len,
+                           CK_BYTE *in_data, CK_ULONG in_data_len,
+                           CK_BYTE *out_data, CK_ULONG *out_data_len)
+{
+    if (!sess || !ctx) {
+        TRACE_ERROR("Invalid function arguments.\n");
+        return CKR_FUNCTION_FAILED;
+    }
+    if (ctx->active == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_NOT_INITIALIZED));
+        return CKR_OPERATION_NOT_INITIALIZED;
+    }
+    if ((length_only == FALSE) && (!out_data || (!in_data && in_data_len))) {
+        TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_FAILED));
+        return CKR_FUNCTION_FAILED;
+    }
+
+    switch (ctx->mech.mechanism) {
+#ifndef NOAES
+    case CKM_AES_GCM:
+        return aes_gcm_decrypt_msg(tokdata, sess, length_only, ctx,
+                                   param, param_len, aad, aad_len,
+                                   in_data, in_data_len,
+                                   out_data, out_data_len);
+#endif
+    default:
+        TRACE_ERROR("%s\n", ock_err(ERR_MECHANISM_INVALID));
+        return CKR_MECHANISM_INVALID;
+    }
+}
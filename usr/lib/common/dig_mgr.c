@@ -478,3 +478,128 @@ out:
 
     return rc;
 }
+
+//
+// Digest part of the hash-and-sign and hash-and-verify mechanisms.
+//
+// If the token provides a streaming digest, a single digest context is kept
+// for the whole operation and the data is hashed directly from the caller's
+// buffer, without going through the digest manager on every update.
+// Otherwise the regular digest manager routines are used.
+//
+static void digest_mgr_hash_sign_free(STDLL_TokData_t *tokdata, SESSION *sess,
+                                      CK_BYTE *context, CK_ULONG context_len)
+{
+    RSA_DIGEST_CONTEXT *ctx = (RSA_DIGEST_CONTEXT *)context;
+
+    UNUSED(context_len);
+
+    digest_mgr_cleanup(tokdata, sess, &ctx->hash_context);
+    free(ctx);
+}
+
+CK_RV digest_mgr_hash_sign_init(STDLL_TokData_t *tokdata, SESSION *sess,
+                                SIGN_VERIFY_CONTEXT *ctx, CK_MECHANISM *mech)
+{
+    RSA_DIGEST_CONTEXT *context = (RSA_DIGEST_CONTEXT *)ctx->context;
+    CK_RV rc;
+
+    switch (mech->mechanism) {
+    case CKM_SHA_1:
+    case CKM_SHA224:
+    case CKM_SHA256:
+    case CKM_SHA384:
+    case CKM_SHA512:
+        if (token_specific.t_sha_stream_init == NULL)
+            break;
+
+        rc = token_specific.t_sha_stream_init(tokdata, &context->hash_context,
+                                              mech);
+        if (rc != CKR_OK) {
+            TRACE_DEVEL("Token specific sha stream init failed.\n");
+            return rc;
+        }
+
+        context->hash_context.multi_init = TRUE;
+        context->hash_context.multi = TRUE;
+        context->hash_context.active = TRUE;
+        context->streaming = TRUE;
+        context->flag = TRUE;
+
+        // the nested digest context must be freed with the operation
+        ctx->context_free_func = digest_mgr_hash_sign_free;
+        ctx->state_unsaveable = TRUE;
+        return CKR_OK;
+    default:
+        break;
+    }
+
+    rc = digest_mgr_init(tokdata, sess, &context->hash_context, mech, FALSE);
+    if (rc != CKR_OK) {
+        TRACE_DEVEL("Digest Mgr Init failed.\n");
+        return rc;
+    }
+    context->flag = TRUE;
+    ctx->state_unsaveable |= context->hash_context.state_unsaveable;
+
+    return CKR_OK;
+}
+
+CK_RV digest_mgr_hash_sign_update(STDLL_TokData_t *tokdata, SESSION *sess,
+                                  RSA_DIGEST_CONTEXT *context,
+                                  CK_BYTE *data, CK_ULONG data_len)
+{
+    CK_RV rc;
+
+    if (context->streaming == FALSE)
+        return digest_mgr_digest_update(tokdata, sess, &context->hash_context,
+                                        data, data_len);
+
+    if (context->hash_context.active == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_NOT_INITIALIZED));
+        return CKR_OPERATION_NOT_INITIALIZED;
+    }
+    if (data_len == 0)
+        return CKR_OK;
+    if (!data) {
+        TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
+        rc = CKR_ARGUMENTS_BAD;
+        goto out;
+    }
+
+    rc = token_specific.t_sha_stream_update(tokdata, &context->hash_context,
+                                            data, data_len);
+
+out:
+    if (rc != CKR_OK)
+        digest_mgr_cleanup(tokdata, sess, &context->hash_context);
+
+    return rc;
+}
+
+CK_RV digest_mgr_hash_sign_final(STDLL_TokData_t *tokdata, SESSION *sess,
+                                 CK_BBOOL length_only,
+                                 RSA_DIGEST_CONTEXT *context,
+                                 CK_BYTE *hash, CK_ULONG *hash_len)
+{
+    CK_RV rc;
+
+    if (context->streaming == FALSE)
+        return digest_mgr_digest_final(tokdata, sess, length_only,
+                                       &context->hash_context, hash, hash_len);
+
+    if (context->hash_context.active == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_NOT_INITIALIZED));
+        return CKR_OPERATION_NOT_INITIALIZED;
+    }
+
+    if (length_only == TRUE)
+        return get_sha_size(context->hash_context.mech.mechanism, hash_len);
+
+    rc = token_specific.t_sha_stream_final(tokdata, &context->hash_context,
+                                           hash, hash_len);
+    if (rc != CKR_BUFFER_TOO_SMALL)
+        digest_mgr_cleanup(tokdata, sess, &context->hash_context);
+
+    return rc;
+}
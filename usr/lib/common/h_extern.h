@@ -433,6 +433,20 @@ CK_RV restore_private_token_object(STDLL_TokData_t *tokdata,
                                    OBJECT *pObj,
                                    const char *fname);
 
+typedef CK_RV (*private_token_object_fn)(STDLL_TokData_t *tokdata,
+                                         const char *name, const char *fname,
+                                         CK_BYTE *header, CK_BYTE *data,
+                                         CK_ULONG len, CK_BYTE *footer,
+                                         void *arg);
+CK_RV for_each_private_token_object(STDLL_TokData_t *tokdata,
+                                    private_token_object_fn fn, void *arg);
+CK_RV unseal_private_token_object(STDLL_TokData_t *tokdata, CK_BYTE *header,
+                                  CK_BYTE *data, CK_ULONG len,
+                                  CK_BYTE *footer, CK_BYTE *clear);
+CK_RV restore_private_token_object_data(STDLL_TokData_t *tokdata,
+                                        const char *name, CK_BYTE *data,
+                                        CK_ULONG len);
+
 CK_RV delete_token_object(STDLL_TokData_t *tokdata, OBJECT *ptr);
 CK_RV delete_token_data(STDLL_TokData_t *tokdata);
 
@@ -1496,6 +1510,19 @@ CK_RV aes_gcm_free_param(CK_GCM_PARAMS *params);
 void aes_gcm_param_from_compat(const CK_GCM_PARAMS_COMPAT *from,
                                CK_GCM_PARAMS *to);
 
+CK_RV aes_gcm_msg_init(STDLL_TokData_t *tokdata, SESSION *,
+                       ENCR_DECR_CONTEXT *, CK_OBJECT_HANDLE, CK_BYTE);
+
+CK_RV aes_gcm_encrypt_msg(STDLL_TokData_t *tokdata, SESSION *, CK_BBOOL,
+                          ENCR_DECR_CONTEXT *, void *, CK_ULONG,
+                          CK_BYTE *, CK_ULONG, CK_BYTE *, CK_ULONG,
+                          CK_BYTE *, CK_ULONG *);
+
+CK_RV aes_gcm_decrypt_msg(STDLL_TokData_t *tokdata, SESSION *, CK_BBOOL,
+                          ENCR_DECR_CONTEXT *, void *, CK_ULONG,
+                          CK_BYTE *, CK_ULONG, CK_BYTE *, CK_ULONG,
+                          CK_BYTE *, CK_ULONG *);
+
 CK_RV aes_ofb_encrypt(STDLL_TokData_t *tokdata, SESSION *sess,
                       CK_BBOOL length_only,
                       ENCR_DECR_CONTEXT *ctx, CK_BYTE *in_data,
@@ -1785,6 +1812,7 @@ int ec_point_from_public_data(const CK_BYTE *data, CK_ULONG data_len,
 
 CK_RV attach_shm(STDLL_TokData_t *tokdata, CK_SLOT_ID slot_id);
 CK_RV detach_shm(STDLL_TokData_t *tokdata, CK_BBOOL ignore_ref_count);
+CK_RV fork_child_shm(STDLL_TokData_t *tokdata);
 
 //get keytype
 CK_RV get_keytype(STDLL_TokData_t *tokdata, CK_OBJECT_HANDLE hkey,
@@ -1841,6 +1869,17 @@ CK_RV encr_mgr_reencrypt_single(STDLL_TokData_t *tokdata, SESSION *sess,
                                 CK_BYTE *in_data, CK_ULONG in_data_len,
                                 CK_BYTE *out_data, CK_ULONG *out_data_len);
 
+CK_RV encr_mgr_msg_init(STDLL_TokData_t *tokdata, SESSION *sess,
+                        ENCR_DECR_CONTEXT *ctx, CK_MECHANISM *mech,
+                        CK_OBJECT_HANDLE key_handle, CK_BBOOL checkpolicy);
+
+CK_RV encr_mgr_encrypt_msg(STDLL_TokData_t *tokdata, SESSION *sess,
+                           CK_BBOOL length_only, ENCR_DECR_CONTEXT *ctx,
+                           void *param, CK_ULONG param_len,
+                           CK_BYTE *aad, CK_ULONG aad_len,
+                           CK_BYTE *in_data, CK_ULONG in_data_len,
+                           CK_BYTE *out_data, CK_ULONG *out_data_len);
+
 // decryption manager routines
 //
 CK_RV decr_mgr_init(STDLL_TokData_t *tokdata,
@@ -1870,6 +1909,17 @@ CK_RV decr_mgr_decrypt_update(STDLL_TokData_t *tokdata,
                               CK_BYTE *in_data, CK_ULONG in_data_len,
                               CK_BYTE *out_data, CK_ULONG *out_data_len);
 
+CK_RV decr_mgr_msg_init(STDLL_TokData_t *tokdata, SESSION *sess,
+                        ENCR_DECR_CONTEXT *ctx, CK_MECHANISM *mech,
+                        CK_OBJECT_HANDLE key_handle, CK_BBOOL checkpolicy);
+
+CK_RV decr_mgr_decrypt_msg(STDLL_TokData_t *tokdata, SESSION *sess,
+                           CK_BBOOL length_only, ENCR_DECR_CONTEXT *ctx,
+                           void *param, CK_ULONG param_len,
+                           CK_BYTE *aad, CK_ULONG aad_len,
+                           CK_BYTE *in_data, CK_ULONG in_data_len,
+                           CK_BYTE *out_data, CK_ULONG *out_data_len);
+
 CK_RV decr_mgr_update_des_ecb(STDLL_TokData_t *tokdata, SESSION *sess,
                               CK_BBOOL length_only, ENCR_DECR_CONTEXT *ctx,
                               CK_BYTE *in_data, CK_ULONG in_data_len,
@@ -1920,6 +1970,18 @@ CK_RV digest_mgr_digest_final(STDLL_TokData_t *tokdata,
                               DIGEST_CONTEXT *ctx,
                               CK_BYTE *hash, CK_ULONG *hash_len);
 
+CK_RV digest_mgr_hash_sign_init(STDLL_TokData_t *tokdata, SESSION *sess,
+                                SIGN_VERIFY_CONTEXT *ctx, CK_MECHANISM *mech);
+
+CK_RV digest_mgr_hash_sign_update(STDLL_TokData_t *tokdata, SESSION *sess,
+                                  RSA_DIGEST_CONTEXT *context,
+                                  CK_BYTE *data, CK_ULONG data_len);
+
+CK_RV digest_mgr_hash_sign_final(STDLL_TokData_t *tokdata, SESSION *sess,
+                                 CK_BBOOL length_only,
+                                 RSA_DIGEST_CONTEXT *context,
+                                 CK_BYTE *hash, CK_ULONG *hash_len);
+
 
 // key manager routines
 //
@@ -2003,6 +2065,16 @@ CK_RV sign_mgr_sign_recover(STDLL_TokData_t *tokdata,
                             CK_ULONG in_data_len,
                             CK_BYTE *out_data, CK_ULONG *out_data_len);
 
+CK_RV sign_mgr_msg_init(STDLL_TokData_t *tokdata, SESSION *sess,
+                        SIGN_VERIFY_CONTEXT *ctx, CK_MECHANISM *mech,
+                        CK_OBJECT_HANDLE key, CK_BBOOL checkpolicy);
+
+CK_RV sign_mgr_sign_msg(STDLL_TokData_t *tokdata, SESSION *sess,
+                        CK_BBOOL length_only, SIGN_VERIFY_CONTEXT *ctx,
+                        void *param, CK_ULONG param_len,
+                        CK_BYTE *in_data, CK_ULONG in_data_len,
+                        CK_BYTE *out_data, CK_ULONG *out_data_len);
+
 CK_RV sign_mgr_sign_final(STDLL_TokData_t *tokdata,
                           SESSION *sess,
                           CK_BBOOL length_only,
@@ -2041,6 +2113,16 @@ CK_RV verify_mgr_verify_recover(STDLL_TokData_t *tokdata,
                                 CK_ULONG sig_len,
                                 CK_BYTE *out_data, CK_ULONG *out_len);
 
+CK_RV verify_mgr_msg_init(STDLL_TokData_t *tokdata, SESSION *sess,
+                          SIGN_VERIFY_CONTEXT *ctx, CK_MECHANISM *mech,
+                          CK_OBJECT_HANDLE key, CK_BBOOL checkpolicy);
+
+CK_RV verify_mgr_verify_msg(STDLL_TokData_t *tokdata, SESSION *sess,
+                            SIGN_VERIFY_CONTEXT *ctx,
+                            void *param, CK_ULONG param_len,
+                            CK_BYTE *in_data, CK_ULONG in_data_len,
+                            CK_BYTE *signature, CK_ULONG sig_len);
+
 CK_RV verify_mgr_verify_update(STDLL_TokData_t *tokdata,
                                SESSION *sess,
                                SIGN_VERIFY_CONTEXT *ctx,
@@ -2146,6 +2228,10 @@ CK_RV object_mgr_find_init(STDLL_TokData_t *tokdata,
                            SESSION *sess,
                            CK_ATTRIBUTE *pTemplate, CK_ULONG ulCount);
 
+CK_RV object_mgr_find(STDLL_TokData_t *tokdata, SESSION *sess,
+                      CK_OBJECT_HANDLE *handles, CK_ULONG max,
+                      CK_ULONG *count);
+
 CK_RV object_mgr_find_build_list(SESSION *sess,
                                  CK_ATTRIBUTE *pTemplate,
                                  CK_ULONG ulCount,
@@ -2204,13 +2290,11 @@ struct find_by_name_args {
     char *name;
 };
 
-struct find_build_list_args {
-    CK_ATTRIBUTE *pTemplate;
+struct find_next_args {
     SESSION *sess;
-    CK_ULONG ulCount;
-    CK_BBOOL hw_feature;
-    CK_BBOOL hidden_object;
-    CK_BBOOL public_only;
+    CK_OBJECT_HANDLE *handles;
+    CK_ULONG max;
+    CK_ULONG count;
 };
 
 struct purge_args {
@@ -2240,7 +2324,8 @@ CK_RV object_copy(STDLL_TokData_t *tokdata,
                   CK_ATTRIBUTE *pTemplate,
                   CK_ULONG ulCount, OBJECT *old_obj, OBJECT **new_obj);
 
-CK_RV object_flatten(OBJECT *obj, CK_BYTE **data, CK_ULONG *len);
+CK_RV object_flatten(OBJECT *obj, CK_BYTE **data, CK_ULONG *len,
+                     CK_BBOOL record);
 
 void object_free(OBJECT *obj);
 
@@ -2272,6 +2357,10 @@ CK_BBOOL object_is_attr_bound(OBJECT *obj);
 
 CK_RV object_init_lock(OBJECT *obj);
 CK_RV object_destroy_lock(OBJECT *obj);
+CK_RV object_get_fast_key(STDLL_TokData_t *tokdata, OBJECT *obj,
+                          const struct fast_key_ops *ops, void **fast_key);
+void object_put_fast_key(const struct fast_key_ops *ops, void *fast_key);
+void object_invalidate_fast_key(OBJECT *obj);
 CK_RV object_lock(OBJECT *obj, OBJ_LOCK_TYPE type);
 CK_RV object_unlock(OBJECT *obj);
 
@@ -2314,6 +2403,9 @@ CK_RV template_copy(TEMPLATE *dest, TEMPLATE *src);
 
 CK_RV template_flatten(TEMPLATE *tmpl, CK_BYTE *dest);
 
+CK_RV template_flatten_record(TEMPLATE *tmpl, CK_BYTE *dest,
+                              CK_ULONG num_entries);
+
 CK_RV template_free(TEMPLATE *tmpl);
 
 CK_BBOOL template_get_class(TEMPLATE *tmpl,
@@ -2325,6 +2417,9 @@ CK_ULONG template_get_size(TEMPLATE *tmpl);
 
 CK_ULONG template_get_compressed_size(TEMPLATE *tmpl);
 
+void template_get_record_size(TEMPLATE *tmpl, CK_ULONG *num_entries,
+                              CK_ULONG *heap_len);
+
 CK_RV template_set_default_common_attributes(TEMPLATE *tmpl);
 
 CK_RV template_merge(TEMPLATE *dest, TEMPLATE **src);
@@ -2336,6 +2431,10 @@ CK_RV template_unflatten(TEMPLATE **tmpl, CK_BYTE *data, CK_ULONG count);
 CK_RV template_unflatten_withSize(TEMPLATE **new_tmpl,
                                   CK_BYTE *buf, CK_ULONG count, int buf_size);
 
+CK_RV template_unflatten_record(TEMPLATE **new_tmpl, const CK_BYTE *buf,
+                                CK_ULONG num_attrs, CK_ULONG num_entries,
+                                CK_ULONG heap_len);
+
 CK_RV template_validate_attribute(STDLL_TokData_t *tokdata,
                                   TEMPLATE *tmpl,
                                   CK_ATTRIBUTE *attr,
@@ -2860,6 +2959,13 @@ typedef CK_RV (*t_rsa_decrypt)(STDLL_TokData_t *, CK_BYTE *in_data,
                                CK_ULONG in_data_len, CK_BYTE *out_data,
                                OBJECT *key_obj);
 
+CK_RV openssl_specific_rsa_generate_pkey(CK_ULONG mod_bits,
+                                         const CK_BYTE *publ_exp,
+                                         CK_ULONG publ_exp_len,
+                                         EVP_PKEY **pkey);
+CK_RV openssl_specific_rsa_keygen_from_pkey(EVP_PKEY *pkey,
+                                            TEMPLATE *publ_tmpl,
+                                            TEMPLATE *priv_tmpl);
 CK_RV openssl_specific_rsa_keygen(TEMPLATE *publ_tmpl, TEMPLATE *priv_tmpl);
 CK_RV openssl_specific_rsa_encrypt(STDLL_TokData_t *, CK_BYTE *in_data,
                                    CK_ULONG in_data_len,
@@ -2873,6 +2979,9 @@ CK_RV openssl_specific_rsa_pkcs_decrypt(STDLL_TokData_t *, CK_BYTE *,
 CK_RV openssl_specific_rsa_pkcs_encrypt(STDLL_TokData_t *, CK_BYTE *,
                                         CK_ULONG, CK_BYTE *, CK_ULONG *,
                                         OBJECT *, t_rsa_encrypt);
+CK_RV openssl_specific_rsa_pkcs_public_encrypt(STDLL_TokData_t *, CK_BYTE *,
+                                               CK_ULONG, CK_BYTE *, CK_ULONG *,
+                                               OBJECT *);
 CK_RV openssl_specific_rsa_pkcs_sign(STDLL_TokData_t *, SESSION *, CK_BYTE *,
                                      CK_ULONG, CK_BYTE *, CK_ULONG *, OBJECT *,
                                      t_rsa_decrypt);
@@ -2914,8 +3023,16 @@ CK_RV openssl_specific_rsa_oaep_decrypt(STDLL_TokData_t *, ENCR_DECR_CONTEXT *,
                                         CK_BYTE *, CK_ULONG, CK_BYTE *,
                                         CK_ULONG *, CK_BYTE *, CK_ULONG,
                                         t_rsa_decrypt);
+CK_RV openssl_specific_msg_sign_key_init(STDLL_TokData_t *tokdata,
+                                         SESSION *sess,
+                                         SIGN_VERIFY_CONTEXT *ctx,
+                                         CK_OBJECT_HANDLE hkey);
 
 CK_RV openssl_make_ec_key_from_template(TEMPLATE *template, EVP_PKEY **pkey);
+CK_RV openssl_specific_ec_generate_pkey(int nid, EVP_PKEY **pkey);
+CK_RV openssl_specific_ec_keygen_from_pkey(EVP_PKEY *ec_pkey,
+                                           TEMPLATE *publ_tmpl,
+                                           TEMPLATE *priv_tmpl);
 CK_RV openssl_specific_ec_generate_keypair(STDLL_TokData_t *tokdata,
                                            TEMPLATE *publ_tmpl,
                                            TEMPLATE *priv_tmpl);
@@ -2947,6 +3064,17 @@ CK_RV openssl_specific_sha_update(STDLL_TokData_t *tokdata, DIGEST_CONTEXT *ctx,
                                   CK_BYTE *in_data, CK_ULONG in_data_len);
 CK_RV openssl_specific_sha_final(STDLL_TokData_t *tokdata, DIGEST_CONTEXT *ctx,
                                  CK_BYTE *out_data, CK_ULONG *out_data_len);
+CK_RV openssl_specific_sha_stream_init(STDLL_TokData_t *tokdata,
+                                       DIGEST_CONTEXT *ctx,
+                                       CK_MECHANISM *mech);
+CK_RV openssl_specific_sha_stream_update(STDLL_TokData_t *tokdata,
+                                         DIGEST_CONTEXT *ctx,
+                                         CK_BYTE *in_data,
+                                         CK_ULONG in_data_len);
+CK_RV openssl_specific_sha_stream_final(STDLL_TokData_t *tokdata,
+                                        DIGEST_CONTEXT *ctx,
+                                        CK_BYTE *out_data,
+                                        CK_ULONG *out_data_len);
 
 CK_RV openssl_specific_aes_ecb(STDLL_TokData_t *tokdata,
                                CK_BYTE *in_data,
@@ -2995,6 +3123,17 @@ CK_RV openssl_specific_aes_gcm_update(STDLL_TokData_t *tokdata, SESSION *sess,
 CK_RV openssl_specific_aes_gcm_final(STDLL_TokData_t *tokdata, SESSION *sess,
                                      ENCR_DECR_CONTEXT *ctx, CK_BYTE *out_data,
                                      CK_ULONG *out_data_len, CK_BYTE encrypt);
+CK_RV openssl_specific_aes_gcm_msg_init(STDLL_TokData_t *tokdata,
+                                        SESSION *sess, ENCR_DECR_CONTEXT *ctx,
+                                        CK_OBJECT_HANDLE hkey,
+                                        CK_BYTE encrypt);
+CK_RV openssl_specific_aes_gcm_msg(STDLL_TokData_t *tokdata, SESSION *sess,
+                                   ENCR_DECR_CONTEXT *ctx,
+                                   CK_GCM_MESSAGE_PARAMS *params,
+                                   CK_BYTE *aad, CK_ULONG aad_len,
+                                   CK_BYTE *in_data, CK_ULONG in_data_len,
+                                   CK_BYTE *out_data, CK_ULONG *out_data_len,
+                                   CK_BYTE encrypt);
 CK_RV openssl_specific_aes_mac(STDLL_TokData_t *tokdata, CK_BYTE *message,
                                CK_ULONG message_len, OBJECT *key, CK_BYTE *mac);
 CK_RV openssl_specific_aes_cmac(STDLL_TokData_t *tokdata, CK_BYTE *message,
@@ -73,25 +73,45 @@ typedef struct _SIGN_VERIFY_CONTEXT {
     CK_BBOOL pkey_active;
     CK_BBOOL state_unsaveable;
     CK_BBOOL count_statistics;
+    void *msg_key;              // private key of a message-based signature,
+                                // set up by C_MessageSignInit
+    void (*msg_key_free_func)(void *msg_key);
 } SIGN_VERIFY_CONTEXT;
 
 
+// position of an object search, see object_mgr_find_init()
+struct find_cursor {
+    CK_ATTRIBUTE *tmpl;         // copy of the search template
+    CK_ULONG tmpl_count;
+    CK_BBOOL public_only;
+    CK_BBOOL hw_feature;
+    CK_BBOOL hidden_object;
+    unsigned int tree;          // object tree currently searched
+    unsigned long node;         // next node number in that tree
+};
+
 typedef struct _SESSION {
     struct bt_ref_hdr hdr;
     CK_SESSION_HANDLE handle;
     CK_SESSION_INFO session_info;
 
+    // search result list, only built up front by the ICSF token
     CK_OBJECT_HANDLE *find_list;        // array of CK_OBJECT_HANDLE
     CK_ULONG_32 find_count;     // # handles in the list
     CK_ULONG_32 find_len;       // max # of handles in the list
     CK_ULONG_32 find_idx;       // current position
     CK_BBOOL find_active;
+    struct find_cursor find_cursor;
 
     ENCR_DECR_CONTEXT encr_ctx;
     ENCR_DECR_CONTEXT decr_ctx;
+    ENCR_DECR_CONTEXT msg_encr_ctx;     // message-based encryption
+    ENCR_DECR_CONTEXT msg_decr_ctx;     // message-based decryption
     DIGEST_CONTEXT digest_ctx;
     SIGN_VERIFY_CONTEXT sign_ctx;
     SIGN_VERIFY_CONTEXT verify_ctx;
+    SIGN_VERIFY_CONTEXT msg_sign_ctx;   // message-based signing
+    SIGN_VERIFY_CONTEXT msg_verify_ctx; // message-based verification
 
     void *private_data;
 } SESSION;
@@ -187,9 +207,33 @@ typedef pthread_mutex_t MUTEX;
 
 typedef struct _TEMPLATE {
     DL_NODE *attribute_list;
+    CK_BYTE *record;            // single block of a restored object record
+    CK_ULONG record_len;
 } TEMPLATE;
 
 
+/*
+ * A derived fast key is a ready-to-use form of a key object, e.g. an OpenSSL
+ * EVP_PKEY built from the key attributes, that is cached with the object
+ * instead of being derived again for every operation. See
+ * object_get_fast_key().
+ *
+ * Only public key material may be cached: a fast key lives in the ordinary
+ * heap for the lifetime of the object, outside of the secure arena.
+ */
+struct _OBJECT;
+
+struct fast_key_ops {
+    const char *name;
+    /* Derives the fast key, called with the object at least read-locked */
+    CK_RV (*derive)(STDLL_TokData_t *tokdata, struct _OBJECT *obj,
+                    void **fast_key);
+    /* Takes an additional reference to a fast key */
+    void *(*get)(void *fast_key);
+    /* Releases a reference to a fast key */
+    void (*put)(void *fast_key);
+};
+
 typedef struct _OBJECT {
     struct bt_ref_hdr hdr;
     CK_OBJECT_CLASS class;
@@ -205,9 +249,51 @@ typedef struct _OBJECT {
 
     // policy support (set via store_object_strength_f pointer)
     struct objstrength strength;
+
+    // derived fast key cache, see object_get_fast_key()
+    pthread_mutex_t fast_key_mutex;
+    const struct fast_key_ops *fast_key_ops;
+    void *fast_key;
+    CK_ULONG fast_key_gen;      // template_gen the fast key was derived from
+    CK_ULONG template_gen;      // changed whenever the template changes
 } OBJECT;
 
 
+/*
+ * Flattened object as stored in the token object files: the header is
+ * followed by the attribute table and the value heap. Values are 8 byte
+ * aligned and referenced by their offset into the heap, the elements of an
+ * attribute array by their index into the table. Objects flattened by
+ * older versions have the attribute count where the magic is. Records are
+ * only written for tokens with a tokversion of TOK_OBJECT_RECORDS or higher,
+ * but always read.
+ */
+#define TOK_OBJECT_RECORDS          0x00030013  /* 3.19 */
+#define OBJECT_RECORD_MAGIC         0x524a424f  /* "OBJR" */
+#define OBJECT_RECORD_VERSION       1
+#define OBJECT_RECORD_ALIGN(len)    (((len) + 7) & ~((CK_ULONG)7))
+
+#define OBJECT_RECORD_ATTR_ULONG    0x00000001  /* value is a 64 bit ulong */
+#define OBJECT_RECORD_ATTR_ARRAY    0x00000002  /* offset/len index elements */
+
+typedef struct _OBJECT_RECORD_HDR {
+    CK_OBJECT_CLASS_32 class;
+    CK_ULONG_32 magic;
+    CK_BYTE name[8];
+    CK_ULONG_32 version;
+    CK_ULONG_32 num_attrs;      // top level attributes, first in the table
+    CK_ULONG_32 num_entries;    // including the attribute array elements
+    CK_ULONG_32 heap_len;
+} OBJECT_RECORD_HDR;
+
+typedef struct _OBJECT_RECORD_ATTR {
+    CK_ULONG_32 type;
+    CK_ULONG_32 flags;
+    CK_ULONG_32 offset;
+    CK_ULONG_32 len;
+} OBJECT_RECORD_ATTR;
+
+
 typedef struct _OBJECT_MAP {
     struct bt_ref_hdr hdr;
     CK_OBJECT_HANDLE obj_handle;
@@ -305,6 +391,7 @@ typedef struct _SSL3_MAC_CONTEXT {
 typedef struct _RSA_DIGEST_CONTEXT {
     DIGEST_CONTEXT hash_context;
     CK_BBOOL flag;
+    CK_BBOOL streaming;         // hash_context uses the token's stream digest
 } RSA_DIGEST_CONTEXT;
 
 
@@ -354,6 +441,12 @@ struct _LW_SHM_TYPE {
     CK_ULONG_32 num_publ_tok_obj;
     CK_BBOOL priv_loaded;
     CK_BBOOL publ_loaded;
+    /*
+     * Sequence counter of the token object lists, odd while a process
+     * modifies them. Allows to check the entry of an object without the
+     * XProcLock, see object_mgr_check_shm().
+     */
+    CK_ULONG_32 tok_obj_seq;
     TOK_OBJ_ENTRY publ_tok_objs[MAX_TOK_OBJS];
     TOK_OBJ_ENTRY priv_tok_objs[MAX_TOK_OBJS];
 };
@@ -396,6 +489,10 @@ struct _STDLL_TokData_t {
     const struct mechtable_funcs *mechtable_funcs;
     struct statistics *statistics;
     struct tokstore_strength store_strength;
+    CK_BBOOL saveable_digest_state; /* see mech_openssl.c */
+    CK_BBOOL use_login_broker;
+    struct login_broker *login_broker; /* see login_broker.h */
+    pid_t fork_shm_ref_pid; /* forked child with its own shm reference */
 };
 
 #endif
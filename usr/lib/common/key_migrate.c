@@ -0,0 +1,404 @@
+/*
+ * COPYRIGHT (c) International Business Machines Corp. 2024
+ *
+ * This program is provided under the terms of the Common Public License,
+ * version 1.0 (CPL-1.0). Any use, reproduction or distribution for this
+ * software constitutes recipient's acceptance of CPL-1.0 terms which can be
+ * found in the file LICENSE file or at
+ * https://opensource.org/licenses/cpl1.0.php
+ */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+
+#include "pkcs11types.h"
+#include "key_migrate.h"
+
+#define DIGEST_LEN          32
+#define DIGEST_HEX_LEN      (2 * DIGEST_LEN)
+
+struct key_migrate_run {
+    CK_FUNCTION_LIST *funcs;
+    CK_SLOT_ID slot_id;
+    struct key_migrate_item *items;
+    unsigned long num_items;
+    key_migrate_func_t func;
+    void *ctx;
+    const struct key_migrate_opts *opts;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    unsigned long next;             /* next item to hand out */
+    unsigned long done;             /* items finished (any status) */
+    unsigned int active;            /* running workers */
+    FILE *checkpoint;
+
+    /* digests listed in the checkpoint file, sorted */
+    unsigned char (*digests)[DIGEST_LEN];
+    unsigned long num_digests;
+};
+
+static volatile sig_atomic_t key_migrate_stop;
+
+static void key_migrate_signal(int sig)
+{
+    (void)sig;
+    key_migrate_stop = 1;
+}
+
+static double elapsed(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) +
+           (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static int blob_digest(const CK_BYTE *blob, CK_ULONG blob_len,
+                       unsigned char *digest)
+{
+    unsigned int len = DIGEST_LEN;
+
+    if (EVP_Digest(blob, blob_len, digest, &len, EVP_sha256(), NULL) != 1)
+        return -EIO;
+
+    return 0;
+}
+
+static int digest_cmp(const void *a, const void *b)
+{
+    return memcmp(a, b, DIGEST_LEN);
+}
+
+static int parse_digest(const char *line, unsigned char *digest)
+{
+    unsigned int i, byte;
+
+    if (strlen(line) < DIGEST_HEX_LEN)
+        return -EINVAL;
+
+    for (i = 0; i < DIGEST_LEN; i++) {
+        if (sscanf(line + 2 * i, "%2x", &byte) != 1)
+            return -EINVAL;
+        digest[i] = byte;
+    }
+
+    return 0;
+}
+
+/*
+ * Loads the digests of an existing checkpoint file and, unless in dry-run
+ * mode, opens it for appending. Malformed lines, e.g. a partly written last
+ * line, are ignored.
+ */
+static int checkpoint_open(struct key_migrate_run *run, const char *path,
+                           CK_BBOOL append)
+{
+    unsigned char (*digests)[DIGEST_LEN];
+    unsigned long alloc = 0;
+    char line[DIGEST_HEX_LEN + 16];
+    FILE *fp;
+
+    fp = fopen(path, "r");
+    if (fp != NULL) {
+        while (fgets(line, sizeof(line), fp) != NULL) {
+            if (run->num_digests == alloc) {
+                alloc = alloc ? 2 * alloc : 256;
+                digests = realloc(run->digests, alloc * DIGEST_LEN);
+                if (digests == NULL) {
+                    fclose(fp);
+                    return -ENOMEM;
+                }
+                run->digests = digests;
+            }
+            if (parse_digest(line, run->digests[run->num_digests]) == 0)
+                run->num_digests++;
+        }
+        fclose(fp);
+
+        if (run->num_digests > 1)
+            qsort(run->digests, run->num_digests, DIGEST_LEN, digest_cmp);
+    } else if (errno != ENOENT) {
+        return -errno;
+    }
+
+    if (!append)
+        return 0;
+
+    run->checkpoint = fopen(path, "a");
+    if (run->checkpoint == NULL)
+        return -errno;
+
+    return 0;
+}
+
+static CK_BBOOL checkpoint_contains(struct key_migrate_run *run,
+                                    const struct key_migrate_item *item)
+{
+    unsigned char digest[DIGEST_LEN];
+
+    if (run->num_digests == 0)
+        return FALSE;
+    if (blob_digest(item->blob, item->blob_len, digest) != 0)
+        return FALSE;
+
+    return bsearch(digest, run->digests, run->num_digests, DIGEST_LEN,
+                   digest_cmp) != NULL;
+}
+
+/* Must be called with the run mutex held. */
+static void checkpoint_add(struct key_migrate_run *run,
+                           const unsigned char *digest)
+{
+    unsigned int i;
+
+    for (i = 0; i < DIGEST_LEN; i++)
+        fprintf(run->checkpoint, "%02x", digest[i]);
+    fputc('\n', run->checkpoint);
+    fflush(run->checkpoint);
+    fsync(fileno(run->checkpoint));
+}
+
+static int migrate_item(struct key_migrate_run *run, CK_SESSION_HANDLE session,
+                        struct key_migrate_item *item)
+{
+    CK_BYTE *new_blob = NULL;
+    CK_ULONG new_blob_len = 0;
+    CK_ATTRIBUTE attr = { CKA_IBM_OPAQUE, NULL, 0 };
+    unsigned char digest[DIGEST_LEN];
+    CK_RV rv;
+    int rc;
+
+    rc = run->func(run->ctx, item, &new_blob, &new_blob_len);
+    if (rc != 0)
+        return KEY_MIGRATE_FAILED;
+
+    if (run->opts->dry_run) {
+        rc = KEY_MIGRATE_DONE;
+        goto out;
+    }
+
+    /* Compute the digest before the object holds the new blob */
+    if (run->checkpoint != NULL &&
+        blob_digest(new_blob, new_blob_len, digest) != 0) {
+        rc = KEY_MIGRATE_FAILED;
+        goto out;
+    }
+
+    attr.pValue = new_blob;
+    attr.ulValueLen = new_blob_len;
+    rv = run->funcs->C_SetAttributeValue(session, item->handle, &attr, 1);
+    if (rv != CKR_OK) {
+        fprintf(stderr, "C_SetAttributeValue failed for key '%s': 0x%lx\n",
+                item->label ? item->label : "", rv);
+        rc = KEY_MIGRATE_FAILED;
+        goto out;
+    }
+
+    if (run->checkpoint != NULL) {
+        pthread_mutex_lock(&run->mutex);
+        checkpoint_add(run, digest);
+        pthread_mutex_unlock(&run->mutex);
+    }
+    rc = KEY_MIGRATE_DONE;
+
+out:
+    if (new_blob != NULL) {
+        OPENSSL_cleanse(new_blob, new_blob_len);
+        free(new_blob);
+    }
+
+    return rc;
+}
+
+static void *key_migrate_worker(void *arg)
+{
+    struct key_migrate_run *run = arg;
+    struct key_migrate_item *item;
+    CK_SESSION_HANDLE session;
+    CK_RV rv;
+
+    rv = run->funcs->C_OpenSession(run->slot_id,
+                                   CKF_SERIAL_SESSION | CKF_RW_SESSION,
+                                   NULL_PTR, NULL_PTR, &session);
+    if (rv != CKR_OK) {
+        fprintf(stderr, "C_OpenSession failed for a worker: 0x%lx\n", rv);
+        goto out;
+    }
+
+    for (;;) {
+        pthread_mutex_lock(&run->mutex);
+        if (key_migrate_stop || run->next >= run->num_items) {
+            pthread_mutex_unlock(&run->mutex);
+            break;
+        }
+        item = &run->items[run->next++];
+        pthread_mutex_unlock(&run->mutex);
+
+        if (checkpoint_contains(run, item))
+            item->status = KEY_MIGRATE_SKIPPED;
+        else
+            item->status = migrate_item(run, session, item);
+
+        pthread_mutex_lock(&run->mutex);
+        run->done++;
+        pthread_mutex_unlock(&run->mutex);
+    }
+
+    run->funcs->C_CloseSession(session);
+
+out:
+    pthread_mutex_lock(&run->mutex);
+    run->active--;
+    pthread_cond_signal(&run->cond);
+    pthread_mutex_unlock(&run->mutex);
+
+    return NULL;
+}
+
+static void report_progress(struct key_migrate_run *run,
+                            const struct timespec *start)
+{
+    double secs = elapsed(start);
+
+    printf("%lu of %lu keys processed, %.1f keys/s\n", run->done,
+           run->num_items, secs > 0 ? run->done / secs : 0.0);
+    fflush(stdout);
+}
+
+/*
+ * Migrates all items with opts->num_workers parallel sessions. The caller
+ * must be logged in to the slot. Failures of single keys are counted in the
+ * statistics and do not stop the run. Returns 0, or a negative errno value
+ * if the run could not be set up.
+ */
+int key_migrate_run(CK_FUNCTION_LIST *funcs, CK_SLOT_ID slot_id,
+                    struct key_migrate_item *items, unsigned long num_items,
+                    key_migrate_func_t func, void *ctx,
+                    const struct key_migrate_opts *opts,
+                    struct key_migrate_stats *stats)
+{
+    struct key_migrate_run run;
+    struct sigaction sa, old_int, old_term;
+    struct timespec start, deadline;
+    pthread_t *threads;
+    unsigned int num_workers, i, started = 0;
+    unsigned long n;
+    int rc = 0;
+
+    memset(stats, 0, sizeof(*stats));
+    memset(&run, 0, sizeof(run));
+    run.funcs = funcs;
+    run.slot_id = slot_id;
+    run.items = items;
+    run.num_items = num_items;
+    run.func = func;
+    run.ctx = ctx;
+    run.opts = opts;
+
+    num_workers = opts->num_workers > 0 ? opts->num_workers : 1;
+    if (num_workers > num_items)
+        num_workers = num_items > 0 ? num_items : 1;
+
+    threads = calloc(num_workers, sizeof(pthread_t));
+    if (threads == NULL)
+        return -ENOMEM;
+
+    if (opts->checkpoint != NULL) {
+        rc = checkpoint_open(&run, opts->checkpoint, !opts->dry_run);
+        if (rc != 0) {
+            fprintf(stderr, "Cannot open checkpoint file '%s': %s\n",
+                    opts->checkpoint, strerror(-rc));
+            goto out;
+        }
+    }
+
+    for (n = 0; n < num_items; n++)
+        items[n].status = KEY_MIGRATE_PENDING;
+
+    pthread_mutex_init(&run.mutex, NULL);
+    pthread_cond_init(&run.cond, NULL);
+
+    key_migrate_stop = 0;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = key_migrate_signal;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, &old_int);
+    sigaction(SIGTERM, &sa, &old_term);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    pthread_mutex_lock(&run.mutex);
+    for (i = 0; i < num_workers; i++) {
+        if (pthread_create(&threads[i], NULL, key_migrate_worker, &run) != 0)
+            break;
+        run.active++;
+        started++;
+    }
+    if (started == 0) {
+        pthread_mutex_unlock(&run.mutex);
+        rc = -EAGAIN;
+        goto restore;
+    }
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    while (run.active > 0) {
+        if (opts->progress_interval == 0) {
+            pthread_cond_wait(&run.cond, &run.mutex);
+            continue;
+        }
+
+        deadline.tv_sec += opts->progress_interval;
+        while (run.active > 0 &&
+               pthread_cond_timedwait(&run.cond, &run.mutex,
+                                      &deadline) != ETIMEDOUT)
+            ;
+        if (run.active > 0)
+            report_progress(&run, &start);
+    }
+    pthread_mutex_unlock(&run.mutex);
+
+    for (i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+
+    stats->seconds = elapsed(&start);
+    stats->total = num_items;
+    stats->interrupted = key_migrate_stop ? TRUE : FALSE;
+    for (n = 0; n < num_items; n++) {
+        switch (items[n].status) {
+        case KEY_MIGRATE_DONE:
+            stats->migrated++;
+            break;
+        case KEY_MIGRATE_SKIPPED:
+            stats->skipped++;
+            break;
+        case KEY_MIGRATE_FAILED:
+            stats->failed++;
+            break;
+        }
+    }
+
+restore:
+    sigaction(SIGINT, &old_int, NULL);
+    sigaction(SIGTERM, &old_term, NULL);
+    pthread_cond_destroy(&run.cond);
+    pthread_mutex_destroy(&run.mutex);
+out:
+    if (run.checkpoint != NULL)
+        fclose(run.checkpoint);
+    free(run.digests);
+    free(threads);
+
+    return rc;
+}
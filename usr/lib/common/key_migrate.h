@@ -0,0 +1,76 @@
+/*
+ * COPYRIGHT (c) International Business Machines Corp. 2024
+ *
+ * This program is provided under the terms of the Common Public License,
+ * version 1.0 (CPL-1.0). Any use, reproduction or distribution for this
+ * software constitutes recipient's acceptance of CPL-1.0 terms which can be
+ * found in the file LICENSE file or at
+ * https://opensource.org/licenses/cpl1.0.php
+ */
+
+/*
+ * Concurrent re-encipherment of secure key blobs (CKA_IBM_OPAQUE) for the
+ * master key migration tools.
+ *
+ * The objects to migrate are collected by the tool and processed by a pool
+ * of workers, each with its own session to the slot. The sessions share the
+ * login state of the session that the tool logged in with. A worker hands
+ * the current blob to the tool's re-encipher function and writes the new
+ * blob back to the object.
+ *
+ * If a checkpoint file is given, the SHA-256 digest of every blob written
+ * back is appended to it. A later run with the same checkpoint file skips
+ * objects whose blob is listed there, so an interrupted migration can be
+ * resumed. SIGINT and SIGTERM stop the workers after their current object.
+ */
+
+#ifndef _KEY_MIGRATE_H_
+#define _KEY_MIGRATE_H_
+
+#include "pkcs11types.h"
+
+#define KEY_MIGRATE_PENDING     0
+#define KEY_MIGRATE_DONE        1
+#define KEY_MIGRATE_SKIPPED     2   /* listed in the checkpoint file */
+#define KEY_MIGRATE_FAILED      3
+
+struct key_migrate_item {
+    CK_OBJECT_HANDLE handle;
+    CK_KEY_TYPE key_type;
+    CK_BYTE *blob;              /* current CKA_IBM_OPAQUE value */
+    CK_ULONG blob_len;
+    char *label;
+    int status;                 /* KEY_MIGRATE_xxx, set by key_migrate_run */
+};
+
+/*
+ * Re-enciphers the blob of an item. Called concurrently from the workers.
+ * On success returns 0 and a malloc'ed new blob, which is freed by the
+ * caller.
+ */
+typedef int (*key_migrate_func_t)(void *ctx, struct key_migrate_item *item,
+                                  CK_BYTE **new_blob, CK_ULONG *new_blob_len);
+
+struct key_migrate_opts {
+    unsigned int num_workers;       /* parallel sessions, at least 1 */
+    CK_BBOOL dry_run;               /* re-encipher, but do not write back */
+    const char *checkpoint;         /* checkpoint file or NULL */
+    unsigned int progress_interval; /* seconds between reports, 0 = none */
+};
+
+struct key_migrate_stats {
+    unsigned long total;
+    unsigned long migrated;
+    unsigned long skipped;
+    unsigned long failed;
+    CK_BBOOL interrupted;
+    double seconds;
+};
+
+int key_migrate_run(CK_FUNCTION_LIST *funcs, CK_SLOT_ID slot_id,
+                    struct key_migrate_item *items, unsigned long num_items,
+                    key_migrate_func_t func, void *ctx,
+                    const struct key_migrate_opts *opts,
+                    struct key_migrate_stats *stats);
+
+#endif
@@ -659,7 +659,8 @@ static CK_RV save_private_token_object_old(STDLL_TokData_t *tokdata, OBJECT *obj
     CK_ULONG_32 obj_data_len_32;
     CK_ULONG_32 total_len;
 
-    rc = object_flatten(obj, &obj_data, &obj_data_len);
+    rc = object_flatten(obj, &obj_data, &obj_data_len,
+                        tokdata->version >= TOK_OBJECT_RECORDS);
     obj_data_len_32 = obj_data_len;
     if (rc != CKR_OK) {
         goto error;
@@ -1551,7 +1552,8 @@ CK_RV save_public_token_object_old(STDLL_TokData_t *tokdata, OBJECT * obj)
     CK_RV rc;
     CK_ULONG_32 total_len;
 
-    rc = object_flatten(obj, &clear, &clear_len);
+    rc = object_flatten(obj, &clear, &clear_len,
+                        tokdata->version >= TOK_OBJECT_RECORDS);
     if (rc != CKR_OK) {
         goto error;
     }
@@ -2331,7 +2333,8 @@ CK_RV save_private_token_object(STDLL_TokData_t *tokdata, OBJECT *obj)
     sprintf(fname, "%s/%s/", tokdata->data_store, PK_LITE_OBJ_DIR);
     strncat(fname, (char *)obj->name, 8);
 
-    rc = object_flatten(obj, &obj_data, &obj_data_len);
+    rc = object_flatten(obj, &obj_data, &obj_data_len,
+                        tokdata->version >= TOK_OBJECT_RECORDS);
     obj_data_len_32 = obj_data_len;
     if (rc != CKR_OK) {
         goto done;
@@ -2475,7 +2478,13 @@ done:
 //
 // Note: The token lock (XProcLock) must be held when calling this function.
 //
-CK_RV load_private_token_objects(STDLL_TokData_t *tokdata)
+/*
+ * Calls 'fn' with the still encrypted header, data and footer of every
+ * private token object of the new data store. Objects that can not be read
+ * are skipped, an error returned by 'fn' stops the walk.
+ */
+CK_RV for_each_private_token_object(STDLL_TokData_t *tokdata,
+                                    private_token_object_fn fn, void *arg)
 {
     FILE *fp1 = NULL, *fp2 = NULL;
     CK_BYTE *buf = NULL;
@@ -2488,9 +2497,6 @@ CK_RV load_private_token_objects(STDLL_TokData_t *tokdata)
     unsigned char header[HEADER_LEN], footer[FOOTER_LEN];
     uint32_t len;
 
-    if (tokdata->version < TOK_NEW_DATA_STORE)
-        return load_private_token_objects_old(tokdata);
-
     fp1 = open_token_object_index(iname, sizeof(iname), tokdata, "r");
     if (!fp1)
         return CKR_OK;          // no token objects
@@ -2540,9 +2546,7 @@ CK_RV load_private_token_objects(STDLL_TokData_t *tokdata)
             continue;
         }
 
-        rc = restore_private_token_object(tokdata, header,
-                                          buf, size,
-                                          footer, NULL, fname);
+        rc = fn(tokdata, tmp, fname, header, buf, size, footer, arg);
         if (rc != CKR_OK)
             goto error;
 
@@ -2562,6 +2566,64 @@ error:
     return rc;
 }
 
+static CK_RV load_private_token_object_cb(STDLL_TokData_t *tokdata,
+                                          const char *name, const char *fname,
+                                          CK_BYTE *header, CK_BYTE *data,
+                                          CK_ULONG len, CK_BYTE *footer,
+                                          void *arg)
+{
+    UNUSED(name);
+    UNUSED(arg);
+
+    return restore_private_token_object(tokdata, header, data, len, footer,
+                                        NULL, fname);
+}
+
+CK_RV load_private_token_objects(STDLL_TokData_t *tokdata)
+{
+    if (tokdata->version < TOK_NEW_DATA_STORE)
+        return load_private_token_objects_old(tokdata);
+
+    return for_each_private_token_object(tokdata,
+                                         load_private_token_object_cb, NULL);
+}
+
+/*
+ * Decrypts the data of a private token object of the new data store into
+ * 'clear', which must hold 'len' bytes.
+ */
+CK_RV unseal_private_token_object(STDLL_TokData_t *tokdata, CK_BYTE *header,
+                                  CK_BYTE *data, CK_ULONG len,
+                                  CK_BYTE *footer, CK_BYTE *clear)
+{
+    unsigned char obj_iv[12], obj_key[32], obj_key_wrapped[40];
+    CK_RV rc;
+
+    /* wrapped key */
+    memcpy(obj_key_wrapped, header + 8, 40);
+    /* iv */
+    memcpy(obj_iv, header + 48, 12);
+
+    rc = aes_256_unwrap(tokdata, obj_key, obj_key_wrapped, tokdata->master_key);
+    if (rc != CKR_OK) {
+        rc = CKR_FUNCTION_FAILED;
+        goto done;
+    }
+
+    rc = aes_256_gcm_unseal(tokdata,
+                            clear, /* plain-text */
+                            header, HEADER_LEN, /* aad */
+                            data, len, /* cipher-text*/
+                            footer, /* tag */
+                            obj_key, obj_iv);
+    if (rc != CKR_OK)
+        rc = CKR_FUNCTION_FAILED;
+
+done:
+    OPENSSL_cleanse(obj_key, sizeof(obj_key));
+    return rc;
+}
+
 //
 //
 CK_RV restore_private_token_object(STDLL_TokData_t *tokdata,
@@ -2571,7 +2633,6 @@ CK_RV restore_private_token_object(STDLL_TokData_t *tokdata,
                                    OBJECT *pObj,
                                    const char *fname)
 {
-    unsigned char obj_iv[12], obj_key[32], obj_key_wrapped[40];
     CK_BYTE *buff = NULL;
     CK_RV rc;
 
@@ -2579,17 +2640,6 @@ CK_RV restore_private_token_object(STDLL_TokData_t *tokdata,
         return restore_private_token_object_old(tokdata, data, len, pObj,
                                                 fname);
 
-    /* wrapped key */
-    memcpy(obj_key_wrapped, header + 8, 40);
-    /* iv */
-    memcpy(obj_iv, header + 48, 12);
-
-    rc = aes_256_unwrap(tokdata, obj_key, obj_key_wrapped, tokdata->master_key);
-    if (rc != CKR_OK) {
-        rc = CKR_FUNCTION_FAILED;
-        goto done;
-    }
-
     buff = (CK_BYTE *)malloc(len);
     if (buff == NULL) {
         TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
@@ -2597,16 +2647,9 @@ CK_RV restore_private_token_object(STDLL_TokData_t *tokdata,
         goto done;
     }
 
-    rc = aes_256_gcm_unseal(tokdata,
-                            buff, /* plain-text */
-                            header, HEADER_LEN, /* aad */
-                            data, len, /* cipher-text*/
-                            footer, /* tag */
-                            obj_key, obj_iv);
-    if (rc != CKR_OK) {
-        rc = CKR_FUNCTION_FAILED;
+    rc = unseal_private_token_object(tokdata, header, data, len, footer, buff);
+    if (rc != CKR_OK)
         goto done;
-    }
 
     rc = object_mgr_restore_obj(tokdata, buff, pObj, fname);
     if (rc != CKR_OK) {
@@ -2620,6 +2663,23 @@ done:
     return rc;
 }
 
+/*
+ * Restores a private token object from its decrypted data, as provided by
+ * unseal_private_token_object(). 'name' is the object's file name.
+ */
+CK_RV restore_private_token_object_data(STDLL_TokData_t *tokdata,
+                                        const char *name, CK_BYTE *data,
+                                        CK_ULONG len)
+{
+    char fname[PATH_MAX];
+
+    if (get_token_object_path(fname, sizeof(fname), tokdata,
+                              (char *)name) < 0)
+        return CKR_FUNCTION_FAILED;
+
+    return object_mgr_restore_obj_withSize(tokdata, data, NULL, len, fname);
+}
+
 CK_RV reload_token_object(STDLL_TokData_t *tokdata, OBJECT *obj)
 {
     unsigned char header[HEADER_LEN], footer[FOOTER_LEN];
@@ -2744,7 +2804,8 @@ CK_RV save_public_token_object(STDLL_TokData_t *tokdata, OBJECT *obj)
     if (tokdata->version < TOK_NEW_DATA_STORE)
         return save_public_token_object_old(tokdata, obj);
 
-    rc = object_flatten(obj, &clear, &clear_len);
+    rc = object_flatten(obj, &clear, &clear_len,
+                        tokdata->version >= TOK_OBJECT_RECORDS);
     if (rc != CKR_OK) {
         goto done;
     }
@@ -425,6 +425,39 @@ void bt_for_each_node(STDLL_TokData_t *tokdata, struct btree *t, void (*func)
     }
 }
 
+/* bt_for_each_node_from
+ *
+ * Like bt_for_each_node, but starts at node number @start and stops after
+ * the first node for which @func returns non-zero. Returns the node number to
+ * continue with, or 0 if the end of the tree has been reached.
+ */
+unsigned long bt_for_each_node_from(STDLL_TokData_t *tokdata, struct btree *t,
+                                    unsigned long start,
+                                    int (*func)(STDLL_TokData_t *tokdata,
+                                                void *p1, unsigned long p2,
+                                                void *p3), void *p3)
+{
+    unsigned long i;
+    void *value;
+    int stop;
+
+    for (i = start; i < t->size + 1; i++) {
+        value = bt_get_node_value(t, i);
+
+        if (value) {
+            stop = (*func) (tokdata, value, i, p3);
+
+            bt_put_node_value(t, value);
+            value = NULL;
+
+            if (stop)
+                return i + 1;
+        }
+    }
+
+    return 0;
+}
+
 /* bt_destroy
  *
  * Walk a binary tree backwards (largest index to smallest), deleting nodes
@@ -0,0 +1,775 @@
+/*
+ * COPYRIGHT (c) International Business Machines Corp. 2024
+ *
+ * This program is provided under the terms of the Common Public License,
+ * version 1.0 (CPL-1.0). Any use, reproduction or distribution for this
+ * software constitutes recipient's acceptance of CPL-1.0 terms which can be
+ * found in the file LICENSE file or at
+ * https://opensource.org/licenses/cpl1.0.php
+ */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include <openssl/crypto.h>
+
+#include "pkcs11types.h"
+#include "defs.h"
+#include "host_defs.h"
+#include "h_extern.h"
+#include "trace.h"
+#include "secure_arena.h"
+#include "login_broker.h"
+
+#define LOGIN_BROKER_SOCKET     "LOGIN_BROKER"
+#define LOGIN_BROKER_VERSION    1
+#define LOGIN_BROKER_TIMEOUT    5       /* seconds */
+#define LOGIN_BROKER_NAME_LEN   32
+#define LOGIN_BROKER_MAX_OBJ    (16 * 1024 * 1024)
+#define LOGIN_BROKER_SALT_LEN   32
+#define LOGIN_BROKER_FAIL_DELAY 1000    /* milliseconds */
+
+struct login_broker_request {
+    uint32_t version;
+    uint32_t pin_len;
+    CK_BYTE pin[MAX_PIN_LEN];
+};
+
+/* Followed by num_objs objects, each a login_broker_record and its data */
+struct login_broker_reply {
+    uint32_t version;
+    uint32_t num_objs;
+    CK_RV rc;
+    CK_ULONG_32 seq;
+    CK_BYTE wrap_key[32];
+    CK_BYTE master_key[MAX_KEY_SIZE];
+};
+
+struct login_broker_record {
+    char name[LOGIN_BROKER_NAME_LEN];
+    uint32_t len;
+};
+
+struct login_broker_obj {
+    char name[LOGIN_BROKER_NAME_LEN];
+    CK_BYTE *data;
+    CK_ULONG len;
+};
+
+struct login_broker {
+    STDLL_TokData_t *tokdata;
+    pid_t pid;
+    pthread_t thread;
+    int listen_fd;
+    int wakeup_fd[2];
+    dev_t dev;
+    ino_t ino;
+    char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+    CK_BYTE pin_salt[LOGIN_BROKER_SALT_LEN];
+    CK_BYTE pin_hash[SHA256_HASH_SIZE];
+    CK_BYTE login_key[32];
+#if OPENSSL_VERSION_PREREQ(3, 0)
+    OSSL_LIB_CTX *libctx;
+#endif
+    /* Snapshot of the decrypted private token objects, see tok_obj_seq */
+    struct login_broker_obj *objs;
+    CK_ULONG num_objs;
+    CK_ULONG max_objs;
+    CK_ULONG_32 seq;
+    CK_BBOOL valid;
+};
+
+/*
+ * Decrypted objects are kept in the secure arena if possible, and are
+ * cleansed before they are released in any case.
+ */
+static CK_BYTE *login_broker_alloc(CK_ULONG len)
+{
+    CK_BYTE *ptr;
+
+    ptr = secure_arena_alloc(len);
+    if (ptr == NULL)
+        ptr = malloc(len);
+
+    return ptr;
+}
+
+static void login_broker_free_objs(struct login_broker_obj *objs,
+                                   CK_ULONG num_objs)
+{
+    CK_ULONG i;
+
+    for (i = 0; i < num_objs; i++) {
+        if (secure_arena_owns(objs[i].data)) {
+            secure_arena_free(objs[i].data);
+        } else if (objs[i].data != NULL) {
+            OPENSSL_cleanse(objs[i].data, objs[i].len);
+            free(objs[i].data);
+        }
+        objs[i].data = NULL;
+    }
+}
+
+static int login_broker_path(STDLL_TokData_t *tokdata, char *path,
+                             size_t path_len)
+{
+    if (ock_snprintf(path, path_len, "%s/%s", tokdata->data_store,
+                     LOGIN_BROKER_SOCKET) != 0) {
+        TRACE_DEVEL("Login broker socket path too long\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+static CK_RV login_broker_pin_hash(STDLL_TokData_t *tokdata,
+                                   const CK_BYTE *salt, CK_CHAR_PTR pin,
+                                   CK_ULONG pin_len, CK_BYTE *hash)
+{
+    CK_BYTE buf[LOGIN_BROKER_SALT_LEN + MAX_PIN_LEN];
+    CK_RV rc;
+
+    memcpy(buf, salt, LOGIN_BROKER_SALT_LEN);
+    memcpy(buf + LOGIN_BROKER_SALT_LEN, pin, pin_len);
+    rc = compute_sha(tokdata, buf, LOGIN_BROKER_SALT_LEN + pin_len, hash,
+                     CKM_SHA256);
+    OPENSSL_cleanse(buf, sizeof(buf));
+
+    return rc;
+}
+
+static int login_broker_io(int fd, void *buf, size_t len, CK_BBOOL out)
+{
+    CK_BYTE *ptr = buf;
+    ssize_t n;
+
+    while (len > 0) {
+        if (out)
+            n = send(fd, ptr, len, MSG_NOSIGNAL);
+        else
+            n = recv(fd, ptr, len, 0);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        ptr += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+/* Both ends only talk to a peer running with their own effective user ID */
+static int login_broker_setup_peer(int fd)
+{
+    struct timeval tv = { LOGIN_BROKER_TIMEOUT, 0 };
+    struct ucred cred;
+    socklen_t len = sizeof(cred);
+
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0) {
+        TRACE_DEVEL("getsockopt(SO_PEERCRED) failed: %s\n", strerror(errno));
+        return -1;
+    }
+    if (cred.uid != geteuid()) {
+        TRACE_WARNING("Login broker peer with pid %d has uid %u, rejected\n",
+                      cred.pid, cred.uid);
+        return -1;
+    }
+
+    if (setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv)) != 0 ||
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv)) != 0) {
+        TRACE_DEVEL("setsockopt failed: %s\n", strerror(errno));
+        return -1;
+    }
+
+    return 0;
+}
+
+static CK_RV login_broker_add_obj(STDLL_TokData_t *tokdata, const char *name,
+                                  const char *fname, CK_BYTE *header,
+                                  CK_BYTE *data, CK_ULONG len,
+                                  CK_BYTE *footer, void *arg)
+{
+    struct login_broker *broker = arg;
+    struct login_broker_obj *objs, *obj;
+    CK_ULONG max;
+    CK_RV rc;
+
+    UNUSED(fname);
+
+    if (strlen(name) >= LOGIN_BROKER_NAME_LEN || len > LOGIN_BROKER_MAX_OBJ) {
+        TRACE_DEVEL("Token object %s not supported by the login broker\n",
+                    name);
+        return CKR_FUNCTION_FAILED;
+    }
+
+    if (broker->num_objs == broker->max_objs) {
+        max = broker->max_objs > 0 ? 2 * broker->max_objs : 64;
+        objs = realloc(broker->objs, max * sizeof(*objs));
+        if (objs == NULL) {
+            TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
+            return CKR_HOST_MEMORY;
+        }
+        broker->objs = objs;
+        broker->max_objs = max;
+    }
+
+    obj = &broker->objs[broker->num_objs];
+    obj->data = login_broker_alloc(len);
+    if (obj->data == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
+        return CKR_HOST_MEMORY;
+    }
+    obj->len = len;
+    strcpy(obj->name, name);
+    broker->num_objs++;
+
+    rc = unseal_private_token_object(tokdata, header, data, len, footer,
+                                     obj->data);
+    if (rc != CKR_OK)
+        TRACE_DEVEL("Failed to decrypt token object %s\n", name);
+
+    return rc;
+}
+
+/*
+ * Rebuilds the snapshot if the token objects changed since it was taken.
+ * Fails if the PIN was changed since the broker was started.
+ */
+static CK_RV login_broker_refresh(STDLL_TokData_t *tokdata,
+                                  struct login_broker *broker)
+{
+    CK_ULONG_32 seq;
+    CK_RV rc;
+
+    rc = XProcLock(tokdata);
+    if (rc != CKR_OK) {
+        TRACE_ERROR("Failed to get process lock.\n");
+        return rc;
+    }
+
+    if (CRYPTO_memcmp(tokdata->nv_token_data->dat.user_login_key,
+                      broker->login_key, sizeof(broker->login_key)) != 0) {
+        TRACE_DEVEL("User PIN changed, login broker requests refused\n");
+        rc = CKR_FUNCTION_FAILED;
+        goto unlock;
+    }
+
+    seq = __atomic_load_n(&tokdata->global_shm->tok_obj_seq, __ATOMIC_ACQUIRE);
+    if (broker->valid && broker->seq == seq)
+        goto unlock;
+
+    login_broker_free_objs(broker->objs, broker->num_objs);
+    broker->num_objs = 0;
+    broker->valid = FALSE;
+
+    rc = for_each_private_token_object(tokdata, login_broker_add_obj, broker);
+    if (rc != CKR_OK) {
+        login_broker_free_objs(broker->objs, broker->num_objs);
+        broker->num_objs = 0;
+        goto unlock;
+    }
+
+    broker->seq = seq;
+    broker->valid = TRUE;
+    TRACE_DEVEL("Login broker snapshot of %lu objects taken at seq %u\n",
+                broker->num_objs, seq);
+
+unlock:
+    if (XProcUnLock(tokdata) != CKR_OK) {
+        TRACE_ERROR("Failed to release process lock.\n");
+        rc = CKR_CANT_LOCK;
+    }
+
+    return rc;
+}
+
+/*
+ * Verifies the PIN of a request. Wrong PINs are counted in the token flags
+ * like those of C_Login, and no PIN is accepted once the user PIN is locked.
+ * Returns CKR_FUNCTION_FAILED if the PIN was changed since the broker was
+ * started, so that the client falls back to the regular login.
+ */
+static CK_RV login_broker_check_pin(STDLL_TokData_t *tokdata,
+                                    struct login_broker *broker,
+                                    CK_CHAR_PTR pin, CK_ULONG pin_len)
+{
+    CK_FLAGS_32 *flags = &tokdata->nv_token_data->token_info.flags;
+    CK_BYTE hash[SHA256_HASH_SIZE];
+    CK_RV rc;
+
+    rc = XProcLock(tokdata);
+    if (rc != CKR_OK) {
+        TRACE_ERROR("Failed to get process lock.\n");
+        return rc;
+    }
+
+    if (*flags & CKF_USER_PIN_LOCKED) {
+        TRACE_DEVEL("User PIN locked, login broker requests refused\n");
+        rc = CKR_PIN_LOCKED;
+        goto unlock;
+    }
+
+    if (CRYPTO_memcmp(tokdata->nv_token_data->dat.user_login_key,
+                      broker->login_key, sizeof(broker->login_key)) != 0) {
+        TRACE_DEVEL("User PIN changed, login broker requests refused\n");
+        rc = CKR_FUNCTION_FAILED;
+        goto unlock;
+    }
+
+    rc = login_broker_pin_hash(tokdata, broker->pin_salt, pin, pin_len, hash);
+    if (rc != CKR_OK)
+        goto unlock;
+
+    if (CRYPTO_memcmp(hash, broker->pin_hash, sizeof(hash)) != 0) {
+        TRACE_DEVEL("Login broker request with a wrong PIN\n");
+        set_login_flags(CKU_USER, flags);
+        if (save_token_data(tokdata, tokdata->slot_id) != CKR_OK)
+            TRACE_DEVEL("Failed to save the login flags\n");
+        rc = CKR_PIN_INCORRECT;
+    }
+
+unlock:
+    if (XProcUnLock(tokdata) != CKR_OK) {
+        TRACE_ERROR("Failed to release process lock.\n");
+        rc = CKR_CANT_LOCK;
+    }
+    OPENSSL_cleanse(hash, sizeof(hash));
+
+    return rc;
+}
+
+/* Serves one request per connection, returns the result of the request */
+static CK_RV login_broker_serve(STDLL_TokData_t *tokdata,
+                                struct login_broker *broker, int fd)
+{
+    struct login_broker_request req;
+    struct login_broker_reply reply;
+    struct login_broker_record rec;
+    CK_ULONG i;
+    CK_RV rc;
+
+    memset(&reply, 0, sizeof(reply));
+    reply.version = LOGIN_BROKER_VERSION;
+
+    if (login_broker_setup_peer(fd) != 0)
+        return CKR_FUNCTION_FAILED;
+    if (login_broker_io(fd, &req, sizeof(req), FALSE) != 0) {
+        reply.rc = CKR_FUNCTION_FAILED;
+        goto out;
+    }
+
+    if (req.version != LOGIN_BROKER_VERSION || req.pin_len > MAX_PIN_LEN) {
+        reply.rc = CKR_ARGUMENTS_BAD;
+        goto reply;
+    }
+
+    reply.rc = login_broker_check_pin(tokdata, broker, req.pin, req.pin_len);
+    if (reply.rc != CKR_OK)
+        goto reply;
+
+    reply.rc = login_broker_refresh(tokdata, broker);
+    if (reply.rc != CKR_OK)
+        goto reply;
+
+    reply.num_objs = broker->num_objs;
+    reply.seq = broker->seq;
+    memcpy(reply.wrap_key, tokdata->user_wrap_key, sizeof(reply.wrap_key));
+    memcpy(reply.master_key, tokdata->master_key, sizeof(reply.master_key));
+
+reply:
+    if (login_broker_io(fd, &reply, sizeof(reply), TRUE) != 0 ||
+        reply.rc != CKR_OK)
+        goto out;
+
+    for (i = 0; i < broker->num_objs; i++) {
+        memset(&rec, 0, sizeof(rec));
+        strcpy(rec.name, broker->objs[i].name);
+        rec.len = broker->objs[i].len;
+        if (login_broker_io(fd, &rec, sizeof(rec), TRUE) != 0 ||
+            login_broker_io(fd, broker->objs[i].data, rec.len, TRUE) != 0)
+            break;
+    }
+
+out:
+    rc = reply.rc;
+    OPENSSL_cleanse(&req, sizeof(req));
+    OPENSSL_cleanse(&reply, sizeof(reply));
+
+    return rc;
+}
+
+static void *login_broker_thread(void *arg)
+{
+    struct login_broker *broker = arg;
+    STDLL_TokData_t *tokdata = broker->tokdata;
+    struct pollfd pfd[2];
+    int fd;
+    CK_RV rc;
+#if OPENSSL_VERSION_PREREQ(3, 0)
+    OSSL_LIB_CTX *prev_libctx;
+
+    /* Decrypt the objects within the library context of the token */
+    prev_libctx = OSSL_LIB_CTX_set0_default(broker->libctx);
+    if (prev_libctx == NULL) {
+        TRACE_ERROR("OSSL_LIB_CTX_set0_default failed\n");
+        return NULL;
+    }
+#endif
+
+    pfd[0].fd = broker->listen_fd;
+    pfd[0].events = POLLIN;
+    pfd[1].fd = broker->wakeup_fd[0];
+    pfd[1].events = POLLIN;
+
+    while (1) {
+        if (poll(pfd, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            TRACE_ERROR("Login broker poll failed: %s\n", strerror(errno));
+            break;
+        }
+        if (pfd[1].revents != 0)
+            break;
+        if (!(pfd[0].revents & POLLIN))
+            continue;
+
+        fd = accept4(broker->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0)
+            continue;
+        rc = login_broker_serve(tokdata, broker, fd);
+        close(fd);
+
+        /* Slow down PIN guessing, but stop at once when asked to */
+        if (rc == CKR_PIN_INCORRECT &&
+            poll(&pfd[1], 1, LOGIN_BROKER_FAIL_DELAY) != 0)
+            break;
+    }
+
+#if OPENSSL_VERSION_PREREQ(3, 0)
+    OSSL_LIB_CTX_set0_default(prev_libctx);
+#endif
+
+    return NULL;
+}
+
+static int login_broker_connect(const char *path)
+{
+    struct sockaddr_un addr;
+    int fd;
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+CK_RV login_broker_attach(STDLL_TokData_t *tokdata, CK_CHAR_PTR pin,
+                          CK_ULONG pin_len)
+{
+    struct login_broker_request req;
+    struct login_broker_reply reply;
+    struct login_broker_record rec;
+    struct login_broker_obj *objs = NULL;
+    char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+    CK_ULONG i, num_objs = 0;
+    CK_RV rc = CKR_FUNCTION_FAILED;
+    int fd;
+
+    if (!tokdata->use_login_broker ||
+        tokdata->version < TOK_NEW_DATA_STORE || pin_len > MAX_PIN_LEN)
+        return CKR_FUNCTION_NOT_SUPPORTED;
+
+    if (login_broker_path(tokdata, path, sizeof(path)) != 0)
+        return CKR_FUNCTION_FAILED;
+
+    fd = login_broker_connect(path);
+    if (fd < 0) {
+        TRACE_DEVEL("No login broker for this token\n");
+        return CKR_FUNCTION_FAILED;
+    }
+
+    memset(&req, 0, sizeof(req));
+    memset(&reply, 0, sizeof(reply));
+    if (login_broker_setup_peer(fd) != 0)
+        goto out;
+
+    req.version = LOGIN_BROKER_VERSION;
+    req.pin_len = pin_len;
+    memcpy(req.pin, pin, pin_len);
+    if (login_broker_io(fd, &req, sizeof(req), TRUE) != 0 ||
+        login_broker_io(fd, &reply, sizeof(reply), FALSE) != 0)
+        goto out;
+
+    if (reply.version != LOGIN_BROKER_VERSION || reply.rc != CKR_OK ||
+        reply.num_objs > MAX_TOK_OBJS) {
+        TRACE_DEVEL("Login broker refused the login: 0x%lx\n", reply.rc);
+        /* The broker has counted the wrong PIN already */
+        if (reply.version == LOGIN_BROKER_VERSION &&
+            (reply.rc == CKR_PIN_INCORRECT || reply.rc == CKR_PIN_LOCKED))
+            rc = reply.rc;
+        goto out;
+    }
+
+    objs = calloc(reply.num_objs > 0 ? reply.num_objs : 1, sizeof(*objs));
+    if (objs == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
+        goto out;
+    }
+
+    for (num_objs = 0; num_objs < reply.num_objs; num_objs++) {
+        if (login_broker_io(fd, &rec, sizeof(rec), FALSE) != 0 ||
+            rec.len > LOGIN_BROKER_MAX_OBJ ||
+            memchr(rec.name, 0, sizeof(rec.name)) == NULL)
+            goto out;
+
+        objs[num_objs].data = login_broker_alloc(rec.len);
+        if (objs[num_objs].data == NULL) {
+            TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
+            goto out;
+        }
+        objs[num_objs].len = rec.len;
+        strcpy(objs[num_objs].name, rec.name);
+        if (login_broker_io(fd, objs[num_objs].data, rec.len, FALSE) != 0) {
+            num_objs++;
+            goto out;
+        }
+    }
+
+    memcpy(tokdata->user_wrap_key, reply.wrap_key, sizeof(reply.wrap_key));
+    memset(tokdata->so_wrap_key, 0, sizeof(tokdata->so_wrap_key));
+    memcpy(tokdata->master_key, reply.master_key, sizeof(reply.master_key));
+
+    rc = XProcLock(tokdata);
+    if (rc != CKR_OK) {
+        TRACE_ERROR("Failed to get process lock.\n");
+        goto out;
+    }
+
+    /*
+     * The snapshot is only used if no token object was changed since the
+     * broker took it, otherwise the objects are loaded from the data store.
+     * As with load_private_token_objects(), errors are not fatal.
+     */
+    if (__atomic_load_n(&tokdata->global_shm->tok_obj_seq,
+                        __ATOMIC_ACQUIRE) == reply.seq) {
+        for (i = 0; i < num_objs; i++) {
+            if (restore_private_token_object_data(tokdata, objs[i].name,
+                                                  objs[i].data,
+                                                  objs[i].len) != CKR_OK) {
+                TRACE_DEVEL("Failed to restore token object %s\n",
+                            objs[i].name);
+                break;
+            }
+        }
+    } else {
+        TRACE_DEVEL("Login broker snapshot outdated, loading the objects\n");
+        load_private_token_objects(tokdata);
+    }
+
+    tokdata->global_shm->priv_loaded = TRUE;
+
+    rc = XProcUnLock(tokdata);
+    if (rc != CKR_OK)
+        TRACE_ERROR("Failed to release process lock.\n");
+    else
+        TRACE_INFO("Logged in through the login broker\n");
+
+out:
+    if (objs != NULL) {
+        login_broker_free_objs(objs, num_objs);
+        free(objs);
+    }
+    OPENSSL_cleanse(&req, sizeof(req));
+    OPENSSL_cleanse(&reply, sizeof(reply));
+    close(fd);
+
+    return rc;
+}
+
+static void login_broker_free(struct login_broker *broker)
+{
+    login_broker_free_objs(broker->objs, broker->num_objs);
+    free(broker->objs);
+    OPENSSL_cleanse(broker, sizeof(*broker));
+    free(broker);
+}
+
+/* Binds the broker socket, unless a broker is already serving the token */
+static int login_broker_listen(STDLL_TokData_t *tokdata,
+                               struct login_broker *broker)
+{
+    struct sockaddr_un addr;
+    struct stat sb;
+    int fd, other;
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        TRACE_ERROR("socket failed: %s\n", strerror(errno));
+        return -1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, broker->path);
+
+    if (XProcLock(tokdata) != CKR_OK) {
+        TRACE_ERROR("Failed to get process lock.\n");
+        close(fd);
+        return -1;
+    }
+
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        if (errno != EADDRINUSE)
+            goto error;
+
+        /* A socket nobody listens on is left over from a crashed broker */
+        other = login_broker_connect(broker->path);
+        if (other >= 0) {
+            close(other);
+            TRACE_DEVEL("A login broker already serves this token\n");
+            goto error_quiet;
+        }
+        unlink(broker->path);
+        if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+            goto error;
+    }
+
+    if (chmod(broker->path, S_IRUSR | S_IWUSR) != 0 ||
+        stat(broker->path, &sb) != 0 || listen(fd, SOMAXCONN) != 0) {
+        unlink(broker->path);
+        goto error;
+    }
+    broker->dev = sb.st_dev;
+    broker->ino = sb.st_ino;
+
+    XProcUnLock(tokdata);
+
+    return fd;
+
+error:
+    TRACE_ERROR("Login broker socket %s: %s\n", broker->path, strerror(errno));
+error_quiet:
+    XProcUnLock(tokdata);
+    close(fd);
+
+    return -1;
+}
+
+void login_broker_start(STDLL_TokData_t *tokdata, CK_CHAR_PTR pin,
+                        CK_ULONG pin_len)
+{
+    struct login_broker *broker;
+    int rc;
+
+    if (!tokdata->use_login_broker || tokdata->login_broker != NULL ||
+        tokdata->version < TOK_NEW_DATA_STORE || pin_len > MAX_PIN_LEN)
+        return;
+
+    broker = calloc(1, sizeof(*broker));
+    if (broker == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
+        return;
+    }
+    broker->tokdata = tokdata;
+    broker->pid = getpid();
+    broker->listen_fd = -1;
+    broker->wakeup_fd[0] = -1;
+    broker->wakeup_fd[1] = -1;
+
+    if (login_broker_path(tokdata, broker->path, sizeof(broker->path)) != 0)
+        goto error;
+
+    if (rng_generate(tokdata, broker->pin_salt,
+                     sizeof(broker->pin_salt)) != CKR_OK ||
+        login_broker_pin_hash(tokdata, broker->pin_salt, pin, pin_len,
+                              broker->pin_hash) != CKR_OK)
+        goto error;
+    memcpy(broker->login_key, tokdata->nv_token_data->dat.user_login_key,
+           sizeof(broker->login_key));
+
+    if (pipe2(broker->wakeup_fd, O_CLOEXEC) != 0) {
+        TRACE_ERROR("pipe2 failed: %s\n", strerror(errno));
+        goto error;
+    }
+
+    broker->listen_fd = login_broker_listen(tokdata, broker);
+    if (broker->listen_fd < 0)
+        goto error;
+
+#if OPENSSL_VERSION_PREREQ(3, 0)
+    /* The caller runs within Opencryptoki's own library context */
+    broker->libctx = OSSL_LIB_CTX_set0_default(NULL);
+#endif
+
+    rc = pthread_create(&broker->thread, NULL, login_broker_thread, broker);
+    if (rc != 0) {
+        TRACE_ERROR("Failed to start the login broker thread, errno=%d\n", rc);
+        unlink(broker->path);
+        goto error;
+    }
+    tokdata->login_broker = broker;
+
+    TRACE_INFO("Login broker started on %s\n", broker->path);
+    return;
+
+error:
+    if (broker->listen_fd >= 0)
+        close(broker->listen_fd);
+    if (broker->wakeup_fd[0] >= 0) {
+        close(broker->wakeup_fd[0]);
+        close(broker->wakeup_fd[1]);
+    }
+    login_broker_free(broker);
+}
+
+/*
+ * In a forked child only the inherited descriptors and memory are released,
+ * the broker thread and its socket belong to the parent.
+ */
+void login_broker_stop(STDLL_TokData_t *tokdata)
+{
+    struct login_broker *broker = tokdata->login_broker;
+    struct stat sb;
+
+    if (broker == NULL)
+        return;
+    tokdata->login_broker = NULL;
+
+    if (broker->pid == getpid()) {
+        if (write(broker->wakeup_fd[1], "", 1) != 1)
+            TRACE_ERROR("Failed to wake up the login broker thread\n");
+        pthread_join(broker->thread, NULL);
+
+        if (stat(broker->path, &sb) == 0 &&
+            sb.st_dev == broker->dev && sb.st_ino == broker->ino)
+            unlink(broker->path);
+        TRACE_INFO("Login broker stopped\n");
+    }
+
+    close(broker->listen_fd);
+    close(broker->wakeup_fd[0]);
+    close(broker->wakeup_fd[1]);
+    login_broker_free(broker);
+}
@@ -0,0 +1,40 @@
+/*
+ * COPYRIGHT (c) International Business Machines Corp. 2024
+ *
+ * This program is provided under the terms of the Common Public License,
+ * version 1.0 (CPL-1.0). Any use, reproduction or distribution for this
+ * software constitutes recipient's acceptance of CPL-1.0 terms which can be
+ * found in the file LICENSE file or at
+ * https://opensource.org/licenses/cpl1.0.php
+ */
+
+#ifndef __LOGIN_BROKER_H
+#define __LOGIN_BROKER_H
+
+#include "pkcs11types.h"
+#include "host_defs.h"
+
+/*
+ * Opt-in login broker for the USER login of tokens with the new data store.
+ *
+ * The first process that logs in with the full PIN verification starts a
+ * broker thread, which listens on a Unix socket in the token directory.
+ * Later logins of processes running with the same effective user ID send
+ * their PIN to the broker instead of deriving the keys with PBKDF2. The
+ * broker compares it against a salted hash of the PIN it was started with,
+ * and replies with the wrap key, the master key and a snapshot of the
+ * decrypted private token objects. The snapshot is built under the XProcLock
+ * and is only used by the client if the token objects did not change since.
+ * Wrong PINs are counted in the token flags as with the regular login, and
+ * are returned as CKR_PIN_INCORRECT or CKR_PIN_LOCKED. Any other failure
+ * makes the client fall back to the regular login.
+ *
+ * The broker is stopped when its process logs out or finalizes the token.
+ */
+CK_RV login_broker_attach(STDLL_TokData_t *tokdata, CK_CHAR_PTR pin,
+                          CK_ULONG pin_len);
+void login_broker_start(STDLL_TokData_t *tokdata, CK_CHAR_PTR pin,
+                        CK_ULONG pin_len);
+void login_broker_stop(STDLL_TokData_t *tokdata);
+
+#endif                          /* __LOGIN_BROKER_H */
@@ -3485,6 +3485,146 @@ void aes_gcm_param_from_compat(const CK_GCM_PARAMS_COMPAT *from,
     to->ulTagBits = from->ulTagBits;
 }
 
+CK_RV aes_gcm_msg_init(STDLL_TokData_t *tokdata, SESSION *sess,
+                       ENCR_DECR_CONTEXT *ctx, CK_OBJECT_HANDLE key,
+                       CK_BYTE direction)
+{
+    if (token_specific.t_aes_gcm_msg_init == NULL ||
+        token_specific.t_aes_gcm_msg == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_MECHANISM_INVALID));
+        return CKR_MECHANISM_INVALID;
+    }
+
+    return token_specific.t_aes_gcm_msg_init(tokdata, sess, ctx, key,
+                                             direction);
+}
+
+static CK_RV aes_gcm_msg_param(void *param, CK_ULONG param_len,
+                               CK_GCM_MESSAGE_PARAMS **gcm_param)
+{
+    CK_GCM_MESSAGE_PARAMS *p = param;
+
+    if (p == NULL || param_len != sizeof(CK_GCM_MESSAGE_PARAMS)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_MECHANISM_PARAM_INVALID));
+        return CKR_MECHANISM_PARAM_INVALID;
+    }
+
+    if (p->pIv == NULL || p->ulIvLen == 0 || p->pTag == NULL ||
+        p->ulTagBits == 0 || p->ulTagBits % 8 != 0 ||
+        p->ulTagBits > AES_BLOCK_SIZE * 8) {
+        TRACE_ERROR("%s\n", ock_err(ERR_MECHANISM_PARAM_INVALID));
+        return CKR_MECHANISM_PARAM_INVALID;
+    }
+
+    *gcm_param = p;
+    return CKR_OK;
+}
+
+CK_RV aes_gcm_encrypt_msg(STDLL_TokData_t *tokdata, SESSION *sess,
+                          CK_BBOOL length_only, ENCR_DECR_CONTEXT *ctx,
+                          void *param, CK_ULONG param_len,
+                          CK_BYTE *aad, CK_ULONG aad_len,
+                          CK_BYTE *in_data, CK_ULONG in_data_len,
+                          CK_BYTE *out_data, CK_ULONG *out_data_len)
+{
+    CK_GCM_MESSAGE_PARAMS *gcm_param;
+    CK_ULONG fixed_len;
+    CK_RV rc;
+
+    if (!sess || !ctx || !out_data_len) {
+        TRACE_ERROR("%s received bad argument(s)\n", __func__);
+        return CKR_FUNCTION_FAILED;
+    }
+
+    rc = aes_gcm_msg_param(param, param_len, &gcm_param);
+    if (rc != CKR_OK)
+        return rc;
+
+    if (length_only == TRUE) {
+        *out_data_len = in_data_len;
+        return CKR_OK;
+    }
+
+    if (*out_data_len < in_data_len) {
+        *out_data_len = in_data_len;
+        TRACE_ERROR("%s\n", ock_err(ERR_BUFFER_TOO_SMALL));
+        return CKR_BUFFER_TOO_SMALL;
+    }
+
+    switch (gcm_param->ivGenerator) {
+    case CKG_NO_GENERATE:
+        break;
+    case CKG_GENERATE_RANDOM:
+        /* The leading ulIvFixedBits are kept, the rest is random */
+        fixed_len = gcm_param->ulIvFixedBits / 8;
+        if (gcm_param->ulIvFixedBits % 8 != 0 ||
+            fixed_len >= gcm_param->ulIvLen) {
+            TRACE_ERROR("%s\n", ock_err(ERR_MECHANISM_PARAM_INVALID));
+            return CKR_MECHANISM_PARAM_INVALID;
+        }
+        rc = rng_generate(tokdata, gcm_param->pIv + fixed_len,
+                          gcm_param->ulIvLen - fixed_len);
+        if (rc != CKR_OK) {
+            TRACE_DEVEL("rng_generate failed.\n");
+            return rc;
+        }
+        break;
+    default:
+        TRACE_ERROR("IV generator 0x%lx not supported\n",
+                    gcm_param->ivGenerator);
+        return CKR_MECHANISM_PARAM_INVALID;
+    }
+
+    rc = token_specific.t_aes_gcm_msg(tokdata, sess, ctx, gcm_param,
+                                      aad, aad_len, in_data, in_data_len,
+                                      out_data, out_data_len, 1);
+    if (rc != CKR_OK)
+        TRACE_ERROR("Token specific aes gcm message encrypt failed: %02lx\n",
+                    rc);
+
+    return rc;
+}
+
+CK_RV aes_gcm_decrypt_msg(STDLL_TokData_t *tokdata, SESSION *sess,
+                          CK_BBOOL length_only, ENCR_DECR_CONTEXT *ctx,
+                          void *param, CK_ULONG param_len,
+                          CK_BYTE *aad, CK_ULONG aad_len,
+                          CK_BYTE *in_data, CK_ULONG in_data_len,
+                          CK_BYTE *out_data, CK_ULONG *out_data_len)
+{
+    CK_GCM_MESSAGE_PARAMS *gcm_param;
+    CK_RV rc;
+
+    if (!sess || !ctx || !out_data_len) {
+        TRACE_ERROR("%s received bad argument(s)\n", __func__);
+        return CKR_FUNCTION_FAILED;
+    }
+
+    rc = aes_gcm_msg_param(param, param_len, &gcm_param);
+    if (rc != CKR_OK)
+        return rc;
+
+    if (length_only == TRUE) {
+        *out_data_len = in_data_len;
+        return CKR_OK;
+    }
+
+    if (*out_data_len < in_data_len) {
+        *out_data_len = in_data_len;
+        TRACE_ERROR("%s\n", ock_err(ERR_BUFFER_TOO_SMALL));
+        return CKR_BUFFER_TOO_SMALL;
+    }
+
+    rc = token_specific.t_aes_gcm_msg(tokdata, sess, ctx, gcm_param,
+                                      aad, aad_len, in_data, in_data_len,
+                                      out_data, out_data_len, 0);
+    if (rc != CKR_OK)
+        TRACE_ERROR("Token specific aes gcm message decrypt failed: %02lx\n",
+                    rc);
+
+    return rc;
+}
+
 //
 // mechanisms
 //
@@ -379,18 +379,13 @@ CK_RV ec_hash_sign_update(STDLL_TokData_t *tokdata,
         digest_mech.ulParameterLen = 0;
         digest_mech.pParameter = NULL;
 
-        rc = digest_mgr_init(tokdata, sess, &context->hash_context,
-                             &digest_mech, FALSE);
-        if (rc != CKR_OK) {
-            TRACE_DEVEL("Digest Mgr Init failed.\n");
+        rc = digest_mgr_hash_sign_init(tokdata, sess, ctx, &digest_mech);
+        if (rc != CKR_OK)
             return rc;
-        }
-        context->flag = TRUE;
-        ctx->state_unsaveable |= context->hash_context.state_unsaveable;
     }
 
-    rc = digest_mgr_digest_update(tokdata, sess, &context->hash_context,
-                                  in_data, in_data_len);
+    rc = digest_mgr_hash_sign_update(tokdata, sess, context,
+                                     in_data, in_data_len);
     if (rc != CKR_OK) {
         TRACE_DEVEL("Digest Mgr Update failed.\n");
         return rc;
@@ -434,8 +429,8 @@ CK_RV ec_hash_sign_final(STDLL_TokData_t *tokdata,
         return rc;
     }
 
-    rc = digest_mgr_digest_final(tokdata, sess, length_only,
-                                 &context->hash_context, hash, &hash_len);
+    rc = digest_mgr_hash_sign_final(tokdata, sess, length_only, context,
+                                    hash, &hash_len);
     if (rc != CKR_OK) {
         TRACE_DEVEL("Digest Mgr Final failed.\n");
         return rc;
@@ -597,18 +592,13 @@ CK_RV ec_hash_verify_update(STDLL_TokData_t *tokdata,
         digest_mech.ulParameterLen = 0;
         digest_mech.pParameter = NULL;
 
-        rc = digest_mgr_init(tokdata, sess, &context->hash_context,
-                             &digest_mech, FALSE);
-        if (rc != CKR_OK) {
-            TRACE_DEVEL("Digest Mgr Init failed.\n");
+        rc = digest_mgr_hash_sign_init(tokdata, sess, ctx, &digest_mech);
+        if (rc != CKR_OK)
             return rc;
-        }
-        context->flag = TRUE;
-        ctx->state_unsaveable |= context->hash_context.state_unsaveable;
     }
 
-    rc = digest_mgr_digest_update(tokdata, sess, &context->hash_context,
-                                  in_data, in_data_len);
+    rc = digest_mgr_hash_sign_update(tokdata, sess, context,
+                                     in_data, in_data_len);
     if (rc != CKR_OK) {
         TRACE_DEVEL("Digest Mgr Update failed.\n");
         return rc;
@@ -650,8 +640,8 @@ CK_RV ec_hash_verify_final(STDLL_TokData_t *tokdata,
         return rc;
     }
 
-    rc = digest_mgr_digest_final(tokdata, sess, FALSE, &context->hash_context,
-                                 hash, &hash_len);
+    rc = digest_mgr_hash_sign_final(tokdata, sess, FALSE, context,
+                                    hash, &hash_len);
     if (rc != CKR_OK) {
         TRACE_DEVEL("Digest Mgr Final failed.\n");
         return rc;
@@ -258,7 +258,7 @@ CK_RV md2_hmac_sign(STDLL_TokData_t *tokdata,
         memset(&k_ipad[i], 0x36, MD2_BLOCK_SIZE - i);
         memset(&k_opad[i], 0x5C, MD2_BLOCK_SIZE - i);
     } else {
-        CK_BYTE *key = (CK_BYTE *) attr + sizeof(CK_ATTRIBUTE);
+        CK_BYTE *key = attr->pValue;
 
         for (i = 0; i < key_bytes; i++) {
             k_ipad[i] = key[i] ^ 0x36;
@@ -37,56 +37,28 @@
 #include <openssl/param_build.h>
 #endif
 
-CK_RV openssl_specific_rsa_keygen(TEMPLATE *publ_tmpl, TEMPLATE *priv_tmpl)
+/*
+ * Generate an RSA key with the given modulus size and public exponent. The
+ * caller must validate the parameters and free the returned key.
+ */
+CK_RV openssl_specific_rsa_generate_pkey(CK_ULONG mod_bits,
+                                         const CK_BYTE *publ_exp,
+                                         CK_ULONG publ_exp_len,
+                                         EVP_PKEY **pkey)
 {
-    CK_ATTRIBUTE *publ_exp = NULL;
-    CK_ATTRIBUTE *attr = NULL;
-    CK_ULONG mod_bits;
-    CK_BBOOL flag;
-    CK_RV rc;
-    CK_ULONG BNLength;
-#if !OPENSSL_VERSION_PREREQ(3, 0)
-    const RSA *rsa = NULL;
-    const BIGNUM *bignum = NULL;
-#else
-    BIGNUM *bignum = NULL;
+#if OPENSSL_VERSION_PREREQ(3, 0)
     int try;
 #endif
-    CK_BYTE *ssl_ptr = NULL;
     BIGNUM *e = NULL;
-    EVP_PKEY *pkey = NULL;
     EVP_PKEY_CTX *ctx = NULL;
-
-    rc = template_attribute_get_ulong(publ_tmpl, CKA_MODULUS_BITS, &mod_bits);
-    if (rc != CKR_OK) {
-        TRACE_ERROR("%s\n", ock_err(ERR_TEMPLATE_INCOMPLETE));
-        return CKR_TEMPLATE_INCOMPLETE; // should never happen
-    }
-
-    // we don't support less than 512 bit keys in the sw
-    if (mod_bits < 512 || mod_bits > OPENSSL_RSA_MAX_MODULUS_BITS) {
-        TRACE_ERROR("%s\n", ock_err(ERR_KEY_SIZE_RANGE));
-        return CKR_KEY_SIZE_RANGE;
-    }
-
-    rc = template_attribute_get_non_empty(publ_tmpl, CKA_PUBLIC_EXPONENT,
-                                          &publ_exp);
-    if (rc != CKR_OK) {
-        TRACE_ERROR("%s\n", ock_err(ERR_TEMPLATE_INCOMPLETE));
-        return CKR_TEMPLATE_INCOMPLETE;
-    }
-
-    if (publ_exp->ulValueLen > sizeof(CK_ULONG)) {
-        TRACE_ERROR("%s\n", ock_err(ERR_ATTRIBUTE_VALUE_INVALID));
-        return CKR_ATTRIBUTE_VALUE_INVALID;
-    }
+    CK_RV rc;
 
     e = BN_new();
     if (e == NULL) {
         TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
         return CKR_HOST_MEMORY;
     }
-    BN_bin2bn(publ_exp->pValue, publ_exp->ulValueLen, e);
+    BN_bin2bn(publ_exp, publ_exp_len, e);
 
     ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, NULL);
     if (ctx == NULL) {
@@ -124,7 +96,7 @@ CK_RV openssl_specific_rsa_keygen(TEMPLATE *publ_tmpl, TEMPLATE *priv_tmpl)
      * fail to generate a key. Retry up to 10 times in such a case.
      */
     for (try = 1; try <= 10; try++) {
-        if (EVP_PKEY_keygen(ctx, &pkey) == 1) {
+        if (EVP_PKEY_keygen(ctx, pkey) == 1) {
             rc = CKR_OK;
             break;
         }
@@ -135,12 +107,40 @@ CK_RV openssl_specific_rsa_keygen(TEMPLATE *publ_tmpl, TEMPLATE *priv_tmpl)
     if (rc != CKR_OK)
         goto done;
 #else
-    if (EVP_PKEY_keygen(ctx, &pkey) != 1) {
+    if (EVP_PKEY_keygen(ctx, pkey) != 1) {
         TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_FAILED));
         rc = CKR_FUNCTION_FAILED;
         goto done;
     }
+    rc = CKR_OK;
+#endif
+done:
+    if (ctx != NULL)
+        EVP_PKEY_CTX_free(ctx);
+    if (e != NULL)
+        BN_free(e);
+    return rc;
+}
+
+/*
+ * Fill the public and private key templates from a generated RSA key.
+ */
+CK_RV openssl_specific_rsa_keygen_from_pkey(EVP_PKEY *pkey,
+                                            TEMPLATE *publ_tmpl,
+                                            TEMPLATE *priv_tmpl)
+{
+    CK_ATTRIBUTE *attr = NULL;
+    CK_BBOOL flag;
+    CK_RV rc;
+    CK_ULONG BNLength;
+#if !OPENSSL_VERSION_PREREQ(3, 0)
+    const RSA *rsa = NULL;
+    const BIGNUM *bignum = NULL;
+#else
+    BIGNUM *bignum = NULL;
 #endif
+    CK_BYTE *ssl_ptr = NULL;
+
 #if !OPENSSL_VERSION_PREREQ(3, 0)
     if ((rsa = EVP_PKEY_get0_RSA(pkey)) == NULL) {
         TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_FAILED));
@@ -537,12 +537,6 @@ done:
         OPENSSL_cleanse(ssl_ptr, BNLength);
         free(ssl_ptr);
     }
-    if (pkey != NULL)
-        EVP_PKEY_free(pkey);
-    if (ctx != NULL)
-        EVP_PKEY_CTX_free(ctx);
-    if (e != NULL)
-        BN_free(e);
 #if OPENSSL_VERSION_PREREQ(3, 0)
     if (bignum != NULL)
         BN_free(bignum);
@@ -550,6 +544,48 @@ done:
     return rc;
 }
 
+CK_RV openssl_specific_rsa_keygen(TEMPLATE *publ_tmpl, TEMPLATE *priv_tmpl)
+{
+    CK_ATTRIBUTE *publ_exp = NULL;
+    CK_ULONG mod_bits;
+    EVP_PKEY *pkey = NULL;
+    CK_RV rc;
+
+    rc = template_attribute_get_ulong(publ_tmpl, CKA_MODULUS_BITS, &mod_bits);
+    if (rc != CKR_OK) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TEMPLATE_INCOMPLETE));
+        return CKR_TEMPLATE_INCOMPLETE; // should never happen
+    }
+
+    // we don't support less than 512 bit keys in the sw
+    if (mod_bits < 512 || mod_bits > OPENSSL_RSA_MAX_MODULUS_BITS) {
+        TRACE_ERROR("%s\n", ock_err(ERR_KEY_SIZE_RANGE));
+        return CKR_KEY_SIZE_RANGE;
+    }
+
+    rc = template_attribute_get_non_empty(publ_tmpl, CKA_PUBLIC_EXPONENT,
+                                          &publ_exp);
+    if (rc != CKR_OK) {
+        TRACE_ERROR("%s\n", ock_err(ERR_TEMPLATE_INCOMPLETE));
+        return CKR_TEMPLATE_INCOMPLETE;
+    }
+
+    if (publ_exp->ulValueLen > sizeof(CK_ULONG)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_ATTRIBUTE_VALUE_INVALID));
+        return CKR_ATTRIBUTE_VALUE_INVALID;
+    }
+
+    rc = openssl_specific_rsa_generate_pkey(mod_bits, publ_exp->pValue,
+                                            publ_exp->ulValueLen, &pkey);
+    if (rc != CKR_OK)
+        return rc;
+
+    rc = openssl_specific_rsa_keygen_from_pkey(pkey, publ_tmpl, priv_tmpl);
+
+    EVP_PKEY_free(pkey);
+    return rc;
+}
+
 // convert from the local PKCS11 template representation to
 // the underlying requirement
 // returns the pointer to the local key representation
@@ -872,19 +908,47 @@ out:
     return NULL;
 }
 
-CK_RV openssl_specific_rsa_encrypt(STDLL_TokData_t *tokdata, CK_BYTE *in_data,
-                                   CK_ULONG in_data_len, CK_BYTE *out_data,
-                                   OBJECT *key_obj)
+static void *fast_key_pkey_get(void *fast_key)
+{
+    if (EVP_PKEY_up_ref(fast_key) != 1)
+        return NULL;
+
+    return fast_key;
+}
+
+static void fast_key_pkey_put(void *fast_key)
+{
+    EVP_PKEY_free(fast_key);
+}
+
+static CK_RV rsa_public_fast_key_derive(STDLL_TokData_t *tokdata,
+                                        OBJECT *key_obj, void **fast_key)
+{
+    UNUSED(tokdata);
+
+    *fast_key = rsa_convert_public_key(key_obj);
+
+    return *fast_key != NULL ? CKR_OK : CKR_FUNCTION_FAILED;
+}
+
+static const struct fast_key_ops rsa_public_fast_key_ops = {
+    .name = "RSA public",
+    .derive = rsa_public_fast_key_derive,
+    .get = fast_key_pkey_get,
+    .put = fast_key_pkey_put,
+};
+
+static CK_RV rsa_public_encrypt(STDLL_TokData_t *tokdata, CK_BYTE *in_data,
+                                CK_ULONG in_data_len, CK_BYTE *out_data,
+                                size_t outlen, OBJECT *key_obj, int padding)
 {
     EVP_PKEY_CTX *ctx = NULL;
     EVP_PKEY *pkey = NULL;
     CK_RV rc;
-    size_t outlen = in_data_len;
-
-    UNUSED(tokdata);
 
-    pkey = rsa_convert_public_key(key_obj);
-    if (pkey == NULL) {
+    rc = object_get_fast_key(tokdata, key_obj, &rsa_public_fast_key_ops,
+                             (void **)&pkey);
+    if (rc != CKR_OK || pkey == NULL) {
         TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_FAILED));
         rc = CKR_FUNCTION_FAILED;
         return rc;
@@ -902,7 +966,7 @@ CK_RV openssl_specific_rsa_encrypt(STDLL_TokData_t *tokdata, CK_BYTE *in_data,
         rc = CKR_FUNCTION_FAILED;
         goto done;
     }
-    if (EVP_PKEY_CTX_set_rsa_padding(ctx, RSA_NO_PADDING) != 1) {
+    if (EVP_PKEY_CTX_set_rsa_padding(ctx, padding) != 1) {
         TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_FAILED));
         rc = CKR_FUNCTION_FAILED;
         goto done;
@@ -923,24 +987,21 @@ done:
     return rc;
 }
 
-CK_RV openssl_specific_rsa_decrypt(STDLL_TokData_t *tokdata, CK_BYTE *in_data,
+CK_RV openssl_specific_rsa_encrypt(STDLL_TokData_t *tokdata, CK_BYTE *in_data,
                                    CK_ULONG in_data_len, CK_BYTE *out_data,
                                    OBJECT *key_obj)
+{
+    return rsa_public_encrypt(tokdata, in_data, in_data_len, out_data,
+                              in_data_len, key_obj, RSA_NO_PADDING);
+}
+
+static CK_RV rsa_private_decrypt(EVP_PKEY *pkey, CK_BYTE *in_data,
+                                 CK_ULONG in_data_len, CK_BYTE *out_data)
 {
     EVP_PKEY_CTX *ctx = NULL;
-    EVP_PKEY *pkey = NULL;
     size_t outlen = in_data_len;
     CK_RV rc;
 
-    UNUSED(tokdata);
-
-    pkey = rsa_convert_private_key(key_obj);
-    if (pkey == NULL) {
-        TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_FAILED));
-        rc = CKR_FUNCTION_FAILED;
-        return rc;
-    }
-
     ctx = EVP_PKEY_CTX_new(pkey, NULL);
     if (ctx == NULL) {
         TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
@@ -967,13 +1028,127 @@ CK_RV openssl_specific_rsa_decrypt(STDLL_TokData_t *tokdata, CK_BYTE *in_data,
 
     rc = CKR_OK;
 done:
-    if (pkey != NULL)
-        EVP_PKEY_free(pkey);
     if (ctx != NULL)
         EVP_PKEY_CTX_free(ctx);
     return rc;
 }
 
+CK_RV openssl_specific_rsa_decrypt(STDLL_TokData_t *tokdata, CK_BYTE *in_data,
+                                   CK_ULONG in_data_len, CK_BYTE *out_data,
+                                   OBJECT *key_obj)
+{
+    EVP_PKEY *pkey = NULL;
+    CK_RV rc;
+
+    UNUSED(tokdata);
+
+    pkey = rsa_convert_private_key(key_obj);
+    if (pkey == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_FAILED));
+        rc = CKR_FUNCTION_FAILED;
+        return rc;
+    }
+
+    rc = rsa_private_decrypt(pkey, in_data, in_data_len, out_data);
+
+    EVP_PKEY_free(pkey);
+    return rc;
+}
+
+/*
+ * Returns the private key that C_MessageSignInit set up for the key object on
+ * the session, or NULL if there is none.
+ */
+static EVP_PKEY *msg_sign_key(SESSION *sess, OBJECT *key_obj)
+{
+    if (sess == NULL || !sess->msg_sign_ctx.active ||
+        sess->msg_sign_ctx.msg_key == NULL ||
+        sess->msg_sign_ctx.key != key_obj->map_handle)
+        return NULL;
+
+    return sess->msg_sign_ctx.msg_key;
+}
+
+/* Signing is a private key operation --> decrypt */
+static CK_RV rsa_sign_decrypt(STDLL_TokData_t *tokdata, SESSION *sess,
+                              CK_BYTE *in_data, CK_ULONG in_data_len,
+                              CK_BYTE *out_data, OBJECT *key_obj,
+                              t_rsa_decrypt rsa_decrypt_func)
+{
+    EVP_PKEY *pkey;
+
+    pkey = msg_sign_key(sess, key_obj);
+    if (pkey != NULL)
+        return rsa_private_decrypt(pkey, in_data, in_data_len, out_data);
+
+    return rsa_decrypt_func(tokdata, in_data, in_data_len, out_data, key_obj);
+}
+
+static void msg_sign_key_free(void *msg_key)
+{
+    EVP_PKEY_free(msg_key);
+}
+
+/*
+ * Builds the private key of a message-based signature once, instead of for
+ * every message. CKM_RSA_X_509 still builds it for every message, its token
+ * function does not get the session.
+ */
+CK_RV openssl_specific_msg_sign_key_init(STDLL_TokData_t *tokdata,
+                                         SESSION *sess,
+                                         SIGN_VERIFY_CONTEXT *ctx,
+                                         CK_OBJECT_HANDLE hkey)
+{
+    OBJECT *key_obj = NULL;
+    CK_KEY_TYPE keytype;
+    EVP_PKEY *pkey = NULL;
+    CK_RV rc;
+
+    UNUSED(sess);
+
+    rc = object_mgr_find_in_map1(tokdata, hkey, &key_obj, READ_LOCK);
+    if (rc != CKR_OK) {
+        TRACE_ERROR("Failed to find specified object.\n");
+        return rc;
+    }
+
+    rc = template_attribute_get_ulong(key_obj->template, CKA_KEY_TYPE,
+                                      &keytype);
+    if (rc != CKR_OK) {
+        TRACE_ERROR("Could not find CKA_KEY_TYPE for the key.\n");
+        goto done;
+    }
+
+    switch (keytype) {
+    case CKK_RSA:
+        pkey = rsa_convert_private_key(key_obj);
+        if (pkey == NULL) {
+            TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_FAILED));
+            rc = CKR_FUNCTION_FAILED;
+        }
+        break;
+#ifndef NO_EC
+    case CKK_EC:
+        rc = openssl_make_ec_key_from_template(key_obj->template, &pkey);
+        break;
+#endif
+    default:
+        /* Built for every message */
+        break;
+    }
+
+    if (rc == CKR_OK && pkey != NULL) {
+        ctx->msg_key = pkey;
+        ctx->msg_key_free_func = msg_sign_key_free;
+    }
+
+done:
+    object_put(tokdata, key_obj, TRUE);
+    key_obj = NULL;
+
+    return rc;
+}
+
 CK_RV openssl_specific_rsa_pkcs_encrypt(STDLL_TokData_t *tokdata,
                                         CK_BYTE *in_data, CK_ULONG in_data_len,
                                         CK_BYTE *out_data,
@@ -1016,6 +1191,36 @@ done:
     return rc;
 }
 
+/*
+ * RSA PKCS#1 v1.5 encryption with a public key object, for tokens performing
+ * public key operations locally. The padding is done by OpenSSL, so that it
+ * does not draw random bytes from the token's crypto adapter.
+ */
+CK_RV openssl_specific_rsa_pkcs_public_encrypt(STDLL_TokData_t *tokdata,
+                                               CK_BYTE *in_data,
+                                               CK_ULONG in_data_len,
+                                               CK_BYTE *out_data,
+                                               CK_ULONG *out_data_len,
+                                               OBJECT *key_obj)
+{
+    CK_ATTRIBUTE *attr = NULL;
+    CK_RV rc;
+
+    rc = template_attribute_get_non_empty(key_obj->template, CKA_MODULUS,
+                                          &attr);
+    if (rc != CKR_OK) {
+        TRACE_ERROR("Could not find CKA_MODULUS for the key.\n");
+        return rc;
+    }
+
+    rc = rsa_public_encrypt(tokdata, in_data, in_data_len, out_data,
+                            attr->ulValueLen, key_obj, RSA_PKCS1_PADDING);
+    if (rc == CKR_OK)
+        *out_data_len = attr->ulValueLen;
+
+    return rc;
+}
+
 CK_RV openssl_specific_rsa_pkcs_decrypt(STDLL_TokData_t *tokdata,
                                         CK_BYTE *in_data, CK_ULONG in_data_len,
                                         CK_BYTE *out_data,
@@ -1066,8 +1271,6 @@ CK_RV openssl_specific_rsa_pkcs_sign(STDLL_TokData_t *tokdata, SESSION *sess,
     CK_RV rc;
     CK_ATTRIBUTE *attr = NULL;
 
-    UNUSED(sess);
-
     /* format the data */
     rc = template_attribute_get_non_empty(key_obj->template, CKA_MODULUS,
                                           &attr);
@@ -1083,8 +1286,8 @@ CK_RV openssl_specific_rsa_pkcs_sign(STDLL_TokData_t *tokdata, SESSION *sess,
         return rc;
     }
 
-    /* signing is a private key operation --> decrypt */
-    rc = rsa_decrypt_func(tokdata, data, modulus_bytes, sig, key_obj);
+    rc = rsa_sign_decrypt(tokdata, sess, data, modulus_bytes, sig, key_obj,
+                          rsa_decrypt_func);
     if (rc == CKR_OK) {
         memcpy(signature, sig, modulus_bytes);
         *sig_len = modulus_bytes;
@@ -1226,8 +1429,6 @@ CK_RV openssl_specific_rsa_pss_sign(STDLL_TokData_t *tokdata, SESSION *sess,
     CK_BYTE *emdata = NULL;
     CK_RSA_PKCS_PSS_PARAMS *pssParms = NULL;
 
-    UNUSED(sess);
-
     /* check the arguments */
     if (!in_data || !sig) {
         TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
@@ -1269,8 +1470,8 @@ CK_RV openssl_specific_rsa_pss_sign(STDLL_TokData_t *tokdata, SESSION *sess,
     if (rc != CKR_OK)
         goto done;
 
-    /* signing is a private key operation --> decrypt  */
-    rc = rsa_decrypt_func(tokdata, emdata, modbytes, sig, key_obj);
+    rc = rsa_sign_decrypt(tokdata, sess, emdata, modbytes, sig, key_obj,
+                          rsa_decrypt_func);
     if (rc == CKR_OK)
         *sig_len = modbytes;
     else
@@ -2219,37 +2420,14 @@ out:
     return CKR_OK;
 }
 
-CK_RV openssl_specific_ec_generate_keypair(STDLL_TokData_t *tokdata,
-                                           TEMPLATE *publ_tmpl,
-                                           TEMPLATE *priv_tmpl)
+/*
+ * Generate an EC key on the curve with the given NID. The caller must free
+ * the returned key.
+ */
+CK_RV openssl_specific_ec_generate_pkey(int nid, EVP_PKEY **pkey)
 {
-
-    CK_ATTRIBUTE *attr = NULL, *ec_point_attr, *value_attr, *parms_attr;
-#if !OPENSSL_VERSION_PREREQ(3, 0)
-    const EC_KEY *ec_key = NULL;
-    BN_CTX *bnctx = NULL;
-#else
-    BIGNUM *bn_d = NULL;
-#endif
-    CK_BYTE *ecpoint = NULL, *enc_ecpoint = NULL, *d = NULL;
-    CK_ULONG ecpoint_len, enc_ecpoint_len, d_len;
-    EVP_PKEY_CTX *ctx = NULL;
-    EVP_PKEY *ec_pkey = NULL;
-    int nid;
-    CK_RV rc;
-
-    UNUSED(tokdata);
-
-    rc = template_attribute_get_non_empty(publ_tmpl, CKA_ECDSA_PARAMS, &attr);
-    if (rc != CKR_OK)
-        goto out;
-
-    nid = curve_nid_from_params(attr->pValue, attr->ulValueLen);
-    if (nid == NID_undef) {
-        TRACE_ERROR("curve not supported by OpenSSL.\n");
-        rc = CKR_CURVE_NOT_SUPPORTED;
-        goto out;
-    }
+    EVP_PKEY_CTX *ctx = NULL;
+    CK_RV rc;
 
     ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_EC, NULL);
     if (ctx == NULL) {
@@ -2270,7 +2448,7 @@ CK_RV openssl_specific_ec_generate_keypair(STDLL_TokData_t *tokdata,
         goto out;
     }
 
-    if (EVP_PKEY_keygen(ctx, &ec_pkey) <= 0) {
+    if (EVP_PKEY_keygen(ctx, pkey) <= 0) {
         TRACE_ERROR("EVP_PKEY_keygen failed\n");
         if (ERR_GET_REASON(ERR_peek_last_error()) == EC_R_INVALID_CURVE)
             rc = CKR_CURVE_NOT_SUPPORTED;
@@ -2279,6 +2457,39 @@ CK_RV openssl_specific_ec_generate_keypair(STDLL_TokData_t *tokdata,
         goto out;
     }
 
+    rc = CKR_OK;
+
+out:
+    if (ctx != NULL)
+        EVP_PKEY_CTX_free(ctx);
+
+    return rc;
+}
+
+/*
+ * Fill the public and private key templates from a generated EC key. The
+ * public key template must contain the CKA_ECDSA_PARAMS of the key's curve.
+ */
+CK_RV openssl_specific_ec_keygen_from_pkey(EVP_PKEY *ec_pkey,
+                                           TEMPLATE *publ_tmpl,
+                                           TEMPLATE *priv_tmpl)
+{
+    CK_ATTRIBUTE *attr = NULL, *ec_point_attr, *value_attr, *parms_attr;
+#if !OPENSSL_VERSION_PREREQ(3, 0)
+    const EC_KEY *ec_key = NULL;
+    BN_CTX *bnctx = NULL;
+#else
+    BIGNUM *bn_d = NULL;
+    int prime_len;
+#endif
+    CK_BYTE *ecpoint = NULL, *enc_ecpoint = NULL, *d = NULL;
+    CK_ULONG ecpoint_len, enc_ecpoint_len, d_len;
+    CK_RV rc;
+
+    rc = template_attribute_get_non_empty(publ_tmpl, CKA_ECDSA_PARAMS, &attr);
+    if (rc != CKR_OK)
+        goto out;
+
 #if !OPENSSL_VERSION_PREREQ(3, 0)
     ec_key = EVP_PKEY_get0_EC_KEY(ec_pkey);
     if (ec_key == NULL) {
@@ -2359,7 +2570,14 @@ CK_RV openssl_specific_ec_generate_keypair(STDLL_TokData_t *tokdata,
         goto out;
     }
 
-    d_len = ec_prime_len_from_nid(nid);
+    prime_len = ec_prime_len_from_pkey(ec_pkey);
+    if (prime_len <= 0) {
+        TRACE_ERROR("ec_prime_len_from_pkey failed\n");
+        rc = CKR_FUNCTION_FAILED;
+        goto out;
+    }
+
+    d_len = prime_len;
     d = OPENSSL_zalloc(d_len);
     if (d == NULL) {
         TRACE_ERROR("OPENSSL_zalloc failed\n");
@@ -2401,8 +2619,6 @@ CK_RV openssl_specific_ec_generate_keypair(STDLL_TokData_t *tokdata,
     rc = CKR_OK;
 
 out:
-    if (ctx != NULL)
-        EVP_PKEY_CTX_free(ctx);
 #if !OPENSSL_VERSION_PREREQ(3, 0)
     if (bnctx != NULL)
         BN_CTX_free(bnctx);
@@ -2410,8 +2626,6 @@ out:
     if (bn_d != NULL)
         BN_free(bn_d);
 #endif
-    if (ec_pkey != NULL)
-        EVP_PKEY_free(ec_pkey);
     if (ecpoint != NULL)
         OPENSSL_free(ecpoint);
     if (enc_ecpoint != NULL)
@@ -2422,6 +2636,53 @@ out:
     return rc;
 }
 
+CK_RV openssl_specific_ec_generate_keypair(STDLL_TokData_t *tokdata,
+                                           TEMPLATE *publ_tmpl,
+                                           TEMPLATE *priv_tmpl)
+{
+    CK_ATTRIBUTE *attr = NULL;
+    EVP_PKEY *ec_pkey = NULL;
+    int nid;
+    CK_RV rc;
+
+    UNUSED(tokdata);
+
+    rc = template_attribute_get_non_empty(publ_tmpl, CKA_ECDSA_PARAMS, &attr);
+    if (rc != CKR_OK)
+        return rc;
+
+    nid = curve_nid_from_params(attr->pValue, attr->ulValueLen);
+    if (nid == NID_undef) {
+        TRACE_ERROR("curve not supported by OpenSSL.\n");
+        return CKR_CURVE_NOT_SUPPORTED;
+    }
+
+    rc = openssl_specific_ec_generate_pkey(nid, &ec_pkey);
+    if (rc != CKR_OK)
+        return rc;
+
+    rc = openssl_specific_ec_keygen_from_pkey(ec_pkey, publ_tmpl, priv_tmpl);
+
+    EVP_PKEY_free(ec_pkey);
+    return rc;
+}
+
+static CK_RV ec_fast_key_derive(STDLL_TokData_t *tokdata, OBJECT *key_obj,
+                                void **fast_key)
+{
+    UNUSED(tokdata);
+
+    return openssl_make_ec_key_from_template(key_obj->template,
+                                             (EVP_PKEY **)fast_key);
+}
+
+static const struct fast_key_ops ec_public_fast_key_ops = {
+    .name = "EC public",
+    .derive = ec_fast_key_derive,
+    .get = fast_key_pkey_get,
+    .put = fast_key_pkey_put,
+};
+
 CK_RV openssl_specific_ec_sign(STDLL_TokData_t *tokdata,  SESSION *sess,
                                CK_BYTE *in_data, CK_ULONG in_data_len,
                                CK_BYTE *out_data, CK_ULONG *out_data_len,
@@ -2438,13 +2699,18 @@ CK_RV openssl_specific_ec_sign(STDLL_TokData_t *tokdata,  SESSION *sess,
     const unsigned char *p;
 
     UNUSED(tokdata);
-    UNUSED(sess);
 
     *out_data_len = 0;
 
-    rc = openssl_make_ec_key_from_template(key_obj->template, &ec_key);
-    if (rc != CKR_OK)
-        return rc;
+    ec_key = msg_sign_key(sess, key_obj);
+    if (ec_key != NULL) {
+        if (EVP_PKEY_up_ref(ec_key) != 1)
+            return CKR_FUNCTION_FAILED;
+    } else {
+        rc = openssl_make_ec_key_from_template(key_obj->template, &ec_key);
+        if (rc != CKR_OK)
+            return rc;
+    }
 
     ctx = EVP_PKEY_CTX_new(ec_key, NULL);
     if (ctx == NULL) {
@@ -2534,13 +2800,21 @@ CK_RV openssl_specific_ec_verify(STDLL_TokData_t *tokdata,
     size_t siglen;
     CK_BYTE *sigbuf = NULL;
     EVP_PKEY_CTX *ctx = NULL;
+    CK_ULONG keyclass = 0, subclass = 0;
 
-    UNUSED(tokdata);
     UNUSED(sess);
 
-    rc = openssl_make_ec_key_from_template(key_obj->template, &ec_key);
+    /* A private key is not cached, its EVP_PKEY would hold the secret */
+    template_get_class(key_obj->template, &keyclass, &subclass);
+    if (keyclass != CKO_PUBLIC_KEY)
+        rc = openssl_make_ec_key_from_template(key_obj->template, &ec_key);
+    else
+        rc = object_get_fast_key(tokdata, key_obj, &ec_public_fast_key_ops,
+                                 (void **)&ec_key);
     if (rc != CKR_OK)
         return rc;
+    if (ec_key == NULL)
+        return CKR_FUNCTION_FAILED;
 
     privlen = ec_prime_len_from_pkey(ec_key);
     if (privlen <= 0) {
@@ -2829,6 +3103,286 @@ static const EVP_MD *md_from_mech(CK_MECHANISM *mech)
     return md;
 }
 
+/*
+ * Digest state that can be saved with C_GetOperationState.
+ *
+ * With OpenSSL 3.0 the state of an EVP digest lives within the provider and
+ * can not be exported. For the SHA-1 and SHA-2 digests the low level
+ * functions are used instead, their context is a plain structure that is
+ * stored in the operation context as is, and can be restored in any session
+ * or process. The low level functions are deprecated and bypass the
+ * providers and the library context, so this is only done when the token
+ * enables it (see saveable_digest_state) and never in FIPS mode.
+ *
+ * Each state starts with a type tag, which tells it from an EVP context.
+ */
+#define OPENSSL_STATE_DIGEST    0x44475354      /* "DGST" */
+#define OPENSSL_STATE_HMAC      0x484d4143      /* "HMAC" */
+
+typedef struct _OPENSSL_DIGEST_STATE {
+    CK_ULONG type;
+    CK_MECHANISM_TYPE mech;
+    union {
+        SHA_CTX sha1;
+        SHA256_CTX sha256;
+        SHA512_CTX sha512;
+    } u;
+} OPENSSL_DIGEST_STATE;
+
+typedef struct _OPENSSL_HMAC_STATE {
+    CK_ULONG type;
+    OPENSSL_DIGEST_STATE inner;
+    OPENSSL_DIGEST_STATE outer;
+} OPENSSL_HMAC_STATE;
+
+#if OPENSSL_VERSION_PREREQ(3, 0)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdeprecated-declarations"
+#endif
+
+static CK_BBOOL digest_state_supported(STDLL_TokData_t *tokdata,
+                                       CK_MECHANISM_TYPE mech)
+{
+    if (!tokdata->saveable_digest_state)
+        return FALSE;
+
+    switch (mech) {
+    case CKM_SHA_1:
+    case CKM_SHA224:
+    case CKM_SHA256:
+    case CKM_SHA384:
+    case CKM_SHA512:
+        break;
+    default:
+        return FALSE;
+    }
+
+#if OPENSSL_VERSION_PREREQ(3, 0)
+    return EVP_default_properties_is_fips_enabled(NULL) ? FALSE : TRUE;
+#else
+    return FIPS_mode() ? FALSE : TRUE;
+#endif
+}
+
+static CK_RV digest_state_init(OPENSSL_DIGEST_STATE *state,
+                               CK_MECHANISM_TYPE mech)
+{
+    int rc;
+
+    state->type = OPENSSL_STATE_DIGEST;
+    state->mech = mech;
+
+    switch (mech) {
+    case CKM_SHA_1:
+        rc = SHA1_Init(&state->u.sha1);
+        break;
+    case CKM_SHA224:
+        rc = SHA224_Init(&state->u.sha256);
+        break;
+    case CKM_SHA256:
+        rc = SHA256_Init(&state->u.sha256);
+        break;
+    case CKM_SHA384:
+        rc = SHA384_Init(&state->u.sha512);
+        break;
+    case CKM_SHA512:
+        rc = SHA512_Init(&state->u.sha512);
+        break;
+    default:
+        TRACE_ERROR("%s\n", ock_err(ERR_MECHANISM_INVALID));
+        return CKR_MECHANISM_INVALID;
+    }
+
+    if (rc != 1) {
+        TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_FAILED));
+        return CKR_FUNCTION_FAILED;
+    }
+
+    return CKR_OK;
+}
+
+static CK_RV digest_state_update(OPENSSL_DIGEST_STATE *state,
+                                 const CK_BYTE *data, CK_ULONG data_len)
+{
+    int rc;
+
+    switch (state->mech) {
+    case CKM_SHA_1:
+        rc = SHA1_Update(&state->u.sha1, data, data_len);
+        break;
+    case CKM_SHA224:
+        rc = SHA224_Update(&state->u.sha256, data, data_len);
+        break;
+    case CKM_SHA256:
+        rc = SHA256_Update(&state->u.sha256, data, data_len);
+        break;
+    case CKM_SHA384:
+        rc = SHA384_Update(&state->u.sha512, data, data_len);
+        break;
+    case CKM_SHA512:
+        rc = SHA512_Update(&state->u.sha512, data, data_len);
+        break;
+    default:
+        TRACE_ERROR("%s\n", ock_err(ERR_SAVED_STATE_INVALID));
+        return CKR_SAVED_STATE_INVALID;
+    }
+
+    if (rc != 1) {
+        TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_FAILED));
+        return CKR_FUNCTION_FAILED;
+    }
+
+    return CKR_OK;
+}
+
+/* 'out' must be large enough for the digest, see get_sha_size() */
+static CK_RV digest_state_final(OPENSSL_DIGEST_STATE *state, CK_BYTE *out)
+{
+    int rc;
+
+    switch (state->mech) {
+    case CKM_SHA_1:
+        rc = SHA1_Final(out, &state->u.sha1);
+        break;
+    case CKM_SHA224:
+        rc = SHA224_Final(out, &state->u.sha256);
+        break;
+    case CKM_SHA256:
+        rc = SHA256_Final(out, &state->u.sha256);
+        break;
+    case CKM_SHA384:
+        rc = SHA384_Final(out, &state->u.sha512);
+        break;
+    case CKM_SHA512:
+        rc = SHA512_Final(out, &state->u.sha512);
+        break;
+    default:
+        TRACE_ERROR("%s\n", ock_err(ERR_SAVED_STATE_INVALID));
+        return CKR_SAVED_STATE_INVALID;
+    }
+
+    if (rc != 1) {
+        TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_FAILED));
+        return CKR_FUNCTION_FAILED;
+    }
+
+    return CKR_OK;
+}
+
+#if OPENSSL_VERSION_PREREQ(3, 0)
+#pragma GCC diagnostic pop
+#endif
+
+static CK_BBOOL state_has_type(const CK_BYTE *context, CK_ULONG context_len,
+                               CK_ULONG state_len, CK_ULONG type)
+{
+    CK_ULONG tag;
+
+    if (context == NULL || context_len != state_len)
+        return FALSE;
+
+    memcpy(&tag, context, sizeof(tag));
+    return tag == type;
+}
+
+static CK_MECHANISM_TYPE hmac_digest_mech(CK_MECHANISM_TYPE mech)
+{
+    switch (mech) {
+    case CKM_SHA_1_HMAC:
+    case CKM_SHA_1_HMAC_GENERAL:
+        return CKM_SHA_1;
+    case CKM_SHA224_HMAC:
+    case CKM_SHA224_HMAC_GENERAL:
+        return CKM_SHA224;
+    case CKM_SHA256_HMAC:
+    case CKM_SHA256_HMAC_GENERAL:
+        return CKM_SHA256;
+    case CKM_SHA384_HMAC:
+    case CKM_SHA384_HMAC_GENERAL:
+        return CKM_SHA384;
+    case CKM_SHA512_HMAC:
+    case CKM_SHA512_HMAC_GENERAL:
+        return CKM_SHA512;
+    default:
+        return CK_UNAVAILABLE_INFORMATION;
+    }
+}
+
+/* HMAC as of RFC 2104 on top of two saveable digest states */
+static CK_RV hmac_state_init(OPENSSL_HMAC_STATE *state,
+                             CK_MECHANISM_TYPE digest_mech,
+                             const CK_BYTE *key, CK_ULONG key_len)
+{
+    CK_BYTE pad[SHA512_BLOCK_SIZE], hkey[MAX_SHA_HASH_SIZE];
+    CK_ULONG block_size, i;
+    CK_RV rc;
+
+    state->type = OPENSSL_STATE_HMAC;
+    block_size = (digest_mech == CKM_SHA384 || digest_mech == CKM_SHA512) ?
+                                    SHA512_BLOCK_SIZE : SHA1_BLOCK_SIZE;
+
+    /* Keys longer than the block size are hashed first */
+    if (key_len > block_size) {
+        rc = digest_state_init(&state->inner, digest_mech);
+        if (rc == CKR_OK)
+            rc = digest_state_update(&state->inner, key, key_len);
+        if (rc == CKR_OK)
+            rc = digest_state_final(&state->inner, hkey);
+        if (rc == CKR_OK)
+            rc = get_sha_size(digest_mech, &key_len);
+        if (rc != CKR_OK)
+            goto out;
+        key = hkey;
+    }
+
+    memset(pad, 0x36, block_size);
+    for (i = 0; i < key_len; i++)
+        pad[i] ^= key[i];
+    rc = digest_state_init(&state->inner, digest_mech);
+    if (rc == CKR_OK)
+        rc = digest_state_update(&state->inner, pad, block_size);
+    if (rc != CKR_OK)
+        goto out;
+
+    memset(pad, 0x5c, block_size);
+    for (i = 0; i < key_len; i++)
+        pad[i] ^= key[i];
+    rc = digest_state_init(&state->outer, digest_mech);
+    if (rc == CKR_OK)
+        rc = digest_state_update(&state->outer, pad, block_size);
+
+out:
+    OPENSSL_cleanse(pad, sizeof(pad));
+    OPENSSL_cleanse(hkey, sizeof(hkey));
+
+    return rc;
+}
+
+static CK_RV hmac_state_final(OPENSSL_HMAC_STATE *state, CK_BYTE *mac)
+{
+    CK_BYTE hash[MAX_SHA_HASH_SIZE];
+    CK_ULONG hash_len;
+    CK_RV rc;
+
+    rc = get_sha_size(state->inner.mech, &hash_len);
+    if (rc == CKR_OK)
+        rc = digest_state_final(&state->inner, hash);
+    if (rc == CKR_OK)
+        rc = digest_state_update(&state->outer, hash, hash_len);
+    if (rc == CKR_OK)
+        rc = digest_state_final(&state->outer, mac);
+
+    OPENSSL_cleanse(hash, sizeof(hash));
+
+    return rc;
+}
+
+static void hmac_state_free(OPENSSL_HMAC_STATE *state)
+{
+    OPENSSL_cleanse(state, sizeof(*state));
+    free(state);
+}
+
 #if !OPENSSL_VERSION_PREREQ(3, 0)
 static EVP_MD_CTX *md_ctx_from_context(DIGEST_CONTEXT *ctx)
 {
@@ -2873,7 +3427,6 @@ static EVP_MD_CTX *md_ctx_from_context(DIGEST_CONTEXT *ctx)
 }
 #endif
 
-#if OPENSSL_VERSION_PREREQ(3, 0)
 static void openssl_specific_sha_free(STDLL_TokData_t *tokdata, SESSION *sess,
                                       CK_BYTE *context, CK_ULONG context_len)
 {
@@ -2881,7 +3434,43 @@ static void openssl_specific_sha_free(STDLL_TokData_t *tokdata, SESSION *sess,
     UNUSED(sess);
     UNUSED(context_len);
 
-    EVP_MD_CTX_free((EVP_MD_CTX *)context);
+    EVP_MD_CTX_free((EVP_MD_CTX *)context);
+}
+
+#if OPENSSL_VERSION_PREREQ(3, 0)
+#define SHA_CONTEXT_IS_SAVEABLE(ctx)                                    \
+            state_has_type((ctx)->context, (ctx)->context_len,          \
+                           sizeof(OPENSSL_DIGEST_STATE), OPENSSL_STATE_DIGEST)
+
+static CK_RV sha_state_final(DIGEST_CONTEXT *ctx, CK_BYTE *in_data,
+                             CK_ULONG in_data_len, CK_BYTE *out_data,
+                             CK_ULONG *out_data_len)
+{
+    OPENSSL_DIGEST_STATE *state = (OPENSSL_DIGEST_STATE *)ctx->context;
+    CK_ULONG hash_len;
+    CK_RV rc;
+
+    rc = get_sha_size(state->mech, &hash_len);
+    if (rc != CKR_OK)
+        return rc;
+    if (*out_data_len < hash_len) {
+        TRACE_ERROR("%s\n", ock_err(ERR_BUFFER_TOO_SMALL));
+        return CKR_BUFFER_TOO_SMALL;
+    }
+
+    if (in_data_len > 0)
+        rc = digest_state_update(state, in_data, in_data_len);
+    if (rc == CKR_OK)
+        rc = digest_state_final(state, out_data);
+    if (rc == CKR_OK)
+        *out_data_len = hash_len;
+
+    free(ctx->context);
+    ctx->context = NULL;
+    ctx->context_len = 0;
+    ctx->context_free_func = NULL;
+
+    return rc;
 }
 #endif
 
@@ -2894,12 +3483,12 @@ CK_RV openssl_specific_sha_init(STDLL_TokData_t *tokdata, DIGEST_CONTEXT *ctx,
     const EVP_MD *md;
 #endif
 
-    UNUSED(tokdata);
-
     ctx->mech.ulParameterLen = mech->ulParameterLen;
     ctx->mech.mechanism = mech->mechanism;
 
 #if !OPENSSL_VERSION_PREREQ(3, 0)
+    UNUSED(tokdata);
+
     md_ctx = md_ctx_from_context(ctx);
     if (md_ctx == NULL) {
         TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
@@ -2908,6 +3497,19 @@ CK_RV openssl_specific_sha_init(STDLL_TokData_t *tokdata, DIGEST_CONTEXT *ctx,
 
     EVP_MD_CTX_free(md_ctx);
 #else
+    if (digest_state_supported(tokdata, mech->mechanism)) {
+        ctx->context_len = sizeof(OPENSSL_DIGEST_STATE);
+        ctx->context = malloc(ctx->context_len);
+        if (ctx->context == NULL) {
+            TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
+            ctx->context_len = 0;
+            return CKR_HOST_MEMORY;
+        }
+
+        return digest_state_init((OPENSSL_DIGEST_STATE *)ctx->context,
+                                 mech->mechanism);
+    }
+
     ctx->context_len = 1;
     ctx->context = (CK_BYTE *)EVP_MD_CTX_new();
     if (ctx->context == NULL) {
@@ -2968,6 +3570,10 @@ CK_RV openssl_specific_sha(STDLL_TokData_t *tokdata, DIGEST_CONTEXT *ctx,
 
     *out_data_len = len;
 #else
+    if (SHA_CONTEXT_IS_SAVEABLE(ctx))
+        return sha_state_final(ctx, in_data, in_data_len,
+                               out_data, out_data_len);
+
     if (*out_data_len < (CK_ULONG)EVP_MD_CTX_size((EVP_MD_CTX *)ctx->context)) {
         TRACE_ERROR("%s\n", ock_err(ERR_BUFFER_TOO_SMALL));
         return CKR_BUFFER_TOO_SMALL;
@@ -3035,6 +3641,10 @@ CK_RV openssl_specific_sha_update(STDLL_TokData_t *tokdata, DIGEST_CONTEXT *ctx,
 
     EVP_MD_CTX_free(md_ctx);
 #else
+    if (SHA_CONTEXT_IS_SAVEABLE(ctx))
+        return digest_state_update((OPENSSL_DIGEST_STATE *)ctx->context,
+                                   in_data, in_data_len);
+
     if (!EVP_DigestUpdate((EVP_MD_CTX *)ctx->context, in_data, in_data_len)) {
         TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_FAILED));
         return CKR_FUNCTION_FAILED;
@@ -3085,6 +3695,9 @@ out:
     ctx->context_len = 0;
     ctx->context_free_func = NULL;
 #else
+    if (SHA_CONTEXT_IS_SAVEABLE(ctx))
+        return sha_state_final(ctx, NULL, 0, out_data, out_data_len);
+
     if (*out_data_len < (CK_ULONG)EVP_MD_CTX_size((EVP_MD_CTX *)ctx->context)) {
         TRACE_ERROR("%s\n", ock_err(ERR_BUFFER_TOO_SMALL));
         return CKR_BUFFER_TOO_SMALL;
@@ -3107,6 +3720,95 @@ out:
     return rc;
 }
 
+/*
+ * Streaming digest used by the hash-and-sign mechanisms. Other than the
+ * regular digest functions, the OpenSSL digest context is kept for the whole
+ * operation with all OpenSSL versions, so that the digest state does not
+ * need to be restored and saved on every update. The state of such a digest
+ * can therefore not be saved with C_GetOperationState.
+ */
+CK_RV openssl_specific_sha_stream_init(STDLL_TokData_t *tokdata,
+                                       DIGEST_CONTEXT *ctx,
+                                       CK_MECHANISM *mech)
+{
+    const EVP_MD *md;
+    EVP_MD_CTX *md_ctx;
+
+    UNUSED(tokdata);
+
+    md = md_from_mech(mech);
+    if (md == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_MECHANISM_INVALID));
+        return CKR_MECHANISM_INVALID;
+    }
+
+    md_ctx = EVP_MD_CTX_new();
+    if (md_ctx == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
+        return CKR_HOST_MEMORY;
+    }
+
+    if (!EVP_DigestInit_ex(md_ctx, md, NULL)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_FAILED));
+        EVP_MD_CTX_free(md_ctx);
+        return CKR_FUNCTION_FAILED;
+    }
+
+    ctx->mech.mechanism = mech->mechanism;
+    ctx->mech.ulParameterLen = 0;
+    ctx->context = (CK_BYTE *)md_ctx;
+    ctx->context_len = 1;
+    ctx->context_free_func = openssl_specific_sha_free;
+    ctx->state_unsaveable = CK_TRUE;
+
+    return CKR_OK;
+}
+
+CK_RV openssl_specific_sha_stream_update(STDLL_TokData_t *tokdata,
+                                         DIGEST_CONTEXT *ctx,
+                                         CK_BYTE *in_data,
+                                         CK_ULONG in_data_len)
+{
+    UNUSED(tokdata);
+
+    if (!ctx || !ctx->context)
+        return CKR_OPERATION_NOT_INITIALIZED;
+
+    if (!EVP_DigestUpdate((EVP_MD_CTX *)ctx->context, in_data, in_data_len)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_FAILED));
+        return CKR_FUNCTION_FAILED;
+    }
+
+    return CKR_OK;
+}
+
+CK_RV openssl_specific_sha_stream_final(STDLL_TokData_t *tokdata,
+                                        DIGEST_CONTEXT *ctx,
+                                        CK_BYTE *out_data,
+                                        CK_ULONG *out_data_len)
+{
+    unsigned int len;
+
+    UNUSED(tokdata);
+
+    if (!ctx || !ctx->context)
+        return CKR_OPERATION_NOT_INITIALIZED;
+
+    if (*out_data_len < (CK_ULONG)EVP_MD_CTX_size((EVP_MD_CTX *)ctx->context)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_BUFFER_TOO_SMALL));
+        return CKR_BUFFER_TOO_SMALL;
+    }
+
+    if (!EVP_DigestFinal((EVP_MD_CTX *)ctx->context, out_data, &len)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_FAILED));
+        return CKR_FUNCTION_FAILED;
+    }
+
+    *out_data_len = len;
+
+    return CKR_OK;
+}
+
 static const EVP_CIPHER *openssl_cipher_from_mech(CK_MECHANISM_TYPE mech,
                                                   CK_ULONG keylen,
                                                   CK_KEY_TYPE keytype)
@@ -4047,6 +4749,145 @@ done:
     return rc;
 }
 
+/*
+ * Message-based AES-GCM: the cipher context is set up with the key once and
+ * is kept for all messages of the operation. Each message only sets the IV,
+ * the AAD and the tag.
+ */
+CK_RV openssl_specific_aes_gcm_msg_init(STDLL_TokData_t *tokdata,
+                                        SESSION *sess, ENCR_DECR_CONTEXT *ctx,
+                                        CK_OBJECT_HANDLE hkey, CK_BYTE encrypt)
+{
+    AES_GCM_CONTEXT *context = NULL;
+    OBJECT *key = NULL;
+    EVP_CIPHER_CTX *gcm_ctx = NULL;
+    CK_ATTRIBUTE *attr = NULL;
+    const EVP_CIPHER *cipher = NULL;
+    CK_RV rc;
+
+    UNUSED(sess);
+
+    context = (AES_GCM_CONTEXT *)ctx->context;
+
+    rc = object_mgr_find_in_map_nocache(tokdata, hkey, &key, READ_LOCK);
+    if (rc != CKR_OK) {
+        TRACE_ERROR("Failed to find specified object.\n");
+        return rc;
+    }
+    rc = template_attribute_get_non_empty(key->template, CKA_VALUE, &attr);
+    if (rc != CKR_OK) {
+        TRACE_ERROR("Could not find CKA_VALUE for the key\n");
+        goto done;
+    }
+
+    cipher = openssl_cipher_from_mech(CKM_AES_GCM, attr->ulValueLen, CKK_AES);
+    if (cipher == NULL) {
+        rc = CKR_MECHANISM_INVALID;
+        goto done;
+    }
+
+    gcm_ctx = EVP_CIPHER_CTX_new();
+    if (gcm_ctx == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
+        rc = CKR_HOST_MEMORY;
+        goto done;
+    }
+
+    if (EVP_CipherInit_ex(gcm_ctx, cipher, NULL, attr->pValue, NULL,
+                          encrypt ? 1 : 0) != 1) {
+        TRACE_ERROR("GCM context initialization failed\n");
+        rc = CKR_GENERAL_ERROR;
+        goto done;
+    }
+
+    /* (Miss-)use the ulClen of AES_GCM_CONTEXT to store the context */
+    context->ulClen = (CK_ULONG)gcm_ctx;
+    ctx->state_unsaveable = CK_TRUE;
+    ctx->context_free_func = openssl_specific_aes_gcm_free;
+
+done:
+    object_put(tokdata, key, TRUE);
+    key = NULL;
+
+    if (rc != CKR_OK)
+        EVP_CIPHER_CTX_free(gcm_ctx);
+
+    return rc;
+}
+
+CK_RV openssl_specific_aes_gcm_msg(STDLL_TokData_t *tokdata, SESSION *sess,
+                                   ENCR_DECR_CONTEXT *ctx,
+                                   CK_GCM_MESSAGE_PARAMS *params,
+                                   CK_BYTE *aad, CK_ULONG aad_len,
+                                   CK_BYTE *in_data, CK_ULONG in_data_len,
+                                   CK_BYTE *out_data, CK_ULONG *out_data_len,
+                                   CK_BYTE encrypt)
+{
+    AES_GCM_CONTEXT *context = NULL;
+    EVP_CIPHER_CTX *gcm_ctx = NULL;
+    CK_ULONG tag_len;
+    int outlen = 0, finlen = 0;
+
+    UNUSED(tokdata);
+    UNUSED(sess);
+
+    context = (AES_GCM_CONTEXT *)ctx->context;
+    gcm_ctx = (EVP_CIPHER_CTX *)context->ulClen;
+    if (gcm_ctx == NULL)
+        return CKR_OPERATION_NOT_INITIALIZED;
+
+    tag_len = params->ulTagBits / 8;
+
+    /* Only the IV is set, the key schedule of the context is kept */
+    if (EVP_CIPHER_CTX_ctrl(gcm_ctx, EVP_CTRL_AEAD_SET_IVLEN,
+                            params->ulIvLen, NULL) != 1 ||
+        EVP_CipherInit_ex(gcm_ctx, NULL, NULL, NULL, params->pIv, -1) != 1) {
+        TRACE_ERROR("GCM set IV failed\n");
+        return CKR_GENERAL_ERROR;
+    }
+
+    if (aad_len > 0 &&
+        EVP_CipherUpdate(gcm_ctx, NULL, &outlen, aad, aad_len) != 1) {
+        TRACE_ERROR("GCM add AAD data failed\n");
+        return CKR_GENERAL_ERROR;
+    }
+
+    if (!encrypt &&
+        EVP_CIPHER_CTX_ctrl(gcm_ctx, EVP_CTRL_AEAD_SET_TAG, tag_len,
+                            params->pTag) != 1) {
+        TRACE_ERROR("GCM set tag failed\n");
+        return CKR_GENERAL_ERROR;
+    }
+
+    outlen = 0;
+    if (in_data_len > 0 &&
+        EVP_CipherUpdate(gcm_ctx, out_data, &outlen,
+                         in_data, in_data_len) != 1) {
+        TRACE_ERROR("GCM update failed\n");
+        return CKR_GENERAL_ERROR;
+    }
+
+    if (EVP_CipherFinal_ex(gcm_ctx, out_data + outlen, &finlen) != 1) {
+        if (!encrypt) {
+            TRACE_ERROR("GCM tag verification failed\n");
+            return CKR_AEAD_DECRYPT_FAILED;
+        }
+        TRACE_ERROR("GCM finalize encryption failed\n");
+        return CKR_GENERAL_ERROR;
+    }
+
+    if (encrypt &&
+        EVP_CIPHER_CTX_ctrl(gcm_ctx, EVP_CTRL_AEAD_GET_TAG, tag_len,
+                            params->pTag) != 1) {
+        TRACE_ERROR("GCM get tag failed\n");
+        return CKR_GENERAL_ERROR;
+    }
+
+    *out_data_len = outlen + finlen;
+
+    return CKR_OK;
+}
+
 CK_RV openssl_specific_aes_mac(STDLL_TokData_t *tokdata, CK_BYTE *message,
                                CK_ULONG message_len, OBJECT *key, CK_BYTE *mac)
 {
@@ -4219,6 +5060,46 @@ CK_RV openssl_specific_tdes_cmac(STDLL_TokData_t *tokdata, CK_BYTE *message,
                                 first, last, ctx);
 }
 
+#define HMAC_CONTEXT_IS_SAVEABLE(ctx)                                   \
+            state_has_type((ctx)->context, (ctx)->context_len,          \
+                           sizeof(OPENSSL_HMAC_STATE), OPENSSL_STATE_HMAC)
+
+static void openssl_specific_hmac_free(STDLL_TokData_t *tokdata, SESSION *sess,
+                                       CK_BYTE *context, CK_ULONG context_len)
+{
+    UNUSED(tokdata);
+    UNUSED(sess);
+    UNUSED(context_len);
+
+    EVP_MD_CTX_destroy((EVP_MD_CTX *)context);
+}
+
+static void hmac_context_free(SIGN_VERIFY_CONTEXT *ctx)
+{
+    if (HMAC_CONTEXT_IS_SAVEABLE(ctx))
+        hmac_state_free((OPENSSL_HMAC_STATE *)ctx->context);
+    else
+        EVP_MD_CTX_destroy((EVP_MD_CTX *)ctx->context);
+
+    ctx->context = NULL;
+    ctx->context_len = 0;
+    ctx->context_free_func = NULL;
+}
+
+static CK_BBOOL hmac_key_exportable(OBJECT *key)
+{
+    CK_BBOOL flag;
+
+    if (template_attribute_get_bool(key->template, CKA_SENSITIVE,
+                                    &flag) != CKR_OK || flag)
+        return FALSE;
+    if (template_attribute_get_bool(key->template, CKA_EXTRACTABLE,
+                                    &flag) != CKR_OK || !flag)
+        return FALSE;
+
+    return TRUE;
+}
+
 CK_RV openssl_specific_hmac_init(STDLL_TokData_t *tokdata,
                                  SIGN_VERIFY_CONTEXT *ctx,
                                  CK_MECHANISM_PTR mech,
@@ -4229,6 +5110,8 @@ CK_RV openssl_specific_hmac_init(STDLL_TokData_t *tokdata,
     CK_ATTRIBUTE *attr = NULL;
     EVP_MD_CTX *mdctx = NULL;
     EVP_PKEY *pkey = NULL;
+    OPENSSL_HMAC_STATE *state;
+    CK_MECHANISM_TYPE digest_mech;
 
     rc = object_mgr_find_in_map1(tokdata, Hkey, &key, READ_LOCK);
     if (rc != CKR_OK) {
@@ -4242,6 +5125,33 @@ CK_RV openssl_specific_hmac_init(STDLL_TokData_t *tokdata,
         goto done;
     }
 
+    /*
+     * The saveable state holds the key's inner and outer pad midstates,
+     * which are as good as the key itself. Keys that must not leave the
+     * token in the clear use the unsaveable EVP context instead.
+     */
+    digest_mech = hmac_digest_mech(mech->mechanism);
+    if (digest_state_supported(tokdata, digest_mech) &&
+        hmac_key_exportable(key)) {
+        state = malloc(sizeof(*state));
+        if (state == NULL) {
+            TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
+            rc = CKR_HOST_MEMORY;
+            goto done;
+        }
+
+        rc = hmac_state_init(state, digest_mech, attr->pValue,
+                             attr->ulValueLen);
+        if (rc != CKR_OK) {
+            hmac_state_free(state);
+            goto done;
+        }
+
+        ctx->context = (CK_BYTE *)state;
+        ctx->context_len = sizeof(*state);
+        goto done;
+    }
+
     pkey = EVP_PKEY_new_mac_key(EVP_PKEY_HMAC, NULL, attr->pValue,
                                 attr->ulValueLen);
     if (pkey == NULL) {
@@ -4325,6 +5235,8 @@ CK_RV openssl_specific_hmac_init(STDLL_TokData_t *tokdata,
         goto done;
     } else {
         ctx->context = (CK_BYTE *) mdctx;
+        ctx->context_free_func = openssl_specific_hmac_free;
+        ctx->state_unsaveable = CK_TRUE;
     }
 
     rc = CKR_OK;
@@ -4426,20 +5338,29 @@ CK_RV openssl_specific_hmac(SIGN_VERIFY_CONTEXT *ctx, CK_BYTE *in_data,
         return CKR_MECHANISM_INVALID;
     }
 
-    mdctx = (EVP_MD_CTX *) ctx->context;
+    if (HMAC_CONTEXT_IS_SAVEABLE(ctx)) {
+        rv = digest_state_update(&((OPENSSL_HMAC_STATE *)ctx->context)->inner,
+                                 in_data, in_data_len);
+        if (rv == CKR_OK)
+            rv = hmac_state_final((OPENSSL_HMAC_STATE *)ctx->context, mac);
+        if (rv != CKR_OK)
+            goto done;
+    } else {
+        mdctx = (EVP_MD_CTX *) ctx->context;
 
-    rc = EVP_DigestSignUpdate(mdctx, in_data, in_data_len);
-    if (rc != 1) {
-        TRACE_ERROR("EVP_DigestSignUpdate failed.\n");
-        rv = CKR_FUNCTION_FAILED;
-        goto done;
-    }
+        rc = EVP_DigestSignUpdate(mdctx, in_data, in_data_len);
+        if (rc != 1) {
+            TRACE_ERROR("EVP_DigestSignUpdate failed.\n");
+            rv = CKR_FUNCTION_FAILED;
+            goto done;
+        }
 
-    rc = EVP_DigestSignFinal(mdctx, mac, &mac_len);
-    if (rc != 1) {
-        TRACE_ERROR("EVP_DigestSignFinal failed.\n");
-        rv = CKR_FUNCTION_FAILED;
-        goto done;
+        rc = EVP_DigestSignFinal(mdctx, mac, &mac_len);
+        if (rc != 1) {
+            TRACE_ERROR("EVP_DigestSignFinal failed.\n");
+            rv = CKR_FUNCTION_FAILED;
+            goto done;
+        }
     }
 
     if (sign) {
@@ -4462,8 +5383,7 @@ CK_RV openssl_specific_hmac(SIGN_VERIFY_CONTEXT *ctx, CK_BYTE *in_data,
         }
     }
 done:
-    EVP_MD_CTX_destroy(mdctx);
-    ctx->context = NULL;
+    hmac_context_free(ctx);
 
     return rv;
 }
@@ -4480,6 +5400,14 @@ CK_RV openssl_specific_hmac_update(SIGN_VERIFY_CONTEXT *ctx, CK_BYTE *in_data,
     if (!ctx || !ctx->context)
         return CKR_OPERATION_NOT_INITIALIZED;
 
+    if (HMAC_CONTEXT_IS_SAVEABLE(ctx)) {
+        rv = digest_state_update(&((OPENSSL_HMAC_STATE *)ctx->context)->inner,
+                                 in_data, in_data_len);
+        if (rv == CKR_OK)
+            return CKR_OK;
+        goto err;
+    }
+
     mdctx = (EVP_MD_CTX *) ctx->context;
 
     rc = EVP_DigestSignUpdate(mdctx, in_data, in_data_len);
@@ -4491,8 +5419,8 @@ CK_RV openssl_specific_hmac_update(SIGN_VERIFY_CONTEXT *ctx, CK_BYTE *in_data,
         return CKR_OK;
     }
 
-    EVP_MD_CTX_destroy(mdctx);
-    ctx->context = NULL;
+err:
+    hmac_context_free(ctx);
     return rv;
 }
 
@@ -4580,13 +5508,19 @@ CK_RV openssl_specific_hmac_final(SIGN_VERIFY_CONTEXT *ctx, CK_BYTE *signature,
         return CKR_OK;
     }
 
-    mdctx = (EVP_MD_CTX *) ctx->context;
+    if (HMAC_CONTEXT_IS_SAVEABLE(ctx)) {
+        rv = hmac_state_final((OPENSSL_HMAC_STATE *)ctx->context, mac);
+        if (rv != CKR_OK)
+            goto done;
+    } else {
+        mdctx = (EVP_MD_CTX *) ctx->context;
 
-    rc = EVP_DigestSignFinal(mdctx, mac, &mac_len);
-    if (rc != 1) {
-        TRACE_ERROR("EVP_DigestSignFinal failed.\n");
-        rv = CKR_FUNCTION_FAILED;
-        goto done;
+        rc = EVP_DigestSignFinal(mdctx, mac, &mac_len);
+        if (rc != 1) {
+            TRACE_ERROR("EVP_DigestSignFinal failed.\n");
+            rv = CKR_FUNCTION_FAILED;
+            goto done;
+        }
     }
 
     if (sign) {
@@ -4609,7 +5543,6 @@ CK_RV openssl_specific_hmac_final(SIGN_VERIFY_CONTEXT *ctx, CK_BYTE *signature,
         }
     }
 done:
-    EVP_MD_CTX_destroy(mdctx);
-    ctx->context = NULL;
+    hmac_context_free(ctx);
     return rv;
 }
@@ -17,11 +17,16 @@
 
 #include <string.h>             // for memcmp() et al
 #include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/random.h>
 #include <fcntl.h>
 #include <unistd.h>
 
+#include <openssl/crypto.h>
+
 #include "pkcs11types.h"
 #include "defs.h"
 #include "host_defs.h"
@@ -31,27 +36,122 @@
 #include "tok_specific.h"
 #include "trace.h"
 
-//
-//
-CK_RV local_rng(CK_BYTE *output, CK_ULONG bytes)
+/*
+ * Small requests, like IVs, salts and symmetric keys, are served from a
+ * per-thread buffer of random bytes, so that most of them do not need a
+ * system call. Every byte of the buffer is handed out only once and is
+ * cleansed right away. The buffer is discarded in the child after a fork,
+ * so that parent and child never return the same bytes.
+ */
+#define RNG_BUFFER_SIZE         512
+#define RNG_BUFFERED_MAX        (RNG_BUFFER_SIZE / 4)
+
+struct rng_buffer {
+    unsigned long fork_generation;
+    CK_ULONG avail;
+    CK_BYTE data[RNG_BUFFER_SIZE];
+};
+
+static __thread struct rng_buffer rng_buffer;
+static unsigned long rng_fork_generation = 1;
+static pthread_once_t rng_atfork_once = PTHREAD_ONCE_INIT;
+
+static void rng_atfork_child(void)
+{
+    __atomic_add_fetch(&rng_fork_generation, 1, __ATOMIC_RELAXED);
+}
+
+static void rng_register_atfork(void)
+{
+    pthread_atfork(NULL, NULL, rng_atfork_child);
+}
+
+static CK_RV rng_read_device(CK_BYTE *output, CK_ULONG bytes)
 {
     int ranfd;
-    int rlen;
-    unsigned int totallen = 0;
+    ssize_t rlen;
+    CK_ULONG totallen = 0;
 
     ranfd = open("/dev/prandom", O_RDONLY);
     if (ranfd < 0)
         ranfd = open("/dev/urandom", O_RDONLY);
-    if (ranfd >= 0) {
-        do {
-            rlen = read(ranfd, output + totallen, bytes - totallen);
-            totallen += rlen;
-        } while (totallen < bytes);
-        close(ranfd);
-        return CKR_OK;
+    if (ranfd < 0)
+        return CKR_FUNCTION_FAILED;
+
+    while (totallen < bytes) {
+        rlen = read(ranfd, output + totallen, bytes - totallen);
+        if (rlen < 0 && errno == EINTR)
+            continue;
+        if (rlen <= 0) {
+            close(ranfd);
+            return CKR_FUNCTION_FAILED;
+        }
+        totallen += rlen;
+    }
+    close(ranfd);
+
+    return CKR_OK;
+}
+
+static CK_RV rng_read(CK_BYTE *output, CK_ULONG bytes)
+{
+    ssize_t rlen;
+    CK_ULONG totallen = 0;
+
+    while (totallen < bytes) {
+        rlen = getrandom(output + totallen, bytes - totallen, 0);
+        if (rlen < 0 && errno == EINTR)
+            continue;
+        if (rlen < 0) {
+            /* Kernel without getrandom(), use the device */
+            if (errno == ENOSYS)
+                return rng_read_device(output + totallen, bytes - totallen);
+            TRACE_ERROR("getrandom failed with errno: %d\n", errno);
+            return CKR_FUNCTION_FAILED;
+        }
+        totallen += rlen;
     }
 
-    return CKR_FUNCTION_FAILED;
+    return CKR_OK;
+}
+
+//
+//
+CK_RV local_rng(CK_BYTE *output, CK_ULONG bytes)
+{
+    struct rng_buffer *buf = &rng_buffer;
+    unsigned long generation;
+    CK_BYTE *p;
+    CK_RV rc;
+
+    if (bytes > RNG_BUFFERED_MAX)
+        return rng_read(output, bytes);
+
+    pthread_once(&rng_atfork_once, rng_register_atfork);
+
+    generation = __atomic_load_n(&rng_fork_generation, __ATOMIC_RELAXED);
+    if (buf->fork_generation != generation) {
+        OPENSSL_cleanse(buf->data, sizeof(buf->data));
+        buf->avail = 0;
+        buf->fork_generation = generation;
+    }
+
+    if (buf->avail < bytes) {
+        rc = rng_read(buf->data, sizeof(buf->data));
+        if (rc != CKR_OK) {
+            buf->avail = 0;
+            return rc;
+        }
+        buf->avail = sizeof(buf->data);
+    }
+
+    /* Hand out the bytes from the end of the buffer and forget them */
+    p = buf->data + buf->avail - bytes;
+    memcpy(output, p, bytes);
+    OPENSSL_cleanse(p, bytes);
+    buf->avail -= bytes;
+
+    return CKR_OK;
 }
 
 //
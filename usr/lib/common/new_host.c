@@ -47,6 +47,7 @@
 #include "trace.h"
 #include "slotmgr.h"
 #include "attributes.h"
+#include "login_broker.h"
 
 #include "../api/apiproto.h"
 #include "../api/policy.h"
@@ -54,6 +55,9 @@
 void SC_SetFunctionList(void);
 CK_RV SC_Finalize(STDLL_TokData_t *tokdata, CK_SLOT_ID sid, SLOT_INFO *sinfp,
                   struct trace_handle_t *t, CK_BBOOL in_fork_initializer);
+CK_RV SC_ForkChild(STDLL_TokData_t *tokdata, CK_SLOT_ID sid,
+                   SLOT_INFO *sinfp, struct trace_handle_t *t,
+                   CK_BBOOL check_only);
 
 /* verify that the mech specified is in the
  * mech list for this token...
@@ -231,6 +235,7 @@ CK_RV SC_Finalize(STDLL_TokData_t *tokdata, CK_SLOT_ID sid, SLOT_INFO *sinfp,
 
     tokdata->initialized = FALSE;
 
+    login_broker_stop(tokdata);
     session_mgr_close_all_sessions(tokdata);
     object_mgr_purge_token_objects(tokdata);
 
@@ -241,7 +246,12 @@ CK_RV SC_Finalize(STDLL_TokData_t *tokdata, CK_SLOT_ID sid, SLOT_INFO *sinfp,
     bt_destroy(&tokdata->priv_token_obj_btree);
     bt_destroy(&tokdata->publ_token_obj_btree);
 
-    detach_shm(tokdata, in_fork_initializer);
+    /*
+     * A forked child does not release the reference on the shared memory
+     * of its parent, only one it took itself in SC_ForkChild().
+     */
+    detach_shm(tokdata, in_fork_initializer &&
+                        tokdata->fork_shm_ref_pid != getpid());
     /* close spin lock file */
     CloseXProcLock(tokdata);
     if (token_specific.t_final != NULL) {
@@ -257,6 +267,68 @@ CK_RV SC_Finalize(STDLL_TokData_t *tokdata, CK_SLOT_ID sid, SLOT_INFO *sinfp,
     return rc;
 }
 
+/*
+ * Called in a forked child that keeps the sessions, logins and token objects
+ * inherited from its parent. The lock file descriptor is shared with the
+ * parent, and so would be its flock, so the lock file is opened again. The
+ * child also takes its own reference on the token's shared memory.
+ * With 'check_only' it is only checked whether the token supports this.
+ */
+CK_RV SC_ForkChild(STDLL_TokData_t *tokdata, CK_SLOT_ID sid,
+                   SLOT_INFO *sinfp, struct trace_handle_t *t,
+                   CK_BBOOL check_only)
+{
+    CK_RV rc;
+
+    UNUSED(sid);
+
+    if (t != NULL)
+        set_trace(*t);
+
+    if (tokdata->initialized == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
+        return CKR_CRYPTOKI_NOT_INITIALIZED;
+    }
+
+    if (token_specific.t_fork_child == NULL) {
+        TRACE_DEVEL("Token does not keep its state in a forked child.\n");
+        return CKR_FUNCTION_NOT_SUPPORTED;
+    }
+    if (check_only)
+        return CKR_OK;
+
+    if (tokdata->spinxplfd != -1)
+        close(tokdata->spinxplfd);
+
+    rc = XProcLock_Init(tokdata);
+    if (rc != CKR_OK) {
+        TRACE_ERROR("Thread lock failed.\n");
+        return rc;
+    }
+
+    rc = CreateXProcLock(sinfp->tokname, tokdata);
+    if (rc != CKR_OK) {
+        TRACE_ERROR("Process lock failed.\n");
+        return rc;
+    }
+
+    rc = fork_child_shm(tokdata);
+    if (rc != CKR_OK) {
+        TRACE_ERROR("Could not reference the shared memory.\n");
+        return rc;
+    }
+    tokdata->fork_shm_ref_pid = getpid();
+
+    /* The parent keeps serving as login broker, if it is one */
+    login_broker_stop(tokdata);
+
+    rc = token_specific.t_fork_child(tokdata);
+    if (rc != CKR_OK)
+        TRACE_ERROR("Token specific fork child call failed.\n");
+
+    return rc;
+}
+
 CK_RV SC_GetTokenInfo(STDLL_TokData_t *tokdata, CK_SLOT_ID sid,
                       CK_TOKEN_INFO_PTR pInfo)
 {
@@ -1333,6 +1405,24 @@ CK_RV SC_Login(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
             compute_md5(tokdata, pPin, ulPinLen, tokdata->user_pin_md5);
             memset(tokdata->so_pin_md5, 0x0, MD5_HASH_SIZE);
         } else {
+            /*
+             * A login broker of the token verifies the PIN and provides the
+             * keys and the decrypted private token objects.
+             */
+            rc = login_broker_attach(tokdata, pPin, ulPinLen);
+            if (rc == CKR_OK) {
+                /* Successful login, clear flags */
+                *flags &= ~(CKF_USER_PIN_LOCKED |
+                            CKF_USER_PIN_FINAL_TRY | CKF_USER_PIN_COUNT_LOW);
+                goto done;
+            }
+            if (rc == CKR_PIN_INCORRECT || rc == CKR_PIN_LOCKED) {
+                TRACE_ERROR("%s\n", ock_err(rc == CKR_PIN_LOCKED ?
+                                             ERR_PIN_LOCKED :
+                                             ERR_PIN_INCORRECT));
+                goto done;
+            }
+
             rc = compute_PKCS5_PBKDF2_HMAC(tokdata, pPin, ulPinLen,
                                            dat->user_login_salt, 64,
                                            dat->user_login_it, EVP_sha512(),
@@ -1342,6 +1432,18 @@ CK_RV SC_Login(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
                 goto done;
             }
 
+            /*
+             * Verify the PIN before deriving the wrap key, so that a wrong
+             * PIN only costs one key derivation.
+             */
+            if (CRYPTO_memcmp(dat->user_login_key,
+                              login_key, 256 / 8) != 0) {
+                set_login_flags(userType, flags);
+                TRACE_ERROR("%s\n", ock_err(ERR_PIN_INCORRECT));
+                rc = CKR_PIN_INCORRECT;
+                goto done;
+            }
+
             rc = compute_PKCS5_PBKDF2_HMAC(tokdata, pPin, ulPinLen,
                                            dat->user_wrap_salt, 64,
                                            dat->user_wrap_it, EVP_sha512(),
@@ -1351,14 +1453,6 @@ CK_RV SC_Login(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
                 goto done;
             }
 
-            if (CRYPTO_memcmp(dat->user_login_key,
-                              login_key, 256 / 8) != 0) {
-                set_login_flags(userType, flags);
-                TRACE_ERROR("%s\n", ock_err(ERR_PIN_INCORRECT));
-                rc = CKR_PIN_INCORRECT;
-                goto done;
-            }
-
             /* Successful login, clear flags */
             *flags &= ~(CKF_USER_PIN_LOCKED |
                         CKF_USER_PIN_FINAL_TRY | CKF_USER_PIN_COUNT_LOW);
@@ -1391,6 +1485,8 @@ CK_RV SC_Login(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
             TRACE_ERROR("Failed to release process lock.\n");
             goto done;
         }
+
+        login_broker_start(tokdata, pPin, ulPinLen);
     } else {
         if (*flags & CKF_SO_PIN_LOCKED) {
             TRACE_ERROR("%s\n", ock_err(ERR_PIN_LOCKED));
@@ -1443,6 +1539,18 @@ CK_RV SC_Login(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
                 goto done;
             }
 
+            /*
+             * Verify the PIN before deriving the wrap key, so that a wrong
+             * PIN only costs one key derivation.
+             */
+            if (CRYPTO_memcmp(dat->so_login_key,
+                              login_key, 256 / 8) != 0) {
+                set_login_flags(userType, flags);
+                TRACE_ERROR("%s\n", ock_err(ERR_PIN_INCORRECT));
+                rc = CKR_PIN_INCORRECT;
+                goto done;
+            }
+
             rc = compute_PKCS5_PBKDF2_HMAC(tokdata, pPin, ulPinLen,
                                            dat->so_wrap_salt, 64,
                                            dat->so_wrap_it, EVP_sha512(),
@@ -1452,14 +1560,6 @@ CK_RV SC_Login(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
                 goto done;
             }
 
-            if (CRYPTO_memcmp(dat->so_login_key,
-                              login_key, 256 / 8) != 0) {
-                set_login_flags(userType, flags);
-                TRACE_ERROR("%s\n", ock_err(ERR_PIN_INCORRECT));
-                rc = CKR_PIN_INCORRECT;
-                goto done;
-            }
-
             /* Successful login, clear flags */
             *flags &= ~(CKF_SO_PIN_LOCKED | CKF_SO_PIN_FINAL_TRY |
                         CKF_SO_PIN_COUNT_LOW);
@@ -1537,6 +1637,7 @@ CK_RV SC_Logout(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession)
     memset(tokdata->user_pin_md5, 0x0, MD5_HASH_SIZE);
     memset(tokdata->so_pin_md5, 0x0, MD5_HASH_SIZE);
 
+    login_broker_stop(tokdata);
     object_mgr_purge_private_token_objects(tokdata);
 
 done:
@@ -1938,20 +2039,13 @@ CK_RV SC_FindObjects(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
         goto done;
     }
 
-    if (!sess->find_list) {
-        TRACE_DEVEL("sess->find_list is NULL.\n");
-        rc = CKR_OPERATION_NOT_INITIALIZED;
+    rc = object_mgr_find(tokdata, sess, phObject, ulMaxObjectCount, &count);
+    if (rc != CKR_OK) {
+        TRACE_DEVEL("object_mgr_find() failed.\n");
         goto done;
     }
-    count = MIN(ulMaxObjectCount, (sess->find_count - sess->find_idx));
-
-    memcpy(phObject, sess->find_list + sess->find_idx,
-           count * sizeof(CK_OBJECT_HANDLE));
     *pulObjectCount = count;
 
-    sess->find_idx += count;
-    rc = CKR_OK;
-
 done:
     TRACE_INFO("C_FindObjects: rc = 0x%08lx, returned %lu objects\n",
                rc, count);
@@ -1988,15 +2082,7 @@ CK_RV SC_FindObjectsFinal(STDLL_TokData_t *tokdata,
         goto done;
     }
 
-    if (sess->find_list)
-        free(sess->find_list);
-
-    sess->find_list = NULL;
-    sess->find_len = 0;
-    sess->find_idx = 0;
-    sess->find_active = FALSE;
-
-    rc = CKR_OK;
+    rc = object_mgr_find_final(sess);
 
 done:
     TRACE_INFO("C_FindObjectsFinal: rc = 0x%08lx\n", rc);
@@ -3967,15 +4053,9 @@ CK_RV SC_CancelFunction(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession)
     return CKR_FUNCTION_NOT_PARALLEL;
 }
 
-CK_RV SC_IBM_ReencryptSingle(STDLL_TokData_t *tokdata, ST_SESSION_T *sSession,
-                             CK_MECHANISM_PTR pDecrMech,
-                             CK_OBJECT_HANDLE hDecrKey,
-                             CK_MECHANISM_PTR pEncrMech,
-                             CK_OBJECT_HANDLE hEncrKey,
-                             CK_BYTE_PTR pEncryptedData,
-                             CK_ULONG ulEncryptedDataLen,
-                             CK_BYTE_PTR pReencryptedData,
-                             CK_ULONG_PTR pulReencryptedDataLen)
+CK_RV SC_MessageEncryptInit(STDLL_TokData_t *tokdata,
+                            ST_SESSION_HANDLE *sSession,
+                            CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
 {
     SESSION *sess = NULL;
     CK_RV rc = CKR_OK;
@@ -3986,12 +4066,16 @@ CK_RV SC_IBM_ReencryptSingle(STDLL_TokData_t *tokdata, ST_SESSION_T *sSession,
         goto done;
     }
 
-    if (!pDecrMech || !pEncrMech) {
+    if (!pMechanism) {
         TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
         rc = CKR_ARGUMENTS_BAD;
         goto done;
     }
 
+    rc = valid_mech(tokdata, pMechanism, CKF_MESSAGE_ENCRYPT);
+    if (rc != CKR_OK)
+        goto done;
+
     sess = session_mgr_find_reset_error(tokdata, sSession->sessionh);
     if (!sess) {
         TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
@@ -3999,13 +4083,6 @@ CK_RV SC_IBM_ReencryptSingle(STDLL_TokData_t *tokdata, ST_SESSION_T *sSession,
         goto done;
     }
 
-    rc = valid_mech(tokdata, pDecrMech, CKF_DECRYPT);
-    if (rc != CKR_OK)
-        goto done;
-    rc = valid_mech(tokdata, pEncrMech, CKF_ENCRYPT);
-    if (rc != CKR_OK)
-        goto done;
-
     if (pin_expired(&sess->session_info,
                     tokdata->nv_token_data->token_info.flags) == TRUE) {
         TRACE_ERROR("%s\n", ock_err(ERR_PIN_EXPIRED));
@@ -4013,27 +4090,20 @@ CK_RV SC_IBM_ReencryptSingle(STDLL_TokData_t *tokdata, ST_SESSION_T *sSession,
         goto done;
     }
 
-    if (sess->decr_ctx.active == TRUE || sess->encr_ctx.active == TRUE) {
-        rc = CKR_OPERATION_ACTIVE;
+    if (sess->msg_encr_ctx.active == TRUE) {
         TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_ACTIVE));
+        rc = CKR_OPERATION_ACTIVE;
         goto done;
     }
 
-    sess->decr_ctx.count_statistics = TRUE;
-    sess->encr_ctx.count_statistics = TRUE;
-    rc = encr_mgr_reencrypt_single(tokdata, sess, &sess->decr_ctx, pDecrMech,
-                                   hDecrKey, &sess->encr_ctx, pEncrMech,
-                                   hEncrKey, pEncryptedData, ulEncryptedDataLen,
-                                   pReencryptedData, pulReencryptedDataLen);
-    if (rc != CKR_OK)
-        TRACE_DEVEL("encr_mgr_reencrypt_single() failed.\n");
+    sess->msg_encr_ctx.count_statistics = TRUE;
+    rc = encr_mgr_msg_init(tokdata, sess, &sess->msg_encr_ctx, pMechanism,
+                           hKey, TRUE);
 
 done:
-    TRACE_INFO("SC_IBM_ReencryptSingle: rc = 0x%08lx, sess = %ld, "
-               "decrmech = 0x%lx, encrmech = 0x%lx\n",
+    TRACE_INFO("C_MessageEncryptInit: rc = 0x%08lx, sess = %ld, mech = 0x%lx\n",
                rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle,
-               (pDecrMech ? pDecrMech->mechanism : (CK_ULONG)-1),
-               (pEncrMech ? pEncrMech->mechanism : (CK_ULONG)-1));
+               (pMechanism ? pMechanism->mechanism : (CK_ULONG)(-1)));
 
     if (sess != NULL)
         session_mgr_put(tokdata, sess);
@@ -4041,89 +4111,737 @@ done:
     return rc;
 }
 
-CK_RV SC_HandleEvent(STDLL_TokData_t *tokdata, unsigned int event_type,
-                     unsigned int event_flags, const char *payload,
-                     unsigned int payload_len)
+/*
+ * Errors do not end the message-based operation, only
+ * C_MessageEncryptFinal does.
+ */
+CK_RV SC_EncryptMessage(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
+                        CK_VOID_PTR pParameter, CK_ULONG ulParameterLen,
+                        CK_BYTE_PTR pAssociatedData,
+                        CK_ULONG ulAssociatedDataLen,
+                        CK_BYTE_PTR pPlaintext, CK_ULONG ulPlaintextLen,
+                        CK_BYTE_PTR pCiphertext, CK_ULONG_PTR pulCiphertextLen)
 {
-    CK_RV rc;
+    SESSION *sess = NULL;
+    CK_BBOOL length_only = FALSE;
+    CK_RV rc = CKR_OK;
 
-    if (token_specific.t_handle_event == NULL)
-        return CKR_FUNCTION_NOT_SUPPORTED;
+    if (tokdata->initialized == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
+        rc = CKR_CRYPTOKI_NOT_INITIALIZED;
+        goto done;
+    }
 
-    rc = token_specific.t_handle_event(tokdata, event_type, event_flags,
-                                       payload, payload_len);
+    sess = session_mgr_find_reset_error(tokdata, sSession->sessionh);
+    if (!sess) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        rc = CKR_SESSION_HANDLE_INVALID;
+        goto done;
+    }
 
-    TRACE_INFO("SC_HandleEvent: rc = 0x%08lx, event_type = 0x%08x, "
-               "event_flags = 0x%08x\n", rc, event_type, event_flags);
+    if (!pParameter || (!pPlaintext && ulPlaintextLen != 0) ||
+        (!pAssociatedData && ulAssociatedDataLen != 0) || !pulCiphertextLen) {
+        TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
+        rc = CKR_ARGUMENTS_BAD;
+        goto done;
+    }
+
+    if (sess->msg_encr_ctx.active == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_NOT_INITIALIZED));
+        rc = CKR_OPERATION_NOT_INITIALIZED;
+        goto done;
+    }
+
+    if (!pCiphertext)
+        length_only = TRUE;
+
+    rc = encr_mgr_encrypt_msg(tokdata, sess, length_only, &sess->msg_encr_ctx,
+                              pParameter, ulParameterLen,
+                              pAssociatedData, ulAssociatedDataLen,
+                              pPlaintext, ulPlaintextLen,
+                              pCiphertext, pulCiphertextLen);
+    if (rc != CKR_OK)
+        TRACE_DEVEL("encr_mgr_encrypt_msg() failed.\n");
+
+done:
+    TRACE_INFO("C_EncryptMessage: rc = 0x%08lx, sess = %ld, amount = %lu\n",
+               rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle,
+               ulPlaintextLen);
+
+    if (sess != NULL)
+        session_mgr_put(tokdata, sess);
 
     return rc;
 }
 
-void SC_SetFunctionList(void)
+CK_RV SC_MessageEncryptFinal(STDLL_TokData_t *tokdata,
+                             ST_SESSION_HANDLE *sSession)
 {
-    function_list.ST_Initialize = ST_Initialize;
-    function_list.ST_GetTokenInfo = SC_GetTokenInfo;
-    function_list.ST_GetMechanismList = SC_GetMechanismList;
-    function_list.ST_GetMechanismInfo = SC_GetMechanismInfo;
-    function_list.ST_InitToken = SC_InitToken;
-    function_list.ST_InitPIN = SC_InitPIN;
-    function_list.ST_SetPIN = SC_SetPIN;
-    function_list.ST_OpenSession = SC_OpenSession;
-    function_list.ST_CloseSession = SC_CloseSession;
-    function_list.ST_GetSessionInfo = SC_GetSessionInfo;
-    function_list.ST_GetOperationState = SC_GetOperationState;
-    function_list.ST_SetOperationState = SC_SetOperationState;
-    function_list.ST_Login = SC_Login;
-    function_list.ST_Logout = SC_Logout;
-    function_list.ST_CreateObject = SC_CreateObject;
-    function_list.ST_CopyObject = SC_CopyObject;
-    function_list.ST_DestroyObject = SC_DestroyObject;
-    function_list.ST_GetObjectSize = SC_GetObjectSize;
-    function_list.ST_GetAttributeValue = SC_GetAttributeValue;
-    function_list.ST_SetAttributeValue = SC_SetAttributeValue;
-    function_list.ST_FindObjectsInit = SC_FindObjectsInit;
-    function_list.ST_FindObjects = SC_FindObjects;
-    function_list.ST_FindObjectsFinal = SC_FindObjectsFinal;
-    function_list.ST_EncryptInit = SC_EncryptInit;
-    function_list.ST_Encrypt = SC_Encrypt;
-    function_list.ST_EncryptUpdate = SC_EncryptUpdate;
-    function_list.ST_EncryptFinal = SC_EncryptFinal;
-    function_list.ST_DecryptInit = SC_DecryptInit;
-    function_list.ST_Decrypt = SC_Decrypt;
-    function_list.ST_DecryptUpdate = SC_DecryptUpdate;
-    function_list.ST_DecryptFinal = SC_DecryptFinal;
-    function_list.ST_DigestInit = SC_DigestInit;
-    function_list.ST_Digest = SC_Digest;
-    function_list.ST_DigestUpdate = SC_DigestUpdate;
-    function_list.ST_DigestKey = SC_DigestKey;
-    function_list.ST_DigestFinal = SC_DigestFinal;
-    function_list.ST_SignInit = SC_SignInit;
-    function_list.ST_Sign = SC_Sign;
-    function_list.ST_SignUpdate = SC_SignUpdate;
-    function_list.ST_SignFinal = SC_SignFinal;
-    function_list.ST_SignRecoverInit = SC_SignRecoverInit;
-    function_list.ST_SignRecover = SC_SignRecover;
-    function_list.ST_VerifyInit = SC_VerifyInit;
-    function_list.ST_Verify = SC_Verify;
-    function_list.ST_VerifyUpdate = SC_VerifyUpdate;
-    function_list.ST_VerifyFinal = SC_VerifyFinal;
-    function_list.ST_VerifyRecoverInit = SC_VerifyRecoverInit;
-    function_list.ST_VerifyRecover = SC_VerifyRecover;
-    function_list.ST_DigestEncryptUpdate = NULL;      // SC_DigestEncryptUpdate;
-    function_list.ST_DecryptDigestUpdate = NULL;      // SC_DecryptDigestUpdate;
-    function_list.ST_SignEncryptUpdate = NULL;  //SC_SignEncryptUpdate;
-    function_list.ST_DecryptVerifyUpdate = NULL;      // SC_DecryptVerifyUpdate;
-    function_list.ST_GenerateKey = SC_GenerateKey;
-    function_list.ST_GenerateKeyPair = SC_GenerateKeyPair;
-    function_list.ST_WrapKey = SC_WrapKey;
-    function_list.ST_UnwrapKey = SC_UnwrapKey;
-    function_list.ST_DeriveKey = SC_DeriveKey;
-    function_list.ST_SeedRandom = SC_SeedRandom;
-    function_list.ST_GenerateRandom = SC_GenerateRandom;
-    function_list.ST_GetFunctionStatus = NULL;  // SC_GetFunctionStatus;
-    function_list.ST_CancelFunction = NULL;     // SC_CancelFunction;
+    SESSION *sess = NULL;
+    CK_RV rc = CKR_OK;
 
-    function_list.ST_IBM_ReencryptSingle = SC_IBM_ReencryptSingle;
+    if (tokdata->initialized == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
+        rc = CKR_CRYPTOKI_NOT_INITIALIZED;
+        goto done;
+    }
+
+    sess = session_mgr_find_reset_error(tokdata, sSession->sessionh);
+    if (!sess) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        rc = CKR_SESSION_HANDLE_INVALID;
+        goto done;
+    }
+
+    if (sess->msg_encr_ctx.active == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_NOT_INITIALIZED));
+        rc = CKR_OPERATION_NOT_INITIALIZED;
+        goto done;
+    }
+
+    rc = encr_mgr_cleanup(tokdata, sess, &sess->msg_encr_ctx);
+
+done:
+    TRACE_INFO("C_MessageEncryptFinal: rc = 0x%08lx, sess = %ld\n",
+               rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle);
+
+    if (sess != NULL)
+        session_mgr_put(tokdata, sess);
+
+    return rc;
+}
+
+CK_RV SC_MessageDecryptInit(STDLL_TokData_t *tokdata,
+                            ST_SESSION_HANDLE *sSession,
+                            CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
+{
+    SESSION *sess = NULL;
+    CK_RV rc = CKR_OK;
+
+    if (tokdata->initialized == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
+        rc = CKR_CRYPTOKI_NOT_INITIALIZED;
+        goto done;
+    }
+
+    if (!pMechanism) {
+        TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
+        rc = CKR_ARGUMENTS_BAD;
+        goto done;
+    }
+
+    rc = valid_mech(tokdata, pMechanism, CKF_MESSAGE_DECRYPT);
+    if (rc != CKR_OK)
+        goto done;
+
+    sess = session_mgr_find_reset_error(tokdata, sSession->sessionh);
+    if (!sess) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        rc = CKR_SESSION_HANDLE_INVALID;
+        goto done;
+    }
+
+    if (pin_expired(&sess->session_info,
+                    tokdata->nv_token_data->token_info.flags) == TRUE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_PIN_EXPIRED));
+        rc = CKR_PIN_EXPIRED;
+        goto done;
+    }
+
+    if (sess->msg_decr_ctx.active == TRUE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_ACTIVE));
+        rc = CKR_OPERATION_ACTIVE;
+        goto done;
+    }
+
+    sess->msg_decr_ctx.count_statistics = TRUE;
+    rc = decr_mgr_msg_init(tokdata, sess, &sess->msg_decr_ctx, pMechanism,
+                           hKey, TRUE);
+
+done:
+    TRACE_INFO("C_MessageDecryptInit: rc = 0x%08lx, sess = %ld, mech = 0x%lx\n",
+               rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle,
+               (pMechanism ? pMechanism->mechanism : (CK_ULONG)(-1)));
+
+    if (sess != NULL)
+        session_mgr_put(tokdata, sess);
+
+    return rc;
+}
+
+/*
+ * Errors do not end the message-based operation, only
+ * C_MessageDecryptFinal does.
+ */
+CK_RV SC_DecryptMessage(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
+                        CK_VOID_PTR pParameter, CK_ULONG ulParameterLen,
+                        CK_BYTE_PTR pAssociatedData,
+                        CK_ULONG ulAssociatedDataLen,
+                        CK_BYTE_PTR pCiphertext, CK_ULONG ulCiphertextLen,
+                        CK_BYTE_PTR pPlaintext, CK_ULONG_PTR pulPlaintextLen)
+{
+    SESSION *sess = NULL;
+    CK_BBOOL length_only = FALSE;
+    CK_RV rc = CKR_OK;
+
+    if (tokdata->initialized == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
+        rc = CKR_CRYPTOKI_NOT_INITIALIZED;
+        goto done;
+    }
+
+    sess = session_mgr_find_reset_error(tokdata, sSession->sessionh);
+    if (!sess) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        rc = CKR_SESSION_HANDLE_INVALID;
+        goto done;
+    }
+
+    if (!pParameter || (!pCiphertext && ulCiphertextLen != 0) ||
+        (!pAssociatedData && ulAssociatedDataLen != 0) || !pulPlaintextLen) {
+        TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
+        rc = CKR_ARGUMENTS_BAD;
+        goto done;
+    }
+
+    if (sess->msg_decr_ctx.active == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_NOT_INITIALIZED));
+        rc = CKR_OPERATION_NOT_INITIALIZED;
+        goto done;
+    }
+
+    if (!pPlaintext)
+        length_only = TRUE;
+
+    rc = decr_mgr_decrypt_msg(tokdata, sess, length_only, &sess->msg_decr_ctx,
+                              pParameter, ulParameterLen,
+                              pAssociatedData, ulAssociatedDataLen,
+                              pCiphertext, ulCiphertextLen,
+                              pPlaintext, pulPlaintextLen);
+    if (rc != CKR_OK)
+        TRACE_DEVEL("decr_mgr_decrypt_msg() failed.\n");
+
+done:
+    TRACE_INFO("C_DecryptMessage: rc = 0x%08lx, sess = %ld, amount = %lu\n",
+               rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle,
+               ulCiphertextLen);
+
+    if (sess != NULL)
+        session_mgr_put(tokdata, sess);
+
+    return rc;
+}
+
+CK_RV SC_MessageDecryptFinal(STDLL_TokData_t *tokdata,
+                             ST_SESSION_HANDLE *sSession)
+{
+    SESSION *sess = NULL;
+    CK_RV rc = CKR_OK;
+
+    if (tokdata->initialized == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
+        rc = CKR_CRYPTOKI_NOT_INITIALIZED;
+        goto done;
+    }
+
+    sess = session_mgr_find_reset_error(tokdata, sSession->sessionh);
+    if (!sess) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        rc = CKR_SESSION_HANDLE_INVALID;
+        goto done;
+    }
+
+    if (sess->msg_decr_ctx.active == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_NOT_INITIALIZED));
+        rc = CKR_OPERATION_NOT_INITIALIZED;
+        goto done;
+    }
+
+    rc = decr_mgr_cleanup(tokdata, sess, &sess->msg_decr_ctx);
+
+done:
+    TRACE_INFO("C_MessageDecryptFinal: rc = 0x%08lx, sess = %ld\n",
+               rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle);
+
+    if (sess != NULL)
+        session_mgr_put(tokdata, sess);
+
+    return rc;
+}
+
+CK_RV SC_MessageSignInit(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
+                         CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
+{
+    SESSION *sess = NULL;
+    CK_RV rc = CKR_OK;
+
+    if (tokdata->initialized == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
+        rc = CKR_CRYPTOKI_NOT_INITIALIZED;
+        goto done;
+    }
+
+    if (!pMechanism) {
+        TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
+        rc = CKR_ARGUMENTS_BAD;
+        goto done;
+    }
+
+    rc = valid_mech(tokdata, pMechanism, CKF_MESSAGE_SIGN);
+    if (rc != CKR_OK)
+        goto done;
+
+    sess = session_mgr_find_reset_error(tokdata, sSession->sessionh);
+    if (!sess) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        rc = CKR_SESSION_HANDLE_INVALID;
+        goto done;
+    }
+
+    if (pin_expired(&sess->session_info,
+                    tokdata->nv_token_data->token_info.flags) == TRUE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_PIN_EXPIRED));
+        rc = CKR_PIN_EXPIRED;
+        goto done;
+    }
+
+    if (sess->msg_sign_ctx.active == TRUE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_ACTIVE));
+        rc = CKR_OPERATION_ACTIVE;
+        goto done;
+    }
+
+    sess->msg_sign_ctx.count_statistics = TRUE;
+    rc = sign_mgr_msg_init(tokdata, sess, &sess->msg_sign_ctx, pMechanism,
+                           hKey, TRUE);
+    if (rc != CKR_OK)
+        TRACE_DEVEL("sign_mgr_msg_init() failed.\n");
+
+done:
+    TRACE_INFO("C_MessageSignInit: rc = 0x%08lx, sess = %ld, mech = 0x%lx\n",
+               rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle,
+               (pMechanism ? pMechanism->mechanism : (CK_ULONG)(-1)));
+
+    if (sess != NULL)
+        session_mgr_put(tokdata, sess);
+
+    return rc;
+}
+
+/*
+ * Errors do not end the message-based operation, only
+ * C_MessageSignFinal does.
+ */
+CK_RV SC_SignMessage(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
+                     CK_VOID_PTR pParameter, CK_ULONG ulParameterLen,
+                     CK_BYTE_PTR pData, CK_ULONG ulDataLen,
+                     CK_BYTE_PTR pSignature, CK_ULONG_PTR pulSignatureLen)
+{
+    SESSION *sess = NULL;
+    CK_BBOOL length_only = FALSE;
+    CK_RV rc = CKR_OK;
+
+    if (tokdata->initialized == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
+        rc = CKR_CRYPTOKI_NOT_INITIALIZED;
+        goto done;
+    }
+
+    sess = session_mgr_find_reset_error(tokdata, sSession->sessionh);
+    if (!sess) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        rc = CKR_SESSION_HANDLE_INVALID;
+        goto done;
+    }
+
+    if (!pData || !pulSignatureLen) {
+        TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
+        rc = CKR_ARGUMENTS_BAD;
+        goto done;
+    }
+
+    if (sess->msg_sign_ctx.active == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_NOT_INITIALIZED));
+        rc = CKR_OPERATION_NOT_INITIALIZED;
+        goto done;
+    }
+
+    if (!pSignature)
+        length_only = TRUE;
+
+    rc = sign_mgr_sign_msg(tokdata, sess, length_only, &sess->msg_sign_ctx,
+                           pParameter, ulParameterLen, pData, ulDataLen,
+                           pSignature, pulSignatureLen);
+    if (rc != CKR_OK)
+        TRACE_DEVEL("sign_mgr_sign_msg() failed.\n");
+
+done:
+    TRACE_INFO("C_SignMessage: rc = 0x%08lx, sess = %ld, datalen = %lu\n",
+               rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle, ulDataLen);
+
+    if (sess != NULL)
+        session_mgr_put(tokdata, sess);
+
+    return rc;
+}
+
+CK_RV SC_MessageSignFinal(STDLL_TokData_t *tokdata,
+                          ST_SESSION_HANDLE *sSession)
+{
+    SESSION *sess = NULL;
+    CK_RV rc = CKR_OK;
+
+    if (tokdata->initialized == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
+        rc = CKR_CRYPTOKI_NOT_INITIALIZED;
+        goto done;
+    }
+
+    sess = session_mgr_find_reset_error(tokdata, sSession->sessionh);
+    if (!sess) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        rc = CKR_SESSION_HANDLE_INVALID;
+        goto done;
+    }
+
+    if (sess->msg_sign_ctx.active == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_NOT_INITIALIZED));
+        rc = CKR_OPERATION_NOT_INITIALIZED;
+        goto done;
+    }
+
+    rc = sign_mgr_cleanup(tokdata, sess, &sess->msg_sign_ctx);
+
+done:
+    TRACE_INFO("C_MessageSignFinal: rc = 0x%08lx, sess = %ld\n",
+               rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle);
+
+    if (sess != NULL)
+        session_mgr_put(tokdata, sess);
+
+    return rc;
+}
+
+CK_RV SC_MessageVerifyInit(STDLL_TokData_t *tokdata,
+                           ST_SESSION_HANDLE *sSession,
+                           CK_MECHANISM_PTR pMechanism, CK_OBJECT_HANDLE hKey)
+{
+    SESSION *sess = NULL;
+    CK_RV rc = CKR_OK;
+
+    if (tokdata->initialized == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
+        rc = CKR_CRYPTOKI_NOT_INITIALIZED;
+        goto done;
+    }
+
+    if (!pMechanism) {
+        TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
+        rc = CKR_ARGUMENTS_BAD;
+        goto done;
+    }
+
+    rc = valid_mech(tokdata, pMechanism, CKF_MESSAGE_VERIFY);
+    if (rc != CKR_OK)
+        goto done;
+
+    sess = session_mgr_find_reset_error(tokdata, sSession->sessionh);
+    if (!sess) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        rc = CKR_SESSION_HANDLE_INVALID;
+        goto done;
+    }
+
+    if (pin_expired(&sess->session_info,
+                    tokdata->nv_token_data->token_info.flags) == TRUE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_PIN_EXPIRED));
+        rc = CKR_PIN_EXPIRED;
+        goto done;
+    }
+
+    if (sess->msg_verify_ctx.active == TRUE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_ACTIVE));
+        rc = CKR_OPERATION_ACTIVE;
+        goto done;
+    }
+
+    sess->msg_verify_ctx.count_statistics = TRUE;
+    rc = verify_mgr_msg_init(tokdata, sess, &sess->msg_verify_ctx, pMechanism,
+                             hKey, TRUE);
+    if (rc != CKR_OK)
+        TRACE_DEVEL("verify_mgr_msg_init() failed.\n");
+
+done:
+    TRACE_INFO("C_MessageVerifyInit: rc = 0x%08lx, sess = %ld, mech = 0x%lx\n",
+               rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle,
+               (pMechanism ? pMechanism->mechanism : (CK_ULONG)(-1)));
+
+    if (sess != NULL)
+        session_mgr_put(tokdata, sess);
+
+    return rc;
+}
+
+/*
+ * Errors do not end the message-based operation, only
+ * C_MessageVerifyFinal does.
+ */
+CK_RV SC_VerifyMessage(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
+                       CK_VOID_PTR pParameter, CK_ULONG ulParameterLen,
+                       CK_BYTE_PTR pData, CK_ULONG ulDataLen,
+                       CK_BYTE_PTR pSignature, CK_ULONG ulSignatureLen)
+{
+    SESSION *sess = NULL;
+    CK_RV rc = CKR_OK;
+
+    if (tokdata->initialized == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
+        rc = CKR_CRYPTOKI_NOT_INITIALIZED;
+        goto done;
+    }
+
+    sess = session_mgr_find_reset_error(tokdata, sSession->sessionh);
+    if (!sess) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        rc = CKR_SESSION_HANDLE_INVALID;
+        goto done;
+    }
+
+    if (!pData || !pSignature) {
+        TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
+        rc = CKR_ARGUMENTS_BAD;
+        goto done;
+    }
+
+    if (sess->msg_verify_ctx.active == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_NOT_INITIALIZED));
+        rc = CKR_OPERATION_NOT_INITIALIZED;
+        goto done;
+    }
+
+    rc = verify_mgr_verify_msg(tokdata, sess, &sess->msg_verify_ctx,
+                               pParameter, ulParameterLen, pData, ulDataLen,
+                               pSignature, ulSignatureLen);
+    if (rc != CKR_OK)
+        TRACE_DEVEL("verify_mgr_verify_msg() failed.\n");
+
+done:
+    TRACE_INFO("C_VerifyMessage: rc = 0x%08lx, sess = %ld, datalen = %lu\n",
+               rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle, ulDataLen);
+
+    if (sess != NULL)
+        session_mgr_put(tokdata, sess);
+
+    return rc;
+}
+
+CK_RV SC_MessageVerifyFinal(STDLL_TokData_t *tokdata,
+                            ST_SESSION_HANDLE *sSession)
+{
+    SESSION *sess = NULL;
+    CK_RV rc = CKR_OK;
+
+    if (tokdata->initialized == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
+        rc = CKR_CRYPTOKI_NOT_INITIALIZED;
+        goto done;
+    }
+
+    sess = session_mgr_find_reset_error(tokdata, sSession->sessionh);
+    if (!sess) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        rc = CKR_SESSION_HANDLE_INVALID;
+        goto done;
+    }
+
+    if (sess->msg_verify_ctx.active == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_NOT_INITIALIZED));
+        rc = CKR_OPERATION_NOT_INITIALIZED;
+        goto done;
+    }
+
+    rc = verify_mgr_cleanup(tokdata, sess, &sess->msg_verify_ctx);
+
+done:
+    TRACE_INFO("C_MessageVerifyFinal: rc = 0x%08lx, sess = %ld\n",
+               rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle);
+
+    if (sess != NULL)
+        session_mgr_put(tokdata, sess);
+
+    return rc;
+}
+
+CK_RV SC_IBM_ReencryptSingle(STDLL_TokData_t *tokdata, ST_SESSION_T *sSession,
+                             CK_MECHANISM_PTR pDecrMech,
+                             CK_OBJECT_HANDLE hDecrKey,
+                             CK_MECHANISM_PTR pEncrMech,
+                             CK_OBJECT_HANDLE hEncrKey,
+                             CK_BYTE_PTR pEncryptedData,
+                             CK_ULONG ulEncryptedDataLen,
+                             CK_BYTE_PTR pReencryptedData,
+                             CK_ULONG_PTR pulReencryptedDataLen)
+{
+    SESSION *sess = NULL;
+    CK_RV rc = CKR_OK;
+
+    if (tokdata->initialized == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_CRYPTOKI_NOT_INITIALIZED));
+        rc = CKR_CRYPTOKI_NOT_INITIALIZED;
+        goto done;
+    }
+
+    if (!pDecrMech || !pEncrMech) {
+        TRACE_ERROR("%s\n", ock_err(ERR_ARGUMENTS_BAD));
+        rc = CKR_ARGUMENTS_BAD;
+        goto done;
+    }
+
+    sess = session_mgr_find_reset_error(tokdata, sSession->sessionh);
+    if (!sess) {
+        TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
+        rc = CKR_SESSION_HANDLE_INVALID;
+        goto done;
+    }
+
+    rc = valid_mech(tokdata, pDecrMech, CKF_DECRYPT);
+    if (rc != CKR_OK)
+        goto done;
+    rc = valid_mech(tokdata, pEncrMech, CKF_ENCRYPT);
+    if (rc != CKR_OK)
+        goto done;
+
+    if (pin_expired(&sess->session_info,
+                    tokdata->nv_token_data->token_info.flags) == TRUE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_PIN_EXPIRED));
+        rc = CKR_PIN_EXPIRED;
+        goto done;
+    }
+
+    if (sess->decr_ctx.active == TRUE || sess->encr_ctx.active == TRUE) {
+        rc = CKR_OPERATION_ACTIVE;
+        TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_ACTIVE));
+        goto done;
+    }
+
+    sess->decr_ctx.count_statistics = TRUE;
+    sess->encr_ctx.count_statistics = TRUE;
+    rc = encr_mgr_reencrypt_single(tokdata, sess, &sess->decr_ctx, pDecrMech,
+                                   hDecrKey, &sess->encr_ctx, pEncrMech,
+                                   hEncrKey, pEncryptedData, ulEncryptedDataLen,
+                                   pReencryptedData, pulReencryptedDataLen);
+    if (rc != CKR_OK)
+        TRACE_DEVEL("encr_mgr_reencrypt_single() failed.\n");
+
+done:
+    TRACE_INFO("SC_IBM_ReencryptSingle: rc = 0x%08lx, sess = %ld, "
+               "decrmech = 0x%lx, encrmech = 0x%lx\n",
+               rc, (sess == NULL) ? -1 : (CK_LONG) sess->handle,
+               (pDecrMech ? pDecrMech->mechanism : (CK_ULONG)-1),
+               (pEncrMech ? pEncrMech->mechanism : (CK_ULONG)-1));
+
+    if (sess != NULL)
+        session_mgr_put(tokdata, sess);
+
+    return rc;
+}
+
+CK_RV SC_HandleEvent(STDLL_TokData_t *tokdata, unsigned int event_type,
+                     unsigned int event_flags, const char *payload,
+                     unsigned int payload_len)
+{
+    CK_RV rc;
+
+    if (token_specific.t_handle_event == NULL)
+        return CKR_FUNCTION_NOT_SUPPORTED;
+
+    rc = token_specific.t_handle_event(tokdata, event_type, event_flags,
+                                       payload, payload_len);
+
+    TRACE_INFO("SC_HandleEvent: rc = 0x%08lx, event_type = 0x%08x, "
+               "event_flags = 0x%08x\n", rc, event_type, event_flags);
+
+    return rc;
+}
+
+void SC_SetFunctionList(void)
+{
+    function_list.ST_Initialize = ST_Initialize;
+    function_list.ST_GetTokenInfo = SC_GetTokenInfo;
+    function_list.ST_GetMechanismList = SC_GetMechanismList;
+    function_list.ST_GetMechanismInfo = SC_GetMechanismInfo;
+    function_list.ST_InitToken = SC_InitToken;
+    function_list.ST_InitPIN = SC_InitPIN;
+    function_list.ST_SetPIN = SC_SetPIN;
+    function_list.ST_OpenSession = SC_OpenSession;
+    function_list.ST_CloseSession = SC_CloseSession;
+    function_list.ST_GetSessionInfo = SC_GetSessionInfo;
+    function_list.ST_GetOperationState = SC_GetOperationState;
+    function_list.ST_SetOperationState = SC_SetOperationState;
+    function_list.ST_Login = SC_Login;
+    function_list.ST_Logout = SC_Logout;
+    function_list.ST_CreateObject = SC_CreateObject;
+    function_list.ST_CopyObject = SC_CopyObject;
+    function_list.ST_DestroyObject = SC_DestroyObject;
+    function_list.ST_GetObjectSize = SC_GetObjectSize;
+    function_list.ST_GetAttributeValue = SC_GetAttributeValue;
+    function_list.ST_SetAttributeValue = SC_SetAttributeValue;
+    function_list.ST_FindObjectsInit = SC_FindObjectsInit;
+    function_list.ST_FindObjects = SC_FindObjects;
+    function_list.ST_FindObjectsFinal = SC_FindObjectsFinal;
+    function_list.ST_EncryptInit = SC_EncryptInit;
+    function_list.ST_Encrypt = SC_Encrypt;
+    function_list.ST_EncryptUpdate = SC_EncryptUpdate;
+    function_list.ST_EncryptFinal = SC_EncryptFinal;
+    function_list.ST_DecryptInit = SC_DecryptInit;
+    function_list.ST_Decrypt = SC_Decrypt;
+    function_list.ST_DecryptUpdate = SC_DecryptUpdate;
+    function_list.ST_DecryptFinal = SC_DecryptFinal;
+    function_list.ST_DigestInit = SC_DigestInit;
+    function_list.ST_Digest = SC_Digest;
+    function_list.ST_DigestUpdate = SC_DigestUpdate;
+    function_list.ST_DigestKey = SC_DigestKey;
+    function_list.ST_DigestFinal = SC_DigestFinal;
+    function_list.ST_SignInit = SC_SignInit;
+    function_list.ST_Sign = SC_Sign;
+    function_list.ST_SignUpdate = SC_SignUpdate;
+    function_list.ST_SignFinal = SC_SignFinal;
+    function_list.ST_SignRecoverInit = SC_SignRecoverInit;
+    function_list.ST_SignRecover = SC_SignRecover;
+    function_list.ST_VerifyInit = SC_VerifyInit;
+    function_list.ST_Verify = SC_Verify;
+    function_list.ST_VerifyUpdate = SC_VerifyUpdate;
+    function_list.ST_VerifyFinal = SC_VerifyFinal;
+    function_list.ST_VerifyRecoverInit = SC_VerifyRecoverInit;
+    function_list.ST_VerifyRecover = SC_VerifyRecover;
+    function_list.ST_DigestEncryptUpdate = NULL;      // SC_DigestEncryptUpdate;
+    function_list.ST_DecryptDigestUpdate = NULL;      // SC_DecryptDigestUpdate;
+    function_list.ST_SignEncryptUpdate = NULL;  //SC_SignEncryptUpdate;
+    function_list.ST_DecryptVerifyUpdate = NULL;      // SC_DecryptVerifyUpdate;
+    function_list.ST_GenerateKey = SC_GenerateKey;
+    function_list.ST_GenerateKeyPair = SC_GenerateKeyPair;
+    function_list.ST_WrapKey = SC_WrapKey;
+    function_list.ST_UnwrapKey = SC_UnwrapKey;
+    function_list.ST_DeriveKey = SC_DeriveKey;
+    function_list.ST_SeedRandom = SC_SeedRandom;
+    function_list.ST_GenerateRandom = SC_GenerateRandom;
+    function_list.ST_GetFunctionStatus = NULL;  // SC_GetFunctionStatus;
+    function_list.ST_CancelFunction = NULL;     // SC_CancelFunction;
+
+    function_list.ST_IBM_ReencryptSingle = SC_IBM_ReencryptSingle;
+
+    function_list.ST_MessageEncryptInit = SC_MessageEncryptInit;
+    function_list.ST_EncryptMessage = SC_EncryptMessage;
+    function_list.ST_MessageEncryptFinal = SC_MessageEncryptFinal;
+    function_list.ST_MessageDecryptInit = SC_MessageDecryptInit;
+    function_list.ST_DecryptMessage = SC_DecryptMessage;
+    function_list.ST_MessageDecryptFinal = SC_MessageDecryptFinal;
+    function_list.ST_MessageSignInit = SC_MessageSignInit;
+    function_list.ST_SignMessage = SC_SignMessage;
+    function_list.ST_MessageSignFinal = SC_MessageSignFinal;
+    function_list.ST_MessageVerifyInit = SC_MessageVerifyInit;
+    function_list.ST_VerifyMessage = SC_VerifyMessage;
+    function_list.ST_MessageVerifyFinal = SC_MessageVerifyFinal;
 
     function_list.ST_HandleEvent = SC_HandleEvent;
 }
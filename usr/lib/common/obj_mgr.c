@@ -28,6 +28,8 @@
 #include "attributes.h"
 #include "tok_spec_struct.h"
 #include "trace.h"
+#include "secure_arena.h"
+#include "tok_obj_seq.h"
 
 #include "../api/apiproto.h"
 #include "../api/policy.h"
@@ -806,6 +808,7 @@ CK_RV object_mgr_destroy_token_objects(STDLL_TokData_t *tokdata)
 
     // now we want to purge the token object list in shared memory
     //
+    tok_obj_seq_write_begin(tokdata->global_shm);
     tokdata->global_shm->num_priv_tok_obj = 0;
     tokdata->global_shm->num_publ_tok_obj = 0;
 
@@ -813,6 +816,7 @@ CK_RV object_mgr_destroy_token_objects(STDLL_TokData_t *tokdata)
            MAX_TOK_OBJS * sizeof(TOK_OBJ_ENTRY));
     memset(&tokdata->global_shm->priv_tok_objs, 0x0,
            MAX_TOK_OBJS * sizeof(TOK_OBJ_ENTRY));
+    tok_obj_seq_write_end(tokdata->global_shm);
 
     rc = XProcUnLock(tokdata);
     if (rc != CKR_OK) {
@@ -1076,45 +1080,40 @@ CK_RV object_mgr_find_in_map2(STDLL_TokData_t *tokdata,
     return CKR_OK;
 }
 
-void find_build_list_cb(STDLL_TokData_t *tokdata, void *node,
-                        unsigned long obj_handle, void *p3)
+/*
+ * Adds the object to the search results if it matches. Returns non-zero once
+ * the requested number of handles has been found, which ends the tree walk.
+ */
+int find_next_cb(STDLL_TokData_t *tokdata, void *node,
+                 unsigned long obj_handle, void *p3)
 {
     OBJECT *obj = (OBJECT *) node;
-    struct find_build_list_args *fa = (struct find_build_list_args *) p3;
+    struct find_next_args *fa = (struct find_next_args *) p3;
+    struct find_cursor *cursor = &fa->sess->find_cursor;
     CK_OBJECT_HANDLE map_handle = CK_INVALID_HANDLE;
     CK_BBOOL match = FALSE, flag = FALSE;
-    CK_OBJECT_HANDLE *find_list;
-    CK_ULONG find_len;
     CK_OBJECT_CLASS class;
     CK_RV rc;
 
     if (object_lock(obj, READ_LOCK) != CKR_OK)
-        return;
+        return 0;
 
-    if ((object_is_private(obj) == FALSE) || (fa->public_only == FALSE)) {
+    if ((object_is_private(obj) == FALSE) || (cursor->public_only == FALSE)) {
         // if the user doesn't specify any template attributes then we return
         // all objects
         //
-        if (fa->pTemplate == NULL || fa->ulCount == 0)
+        if (cursor->tmpl == NULL || cursor->tmpl_count == 0)
             match = TRUE;
         else
-            match = template_compare(fa->pTemplate, fa->ulCount, obj->template);
+            match = template_compare(cursor->tmpl, cursor->tmpl_count,
+                                     obj->template);
     }
     // if we have a match, find the object in the map (add it if necessary)
     // then add the object to the list of found objects //
     if (match) {
-        rc = object_mgr_find_in_map2(tokdata, obj, &map_handle);
-        if (rc != CKR_OK) {
-            rc = object_mgr_add_to_map(tokdata, fa->sess, obj, obj_handle,
-                                       &map_handle);
-            if (rc != CKR_OK) {
-                TRACE_DEVEL("object_mgr_add_to_map failed.\n");
-                goto done;
-            }
-        }
         // If hw_feature is false here, we need to filter out all objects
         // that have the CKO_HW_FEATURE attribute set. - KEY
-        if (fa->hw_feature == FALSE &&
+        if (cursor->hw_feature == FALSE &&
             template_attribute_get_ulong(obj->template, CKA_CLASS,
                                          &class) == CKR_OK) {
              if (class == CKO_HW_FEATURE)
@@ -1123,39 +1122,74 @@ void find_build_list_cb(STDLL_TokData_t *tokdata, void *node,
 
         /* Don't find objects that have been created with the CKA_HIDDEN
          * attribute set */
-        if (fa->hidden_object == FALSE &&
+        if (cursor->hidden_object == FALSE &&
             template_attribute_get_bool(obj->template, CKA_HIDDEN,
                                         &flag) == CKR_OK) {
             if (flag == TRUE)
                 goto done;
         }
 
-        fa->sess->find_list[fa->sess->find_count] = map_handle;
-        fa->sess->find_count++;
-
-        if (fa->sess->find_count >= fa->sess->find_len) {
-            fa->sess->find_len += 15;
-            find_len = fa->sess->find_len + 15;
-            find_list = (CK_OBJECT_HANDLE *)realloc(fa->sess->find_list,
-                                        find_len * sizeof(CK_OBJECT_HANDLE));
-            if (!find_list) {
-                TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
+        rc = object_mgr_find_in_map2(tokdata, obj, &map_handle);
+        if (rc != CKR_OK) {
+            rc = object_mgr_add_to_map(tokdata, fa->sess, obj, obj_handle,
+                                       &map_handle);
+            if (rc != CKR_OK) {
+                TRACE_DEVEL("object_mgr_add_to_map failed.\n");
                 goto done;
             }
-            fa->sess->find_list = find_list;
-            fa->sess->find_len = find_len;
         }
+
+        fa->handles[fa->count] = map_handle;
+        fa->count++;
     }
 
 done:
     object_unlock(obj);
+
+    return fa->count >= fa->max;
 }
 
+/*
+ * Returns the n-th object tree to search, or NULL after the last one.
+ *
+ *   Public Session:   public token objects,   public session objects
+ *   User Session:     all token objects,      all session objects
+ *   SO session:       public token objects,   public session objects
+ *
+ * Private session objects are filtered out by find_next_cb() for public
+ * sessions.
+ */
+static struct btree *find_tree(STDLL_TokData_t *tokdata,
+                               struct find_cursor *cursor)
+{
+    unsigned int n = cursor->tree;
+
+    if (cursor->public_only)
+        n++;
+
+    switch (n) {
+    case 0:
+        return &tokdata->priv_token_obj_btree;
+    case 1:
+        return &tokdata->publ_token_obj_btree;
+    case 2:
+        return &tokdata->sess_obj_btree;
+    default:
+        return NULL;
+    }
+}
+
+/*
+ * Starts an object search. No objects are looked at here, the search
+ * template is copied to the session's find cursor and object_mgr_find()
+ * walks the object trees incrementally from there. Objects created or
+ * destroyed while a search is active may or may not be found.
+ */
 CK_RV object_mgr_find_init(STDLL_TokData_t *tokdata,
                            SESSION *sess,
                            CK_ATTRIBUTE *pTemplate, CK_ULONG ulCount)
 {
-    struct find_build_list_args fa;
+    struct find_cursor *cursor;
     CK_OBJECT_CLASS class = 0;
     CK_BBOOL flag = FALSE;
     CK_RV rc;
@@ -1167,55 +1201,13 @@ CK_RV object_mgr_find_init(STDLL_TokData_t *tokdata,
         return CKR_FUNCTION_FAILED;
     }
     if (sess->find_active != FALSE) {
-        return CKR_OPERATION_ACTIVE;
         TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_ACTIVE));
-    }
-    // initialize the found object list.  if it doesn't exist, allocate
-    // a list big enough for 10 handles.  we'll reallocate if we need more
-    //
-    if (sess->find_list != NULL) {
-        memset(sess->find_list, 0x0, sess->find_len * sizeof(CK_OBJECT_HANDLE));
-    } else {
-        sess->find_list =
-            (CK_OBJECT_HANDLE *) malloc(10 * sizeof(CK_OBJECT_HANDLE));
-        if (!sess->find_list) {
-            TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
-            return CKR_HOST_MEMORY;
-        } else {
-            memset(sess->find_list, 0x0, 10 * sizeof(CK_OBJECT_HANDLE));
-            sess->find_len = 10;
-        }
-    }
-
-    sess->find_count = 0;
-    sess->find_idx = 0;
-
-    rc = XProcLock(tokdata);
-    if (rc != CKR_OK) {
-        TRACE_ERROR("Failed to get Process Lock.\n");
-        return rc;
-    }
-
-    object_mgr_update_from_shm(tokdata);
-
-    rc = XProcUnLock(tokdata);
-    if (rc != CKR_OK) {
-        TRACE_ERROR("Failed to release Process Lock.\n");
-        return rc;
+        return CKR_OPERATION_ACTIVE;
     }
 
-    fa.hw_feature = FALSE;
-    fa.hidden_object = FALSE;
-    fa.sess = sess;
-    fa.pTemplate = pTemplate;
-    fa.ulCount = ulCount;
+    cursor = &sess->find_cursor;
+    memset(cursor, 0, sizeof(*cursor));
 
-    // which objects can be returned:
-    //
-    //   Public Session:   public session objects, public token objects
-    //   User Session:     all session objects,    all token objects
-    //   SO session:       public session objects, public token objects
-    //
     // PKCS#11 v2.11 (pg. 79): "When searching using C_FindObjectsInit
     // and C_FindObjects, hardware feature objects are not returned
     // unless the CKA_CLASS attribute in the template has the value
@@ -1227,7 +1219,7 @@ CK_RV object_mgr_find_init(STDLL_TokData_t *tokdata,
         return CKR_ATTRIBUTE_VALUE_INVALID;
     }
     if (rc == CKR_OK && class == CKO_HW_FEATURE)
-        fa.hw_feature = TRUE;
+        cursor->hw_feature = TRUE;
 
     rc = get_bool_attribute_by_type(pTemplate, ulCount, CKA_HIDDEN, &flag);
     if (rc == CKR_ATTRIBUTE_VALUE_INVALID) {
@@ -1235,37 +1227,92 @@ CK_RV object_mgr_find_init(STDLL_TokData_t *tokdata,
         return CKR_ATTRIBUTE_VALUE_INVALID;
     }
     if (rc == CKR_OK && flag == TRUE)
-        fa.hidden_object = TRUE;
+        cursor->hidden_object = TRUE;
 
     switch (sess->session_info.state) {
-    case CKS_RO_PUBLIC_SESSION:
-    case CKS_RW_PUBLIC_SESSION:
-    case CKS_RW_SO_FUNCTIONS:
-        fa.public_only = TRUE;
-
-        bt_for_each_node(tokdata, &tokdata->publ_token_obj_btree,
-                         find_build_list_cb, &fa);
-        bt_for_each_node(tokdata, &tokdata->sess_obj_btree, find_build_list_cb,
-                         &fa);
-        break;
     case CKS_RO_USER_FUNCTIONS:
     case CKS_RW_USER_FUNCTIONS:
-        fa.public_only = FALSE;
-
-        bt_for_each_node(tokdata, &tokdata->priv_token_obj_btree,
-                         find_build_list_cb, &fa);
-        bt_for_each_node(tokdata, &tokdata->publ_token_obj_btree,
-                         find_build_list_cb, &fa);
-        bt_for_each_node(tokdata, &tokdata->sess_obj_btree, find_build_list_cb,
-                         &fa);
+        cursor->public_only = FALSE;
+        break;
+    default:
+        cursor->public_only = TRUE;
         break;
     }
 
+    rc = XProcLock(tokdata);
+    if (rc != CKR_OK) {
+        TRACE_ERROR("Failed to get Process Lock.\n");
+        return rc;
+    }
+
+    object_mgr_update_from_shm(tokdata);
+
+    rc = XProcUnLock(tokdata);
+    if (rc != CKR_OK) {
+        TRACE_ERROR("Failed to release Process Lock.\n");
+        return rc;
+    }
+
+    // the caller's template is only valid during C_FindObjectsInit
+    rc = dup_attribute_array(pTemplate, ulCount, &cursor->tmpl,
+                             &cursor->tmpl_count);
+    if (rc != CKR_OK) {
+        TRACE_ERROR("Failed to copy the search template.\n");
+        return rc;
+    }
+
+    cursor->tree = 0;
+    cursor->node = 1;
     sess->find_active = TRUE;
 
     return CKR_OK;
 }
 
+/*
+ * Returns up to max handles of matching objects, continuing the search
+ * where the previous call stopped. *count is less than max only once all
+ * object trees have been searched.
+ */
+CK_RV object_mgr_find(STDLL_TokData_t *tokdata, SESSION *sess,
+                      CK_OBJECT_HANDLE *handles, CK_ULONG max,
+                      CK_ULONG *count)
+{
+    struct find_next_args fa;
+    struct find_cursor *cursor;
+    struct btree *tree;
+    unsigned long next;
+
+    if (!sess || !handles || !count) {
+        TRACE_ERROR("Invalid function argument.\n");
+        return CKR_FUNCTION_FAILED;
+    }
+    if (sess->find_active == FALSE) {
+        TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_NOT_INITIALIZED));
+        return CKR_OPERATION_NOT_INITIALIZED;
+    }
+
+    cursor = &sess->find_cursor;
+    fa.sess = sess;
+    fa.handles = handles;
+    fa.max = max;
+    fa.count = 0;
+
+    while (fa.count < max && (tree = find_tree(tokdata, cursor)) != NULL) {
+        next = bt_for_each_node_from(tokdata, tree, cursor->node,
+                                     find_next_cb, &fa);
+        if (next != 0) {
+            cursor->node = next;
+        } else {
+            cursor->tree++;
+            cursor->node = 1;
+        }
+    }
+
+    *count = fa.count;
+
+    return CKR_OK;
+}
+
 //
 //
 CK_RV object_mgr_find_final(SESSION *sess)
@@ -1278,10 +1325,10 @@ CK_RV object_mgr_find_final(SESSION *sess)
         TRACE_ERROR("%s\n", ock_err(ERR_OPERATION_NOT_INITIALIZED));
         return CKR_OPERATION_NOT_INITIALIZED;
     }
-    free(sess->find_list);
-    sess->find_list = NULL;
-    sess->find_count = 0;
-    sess->find_idx = 0;
+    if (sess->find_cursor.tmpl != NULL)
+        cleanse_and_free_attribute_array(sess->find_cursor.tmpl,
+                                         sess->find_cursor.tmpl_count);
+    memset(&sess->find_cursor, 0, sizeof(sess->find_cursor));
     sess->find_active = FALSE;
 
     return CKR_OK;
@@ -1407,8 +1454,11 @@ CK_BBOOL object_mgr_purge_session_objects(STDLL_TokData_t *tokdata,
     if (!sess)
         return FALSE;
 
+    /* Release the key material of all purged objects at once */
+    secure_arena_release_begin();
     bt_for_each_node(tokdata, &tokdata->sess_obj_btree, purge_session_obj_cb,
                      &pa);
+    secure_arena_release_end();
 
     return TRUE;
 }
@@ -1448,8 +1498,10 @@ CK_BBOOL object_mgr_purge_token_objects(STDLL_TokData_t *tokdata)
 
 CK_BBOOL object_mgr_purge_private_token_objects(STDLL_TokData_t *tokdata)
 {
+    secure_arena_release_begin();
     bt_for_each_node(tokdata, &tokdata->priv_token_obj_btree, purge_token_obj_cb,
                      &tokdata->priv_token_obj_btree);
+    secure_arena_release_end();
 
     return TRUE;
 }
@@ -1635,8 +1687,10 @@ CK_RV object_mgr_save_token_object(STDLL_TokData_t *tokdata, OBJECT *obj)
         entry = &tokdata->global_shm->publ_tok_objs[index];
     }
 
+    tok_obj_seq_write_begin(tokdata->global_shm);
     entry->count_lo = obj->count_lo;
     entry->count_hi = obj->count_hi;
+    tok_obj_seq_write_end(tokdata->global_shm);
 
     rc = XProcUnLock(tokdata);
     if (rc != CKR_OK) {
@@ -1736,6 +1790,7 @@ void object_mgr_add_to_shm(OBJECT *obj, LW_SHM_TYPE *global_shm)
     else
         entry = &global_shm->publ_tok_objs[global_shm->num_publ_tok_obj];
 
+    tok_obj_seq_write_begin(global_shm);
     entry->deleted = FALSE;
     entry->count_lo = 0;
     entry->count_hi = 0;
@@ -1745,6 +1800,7 @@ void object_mgr_add_to_shm(OBJECT *obj, LW_SHM_TYPE *global_shm)
         global_shm->num_priv_tok_obj++;
     else
         global_shm->num_publ_tok_obj++;
+    tok_obj_seq_write_end(global_shm);
 
     return;
 }
@@ -1783,6 +1839,7 @@ CK_RV object_mgr_del_from_shm(OBJECT *obj, LW_SHM_TYPE *global_shm)
         // If we want to delete the last object we need to subtract 9 from 9 not
         // 10 from 9.)
         //
+        tok_obj_seq_write_begin(global_shm);
         global_shm->num_priv_tok_obj--;
         if (index > global_shm->num_priv_tok_obj) {
             count = index - global_shm->num_priv_tok_obj;
@@ -1808,6 +1865,7 @@ CK_RV object_mgr_del_from_shm(OBJECT *obj, LW_SHM_TYPE *global_shm)
                    priv_tok_objs[global_shm->num_priv_tok_obj], 0,
                    sizeof(TOK_OBJ_ENTRY));
         }
+        tok_obj_seq_write_end(global_shm);
     } else {
         if (global_shm->num_publ_tok_obj == 0) {
             TRACE_DEVEL("%s\n", ock_err(ERR_OBJECT_HANDLE_INVALID));
@@ -1820,6 +1878,7 @@ CK_RV object_mgr_del_from_shm(OBJECT *obj, LW_SHM_TYPE *global_shm)
             TRACE_DEVEL("object_mgr_search_shm_for_obj failed.\n");
             return rc;
         }
+        tok_obj_seq_write_begin(global_shm);
         global_shm->num_publ_tok_obj--;
 
 
@@ -1844,6 +1903,7 @@ CK_RV object_mgr_del_from_shm(OBJECT *obj, LW_SHM_TYPE *global_shm)
                    publ_tok_objs[global_shm->num_publ_tok_obj], 0,
                    sizeof(TOK_OBJ_ENTRY));
         }
+        tok_obj_seq_write_end(global_shm);
     }
 
     return CKR_OK;
@@ -1894,6 +1954,22 @@ CK_RV object_mgr_get_shm_entry_for_obj(STDLL_TokData_t *tokdata, OBJECT *obj,
 }
 
 
+/*
+ * Check without taking the XProcLock whether the shared memory entry of the
+ * object is unchanged. The entry at the last known index of the object is
+ * read within a sequence counter read section. Returns FALSE if the entry has
+ * changed, has moved, or the lists were modified concurrently, the caller
+ * must then do the check under the XProcLock.
+ */
+static CK_BBOOL object_mgr_shm_unchanged(STDLL_TokData_t *tokdata,
+                                         OBJECT *obj)
+{
+    return tok_obj_seq_entry_unchanged(tokdata->global_shm,
+                                       object_is_private(obj), obj->index,
+                                       obj->name, obj->count_hi,
+                                       obj->count_lo);
+}
+
 // The object must hold the READ lock when this function is called!
 //
 CK_RV object_mgr_check_shm(STDLL_TokData_t *tokdata, OBJECT *obj)
@@ -1902,6 +1978,10 @@ CK_RV object_mgr_check_shm(STDLL_TokData_t *tokdata, OBJECT *obj)
     CK_BBOOL rd_locked = TRUE, wr_locked = FALSE;
     CK_RV rc;
 
+    /* Fast path: the object is unchanged, no need to serialize processes */
+    if (object_mgr_shm_unchanged(tokdata, obj))
+        return CKR_OK;
+
 retry:
     rc = XProcLock(tokdata);
     if (rc != CKR_OK) {
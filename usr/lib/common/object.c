@@ -269,9 +269,58 @@ error:
 }
 
 
+// object_flatten_record()
+//
+// The object is written as an object record, see OBJECT_RECORD_HDR.
+//
+static CK_RV object_flatten_record(OBJECT *obj, CK_BYTE **data, CK_ULONG *len)
+{
+    OBJECT_RECORD_HDR hdr;
+    CK_BYTE *buf = NULL;
+    CK_ULONG num_entries, heap_len, total_len;
+    long rc;
+
+    template_get_record_size(obj->template, &num_entries, &heap_len);
+
+    total_len = sizeof(OBJECT_RECORD_HDR) +
+                num_entries * sizeof(OBJECT_RECORD_ATTR) + heap_len;
+
+    buf = (CK_BYTE *) calloc(1, total_len);
+    if (!buf) {
+        TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
+        return CKR_HOST_MEMORY;
+    }
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.class = obj->class;
+    hdr.magic = OBJECT_RECORD_MAGIC;
+    memcpy(hdr.name, obj->name, sizeof(hdr.name));
+    hdr.version = OBJECT_RECORD_VERSION;
+    hdr.num_attrs = template_get_count(obj->template);
+    hdr.num_entries = num_entries;
+    hdr.heap_len = heap_len;
+    memcpy(buf, &hdr, sizeof(hdr));
+
+    rc = template_flatten_record(obj->template,
+                                 buf + sizeof(OBJECT_RECORD_HDR), num_entries);
+    if (rc != CKR_OK) {
+        free(buf);
+        return rc;
+    }
+
+    *data = buf;
+    *len = total_len;
+
+    return CKR_OK;
+}
+
 // object_flatten() - this is still used when saving token objects
 //
-CK_RV object_flatten(OBJECT * obj, CK_BYTE ** data, CK_ULONG * len)
+// Objects are written as object records only if record is TRUE, releases
+// before 3.19 can not read them.
+//
+CK_RV object_flatten(OBJECT * obj, CK_BYTE ** data, CK_ULONG * len,
+                     CK_BBOOL record)
 {
     CK_BYTE *buf = NULL;
     CK_ULONG tmpl_len, total_len;
@@ -284,6 +333,9 @@ CK_RV object_flatten(OBJECT * obj, CK_BYTE ** data, CK_ULONG * len)
         TRACE_ERROR("Invalid function arguments.\n");
         return CKR_FUNCTION_FAILED;
     }
+    if (record)
+        return object_flatten_record(obj, data, len);
+
     count = template_get_count(obj->template);
     tmpl_len = template_get_compressed_size(obj->template);
 
@@ -330,6 +382,7 @@ void object_free(OBJECT * obj)
 {
     /* refactorization here to do actual free - fix from coverity scan */
     if (obj) {
+        object_invalidate_fast_key(obj);
         if (obj->template)
             template_free(obj->template);
         object_destroy_lock(obj);
@@ -685,6 +738,8 @@ CK_RV object_set_attribute_values(STDLL_TokData_t * tokdata,
         return rc;
     }
 
+    object_invalidate_fast_key(obj);
+
     return CKR_OK;
 
 error:
@@ -698,6 +753,39 @@ error:
 }
 
 
+// object_restore_record()
+//
+// Restores the template of an object written by object_flatten().
+// If data_size=-1, won't do bounds checking
+//
+static CK_RV object_restore_record(CK_BYTE *data, int data_size,
+                                   TEMPLATE **tmpl)
+{
+    OBJECT_RECORD_HDR hdr;
+    CK_ULONG table_len;
+
+    if (data_size >= 0 && (CK_ULONG)data_size < sizeof(hdr)) {
+        TRACE_ERROR("Object record is truncated\n");
+        return CKR_FUNCTION_FAILED;
+    }
+    memcpy(&hdr, data, sizeof(hdr));
+
+    if (hdr.version != OBJECT_RECORD_VERSION) {
+        TRACE_ERROR("Unsupported object record version: %u\n", hdr.version);
+        return CKR_FUNCTION_FAILED;
+    }
+
+    table_len = (CK_ULONG)hdr.num_entries * sizeof(OBJECT_RECORD_ATTR);
+    if (data_size >= 0 &&
+        (CK_ULONG)data_size - sizeof(hdr) < table_len + hdr.heap_len) {
+        TRACE_ERROR("Object record is truncated\n");
+        return CKR_FUNCTION_FAILED;
+    }
+
+    return template_unflatten_record(tmpl, data + sizeof(hdr), hdr.num_attrs,
+                                     hdr.num_entries, hdr.heap_len);
+}
+
 //
 //Modified object_restore to prevent buffer overflow
 //If data_size=-1, won't do bounds checking
@@ -761,10 +849,20 @@ CK_RV object_restore_withSize(struct policy *policy,
         }
     }
 
-    rc = template_unflatten_withSize(&tmpl, data + offset, count, data_size);
-    if (rc != CKR_OK) {
-        TRACE_DEVEL("template_unflatten_withSize failed.\n");
-        goto error;
+    if (count == OBJECT_RECORD_MAGIC) {
+        rc = object_restore_record(data, data_size, &tmpl);
+        if (rc != CKR_OK) {
+            TRACE_DEVEL("object_restore_record failed.\n");
+            goto error;
+        }
+    } else {
+        /* Written by an older version */
+        rc = template_unflatten_withSize(&tmpl, data + offset, count,
+                                         data_size);
+        if (rc != CKR_OK) {
+            TRACE_DEVEL("template_unflatten_withSize failed.\n");
+            goto error;
+        }
     }
     /* External tools (e.g., pkcscca) might use this function and not
        be aware of any policy.  Allow them to pass NULL. */
@@ -788,6 +886,7 @@ CK_RV object_restore_withSize(struct policy *policy,
         *new_obj = obj;
     } else {
         /* Reload of existing object only changes the template */
+        object_invalidate_fast_key(*new_obj);
         template_free((*new_obj)->template);
         (*new_obj)->template = obj->template;
         (*new_obj)->strength.strength = obj->strength.strength;
@@ -914,11 +1013,19 @@ CK_RV object_init_lock(OBJECT *obj)
         return CKR_CANT_LOCK;
     }
 
+    if (pthread_mutex_init(&obj->fast_key_mutex, NULL) != 0) {
+        TRACE_DEVEL("Object fast key mutex init failed.\n");
+        pthread_rwlock_destroy(&obj->template_rwlock);
+        return CKR_CANT_LOCK;
+    }
+
     return CKR_OK;
 }
 
 CK_RV object_destroy_lock(OBJECT *obj)
 {
+    pthread_mutex_destroy(&obj->fast_key_mutex);
+
     if (pthread_rwlock_destroy(&obj->template_rwlock) != 0) {
         TRACE_DEVEL("Object Lock destroy failed.\n");
         return CKR_CANT_LOCK;
@@ -927,6 +1034,87 @@ CK_RV object_destroy_lock(OBJECT *obj)
     return CKR_OK;
 }
 
+/*
+ * Returns a reference to the derived fast key of the given kind for the
+ * object, deriving and caching it if the object has none or its template
+ * changed since. The object must be at least read-locked by the caller. The
+ * reference is released with object_put_fast_key(), it stays valid even if
+ * the cached fast key is invalidated meanwhile.
+ *
+ * An object caches one fast key, deriving one of another kind replaces it.
+ */
+CK_RV object_get_fast_key(STDLL_TokData_t *tokdata, OBJECT *obj,
+                          const struct fast_key_ops *ops, void **fast_key)
+{
+    void *new_key = NULL;
+    CK_ULONG gen;
+    CK_RV rc;
+
+    if (pthread_mutex_lock(&obj->fast_key_mutex) != 0) {
+        TRACE_DEVEL("Object fast key mutex lock failed.\n");
+        return CKR_CANT_LOCK;
+    }
+
+    gen = __atomic_load_n(&obj->template_gen, __ATOMIC_ACQUIRE);
+    if (obj->fast_key != NULL && obj->fast_key_ops == ops &&
+        obj->fast_key_gen == gen) {
+        *fast_key = ops->get(obj->fast_key);
+        pthread_mutex_unlock(&obj->fast_key_mutex);
+        return CKR_OK;
+    }
+
+    rc = ops->derive(tokdata, obj, &new_key);
+    if (rc != CKR_OK) {
+        TRACE_DEVEL("Deriving the %s fast key failed with rc=0x%lx.\n",
+                    ops->name, rc);
+        pthread_mutex_unlock(&obj->fast_key_mutex);
+        return rc;
+    }
+
+    if (obj->fast_key != NULL)
+        obj->fast_key_ops->put(obj->fast_key);
+    obj->fast_key = new_key;
+    obj->fast_key_ops = ops;
+    obj->fast_key_gen = gen;
+
+    *fast_key = ops->get(new_key);
+
+    pthread_mutex_unlock(&obj->fast_key_mutex);
+
+    return CKR_OK;
+}
+
+void object_put_fast_key(const struct fast_key_ops *ops, void *fast_key)
+{
+    if (fast_key != NULL)
+        ops->put(fast_key);
+}
+
+/*
+ * Drops the cached fast key. Must be called whenever the object's template
+ * changes, references already handed out stay valid.
+ */
+void object_invalidate_fast_key(OBJECT *obj)
+{
+    void *fast_key;
+    const struct fast_key_ops *ops;
+
+    __atomic_add_fetch(&obj->template_gen, 1, __ATOMIC_RELEASE);
+
+    if (__atomic_load_n(&obj->fast_key, __ATOMIC_ACQUIRE) == NULL)
+        return;
+
+    pthread_mutex_lock(&obj->fast_key_mutex);
+    fast_key = obj->fast_key;
+    ops = obj->fast_key_ops;
+    obj->fast_key = NULL;
+    obj->fast_key_ops = NULL;
+    pthread_mutex_unlock(&obj->fast_key_mutex);
+
+    if (fast_key != NULL)
+        ops->put(fast_key);
+}
+
 /*
  * Do NOT try to get an object lock, if the current thread holds the
  * XProcLock! This might case a deadlock !
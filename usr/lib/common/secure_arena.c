@@ -0,0 +1,411 @@
+/*
+ * COPYRIGHT (c) International Business Machines Corp. 2024
+ *
+ * This program is provided under the terms of the Common Public License,
+ * version 1.0 (CPL-1.0). Any use, reproduction or distribution for this
+ * software constitutes recipient's acceptance of CPL-1.0 terms which can be
+ * found in the file LICENSE file or at
+ * https://opensource.org/licenses/cpl1.0.php
+ */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+
+#include <openssl/crypto.h>
+
+#include "pkcs11types.h"
+#include "defs.h"
+#include "trace.h"
+#include "secure_arena.h"
+
+/*
+ * The arena is managed in units of ARENA_UNIT bytes with one bit per unit.
+ * Every block starts with a header holding its number of units, the value
+ * follows the header.
+ */
+#define ARENA_UNIT          32
+#define ARENA_HDR_SIZE      16
+#define ARENA_MAX_SIZE      (1024 * 1024)
+#define ARENA_MIN_SIZE      (16 * 1024)
+#define BITS_PER_LONG       (8 * sizeof(unsigned long))
+
+static struct {
+    pthread_mutex_t mutex;
+    pid_t pid;
+    int forking;
+    int setup_done;
+    unsigned char *map;
+    size_t map_len;
+    unsigned char *base;
+    size_t size;
+    size_t num_units;
+    unsigned long *bitmap;
+    size_t hint;
+} arena = {
+    .mutex = PTHREAD_MUTEX_INITIALIZER,
+};
+
+/*
+ * Blocks released by a thread between secure_arena_release_begin() and
+ * secure_arena_release_end(). They are cleansed and returned to the arena
+ * together, with the arena mutex taken only once.
+ */
+struct arena_release {
+    unsigned int depth;
+    unsigned char **blocks;
+    size_t num;
+    size_t max;
+};
+
+static __thread struct arena_release arena_release;
+
+/*
+ * The arena mutex is not held across fork(). The fork handlers of the API
+ * layer are registered before those of the token, so the child handler of
+ * the API layer, which finalizes the token and releases its objects, runs
+ * before the child handler of the arena. Instead, the mutex is initialized
+ * again in the child when the arena is used for the first time after fork,
+ * or by the child handler. Until then, the child is single threaded.
+ * A block that was allocated or released by another thread while fork() was
+ * called may stay marked as used in the child, which only loses its space.
+ *
+ * Memory locks are not inherited by the child, so the arena is locked again.
+ * A child that keeps its parent's token objects keeps their sensitive values
+ * in the arena.
+ */
+static void arena_child_reset(void)
+{
+    pid_t pid = getpid();
+
+    if (arena.pid == pid)
+        return;
+
+    pthread_mutex_init(&arena.mutex, NULL);
+    arena.pid = pid;
+
+    if (arena.base != NULL && mlock(arena.base, arena.size) != 0)
+        TRACE_WARNING("Locking the secure arena in the child failed with "
+                      "errno: %d\n", errno);
+}
+
+static void arena_fork_prepare(void)
+{
+    __atomic_store_n(&arena.forking, 1, __ATOMIC_SEQ_CST);
+}
+
+static void arena_fork_parent(void)
+{
+    __atomic_store_n(&arena.forking, 0, __ATOMIC_SEQ_CST);
+}
+
+static void arena_fork_child(void)
+{
+    arena_child_reset();
+    __atomic_store_n(&arena.forking, 0, __ATOMIC_SEQ_CST);
+}
+
+static void arena_lock(void)
+{
+    if (__atomic_load_n(&arena.forking, __ATOMIC_SEQ_CST))
+        arena_child_reset();
+
+    pthread_mutex_lock(&arena.mutex);
+}
+
+static void arena_unlock(void)
+{
+    pthread_mutex_unlock(&arena.mutex);
+}
+
+static void secure_arena_init(void) __attribute__ ((constructor));
+
+static void secure_arena_init(void)
+{
+    arena.pid = getpid();
+    pthread_atfork(arena_fork_prepare, arena_fork_parent, arena_fork_child);
+}
+
+/*
+ * Returns the amount of memory locked by the process already, e.g. by the
+ * arenas of other tokens loaded into the same process.
+ */
+static size_t locked_memory(void)
+{
+    char line[128];
+    unsigned long kb = 0;
+    FILE *fp;
+
+    fp = fopen("/proc/self/status", "r");
+    if (fp == NULL)
+        return 0;
+
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        if (sscanf(line, "VmLck: %lu kB", &kb) == 1)
+            break;
+    }
+    fclose(fp);
+
+    return kb * 1024;
+}
+
+/* Must be called with the arena mutex held. */
+static void secure_arena_setup(void)
+{
+    long page = sysconf(_SC_PAGESIZE);
+    struct rlimit rlim;
+    unsigned char *map;
+    size_t size = ARENA_MAX_SIZE, avail, locked;
+
+    arena.setup_done = 1;
+
+    /*
+     * Every token library has its own arena. Leave room in the locked memory
+     * limit for the arenas of other tokens and for the application.
+     */
+    if (getrlimit(RLIMIT_MEMLOCK, &rlim) == 0 &&
+        rlim.rlim_cur != RLIM_INFINITY) {
+        locked = locked_memory();
+        avail = rlim.rlim_cur > locked ? rlim.rlim_cur - locked : 0;
+        if (avail / 4 < size)
+            size = avail / 4;
+        size &= ~((size_t)page - 1);
+        if (size < ARENA_MIN_SIZE) {
+            TRACE_WARNING("Locked memory limit of %lu bytes too small (%zu "
+                          "bytes locked already), sensitive attribute values "
+                          "are kept on the heap\n",
+                          (unsigned long)rlim.rlim_cur, locked);
+            return;
+        }
+    }
+
+    map = mmap(NULL, size + 2 * page, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS,
+               -1, 0);
+    if (map == MAP_FAILED) {
+        TRACE_DEVEL("mmap failed with errno: %d, secure arena not used\n",
+                    errno);
+        return;
+    }
+
+    /* The first and the last page stay inaccessible as guard pages */
+    if (mprotect(map + page, size, PROT_READ | PROT_WRITE) != 0 ||
+        mlock(map + page, size) != 0) {
+        TRACE_WARNING("Locking the secure arena failed with errno: %d, "
+                      "sensitive attribute values are kept on the heap\n",
+                      errno);
+        munmap(map, size + 2 * page);
+        return;
+    }
+#ifdef MADV_DONTDUMP
+    madvise(map + page, size, MADV_DONTDUMP);
+#endif
+
+    arena.num_units = size / ARENA_UNIT;
+    arena.bitmap = calloc((arena.num_units + BITS_PER_LONG - 1) /
+                          BITS_PER_LONG, sizeof(unsigned long));
+    if (arena.bitmap == NULL) {
+        munlock(map + page, size);
+        munmap(map, size + 2 * page);
+        return;
+    }
+
+    arena.map = map;
+    arena.map_len = size + 2 * page;
+    arena.size = size;
+    arena.base = map + page;
+    arena.hint = 0;
+
+    TRACE_DEVEL("Secure arena of %zu bytes set up\n", size);
+}
+
+static void secure_arena_fini(void) __attribute__ ((destructor));
+
+static void secure_arena_fini(void)
+{
+    if (arena.base == NULL)
+        return;
+
+    OPENSSL_cleanse(arena.base, arena.size);
+    munlock(arena.base, arena.size);
+    munmap(arena.map, arena.map_len);
+    free(arena.bitmap);
+    arena.base = NULL;
+}
+
+static inline int unit_used(size_t unit)
+{
+    return (arena.bitmap[unit / BITS_PER_LONG] >> (unit % BITS_PER_LONG)) & 1;
+}
+
+static void mark_units(size_t start, size_t count, int used)
+{
+    size_t unit;
+
+    for (unit = start; unit < start + count; unit++) {
+        if (used)
+            arena.bitmap[unit / BITS_PER_LONG] |=
+                                        1UL << (unit % BITS_PER_LONG);
+        else
+            arena.bitmap[unit / BITS_PER_LONG] &=
+                                        ~(1UL << (unit % BITS_PER_LONG));
+    }
+}
+
+/* Find 'count' free consecutive units within [from, to). */
+static long find_free_units(size_t from, size_t to, size_t count)
+{
+    size_t unit = from, run = 0;
+
+    while (unit < to) {
+        /* Skip completely used words */
+        if (run == 0 && unit % BITS_PER_LONG == 0 &&
+            arena.bitmap[unit / BITS_PER_LONG] == ~0UL) {
+            unit += BITS_PER_LONG;
+            continue;
+        }
+
+        if (unit_used(unit))
+            run = 0;
+        else if (++run == count)
+            return unit + 1 - count;
+        unit++;
+    }
+
+    return -1;
+}
+
+void *secure_arena_alloc(size_t len)
+{
+    unsigned char *block = NULL;
+    size_t count;
+    long start;
+
+    arena_lock();
+
+    if (!arena.setup_done)
+        secure_arena_setup();
+    if (arena.base == NULL)
+        goto out;
+
+    count = (len + ARENA_HDR_SIZE + ARENA_UNIT - 1) / ARENA_UNIT;
+    if (count > arena.num_units)
+        goto out;
+
+    start = find_free_units(arena.hint, arena.num_units, count);
+    if (start < 0)
+        start = find_free_units(0, arena.num_units, count);
+    if (start < 0)
+        goto out;
+
+    mark_units(start, count, 1);
+    arena.hint = start + count;
+
+    block = arena.base + start * ARENA_UNIT;
+    *(size_t *)block = count;
+    block += ARENA_HDR_SIZE;
+
+out:
+    arena_unlock();
+
+    return block;
+}
+
+/* Must be called with the arena mutex held. */
+static void release_block(unsigned char *block)
+{
+    size_t start, count;
+
+    start = (block - arena.base) / ARENA_UNIT;
+    count = *(size_t *)block;
+    OPENSSL_cleanse(block, count * ARENA_UNIT);
+    mark_units(start, count, 0);
+    if (start < arena.hint)
+        arena.hint = start;
+}
+
+void secure_arena_free(void *ptr)
+{
+    struct arena_release *rel = &arena_release;
+    unsigned char *block, **blocks;
+    size_t max;
+
+    if (!secure_arena_owns(ptr))
+        return;
+
+    block = (unsigned char *)ptr - ARENA_HDR_SIZE;
+
+    if (rel->depth > 0) {
+        if (rel->num == rel->max) {
+            max = rel->max > 0 ? 2 * rel->max : 64;
+            blocks = realloc(rel->blocks, max * sizeof(*blocks));
+            if (blocks == NULL)
+                goto release;
+            rel->blocks = blocks;
+            rel->max = max;
+        }
+        rel->blocks[rel->num++] = block;
+        return;
+    }
+
+release:
+    arena_lock();
+    release_block(block);
+    arena_unlock();
+}
+
+/*
+ * Defer the release of arena blocks by the calling thread, e.g. while all
+ * objects of a session are destroyed at session close or logout. The blocks
+ * are released by the matching secure_arena_release_end(). Calls can be
+ * nested.
+ */
+void secure_arena_release_begin(void)
+{
+    arena_release.depth++;
+}
+
+static int compare_blocks(const void *a, const void *b)
+{
+    const unsigned char *x = *(unsigned char * const *)a;
+    const unsigned char *y = *(unsigned char * const *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+void secure_arena_release_end(void)
+{
+    struct arena_release *rel = &arena_release;
+    size_t i;
+
+    if (rel->depth == 0 || --rel->depth > 0)
+        return;
+
+    if (rel->num > 0) {
+        /* Release in address order, the values of a key are adjacent */
+        qsort(rel->blocks, rel->num, sizeof(*rel->blocks), compare_blocks);
+
+        arena_lock();
+        for (i = 0; i < rel->num; i++)
+            release_block(rel->blocks[i]);
+        arena_unlock();
+    }
+
+    free(rel->blocks);
+    rel->blocks = NULL;
+    rel->num = 0;
+    rel->max = 0;
+}
+
+int secure_arena_owns(const void *ptr)
+{
+    const unsigned char *p = ptr;
+
+    return arena.base != NULL && p >= arena.base &&
+           p < arena.base + arena.size;
+}
@@ -0,0 +1,36 @@
+/*
+ * COPYRIGHT (c) International Business Machines Corp. 2024
+ *
+ * This program is provided under the terms of the Common Public License,
+ * version 1.0 (CPL-1.0). Any use, reproduction or distribution for this
+ * software constitutes recipient's acceptance of CPL-1.0 terms which can be
+ * found in the file LICENSE file or at
+ * https://opensource.org/licenses/cpl1.0.php
+ */
+
+#ifndef __SECURE_ARENA_H
+#define __SECURE_ARENA_H
+
+#include <stddef.h>
+
+/*
+ * Locked memory arena for sensitive attribute values.
+ *
+ * The arena is a single mapping that is locked into memory, excluded from
+ * core dumps and surrounded by inaccessible guard pages. It is set up on
+ * the first allocation and sized within the RLIMIT_MEMLOCK limit of the
+ * process. secure_arena_alloc() returns NULL if the arena could not be set
+ * up or is full, callers then keep the value on the regular heap.
+ * Released blocks are cleansed before they are reused.
+ *
+ * Between secure_arena_release_begin() and secure_arena_release_end(), the
+ * blocks freed by the calling thread are collected and released together.
+ */
+void *secure_arena_alloc(size_t len);
+void secure_arena_free(void *ptr);
+int secure_arena_owns(const void *ptr);
+
+void secure_arena_release_begin(void);
+void secure_arena_release_end(void);
+
+#endif                          /* __SECURE_ARENA_H */
@@ -20,8 +20,10 @@
 #include "defs.h"
 #include "host_defs.h"
 #include "h_extern.h"
+#include "attributes.h"
 #include "tok_spec_struct.h"
 #include "trace.h"
+#include "login_broker.h"
 
 
 // session_mgr_find()
@@ -264,6 +266,10 @@ CK_RV session_mgr_close_session(STDLL_TokData_t *tokdata,
     if (sess->find_list)
         free(sess->find_list);
 
+    if (sess->find_cursor.tmpl)
+        cleanse_and_free_attribute_array(sess->find_cursor.tmpl,
+                                         sess->find_cursor.tmpl_count);
+
     if (sess->encr_ctx.context) {
         if (sess->encr_ctx.context_free_func != NULL)
             sess->encr_ctx.context_free_func(tokdata, sess,
@@ -288,6 +294,24 @@ CK_RV session_mgr_close_session(STDLL_TokData_t *tokdata,
     if (sess->decr_ctx.mech.pParameter)
         free(sess->decr_ctx.mech.pParameter);
 
+    if (sess->msg_encr_ctx.context) {
+        if (sess->msg_encr_ctx.context_free_func != NULL)
+            sess->msg_encr_ctx.context_free_func(tokdata, sess,
+                                                 sess->msg_encr_ctx.context,
+                                                 sess->msg_encr_ctx.context_len);
+        else
+            free(sess->msg_encr_ctx.context);
+    }
+
+    if (sess->msg_decr_ctx.context) {
+        if (sess->msg_decr_ctx.context_free_func != NULL)
+            sess->msg_decr_ctx.context_free_func(tokdata, sess,
+                                                 sess->msg_decr_ctx.context,
+                                                 sess->msg_decr_ctx.context_len);
+        else
+            free(sess->msg_decr_ctx.context);
+    }
+
     if (sess->digest_ctx.context) {
         if (sess->digest_ctx.context_free_func != NULL)
             sess->digest_ctx.context_free_func(tokdata, sess,
@@ -324,6 +348,33 @@ CK_RV session_mgr_close_session(STDLL_TokData_t *tokdata,
     if (sess->verify_ctx.mech.pParameter)
         free(sess->verify_ctx.mech.pParameter);
 
+    if (sess->msg_sign_ctx.context) {
+        if (sess->msg_sign_ctx.context_free_func != NULL)
+            sess->msg_sign_ctx.context_free_func(tokdata, sess,
+                                                 sess->msg_sign_ctx.context,
+                                                 sess->msg_sign_ctx.context_len);
+        else
+            free(sess->msg_sign_ctx.context);
+    }
+
+    if (sess->msg_sign_ctx.mech.pParameter)
+        free(sess->msg_sign_ctx.mech.pParameter);
+
+    if (sess->msg_sign_ctx.msg_key)
+        sess->msg_sign_ctx.msg_key_free_func(sess->msg_sign_ctx.msg_key);
+
+    if (sess->msg_verify_ctx.context) {
+        if (sess->msg_verify_ctx.context_free_func != NULL)
+            sess->msg_verify_ctx.context_free_func(tokdata, sess,
+                                           sess->msg_verify_ctx.context,
+                                           sess->msg_verify_ctx.context_len);
+        else
+            free(sess->msg_verify_ctx.context);
+    }
+
+    if (sess->msg_verify_ctx.mech.pParameter)
+        free(sess->msg_verify_ctx.mech.pParameter);
+
     bt_put_node_value(&tokdata->sess_btree, sess);
     sess = NULL;
     bt_node_free(&tokdata->sess_btree, handle, TRUE);
@@ -342,6 +393,7 @@ CK_RV session_mgr_close_session(STDLL_TokData_t *tokdata,
         if (token_specific.t_logout) {
             rc = token_specific.t_logout(tokdata);
         }
+        login_broker_stop(tokdata);
         object_mgr_purge_private_token_objects(tokdata);
 
         __transaction_atomic {  /* start transaction */
@@ -374,6 +426,10 @@ void session_free(STDLL_TokData_t *tokdata, void *node_value,
     if (sess->find_list)
         free(sess->find_list);
 
+    if (sess->find_cursor.tmpl)
+        cleanse_and_free_attribute_array(sess->find_cursor.tmpl,
+                                         sess->find_cursor.tmpl_count);
+
     if (sess->encr_ctx.context) {
         if (sess->encr_ctx.context_free_func != NULL)
             sess->encr_ctx.context_free_func(tokdata, sess,
@@ -398,6 +454,24 @@ void session_free(STDLL_TokData_t *tokdata, void *node_value,
     if (sess->decr_ctx.mech.pParameter)
         free(sess->decr_ctx.mech.pParameter);
 
+    if (sess->msg_encr_ctx.context) {
+        if (sess->msg_encr_ctx.context_free_func != NULL)
+            sess->msg_encr_ctx.context_free_func(tokdata, sess,
+                                                 sess->msg_encr_ctx.context,
+                                                 sess->msg_encr_ctx.context_len);
+        else
+            free(sess->msg_encr_ctx.context);
+    }
+
+    if (sess->msg_decr_ctx.context) {
+        if (sess->msg_decr_ctx.context_free_func != NULL)
+            sess->msg_decr_ctx.context_free_func(tokdata, sess,
+                                                 sess->msg_decr_ctx.context,
+                                                 sess->msg_decr_ctx.context_len);
+        else
+            free(sess->msg_decr_ctx.context);
+    }
+
     if (sess->digest_ctx.context) {
         if (sess->digest_ctx.context_free_func != NULL)
             sess->digest_ctx.context_free_func(tokdata, sess,
@@ -434,6 +508,33 @@ void session_free(STDLL_TokData_t *tokdata, void *node_value,
     if (sess->verify_ctx.mech.pParameter)
         free(sess->verify_ctx.mech.pParameter);
 
+    if (sess->msg_sign_ctx.context) {
+        if (sess->msg_sign_ctx.context_free_func != NULL)
+            sess->msg_sign_ctx.context_free_func(tokdata, sess,
+                                                 sess->msg_sign_ctx.context,
+                                                 sess->msg_sign_ctx.context_len);
+        else
+            free(sess->msg_sign_ctx.context);
+    }
+
+    if (sess->msg_sign_ctx.mech.pParameter)
+        free(sess->msg_sign_ctx.mech.pParameter);
+
+    if (sess->msg_sign_ctx.msg_key)
+        sess->msg_sign_ctx.msg_key_free_func(sess->msg_sign_ctx.msg_key);
+
+    if (sess->msg_verify_ctx.context) {
+        if (sess->msg_verify_ctx.context_free_func != NULL)
+            sess->msg_verify_ctx.context_free_func(tokdata, sess,
+                                           sess->msg_verify_ctx.context,
+                                           sess->msg_verify_ctx.context_len);
+        else
+            free(sess->msg_verify_ctx.context);
+    }
+
+    if (sess->msg_verify_ctx.mech.pParameter)
+        free(sess->msg_verify_ctx.mech.pParameter);
+
     /* NB: any access to sess or @node_value after this returns will segfault */
     bt_node_free(&tokdata->sess_btree, node_idx, TRUE);
 }
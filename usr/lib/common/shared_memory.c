@@ -393,6 +393,26 @@ int sm_close(void *addr, int destroy, int ignore_ref_count)
     return 0;
 }
 
+/*
+ * Take an additional reference on a shared memory region that is already
+ * mapped, e.g. by a forked child that keeps the mapping of its parent.
+ */
+int sm_add_ref(void *addr)
+{
+    struct shm_context *ctx = get_shm_context(addr);
+
+    if (ctx->ref <= 0) {
+        TRACE_ERROR("Error: invalid shared memory address %p (ref=%d).\n",
+                    addr, ctx->ref);
+        return -EINVAL;
+    }
+
+    ctx->ref += 1;
+    TRACE_DEVEL("add ref: ref = %d\n", ctx->ref);
+
+    return 0;
+}
+
 /*
  * Destroy a shared memory region.
  */
@@ -31,6 +31,8 @@ int sm_open(const char *sm_name, int mode, void **p_addr, size_t len,
 
 int sm_close(void *addr, int destroy, int ignore_ref_count);
 
+int sm_add_ref(void *addr);
+
 int sm_destroy(const char *name);
 
 int sm_sync(void *addr);
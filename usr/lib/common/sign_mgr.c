@@ -858,6 +858,12 @@ CK_RV sign_mgr_cleanup(STDLL_TokData_t *tokdata, SESSION *sess,
     }
     ctx->context_free_func = NULL;
 
+    if (ctx->msg_key) {
+        ctx->msg_key_free_func(ctx->msg_key);
+        ctx->msg_key = NULL;
+    }
+    ctx->msg_key_free_func = NULL;
+
     return CKR_OK;
 }
 
@@ -1256,3 +1262,79 @@ CK_RV sign_mgr_sign_recover(STDLL_TokData_t *tokdata,
 
     return CKR_FUNCTION_FAILED;
 }
+
+//
+// Message-based signing: the key usage, policy and mechanism checks are done
+// once by sign_mgr_msg_init, each sign_mgr_sign_msg call is a single-part
+// signature on the same context. Only mechanisms whose single-part signature
+// leaves the context reusable are supported. Tokens may also set up the
+// private key once, it is kept in the context until sign_mgr_cleanup.
+//
+CK_RV sign_mgr_msg_init(STDLL_TokData_t *tokdata, SESSION *sess,
+                        SIGN_VERIFY_CONTEXT *ctx, CK_MECHANISM *mech,
+                        CK_OBJECT_HANDLE key, CK_BBOOL checkpolicy)
+{
+    CK_RV rc;
+
+    if (!sess || !ctx || !mech) {
+        TRACE_ERROR("Invalid function arguments.\n");
+        return CKR_FUNCTION_FAILED;
+    }
+
+    switch (mech->mechanism) {
+    case CKM_RSA_X_509:
+    case CKM_RSA_PKCS:
+    case CKM_RSA_PKCS_PSS:
+    case CKM_SHA1_RSA_PKCS:
+    case CKM_SHA224_RSA_PKCS:
+    case CKM_SHA256_RSA_PKCS:
+    case CKM_SHA384_RSA_PKCS:
+    case CKM_SHA512_RSA_PKCS:
+    case CKM_SHA1_RSA_PKCS_PSS:
+    case CKM_SHA224_RSA_PKCS_PSS:
+    case CKM_SHA256_RSA_PKCS_PSS:
+    case CKM_SHA384_RSA_PKCS_PSS:
+    case CKM_SHA512_RSA_PKCS_PSS:
+    case CKM_ECDSA:
+    case CKM_ECDSA_SHA1:
+    case CKM_ECDSA_SHA224:
+    case CKM_ECDSA_SHA256:
+    case CKM_ECDSA_SHA384:
+    case CKM_ECDSA_SHA512:
+        break;
+    default:
+        TRACE_ERROR("%s\n", ock_err(ERR_MECHANISM_INVALID));
+        return CKR_MECHANISM_INVALID;
+    }
+
+    rc = sign_mgr_init(tokdata, sess, ctx, mech, FALSE, key, checkpolicy);
+    if (rc != CKR_OK || token_specific.t_msg_sign_key_init == NULL)
+        return rc;
+
+    rc = token_specific.t_msg_sign_key_init(tokdata, sess, ctx, key);
+    if (rc != CKR_OK) {
+        TRACE_DEVEL("Token specific msg_sign_key_init failed.\n");
+        sign_mgr_cleanup(tokdata, sess, ctx);
+    }
+
+    return rc;
+}
+
+
+//
+//
+CK_RV sign_mgr_sign_msg(STDLL_TokData_t *tokdata, SESSION *sess,
+                        CK_BBOOL length_only, SIGN_VERIFY_CONTEXT *ctx,
+                        void *param, CK_ULONG param_len,
+                        CK_BYTE *in_data, CK_ULONG in_data_len,
+                        CK_BYTE *out_data, CK_ULONG *out_data_len)
+{
+    // none of the supported mechanisms has per-message parameters
+    if (param != NULL || param_len != 0) {
+        TRACE_ERROR("%s\n", ock_err(ERR_MECHANISM_PARAM_INVALID));
+        return CKR_MECHANISM_PARAM_INVALID;
+    }
+
+    return sign_mgr_sign(tokdata, sess, length_only, ctx,
+                         in_data, in_data_len, out_data, out_data_len);
+}
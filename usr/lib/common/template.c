@@ -32,6 +32,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <openssl/rand.h>
+#include <openssl/crypto.h>
 
 #include "pkcs11types.h"
 #include "defs.h"
@@ -41,10 +42,105 @@
 #include "pkcs32.h"
 #include "p11util.h"
 #include "attributes.h"
+#include "secure_arena.h"
 #include "trace.h"
 
 static CK_ULONG attribute_get_compressed_size(CK_ATTRIBUTE_PTR attr);
 
+/* Is ptr within the object record block the template was restored from? */
+static inline CK_BBOOL template_record_owns(TEMPLATE *tmpl, const void *ptr)
+{
+    const CK_BYTE *p = ptr;
+
+    return tmpl->record != NULL && p >= tmpl->record &&
+           p < tmpl->record + tmpl->record_len;
+}
+
+/*
+ * Move the value of a key material attribute that is owned by the template
+ * into the secure arena. The attribute structure itself stays where it is,
+ * only its pValue is redirected, so pointers held by callers remain valid.
+ * If the arena is not available or full, the value stays on the heap.
+ */
+static void template_attribute_protect(TEMPLATE *tmpl, CK_ATTRIBUTE *attr)
+{
+    CK_OBJECT_CLASS class;
+    CK_BYTE *value;
+
+    if (attr->ulValueLen == 0 ||
+        (attr->pValue != (CK_BYTE *)attr + sizeof(CK_ATTRIBUTE) &&
+         !template_record_owns(tmpl, attr->pValue)))
+        return;
+
+    switch (attr->type) {
+    case CKA_VALUE:
+        /*
+         * CKA_VALUE is key material only for private and secret keys. If the
+         * class is not known (yet), it is treated as key material.
+         */
+        if (template_attribute_get_ulong(tmpl, CKA_CLASS, &class) != CKR_OK)
+            break;
+        if (class != CKO_PRIVATE_KEY && class != CKO_SECRET_KEY)
+            return;
+        break;
+    case CKA_PRIVATE_EXPONENT:
+    case CKA_PRIME_1:
+    case CKA_PRIME_2:
+    case CKA_EXPONENT_1:
+    case CKA_EXPONENT_2:
+    case CKA_COEFFICIENT:
+        break;
+    default:
+        return;
+    }
+
+    value = secure_arena_alloc(attr->ulValueLen);
+    if (value == NULL)
+        return;
+
+    memcpy(value, attr->pValue, attr->ulValueLen);
+    OPENSSL_cleanse(attr->pValue, attr->ulValueLen);
+    attr->pValue = value;
+}
+
+/* Free an attribute that is owned by a template. */
+static void template_attribute_free(TEMPLATE *tmpl, CK_ATTRIBUTE *attr)
+{
+    if (template_record_owns(tmpl, attr)) {
+        /* Released together with the record block by template_free() */
+        if (!is_attribute_attr_array(attr->type) && attr->ulValueLen > 0 &&
+            secure_arena_owns(attr->pValue))
+            secure_arena_free(attr->pValue);
+        return;
+    }
+
+    if (is_attribute_attr_array(attr->type)) {
+        cleanse_and_free_attribute_array2((CK_ATTRIBUTE_PTR)attr->pValue,
+                                          attr->ulValueLen /
+                                                sizeof(CK_ATTRIBUTE),
+                                          FALSE);
+    } else if (attr->ulValueLen > 0 && secure_arena_owns(attr->pValue)) {
+        secure_arena_free(attr->pValue);
+    }
+    free(attr);
+}
+
+/* Remove a node from the template's attribute list. */
+static void template_remove_node(TEMPLATE *tmpl, DL_NODE *node)
+{
+    if (!template_record_owns(tmpl, node)) {
+        tmpl->attribute_list = dlist_remove_node(tmpl->attribute_list, node);
+        return;
+    }
+
+    if (node->prev != NULL)
+        node->prev->next = node->next;
+    else
+        tmpl->attribute_list = node->next;
+    if (node->next != NULL)
+        node->next->prev = node->prev;
+}
+
 /* Random 32 byte string is unique with overwhelming probability. */
 #define UNIQUE_ID_LEN 32
 
@@ -621,11 +717,14 @@ CK_RV template_copy(TEMPLATE *dest, TEMPLATE *src)
             return CKR_HOST_MEMORY;
         }
 
-        memcpy(new_attr, attr, len);
-        if (new_attr->ulValueLen > 0)
+        /* The value may live in the secure arena, copy it via pValue */
+        memcpy(new_attr, attr, sizeof(CK_ATTRIBUTE));
+        if (new_attr->ulValueLen > 0) {
             new_attr->pValue = (CK_BYTE *) new_attr + sizeof(CK_ATTRIBUTE);
-        else
+            memcpy(new_attr->pValue, attr->pValue, attr->ulValueLen);
+        } else {
             new_attr->pValue = NULL;
+        }
 
         if (is_attribute_attr_array(new_attr->type) &&
             new_attr->ulValueLen > 0) {
@@ -666,6 +765,7 @@ CK_RV template_copy(TEMPLATE *dest, TEMPLATE *src)
             return CKR_HOST_MEMORY;
         }
         dest->attribute_list = list;
+        template_attribute_protect(dest, new_attr);
         node = node->next;
     }
 
@@ -817,8 +917,12 @@ CK_RV template_flatten(TEMPLATE *tmpl, CK_BYTE *dest)
         }
 
         if (long_len == 4) {
-            memcpy(ptr, attr, sizeof(CK_ATTRIBUTE) + attr->ulValueLen);
-            ptr += sizeof(CK_ATTRIBUTE) + attr->ulValueLen;
+            memcpy(ptr, attr, sizeof(CK_ATTRIBUTE));
+            ptr += sizeof(CK_ATTRIBUTE);
+            if (attr->ulValueLen != 0) {
+                memcpy(ptr, attr->pValue, attr->ulValueLen);
+                ptr += attr->ulValueLen;
+            }
         } else {
             attr_32.type = attr->type;
             attr_32.pValue = 0x00;
@@ -1199,6 +1303,271 @@ add_it:
 }
 
 
+/* Adds the table entries and the value heap needed by an attribute. */
+static void attribute_get_record_size(CK_ATTRIBUTE_PTR attr,
+                                      CK_ULONG *num_entries,
+                                      CK_ULONG *heap_len)
+{
+    CK_ATTRIBUTE_PTR attrs;
+    CK_ULONG i;
+
+    (*num_entries)++;
+
+    if (is_attribute_attr_array(attr->type)) {
+        attrs = (CK_ATTRIBUTE_PTR)attr->pValue;
+        for (i = 0; i < attr->ulValueLen / sizeof(CK_ATTRIBUTE); i++)
+            attribute_get_record_size(&attrs[i], num_entries, heap_len);
+    } else if (flatten_ulong_attribute_as_ulong32(attr->type) &&
+               attr->ulValueLen != 0) {
+        *heap_len += sizeof(uint64_t);
+    } else {
+        *heap_len += OBJECT_RECORD_ALIGN(attr->ulValueLen);
+    }
+}
+
+/* template_get_record_size()
+ *
+ * returns the number of attribute table entries and the size of the value
+ * heap that template_flatten_record() produces
+ */
+void template_get_record_size(TEMPLATE *tmpl, CK_ULONG *num_entries,
+                              CK_ULONG *heap_len)
+{
+    DL_NODE *node;
+
+    *num_entries = 0;
+    *heap_len = 0;
+
+    if (tmpl == NULL)
+        return;
+
+    for (node = tmpl->attribute_list; node != NULL; node = node->next)
+        attribute_get_record_size((CK_ATTRIBUTE *)node->data, num_entries,
+                                  heap_len);
+}
+
+struct record_cursor {
+    OBJECT_RECORD_ATTR *table;
+    CK_BYTE *heap;
+    CK_ULONG next_entry;
+    CK_ULONG heap_ofs;
+};
+
+static void attribute_flatten_record(struct record_cursor *cur,
+                                     CK_ATTRIBUTE_PTR attr, CK_ULONG index)
+{
+    OBJECT_RECORD_ATTR *entry = &cur->table[index];
+    CK_ATTRIBUTE_PTR attrs;
+    CK_ULONG i;
+    uint64_t val;
+
+    entry->type = attr->type;
+    entry->flags = 0;
+
+    if (is_attribute_attr_array(attr->type)) {
+        /* The elements get the next free range of table entries */
+        entry->flags = OBJECT_RECORD_ATTR_ARRAY;
+        entry->offset = cur->next_entry;
+        entry->len = attr->ulValueLen / sizeof(CK_ATTRIBUTE);
+        cur->next_entry += entry->len;
+
+        attrs = (CK_ATTRIBUTE_PTR)attr->pValue;
+        for (i = 0; i < entry->len; i++)
+            attribute_flatten_record(cur, &attrs[i], entry->offset + i);
+        return;
+    }
+
+    entry->offset = cur->heap_ofs;
+    if (flatten_ulong_attribute_as_ulong32(attr->type) &&
+        attr->ulValueLen != 0) {
+        val = *(CK_ULONG *)attr->pValue;
+        memcpy(cur->heap + cur->heap_ofs, &val, sizeof(val));
+        entry->flags = OBJECT_RECORD_ATTR_ULONG;
+        entry->len = sizeof(val);
+    } else {
+        if (attr->ulValueLen != 0)
+            memcpy(cur->heap + cur->heap_ofs, attr->pValue, attr->ulValueLen);
+        entry->len = attr->ulValueLen;
+    }
+    cur->heap_ofs += OBJECT_RECORD_ALIGN(entry->len);
+}
+
+/* template_flatten_record()
+ *
+ * writes the attribute table and the value heap of an object record to
+ * dest. The top level attributes come first in the table. dest must be
+ * zeroed and sized as returned by template_get_record_size().
+ */
+CK_RV template_flatten_record(TEMPLATE *tmpl, CK_BYTE *dest,
+                              CK_ULONG num_entries)
+{
+    struct record_cursor cur;
+    DL_NODE *node;
+    CK_ULONG i;
+
+    if (!tmpl || !dest) {
+        TRACE_ERROR("Invalid function arguments.\n");
+        return CKR_FUNCTION_FAILED;
+    }
+
+    cur.table = (OBJECT_RECORD_ATTR *)dest;
+    cur.heap = dest + num_entries * sizeof(OBJECT_RECORD_ATTR);
+    cur.next_entry = template_get_count(tmpl);
+    cur.heap_ofs = 0;
+
+    for (node = tmpl->attribute_list, i = 0; node != NULL;
+         node = node->next, i++)
+        attribute_flatten_record(&cur, (CK_ATTRIBUTE *)node->data, i);
+
+    return CKR_OK;
+}
+
+static CK_RV attribute_unflatten_record(const CK_BYTE *table,
+                                        CK_ULONG num_entries,
+                                        CK_BYTE *heap, CK_ULONG heap_len,
+                                        CK_ATTRIBUTE *attrs, CK_ULONG index,
+                                        CK_ULONG *next_entry)
+{
+    CK_ATTRIBUTE *attr = &attrs[index];
+    OBJECT_RECORD_ATTR entry;
+    CK_ULONG i, val;
+    uint64_t val64;
+    CK_RV rc;
+
+    memcpy(&entry, table + index * sizeof(entry), sizeof(entry));
+    attr->type = entry.type;
+
+    if (entry.flags & OBJECT_RECORD_ATTR_ARRAY) {
+        /* Element ranges are allocated in order, this also rules out loops */
+        if (!is_attribute_attr_array(entry.type) ||
+            entry.offset != *next_entry ||
+            entry.len > num_entries - *next_entry) {
+            TRACE_ERROR("Invalid attribute array in object record\n");
+            return CKR_FUNCTION_FAILED;
+        }
+        *next_entry += entry.len;
+
+        attr->ulValueLen = entry.len * sizeof(CK_ATTRIBUTE);
+        attr->pValue = entry.len > 0 ? &attrs[entry.offset] : NULL;
+        for (i = 0; i < entry.len; i++) {
+            rc = attribute_unflatten_record(table, num_entries, heap,
+                                            heap_len, attrs, entry.offset + i,
+                                            next_entry);
+            if (rc != CKR_OK)
+                return rc;
+        }
+        return CKR_OK;
+    }
+
+    if (is_attribute_attr_array(entry.type) || entry.offset > heap_len ||
+        entry.len > heap_len - entry.offset) {
+        TRACE_ERROR("Invalid attribute in object record\n");
+        return CKR_FUNCTION_FAILED;
+    }
+
+    attr->ulValueLen = entry.len;
+    attr->pValue = entry.len > 0 ? heap + entry.offset : NULL;
+
+    if (entry.flags & OBJECT_RECORD_ATTR_ULONG) {
+        if (entry.len != sizeof(val64)) {
+            TRACE_ERROR("Invalid attribute in object record\n");
+            return CKR_FUNCTION_FAILED;
+        }
+        /* Values are 8 byte aligned, a CK_ULONG fits into its slot */
+        memcpy(&val64, attr->pValue, sizeof(val64));
+        val = (CK_ULONG)val64;
+        memcpy(attr->pValue, &val, sizeof(val));
+        attr->ulValueLen = sizeof(val);
+    }
+
+    return CKR_OK;
+}
+
+/* template_unflatten_record()
+ *
+ * restores a template from the attribute table and value heap of an object
+ * record. The list nodes, the attributes and the values all live in one
+ * allocation that mirrors the record and is released by template_free().
+ * The caller must ensure that buf holds the table and the heap.
+ */
+CK_RV template_unflatten_record(TEMPLATE **new_tmpl, const CK_BYTE *buf,
+                                CK_ULONG num_attrs, CK_ULONG num_entries,
+                                CK_ULONG heap_len)
+{
+    TEMPLATE *tmpl;
+    DL_NODE *nodes;
+    CK_ATTRIBUTE *attrs;
+    CK_BYTE *heap;
+    CK_ULONG i, next_entry = num_attrs;
+    CK_RV rc;
+
+    if (!new_tmpl || !buf || num_attrs > num_entries) {
+        TRACE_ERROR("Invalid function arguments.\n");
+        return CKR_FUNCTION_FAILED;
+    }
+
+    tmpl = (TEMPLATE *) calloc(1, sizeof(TEMPLATE));
+    if (!tmpl) {
+        TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
+        return CKR_HOST_MEMORY;
+    }
+
+    if (num_entries == 0) {
+        *new_tmpl = tmpl;
+        return CKR_OK;
+    }
+
+    tmpl->record_len = num_attrs * sizeof(DL_NODE) +
+                       num_entries * sizeof(CK_ATTRIBUTE) + heap_len;
+    tmpl->record = malloc(tmpl->record_len);
+    if (tmpl->record == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
+        free(tmpl);
+        return CKR_HOST_MEMORY;
+    }
+
+    nodes = (DL_NODE *)tmpl->record;
+    attrs = (CK_ATTRIBUTE *)(nodes + num_attrs);
+    heap = (CK_BYTE *)(attrs + num_entries);
+    memcpy(heap, buf + num_entries * sizeof(OBJECT_RECORD_ATTR), heap_len);
+
+    for (i = 0; i < num_attrs; i++) {
+        rc = attribute_unflatten_record(buf, num_entries, heap, heap_len,
+                                        attrs, i, &next_entry);
+        if (rc != CKR_OK)
+            goto error;
+    }
+    if (next_entry != num_entries) {
+        TRACE_ERROR("Unreferenced entries in object record\n");
+        rc = CKR_FUNCTION_FAILED;
+        goto error;
+    }
+
+    /* Same order as template_unflatten() produces */
+    for (i = 0; i < num_attrs; i++) {
+        nodes[i].data = &attrs[i];
+        nodes[i].prev = NULL;
+        nodes[i].next = tmpl->attribute_list;
+        if (tmpl->attribute_list != NULL)
+            tmpl->attribute_list->prev = &nodes[i];
+        tmpl->attribute_list = &nodes[i];
+    }
+
+    for (i = 0; i < num_attrs; i++)
+        template_attribute_protect(tmpl, &attrs[i]);
+
+    *new_tmpl = tmpl;
+
+    return CKR_OK;
+
+error:
+    OPENSSL_cleanse(tmpl->record, tmpl->record_len);
+    free(tmpl->record);
+    free(tmpl);
+
+    return rc;
+}
+
 /* template_free() */
 CK_RV template_free(TEMPLATE *tmpl)
 {
@@ -1208,18 +1577,15 @@ CK_RV template_free(TEMPLATE *tmpl)
     while (tmpl->attribute_list) {
         CK_ATTRIBUTE *attr = (CK_ATTRIBUTE *) tmpl->attribute_list->data;
 
-        if (attr) {
-            if (is_attribute_attr_array(attr->type)) {
-                cleanse_and_free_attribute_array2(
-                                    (CK_ATTRIBUTE_PTR)attr->pValue,
-                                    attr->ulValueLen / sizeof(CK_ATTRIBUTE),
-                                    FALSE);
-            }
-            free(attr);
-        }
+        if (attr)
+            template_attribute_free(tmpl, attr);
 
-        tmpl->attribute_list = dlist_remove_node(tmpl->attribute_list,
-                                                 tmpl->attribute_list);
+        template_remove_node(tmpl, tmpl->attribute_list);
+    }
+
+    if (tmpl->record != NULL) {
+        OPENSSL_cleanse(tmpl->record, tmpl->record_len);
+        free(tmpl->record);
     }
 
     free(tmpl);
@@ -1640,15 +2006,8 @@ CK_RV template_update_attribute(TEMPLATE *tmpl, CK_ATTRIBUTE *new_attr)
         attr = (CK_ATTRIBUTE *) node->data;
 
         if (new_attr->type == attr->type) {
-            if (is_attribute_attr_array(attr->type)) {
-                 cleanse_and_free_attribute_array2(
-                                     (CK_ATTRIBUTE_PTR)attr->pValue,
-                                     attr->ulValueLen / sizeof(CK_ATTRIBUTE),
-                                     FALSE);
-            }
-            free(attr);
-            tmpl->attribute_list =
-                dlist_remove_node(tmpl->attribute_list, node);
+            template_attribute_free(tmpl, attr);
+            template_remove_node(tmpl, node);
             break;
         }
 
@@ -1663,6 +2022,8 @@ CK_RV template_update_attribute(TEMPLATE *tmpl, CK_ATTRIBUTE *new_attr)
     }
 
     tmpl->attribute_list = list;
+    template_attribute_protect(tmpl, new_attr);
+
     return CKR_OK;
 }
 
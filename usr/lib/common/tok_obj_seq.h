@@ -0,0 +1,90 @@
+/*
+ * COPYRIGHT (c) International Business Machines Corp. 2024
+ *
+ * This program is provided under the terms of the Common Public License,
+ * version 1.0 (CPL-1.0). Any use, reproduction or distribution for this
+ * software constitutes recipient's acceptance of CPL-1.0 terms which can be
+ * found in the file LICENSE file or at
+ * https://opensource.org/licenses/cpl1.0.php
+ */
+
+#ifndef __TOK_OBJ_SEQ_H
+#define __TOK_OBJ_SEQ_H
+
+#include <string.h>
+
+#include "pkcs11types.h"
+#include "defs.h"
+#include "host_defs.h"
+
+/*
+ * The token object lists in the shared memory are modified only while holding
+ * the XProcLock. Writers additionally make the sequence counter odd while they
+ * modify the lists, so that readers not holding the XProcLock can detect
+ * concurrent modifications.
+ */
+static inline void tok_obj_seq_write_begin(LW_SHM_TYPE *global_shm)
+{
+    __atomic_store_n(&global_shm->tok_obj_seq, global_shm->tok_obj_seq + 1,
+                     __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void tok_obj_seq_write_end(LW_SHM_TYPE *global_shm)
+{
+    __atomic_store_n(&global_shm->tok_obj_seq, global_shm->tok_obj_seq + 1,
+                     __ATOMIC_RELEASE);
+}
+
+/*
+ * Check without the XProcLock whether entry 'index' of the private or public
+ * token object list still has the given name and update counter. Returns
+ * FALSE if it does not, or if a writer modified the lists while the entry was
+ * read. The caller then has to check the entry under the XProcLock.
+ */
+static inline CK_BBOOL tok_obj_seq_entry_unchanged(LW_SHM_TYPE *global_shm,
+                                                   CK_BBOOL priv,
+                                                   CK_ULONG index,
+                                                   const CK_BYTE *name,
+                                                   CK_ULONG_32 count_hi,
+                                                   CK_ULONG_32 count_lo)
+{
+    TOK_OBJ_ENTRY *entry;
+    CK_ULONG_32 seq, num_entries;
+    CK_BBOOL unchanged;
+
+    seq = __atomic_load_n(&global_shm->tok_obj_seq, __ATOMIC_ACQUIRE);
+    if (seq & 1)
+        return FALSE;
+
+    if (priv) {
+        num_entries = __atomic_load_n(&global_shm->num_priv_tok_obj,
+                                      __ATOMIC_RELAXED);
+        entry = global_shm->priv_tok_objs;
+    } else {
+        num_entries = __atomic_load_n(&global_shm->num_publ_tok_obj,
+                                      __ATOMIC_RELAXED);
+        entry = global_shm->publ_tok_objs;
+    }
+    if (index >= num_entries || index >= MAX_TOK_OBJS)
+        return FALSE;
+    entry += index;
+
+    unchanged = memcmp(name, entry->name, 8) == 0 &&
+                __atomic_load_n(&entry->count_hi, __ATOMIC_RELAXED) ==
+                                                                count_hi &&
+                __atomic_load_n(&entry->count_lo, __ATOMIC_RELAXED) ==
+                                                                count_lo;
+
+#ifdef TOK_OBJ_SEQ_TEST_HOOK
+    TOK_OBJ_SEQ_TEST_HOOK(global_shm);
+#endif
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    if (__atomic_load_n(&global_shm->tok_obj_seq, __ATOMIC_RELAXED) != seq)
+        return FALSE;
+
+    return unchanged;
+}
+
+#endif
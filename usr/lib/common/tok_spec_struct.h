@@ -73,6 +73,10 @@ struct token_specific_struct {
     // any specific final code
     CK_RV(*t_final) (STDLL_TokData_t *, CK_BBOOL);
 
+    // Re-establish per-process resources in a forked child that keeps the
+    // token state of its parent. NULL if the token does not support this.
+    CK_RV(*t_fork_child) (STDLL_TokData_t *);
+
     CK_RV(*t_init_token) (STDLL_TokData_t *, CK_SLOT_ID, CK_CHAR_PTR,
                           CK_ULONG, CK_CHAR_PTR);
     CK_RV(*t_login) (STDLL_TokData_t *, SESSION *, CK_USER_TYPE,
@@ -153,6 +157,9 @@ struct token_specific_struct {
 
     CK_RV(*t_rsa_generate_keypair) (STDLL_TokData_t *tokdata, TEMPLATE *,
                                     TEMPLATE *);
+    // Token Specific message-based signing (private key set up once per init)
+    CK_RV(*t_msg_sign_key_init) (STDLL_TokData_t *, SESSION *,
+                                 SIGN_VERIFY_CONTEXT *, CK_OBJECT_HANDLE);
 
     CK_RV(*t_ec_sign) (STDLL_TokData_t *tokdata, SESSION *, CK_BYTE *, CK_ULONG,
                        CK_BYTE *, CK_ULONG *, OBJECT *);
@@ -186,6 +193,13 @@ struct token_specific_struct {
                           CK_ULONG);
     CK_RV(*t_sha_final) (STDLL_TokData_t *, DIGEST_CONTEXT *, CK_BYTE *,
                          CK_ULONG *);
+    // Token Specific streaming digest for hash-and-sign mechanisms
+    CK_RV(*t_sha_stream_init) (STDLL_TokData_t *, DIGEST_CONTEXT *,
+                               CK_MECHANISM *);
+    CK_RV(*t_sha_stream_update) (STDLL_TokData_t *, DIGEST_CONTEXT *,
+                                 CK_BYTE *, CK_ULONG);
+    CK_RV(*t_sha_stream_final) (STDLL_TokData_t *, DIGEST_CONTEXT *,
+                                CK_BYTE *, CK_ULONG *);
 
     // Token Specific HMAC
     CK_RV(*t_hmac_sign_init) (STDLL_TokData_t *, SESSION *, CK_MECHANISM *,
@@ -236,6 +250,14 @@ struct token_specific_struct {
     CK_RV(*t_aes_gcm_final) (STDLL_TokData_t *, SESSION *,
                              ENCR_DECR_CONTEXT *, CK_BYTE *,
                              CK_ULONG *, CK_BYTE);
+    // Token Specific message-based AES-GCM (key set up once per init)
+    CK_RV(*t_aes_gcm_msg_init) (STDLL_TokData_t *, SESSION *,
+                                ENCR_DECR_CONTEXT *, CK_OBJECT_HANDLE,
+                                CK_BYTE);
+    CK_RV(*t_aes_gcm_msg) (STDLL_TokData_t *, SESSION *, ENCR_DECR_CONTEXT *,
+                           CK_GCM_MESSAGE_PARAMS *, CK_BYTE *, CK_ULONG,
+                           CK_BYTE *, CK_ULONG, CK_BYTE *, CK_ULONG *,
+                           CK_BYTE);
 
     CK_RV(*t_aes_ofb) (STDLL_TokData_t *, CK_BYTE *, CK_ULONG, CK_BYTE *,
                        OBJECT *, CK_BYTE *, uint_32);
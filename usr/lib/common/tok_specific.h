@@ -39,6 +39,7 @@ CK_RV token_specific_save_token_data(STDLL_TokData_t *, CK_SLOT_ID slot_id,
                                      FILE *fh);
 
 CK_RV token_specific_final(STDLL_TokData_t *, CK_BBOOL);
+CK_RV token_specific_fork_child(STDLL_TokData_t *);
 CK_RV token_specific_init_token(STDLL_TokData_t *, CK_SLOT_ID, CK_CHAR_PTR,
                                 CK_ULONG, CK_CHAR_PTR);
 CK_RV token_specific_login(STDLL_TokData_t *, SESSION *, CK_USER_TYPE,
@@ -166,6 +167,9 @@ CK_RV token_specific_copy_object(SESSION *, CK_ATTRIBUTE_PTR, CK_ULONG,
 CK_RV token_specific_ec_generate_keypair(STDLL_TokData_t *, TEMPLATE *,
                                          TEMPLATE *);
 
+CK_RV token_specific_msg_sign_key_init(STDLL_TokData_t *, SESSION *,
+                                       SIGN_VERIFY_CONTEXT *, CK_OBJECT_HANDLE);
+
 CK_RV token_specific_create_object(SESSION *, CK_ATTRIBUTE_PTR, CK_ULONG,
                                    CK_OBJECT_HANDLE_PTR);
 
@@ -205,6 +209,15 @@ CK_RV token_specific_sha_update(STDLL_TokData_t *, DIGEST_CONTEXT *, CK_BYTE *,
 CK_RV token_specific_sha_final(STDLL_TokData_t *, DIGEST_CONTEXT *, CK_BYTE *,
                                CK_ULONG *);
 
+CK_RV token_specific_sha_stream_init(STDLL_TokData_t *, DIGEST_CONTEXT *,
+                                     CK_MECHANISM *);
+
+CK_RV token_specific_sha_stream_update(STDLL_TokData_t *, DIGEST_CONTEXT *,
+                                       CK_BYTE *, CK_ULONG);
+
+CK_RV token_specific_sha_stream_final(STDLL_TokData_t *, DIGEST_CONTEXT *,
+                                      CK_BYTE *, CK_ULONG *);
+
 CK_RV token_specific_hmac_sign_init(STDLL_TokData_t *, SESSION *,
                                     CK_MECHANISM *, CK_OBJECT_HANDLE);
 
@@ -270,6 +283,15 @@ CK_RV token_specific_aes_gcm_final(STDLL_TokData_t *, SESSION *,
                                    ENCR_DECR_CONTEXT *, CK_BYTE *,
                                    CK_ULONG *, CK_BYTE);
 
+CK_RV token_specific_aes_gcm_msg_init(STDLL_TokData_t *, SESSION *,
+                                      ENCR_DECR_CONTEXT *, CK_OBJECT_HANDLE,
+                                      CK_BYTE);
+
+CK_RV token_specific_aes_gcm_msg(STDLL_TokData_t *, SESSION *,
+                                 ENCR_DECR_CONTEXT *, CK_GCM_MESSAGE_PARAMS *,
+                                 CK_BYTE *, CK_ULONG, CK_BYTE *, CK_ULONG,
+                                 CK_BYTE *, CK_ULONG *, CK_BYTE);
+
 CK_RV token_specific_aes_ofb(STDLL_TokData_t *,
                              CK_BYTE *,
                              CK_ULONG, CK_BYTE *, OBJECT *, CK_BYTE *, uint_32);
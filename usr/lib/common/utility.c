@@ -640,6 +640,27 @@ err:
     return rc;
 }
 
+/*
+ * A forked child that keeps the token state of its parent also keeps the
+ * mapping of the shared memory, and needs its own reference on it.
+ */
+CK_RV fork_child_shm(STDLL_TokData_t *tokdata)
+{
+    CK_RV rc;
+
+    rc = XProcLock(tokdata);
+    if (rc != CKR_OK)
+        return rc;
+
+    if (sm_add_ref((void *) tokdata->global_shm)) {
+        TRACE_DEVEL("sm_add_ref failed.\n");
+        XProcUnLock(tokdata);
+        return CKR_FUNCTION_FAILED;
+    }
+
+    return XProcUnLock(tokdata);
+}
+
 /* Compute specified SHA or MD5 using software */
 CK_RV compute_sha(STDLL_TokData_t *tokdata, CK_BYTE *data, CK_ULONG len,
                   CK_BYTE *hash, CK_ULONG mech)
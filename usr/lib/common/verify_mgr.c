@@ -1231,3 +1231,63 @@ CK_RV verify_mgr_verify_recover(STDLL_TokData_t *tokdata,
 
     return CKR_FUNCTION_FAILED;
 }
+
+//
+// Message-based verification, see sign_mgr_msg_init.
+//
+CK_RV verify_mgr_msg_init(STDLL_TokData_t *tokdata, SESSION *sess,
+                          SIGN_VERIFY_CONTEXT *ctx, CK_MECHANISM *mech,
+                          CK_OBJECT_HANDLE key, CK_BBOOL checkpolicy)
+{
+    if (!sess || !ctx || !mech) {
+        TRACE_ERROR("Invalid function arguments.\n");
+        return CKR_FUNCTION_FAILED;
+    }
+
+    switch (mech->mechanism) {
+    case CKM_RSA_X_509:
+    case CKM_RSA_PKCS:
+    case CKM_RSA_PKCS_PSS:
+    case CKM_SHA1_RSA_PKCS:
+    case CKM_SHA224_RSA_PKCS:
+    case CKM_SHA256_RSA_PKCS:
+    case CKM_SHA384_RSA_PKCS:
+    case CKM_SHA512_RSA_PKCS:
+    case CKM_SHA1_RSA_PKCS_PSS:
+    case CKM_SHA224_RSA_PKCS_PSS:
+    case CKM_SHA256_RSA_PKCS_PSS:
+    case CKM_SHA384_RSA_PKCS_PSS:
+    case CKM_SHA512_RSA_PKCS_PSS:
+    case CKM_ECDSA:
+    case CKM_ECDSA_SHA1:
+    case CKM_ECDSA_SHA224:
+    case CKM_ECDSA_SHA256:
+    case CKM_ECDSA_SHA384:
+    case CKM_ECDSA_SHA512:
+        break;
+    default:
+        TRACE_ERROR("%s\n", ock_err(ERR_MECHANISM_INVALID));
+        return CKR_MECHANISM_INVALID;
+    }
+
+    return verify_mgr_init(tokdata, sess, ctx, mech, FALSE, key, checkpolicy);
+}
+
+
+//
+//
+CK_RV verify_mgr_verify_msg(STDLL_TokData_t *tokdata, SESSION *sess,
+                            SIGN_VERIFY_CONTEXT *ctx,
+                            void *param, CK_ULONG param_len,
+                            CK_BYTE *in_data, CK_ULONG in_data_len,
+                            CK_BYTE *signature, CK_ULONG sig_len)
+{
+    // none of the supported mechanisms has per-message parameters
+    if (param != NULL || param_len != 0) {
+        TRACE_ERROR("%s\n", ock_err(ERR_MECHANISM_PARAM_INVALID));
+        return CKR_MECHANISM_PARAM_INVALID;
+    }
+
+    return verify_mgr_verify(tokdata, sess, ctx, in_data, in_data_len,
+                             signature, sig_len);
+}
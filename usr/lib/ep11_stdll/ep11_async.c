@@ -0,0 +1,219 @@
+/*
+ * COPYRIGHT (c) International Business Machines Corp. 2024
+ *
+ * This program is provided under the terms of the Common Public License,
+ * version 1.0 (CPL-1.0). Any use, reproduction or distribution for this
+ * software constitutes recipient's acceptance of CPL-1.0 terms which can be
+ * found in the file LICENSE file or at
+ * https://opensource.org/licenses/cpl1.0.php
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "pkcs11types.h"
+#include "defs.h"
+#include "trace.h"
+#include "ep11_async.h"
+
+struct ep11_async_lane {
+    struct ep11_async_lane_info info;
+    unsigned int running;
+    time_t offline_until;
+    unsigned long completed;
+    unsigned long failovers;
+};
+
+struct ep11_async {
+    pthread_mutex_t mutex;
+    pthread_cond_t lane_cond;       /* a request slot of a lane got free */
+    unsigned int num_lanes;
+    unsigned int depth;
+    unsigned int next_lane;
+    struct ep11_async_lane *lanes;
+};
+
+static time_t now_secs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec;
+}
+
+static CK_BBOOL is_device_failure(CK_RV rc)
+{
+    return rc == CKR_DEVICE_ERROR || rc == CKR_DEVICE_REMOVED;
+}
+
+/*
+ * Selects the online lane with the fewest requests in flight, other than
+ * 'exclude'. Lanes with the same load are used in turn. If all lanes are
+ * offline, the one that went offline first is used, so requests are not
+ * failed without trying. Returns NULL if the selected lane has no free
+ * request slot. Must be called with the mutex held.
+ */
+static struct ep11_async_lane *select_lane(struct ep11_async *async,
+                                           struct ep11_async_lane *exclude)
+{
+    struct ep11_async_lane *lane, *best = NULL, *oldest = NULL;
+    time_t now = now_secs();
+    unsigned int i;
+
+    for (i = 0; i < async->num_lanes; i++) {
+        lane = &async->lanes[(async->next_lane + i) % async->num_lanes];
+        if (lane == exclude)
+            continue;
+
+        if (lane->offline_until > now) {
+            if (oldest == NULL || lane->offline_until < oldest->offline_until)
+                oldest = lane;
+            continue;
+        }
+
+        if (best == NULL || lane->running < best->running)
+            best = lane;
+    }
+
+    if (best == NULL)
+        best = oldest;
+    if (best == NULL || best->running >= async->depth)
+        return NULL;
+
+    async->next_lane = (best - async->lanes + 1) % async->num_lanes;
+    return best;
+}
+
+/*
+ * Executes a request on the selected lane, and on other lanes as long as it
+ * fails with a device error. Must be called with the mutex held, it is
+ * released while the request function runs.
+ */
+static CK_RV execute(struct ep11_async *async, ep11_async_func_t func,
+                     void *arg)
+{
+    struct ep11_async_lane *lane = NULL;
+    unsigned int attempts = 0;
+    CK_RV rc;
+
+    for (;;) {
+        while ((lane = select_lane(async, lane)) == NULL)
+            pthread_cond_wait(&async->lane_cond, &async->mutex);
+        lane->running++;
+        pthread_mutex_unlock(&async->mutex);
+
+        rc = func(arg, lane->info.target);
+
+        pthread_mutex_lock(&async->mutex);
+        lane->running--;
+        pthread_cond_broadcast(&async->lane_cond);
+        attempts++;
+
+        if (!is_device_failure(rc)) {
+            lane->offline_until = 0;
+            lane->completed++;
+            return rc;
+        }
+
+        if (lane->offline_until <= now_secs())
+            TRACE_WARNING("APQN %02x.%04x failed with rc=0x%lx, taking it "
+                          "offline for %u seconds\n", lane->info.adapter,
+                          lane->info.domain, rc, EP11_ASYNC_OFFLINE_SECS);
+        lane->offline_until = now_secs() + EP11_ASYNC_OFFLINE_SECS;
+
+        if (attempts >= async->num_lanes)
+            return rc;
+
+        TRACE_DEVEL("Moving request away from APQN %02x.%04x\n",
+                    lane->info.adapter, lane->info.domain);
+        lane->failovers++;
+    }
+}
+
+CK_RV ep11_async_create(const struct ep11_async_lane_info *lanes,
+                        unsigned int num_lanes, unsigned int depth,
+                        struct ep11_async **async)
+{
+    struct ep11_async *a;
+    unsigned int i;
+
+    *async = NULL;
+
+    if (num_lanes == 0 || depth == 0 || depth > EP11_ASYNC_MAX_DEPTH)
+        return CKR_ARGUMENTS_BAD;
+
+    a = calloc(1, sizeof(*a));
+    if (a == NULL)
+        return CKR_HOST_MEMORY;
+
+    a->lanes = calloc(num_lanes, sizeof(*a->lanes));
+    if (a->lanes == NULL) {
+        free(a);
+        return CKR_HOST_MEMORY;
+    }
+
+    pthread_mutex_init(&a->mutex, NULL);
+    pthread_cond_init(&a->lane_cond, NULL);
+    a->num_lanes = num_lanes;
+    a->depth = depth;
+
+    for (i = 0; i < num_lanes; i++)
+        a->lanes[i].info = lanes[i];
+
+    TRACE_INFO("Dispatching requests to %u APQNs with at most %u requests "
+               "in flight each\n", num_lanes, depth);
+
+    *async = a;
+    return CKR_OK;
+}
+
+/* Must not be called while requests are executed */
+void ep11_async_destroy(struct ep11_async *async)
+{
+    if (async == NULL)
+        return;
+
+    pthread_cond_destroy(&async->lane_cond);
+    pthread_mutex_destroy(&async->mutex);
+    free(async->lanes);
+    free(async);
+}
+
+/*
+ * Executes a request on the calling thread, once a request slot is free.
+ * Returns the return code of the request function of the last lane it was
+ * executed on.
+ */
+CK_RV ep11_async_call(struct ep11_async *async, ep11_async_func_t func,
+                      void *arg)
+{
+    CK_RV rc;
+
+    pthread_mutex_lock(&async->mutex);
+    rc = execute(async, func, arg);
+    pthread_mutex_unlock(&async->mutex);
+
+    return rc;
+}
+
+unsigned int ep11_async_num_lanes(struct ep11_async *async)
+{
+    return async->num_lanes;
+}
+
+void ep11_async_get_stats(struct ep11_async *async, unsigned int lane,
+                          struct ep11_async_lane_stats *stats)
+{
+    struct ep11_async_lane *l = &async->lanes[lane];
+
+    pthread_mutex_lock(&async->mutex);
+    stats->adapter = l->info.adapter;
+    stats->domain = l->info.domain;
+    stats->completed = l->completed;
+    stats->failovers = l->failovers;
+    stats->running = l->running;
+    stats->online = l->offline_until <= now_secs();
+    pthread_mutex_unlock(&async->mutex);
+}
@@ -0,0 +1,65 @@
+/*
+ * COPYRIGHT (c) International Business Machines Corp. 2024
+ *
+ * This program is provided under the terms of the Common Public License,
+ * version 1.0 (CPL-1.0). Any use, reproduction or distribution for this
+ * software constitutes recipient's acceptance of CPL-1.0 terms which can be
+ * found in the file LICENSE file or at
+ * https://opensource.org/licenses/cpl1.0.php
+ */
+
+/*
+ * OpenCryptoki EP11 token - request dispatching across APQNs
+ *
+ * Requests are dispatched across the APQNs of the token (lanes), with at most
+ * 'depth' requests in flight to each APQN. A request goes to the online lane
+ * with the fewest requests in flight. A request failing with a device error
+ * takes its lane offline for a while and is resubmitted to another lane.
+ *
+ * ep11_async_call() executes a request on the calling thread, which waits
+ * for a free request slot first. The number of requests in flight is thus
+ * bounded by the number of application threads.
+ */
+
+#ifndef EP11_ASYNC_H
+#define EP11_ASYNC_H
+
+#include <stdint.h>
+#include "pkcs11types.h"
+
+#define EP11_ASYNC_MAX_DEPTH        64
+#define EP11_ASYNC_OFFLINE_SECS     10
+
+struct ep11_async;
+
+/* Executes a request against the EP11 target (target_t) of a single APQN */
+typedef CK_RV (*ep11_async_func_t)(void *arg, uint64_t target);
+
+struct ep11_async_lane_info {
+    unsigned int adapter;
+    unsigned int domain;
+    uint64_t target;
+};
+
+struct ep11_async_lane_stats {
+    unsigned int adapter;
+    unsigned int domain;
+    unsigned int running;       /* requests in flight */
+    unsigned long completed;
+    unsigned long failovers;    /* requests moved away after a device error */
+    CK_BBOOL online;
+};
+
+CK_RV ep11_async_create(const struct ep11_async_lane_info *lanes,
+                        unsigned int num_lanes, unsigned int depth,
+                        struct ep11_async **async);
+void ep11_async_destroy(struct ep11_async *async);
+
+CK_RV ep11_async_call(struct ep11_async *async, ep11_async_func_t func,
+                      void *arg);
+
+unsigned int ep11_async_num_lanes(struct ep11_async *async);
+void ep11_async_get_stats(struct ep11_async *async, unsigned int lane,
+                          struct ep11_async_lane_stats *stats);
+
+#endif
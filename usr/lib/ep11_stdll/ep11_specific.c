@@ -63,6 +63,7 @@
 
 #include "ep11_func.h"
 #include "ep11_specific.h"
+#include "ep11_async.h"
 #include "pkey_utils.h"
 
 #define EP11SHAREDLIB_NAME "OCK_EP11_LIBRARY"
@@ -512,6 +513,23 @@ static CK_RV handle_all_ep11_cards(ep11_target_t * ep11_targets,
 #define PKEY_MODE_DEFAULT           1
 #define PKEY_MODE_ENABLE4NONEXTR    2
 
+/*
+ * Mechanism list and mechanism infos of a target, as reported to the
+ * application. Built on first use and never modified afterwards.
+ */
+typedef struct {
+    CK_MECHANISM_TYPE type;
+    CK_RV rc;
+    CK_MECHANISM_INFO info;
+} ep11_mech_entry_t;
+
+typedef struct {
+    CK_ULONG num_mechs;
+    CK_MECHANISM_TYPE *mechs;       /* exposed mechanisms in card order */
+    CK_ULONG num_entries;
+    ep11_mech_entry_t *entries;     /* all card mechanisms, sorted by type */
+} ep11_mech_table_t;
+
 typedef struct {
     volatile unsigned long ref_count;
     target_t target;
@@ -521,6 +539,10 @@ typedef struct {
     size_t control_points_len;
     size_t max_control_point_index;
     CK_CHAR serialNumber[16];
+    ep11_mech_table_t *mech_table;
+    struct ep11_async *async;
+    struct ep11_async_lane_info *async_lanes;
+    unsigned int num_async_lanes;
 } ep11_target_info_t;
 
 typedef struct {
@@ -533,6 +555,7 @@ typedef struct {
     int strict_mode;
     int vhsm_mode;
     int optimize_single_ops;
+    int local_pubkey_ops;
     int pkey_mode;
     int pkey_wrap_supported;
     char pkey_mk_vp[PKEY_MK_VP_LENGTH];
@@ -547,12 +570,14 @@ typedef struct {
     CK_VERSION ep11_lib_version;
     volatile ep11_target_info_t *target_info;
     pthread_rwlock_t target_rwlock;
+    unsigned int async_depth;
 } ep11_private_data_t;
 
 static ep11_target_info_t *get_target_info(STDLL_TokData_t *tokdata);
 static void put_target_info(STDLL_TokData_t *tokdata,
                             ep11_target_info_t *target_info);
 static CK_RV refresh_target_info(STDLL_TokData_t *tokdata);
+static void free_mech_table(ep11_mech_table_t *table);
 
 static CK_RV get_ep11_target_for_apqn(uint_32 adapter, uint_32 domain,
                                       target_t *target, uint64_t flags);
@@ -560,6 +585,65 @@ static void free_ep11_target_for_apqn(target_t target);
 static CK_RV update_ep11_attrs_from_blob(STDLL_TokData_t *tokdata,
                                          TEMPLATE *tmpl);
 
+/*
+ * Single-part operations are dispatched across the single APQN targets of the
+ * target info if ASYNC_QUEUE_DEPTH is configured, otherwise the group target
+ * is used.
+ */
+enum ep11_single_op {
+    EP11_SINGLE_SIGN,
+    EP11_SINGLE_VERIFY,
+    EP11_SINGLE_ENCRYPT,
+    EP11_SINGLE_DECRYPT,
+};
+
+struct ep11_single_args {
+    enum ep11_single_op op;
+    const CK_BYTE *blob;
+    size_t blob_len;
+    CK_MECHANISM *mech;
+    CK_BYTE *in;
+    CK_ULONG in_len;
+    CK_BYTE *out;
+    CK_ULONG *out_len;          /* NULL for verify */
+    CK_ULONG sig_len;           /* verify only */
+};
+
+static CK_RV ep11_single_func(void *arg, uint64_t target)
+{
+    struct ep11_single_args *args = arg;
+
+    switch (args->op) {
+    case EP11_SINGLE_SIGN:
+        return dll_m_SignSingle(args->blob, args->blob_len, args->mech,
+                                args->in, args->in_len, args->out,
+                                args->out_len, target);
+    case EP11_SINGLE_VERIFY:
+        return dll_m_VerifySingle(args->blob, args->blob_len, args->mech,
+                                  args->in, args->in_len, args->out,
+                                  args->sig_len, target);
+    case EP11_SINGLE_ENCRYPT:
+        return dll_m_EncryptSingle(args->blob, args->blob_len, args->mech,
+                                   args->in, args->in_len, args->out,
+                                   args->out_len, target);
+    case EP11_SINGLE_DECRYPT:
+        return dll_m_DecryptSingle(args->blob, args->blob_len, args->mech,
+                                   args->in, args->in_len, args->out,
+                                   args->out_len, target);
+    }
+
+    return CKR_FUNCTION_FAILED;
+}
+
+static CK_RV ep11_single(ep11_target_info_t *target_info,
+                         struct ep11_single_args *args)
+{
+    if (target_info->async != NULL)
+        return ep11_async_call(target_info->async, ep11_single_func, args);
+
+    return ep11_single_func(args, target_info->target);
+}
+
 
 /* defined in the makefile, ep11 library can run standalone (without HW card),
    crypto algorithms are implemented in software then (no secure key) */
@@ -973,6 +1057,59 @@ static CK_BBOOL ep11tok_pkey_session_read_write(SESSION *session)
     return CK_FALSE;
 }
 
+/*
+ * Returns true if public key operations with the given key are performed
+ * locally with OpenSSL from the public key attributes, instead of on the
+ * EP11 crypto adapter (LOCAL_PUBLIC_KEY_OPERATIONS token option).
+ */
+static CK_BBOOL ep11tok_local_pubkey(STDLL_TokData_t *tokdata, OBJECT *key_obj)
+{
+    ep11_private_data_t *ep11_data = tokdata->private_data;
+    CK_OBJECT_CLASS class;
+    CK_KEY_TYPE keytype;
+
+    if (!ep11_data->local_pubkey_ops)
+        return CK_FALSE;
+
+    if (template_attribute_get_ulong(key_obj->template, CKA_CLASS,
+                                     &class) != CKR_OK ||
+        class != CKO_PUBLIC_KEY)
+        return CK_FALSE;
+
+    if (template_attribute_get_ulong(key_obj->template, CKA_KEY_TYPE,
+                                     &keytype) != CKR_OK)
+        return CK_FALSE;
+
+    return keytype == CKK_RSA || keytype == CKK_EC;
+}
+
+static CK_BBOOL ep11tok_local_pubkey_mech(CK_MECHANISM_TYPE mech)
+{
+    switch (mech) {
+    case CKM_RSA_PKCS:
+    case CKM_SHA1_RSA_PKCS:
+    case CKM_SHA224_RSA_PKCS:
+    case CKM_SHA256_RSA_PKCS:
+    case CKM_SHA384_RSA_PKCS:
+    case CKM_SHA512_RSA_PKCS:
+    case CKM_RSA_PKCS_PSS:
+    case CKM_SHA1_RSA_PKCS_PSS:
+    case CKM_SHA224_RSA_PKCS_PSS:
+    case CKM_SHA256_RSA_PKCS_PSS:
+    case CKM_SHA384_RSA_PKCS_PSS:
+    case CKM_SHA512_RSA_PKCS_PSS:
+    case CKM_ECDSA:
+    case CKM_ECDSA_SHA1:
+    case CKM_ECDSA_SHA224:
+    case CKM_ECDSA_SHA256:
+    case CKM_ECDSA_SHA384:
+    case CKM_ECDSA_SHA512:
+        return CK_TRUE;
+    default:
+        return CK_FALSE;
+    }
+}
+
 /**
  * Checks if the preconditions for using the related protected key of
  * the given secure key object are met. The caller of this routine must
@@ -1016,6 +1153,11 @@ CK_RV ep11tok_pkey_check(STDLL_TokData_t *tokdata, SESSION *session,
     CK_ATTRIBUTE *opaque_attr = NULL;
     CK_RV ret = CKR_FUNCTION_NOT_SUPPORTED;
 
+    /* Public key operations performed locally use the same software path */
+    if (ep11tok_local_pubkey(tokdata, key_obj) &&
+        ep11tok_local_pubkey_mech(mech->mechanism))
+        return CKR_OK;
+
     /* Check if CPACF supports the operation implied by this key and mech */
     if (!pkey_op_supported_by_cpacf(ep11_data->msa_level, mech->mechanism,
                                     key_obj->template))
@@ -2350,6 +2492,119 @@ static CK_RV ep11tok_load_libica(STDLL_TokData_t *tokdata)
     return CKR_OK;
 }
 
+struct async_lane_data {
+    ep11_private_data_t *ep11_data;
+    ep11_target_info_t *target_info;
+};
+
+static CK_RV add_async_lane_handler(uint_32 adapter, uint_32 domain,
+                                    void *handler_data)
+{
+    struct async_lane_data *data = handler_data;
+    ep11_private_data_t *ep11_data = data->ep11_data;
+    ep11_target_info_t *target_info = data->target_info;
+    struct ep11_async_lane_info *lane;
+    struct XCP_Module module;
+    CK_RV rc;
+
+    if (target_info->num_async_lanes >= MAX_APQN)
+        return CKR_OK;
+
+    lane = &target_info->async_lanes[target_info->num_async_lanes];
+    lane->adapter = adapter;
+    lane->domain = domain;
+    lane->target = XCP_TGT_INIT;
+
+    memset(&module, 0, sizeof(module));
+    module.version = ep11_data->ep11_lib_version.major >= 3 ?
+                                        XCP_MOD_VERSION_2 : XCP_MOD_VERSION_1;
+    module.flags = XCP_MFL_MODULE;
+    module.api = target_info->used_firmware_API_version;
+    module.module_nr = adapter;
+    XCPTGTMASK_SET_DOM(module.domainmask, domain);
+
+    rc = dll_m_add_module(&module, &lane->target);
+    if (rc != CKR_OK) {
+        TRACE_ERROR("%s dll_m_add_module (%02x.%04x) failed: rc=%ld\n",
+                    __func__, adapter, domain, rc);
+        return CKR_OK;
+    }
+
+    target_info->num_async_lanes++;
+    return CKR_OK;
+}
+
+static void ep11tok_free_async(ep11_target_info_t *target_info)
+{
+    unsigned int i;
+
+    ep11_async_destroy(target_info->async);
+    target_info->async = NULL;
+
+    for (i = 0; i < target_info->num_async_lanes; i++)
+        dll_m_rm_module(NULL, target_info->async_lanes[i].target);
+    free(target_info->async_lanes);
+    target_info->async_lanes = NULL;
+    target_info->num_async_lanes = 0;
+}
+
+/*
+ * Sets up the dispatching of single-part operations with one target per
+ * currently available APQN, see ep11_async.h. The lanes are part of the
+ * target info, so they are set up freshly whenever APQNs are added or
+ * removed. Requests are not dispatched if the EP11 host library can not
+ * provide single APQN targets.
+ */
+static CK_RV ep11tok_setup_async(STDLL_TokData_t *tokdata,
+                                 ep11_target_info_t *target_info)
+{
+    ep11_private_data_t *ep11_data = tokdata->private_data;
+    struct async_lane_data data;
+    CK_RV rc;
+
+    if (dll_m_add_module == NULL) {
+        TRACE_WARNING("%s Function dll_m_add_module is not available, "
+                      "request dispatching disabled\n", __func__);
+        OCK_SYSLOG(LOG_WARNING, "%s: Warning: The EP11 host library does not "
+                   "support single APQN targets, ASYNC_QUEUE_DEPTH is "
+                   "ignored\n", __func__);
+        return CKR_OK;
+    }
+
+    target_info->async_lanes = calloc(MAX_APQN,
+                                      sizeof(struct ep11_async_lane_info));
+    if (target_info->async_lanes == NULL)
+        return CKR_HOST_MEMORY;
+
+    data.ep11_data = ep11_data;
+    data.target_info = target_info;
+    rc = handle_all_ep11_cards(&ep11_data->target_list,
+                               add_async_lane_handler, &data);
+    if (rc != CKR_OK)
+        goto error;
+
+    if (target_info->num_async_lanes == 0) {
+        TRACE_ERROR("%s No APQN available for request dispatching\n",
+                    __func__);
+        rc = CKR_DEVICE_ERROR;
+        goto error;
+    }
+
+    rc = ep11_async_create(target_info->async_lanes,
+                           target_info->num_async_lanes,
+                           ep11_data->async_depth, &target_info->async);
+    if (rc != CKR_OK) {
+        TRACE_ERROR("%s ep11_async_create failed: rc=0x%lx\n", __func__, rc);
+        goto error;
+    }
+
+    return CKR_OK;
+
+error:
+    ep11tok_free_async(target_info);
+    return rc;
+}
+
 CK_RV ep11tok_init(STDLL_TokData_t * tokdata, CK_SLOT_ID SlotNumber,
                    char *conf_name)
 {
@@ -2513,9 +2768,14 @@ CK_RV ep11tok_final(STDLL_TokData_t * tokdata, CK_BBOOL in_fork_initializer)
 
     if (ep11_data != NULL) {
         if (ep11_data->target_info != NULL) {
+            /* Worker threads do not exist in the child of a fork */
+            if (!in_fork_initializer)
+                ep11tok_free_async((ep11_target_info_t *)
+                                                    ep11_data->target_info);
             if (dll_m_rm_module != NULL)
                 dll_m_rm_module(NULL, ep11_data->target_info->target);
             free_card_versions(ep11_data->target_info->card_versions);
+            free_mech_table(ep11_data->target_info->mech_table);
             free((void* )ep11_data->target_info);
         }
         pthread_rwlock_destroy(&ep11_data->target_rwlock);
@@ -4584,6 +4844,12 @@ CK_RV token_specific_rsa_verify(STDLL_TokData_t *tokdata, SESSION *session,
     size_t spki_len = 0;
     CK_MECHANISM mech;
 
+    if (ep11tok_local_pubkey(tokdata, key_obj))
+        return openssl_specific_rsa_pkcs_verify(tokdata, session, in_data,
+                                                in_data_len, signature,
+                                                sig_len, key_obj,
+                                                openssl_specific_rsa_encrypt);
+
     rc = obj_opaque_2_blob(tokdata, key_obj, &spki, &spki_len);
     if (rc != CKR_OK) {
         TRACE_ERROR("%s no blob rc=0x%lx\n", __func__, rc);
@@ -4608,6 +4874,24 @@ CK_RV token_specific_rsa_verify(STDLL_TokData_t *tokdata, SESSION *session,
     return rc;
 }
 
+/*
+ * RSA public encryption is only routed here for local public key operations,
+ * see ep11tok_pkey_check().
+ */
+CK_RV token_specific_rsa_encrypt(STDLL_TokData_t *tokdata, CK_BYTE *in_data,
+                                 CK_ULONG in_data_len, CK_BYTE *out_data,
+                                 CK_ULONG *out_data_len, OBJECT *key_obj)
+{
+    if (!ep11tok_local_pubkey(tokdata, key_obj)) {
+        TRACE_ERROR("%s\n", ock_err(ERR_FUNCTION_NOT_SUPPORTED));
+        return CKR_FUNCTION_NOT_SUPPORTED;
+    }
+
+    return openssl_specific_rsa_pkcs_public_encrypt(tokdata, in_data,
+                                                    in_data_len, out_data,
+                                                    out_data_len, key_obj);
+}
+
 CK_RV token_specific_rsa_pss_sign(STDLL_TokData_t *tokdata, SESSION *session,
                                   SIGN_VERIFY_CONTEXT *ctx,
                                   CK_BYTE *in_data, CK_ULONG in_data_len,
@@ -4665,6 +4949,17 @@ CK_RV token_specific_rsa_pss_verify(STDLL_TokData_t *tokdata, SESSION *session,
         return rc;
     }
 
+    if (ep11tok_local_pubkey(tokdata, key_obj)) {
+        /* Release obj lock, the key is looked up again */
+        object_put(tokdata, key_obj, TRUE);
+        key_obj = NULL;
+
+        return openssl_specific_rsa_pss_verify(tokdata, session, ctx, in_data,
+                                               in_data_len, signature,
+                                               sig_len,
+                                               openssl_specific_rsa_encrypt);
+    }
+
     mech.mechanism = CKM_RSA_PKCS_PSS;
     mech.ulParameterLen = ctx->mech.ulParameterLen;
     mech.pParameter = ctx->mech.pParameter;
@@ -4746,6 +5041,11 @@ CK_RV token_specific_ec_verify(STDLL_TokData_t *tokdata, SESSION  *session,
     size_t spki_len = 0;
     CK_MECHANISM mech;
 
+    if (ep11tok_local_pubkey(tokdata, key_obj))
+        return openssl_specific_ec_verify(tokdata, session, in_data,
+                                          in_data_len, out_data, out_data_len,
+                                          key_obj);
+
     rc = obj_opaque_2_blob(tokdata, key_obj, &spki, &spki_len);
     if (rc != CKR_OK) {
         TRACE_ERROR("%s no blob rc=0x%lx\n", __func__, rc);
@@ -7329,6 +7629,7 @@ CK_RV ep11tok_sign_single(STDLL_TokData_t *tokdata, SESSION *session,
     size_t keyblobsize = 0;
     CK_BYTE *keyblob;
     OBJECT *key_obj = NULL;
+    struct ep11_single_args args = { 0 };
 
     rc = h_opaque_2_blob(tokdata, key, &keyblob, &keyblobsize, &key_obj,
                          READ_LOCK);
@@ -7351,9 +7652,17 @@ CK_RV ep11tok_sign_single(STDLL_TokData_t *tokdata, SESSION *session,
         goto done;
     }
 
+    args.op = EP11_SINGLE_SIGN;
+    args.blob = keyblob;
+    args.blob_len = keyblobsize;
+    args.mech = mech;
+    args.in = in_data;
+    args.in_len = in_data_len;
+    args.out = signature;
+    args.out_len = sig_len;
+
     RETRY_START(rc, tokdata)
-    rc = dll_m_SignSingle(keyblob, keyblobsize, mech, in_data, in_data_len,
-                          signature, sig_len, target_info->target);
+    rc = ep11_single(target_info, &args);
     RETRY_END(rc, tokdata, session)
     if (rc != CKR_OK) {
         rc = ep11_error_to_pkcs11_error(rc, session);
@@ -7648,6 +7957,7 @@ CK_RV ep11tok_verify_single(STDLL_TokData_t *tokdata, SESSION *session,
     CK_BYTE *spki;
     size_t spki_len = 0;
     OBJECT *key_obj = NULL;
+    struct ep11_single_args args = { 0 };
 
     rc = h_opaque_2_blob(tokdata, key, &spki, &spki_len, &key_obj, READ_LOCK);
     if (rc != CKR_OK) {
@@ -7679,9 +7989,18 @@ CK_RV ep11tok_verify_single(STDLL_TokData_t *tokdata, SESSION *session,
         goto done;
     }
 
+    args.op = EP11_SINGLE_VERIFY;
+    args.blob = spki;
+    args.blob_len = spki_len;
+    args.mech = mech;
+    args.in = in_data;
+    args.in_len = in_data_len;
+    args.out = signature;
+    args.out_len = NULL;
+    args.sig_len = sig_len;
+
     RETRY_START(rc, tokdata)
-    rc = dll_m_VerifySingle(spki, spki_len, mech, in_data, in_data_len,
-                            signature, sig_len, target_info->target);
+    rc = ep11_single(target_info, &args);
     RETRY_END(rc, tokdata, session)
     if (rc != CKR_OK) {
         rc = ep11_error_to_pkcs11_error(rc, session);
@@ -7855,6 +8174,7 @@ CK_RV ep11tok_decrypt_single(STDLL_TokData_t *tokdata, SESSION *session,
     size_t keyblobsize = 0;
     CK_BYTE *keyblob;
     OBJECT *key_obj = NULL;
+    struct ep11_single_args args = { 0 };
 
     rc = h_opaque_2_blob(tokdata, key, &keyblob, &keyblobsize, &key_obj,
                          READ_LOCK);
@@ -7877,10 +8197,17 @@ CK_RV ep11tok_decrypt_single(STDLL_TokData_t *tokdata, SESSION *session,
         goto done;
     }
 
+    args.op = EP11_SINGLE_DECRYPT;
+    args.blob = keyblob;
+    args.blob_len = keyblobsize;
+    args.mech = mech;
+    args.in = input_data;
+    args.in_len = input_data_len;
+    args.out = output_data;
+    args.out_len = p_output_data_len;
+
     RETRY_START(rc, tokdata)
-    rc = dll_m_DecryptSingle(keyblob, keyblobsize, mech, input_data,
-                             input_data_len, output_data, p_output_data_len,
-                             target_info->target);
+    rc = ep11_single(target_info, &args);
     RETRY_END(rc, tokdata, session)
     if (rc != CKR_OK) {
         rc = ep11_error_to_pkcs11_error(rc, session);
@@ -8054,6 +8381,7 @@ CK_RV ep11tok_encrypt_single(STDLL_TokData_t *tokdata, SESSION *session,
     size_t keyblobsize = 0;
     CK_BYTE *keyblob;
     OBJECT *key_obj = NULL;
+    struct ep11_single_args args = { 0 };
 
     rc = h_opaque_2_blob(tokdata, key, &keyblob, &keyblobsize, &key_obj,
                          READ_LOCK);
@@ -8087,10 +8415,17 @@ CK_RV ep11tok_encrypt_single(STDLL_TokData_t *tokdata, SESSION *session,
         goto done;
     }
 
+    args.op = EP11_SINGLE_ENCRYPT;
+    args.blob = keyblob;
+    args.blob_len = keyblobsize;
+    args.mech = mech;
+    args.in = input_data;
+    args.in_len = input_data_len;
+    args.out = output_data;
+    args.out_len = p_output_data_len;
+
     RETRY_START(rc, tokdata)
-    rc = dll_m_EncryptSingle(keyblob, keyblobsize, mech, input_data,
-                             input_data_len, output_data, p_output_data_len,
-                             target_info->target);
+    rc = ep11_single(target_info, &args);
     RETRY_END(rc, tokdata, session)
     if (rc != CKR_OK) {
         rc = ep11_error_to_pkcs11_error(rc, session);
@@ -8898,6 +9233,10 @@ static const CK_MECHANISM_TYPE ep11_supported_mech_list[] = {
 static const CK_ULONG supported_mech_list_len =
     (sizeof(ep11_supported_mech_list) / sizeof(CK_MECHANISM_TYPE));
 
+static CK_RV ep11tok_query_mechanism_info(STDLL_TokData_t *tokdata,
+                                          CK_MECHANISM_TYPE type,
+                                          CK_MECHANISM_INFO_PTR pInfo);
+
 /* Note: Do not move this function inside
    ep11tok_is_mechanism_supported since that would introduce an
    endless loop.  Also do not use it in ep11tok_get_mechanism_info for
@@ -8910,165 +9249,200 @@ static CK_RV ep11tok_check_policy_for_mech(STDLL_TokData_t *tokdata,
 
     if (tokdata->policy->active == CK_FALSE)
         return CKR_OK;
-    rc = ep11tok_get_mechanism_info(tokdata, mech, pinfo);
+    rc = ep11tok_query_mechanism_info(tokdata, mech, pinfo);
     if (rc != CKR_OK)
         return rc;
     return tokdata->policy->update_mech_info(tokdata->policy, mech, pinfo);
 }
 
-/* filtering out some mechanisms we do not want to provide
- * makes it complicated
+static void free_mech_table(ep11_mech_table_t *table)
+{
+    if (table == NULL)
+        return;
+
+    free(table->mechs);
+    free(table->entries);
+    free(table);
+}
+
+static int mech_entry_compare(const void *a, const void *b)
+{
+    const ep11_mech_entry_t *e1 = a, *e2 = b;
+
+    if (e1->type < e2->type)
+        return -1;
+    return e1->type > e2->type;
+}
+
+/*
+ * Builds the mechanism table for a target from the card's mechanism list,
+ * filtering out some mechanisms we do not want to provide.
  */
-CK_RV ep11tok_get_mechanism_list(STDLL_TokData_t * tokdata,
-                                 CK_MECHANISM_TYPE_PTR pMechanismList,
-                                 CK_ULONG_PTR pulCount)
+static CK_RV ep11tok_build_mech_table(STDLL_TokData_t *tokdata,
+                                      ep11_target_info_t *target_info,
+                                      ep11_mech_table_t **table)
 {
-    CK_RV rc = 0;
-    CK_ULONG counter = 0, size = 0;
-    CK_MECHANISM_TYPE_PTR mlist = NULL;
-    CK_MECHANISM_TYPE_PTR tmp;
-    CK_ULONG i;
-    ep11_target_info_t* target_info;
+    ep11_mech_table_t *tab;
+    CK_MECHANISM_TYPE_PTR mlist = NULL, tmp;
     CK_MECHANISM_INFO info;
+    CK_ULONG counter = 0, i;
+    CK_RV rc;
 
-    target_info = get_target_info(tokdata);
-    if (target_info == NULL)
-        return CKR_FUNCTION_FAILED;
+    rc = dll_m_GetMechanismList(0, NULL, &counter, target_info->target);
+    if (rc != CKR_OK) {
+        rc = ep11_error_to_pkcs11_error(rc, NULL);
+        TRACE_ERROR("%s bad rc=0x%lx from m_GetMechanismList() #1\n",
+                    __func__, rc);
+        return rc;
+    }
 
-    /* size query */
-    if (pMechanismList == NULL) {
-        rc = dll_m_GetMechanismList(0, pMechanismList, pulCount,
-                                    target_info->target);
+    /*
+     * For mixed card levels, the size query call and the call to obtain the
+     * list may run on different cards. When the size query call runs on a
+     * card with less mechanisms than the second call, return code
+     * CKR_BUFFER_TOO_SMALL may be encountered, when the card where the
+     * second call runs supports more mechanisms than the one where the
+     * size query was run. Repeat the call to obtain the list with the
+     * larger list.
+     */
+    do {
+        tmp = (CK_MECHANISM_TYPE *) realloc(mlist,
+                                sizeof(CK_MECHANISM_TYPE) * counter);
+        if (!tmp) {
+            TRACE_ERROR("%s Memory allocation failed\n", __func__);
+            rc = CKR_HOST_MEMORY;
+            goto out;
+        }
+        mlist = tmp;
+        rc = dll_m_GetMechanismList(0, mlist, &counter, target_info->target);
         if (rc != CKR_OK) {
             rc = ep11_error_to_pkcs11_error(rc, NULL);
-            TRACE_ERROR("%s bad rc=0x%lx from m_GetMechanismList() #1\n",
+            TRACE_ERROR("%s bad rc=0x%lx from m_GetMechanismList() #2\n",
                         __func__, rc);
-            goto out;
+            if (rc != CKR_BUFFER_TOO_SMALL)
+                goto out;
         }
+        /* counter was updated in case of CKR_BUFFER_TOO_SMALL */
+    } while (rc == CKR_BUFFER_TOO_SMALL);
 
-        /* adjust the size according to the ban list,
-         * for this we need to know what the card provides
-         */
-        counter = *pulCount;
+    tab = calloc(1, sizeof(*tab));
+    if (tab == NULL) {
+        TRACE_ERROR("%s Memory allocation failed\n", __func__);
+        rc = CKR_HOST_MEMORY;
+        goto out;
+    }
+    tab->mechs = calloc(counter > 0 ? counter : 1, sizeof(CK_MECHANISM_TYPE));
+    tab->entries = calloc(counter > 0 ? counter : 1, sizeof(ep11_mech_entry_t));
+    if (tab->mechs == NULL || tab->entries == NULL) {
+        TRACE_ERROR("%s Memory allocation failed\n", __func__);
+        free_mech_table(tab);
+        rc = CKR_HOST_MEMORY;
+        goto out;
+    }
 
-        /*
-         * For mixed card levels, the size query call and the call to obtain the
-         * list may run on different cards. When the size query call runs on a
-         * card with less mechanisms than the second call, return code
-         * CKR_BUFFER_TOO_SMALL may be encountered, when the card where the
-         * second call runs supports more mechanisms than the one where the
-         * size query was run. Repeat the call to obtain the list with the
-         * larger list.
-         */
-        do {
-            tmp = (CK_MECHANISM_TYPE *) realloc(mlist,
-                                    sizeof(CK_MECHANISM_TYPE) * counter);
-            if (!tmp) {
-                TRACE_ERROR("%s Memory allocation failed\n", __func__);
-                rc = CKR_HOST_MEMORY;
-                goto out;
-            }
-            mlist = tmp;
-            rc = dll_m_GetMechanismList(0, mlist, &counter, target_info->target);
-            if (rc != CKR_OK) {
-                rc = ep11_error_to_pkcs11_error(rc, NULL);
-                TRACE_ERROR("%s bad rc=0x%lx from m_GetMechanismList() #2\n",
-                            __func__, rc);
-                if (rc != CKR_BUFFER_TOO_SMALL)
-                    goto out;
-            }
-            /* counter was updated in case of CKR_BUFFER_TOO_SMALL */
-            *pulCount = counter;
-        } while (rc == CKR_BUFFER_TOO_SMALL);
-
-        for (i = 0; i < counter; i++) {
-            if (mlist[i] == CKM_IBM_CPACF_WRAP) {
-                /* Internal mechanisms should not be exposed. */
-                *pulCount = *pulCount - 1;
-            } else if (ep11tok_is_mechanism_supported(tokdata, mlist[i]) != CKR_OK) {
-                /* banned mech found,
-                 * decrement reported list size
-                 */
-                *pulCount = *pulCount - 1;
-            } else if (ep11tok_check_policy_for_mech(tokdata, mlist[i], &info) !=
-                    CKR_OK) {
-                TRACE_DEVEL("Policy blocks mechanism 0x%lx!\n", mlist[i]);
-                *pulCount -= 1;
-            }
-        }
-    } else {
-        /* 2. call, content request */
-        size = *pulCount;
+    for (i = 0; i < counter; i++) {
+        TRACE_INFO("%s raw mech list entry '%s'\n",
+                   __func__, ep11_get_ckm(tokdata, mlist[i]));
 
-        /* find out size ep11 will report, cannot use the size
-         * that comes as parameter, this is a 'reduced size',
-         * ep11 would complain about insufficient list size
-         */
-        rc = dll_m_GetMechanismList(0, mlist, &counter, target_info->target);
-        if (rc != CKR_OK) {
-            rc = ep11_error_to_pkcs11_error(rc, NULL);
-            TRACE_ERROR("%s bad rc=0x%lx from m_GetMechanismList() #3\n",
-                        __func__, rc);
+        tab->entries[i].type = mlist[i];
+        tab->entries[i].rc = ep11tok_query_mechanism_info(tokdata, mlist[i],
+                                                      &tab->entries[i].info);
+        switch (tab->entries[i].rc) {
+        case CKR_OK:
+        case CKR_MECHANISM_INVALID:
+        case CKR_MECHANISM_PARAM_INVALID:
+            break;
+        default:
+            /* Do not remember transient failures */
+            rc = tab->entries[i].rc;
+            free_mech_table(tab);
             goto out;
         }
 
-        /*
-         * For mixed card levels, the size query call and the call to obtain the
-         * list may run on different cards. When the size query call runs on a
-         * card with less mechanisms than the second call, return code
-         * CKR_BUFFER_TOO_SMALL may be encountered, when the card where the
-         * second call runs supports more mechanisms than the one where the
-         * size query was run. Repeat the call to obtain the list with the
-         * larger list.
-         */
-        do {
-            tmp = (CK_MECHANISM_TYPE *) realloc(mlist,
-                                    sizeof(CK_MECHANISM_TYPE) * counter);
-            if (!tmp) {
-                TRACE_ERROR("%s Memory allocation failed\n", __func__);
-                rc = CKR_HOST_MEMORY;
-                goto out;
-            }
-            mlist = tmp;
-            /* all the card has */
-            rc = dll_m_GetMechanismList(0, mlist, &counter, target_info->target);
-            if (rc != CKR_OK) {
-                rc = ep11_error_to_pkcs11_error(rc, NULL);
-                TRACE_ERROR("%s bad rc=0x%lx from m_GetMechanismList() #4\n",
-                            __func__, rc);
-                if (rc != CKR_BUFFER_TOO_SMALL)
-                    goto out;
-            }
-        } while (rc == CKR_BUFFER_TOO_SMALL);
+        if (mlist[i] == CKM_IBM_CPACF_WRAP)
+            /* Internal mechanisms should not be exposed. */
+            continue;
+        if (ep11tok_check_policy_for_mech(tokdata, mlist[i], &info) !=
+            CKR_OK) {
+            TRACE_DEVEL("Policy blocks mechanism 0x%lx!\n", mlist[i]);
+            continue;
+        }
+        if (ep11tok_is_mechanism_supported(tokdata, mlist[i]) != CKR_OK)
+            continue;
 
-        for (i = 0; i < counter; i++)
-            TRACE_INFO("%s raw mech list entry '%s'\n",
-                       __func__, ep11_get_ckm(tokdata, mlist[i]));
+        tab->mechs[tab->num_mechs++] = mlist[i];
+    }
 
-        /* copy only mechanisms not banned */
-        *pulCount = 0;
-        for (i = 0; i < counter; i++) {
-            if (mlist[i] == CKM_IBM_CPACF_WRAP)
-                /* Internal mechanisms should not be exposed. */
-                continue;
-            if (ep11tok_check_policy_for_mech(tokdata, mlist[i], &info) !=
-                CKR_OK) {
-                TRACE_DEVEL("Policy blocks mechanism 0x%lx!\n", mlist[i]);
-                continue;
-            }
-            if (ep11tok_is_mechanism_supported(tokdata, mlist[i]) == CKR_OK) {
-                if (*pulCount < size)
-                    pMechanismList[*pulCount] = mlist[i];
-                *pulCount = *pulCount + 1;
-            }
-        }
-        if (*pulCount > size)
-            rc = CKR_BUFFER_TOO_SMALL;
+    tab->num_entries = counter;
+    qsort(tab->entries, tab->num_entries, sizeof(ep11_mech_entry_t),
+          mech_entry_compare);
+
+    *table = tab;
+    rc = CKR_OK;
+
+out:
+    free(mlist);
+    return rc;
+}
+
+/*
+ * Returns the mechanism table of the target, building it on first use.
+ * The table lives as long as the target info, so it is rebuilt after the
+ * target info was refreshed due to an APQN event.
+ */
+static ep11_mech_table_t *get_mech_table(STDLL_TokData_t *tokdata,
+                                         ep11_target_info_t *target_info,
+                                         CK_RV *rc)
+{
+    ep11_mech_table_t *table;
+
+    table = __atomic_load_n(&target_info->mech_table, __ATOMIC_ACQUIRE);
+    if (table != NULL) {
+        *rc = CKR_OK;
+        return table;
     }
 
+    *rc = ep11tok_build_mech_table(tokdata, target_info, &table);
+    if (*rc != CKR_OK)
+        return NULL;
+
+    /* Another thread may have built it concurrently, use the first one */
+    if (!__sync_bool_compare_and_swap(&target_info->mech_table, NULL,
+                                      table)) {
+        free_mech_table(table);
+        table = __atomic_load_n(&target_info->mech_table, __ATOMIC_ACQUIRE);
+    }
+
+    return table;
+}
+
+CK_RV ep11tok_get_mechanism_list(STDLL_TokData_t * tokdata,
+                                 CK_MECHANISM_TYPE_PTR pMechanismList,
+                                 CK_ULONG_PTR pulCount)
+{
+    ep11_target_info_t* target_info;
+    ep11_mech_table_t *table;
+    CK_ULONG size = *pulCount;
+    CK_RV rc;
+
+    target_info = get_target_info(tokdata);
+    if (target_info == NULL)
+        return CKR_FUNCTION_FAILED;
+
+    table = get_mech_table(tokdata, target_info, &rc);
+    if (table == NULL)
+        goto out;
+
+    *pulCount = table->num_mechs;
+    if (pMechanismList == NULL)
+        goto out;
+
+    memcpy(pMechanismList, table->mechs,
+           MIN(size, table->num_mechs) * sizeof(CK_MECHANISM_TYPE));
+    if (size < table->num_mechs)
+        rc = CKR_BUFFER_TOO_SMALL;
+
 out:
-    if (mlist)
-        free(mlist);
     put_target_info(tokdata, target_info);
     return rc;
 }
@@ -9297,6 +9671,40 @@ CK_RV ep11tok_is_mechanism_supported_ex(STDLL_TokData_t *tokdata,
 CK_RV ep11tok_get_mechanism_info(STDLL_TokData_t * tokdata,
                                  CK_MECHANISM_TYPE type,
                                  CK_MECHANISM_INFO_PTR pInfo)
+{
+    ep11_target_info_t* target_info;
+    ep11_mech_table_t *table;
+    ep11_mech_entry_t key, *entry = NULL;
+    CK_RV rc;
+
+    target_info = get_target_info(tokdata);
+    if (target_info == NULL)
+        return CKR_FUNCTION_FAILED;
+
+    table = get_mech_table(tokdata, target_info, &rc);
+    if (table != NULL) {
+        key.type = type;
+        entry = bsearch(&key, table->entries, table->num_entries,
+                        sizeof(ep11_mech_entry_t), mech_entry_compare);
+        if (entry != NULL) {
+            rc = entry->rc;
+            if (rc == CKR_OK)
+                *pInfo = entry->info;
+        }
+    }
+
+    put_target_info(tokdata, target_info);
+
+    /* Mechanisms not reported by the card are checked as before */
+    if (entry == NULL)
+        return ep11tok_query_mechanism_info(tokdata, type, pInfo);
+
+    return rc;
+}
+
+static CK_RV ep11tok_query_mechanism_info(STDLL_TokData_t *tokdata,
+                                          CK_MECHANISM_TYPE type,
+                                          CK_MECHANISM_INFO_PTR pInfo)
 {
     CK_RV rc;
     int status;
@@ -9771,6 +10179,18 @@ static CK_RV read_adapter_config_file(STDLL_TokData_t * tokdata,
             }
         }
 
+        if (confignode_hastype(c, CT_INTVAL) &&
+            strcmp(c->key, "ASYNC_QUEUE_DEPTH") == 0) {
+            if (confignode_to_intval(c)->value > EP11_ASYNC_MAX_DEPTH) {
+                ep11_config_error_token(fname, c->key, c->line,
+                                        "NUMBER between 0 and 64");
+                rc = CKR_FUNCTION_FAILED;
+                break;
+            }
+            ep11_data->async_depth = confignode_to_intval(c)->value;
+            continue;
+        }
+
         if (confignode_hastype(c, CT_NUMPAIRLIST)) {
             list = confignode_to_numpairlist(c);
 
@@ -9852,6 +10272,11 @@ static CK_RV read_adapter_config_file(STDLL_TokData_t * tokdata,
             continue;
         }
 
+        if (strcmp(bare->base.key, "LOCAL_PUBLIC_KEY_OPERATIONS") == 0) {
+            ep11_data->local_pubkey_ops = 1;
+            continue;
+        }
+
         if (strcmp(bare->base.key, "PKEY_MODE") == 0) {
             rc = ep11_config_next(&c, CT_BARECONST, fname, "PKEY mode");
             if (rc != CKR_OK)
@@ -12329,6 +12754,13 @@ static CK_RV refresh_target_info(STDLL_TokData_t *tokdata)
     if (rc != CKR_OK)
         goto error;
 
+    /* Setup the single APQN targets freshly with the current set of APQNs */
+    if (ep11_data->async_depth > 0) {
+        rc = ep11tok_setup_async(tokdata, target_info);
+        if (rc != CKR_OK)
+            goto error;
+    }
+
     /* Setup the group target freshly with the current set of APQNs */
     rc = ep11tok_setup_target(tokdata, target_info);
     if (rc != CKR_OK)
@@ -12356,6 +12788,7 @@ static CK_RV refresh_target_info(STDLL_TokData_t *tokdata)
     return CKR_OK;
 
 error:
+    ep11tok_free_async(target_info);
     free_card_versions(target_info->card_versions);
     free((void *)target_info);
     return rc;
@@ -12436,9 +12869,11 @@ static void put_target_info(STDLL_TokData_t *tokdata,
         TRACE_DEBUG("%s: target_info: %p is freed\n", __func__,
                     (void *)target_info);
 
+        ep11tok_free_async(target_info);
         if (dll_m_rm_module != NULL)
             dll_m_rm_module(NULL, target_info->target);
         free_card_versions(target_info->card_versions);
+        free_mech_table(target_info->mech_table);
         free(target_info);
     }
 }
@@ -3,7 +3,7 @@ nobase_lib_LTLIBRARIES += opencryptoki/stdll/libpkcs11_ep11.la
 noinst_HEADERS +=							\
 	usr/lib/ep11_stdll/ep11.h usr/lib/ep11_stdll/ep11adm.h 		\
 	usr/lib/ep11_stdll/ep11_func.h usr/lib/ep11_stdll/ep11_specific.h \
-	usr/lib/ep11_stdll/tok_struct.h
+	usr/lib/ep11_stdll/tok_struct.h usr/lib/ep11_stdll/ep11_async.h
 
 opencryptoki_stdll_libpkcs11_ep11_la_CFLAGS =				\
 	-DDEV -D_THREAD_SAFE -DSHALLOW=0 -DEPSWTOK=1 -DLITE=0 -DNOCDMF	\
@@ -34,13 +34,16 @@ opencryptoki_stdll_libpkcs11_ep11_la_SOURCES = usr/lib/common/asn1.c	\
 	usr/lib/common/object.c usr/lib/common/sign_mgr.c		\
 	usr/lib/common/verify_mgr.c usr/lib/common/key.c		\
 	usr/lib/common/key_mgr.c usr/lib/common/template.c		\
+	usr/lib/common/secure_arena.c usr/lib/common/login_broker.c	\
 	usr/lib/common/p11util.c usr/lib/common/utility.c		\
 	usr/lib/common/trace.c usr/lib/common/mech_list.c		\
 	usr/lib/common/shared_memory.c usr/lib/common/attributes.c	\
 	usr/lib/common/sw_crypt.c usr/lib/common/profile_obj.c		\
 	usr/lib/common/dlist.c usr/lib/common/pkey_utils.c		\
+	usr/lib/common/mech_openssl.c					\
 	usr/lib/ep11_stdll/new_host.c					\
 	usr/lib/ep11_stdll/ep11_specific.c				\
+	usr/lib/ep11_stdll/ep11_async.c					\
 	usr/lib/common/utility_common.c usr/lib/common/ec_supported.c	\
 	usr/lib/api/policyhelper.c usr/lib/config/configuration.c	\
 	usr/lib/config/cfgparse.y usr/lib/config/cfglex.l
@@ -1917,20 +1917,13 @@ CK_RV SC_FindObjects(STDLL_TokData_t *tokdata, ST_SESSION_HANDLE *sSession,
         goto done;
     }
 
-    if (!sess->find_list) {
-        TRACE_DEVEL("sess->find_list is NULL.\n");
-        rc = CKR_OPERATION_NOT_INITIALIZED;
+    rc = object_mgr_find(tokdata, sess, phObject, ulMaxObjectCount, &count);
+    if (rc != CKR_OK) {
+        TRACE_DEVEL("object_mgr_find() failed.\n");
         goto done;
     }
-    count = MIN(ulMaxObjectCount, (sess->find_count - sess->find_idx));
-
-    memcpy(phObject, sess->find_list + sess->find_idx,
-           count * sizeof(CK_OBJECT_HANDLE));
     *pulObjectCount = count;
 
-    sess->find_idx += count;
-    rc = CKR_OK;
-
 done:
     TRACE_INFO("C_FindObjects: rc = 0x%08lx, returned %lu objects\n",
                rc, count);
@@ -1967,15 +1960,7 @@ CK_RV SC_FindObjectsFinal(STDLL_TokData_t *tokdata,
         goto done;
     }
 
-    if (sess->find_list)
-        free(sess->find_list);
-
-    sess->find_list = NULL;
-    sess->find_len = 0;
-    sess->find_idx = 0;
-    sess->find_active = FALSE;
-
-    rc = CKR_OK;
+    rc = object_mgr_find_final(sess);
 
 done:
     TRACE_INFO("C_FindObjectsFinal: rc = 0x%08lx\n", rc);
@@ -57,6 +57,7 @@ token_spec_t token_specific = {
     NULL,                       // save_token_data
     &token_specific_rng,
     NULL,                       // final
+    NULL,                       // fork_child
     NULL,                       // init_token
     NULL,                       // token_specific_login,
     NULL,                       // token_specific_logout,
@@ -75,7 +76,7 @@ token_spec_t token_specific = {
     NULL,                       // des3_cmac
     // RSA
     NULL,                       // rsa_decrypt
-    NULL,                       // rsa_encrypt
+    &token_specific_rsa_encrypt,
     &token_specific_rsa_sign,
     &token_specific_rsa_verify,
     NULL,                       // rsa_verify_recover
@@ -89,6 +90,7 @@ token_spec_t token_specific = {
     &token_specific_rsa_pss_sign,
     &token_specific_rsa_pss_verify,
     NULL,                       // rsa_generate_keypair
+    NULL,                       // msg_sign_key_init
     // Elliptic Curve
     &token_specific_ec_sign,
     &token_specific_ec_verify,
@@ -102,6 +104,9 @@ token_spec_t token_specific = {
     &token_specific_sha,
     &token_specific_sha_update,
     &token_specific_sha_final,
+    NULL,                       // sha_stream_init
+    NULL,                       // sha_stream_update
+    NULL,                       // sha_stream_final
     // HMAC
     NULL,                       // hmac_sign_init
     NULL,                       // hmac_sign
@@ -121,6 +126,8 @@ token_spec_t token_specific = {
     NULL,                       // aes_gcm
     NULL,                       // aes_gcm_update
     NULL,                       // aes_gcm_final
+    NULL,                       // aes_gcm_msg_init
+    NULL,                       // aes_gcm_msg
     NULL,                       // aes_ofb
     NULL,                       // aes_cfb
     NULL,                       // aes_mac
@@ -31,6 +31,7 @@ opencryptoki_stdll_libpkcs11_ica_la_SOURCES =				\
 	usr/lib/common/mech_ec.c usr/lib/common/new_host.c		\
 	usr/lib/common/obj_mgr.c usr/lib/common/object.c		\
 	usr/lib/common/sign_mgr.c usr/lib/common/template.c		\
+	usr/lib/common/secure_arena.c usr/lib/common/login_broker.c	\
 	usr/lib/common/p11util.c usr/lib/common/utility.c		\
 	usr/lib/common/verify_mgr.c usr/lib/common/trace.c		\
 	usr/lib/common/mech_list.c usr/lib/common/shared_memory.c	\
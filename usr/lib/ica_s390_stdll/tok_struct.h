@@ -46,6 +46,7 @@ token_spec_t token_specific = {
     NULL,                       // save_token_data
     &token_specific_rng,
     &token_specific_final,
+    NULL,                       // fork_child
     NULL,                       // init_token
     NULL,                       // login
     NULL,                       // logout
@@ -78,6 +79,7 @@ token_spec_t token_specific = {
     &token_specific_rsa_pss_sign,
     &token_specific_rsa_pss_verify,
     &token_specific_rsa_generate_keypair,
+    NULL,                       // msg_sign_key_init
 #ifndef NO_EC
     // Elliptic Curve
     &token_specific_ec_sign,
@@ -97,6 +99,9 @@ token_spec_t token_specific = {
     &token_specific_sha,
     &token_specific_sha_update,
     &token_specific_sha_final,
+    NULL,                       // sha_stream_init
+    NULL,                       // sha_stream_update
+    NULL,                       // sha_stream_final
     //HMAC
     NULL,                       // hmac_sign_init
     NULL,                       // hmac_sign
@@ -117,6 +122,8 @@ token_spec_t token_specific = {
     &token_specific_aes_gcm,
     &token_specific_aes_gcm_update,
     &token_specific_aes_gcm_final,
+    NULL,                       // aes_gcm_msg_init
+    NULL,                       // aes_gcm_msg
     &token_specific_aes_ofb,
     &token_specific_aes_cfb,
     &token_specific_aes_mac,
@@ -130,6 +137,8 @@ token_spec_t token_specific = {
     NULL,                       // aes_gcm,
     NULL,                       // aes_gcm_update,
     NULL,                       // aes_gcm_final,
+    NULL,                       // aes_gcm_msg_init
+    NULL,                       // aes_gcm_msg
     NULL,                       // aes_ofb,
     NULL,                       // aes_cfb,
     NULL,                       // aes_mac,
@@ -23,6 +23,10 @@
 #include <ctype.h>
 #include <lber.h>
 #include <limits.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <poll.h>
 #include "icsf.h"
 
 /* For logging functions: */
@@ -502,6 +506,267 @@ cleanup:
     return rc;
 }
 
+/*
+ * Threads waiting for ICSF responses on the shared LDAP handles.
+ *
+ * libldap holds the result lock of a handle while a thread waits in
+ * ldap_result(), so a thread waiting for its own response would also hold
+ * back the responses of all other threads that use the same handle. Only one
+ * thread at a time, the reader, therefore reads responses from a handle.
+ * It takes any response, hands responses to other requests over to their
+ * waiting threads and wakes them up. When the reader got its own response,
+ * one of the remaining waiting threads becomes the reader.
+ */
+struct icsf_waiter {
+    LDAP *ld;
+    int msgid;
+    int reading;
+    int done;
+    int err;
+    LDAPMessage *res;
+    struct icsf_waiter *next;
+};
+
+static pthread_mutex_t icsf_waiters_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t icsf_waiters_cond = PTHREAD_COND_INITIALIZER;
+static struct icsf_waiter *icsf_waiters = NULL;
+
+/*
+ * Get the point in time at which waiting for a response times out. The
+ * timeout is the one set for synchronous operations on the handle
+ * (LDAP_OPT_TIMEOUT), as used by ldap_extended_operation_s(). Returns 0 if
+ * no timeout is set.
+ */
+static int icsf_result_deadline(LDAP * ld, struct timespec *deadline)
+{
+    struct timeval *tv = NULL;
+
+    if (ldap_get_option(ld, LDAP_OPT_TIMEOUT, &tv) != LDAP_OPT_SUCCESS ||
+        tv == NULL)
+        return 0;
+
+    clock_gettime(CLOCK_REALTIME, deadline);
+    deadline->tv_sec += tv->tv_sec;
+    deadline->tv_nsec += tv->tv_usec * 1000;
+    if (deadline->tv_nsec >= 1000000000) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000;
+    }
+    ldap_memfree(tv);
+
+    return 1;
+}
+
+/*
+ * Get the milliseconds remaining until 'deadline'. Returns 0 if it has
+ * passed.
+ */
+static int icsf_result_remaining(const struct timespec *deadline)
+{
+    struct timespec now;
+    long long msec;
+
+    clock_gettime(CLOCK_REALTIME, &now);
+    msec = (long long)(deadline->tv_sec - now.tv_sec) * 1000 +
+           (deadline->tv_nsec - now.tv_nsec + 999999) / 1000000;
+    if (msec <= 0)
+        return 0;
+
+    return msec > INT_MAX ? INT_MAX : (int)msec;
+}
+
+/*
+ * Read the next response from 'ld' as the reader of the handle. libldap
+ * also holds the connection lock while it waits in ldap_result(), which
+ * would hold back the requests that other threads send on the handle. The
+ * reader therefore blocks in poll() until the connection is readable, and
+ * calls ldap_result() only to read what has arrived. Responses that libldap
+ * has already buffered are returned without waiting. Returns 0 if
+ * 'deadline' passed.
+ */
+static int icsf_read_result(LDAP * ld, const struct timespec *deadline,
+                            LDAPMessage ** msg)
+{
+    struct timeval zero = { 0, 0 };
+    struct pollfd pfd;
+    int rc, timeout = -1;
+
+    if (ldap_get_option(ld, LDAP_OPT_DESC, &pfd.fd) != LDAP_OPT_SUCCESS)
+        return -1;
+    pfd.events = POLLIN;
+
+    for (;;) {
+        rc = ldap_result(ld, LDAP_RES_ANY, LDAP_MSG_ALL, &zero, msg);
+        if (rc != 0)
+            return rc;
+
+        if (deadline != NULL) {
+            timeout = icsf_result_remaining(deadline);
+            if (timeout == 0)
+                return 0;
+        }
+
+        pfd.revents = 0;
+        rc = poll(&pfd, 1, timeout);
+        if (rc < 0 && errno != EINTR) {
+            TRACE_ERROR("poll failed: %s\n", strerror(errno));
+            return -1;
+        }
+    }
+}
+
+/*
+ * Wait for the response to the request with message ID 'msgid' on 'ld'.
+ * The caller blocks, either as the reader of the handle or on the condition
+ * variable until the reader handed its response over.
+ */
+static int icsf_wait_result(LDAP * ld, int msgid, LDAPMessage ** res)
+{
+    struct icsf_waiter self = { ld, msgid, 0, 0, LDAP_SUCCESS, NULL, NULL };
+    struct icsf_waiter *w, **pw;
+    struct timespec deadline;
+    LDAPMessage *msg = NULL;
+    int has_deadline, rc, err;
+
+    has_deadline = icsf_result_deadline(ld, &deadline);
+
+    pthread_mutex_lock(&icsf_waiters_mutex);
+    self.next = icsf_waiters;
+    icsf_waiters = &self;
+
+    while (!self.done) {
+        for (w = icsf_waiters; w != NULL; w = w->next) {
+            if (w->ld == ld && w->reading)
+                break;
+        }
+
+        if (w != NULL) {
+            /* Another thread reads, and hands our response over */
+            if (!has_deadline) {
+                pthread_cond_wait(&icsf_waiters_cond, &icsf_waiters_mutex);
+            } else if (pthread_cond_timedwait(&icsf_waiters_cond,
+                                              &icsf_waiters_mutex,
+                                              &deadline) == ETIMEDOUT &&
+                       !self.done) {
+                self.done = 1;
+                self.err = LDAP_TIMEOUT;
+            }
+            continue;
+        }
+
+        self.reading = 1;
+        pthread_mutex_unlock(&icsf_waiters_mutex);
+
+        rc = icsf_read_result(ld, has_deadline ? &deadline : NULL, &msg);
+
+        pthread_mutex_lock(&icsf_waiters_mutex);
+        self.reading = 0;
+
+        if (rc > 0) {
+            for (w = icsf_waiters; w != NULL; w = w->next) {
+                if (w->ld == ld && w->msgid == ldap_msgid(msg))
+                    break;
+            }
+            if (w != NULL) {
+                w->res = msg;
+                w->done = 1;
+            } else {
+                TRACE_DEVEL("Dropping response to message %d.\n",
+                            ldap_msgid(msg));
+                ldap_msgfree(msg);
+            }
+        } else if (rc == 0) {
+            self.done = 1;
+            self.err = LDAP_TIMEOUT;
+        } else {
+            /* The connection failed for all requests on it */
+            err = LDAP_OTHER;
+            ldap_get_option(ld, LDAP_OPT_RESULT_CODE, &err);
+            for (w = icsf_waiters; w != NULL; w = w->next) {
+                if (w->ld == ld && !w->done) {
+                    w->done = 1;
+                    w->err = err != LDAP_SUCCESS ? err : LDAP_OTHER;
+                }
+            }
+        }
+
+        pthread_cond_broadcast(&icsf_waiters_cond);
+    }
+
+    for (pw = &icsf_waiters; *pw != &self; pw = &(*pw)->next)
+        ;
+    *pw = self.next;
+    /* Let another thread take over reading */
+    pthread_cond_broadcast(&icsf_waiters_cond);
+    pthread_mutex_unlock(&icsf_waiters_mutex);
+
+    if (self.res == NULL) {
+        TRACE_ERROR("Failed to receive ICSF response: %s (%d)\n",
+                    ldap_err2string(self.err), self.err);
+        if (self.err == LDAP_TIMEOUT)
+            ldap_abandon_ext(ld, msgid, NULL, NULL);
+        return self.err;
+    }
+
+    *res = self.res;
+
+    return LDAP_SUCCESS;
+}
+
+/*
+ * Send an ICSF request as an asynchronous LDAP extended operation and wait
+ * for the response with the matching message ID.
+ *
+ * Unlike ldap_extended_operation_s(), the result code and the diagnostic
+ * message are taken from the response message itself rather than from the
+ * LDAP handle. This allows several threads to have requests outstanding on
+ * the same LDAP handle at the same time, so that the requests of all sessions
+ * sharing a connection are pipelined to the server.
+ */
+static int icsf_extended_operation(LDAP * ld, struct berval *raw_req,
+                                   char **response_oid,
+                                   struct berval **raw_res)
+{
+    LDAPMessage *res = NULL;
+    char *diag_msg = NULL;
+    int msgid, err = LDAP_OTHER;
+    int rc;
+
+    rc = ldap_extended_operation(ld, ICSF_REQ_OID, raw_req, NULL, NULL,
+                                 &msgid);
+    if (rc != LDAP_SUCCESS) {
+        TRACE_ERROR("Failed to send ICSF request: %s (%d)\n",
+                    ldap_err2string(rc), rc);
+        return rc;
+    }
+
+    rc = icsf_wait_result(ld, msgid, &res);
+    if (rc != LDAP_SUCCESS)
+        return rc;
+
+    rc = ldap_parse_extended_result(ld, res, response_oid, raw_res, 0);
+    if (rc != LDAP_SUCCESS) {
+        TRACE_ERROR("Failed to parse ICSF response: %s (%d)\n",
+                    ldap_err2string(rc), rc);
+        ldap_msgfree(res);
+        return rc;
+    }
+
+    rc = ldap_parse_result(ld, res, &err, NULL, &diag_msg, NULL, NULL, 1);
+    if (rc == LDAP_SUCCESS)
+        rc = err;
+    if (rc != LDAP_SUCCESS) {
+        TRACE_ERROR("ICSF call failed: %s (%d)%s%s\n",
+                    ldap_err2string(rc), rc,
+                    diag_msg ? "\nDetailed message: " : "",
+                    diag_msg ? diag_msg : "");
+    }
+    if (diag_msg)
+        ldap_memfree(diag_msg);
+
+    return rc;
+}
+
 /*
  * `icsf_call` is a generic helper function for ICSF services.
  *
@@ -635,17 +900,8 @@ static int icsf_call(LDAP * ld, int *reason, char *handle, size_t handle_len,
     }
 
     /* Call ICSF service */
-    rc = ldap_extended_operation_s(ld, ICSF_REQ_OID, raw_req, NULL, NULL,
-                                   &response_oid, &raw_res);
+    rc = icsf_extended_operation(ld, raw_req, &response_oid, &raw_res);
     if (rc != LDAP_SUCCESS) {
-        char *ext_msg = NULL;
-        ldap_get_option(ld, LDAP_OPT_DIAGNOSTIC_MESSAGE, &ext_msg);
-        TRACE_ERROR("ICSF call failed: %s (%d)%s%s\n",
-                    ldap_err2string(rc), rc,
-                    ext_msg ? "\nDetailed message: " : "",
-                    ext_msg ? ext_msg : "");
-        if (ext_msg)
-            ldap_memfree(ext_msg);
         rc = -1;
         goto cleanup;
     }
@@ -2059,13 +2315,66 @@ done:
     return rc;
 }
 
+/*
+ * Append a copy of an attribute to a dynamically allocated attribute array.
+ */
+static int icsf_collect_attribute(CK_ATTRIBUTE ** attrs, CK_ULONG * attrs_len,
+                                  CK_ATTRIBUTE_TYPE type, const void *value,
+                                  CK_ULONG value_len)
+{
+    CK_ATTRIBUTE *tmp;
+    void *copy = NULL;
+
+    if (value_len > 0) {
+        copy = malloc(value_len);
+        if (copy == NULL)
+            return -1;
+        memcpy(copy, value, value_len);
+    }
+
+    tmp = realloc(*attrs, (*attrs_len + 1) * sizeof(CK_ATTRIBUTE));
+    if (tmp == NULL) {
+        free(copy);
+        return -1;
+    }
+
+    tmp[*attrs_len].type = type;
+    tmp[*attrs_len].pValue = copy;
+    tmp[*attrs_len].ulValueLen = value_len;
+    *attrs = tmp;
+    (*attrs_len)++;
+
+    return 0;
+}
+
+static void icsf_free_collected_attributes(CK_ATTRIBUTE * attrs,
+                                           CK_ULONG attrs_len)
+{
+    CK_ULONG i;
+
+    for (i = 0; i < attrs_len; i++)
+        free(attrs[i].pValue);
+    free(attrs);
+}
+
+/*
+ * Decode a GAV attribute list into `attrs`. If `types` is given, a copy of
+ * every attribute of the list with one of these types is additionally
+ * returned in `collected`, which must be freed by the caller.
+ */
 static int icsf_ber_decode_get_attribute_list(BerElement * berbuf,
                                               CK_ATTRIBUTE * attrs,
-                                              CK_ULONG attrs_len)
+                                              CK_ULONG attrs_len,
+                                              const CK_ATTRIBUTE_TYPE * types,
+                                              CK_ULONG types_len,
+                                              CK_ATTRIBUTE ** collected,
+                                              CK_ULONG * collected_len)
 {
     int attrtype;
     struct berval attrbval = { 0, NULL };
     ber_int_t intval;
+    CK_ULONG ulval;
+    void *value;
     unsigned int i;
     CK_ULONG found = 0;
     ber_tag_t tag;
@@ -2090,10 +2399,13 @@ static int icsf_ber_decode_get_attribute_list(BerElement * berbuf,
         if ((tag & LBER_BIG_TAG_MASK) == 0) {
             if (ber_scanf(berbuf, "o}", &attrbval) == LBER_ERROR)
                 goto decode_error;
+            value = attrbval.bv_val;
         } else {
             if (ber_scanf(berbuf, "i}", &intval) == LBER_ERROR)
                 goto decode_error;
             attrbval.bv_len = sizeof(CK_ULONG);
+            ulval = intval;
+            value = &ulval;
         }
 
         /* see if this type matches any that we need to
@@ -2109,11 +2421,7 @@ static int icsf_ber_decode_get_attribute_list(BerElement * berbuf,
             if (attrs[i].pValue == NULL) {
                 attrs[i].ulValueLen = attrbval.bv_len;
             } else if (attrs[i].ulValueLen >= attrbval.bv_len) {
-                if ((tag & LBER_BIG_TAG_MASK) == 0) {
-                    memcpy(attrs[i].pValue, attrbval.bv_val, attrbval.bv_len);
-                } else {
-                    *((CK_ULONG *) attrs[i].pValue) = intval;
-                }
+                memcpy(attrs[i].pValue, value, attrbval.bv_len);
                 attrs[i].ulValueLen = attrbval.bv_len;
             } else {
                 rc = CKR_BUFFER_TOO_SMALL;
@@ -2125,10 +2433,28 @@ static int icsf_ber_decode_get_attribute_list(BerElement * berbuf,
             found++;
         }
 
+        /* also keep a copy if the caller wants to collect this type */
+        for (i = 0; i < types_len; i++) {
+            if (types[i] != (CK_ATTRIBUTE_TYPE)attrtype)
+                continue;
+
+            if (icsf_collect_attribute(collected, collected_len,
+                                       attrtype, value, attrbval.bv_len)) {
+                rc = CKR_HOST_MEMORY;
+                goto decode_error;
+            }
+            break;
+        }
+
+        if ((tag & LBER_BIG_TAG_MASK) == 0) {
+            ber_memfree(attrbval.bv_val);
+            attrbval.bv_val = NULL;
+        }
+
         /* if we have found all the values for our list, then
-         * we are done.
+         * we are done, unless all attributes are to be collected.
          */
-        if (found == attrs_len)
+        if (found == attrs_len && types_len == 0)
             break;
     }
 
@@ -2146,15 +2472,27 @@ static int icsf_ber_decode_get_attribute_list(BerElement * berbuf,
 decode_error:
     TRACE_ERROR("Failed to decode message.\n");
 
+    if (attrbval.bv_val)
+        ber_memfree(attrbval.bv_val);
+
     if (!rc)
         rc = CKR_FUNCTION_FAILED;
 
     return rc;
 }
 
-int icsf_get_attribute(LDAP * ld, int *reason,
-                       struct icsf_object_record *object, CK_ATTRIBUTE * attrs,
-                       CK_ULONG attrs_len)
+/*
+ * Get the values of the attributes in `attrs`. If `types` is given, a copy
+ * of all attributes of the object with one of these types is additionally
+ * returned in `collected`, out of the same response. The caller must free
+ * the collected attributes.
+ */
+int icsf_get_attribute_collect(LDAP * ld, int *reason,
+                               struct icsf_object_record *object,
+                               CK_ATTRIBUTE * attrs, CK_ULONG attrs_len,
+                               const CK_ATTRIBUTE_TYPE * types,
+                               CK_ULONG types_len, CK_ATTRIBUTE ** collected,
+                               CK_ULONG * collected_len)
 {
 
     char handle[ICSF_HANDLE_LEN];
@@ -2164,8 +2502,15 @@ int icsf_get_attribute(LDAP * ld, int *reason,
     int rc = 0;
 
     CHECK_ARG_NON_NULL(ld);
-    CHECK_ARG_NON_NULL(attrs);
     CHECK_ARG_NON_NULL(object);
+    if (attrs_len > 0)
+        CHECK_ARG_NON_NULL(attrs);
+    if (types_len > 0) {
+        CHECK_ARG_NON_NULL(collected);
+        CHECK_ARG_NON_NULL(collected_len);
+        *collected = NULL;
+        *collected_len = 0;
+    }
 
     object_record_to_handle(handle, object);
 
@@ -2209,13 +2554,21 @@ int icsf_get_attribute(LDAP * ld, int *reason,
      *
      * asn.1 {{{ito|i} {ito|i} ...}i}
      */
-    rc = icsf_ber_decode_get_attribute_list(result, attrs, attrs_len);
+    rc = icsf_ber_decode_get_attribute_list(result, attrs, attrs_len,
+                                            types, types_len, collected,
+                                            collected_len);
     if (rc < 0) {
         TRACE_ERROR("Failed to decode message.\n");
         goto cleanup;
     }
 
 cleanup:
+    if (rc != 0 && types_len > 0 && *collected != NULL) {
+        icsf_free_collected_attributes(*collected, *collected_len);
+        *collected = NULL;
+        *collected_len = 0;
+    }
+
     if (msg)
         ber_free(msg, 1);
 
@@ -2225,6 +2578,16 @@ cleanup:
     return rc;
 }
 
+int icsf_get_attribute(LDAP * ld, int *reason,
+                       struct icsf_object_record *object, CK_ATTRIBUTE * attrs,
+                       CK_ULONG attrs_len)
+{
+    CHECK_ARG_NON_NULL(attrs);
+
+    return icsf_get_attribute_collect(ld, reason, object, attrs, attrs_len,
+                                      NULL, 0, NULL, NULL);
+}
+
 int icsf_set_attribute(LDAP * ld, int *reason,
                        struct icsf_object_record *object, CK_ATTRIBUTE * attrs,
                        CK_ULONG attrs_len)
@@ -184,6 +184,13 @@ int icsf_get_attribute(LDAP * ld, int *reason,
                        struct icsf_object_record *object, CK_ATTRIBUTE * attrs,
                        CK_ULONG attrs_len);
 
+int icsf_get_attribute_collect(LDAP * ld, int *reason,
+                               struct icsf_object_record *object,
+                               CK_ATTRIBUTE * attrs, CK_ULONG attrs_len,
+                               const CK_ATTRIBUTE_TYPE * types,
+                               CK_ULONG types_len, CK_ATTRIBUTE ** collected,
+                               CK_ULONG * collected_len);
+
 int icsf_set_attribute(LDAP * ld, int *reason,
                        struct icsf_object_record *object, CK_ATTRIBUTE * attrs,
                        CK_ULONG attrs_len);
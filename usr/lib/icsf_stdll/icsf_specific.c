@@ -132,6 +132,12 @@ struct icsf_object_mapping {
     CK_SESSION_HANDLE session_id;
     struct icsf_object_record icsf_object;
     struct objstrength strength;
+
+    /* Cached attributes, protected by attr_cache_mutex */
+    CK_ATTRIBUTE *attr_cache;
+    CK_ULONG attr_cache_len;
+    CK_BBOOL attr_cache_valid;
+    CK_ULONG attr_cache_gen;
 };
 
 /*
@@ -147,9 +153,15 @@ struct icsf_multi_part_context {
 
 struct icsf_policy_attr {
     LDAP *ld;
-    struct icsf_object_record *icsf_object;
+    icsf_private_data_t *icsf_data;
+    struct icsf_object_mapping *mapping;
 };
 
+static int get_object_attributes(icsf_private_data_t *icsf_data, LDAP *ld,
+                                 int *reason,
+                                 struct icsf_object_mapping *mapping,
+                                 CK_ATTRIBUTE *attrs, CK_ULONG attrs_len);
+
 int icsf_to_ock_err(int icsf_return_code, int icsf_reason_code);
 
 static CK_RV icsf_policy_get_attr(void *data,
@@ -162,7 +174,8 @@ static CK_RV icsf_policy_get_attr(void *data,
     CK_ATTRIBUTE *a;
     CK_ATTRIBUTE s = { .type = type, .ulValueLen = 0, .pValue = NULL };
     
-    rc = icsf_get_attribute(d->ld, &reason, d->icsf_object, &s, 1);
+    rc = get_object_attributes(d->icsf_data, d->ld, &reason, d->mapping,
+                               &s, 1);
     if (rc != CKR_OK) {
         TRACE_DEVEL("icsf_get_attribute failed\n");
         return icsf_to_ock_err(rc, reason);
@@ -180,7 +193,8 @@ static CK_RV icsf_policy_get_attr(void *data,
     a->type = type;
     a->ulValueLen = s.ulValueLen;
     a->pValue = (CK_BYTE *) a + sizeof(CK_ATTRIBUTE);
-    rc = icsf_get_attribute(d->ld, &reason, d->icsf_object, a, 1);
+    rc = get_object_attributes(d->icsf_data, d->ld, &reason, d->mapping,
+                               a, 1);
     if (rc != CKR_OK) {
         TRACE_DEVEL("icsf_get_attribute failed\n");
         free(a);
@@ -198,34 +212,147 @@ static void icsf_policy_free_attr(CK_ATTRIBUTE *attr)
 /*
  * Get the session specific structure.
  */
-static struct session_state *get_session_state(STDLL_TokData_t * tokdata,
-                                               CK_SESSION_HANDLE session_id)
+static struct session_state *get_session_state(SESSION *session)
 {
-    icsf_private_data_t *icsf_data = tokdata->private_data;
-    struct session_state *found = NULL;
-    struct session_state *s;
+    return session->private_data;
+}
 
-    /* Lock sessions list */
-    if (pthread_mutex_lock(&icsf_data->sess_list_mutex)) {
-        TRACE_ERROR("Failed to lock mutex.\n");
-        return NULL;
-    }
+/*
+ * Attributes that are cached for each object. These can not be changed after
+ * the object was created, so other processes or hosts using the same ICSF
+ * server can not make them stale. Mutable attributes like CKA_LABEL and CKA_ID
+ * are always read from the server. So is CKA_PRIVATE, which the session
+ * permission checks are based on.
+ */
+static const CK_ATTRIBUTE_TYPE icsf_cached_attrs[] = {
+    CKA_CLASS, CKA_KEY_TYPE, CKA_TOKEN,
+    CKA_MODULUS, CKA_MODULUS_BITS, CKA_PUBLIC_EXPONENT, CKA_EC_PARAMS,
+    CKA_EC_POINT, CKA_VALUE_LEN,
+};
 
-    for_each_list_entry(&icsf_data->sessions, struct session_state, s, sessions) {
-        if (s->session_id == session_id) {
-            found = s;
-            goto done;
+static const CK_ULONG icsf_cached_attrs_len =
+                (sizeof(icsf_cached_attrs) / sizeof(CK_ATTRIBUTE_TYPE));
+
+static void free_object_mapping(void *node)
+{
+    struct icsf_object_mapping *mapping = node;
+
+    free_attribute_array(mapping->attr_cache, mapping->attr_cache_len);
+    free(mapping);
+}
+
+/*
+ * Drop the cached attributes of an object after it has been modified. The
+ * generation count keeps a reader that fetched the attributes before the
+ * modification from caching them afterwards.
+ */
+static void invalidate_object_attributes(icsf_private_data_t *icsf_data,
+                                         struct icsf_object_mapping *mapping)
+{
+    pthread_mutex_lock(&icsf_data->attr_cache_mutex);
+    free_attribute_array(mapping->attr_cache, mapping->attr_cache_len);
+    mapping->attr_cache = NULL;
+    mapping->attr_cache_len = 0;
+    mapping->attr_cache_valid = FALSE;
+    mapping->attr_cache_gen++;
+    pthread_mutex_unlock(&icsf_data->attr_cache_mutex);
+}
+
+/*
+ * Try to get the attribute values from the attribute cache of the object.
+ * Returns TRUE if the request was served from the cache, in which case *rc
+ * contains the result, as icsf_get_attribute() would have returned it.
+ *
+ * Must be called with attr_cache_mutex locked.
+ */
+static CK_BBOOL get_cached_attributes(struct icsf_object_mapping *mapping,
+                                      CK_ATTRIBUTE *attrs, CK_ULONG attrs_len,
+                                      int *rc)
+{
+    CK_ATTRIBUTE *cached;
+    CK_ULONG i;
+
+    if (!mapping->attr_cache_valid)
+        return FALSE;
+
+    /* All attributes must be in the cache */
+    for (i = 0; i < attrs_len; i++) {
+        if (get_attribute_by_type(mapping->attr_cache, mapping->attr_cache_len,
+                                  attrs[i].type) == NULL)
+            return FALSE;
+    }
+
+    *rc = CKR_OK;
+    for (i = 0; i < attrs_len; i++) {
+        cached = get_attribute_by_type(mapping->attr_cache,
+                                       mapping->attr_cache_len, attrs[i].type);
+        if (attrs[i].pValue == NULL) {
+            attrs[i].ulValueLen = cached->ulValueLen;
+        } else if (attrs[i].ulValueLen >= cached->ulValueLen) {
+            if (cached->ulValueLen > 0)
+                memcpy(attrs[i].pValue, cached->pValue, cached->ulValueLen);
+            attrs[i].ulValueLen = cached->ulValueLen;
+        } else {
+            /* Continue, all attributes must be processed */
+            attrs[i].ulValueLen = CK_UNAVAILABLE_INFORMATION;
+            *rc = CKR_BUFFER_TOO_SMALL;
         }
     }
 
-done:
-    /* Unlock */
-    if (pthread_mutex_unlock(&icsf_data->sess_list_mutex)) {
-        TRACE_ERROR("Mutex Unlock failed.\n");
-        return NULL;
+    return TRUE;
+}
+
+/*
+ * Get attribute values of an object. The cacheable attributes of an object
+ * are read from the server together with the first request for the object,
+ * and later requests for cacheable attributes only are served locally.
+ * Returns an ICSF return code like icsf_get_attribute().
+ */
+static int get_object_attributes(icsf_private_data_t *icsf_data, LDAP *ld,
+                                 int *reason,
+                                 struct icsf_object_mapping *mapping,
+                                 CK_ATTRIBUTE *attrs, CK_ULONG attrs_len)
+{
+    CK_ATTRIBUTE *collected = NULL;
+    CK_ULONG collected_len = 0;
+    CK_BBOOL cached, valid;
+    CK_ULONG gen;
+    int rc = 0;
+
+    *reason = 0;
+
+    pthread_mutex_lock(&icsf_data->attr_cache_mutex);
+    cached = get_cached_attributes(mapping, attrs, attrs_len, &rc);
+    valid = mapping->attr_cache_valid;
+    gen = mapping->attr_cache_gen;
+    pthread_mutex_unlock(&icsf_data->attr_cache_mutex);
+    if (cached)
+        return rc;
+
+    /* Cached already, but a non-cacheable attribute was requested */
+    if (valid)
+        return icsf_get_attribute(ld, reason, &mapping->icsf_object,
+                                  attrs, attrs_len);
+
+    rc = icsf_get_attribute_collect(ld, reason, &mapping->icsf_object,
+                                    attrs, attrs_len, icsf_cached_attrs,
+                                    icsf_cached_attrs_len, &collected,
+                                    &collected_len);
+    if (rc != 0)
+        return rc;
+
+    pthread_mutex_lock(&icsf_data->attr_cache_mutex);
+    if (!mapping->attr_cache_valid && mapping->attr_cache_gen == gen) {
+        mapping->attr_cache = collected;
+        mapping->attr_cache_len = collected_len;
+        mapping->attr_cache_valid = TRUE;
+        collected = NULL;
     }
+    pthread_mutex_unlock(&icsf_data->attr_cache_mutex);
 
-    return found;
+    free_attribute_array(collected, collected_len);
+
+    return rc;
 }
 
 static void purge_object_mapping_cb(STDLL_TokData_t * tokdata, void *value,
@@ -358,7 +485,8 @@ CK_RV icsftok_init(STDLL_TokData_t * tokdata, CK_SLOT_ID slot_id,
         return CKR_HOST_MEMORY;
     list_init(&icsf_data->sessions);
     pthread_mutex_init(&icsf_data->sess_list_mutex, NULL);
-    bt_init(&icsf_data->objects, free);
+    bt_init(&icsf_data->objects, free_object_mapping);
+    pthread_mutex_init(&icsf_data->attr_cache_mutex, NULL);
     tokdata->private_data = icsf_data;
 
     rc = XProcLock(tokdata);
@@ -1287,6 +1415,83 @@ LDAP *getLDAPhandle(STDLL_TokData_t * tokdata, CK_SLOT_ID slot_id)
     return new_ld;
 }
 
+/*
+ * Get an LDAP handle for a session out of the connection pool. A new
+ * connection is opened as long as the pool is not full, afterwards the
+ * connection with the fewest sessions is shared.
+ *
+ * Must be called with sess_list_mutex locked.
+ */
+static LDAP *get_pooled_ldap_handle(STDLL_TokData_t * tokdata,
+                                    CK_SLOT_ID slot_id)
+{
+    icsf_private_data_t *icsf_data = tokdata->private_data;
+    int i, idx = -1, free_idx = -1;
+
+    for (i = 0; i < ICSF_LDAP_POOL_SIZE; i++) {
+        if (icsf_data->ld_pool[i] == NULL) {
+            if (free_idx < 0)
+                free_idx = i;
+            continue;
+        }
+        if (idx < 0 ||
+            icsf_data->ld_pool_refs[i] < icsf_data->ld_pool_refs[idx])
+            idx = i;
+    }
+
+    if (free_idx >= 0) {
+        icsf_data->ld_pool[free_idx] = getLDAPhandle(tokdata, slot_id);
+        if (icsf_data->ld_pool[free_idx] != NULL)
+            idx = free_idx;
+        else
+            TRACE_DEVEL("Failed to open a new LDAP connection.\n");
+    }
+
+    if (idx < 0)
+        return NULL;
+
+    icsf_data->ld_pool_refs[idx]++;
+    TRACE_DEVEL("LDAP connection %d now used by %u session(s)\n", idx,
+                icsf_data->ld_pool_refs[idx]);
+
+    return icsf_data->ld_pool[idx];
+}
+
+/*
+ * Drop the reference of a session to a pooled LDAP handle, and close the
+ * connection if no other session uses it.
+ *
+ * Must be called with sess_list_mutex locked.
+ */
+static CK_RV put_pooled_ldap_handle(STDLL_TokData_t * tokdata, LDAP *ld,
+                                    CK_BBOOL in_fork_initializer)
+{
+    icsf_private_data_t *icsf_data = tokdata->private_data;
+    int i;
+
+    for (i = 0; i < ICSF_LDAP_POOL_SIZE; i++) {
+        if (icsf_data->ld_pool[i] != ld)
+            continue;
+
+        if (icsf_data->ld_pool_refs[i] > 1) {
+            icsf_data->ld_pool_refs[i]--;
+            return CKR_OK;
+        }
+
+        /* Log off from LDAP server */
+        if (!in_fork_initializer && icsf_logout(ld)) {
+            TRACE_DEVEL("Failed to disconnect from LDAP server.\n");
+            return CKR_FUNCTION_FAILED;
+        }
+        icsf_data->ld_pool[i] = NULL;
+        icsf_data->ld_pool_refs[i] = 0;
+        return CKR_OK;
+    }
+
+    TRACE_ERROR("LDAP handle not found in the connection pool.\n");
+    return CKR_FUNCTION_FAILED;
+}
+
 CK_RV icsf_get_handles(STDLL_TokData_t * tokdata, CK_SLOT_ID slot_id)
 {
     icsf_private_data_t *icsf_data = tokdata->private_data;
@@ -1302,7 +1507,7 @@ CK_RV icsf_get_handles(STDLL_TokData_t * tokdata, CK_SLOT_ID slot_id)
     for_each_list_entry(&icsf_data->sessions, struct session_state, s,
                         sessions) {
         if (s->ld == NULL)
-            s->ld = getLDAPhandle(tokdata, slot_id);
+            s->ld = get_pooled_ldap_handle(tokdata, slot_id);
     }
 
     if (pthread_mutex_unlock(&icsf_data->sess_list_mutex)) {
@@ -1345,7 +1550,7 @@ CK_RV icsftok_open_session(STDLL_TokData_t * tokdata, SESSION * sess)
      * same login state.
      */
     if (session_mgr_user_session_exists(tokdata)) {
-        ld = getLDAPhandle(tokdata, sess->session_info.slotID);
+        ld = get_pooled_ldap_handle(tokdata, sess->session_info.slotID);
         if (ld == NULL) {
             TRACE_DEVEL("Failed to get LDAP handle for session.\n");
             rc = CKR_FUNCTION_FAILED;
@@ -1357,6 +1562,7 @@ CK_RV icsftok_open_session(STDLL_TokData_t * tokdata, SESSION * sess)
 
     /* put new session_state into the list */
     list_insert_head(&icsf_data->sessions, &session_state->sessions);
+    sess->private_data = session_state;
 
 done:
     /* Unlock */
@@ -1428,12 +1634,12 @@ static CK_RV close_session(STDLL_TokData_t * tokdata,
     if (rc)
         return rc;
 
-    /* Log off from LDAP server */
+    /* Release the pooled LDAP connection */
     if (session_state->ld) {
-        if (!in_fork_initializer && icsf_logout(session_state->ld)) {
-            TRACE_DEVEL("Failed to disconnect from LDAP server.\n");
-            return CKR_FUNCTION_FAILED;
-        }
+        rc = put_pooled_ldap_handle(tokdata, session_state->ld,
+                                    in_fork_initializer);
+        if (rc != CKR_OK)
+            return rc;
         session_state->ld = NULL;
     }
 
@@ -1456,18 +1662,31 @@ static CK_RV close_session(STDLL_TokData_t * tokdata,
 CK_RV icsftok_close_session(STDLL_TokData_t * tokdata, SESSION * session,
                             CK_BBOOL in_fork_initializer)
 {
+    icsf_private_data_t *icsf_data = tokdata->private_data;
     CK_RV rc;
     struct session_state *session_state;
 
     /* Get the related session_state */
     if (session == NULL
-        || !(session_state = get_session_state(tokdata, session->handle))) {
+        || !(session_state = get_session_state(session))) {
         TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
         return CKR_SESSION_HANDLE_INVALID;
     }
 
+    if (pthread_mutex_lock(&icsf_data->sess_list_mutex)) {
+        TRACE_ERROR("Failed to lock mutex.\n");
+        return CKR_FUNCTION_FAILED;
+    }
+
     if ((rc = close_session(tokdata, session_state, in_fork_initializer)))
         TRACE_ERROR("close_session failed\n");
+    else
+        session->private_data = NULL;
+
+    if (pthread_mutex_unlock(&icsf_data->sess_list_mutex)) {
+        TRACE_ERROR("Mutex Unlock Failed.\n");
+        return CKR_FUNCTION_FAILED;
+    }
 
     return rc;
 }
@@ -1503,6 +1722,7 @@ CK_RV icsftok_final(STDLL_TokData_t * tokdata, CK_BBOOL finalize,
 
     if (finalize) {
         bt_destroy(&icsf_data->objects);
+        pthread_mutex_destroy(&icsf_data->attr_cache_mutex);
         pthread_mutex_destroy(&icsf_data->sess_list_mutex);
         free(icsf_data);
         tokdata->private_data = NULL;
@@ -1716,7 +1936,7 @@ CK_RV icsftok_copy_object(STDLL_TokData_t * tokdata,
     CK_ATTRIBUTE_PTR temp_attrs;
 
     /* Get session state */
-    if (!(session_state = get_session_state(tokdata, session->handle))) {
+    if (!(session_state = get_session_state(session))) {
         TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
         rc = CKR_SESSION_HANDLE_INVALID;
         goto done;
@@ -1730,7 +1950,7 @@ CK_RV icsftok_copy_object(STDLL_TokData_t * tokdata,
     }
 
     /* Allocate structure for new object */
-    if (!(mapping_dst = malloc(sizeof(*mapping_dst)))) {
+    if (!(mapping_dst = calloc(1, sizeof(*mapping_dst)))) {
         TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
         rc = CKR_HOST_MEMORY;
         goto done;
@@ -1743,8 +1963,8 @@ CK_RV icsftok_copy_object(STDLL_TokData_t * tokdata,
         goto done;
     }
 
-    rc = icsf_get_attribute(session_state->ld, &reason,
-                            &mapping_src->icsf_object, priv_attrs, 2);
+    rc = get_object_attributes(icsf_data, session_state->ld, &reason,
+                               mapping_src, priv_attrs, 2);
     if (rc != CKR_OK) {
         TRACE_ERROR("icsf_get_attribute failed\n");
         goto done;
@@ -1845,7 +2065,7 @@ CK_RV icsftok_create_object(STDLL_TokData_t * tokdata, SESSION * session,
     }
 
     /* Allocate structure to keep ICSF object information */
-    if (!(mapping = malloc(sizeof(*mapping)))) {
+    if (!(mapping = calloc(1, sizeof(*mapping)))) {
         TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
         return CKR_HOST_MEMORY;
     }
@@ -1853,7 +2073,7 @@ CK_RV icsftok_create_object(STDLL_TokData_t * tokdata, SESSION * session,
     mapping->session_id = session->handle;
 
     /* Get session state */
-    if (!(session_state = get_session_state(tokdata, session->handle))) {
+    if (!(session_state = get_session_state(session))) {
         TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
         rc = CKR_SESSION_HANDLE_INVALID;
         goto done;
@@ -1875,7 +2095,8 @@ CK_RV icsftok_create_object(STDLL_TokData_t * tokdata, SESSION * session,
     }
     /* Policy check */
     pattr.ld = session_state->ld;
-    pattr.icsf_object = &mapping->icsf_object;
+    pattr.icsf_data = icsf_data;
+    pattr.mapping = mapping;
     rc = tokdata->policy->store_object_strength(tokdata->policy,
                                                 &mapping->strength,
                                                 icsf_policy_get_attr, &pattr,
@@ -2052,7 +2273,7 @@ CK_RV icsftok_generate_key_pair(STDLL_TokData_t * tokdata, SESSION * session,
         goto done;
 
     /* Get session state */
-    if (!(session_state = get_session_state(tokdata, session->handle))) {
+    if (!(session_state = get_session_state(session))) {
         TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
         rc = CKR_SESSION_HANDLE_INVALID;
         goto done;
@@ -2082,8 +2303,8 @@ CK_RV icsftok_generate_key_pair(STDLL_TokData_t * tokdata, SESSION * session,
     }
 
     /* Allocate structure to keep ICSF objects information */
-    if (!(pub_key_mapping = malloc(sizeof(*pub_key_mapping))) ||
-        !(priv_key_mapping = malloc(sizeof(*priv_key_mapping)))) {
+    if (!(pub_key_mapping = calloc(1, sizeof(*pub_key_mapping))) ||
+        !(priv_key_mapping = calloc(1, sizeof(*priv_key_mapping)))) {
         TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
         rc = CKR_HOST_MEMORY;
         goto done;
@@ -2100,7 +2321,8 @@ CK_RV icsftok_generate_key_pair(STDLL_TokData_t * tokdata, SESSION * session,
         goto done;
     }
     pattr.ld = session_state->ld;
-    pattr.icsf_object = &pub_key_mapping->icsf_object;
+    pattr.icsf_data = icsf_data;
+    pattr.mapping = pub_key_mapping;
     rc = tokdata->policy->store_object_strength(tokdata->policy,
                                                 &pub_key_mapping->strength,
                                                 icsf_policy_get_attr, &pattr,
@@ -2109,7 +2331,7 @@ CK_RV icsftok_generate_key_pair(STDLL_TokData_t * tokdata, SESSION * session,
         TRACE_ERROR("POLICY VIOLATION: Public key too weak\n");
         goto done;
     }
-    pattr.icsf_object = &priv_key_mapping->icsf_object;
+    pattr.mapping = priv_key_mapping;
     rc = tokdata->policy->store_object_strength(tokdata->policy,
                                                 &priv_key_mapping->strength,
                                                 icsf_policy_get_attr, &pattr,
@@ -2204,7 +2426,7 @@ CK_RV icsftok_generate_key(STDLL_TokData_t * tokdata, SESSION * session,
     }
 
     /* Allocate structure to keep ICSF object information */
-    if (!(mapping = malloc(sizeof(*mapping)))) {
+    if (!(mapping = calloc(1, sizeof(*mapping)))) {
         TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
         goto done;
     }
@@ -2212,7 +2434,7 @@ CK_RV icsftok_generate_key(STDLL_TokData_t * tokdata, SESSION * session,
     mapping->session_id = session->handle;
 
     /* Get session state */
-    if (!(session_state = get_session_state(tokdata, session->handle))) {
+    if (!(session_state = get_session_state(session))) {
         TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
         rc = CKR_SESSION_HANDLE_INVALID;
         goto done;
@@ -2234,7 +2456,8 @@ CK_RV icsftok_generate_key(STDLL_TokData_t * tokdata, SESSION * session,
         goto done;
     }
     pattr.ld = session_state->ld;
-    pattr.icsf_object = &mapping->icsf_object;
+    pattr.icsf_data = icsf_data;
+    pattr.mapping = mapping;
     rc = tokdata->policy->store_object_strength(tokdata->policy,
                                                 &mapping->strength,
                                                 icsf_policy_get_attr, &pattr,
@@ -2389,7 +2612,7 @@ CK_RV icsftok_encrypt_init(STDLL_TokData_t * tokdata,
     struct icsf_object_mapping *mapping = NULL;
 
     /* Check session */
-    if (!get_session_state(tokdata, session->handle)) {
+    if (!get_session_state(session)) {
         rc = CKR_SESSION_HANDLE_INVALID;
         TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
         goto done;
@@ -2520,7 +2743,7 @@ CK_RV icsftok_encrypt(STDLL_TokData_t * tokdata,
     }
 
     /* Check session */
-    if (!(session_state = get_session_state(tokdata, session->handle))) {
+    if (!(session_state = get_session_state(session))) {
         TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
         rc = CKR_SESSION_HANDLE_INVALID;
         goto done;
@@ -2620,7 +2843,7 @@ CK_RV icsftok_encrypt_update(STDLL_TokData_t * tokdata,
     }
 
     /* Check session */
-    if (!(session_state = get_session_state(tokdata, session->handle))) {
+    if (!(session_state = get_session_state(session))) {
         TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
         rc = CKR_SESSION_HANDLE_INVALID;
         goto done;
@@ -2800,7 +3023,7 @@ CK_RV icsftok_encrypt_final(STDLL_TokData_t * tokdata,
     }
 
     /* Check session */
-    if (!(session_state = get_session_state(tokdata, session->handle))) {
+    if (!(session_state = get_session_state(session))) {
         TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
         rc = CKR_SESSION_HANDLE_INVALID;
         goto done;
@@ -2906,7 +3129,7 @@ CK_RV icsftok_decrypt_init(STDLL_TokData_t * tokdata,
     struct icsf_object_mapping *mapping = NULL;
 
     /* Check session */
-    if (!get_session_state(tokdata, session->handle)) {
+    if (!get_session_state(session)) {
         rc = CKR_SESSION_HANDLE_INVALID;
         TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
         goto done;
@@ -3037,7 +3260,7 @@ CK_RV icsftok_decrypt(STDLL_TokData_t * tokdata,
     }
 
     /* Check session */
-    if (!(session_state = get_session_state(tokdata, session->handle))) {
+    if (!(session_state = get_session_state(session))) {
         TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
         rc = CKR_SESSION_HANDLE_INVALID;
         goto done;
@@ -3138,7 +3361,7 @@ CK_RV icsftok_decrypt_update(STDLL_TokData_t * tokdata,
     }
 
     /* Check session */
-    if (!(session_state = get_session_state(tokdata, session->handle))) {
+    if (!(session_state = get_session_state(session))) {
         TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
         rc = CKR_SESSION_HANDLE_INVALID;
         goto done;
@@ -3333,7 +3556,7 @@ CK_RV icsftok_decrypt_final(STDLL_TokData_t * tokdata,
     }
 
     /* Check session */
-    if (!(session_state = get_session_state(tokdata, session->handle))) {
+    if (!(session_state = get_session_state(session))) {
         TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
         rc = CKR_SESSION_HANDLE_INVALID;
         goto done;
@@ -3444,7 +3667,7 @@ CK_RV icsftok_get_attribute_value(STDLL_TokData_t * tokdata,
     };
 
     /* Get session state */
-    if (!(session_state = get_session_state(tokdata, sess->handle))) {
+    if (!(session_state = get_session_state(sess))) {
         TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
         return CKR_SESSION_HANDLE_INVALID;
     }
@@ -3465,8 +3688,8 @@ CK_RV icsftok_get_attribute_value(STDLL_TokData_t * tokdata,
     }
 
     /* get the private attribute so we can check the permissions */
-    rc = icsf_get_attribute(session_state->ld, &reason,
-                            &mapping->icsf_object, priv_attr, 1);
+    rc = get_object_attributes(icsf_data, session_state->ld, &reason,
+                               mapping, priv_attr, 1);
     if (rc != CKR_OK) {
         TRACE_DEVEL("icsf_get_attribute failed\n");
         rc = icsf_to_ock_err(rc, reason);
@@ -3484,8 +3707,8 @@ CK_RV icsftok_get_attribute_value(STDLL_TokData_t * tokdata,
     // get requested attributes and values if the obj_size ptr is not set
     if (!obj_size) {
         /* Now call icsf to get the attribute values */
-        rc = icsf_get_attribute(session_state->ld, &reason,
-                                &mapping->icsf_object, pTemplate, ulCount);
+        rc = get_object_attributes(icsf_data, session_state->ld, &reason,
+                                   mapping, pTemplate, ulCount);
 
         if (rc != CKR_OK) {
             TRACE_DEVEL("icsf_get_attribute failed\n");
@@ -3534,7 +3757,7 @@ CK_RV icsftok_set_attribute_value(STDLL_TokData_t * tokdata,
     };
 
     /* Get session state */
-    if (!(session_state = get_session_state(tokdata, sess->handle))) {
+    if (!(session_state = get_session_state(sess))) {
         TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
         return CKR_SESSION_HANDLE_INVALID;
     }
@@ -3558,8 +3781,8 @@ CK_RV icsftok_set_attribute_value(STDLL_TokData_t * tokdata,
      * first get CKA_PRIVATE since we need to check againse session
      * icsf will check if the attributes are modifiable
      */
-    rc = icsf_get_attribute(session_state->ld, &reason,
-                            &mapping->icsf_object, priv_attrs, 2);
+    rc = get_object_attributes(icsf_data, session_state->ld, &reason,
+                               mapping, priv_attrs, 2);
     if (rc != CKR_OK) {
         TRACE_DEVEL("icsf_get_attribute failed\n");
         rc = icsf_to_ock_err(rc, reason);
@@ -3582,6 +3805,8 @@ CK_RV icsftok_set_attribute_value(STDLL_TokData_t * tokdata,
         goto done;
     }
 
+    invalidate_object_attributes(icsf_data, mapping);
+
 done:
     if (mapping) {
         bt_put_node_value(&icsf_data->objects, mapping);
@@ -3659,7 +3884,7 @@ CK_RV icsftok_find_objects_init(STDLL_TokData_t * tokdata, SESSION * sess,
     }
 
     /* Get session state */
-    if (!(session_state = get_session_state(tokdata, sess->handle))) {
+    if (!(session_state = get_session_state(sess))) {
         TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
         return CKR_SESSION_HANDLE_INVALID;
     }
@@ -3722,7 +3947,7 @@ CK_RV icsftok_find_objects_init(STDLL_TokData_t * tokdata, SESSION * sess,
             if (!node_number) {
                 struct icsf_object_mapping *new_mapping;
 
-                if (!(new_mapping = malloc(sizeof(*new_mapping)))) {
+                if (!(new_mapping = calloc(1, sizeof(*new_mapping)))) {
                     TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
                     rv = CKR_HOST_MEMORY;
                     goto done;
@@ -3731,7 +3956,8 @@ CK_RV icsftok_find_objects_init(STDLL_TokData_t * tokdata, SESSION * sess,
                 new_mapping->icsf_object = records[i];
                 /* Policy check */
                 pattr.ld = session_state->ld;
-                pattr.icsf_object = &new_mapping->icsf_object;
+                pattr.icsf_data = icsf_data;
+                pattr.mapping = new_mapping;
                 rc = tokdata->policy->store_object_strength(
                      tokdata->policy, &new_mapping->strength,
                      icsf_policy_get_attr, &pattr, icsf_policy_free_attr, sess);
@@ -3793,7 +4019,7 @@ CK_RV icsftok_destroy_object(STDLL_TokData_t * tokdata, SESSION * sess,
 
 
     /* Get session state */
-    if (!(session_state = get_session_state(tokdata, sess->handle))) {
+    if (!(session_state = get_session_state(sess))) {
         TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
         return CKR_SESSION_HANDLE_INVALID;;
     }
@@ -3896,7 +4122,7 @@ CK_RV icsftok_sign_init(STDLL_TokData_t * tokdata,
     CK_MAC_GENERAL_PARAMS *param;
 
     /* Check session */
-    if (!(session_state = get_session_state(tokdata, session->handle))) {
+    if (!(session_state = get_session_state(session))) {
         TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
         return CKR_SESSION_HANDLE_INVALID;
     }
@@ -4082,7 +4308,7 @@ CK_RV icsftok_sign(STDLL_TokData_t * tokdata,
     }
 
     /* Check session */
-    if (!(session_state = get_session_state(tokdata, session->handle))) {
+    if (!(session_state = get_session_state(session))) {
         TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
         rc = CKR_SESSION_HANDLE_INVALID;
         goto done;
@@ -4204,7 +4430,7 @@ CK_RV icsftok_sign_update(STDLL_TokData_t * tokdata,
     char *buffer = NULL;
 
     /* Check session */
-    if (!(session_state = get_session_state(tokdata, session->handle))) {
+    if (!(session_state = get_session_state(session))) {
         TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
         rc = CKR_SESSION_HANDLE_INVALID;
         goto done;
@@ -4363,7 +4589,7 @@ CK_RV icsftok_sign_final(STDLL_TokData_t * tokdata,
     CK_BBOOL length_only = (signature == NULL);
 
     /* Check session */
-    if (!(session_state = get_session_state(tokdata, session->handle))) {
+    if (!(session_state = get_session_state(session))) {
         TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
         rc = CKR_SESSION_HANDLE_INVALID;
         goto done;
@@ -4488,7 +4714,7 @@ CK_RV icsftok_verify_init(STDLL_TokData_t * tokdata,
     CK_MAC_GENERAL_PARAMS *param;
 
     /* Check session */
-    if (!(session_state = get_session_state(tokdata, session->handle))) {
+    if (!(session_state = get_session_state(session))) {
         TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
         return CKR_SESSION_HANDLE_INVALID;
     }
@@ -4679,7 +4905,7 @@ CK_RV icsftok_verify(STDLL_TokData_t * tokdata,
     }
 
     /* Check session */
-    if (!(session_state = get_session_state(tokdata, session->handle))) {
+    if (!(session_state = get_session_state(session))) {
         TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
         rc = CKR_SESSION_HANDLE_INVALID;
         goto done;
@@ -4775,7 +5001,7 @@ CK_RV icsftok_verify_update(STDLL_TokData_t * tokdata,
     char *buffer = NULL;
 
     /* Check session */
-    if (!(session_state = get_session_state(tokdata, session->handle))) {
+    if (!(session_state = get_session_state(session))) {
         TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
         rc = CKR_SESSION_HANDLE_INVALID;
         goto done;
@@ -4939,7 +5165,7 @@ CK_RV icsftok_verify_final(STDLL_TokData_t * tokdata,
     }
 
     /* Check session */
-    if (!(session_state = get_session_state(tokdata, session->handle))) {
+    if (!(session_state = get_session_state(session))) {
         TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
         rc = CKR_SESSION_HANDLE_INVALID;
         goto done;
@@ -5051,7 +5277,7 @@ CK_RV icsftok_wrap_key(STDLL_TokData_t * tokdata,
     size_t expected_block_size = 0;
 
     /* Check session */
-    if (!(session_state = get_session_state(tokdata, session->handle))) {
+    if (!(session_state = get_session_state(session))) {
         TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
         return CKR_SESSION_HANDLE_INVALID;
     }
@@ -5169,7 +5395,7 @@ CK_RV icsftok_unwrap_key(STDLL_TokData_t * tokdata,
     struct icsf_policy_attr pattr;
 
     /* Check session */
-    if (!(session_state = get_session_state(tokdata, session->handle))) {
+    if (!(session_state = get_session_state(session))) {
         TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
         return CKR_SESSION_HANDLE_INVALID;
     }
@@ -5196,7 +5422,7 @@ CK_RV icsftok_unwrap_key(STDLL_TokData_t * tokdata,
 
 
     /* Allocate structure to keep ICSF object information */
-    if (!(key_mapping = malloc(sizeof(*key_mapping)))) {
+    if (!(key_mapping = calloc(1, sizeof(*key_mapping)))) {
         TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
         rc = CKR_HOST_MEMORY;
         goto done;
@@ -5248,7 +5474,8 @@ CK_RV icsftok_unwrap_key(STDLL_TokData_t * tokdata,
         goto done;
     }
     pattr.ld = session_state->ld;
-    pattr.icsf_object = &key_mapping->icsf_object;
+    pattr.icsf_data = icsf_data;
+    pattr.mapping = key_mapping;
     rc = tokdata->policy->store_object_strength(tokdata->policy,
                                                 &key_mapping->strength,
                                                 icsf_policy_get_attr, &pattr,
@@ -5347,7 +5574,7 @@ CK_RV icsftok_derive_key(STDLL_TokData_t * tokdata, SESSION * session,
 
     /* Allocate structure to keep ICSF object information */
     for (i = 0; i < sizeof(mappings) / sizeof(*mappings); i++) {
-        if (!(mappings[i] = malloc(sizeof(*mappings[i])))) {
+        if (!(mappings[i] = calloc(1, sizeof(*mappings[i])))) {
             TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
             rc = CKR_HOST_MEMORY;
             goto done;
@@ -5361,7 +5588,7 @@ CK_RV icsftok_derive_key(STDLL_TokData_t * tokdata, SESSION * session,
     }
 
     /* Get session state */
-    if (!(session_state = get_session_state(tokdata, session->handle))) {
+    if (!(session_state = get_session_state(session))) {
         TRACE_ERROR("%s\n", ock_err(ERR_SESSION_HANDLE_INVALID));
         rc = CKR_SESSION_HANDLE_INVALID;
         goto done;
@@ -5399,7 +5626,8 @@ CK_RV icsftok_derive_key(STDLL_TokData_t * tokdata, SESSION * session,
             goto done;
         }
         pattr.ld = session_state->ld;
-        pattr.icsf_object = &mappings[0]->icsf_object;
+        pattr.icsf_data = icsf_data;
+        pattr.mapping = mappings[0];
         rc = tokdata->policy->store_object_strength(tokdata->policy,
                                                     &mappings[0]->strength,
                                                     icsf_policy_get_attr,
@@ -5425,8 +5653,9 @@ CK_RV icsftok_derive_key(STDLL_TokData_t * tokdata, SESSION * session,
             goto done;
         }
         pattr.ld = session_state->ld;
+        pattr.icsf_data = icsf_data;
         for (i = 0; i < 4; ++i) {
-            pattr.icsf_object = &mappings[i]->icsf_object;
+            pattr.mapping = mappings[i];
             rc = tokdata->policy->store_object_strength(tokdata->policy,
                                                         &mappings[i]->strength,
                                                         icsf_policy_get_attr,
@@ -16,14 +16,20 @@
 #ifndef ICSF_SPECIFIC_H
 #define ICSF_SPECIFIC_H
 
+#include <ldap.h>
 #include "pkcs11types.h"
 #include "list.h"
 
+/* Maximum number of LDAP connections shared by the sessions of a token */
+#define ICSF_LDAP_POOL_SIZE 4
+
 typedef struct {
     /*
      * This list contains one element to each session and it's used to keep
      * session specific data. Any insertion or deletion in this list should
-     * be protected by sess_list_mutex.
+     * be protected by sess_list_mutex. The element of a session is also
+     * referenced by the private_data field of the SESSION structure, which
+     * is used to look it up.
      *
      * This lock is intended to protect the linked list, not the content of each
      * element. Since PKCS#11 applications should not use the same session for
@@ -33,11 +39,23 @@ typedef struct {
     list_t sessions;
     pthread_mutex_t sess_list_mutex;
 
+    /*
+     * Pool of bound LDAP connections. Sessions do not own a connection, but
+     * reference one of the pool, and the requests of all sessions referencing
+     * the same connection are pipelined over it. A connection is closed when
+     * its last session is closed. Protected by sess_list_mutex.
+     */
+    LDAP *ld_pool[ICSF_LDAP_POOL_SIZE];
+    unsigned int ld_pool_refs[ICSF_LDAP_POOL_SIZE];
+
     /*
      * This binary tree keeps the mapping between ICSF object handles and PKCS#11
      * object handles. The tree index is used as the PKCS#11 handle.
      */
     struct btree objects;
+
+    /* Protects the attribute caches of the objects in the tree above. */
+    pthread_mutex_t attr_cache_mutex;
 } icsf_private_data_t;
 
 CK_RV icsftok_init(STDLL_TokData_t * tokdata, CK_SLOT_ID slot_id,
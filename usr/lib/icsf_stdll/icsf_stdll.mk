@@ -28,6 +28,7 @@ opencryptoki_stdll_libpkcs11_icsf_la_SOURCES = usr/lib/common/asn1.c	\
 	usr/lib/common/dp_obj.c usr/lib/common/mech_aes.c		\
 	usr/lib/common/mech_rsa.c usr/lib/common/mech_ec.c		\
 	usr/lib/common/obj_mgr.c usr/lib/common/template.c		\
+	usr/lib/common/secure_arena.c usr/lib/common/login_broker.c	\
 	usr/lib/common/p11util.c usr/lib/common/data_obj.c		\
 	usr/lib/common/encr_mgr.c usr/lib/common/key_mgr.c		\
 	usr/lib/common/mech_md2.c usr/lib/common/mech_sha.c		\
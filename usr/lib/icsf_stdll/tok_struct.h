@@ -49,6 +49,7 @@ token_spec_t token_specific = {
     &token_specific_save_token_data,
     NULL,                       // rng
     NULL,                       // final
+    NULL,                       // fork_child
     NULL,                       // init token
     NULL,                       // login
     NULL,                       // logout
@@ -81,6 +82,7 @@ token_spec_t token_specific = {
     NULL,                       // rsa_pss_sign
     NULL,                       // rsa_pss_verify
     NULL,                       // rsa_generate_keypair
+    NULL,                       // msg_sign_key_init
     // Elliptic Curve
     NULL,                       // ec_sign
     NULL,                       // ec_verify
@@ -94,6 +96,9 @@ token_spec_t token_specific = {
     NULL,                       // sha
     NULL,                       // sha_update
     NULL,                       // sha_final
+    NULL,                       // sha_stream_init
+    NULL,                       // sha_stream_update
+    NULL,                       // sha_stream_final
     //HMAC
     NULL,                       // hmac_sign_init
     NULL,                       // hmac_sign
@@ -113,6 +118,8 @@ token_spec_t token_specific = {
     NULL,                       // aes_gcm
     NULL,                       // aes_gcm_update
     NULL,                       // aes_gcm_final
+    NULL,                       // aes_gcm_msg_init
+    NULL,                       // aes_gcm_msg
     NULL,                       // aes_ofb
     NULL,                       // aes_cfb
     NULL,                       // aes_mac
@@ -0,0 +1,491 @@
+/*
+ * COPYRIGHT (c) International Business Machines Corp. 2024
+ *
+ * This program is provided under the terms of the Common Public License,
+ * version 1.0 (CPL-1.0). Any use, reproduction or distribution for this
+ * software constitutes recipient's acceptance of CPL-1.0 terms which can be
+ * found in the file LICENSE file or at
+ * https://opensource.org/licenses/cpl1.0.php
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/objects.h>
+#include <openssl/x509.h>
+
+#include "pkcs11types.h"
+#include "defs.h"
+#include "host_defs.h"
+#include "h_extern.h"
+#include "trace.h"
+#include "secure_arena.h"
+#include "soft_keypool.h"
+
+static const CK_BYTE default_publ_exp[] = { 0x01, 0x00, 0x01 };
+
+CK_RV soft_keypool_init(struct soft_keypool *pool)
+{
+    memset(pool, 0, sizeof(*pool));
+
+    if (pthread_mutex_init(&pool->mutex, NULL) != 0) {
+        TRACE_ERROR("Initializing the keygen pool mutex failed.\n");
+        return CKR_CANT_LOCK;
+    }
+    if (pthread_cond_init(&pool->refill, NULL) != 0) {
+        TRACE_ERROR("Initializing the keygen pool condition failed.\n");
+        pthread_mutex_destroy(&pool->mutex);
+        return CKR_CANT_LOCK;
+    }
+
+    pool->size = SOFT_KEYPOOL_DEFAULT_SIZE;
+    pool->num_threads = SOFT_KEYPOOL_DEFAULT_THREADS;
+
+    return CKR_OK;
+}
+
+static struct soft_keypool_entry *soft_keypool_new_entry(
+                                                struct soft_keypool *pool)
+{
+    if (pool->num_entries >= SOFT_KEYPOOL_MAX_ENTRIES) {
+        TRACE_ERROR("Too many keygen pool entries, at most %u are allowed\n",
+                    SOFT_KEYPOOL_MAX_ENTRIES);
+        return NULL;
+    }
+
+    return &pool->entries[pool->num_entries++];
+}
+
+CK_RV soft_keypool_add_rsa(struct soft_keypool *pool, CK_ULONG mod_bits)
+{
+    struct soft_keypool_entry *entry;
+
+    entry = soft_keypool_new_entry(pool);
+    if (entry == NULL)
+        return CKR_FUNCTION_FAILED;
+
+    entry->key_type = CKK_RSA;
+    entry->mod_bits = mod_bits;
+
+    return CKR_OK;
+}
+
+CK_RV soft_keypool_add_ec(struct soft_keypool *pool, int nid)
+{
+    struct soft_keypool_entry *entry;
+    const ASN1_OBJECT *obj;
+    unsigned char *p;
+    int len;
+
+    obj = OBJ_nid2obj(nid);
+    if (obj == NULL || (len = i2d_ASN1_OBJECT(obj, NULL)) <= 0) {
+        TRACE_ERROR("Curve %d not supported by OpenSSL.\n", nid);
+        return CKR_CURVE_NOT_SUPPORTED;
+    }
+
+    entry = soft_keypool_new_entry(pool);
+    if (entry == NULL)
+        return CKR_FUNCTION_FAILED;
+
+    entry->params = malloc(len);
+    if (entry->params == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
+        pool->num_entries--;
+        return CKR_HOST_MEMORY;
+    }
+    p = entry->params;
+    entry->params_len = i2d_ASN1_OBJECT(obj, &p);
+    entry->key_type = CKK_EC;
+    entry->nid = nid;
+
+    return CKR_OK;
+}
+
+static CK_RV soft_keypool_generate(struct soft_keypool_entry *entry,
+                                   EVP_PKEY **pkey)
+{
+    switch (entry->key_type) {
+    case CKK_RSA:
+        return openssl_specific_rsa_generate_pkey(entry->mod_bits,
+                                                  default_publ_exp,
+                                                  sizeof(default_publ_exp),
+                                                  pkey);
+    case CKK_EC:
+        return openssl_specific_ec_generate_pkey(entry->nid, pkey);
+    default:
+        return CKR_KEY_TYPE_INCONSISTENT;
+    }
+}
+
+/*
+ * Move a generated key into a block of the secure arena, DER encoded. The
+ * key is freed in any case. Returns NULL if the arena is full.
+ */
+static CK_BYTE *soft_keypool_store(EVP_PKEY *pkey, CK_ULONG *len)
+{
+    CK_BYTE *der = NULL, *p;
+    int der_len;
+
+    der_len = i2d_PrivateKey(pkey, NULL);
+    if (der_len <= 0) {
+        TRACE_ERROR("i2d_PrivateKey failed\n");
+        goto out;
+    }
+
+    der = secure_arena_alloc(der_len);
+    if (der == NULL)
+        goto out;
+
+    p = der;
+    if (i2d_PrivateKey(pkey, &p) != der_len) {
+        TRACE_ERROR("i2d_PrivateKey failed\n");
+        secure_arena_free(der);
+        der = NULL;
+        goto out;
+    }
+    *len = der_len;
+
+out:
+    EVP_PKEY_free(pkey);
+    return der;
+}
+
+/* Decode a queued key and release its arena block. */
+static EVP_PKEY *soft_keypool_load(struct soft_keypool_entry *entry,
+                                   CK_BYTE *der, CK_ULONG len)
+{
+    const unsigned char *p = der;
+    EVP_PKEY *pkey;
+
+    pkey = d2i_PrivateKey(entry->key_type == CKK_RSA ?
+                                            EVP_PKEY_RSA : EVP_PKEY_EC,
+                          NULL, &p, len);
+    if (pkey == NULL)
+        TRACE_ERROR("d2i_PrivateKey failed\n");
+
+    secure_arena_free(der);
+
+    return pkey;
+}
+
+/*
+ * Return the entry that most needs to be refilled, or NULL if all queues are
+ * full or about to be. Must be called with the pool mutex held.
+ */
+static struct soft_keypool_entry *soft_keypool_next_entry(
+                                                struct soft_keypool *pool)
+{
+    struct soft_keypool_entry *entry, *next = NULL;
+    unsigned int i;
+
+    for (i = 0; i < pool->num_entries; i++) {
+        entry = &pool->entries[i];
+        if (entry->disabled || entry->arena_full ||
+            entry->count + entry->pending >= pool->size)
+            continue;
+        if (next == NULL ||
+            entry->count + entry->pending < next->count + next->pending)
+            next = entry;
+    }
+
+    return next;
+}
+
+static void *soft_keypool_worker(void *arg)
+{
+    struct soft_keypool *pool = arg;
+    struct soft_keypool_entry *entry;
+    EVP_PKEY *pkey;
+    CK_BYTE *der;
+    CK_ULONG der_len = 0;
+    CK_RV rc;
+#if OPENSSL_VERSION_PREREQ(3, 0)
+    OSSL_LIB_CTX *prev_libctx;
+
+    /* Generate the keys within the library context of the token */
+    prev_libctx = OSSL_LIB_CTX_set0_default(pool->libctx);
+    if (prev_libctx == NULL) {
+        TRACE_ERROR("OSSL_LIB_CTX_set0_default failed\n");
+        return NULL;
+    }
+#endif
+
+    pthread_mutex_lock(&pool->mutex);
+    while (!pool->stop) {
+        entry = soft_keypool_next_entry(pool);
+        if (entry == NULL) {
+            pthread_cond_wait(&pool->refill, &pool->mutex);
+            continue;
+        }
+
+        entry->pending++;
+        pthread_mutex_unlock(&pool->mutex);
+
+        pkey = NULL;
+        der = NULL;
+        rc = soft_keypool_generate(entry, &pkey);
+        if (rc == CKR_OK)
+            der = soft_keypool_store(pkey, &der_len);
+
+        pthread_mutex_lock(&pool->mutex);
+        entry->pending--;
+
+        if (rc != CKR_OK) {
+            TRACE_ERROR("Keygen pool: generating a key failed, rc=0x%lx, "
+                        "entry disabled\n", rc);
+            entry->disabled = TRUE;
+            continue;
+        }
+
+        if (der == NULL) {
+            TRACE_DEVEL("Keygen pool: secure arena full, refill paused\n");
+            entry->arena_full = TRUE;
+            continue;
+        }
+
+        if (pool->stop) {
+            secure_arena_free(der);
+            break;
+        }
+
+        entry->keys[(entry->head + entry->count) % pool->size] = der;
+        entry->key_lens[(entry->head + entry->count) % pool->size] = der_len;
+        entry->count++;
+    }
+    pthread_mutex_unlock(&pool->mutex);
+
+#if OPENSSL_VERSION_PREREQ(3, 0)
+    OSSL_LIB_CTX_set0_default(prev_libctx);
+#endif
+
+    return NULL;
+}
+
+/*
+ * Start the worker threads. This is deferred until the first key is
+ * requested, so that processes that never generate keys do not spend any
+ * CPU time on filling the pool. Must be called with the pool mutex held.
+ */
+static void soft_keypool_start(struct soft_keypool *pool)
+{
+    unsigned int i;
+    int rc;
+
+    pool->started = TRUE;
+
+#if OPENSSL_VERSION_PREREQ(3, 0)
+    /* The caller runs within Opencryptoki's own library context */
+    pool->libctx = OSSL_LIB_CTX_set0_default(NULL);
+#endif
+
+    for (i = 0; i < pool->num_threads; i++) {
+        rc = pthread_create(&pool->threads[i], NULL, soft_keypool_worker,
+                            pool);
+        if (rc != 0) {
+            TRACE_ERROR("Failed to start keygen pool thread, errno=%d\n", rc);
+            break;
+        }
+        pool->running++;
+    }
+
+    TRACE_DEVEL("Keygen pool: %u worker threads started\n", pool->running);
+}
+
+static EVP_PKEY *soft_keypool_get(struct soft_keypool *pool,
+                                  struct soft_keypool_entry *entry)
+{
+    CK_BYTE *der = NULL;
+    CK_ULONG der_len = 0;
+
+    pthread_mutex_lock(&pool->mutex);
+
+    if (!pool->started)
+        soft_keypool_start(pool);
+
+    if (entry->count > 0) {
+        der = entry->keys[entry->head];
+        der_len = entry->key_lens[entry->head];
+        entry->keys[entry->head] = NULL;
+        entry->head = (entry->head + 1) % pool->size;
+        entry->count--;
+        entry->hits++;
+    } else {
+        entry->misses++;
+    }
+    /* Arena space may have been released meanwhile, try again */
+    entry->arena_full = FALSE;
+
+    pthread_cond_signal(&pool->refill);
+    pthread_mutex_unlock(&pool->mutex);
+
+    if (der == NULL)
+        return NULL;
+
+    return soft_keypool_load(entry, der, der_len);
+}
+
+EVP_PKEY *soft_keypool_get_rsa(struct soft_keypool *pool, CK_ULONG mod_bits,
+                               const CK_BYTE *publ_exp, CK_ULONG publ_exp_len)
+{
+    unsigned int i;
+
+    /* Only keys with the default public exponent are pre-generated */
+    while (publ_exp_len > 0 && *publ_exp == 0) {
+        publ_exp++;
+        publ_exp_len--;
+    }
+    if (publ_exp_len != sizeof(default_publ_exp) ||
+        memcmp(publ_exp, default_publ_exp, publ_exp_len) != 0)
+        return NULL;
+
+    for (i = 0; i < pool->num_entries; i++) {
+        if (pool->entries[i].key_type == CKK_RSA &&
+            pool->entries[i].mod_bits == mod_bits)
+            return soft_keypool_get(pool, &pool->entries[i]);
+    }
+
+    return NULL;
+}
+
+EVP_PKEY *soft_keypool_get_ec(struct soft_keypool *pool,
+                              const CK_BYTE *params, CK_ULONG params_len)
+{
+    unsigned int i;
+
+    for (i = 0; i < pool->num_entries; i++) {
+        if (pool->entries[i].key_type == CKK_EC &&
+            pool->entries[i].params_len == params_len &&
+            memcmp(pool->entries[i].params, params, params_len) == 0)
+            return soft_keypool_get(pool, &pool->entries[i]);
+    }
+
+    return NULL;
+}
+
+/*
+ * Get the size, fill level and hit rate of the pool entry with the given
+ * index. Returns CKR_ARGUMENTS_BAD if there is no such entry.
+ */
+CK_RV soft_keypool_get_stats(struct soft_keypool *pool, unsigned int index,
+                            struct soft_keypool_stats *stats)
+{
+    struct soft_keypool_entry *entry;
+    unsigned long total;
+
+    if (index >= pool->num_entries)
+        return CKR_ARGUMENTS_BAD;
+
+    pthread_mutex_lock(&pool->mutex);
+
+    entry = &pool->entries[index];
+    total = entry->hits + entry->misses;
+
+    stats->key_type = entry->key_type;
+    stats->mod_bits = entry->mod_bits;
+    stats->nid = entry->nid;
+    stats->size = pool->size;
+    stats->ready = entry->count;
+    stats->hits = entry->hits;
+    stats->misses = entry->misses;
+    stats->hit_rate = total > 0 ? entry->hits * 100 / total : 0;
+
+    pthread_mutex_unlock(&pool->mutex);
+
+    return CKR_OK;
+}
+
+static void soft_keypool_trace_stats(struct soft_keypool *pool)
+{
+    struct soft_keypool_stats stats;
+    unsigned int i;
+
+    for (i = 0; i < pool->num_entries; i++) {
+        if (soft_keypool_get_stats(pool, i, &stats) != CKR_OK)
+            break;
+
+        if (stats.key_type == CKK_RSA)
+            TRACE_INFO("Keygen pool RSA %lu: size %u ready %u hits %lu "
+                       "misses %lu hit rate %u%%\n", stats.mod_bits,
+                       stats.size, stats.ready, stats.hits, stats.misses,
+                       stats.hit_rate);
+        else
+            TRACE_INFO("Keygen pool EC %s: size %u ready %u hits %lu "
+                       "misses %lu hit rate %u%%\n", OBJ_nid2sn(stats.nid),
+                       stats.size, stats.ready, stats.hits, stats.misses,
+                       stats.hit_rate);
+    }
+}
+
+void soft_keypool_final(struct soft_keypool *pool,
+                        CK_BBOOL in_fork_initializer)
+{
+    struct soft_keypool_entry *entry;
+    unsigned int i, k;
+
+    /*
+     * In the child after a fork the worker threads do not exist, and the
+     * mutex may have been held by one of them, so neither is touched.
+     */
+    if (!in_fork_initializer) {
+        pthread_mutex_lock(&pool->mutex);
+        pool->stop = TRUE;
+        pthread_cond_broadcast(&pool->refill);
+        pthread_mutex_unlock(&pool->mutex);
+
+        for (i = 0; i < pool->running; i++)
+            pthread_join(pool->threads[i], NULL);
+
+        soft_keypool_trace_stats(pool);
+    }
+    pool->running = 0;
+
+    for (i = 0; i < pool->num_entries; i++) {
+        entry = &pool->entries[i];
+        for (k = 0; k < entry->count; k++)
+            secure_arena_free(entry->keys[(entry->head + k) % pool->size]);
+        free(entry->params);
+    }
+    pool->num_entries = 0;
+
+    if (!in_fork_initializer) {
+        pthread_cond_destroy(&pool->refill);
+        pthread_mutex_destroy(&pool->mutex);
+    }
+}
+
+/*
+ * Reset the pool in a forked child that keeps the token state of its parent.
+ * The parent may hand out the queued keys as well, so they are discarded.
+ * The worker threads do not exist in the child, they are started again on the
+ * next key request.
+ */
+void soft_keypool_fork_child(struct soft_keypool *pool)
+{
+    struct soft_keypool_entry *entry;
+    unsigned int i, k;
+
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->refill, NULL);
+
+    for (i = 0; i < pool->num_entries; i++) {
+        entry = &pool->entries[i];
+        for (k = 0; k < entry->count; k++) {
+            secure_arena_free(entry->keys[(entry->head + k) % pool->size]);
+            entry->keys[(entry->head + k) % pool->size] = NULL;
+        }
+        entry->head = 0;
+        entry->count = 0;
+        entry->pending = 0;
+        entry->arena_full = FALSE;
+        entry->hits = 0;
+        entry->misses = 0;
+    }
+
+    pool->running = 0;
+    pool->started = FALSE;
+    pool->stop = FALSE;
+}
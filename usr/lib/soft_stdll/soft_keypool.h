@@ -0,0 +1,101 @@
+/*
+ * COPYRIGHT (c) International Business Machines Corp. 2024
+ *
+ * This program is provided under the terms of the Common Public License,
+ * version 1.0 (CPL-1.0). Any use, reproduction or distribution for this
+ * software constitutes recipient's acceptance of CPL-1.0 terms which can be
+ * found in the file LICENSE file or at
+ * https://opensource.org/licenses/cpl1.0.php
+ */
+
+/*
+ * Background key pair pre-generation for the soft token.
+ *
+ * For each configured RSA modulus size or EC curve the pool keeps a queue of
+ * ready generated keys. Worker threads refill the queues in the background,
+ * so that C_GenerateKeyPair only has to take a key from the queue and build
+ * the key objects from it. Requests that do not match a configured entry, or
+ * find its queue empty, generate the key synchronously as before.
+ *
+ * The queued keys are kept DER encoded in the locked secure arena, and are
+ * decoded when they are taken from the queue. If the arena is full, an entry
+ * is not refilled until it is requested again.
+ */
+
+#ifndef SOFT_KEYPOOL_H
+#define SOFT_KEYPOOL_H
+
+#include <pthread.h>
+
+#include <openssl/evp.h>
+
+#include "pkcs11types.h"
+#include "defs.h"
+
+#define SOFT_KEYPOOL_MAX_ENTRIES        8
+#define SOFT_KEYPOOL_MAX_SIZE           64
+#define SOFT_KEYPOOL_MAX_THREADS        16
+#define SOFT_KEYPOOL_DEFAULT_SIZE       8
+#define SOFT_KEYPOOL_DEFAULT_THREADS    1
+
+struct soft_keypool_entry {
+    CK_KEY_TYPE key_type;
+    CK_ULONG mod_bits;              /* CKK_RSA only */
+    int nid;                        /* CKK_EC only */
+    CK_BYTE *params;                /* CKK_EC only: DER encoded curve OID */
+    CK_ULONG params_len;
+    CK_BYTE *keys[SOFT_KEYPOOL_MAX_SIZE];   /* DER, in the secure arena */
+    CK_ULONG key_lens[SOFT_KEYPOOL_MAX_SIZE];
+    unsigned int head;
+    unsigned int count;             /* ready keys in the queue */
+    unsigned int pending;           /* keys currently being generated */
+    CK_BBOOL disabled;              /* generation failed, no longer refilled */
+    CK_BBOOL arena_full;            /* not refilled until requested again */
+    unsigned long hits;
+    unsigned long misses;
+};
+
+struct soft_keypool_stats {
+    CK_KEY_TYPE key_type;
+    CK_ULONG mod_bits;              /* CKK_RSA only */
+    int nid;                        /* CKK_EC only */
+    unsigned int size;              /* queue depth */
+    unsigned int ready;             /* ready keys in the queue */
+    unsigned long hits;
+    unsigned long misses;
+    unsigned int hit_rate;          /* percent of requests served */
+};
+
+struct soft_keypool {
+    pthread_mutex_t mutex;
+    pthread_cond_t refill;
+    unsigned int size;              /* queue depth per entry */
+    unsigned int num_threads;
+    pthread_t threads[SOFT_KEYPOOL_MAX_THREADS];
+    unsigned int running;           /* number of started worker threads */
+    CK_BBOOL started;
+    CK_BBOOL stop;
+#if OPENSSL_VERSION_PREREQ(3, 0)
+    OSSL_LIB_CTX *libctx;
+#endif
+    struct soft_keypool_entry entries[SOFT_KEYPOOL_MAX_ENTRIES];
+    unsigned int num_entries;
+};
+
+CK_RV soft_keypool_init(struct soft_keypool *pool);
+CK_RV soft_keypool_add_rsa(struct soft_keypool *pool, CK_ULONG mod_bits);
+CK_RV soft_keypool_add_ec(struct soft_keypool *pool, int nid);
+
+EVP_PKEY *soft_keypool_get_rsa(struct soft_keypool *pool, CK_ULONG mod_bits,
+                               const CK_BYTE *publ_exp, CK_ULONG publ_exp_len);
+EVP_PKEY *soft_keypool_get_ec(struct soft_keypool *pool,
+                              const CK_BYTE *params, CK_ULONG params_len);
+
+CK_RV soft_keypool_get_stats(struct soft_keypool *pool, unsigned int index,
+                            struct soft_keypool_stats *stats);
+
+void soft_keypool_final(struct soft_keypool *pool,
+                        CK_BBOOL in_fork_initializer);
+void soft_keypool_fork_child(struct soft_keypool *pool);
+
+#endif
@@ -21,8 +21,11 @@
 
 #include <pthread.h>
 #include <string.h>             // for memcmp() et al
+#include <strings.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <limits.h>
+#include <syslog.h>
 
 #include <openssl/opensslv.h>
 
@@ -34,6 +37,10 @@
 #include "tok_specific.h"
 #include "tok_struct.h"
 #include "trace.h"
+#include "ock_syslog.h"
+#include "cfgparser.h"
+#include "configuration.h"
+#include "soft_keypool.h"
 
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -46,6 +53,9 @@
 #include <openssl/crypto.h>
 #include <openssl/bn.h>
 #include <openssl/err.h>
+#include <openssl/rsa.h>
+#include <openssl/ec.h>
+#include <openssl/objects.h>
 #if OPENSSL_VERSION_PREREQ(3, 0)
 #include <openssl/core_names.h>
 #include <openssl/param_build.h>
@@ -53,6 +63,19 @@
 
 #define MAX_GENERIC_KEY_SIZE 256
 
+#define SOFT_CFG_KEYGEN_POOL    "KEYGEN_POOL"
+#define SOFT_CFG_SIZE           "SIZE"
+#define SOFT_CFG_THREADS        "THREADS"
+#define SOFT_CFG_RSA            "RSA"
+#define SOFT_CFG_EC             "EC"
+#define SOFT_CFG_SAVEABLE_STATE "SAVEABLE_DIGEST_STATE"
+#define SOFT_CFG_LOGIN_BROKER   "LOGIN_BROKER"
+
+struct soft_private_data {
+    struct soft_keypool keypool;
+    CK_BBOOL keypool_enabled;
+};
+
 const char manuf[] = "IBM";
 const char model[] = "Soft";
 const char descr[] = "IBM Soft token";
@@ -70,22 +93,35 @@ static const MECH_LIST_ELEMENT soft_mech_list[] = {
 #endif
     {CKM_RSA_PKCS,
      {512, 4096, CKF_ENCRYPT | CKF_DECRYPT | CKF_WRAP | CKF_UNWRAP | CKF_SIGN |
-      CKF_VERIFY | CKF_SIGN_RECOVER | CKF_VERIFY_RECOVER}},
-    {CKM_SHA1_RSA_PKCS, {512, 4096, CKF_SIGN | CKF_VERIFY}},
-    {CKM_SHA224_RSA_PKCS, {512, 4096, CKF_SIGN|CKF_VERIFY}},
-    {CKM_SHA256_RSA_PKCS, {512, 4096, CKF_SIGN | CKF_VERIFY}},
-    {CKM_SHA384_RSA_PKCS, {512, 4096, CKF_SIGN | CKF_VERIFY}},
-    {CKM_SHA512_RSA_PKCS, {512, 4096, CKF_SIGN | CKF_VERIFY}},
-    {CKM_RSA_PKCS_PSS, {512, 4096, CKF_SIGN | CKF_VERIFY}},
-    {CKM_SHA1_RSA_PKCS_PSS, {512, 4096, CKF_SIGN | CKF_VERIFY}},
-    {CKM_SHA224_RSA_PKCS_PSS, {512, 4096, CKF_SIGN|CKF_VERIFY}},
-    {CKM_SHA256_RSA_PKCS_PSS, {512, 4096, CKF_SIGN | CKF_VERIFY}},
-    {CKM_SHA384_RSA_PKCS_PSS, {512, 4096, CKF_SIGN | CKF_VERIFY}},
-    {CKM_SHA512_RSA_PKCS_PSS, {512, 4096, CKF_SIGN | CKF_VERIFY}},
+      CKF_VERIFY | CKF_SIGN_RECOVER | CKF_VERIFY_RECOVER | CKF_MESSAGE_SIGN |
+      CKF_MESSAGE_VERIFY}},
+    {CKM_SHA1_RSA_PKCS, {512, 4096, CKF_SIGN | CKF_VERIFY |
+                         CKF_MESSAGE_SIGN | CKF_MESSAGE_VERIFY}},
+    {CKM_SHA224_RSA_PKCS, {512, 4096, CKF_SIGN | CKF_VERIFY |
+                           CKF_MESSAGE_SIGN | CKF_MESSAGE_VERIFY}},
+    {CKM_SHA256_RSA_PKCS, {512, 4096, CKF_SIGN | CKF_VERIFY |
+                           CKF_MESSAGE_SIGN | CKF_MESSAGE_VERIFY}},
+    {CKM_SHA384_RSA_PKCS, {512, 4096, CKF_SIGN | CKF_VERIFY |
+                           CKF_MESSAGE_SIGN | CKF_MESSAGE_VERIFY}},
+    {CKM_SHA512_RSA_PKCS, {512, 4096, CKF_SIGN | CKF_VERIFY |
+                           CKF_MESSAGE_SIGN | CKF_MESSAGE_VERIFY}},
+    {CKM_RSA_PKCS_PSS, {512, 4096, CKF_SIGN | CKF_VERIFY |
+                        CKF_MESSAGE_SIGN | CKF_MESSAGE_VERIFY}},
+    {CKM_SHA1_RSA_PKCS_PSS, {512, 4096, CKF_SIGN | CKF_VERIFY |
+                             CKF_MESSAGE_SIGN | CKF_MESSAGE_VERIFY}},
+    {CKM_SHA224_RSA_PKCS_PSS, {512, 4096, CKF_SIGN | CKF_VERIFY |
+                               CKF_MESSAGE_SIGN | CKF_MESSAGE_VERIFY}},
+    {CKM_SHA256_RSA_PKCS_PSS, {512, 4096, CKF_SIGN | CKF_VERIFY |
+                               CKF_MESSAGE_SIGN | CKF_MESSAGE_VERIFY}},
+    {CKM_SHA384_RSA_PKCS_PSS, {512, 4096, CKF_SIGN | CKF_VERIFY |
+                               CKF_MESSAGE_SIGN | CKF_MESSAGE_VERIFY}},
+    {CKM_SHA512_RSA_PKCS_PSS, {512, 4096, CKF_SIGN | CKF_VERIFY |
+                               CKF_MESSAGE_SIGN | CKF_MESSAGE_VERIFY}},
 #if !(NOX509)
     {CKM_RSA_X_509,
      {512, 4096, CKF_ENCRYPT | CKF_DECRYPT | CKF_WRAP | CKF_UNWRAP | CKF_SIGN |
-      CKF_VERIFY | CKF_SIGN_RECOVER | CKF_VERIFY_RECOVER}},
+      CKF_VERIFY | CKF_SIGN_RECOVER | CKF_VERIFY_RECOVER | CKF_MESSAGE_SIGN |
+      CKF_MESSAGE_VERIFY}},
 #endif
     {CKM_RSA_PKCS_OAEP,
      {512, 4096, CKF_ENCRYPT | CKF_DECRYPT | CKF_WRAP | CKF_UNWRAP}},
@@ -198,7 +234,8 @@ static const MECH_LIST_ELEMENT soft_mech_list[] = {
     {CKM_AES_CFB8, {16, 32, CKF_ENCRYPT | CKF_DECRYPT | CKF_WRAP | CKF_UNWRAP}},
     {CKM_AES_CFB128, {16, 32, CKF_ENCRYPT | CKF_DECRYPT | CKF_WRAP | CKF_UNWRAP}},
 #endif
-    {CKM_AES_GCM, {16, 32, CKF_ENCRYPT | CKF_DECRYPT}},
+    {CKM_AES_GCM, {16, 32, CKF_ENCRYPT | CKF_DECRYPT |
+                           CKF_MESSAGE_ENCRYPT | CKF_MESSAGE_DECRYPT}},
     {CKM_AES_MAC, {16, 32, CKF_HW | CKF_SIGN | CKF_VERIFY}},
     {CKM_AES_MAC_GENERAL, {16, 32, CKF_HW | CKF_SIGN | CKF_VERIFY}},
     {CKM_AES_CMAC, {16, 32, CKF_SIGN | CKF_VERIFY}},
@@ -209,17 +246,17 @@ static const MECH_LIST_ELEMENT soft_mech_list[] = {
     {CKM_EC_KEY_PAIR_GEN, {160, 521, CKF_GENERATE_KEY_PAIR |
                            CKF_EC_NAMEDCURVE | CKF_EC_F_P}},
     {CKM_ECDSA, {160, 521, CKF_SIGN | CKF_VERIFY | CKF_EC_NAMEDCURVE |
-                 CKF_EC_F_P}},
+                 CKF_EC_F_P | CKF_MESSAGE_SIGN | CKF_MESSAGE_VERIFY}},
     {CKM_ECDSA_SHA1, {160, 521, CKF_SIGN | CKF_VERIFY | CKF_EC_NAMEDCURVE |
-                      CKF_EC_F_P}},
+                      CKF_EC_F_P | CKF_MESSAGE_SIGN | CKF_MESSAGE_VERIFY}},
     {CKM_ECDSA_SHA224, {160, 521, CKF_SIGN | CKF_VERIFY | CKF_EC_NAMEDCURVE |
-                        CKF_EC_F_P}},
+                        CKF_EC_F_P | CKF_MESSAGE_SIGN | CKF_MESSAGE_VERIFY}},
     {CKM_ECDSA_SHA256, {160, 521, CKF_SIGN | CKF_VERIFY | CKF_EC_NAMEDCURVE |
-                        CKF_EC_F_P}},
+                        CKF_EC_F_P | CKF_MESSAGE_SIGN | CKF_MESSAGE_VERIFY}},
     {CKM_ECDSA_SHA384, {160, 521, CKF_SIGN | CKF_VERIFY | CKF_EC_NAMEDCURVE |
-                        CKF_EC_F_P}},
+                        CKF_EC_F_P | CKF_MESSAGE_SIGN | CKF_MESSAGE_VERIFY}},
     {CKM_ECDSA_SHA512, {160, 521, CKF_SIGN | CKF_VERIFY | CKF_EC_NAMEDCURVE |
-                        CKF_EC_F_P}},
+                        CKF_EC_F_P | CKF_MESSAGE_SIGN | CKF_MESSAGE_VERIFY}},
     {CKM_ECDH1_DERIVE, {160, 521, CKF_DERIVE | CKF_EC_NAMEDCURVE | CKF_EC_F_P}},
 #endif
 };
@@ -227,38 +264,254 @@ static const MECH_LIST_ELEMENT soft_mech_list[] = {
 static const CK_ULONG soft_mech_list_len =
                     (sizeof(soft_mech_list) / sizeof(MECH_LIST_ELEMENT));
 
+static CK_RV soft_config_parse_keygen_pool(STDLL_TokData_t *tokdata,
+                                           const char *fname,
+                                           struct ConfigStructNode *pool_node)
+{
+    struct soft_private_data *soft_data = tokdata->private_data;
+    struct soft_keypool *pool = &soft_data->keypool;
+    struct ConfigBaseNode *c;
+    unsigned long val;
+    char *str;
+    int i, nid;
+    CK_RV rc;
+
+    confignode_foreach(c, pool_node->value, i) {
+        TRACE_DEBUG("Config node: '%s' type: %u line: %u\n",
+                    c->key, c->type, c->line);
+
+        if (confignode_hastype(c, CT_EOC))
+            continue;
+
+        if (strcasecmp(c->key, SOFT_CFG_SIZE) == 0 &&
+            confignode_hastype(c, CT_INTVAL)) {
+            val = confignode_to_intval(c)->value;
+            if (val < 1 || val > SOFT_KEYPOOL_MAX_SIZE)
+                goto invalid;
+            pool->size = val;
+            continue;
+        }
+
+        if (strcasecmp(c->key, SOFT_CFG_THREADS) == 0 &&
+            confignode_hastype(c, CT_INTVAL)) {
+            val = confignode_to_intval(c)->value;
+            if (val < 1 || val > SOFT_KEYPOOL_MAX_THREADS)
+                goto invalid;
+            pool->num_threads = val;
+            continue;
+        }
+
+        if (strcasecmp(c->key, SOFT_CFG_RSA) == 0 &&
+            confignode_hastype(c, CT_INTVAL)) {
+            val = confignode_to_intval(c)->value;
+            if (val < 512 || val > OPENSSL_RSA_MAX_MODULUS_BITS)
+                goto invalid;
+            rc = soft_keypool_add_rsa(pool, val);
+            if (rc != CKR_OK)
+                goto invalid;
+            continue;
+        }
+
+        if (strcasecmp(c->key, SOFT_CFG_EC) == 0 &&
+            (str = confignode_getstr(c)) != NULL) {
+            nid = OBJ_sn2nid(str);
+            if (nid == NID_undef)
+                nid = EC_curve_nist2nid(str);
+            if (nid == NID_undef)
+                goto invalid;
+            rc = soft_keypool_add_ec(pool, nid);
+            if (rc != CKR_OK)
+                goto invalid;
+            continue;
+        }
+
+        OCK_SYSLOG(LOG_ERR, "Error parsing config file '%s': unexpected token "
+                   "'%s' at line %d\n", fname, c->key, c->line);
+        TRACE_ERROR("Error parsing config file '%s': unexpected token '%s' "
+                    "at line %d\n", fname, c->key, c->line);
+        return CKR_FUNCTION_FAILED;
+    }
+
+    soft_data->keypool_enabled = (pool->num_entries > 0);
+
+    return CKR_OK;
+
+invalid:
+    OCK_SYSLOG(LOG_ERR, "Error parsing config file '%s': invalid value for "
+               "'%s' at line %d\n", fname, c->key, c->line);
+    TRACE_ERROR("Error parsing config file '%s': invalid value for '%s' "
+                "at line %d\n", fname, c->key, c->line);
+    return CKR_FUNCTION_FAILED;
+}
+
+static void soft_config_parse_error(int line, int col, const char *msg)
+{
+    OCK_SYSLOG(LOG_ERR, "Error parsing config file: line %d column %d: %s\n",
+               line, col, msg);
+    TRACE_ERROR("Error parsing config file: line %d column %d: %s\n", line, col,
+                msg);
+}
+
+static CK_RV soft_load_config_file(STDLL_TokData_t *tokdata, char *conf_name)
+{
+    char fname[PATH_MAX];
+    FILE *file;
+    struct ConfigBaseNode *c, *config = NULL;
+    struct ConfigStructNode *struct_node;
+    CK_RV rc = CKR_OK;
+    int ret, i;
+
+    if (conf_name == NULL || strlen(conf_name) == 0)
+        return CKR_OK;
+
+    if (conf_name[0] == '/') {
+        /* Absolute path name */
+        strncpy(fname, conf_name, sizeof(fname) - 1);
+        fname[sizeof(fname) - 1] = '\0';
+    } else {
+        /* relative path name */
+        snprintf(fname, sizeof(fname), "%s/%s", OCK_CONFDIR, conf_name);
+        fname[sizeof(fname) - 1] = '\0';
+    }
+
+    file = fopen(fname, "r");
+    if (file == NULL) {
+        TRACE_ERROR("%s fopen('%s') failed with errno: %s\n", __func__, fname,
+                    strerror(errno));
+        return CKR_FUNCTION_FAILED;
+    }
+
+    ret = parse_configlib_file(file, &config, soft_config_parse_error, 0);
+    if (ret != 0) {
+        TRACE_ERROR("Error parsing config file '%s'\n", fname);
+        rc = CKR_FUNCTION_FAILED;
+        goto done;
+    }
+
+    confignode_foreach(c, config, i) {
+        TRACE_DEBUG("Config node: '%s' type: %u line: %u\n",
+                    c->key, c->type, c->line);
+
+        if (confignode_hastype(c, CT_FILEVERSION)) {
+            TRACE_DEBUG("Config file version: '%s'\n",
+                        confignode_to_fileversion(c)->base.key);
+            continue;
+        }
+
+        if (confignode_hastype(c, CT_EOC))
+            continue;
+
+        if (confignode_hastype(c, CT_STRUCT)) {
+            struct_node = confignode_to_struct(c);
+            if (strcasecmp(struct_node->base.key, SOFT_CFG_KEYGEN_POOL) == 0) {
+                rc = soft_config_parse_keygen_pool(tokdata, fname,
+                                                   struct_node);
+                if (rc != CKR_OK)
+                    break;
+                continue;
+            }
+        }
+
+        if (confignode_hastype(c, CT_BARECONST) &&
+            strcasecmp(c->key, SOFT_CFG_SAVEABLE_STATE) == 0) {
+            tokdata->saveable_digest_state = TRUE;
+            continue;
+        }
+
+        if (confignode_hastype(c, CT_BARECONST) &&
+            strcasecmp(c->key, SOFT_CFG_LOGIN_BROKER) == 0) {
+            tokdata->use_login_broker = TRUE;
+            continue;
+        }
+
+        OCK_SYSLOG(LOG_ERR, "Error parsing config file '%s': unexpected token "
+                   "'%s' at line %d\n", fname, c->key, c->line);
+        TRACE_ERROR("Error parsing config file '%s': unexpected token '%s' "
+                    "at line %d\n", fname, c->key, c->line);
+        rc = CKR_FUNCTION_FAILED;
+        break;
+    }
+
+done:
+    confignode_deepfree(config);
+    fclose(file);
+
+    return rc;
+}
+
 CK_RV token_specific_init(STDLL_TokData_t *tokdata, CK_SLOT_ID SlotNumber,
                           char *conf_name)
 {
-    UNUSED(conf_name);
+    struct soft_private_data *soft_data;
     CK_RV rc;
 
+    soft_data = calloc(1, sizeof(*soft_data));
+    if (soft_data == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
+        return CKR_HOST_MEMORY;
+    }
+    tokdata->private_data = soft_data;
+
+    rc = soft_keypool_init(&soft_data->keypool);
+    if (rc != CKR_OK)
+        goto error;
+
+    rc = soft_load_config_file(tokdata, conf_name);
+    if (rc != CKR_OK) {
+        soft_keypool_final(&soft_data->keypool, FALSE);
+        goto error;
+    }
+
     rc = ock_generic_filter_mechanism_list(tokdata,
                                            soft_mech_list, soft_mech_list_len,
                                            &(tokdata->mech_list),
                                            &(tokdata->mech_list_len));
     if (rc != CKR_OK) {
         TRACE_ERROR("Mechanism filtering failed!  rc = 0x%lx\n", rc);
-        return rc;
+        soft_keypool_final(&soft_data->keypool, FALSE);
+        goto error;
     }
 
     TRACE_INFO("soft %s slot=%lu running\n", __func__, SlotNumber);
 
     return CKR_OK;
+
+error:
+    free(soft_data);
+    tokdata->private_data = NULL;
+    return rc;
 }
 
 CK_RV token_specific_final(STDLL_TokData_t *tokdata,
-                           CK_BBOOL token_specific_final)
+                           CK_BBOOL in_fork_initializer)
 {
-    UNUSED(token_specific_final);
+    struct soft_private_data *soft_data = tokdata->private_data;
 
     TRACE_INFO("soft %s running\n", __func__);
 
+    if (soft_data != NULL) {
+        soft_keypool_final(&soft_data->keypool, in_fork_initializer);
+        free(soft_data);
+        tokdata->private_data = NULL;
+    }
+
     free(tokdata->mech_list);
     
     return CKR_OK;
 }
 
+CK_RV token_specific_fork_child(STDLL_TokData_t *tokdata)
+{
+    struct soft_private_data *soft_data = tokdata->private_data;
+
+    TRACE_INFO("soft %s running\n", __func__);
+
+    if (soft_data != NULL)
+        soft_keypool_fork_child(&soft_data->keypool);
+
+    return CKR_OK;
+}
+
 CK_RV token_specific_des_key_gen(STDLL_TokData_t *tokdata, CK_BYTE **des_key,
                                  CK_ULONG *len, CK_ULONG keysize,
                                  CK_BBOOL *is_opaque)
@@ -373,9 +626,27 @@ CK_RV token_specific_rsa_generate_keypair(STDLL_TokData_t *tokdata,
                                           TEMPLATE *publ_tmpl,
                                           TEMPLATE *priv_tmpl)
 {
-    UNUSED(tokdata);
+    struct soft_private_data *soft_data = tokdata->private_data;
+    CK_ATTRIBUTE *publ_exp = NULL;
+    CK_ULONG mod_bits;
+    EVP_PKEY *pkey = NULL;
+    CK_RV rc;
+
+    if (soft_data->keypool_enabled &&
+        template_attribute_get_ulong(publ_tmpl, CKA_MODULUS_BITS,
+                                     &mod_bits) == CKR_OK &&
+        template_attribute_get_non_empty(publ_tmpl, CKA_PUBLIC_EXPONENT,
+                                         &publ_exp) == CKR_OK)
+        pkey = soft_keypool_get_rsa(&soft_data->keypool, mod_bits,
+                                    publ_exp->pValue, publ_exp->ulValueLen);
+
+    if (pkey == NULL)
+        return openssl_specific_rsa_keygen(publ_tmpl, priv_tmpl);
 
-    return openssl_specific_rsa_keygen(publ_tmpl, priv_tmpl);
+    rc = openssl_specific_rsa_keygen_from_pkey(pkey, publ_tmpl, priv_tmpl);
+
+    EVP_PKEY_free(pkey);
+    return rc;
 }
 
 CK_RV token_specific_rsa_encrypt(STDLL_TokData_t *tokdata, CK_BYTE *in_data,
@@ -428,6 +699,13 @@ CK_RV token_specific_rsa_verify_recover(STDLL_TokData_t *tokdata,
                                                     openssl_specific_rsa_encrypt);
 }
 
+CK_RV token_specific_msg_sign_key_init(STDLL_TokData_t *tokdata,
+                                       SESSION *sess, SIGN_VERIFY_CONTEXT *ctx,
+                                       CK_OBJECT_HANDLE hkey)
+{
+    return openssl_specific_msg_sign_key_init(tokdata, sess, ctx, hkey);
+}
+
 CK_RV token_specific_rsa_pss_sign(STDLL_TokData_t *tokdata, SESSION *sess,
                                   SIGN_VERIFY_CONTEXT *ctx,
                                   CK_BYTE *in_data, CK_ULONG in_data_len,
@@ -637,6 +915,26 @@ CK_RV token_specific_aes_gcm_final(STDLL_TokData_t *tokdata, SESSION *sess,
                                           out_data_len, encrypt);
 }
 
+CK_RV token_specific_aes_gcm_msg_init(STDLL_TokData_t *tokdata, SESSION *sess,
+                                      ENCR_DECR_CONTEXT *ctx,
+                                      CK_OBJECT_HANDLE key, CK_BYTE encrypt)
+{
+    return openssl_specific_aes_gcm_msg_init(tokdata, sess, ctx, key, encrypt);
+}
+
+CK_RV token_specific_aes_gcm_msg(STDLL_TokData_t *tokdata, SESSION *sess,
+                                 ENCR_DECR_CONTEXT *ctx,
+                                 CK_GCM_MESSAGE_PARAMS *params,
+                                 CK_BYTE *aad, CK_ULONG aad_len,
+                                 CK_BYTE *in_data, CK_ULONG in_data_len,
+                                 CK_BYTE *out_data, CK_ULONG *out_data_len,
+                                 CK_BYTE encrypt)
+{
+    return openssl_specific_aes_gcm_msg(tokdata, sess, ctx, params, aad,
+                                        aad_len, in_data, in_data_len,
+                                        out_data, out_data_len, encrypt);
+}
+
 CK_RV token_specific_aes_mac(STDLL_TokData_t *tokdata, CK_BYTE *message,
                              CK_ULONG message_len, OBJECT *key, CK_BYTE *mac)
 {
@@ -1050,6 +1348,29 @@ CK_RV token_specific_sha_final(STDLL_TokData_t *tokdata, DIGEST_CONTEXT *ctx,
     return openssl_specific_sha_final(tokdata, ctx, out_data, out_data_len);
 }
 
+CK_RV token_specific_sha_stream_init(STDLL_TokData_t *tokdata,
+                                     DIGEST_CONTEXT *ctx, CK_MECHANISM *mech)
+{
+    return openssl_specific_sha_stream_init(tokdata, ctx, mech);
+}
+
+CK_RV token_specific_sha_stream_update(STDLL_TokData_t *tokdata,
+                                       DIGEST_CONTEXT *ctx,
+                                       CK_BYTE *in_data, CK_ULONG in_data_len)
+{
+    return openssl_specific_sha_stream_update(tokdata, ctx, in_data,
+                                              in_data_len);
+}
+
+CK_RV token_specific_sha_stream_final(STDLL_TokData_t *tokdata,
+                                      DIGEST_CONTEXT *ctx,
+                                      CK_BYTE *out_data,
+                                      CK_ULONG *out_data_len)
+{
+    return openssl_specific_sha_stream_final(tokdata, ctx, out_data,
+                                             out_data_len);
+}
+
 CK_RV token_specific_hmac_sign_init(STDLL_TokData_t *tokdata, SESSION *sess,
                                     CK_MECHANISM *mech, CK_OBJECT_HANDLE Hkey)
 {
@@ -1177,7 +1498,25 @@ CK_RV token_specific_ec_generate_keypair(STDLL_TokData_t *tokdata,
                                          TEMPLATE *publ_tmpl,
                                          TEMPLATE *priv_tmpl)
 {
-    return openssl_specific_ec_generate_keypair(tokdata, publ_tmpl, priv_tmpl);
+    struct soft_private_data *soft_data = tokdata->private_data;
+    CK_ATTRIBUTE *attr = NULL;
+    EVP_PKEY *pkey = NULL;
+    CK_RV rc;
+
+    if (soft_data->keypool_enabled &&
+        template_attribute_get_non_empty(publ_tmpl, CKA_ECDSA_PARAMS,
+                                         &attr) == CKR_OK)
+        pkey = soft_keypool_get_ec(&soft_data->keypool, attr->pValue,
+                                   attr->ulValueLen);
+
+    if (pkey == NULL)
+        return openssl_specific_ec_generate_keypair(tokdata, publ_tmpl,
+                                                    priv_tmpl);
+
+    rc = openssl_specific_ec_keygen_from_pkey(pkey, publ_tmpl, priv_tmpl);
+
+    EVP_PKEY_free(pkey);
+    return rc;
 }
 
 CK_RV token_specific_ec_sign(STDLL_TokData_t *tokdata,  SESSION *sess,
@@ -1,6 +1,7 @@
 nobase_lib_LTLIBRARIES += opencryptoki/stdll/libpkcs11_sw.la
 
-noinst_HEADERS += usr/lib/soft_stdll/tok_struct.h
+noinst_HEADERS +=							\
+	usr/lib/soft_stdll/tok_struct.h usr/lib/soft_stdll/soft_keypool.h
 
 opencryptoki_stdll_libpkcs11_sw_la_CFLAGS =				\
 	-DDEV -D_THREAD_SAFE -DSHALLOW=0 -DSWTOK=1 -DLITE=0 -DNOCDMF	\
@@ -8,7 +9,8 @@ opencryptoki_stdll_libpkcs11_sw_la_CFLAGS =				\
 	-DTOK_NEW_DATA_STORE=0x0003000c					\
 	-I${srcdir}/usr/lib/common -I${srcdir}/usr/include		\
 	-DSTDLL_NAME=\"swtok\" -I${top_builddir}/usr/lib/api		\
-	-I${srcdir}/usr/lib/api
+	-I${srcdir}/usr/lib/api -I${top_builddir}/usr/lib/config	\
+	-I${srcdir}/usr/lib/config
 
 opencryptoki_stdll_libpkcs11_sw_la_LDFLAGS =				\
 	-shared -Wl,-z,defs,-Bsymbolic -lc -lpthread -lcrypto -lrt	\
@@ -30,13 +32,16 @@ opencryptoki_stdll_libpkcs11_sw_la_SOURCES =				\
 	usr/lib/common/new_host.c usr/lib/common/obj_mgr.c		\
 	usr/lib/common/object.c usr/lib/common/sign_mgr.c		\
 	usr/lib/common/template.c usr/lib/common/p11util.c		\
+	usr/lib/common/secure_arena.c usr/lib/common/login_broker.c	\
 	usr/lib/common/utility.c usr/lib/common/verify_mgr.c		\
 	usr/lib/common/trace.c usr/lib/common/mech_list.c		\
 	usr/lib/common/shared_memory.c usr/lib/common/profile_obj.c	\
 	usr/lib/soft_stdll/soft_specific.c usr/lib/common/attributes.c	\
 	usr/lib/common/dlist.c usr/lib/common/mech_openssl.c		\
 	usr/lib/common/utility_common.c usr/lib/common/ec_supported.c	\
-	usr/lib/api/policyhelper.c
+	usr/lib/api/policyhelper.c usr/lib/soft_stdll/soft_keypool.c	\
+	usr/lib/config/configuration.c usr/lib/config/cfgparse.y	\
+	usr/lib/config/cfglex.l
 
 if ENABLE_LOCKS
 opencryptoki_stdll_libpkcs11_sw_la_SOURCES +=				\
@@ -68,6 +68,7 @@ token_spec_t token_specific = {
     NULL,                       // save_token_data
     NULL,                       // random number generator
     &token_specific_final,
+    &token_specific_fork_child,
     NULL,                       // init_token
     NULL,                       // login
     NULL,                       // logout
@@ -100,6 +101,7 @@ token_spec_t token_specific = {
     &token_specific_rsa_pss_sign,
     &token_specific_rsa_pss_verify,
     &token_specific_rsa_generate_keypair,
+    &token_specific_msg_sign_key_init,
 #ifndef NO_EC
     // Elliptic Curve
     &token_specific_ec_sign,
@@ -126,6 +128,9 @@ token_spec_t token_specific = {
     &token_specific_sha,
     &token_specific_sha_update,
     &token_specific_sha_final,
+    &token_specific_sha_stream_init,
+    &token_specific_sha_stream_update,
+    &token_specific_sha_stream_final,
     // HMAC
     &token_specific_hmac_sign_init,
     &token_specific_hmac_sign,
@@ -146,6 +151,8 @@ token_spec_t token_specific = {
     &token_specific_aes_gcm,
     &token_specific_aes_gcm_update,
     &token_specific_aes_gcm_final,
+    &token_specific_aes_gcm_msg_init,
+    &token_specific_aes_gcm_msg,
     &token_specific_aes_ofb,
     &token_specific_aes_cfb,
     &token_specific_aes_mac,
@@ -159,6 +166,8 @@ token_spec_t token_specific = {
     NULL,                       // aes_gcm
     NULL,                       // aes_gcm_update
     NULL,                       // aes_gcm_final
+    NULL,                       // aes_gcm_msg_init
+    NULL,                       // aes_gcm_msg
     NULL,                       // aes_mac
     NULL,                       // aes_cmac
     NULL,                       // aes_ofb
@@ -41,6 +41,7 @@ struct token_specific_struct token_specific = {
     NULL,                       // save_token_data
     &token_specific_rng,
     &token_specific_final,
+    NULL,                       // fork_child
     &token_specific_init_token,
     &token_specific_login,
     &token_specific_logout,
@@ -73,6 +74,7 @@ struct token_specific_struct token_specific = {
     NULL,                       // rsa_pss_sign
     NULL,                       // rsa_pss_verify
     &token_specific_rsa_generate_keypair,
+    NULL,                       // msg_sign_key_init
     // Elliptic Curve
     NULL,                       // ec_sign
     NULL,                       // ec_verify
@@ -85,6 +87,9 @@ struct token_specific_struct token_specific = {
     NULL,                       // sha
     NULL,                       // sha_update
     NULL,                       // sha_final
+    NULL,                       // sha_stream_init
+    NULL,                       // sha_stream_update
+    NULL,                       // sha_stream_final
     // HMAC
     NULL,                       // hmac_sign_init
     NULL,                       // hmac_sign
@@ -104,6 +109,8 @@ struct token_specific_struct token_specific = {
     NULL,                       // aes_gcm
     NULL,                       // aes_gcm_update
     NULL,                       // aes_gcm_final
+    NULL,                       // aes_gcm_msg_init
+    NULL,                       // aes_gcm_msg
     NULL,                       // aes_ofb
     NULL,                       // aes_cfb
     NULL,                       // aes_mac
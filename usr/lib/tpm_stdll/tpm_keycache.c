@@ -0,0 +1,291 @@
+/*
+ * COPYRIGHT (c) International Business Machines Corp. 2024
+ *
+ * This program is provided under the terms of the Common Public License,
+ * version 1.0 (CPL-1.0). Any use, reproduction or distribution for this
+ * software constitutes recipient's acceptance of CPL-1.0 terms which can be
+ * found in the file LICENSE file or at
+ * https://opensource.org/licenses/cpl1.0.php
+ */
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/evp.h>
+
+#include "pkcs11types.h"
+#include "defs.h"
+#include "trace.h"
+#include "tpm_keycache.h"
+
+/* Unloads the key of an entry, or defers that until it is released. */
+static void retire(struct tpm_keycache *cache, struct tpm_keycache_entry *e)
+{
+    if (e->refs > 0) {
+        e->stale = TRUE;
+        return;
+    }
+
+    cache->unload(cache->unload_arg, e->handle);
+    memset(e, 0, sizeof(*e));
+}
+
+/* Must be called with the mutex held. */
+static struct tpm_keycache_entry *find_id(struct tpm_keycache *cache,
+                                          const void *id)
+{
+    unsigned int i;
+
+    for (i = 0; i < cache->slots; i++) {
+        if (cache->entries[i].valid && !cache->entries[i].stale &&
+            cache->entries[i].id == id)
+            return &cache->entries[i];
+    }
+
+    return NULL;
+}
+
+/*
+ * Returns a free entry, evicting the least recently used entry that is not in
+ * use if the cache is full. Must be called with the mutex held.
+ */
+static struct tpm_keycache_entry *find_free(struct tpm_keycache *cache)
+{
+    struct tpm_keycache_entry *e, *lru = NULL;
+    unsigned int i;
+
+    for (i = 0; i < cache->slots; i++) {
+        e = &cache->entries[i];
+        if (!e->valid)
+            return e;
+        if (e->refs == 0 && (lru == NULL || e->last_used < lru->last_used))
+            lru = e;
+    }
+
+    if (lru != NULL) {
+        TRACE_DEVEL("Evicting TPM key handle 0x%x\n", lru->handle);
+        cache->evictions++;
+        retire(cache, lru);
+    }
+
+    return lru;
+}
+
+CK_RV tpm_keycache_init(struct tpm_keycache *cache, unsigned int slots,
+                        tpm_keycache_unload_t unload, void *unload_arg)
+{
+    memset(cache, 0, sizeof(*cache));
+
+    if (slots == 0 || unload == NULL)
+        return CKR_ARGUMENTS_BAD;
+    if (slots > TPM_KEYCACHE_MAX_SLOTS)
+        slots = TPM_KEYCACHE_MAX_SLOTS;
+
+    cache->entries = calloc(slots, sizeof(*cache->entries));
+    if (cache->entries == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
+        return CKR_HOST_MEMORY;
+    }
+
+    pthread_mutex_init(&cache->mutex, NULL);
+    cache->slots = slots;
+    cache->unload = unload;
+    cache->unload_arg = unload_arg;
+
+    TRACE_INFO("Caching up to %u loaded TPM keys\n", slots);
+
+    return CKR_OK;
+}
+
+/*
+ * Frees the cache. The cached keys are only unloaded if unload is TRUE, a
+ * forked child must not unload the keys of its parent.
+ */
+void tpm_keycache_final(struct tpm_keycache *cache, CK_BBOOL unload)
+{
+    unsigned int i;
+
+    if (cache->entries == NULL)
+        return;
+
+    if (unload) {
+        for (i = 0; i < cache->slots; i++) {
+            if (cache->entries[i].valid)
+                cache->unload(cache->unload_arg, cache->entries[i].handle);
+        }
+    }
+
+    pthread_mutex_destroy(&cache->mutex);
+    free(cache->entries);
+    memset(cache, 0, sizeof(*cache));
+}
+
+/* Computes the digest identifying a key blob and its (optional) auth data */
+CK_RV tpm_keycache_digest(const CK_BYTE *blob, CK_ULONG blob_len,
+                          const CK_BYTE *auth, CK_ULONG auth_len,
+                          unsigned char *digest)
+{
+    EVP_MD_CTX *md_ctx;
+    unsigned int len = TPM_KEYCACHE_DIGEST_SIZE;
+    CK_RV rc = CKR_FUNCTION_FAILED;
+
+    md_ctx = EVP_MD_CTX_new();
+    if (md_ctx == NULL) {
+        TRACE_ERROR("%s\n", ock_err(ERR_HOST_MEMORY));
+        return CKR_HOST_MEMORY;
+    }
+
+    if (EVP_DigestInit_ex(md_ctx, EVP_sha256(), NULL) != 1 ||
+        EVP_DigestUpdate(md_ctx, blob, blob_len) != 1 ||
+        (auth != NULL && EVP_DigestUpdate(md_ctx, auth, auth_len) != 1) ||
+        EVP_DigestFinal_ex(md_ctx, digest, &len) != 1) {
+        TRACE_ERROR("Failed to compute the key blob digest\n");
+        goto out;
+    }
+
+    rc = CKR_OK;
+out:
+    EVP_MD_CTX_free(md_ctx);
+    return rc;
+}
+
+/*
+ * Looks up the loaded key handle of a key object. On a hit, the entry is held
+ * until tpm_keycache_release() is called for the handle.
+ */
+CK_BBOOL tpm_keycache_get(struct tpm_keycache *cache, const void *id,
+                          const unsigned char *digest, uint32_t *handle)
+{
+    struct tpm_keycache_entry *e;
+    CK_BBOOL found = FALSE;
+
+    pthread_mutex_lock(&cache->mutex);
+
+    e = find_id(cache, id);
+    if (e != NULL &&
+        memcmp(e->digest, digest, TPM_KEYCACHE_DIGEST_SIZE) == 0) {
+        e->refs++;
+        e->last_used = ++cache->tick;
+        *handle = e->handle;
+        cache->hits++;
+        found = TRUE;
+    } else {
+        cache->misses++;
+    }
+
+    pthread_mutex_unlock(&cache->mutex);
+
+    return found;
+}
+
+/*
+ * Adds a freshly loaded key handle, which is held like after
+ * tpm_keycache_get(). Returns FALSE if the handle was not cached, because the
+ * key was added concurrently or all entries are in use. The handle is then
+ * unloaded by tpm_keycache_release().
+ */
+CK_BBOOL tpm_keycache_add(struct tpm_keycache *cache, const void *id,
+                          const unsigned char *digest, uint32_t handle)
+{
+    struct tpm_keycache_entry *e;
+    CK_BBOOL added = FALSE;
+
+    pthread_mutex_lock(&cache->mutex);
+
+    e = find_id(cache, id);
+    if (e != NULL) {
+        if (memcmp(e->digest, digest, TPM_KEYCACHE_DIGEST_SIZE) == 0)
+            goto out;
+        /* The key blob of the object has changed */
+        retire(cache, e);
+    }
+
+    e = find_free(cache);
+    if (e == NULL) {
+        TRACE_DEVEL("All cached TPM keys are in use\n");
+        goto out;
+    }
+
+    e->id = id;
+    memcpy(e->digest, digest, TPM_KEYCACHE_DIGEST_SIZE);
+    e->handle = handle;
+    e->refs = 1;
+    e->last_used = ++cache->tick;
+    e->valid = TRUE;
+    e->stale = FALSE;
+    added = TRUE;
+
+out:
+    pthread_mutex_unlock(&cache->mutex);
+
+    return added;
+}
+
+/* Releases a key handle obtained from tpm_keycache_get() or _add() */
+void tpm_keycache_release(struct tpm_keycache *cache, uint32_t handle)
+{
+    struct tpm_keycache_entry *e;
+    unsigned int i;
+
+    pthread_mutex_lock(&cache->mutex);
+
+    for (i = 0; i < cache->slots; i++) {
+        e = &cache->entries[i];
+        if (!e->valid || e->handle != handle)
+            continue;
+
+        if (e->refs > 0)
+            e->refs--;
+        if (e->stale)
+            retire(cache, e);
+        goto out;
+    }
+
+    /* Not cached */
+    cache->unload(cache->unload_arg, handle);
+
+out:
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+/*
+ * Drops all cached keys, e.g. when their parent keys are unloaded at logout.
+ * Keys still in use are unloaded when they are released.
+ */
+void tpm_keycache_flush(struct tpm_keycache *cache)
+{
+    unsigned int i;
+
+    if (cache->entries == NULL)
+        return;
+
+    pthread_mutex_lock(&cache->mutex);
+
+    for (i = 0; i < cache->slots; i++) {
+        if (cache->entries[i].valid)
+            retire(cache, &cache->entries[i]);
+    }
+
+    pthread_mutex_unlock(&cache->mutex);
+}
+
+void tpm_keycache_get_stats(struct tpm_keycache *cache,
+                            struct tpm_keycache_stats *stats)
+{
+    unsigned int i;
+
+    pthread_mutex_lock(&cache->mutex);
+
+    memset(stats, 0, sizeof(*stats));
+    stats->slots = cache->slots;
+    for (i = 0; i < cache->slots; i++) {
+        if (cache->entries[i].valid)
+            stats->used++;
+    }
+    stats->hits = cache->hits;
+    stats->misses = cache->misses;
+    stats->evictions = cache->evictions;
+
+    pthread_mutex_unlock(&cache->mutex);
+}
@@ -0,0 +1,83 @@
+/*
+ * COPYRIGHT (c) International Business Machines Corp. 2024
+ *
+ * This program is provided under the terms of the Common Public License,
+ * version 1.0 (CPL-1.0). Any use, reproduction or distribution for this
+ * software constitutes recipient's acceptance of CPL-1.0 terms which can be
+ * found in the file LICENSE file or at
+ * https://opensource.org/licenses/cpl1.0.php
+ */
+
+/*
+ * OpenCryptoki TPM token - cache of loaded key handles
+ *
+ * Loading a key blob into the TSS is a round trip to tcsd and the TPM, so the
+ * handles of loaded keys are kept for later operations with the same key. An
+ * entry is identified by the key object and a digest of its key blob and
+ * encrypted auth data. The cache holds at most as many keys as the TPM has
+ * key slots left, and unloads the least recently used key that is not in use
+ * when it is full.
+ */
+
+#ifndef TPM_KEYCACHE_H
+#define TPM_KEYCACHE_H
+
+#include <pthread.h>
+#include <stdint.h>
+#include "pkcs11types.h"
+
+#define TPM_KEYCACHE_DIGEST_SIZE    32
+#define TPM_KEYCACHE_MAX_SLOTS      64
+
+/* Unloads a TSS key handle (TSS_HKEY) that is no longer cached */
+typedef void (*tpm_keycache_unload_t)(void *arg, uint32_t handle);
+
+struct tpm_keycache_entry {
+    const void *id;
+    unsigned char digest[TPM_KEYCACHE_DIGEST_SIZE];
+    uint32_t handle;
+    unsigned int refs;
+    unsigned long last_used;
+    CK_BBOOL valid;
+    CK_BBOOL stale;     /* flushed while in use, unloaded on release */
+};
+
+struct tpm_keycache_stats {
+    unsigned int slots;
+    unsigned int used;
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+};
+
+struct tpm_keycache {
+    pthread_mutex_t mutex;
+    struct tpm_keycache_entry *entries;
+    unsigned int slots;
+    unsigned long tick;
+    tpm_keycache_unload_t unload;
+    void *unload_arg;
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long evictions;
+};
+
+CK_RV tpm_keycache_init(struct tpm_keycache *cache, unsigned int slots,
+                        tpm_keycache_unload_t unload, void *unload_arg);
+void tpm_keycache_final(struct tpm_keycache *cache, CK_BBOOL unload);
+
+CK_RV tpm_keycache_digest(const CK_BYTE *blob, CK_ULONG blob_len,
+                          const CK_BYTE *auth, CK_ULONG auth_len,
+                          unsigned char *digest);
+
+CK_BBOOL tpm_keycache_get(struct tpm_keycache *cache, const void *id,
+                          const unsigned char *digest, uint32_t *handle);
+CK_BBOOL tpm_keycache_add(struct tpm_keycache *cache, const void *id,
+                          const unsigned char *digest, uint32_t handle);
+void tpm_keycache_release(struct tpm_keycache *cache, uint32_t handle);
+void tpm_keycache_flush(struct tpm_keycache *cache);
+
+void tpm_keycache_get_stats(struct tpm_keycache *cache,
+                            struct tpm_keycache_stats *stats);
+
+#endif
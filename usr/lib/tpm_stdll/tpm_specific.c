@@ -59,6 +59,7 @@
 #include "ock_syslog.h"
 
 #include "tpm_specific.h"
+#include "tpm_keycache.h"
 
 #include "../api/apiproto.h"
 
@@ -76,6 +77,9 @@ typedef struct {
     /* TSP policy handles */
     TSS_HPOLICY hDefaultPolicy;
 
+    /* Loaded TSP key handles of the PKCS#11 key objects */
+    struct tpm_keycache key_cache;
+
     /* PKCS#11 key handles */
     CK_OBJECT_HANDLE ckPublicRootKey;
     CK_OBJECT_HANDLE ckPublicLeafKey;
@@ -174,11 +178,60 @@ CK_RV token_specific_rng(STDLL_TokData_t * tokdata, CK_BYTE * output,
     return CKR_OK;
 }
 
+static void token_unload_key(void *arg, uint32_t handle)
+{
+    tpm_private_data_t *tpm_data = (tpm_private_data_t *)arg;
+    TSS_RESULT result;
+
+    result = Tspi_Key_UnloadKey(handle);
+    if (result)
+        TRACE_DEVEL("Tspi_Key_UnloadKey failed. rc=0x%x\n", result);
+
+    Tspi_Context_CloseObject(tpm_data->tspContext, handle);
+}
+
+/*
+ * Returns the number of key slots of the TPM left for caching loaded keys.
+ * The root and leaf keys of the logged in user stay loaded.
+ */
+static unsigned int token_key_cache_slots(tpm_private_data_t *tpm_data)
+{
+    TSS_RESULT result;
+    TSS_HTPM hTPM;
+    UINT32 subcap = TSS_TPMCAP_PROP_SLOTS, len = 0;
+    BYTE *buf = NULL;
+    unsigned int slots;
+
+    result = Tspi_Context_GetTpmObject(tpm_data->tspContext, &hTPM);
+    if (result) {
+        TRACE_DEVEL("Tspi_Context_GetTpmObject failed. rc=0x%x\n", result);
+        return TPMTOK_KEY_CACHE_SLOTS;
+    }
+
+    result = Tspi_TPM_GetCapability(hTPM, TSS_TPMCAP_PROPERTY, sizeof(subcap),
+                                    (BYTE *)&subcap, &len, &buf);
+    if (result || len < sizeof(UINT32)) {
+        TRACE_DEVEL("Tspi_TPM_GetCapability failed. rc=0x%x\n", result);
+        if (buf != NULL)
+            Tspi_Context_FreeMemory(tpm_data->tspContext, buf);
+        return TPMTOK_KEY_CACHE_SLOTS;
+    }
+
+    memcpy(&slots, buf, sizeof(UINT32));
+    Tspi_Context_FreeMemory(tpm_data->tspContext, buf);
+
+    TRACE_DEVEL("TPM has %u key slots\n", slots);
+
+    return slots > TPMTOK_RESERVED_KEY_SLOTS ?
+                        slots - TPMTOK_RESERVED_KEY_SLOTS : 1;
+}
+
 CK_RV token_specific_init(STDLL_TokData_t * tokdata, CK_SLOT_ID SlotNumber,
                           char *conf_name)
 {
     tpm_private_data_t *tpm_data;
     TSS_RESULT result;
+    CK_RV rc;
     char path_buf[PATH_MAX], fname[PATH_MAX];
     struct stat statbuf;
 
@@ -246,6 +299,16 @@ CK_RV token_specific_init(STDLL_TokData_t * tokdata, CK_SLOT_ID SlotNumber,
         return CKR_FUNCTION_FAILED;
     }
 
+    rc = tpm_keycache_init(&tpm_data->key_cache,
+                           token_key_cache_slots(tpm_data),
+                           token_unload_key, tpm_data);
+    if (rc != CKR_OK) {
+        TRACE_ERROR("tpm_keycache_init failed. rc=0x%lx\n", rc);
+        Tspi_Context_Close(tpm_data->tspContext);
+        free(tpm_data);
+        return rc;
+    }
+
     OpenSSL_add_all_algorithms();
 
     return CKR_OK;
@@ -262,7 +325,7 @@ CK_RV token_find_key(STDLL_TokData_t * tokdata, int key_type,
         {CKA_CLASS, &class, sizeof(class)},
         {CKA_HIDDEN, &true, sizeof(CK_BBOOL)}
     };
-    CK_OBJECT_HANDLE hObj;
+    CK_OBJECT_HANDLE hObj[2];
     CK_ULONG ulObjCount;
     SESSION dummy_sess;
 
@@ -276,11 +339,10 @@ CK_RV token_find_key(STDLL_TokData_t * tokdata, int key_type,
         goto done;
     }
 
-    /* pulled from SC_FindObjects */
-    ulObjCount = MIN(1, (dummy_sess.find_count - dummy_sess.find_idx));
-    memcpy(&hObj, dummy_sess.find_list + dummy_sess.find_idx,
-           ulObjCount * sizeof(CK_OBJECT_HANDLE));
-    dummy_sess.find_idx += ulObjCount;
+    /* Ask for two handles, so that a duplicate key is detected */
+    rc = object_mgr_find(tokdata, &dummy_sess, hObj, 2, &ulObjCount);
+    if (rc != CKR_OK)
+        goto done;
 
     if (ulObjCount > 1) {
         TRACE_INFO("More than one matching key found in the store!\n");
@@ -292,7 +354,7 @@ CK_RV token_find_key(STDLL_TokData_t * tokdata, int key_type,
         goto done;
     }
 
-    *handle = hObj;
+    *handle = hObj[0];
 done:
     object_mgr_find_final(&dummy_sess);
     free(key_id);
@@ -1900,6 +1962,9 @@ CK_RV token_specific_logout(STDLL_TokData_t *tokdata)
 {
     tpm_private_data_t *tpm_data = (tpm_private_data_t *)tokdata->private_data;
 
+    /* The cached keys may depend on the leaf keys unloaded below */
+    tpm_keycache_flush(&tpm_data->key_cache);
+
     if (tpm_data->hPrivateLeafKey != NULL_HKEY) {
         Tspi_Key_UnloadKey(tpm_data->hPrivateLeafKey);
     } else if (tpm_data->hPublicLeafKey != NULL_HKEY) {
@@ -2357,6 +2422,8 @@ CK_RV token_specific_final(STDLL_TokData_t *tokdata,
 
     TRACE_INFO("tpm %s running\n", __func__);
 
+    tpm_keycache_final(&tpm_data->key_cache, !in_fork_initializer);
+
     /*
      * Only close the context if not in in_fork_initializer. If we close the
      * context in a forked child process, this also closes the parent's context.
@@ -2781,6 +2848,10 @@ CK_RV token_specific_rsa_generate_keypair(STDLL_TokData_t * tokdata,
     return rc;
 }
 
+/*
+ * Returns the loaded TSS key handle of an RSA key object. The handle must be
+ * released with token_rsa_release_key() after use.
+ */
 CK_RV token_rsa_load_key(STDLL_TokData_t * tokdata, OBJECT * key_obj,
                          TSS_HKEY * phKey)
 {
@@ -2789,7 +2860,8 @@ CK_RV token_rsa_load_key(STDLL_TokData_t * tokdata, OBJECT * key_obj,
     TSS_HPOLICY hPolicy = NULL_HPOLICY;
     TSS_HKEY hParentKey;
     BYTE *authData = NULL;
-    CK_ATTRIBUTE *attr;
+    CK_ATTRIBUTE *attr, *auth_attr = NULL;
+    unsigned char digest[TPM_KEYCACHE_DIGEST_SIZE];
     CK_RV rc;
     CK_OBJECT_HANDLE handle;
 
@@ -2828,6 +2900,8 @@ CK_RV token_rsa_load_key(STDLL_TokData_t * tokdata, OBJECT * key_obj,
             object_lock(key_obj, READ_LOCK);
             return rc;
         }
+        /* The wrapped key is loaded again from its new blob below */
+        token_unload_key(tpm_data, *phKey);
 
         /* Get the READ lock again */
         rc = object_lock(key_obj, READ_LOCK);
@@ -2843,6 +2917,23 @@ CK_RV token_rsa_load_key(STDLL_TokData_t * tokdata, OBJECT * key_obj,
         }
     }
 
+    /* auth data may be required */
+    if (template_attribute_get_non_empty(key_obj->template, CKA_ENC_AUTHDATA,
+                                         &auth_attr) != CKR_OK)
+        auth_attr = NULL;
+
+    rc = tpm_keycache_digest(attr->pValue, attr->ulValueLen,
+                             auth_attr != NULL ? auth_attr->pValue : NULL,
+                             auth_attr != NULL ? auth_attr->ulValueLen : 0,
+                             digest);
+    if (rc != CKR_OK) {
+        TRACE_DEVEL("tpm_keycache_digest failed. rc=0x%lx\n", rc);
+        return rc;
+    }
+
+    if (tpm_keycache_get(&tpm_data->key_cache, key_obj, digest, phKey))
+        return CKR_OK;
+
     result = Tspi_Context_LoadKeyByBlob(tpm_data->tspContext, hParentKey,
                                         attr->ulValueLen, attr->pValue, phKey);
     if (result) {
@@ -2850,31 +2941,32 @@ CK_RV token_rsa_load_key(STDLL_TokData_t * tokdata, OBJECT * key_obj,
         return CKR_FUNCTION_FAILED;
     }
 
-    /* auth data may be required */
-    rc = template_attribute_get_non_empty(key_obj->template, CKA_ENC_AUTHDATA,
-                                          &attr);
-    if (rc == CKR_OK) {
+    if (auth_attr != NULL) {
         if ((tpm_data->hPrivateLeafKey == NULL_HKEY) &&
             (tpm_data->hPublicLeafKey == NULL_HKEY)) {
             TRACE_ERROR("Shouldn't be in a public session here\n");
-            return CKR_FUNCTION_FAILED;
+            rc = CKR_FUNCTION_FAILED;
+            goto error;
         } else if (tpm_data->hPublicLeafKey != NULL_HKEY) {
             hParentKey = tpm_data->hPublicLeafKey;
         } else {
             hParentKey = tpm_data->hPrivateLeafKey;
         }
 
-        result = token_unwrap_auth_data(tokdata, attr->pValue, attr->ulValueLen,
+        result = token_unwrap_auth_data(tokdata, auth_attr->pValue,
+                                        auth_attr->ulValueLen,
                                         hParentKey, &authData);
         if (result) {
             TRACE_DEVEL("token_unwrap_auth_data: 0x%x\n", result);
-            return CKR_FUNCTION_FAILED;
+            rc = CKR_FUNCTION_FAILED;
+            goto error;
         }
 
         result = Tspi_GetPolicyObject(*phKey, TSS_POLICY_USAGE, &hPolicy);
         if (result) {
             TRACE_ERROR("Tspi_GetPolicyObject: 0x%x\n", result);
-            return CKR_FUNCTION_FAILED;
+            rc = CKR_FUNCTION_FAILED;
+            goto error;
         }
 
         /* If the policy handle returned is the same as the context's default
@@ -2886,7 +2978,8 @@ CK_RV token_rsa_load_key(STDLL_TokData_t * tokdata, OBJECT * key_obj,
                                                TSS_POLICY_USAGE, &hPolicy);
             if (result) {
                 TRACE_ERROR("Tspi_Context_CreateObject: 0x%x\n", result);
-                return CKR_FUNCTION_FAILED;
+                rc = CKR_FUNCTION_FAILED;
+                goto error;
             }
 
             result = Tspi_Policy_SetSecret(hPolicy, TSS_SECRET_MODE_SHA1,
@@ -2894,28 +2987,48 @@ CK_RV token_rsa_load_key(STDLL_TokData_t * tokdata, OBJECT * key_obj,
             if (result) {
                 TRACE_ERROR("Tspi_Policy_SetSecret failed. "
                             "rc=0x%x\n", result);
-                return CKR_FUNCTION_FAILED;
+                rc = CKR_FUNCTION_FAILED;
+                goto error;
             }
 
             result = Tspi_Policy_AssignToObject(hPolicy, *phKey);
             if (result) {
                 TRACE_ERROR("Tspi_Policy_AssignToObject failed."
                             " rc=0x%x\n", result);
-                return CKR_FUNCTION_FAILED;
+                rc = CKR_FUNCTION_FAILED;
+                goto error;
             }
         } else {
             result = Tspi_Policy_SetSecret(hPolicy, TSS_SECRET_MODE_SHA1,
                                            SHA1_HASH_SIZE, authData);
             if (result) {
                 TRACE_ERROR("Tspi_Policy_SetSecret failed. rc=0x%x\n", result);
-                return CKR_FUNCTION_FAILED;
+                rc = CKR_FUNCTION_FAILED;
+                goto error;
             }
         }
 
         Tspi_Context_FreeMemory(tpm_data->tspContext, authData);
     }
 
+    /* If the key isn't cached, it is unloaded when released */
+    tpm_keycache_add(&tpm_data->key_cache, key_obj, digest, *phKey);
+
     return CKR_OK;
+
+error:
+    if (authData != NULL)
+        Tspi_Context_FreeMemory(tpm_data->tspContext, authData);
+    token_unload_key(tpm_data, *phKey);
+
+    return rc;
+}
+
+void token_rsa_release_key(STDLL_TokData_t * tokdata, TSS_HKEY hKey)
+{
+    tpm_private_data_t *tpm_data = (tpm_private_data_t *)tokdata->private_data;
+
+    tpm_keycache_release(&tpm_data->key_cache, hKey);
 }
 
 CK_RV token_specific_rsa_decrypt(STDLL_TokData_t * tokdata,
@@ -2944,7 +3057,8 @@ CK_RV token_specific_rsa_decrypt(STDLL_TokData_t * tokdata,
                                        TSS_ENCDATA_BIND, &hEncData);
     if (result) {
         TRACE_ERROR("Tspi_Context_CreateObject failed. rc=0x%x\n", result);
-        return CKR_FUNCTION_FAILED;
+        rc = CKR_FUNCTION_FAILED;
+        goto done;
     }
 
     result = Tspi_SetAttribData(hEncData, TSS_TSPATTRIB_ENCDATA_BLOB,
@@ -2952,7 +3066,8 @@ CK_RV token_specific_rsa_decrypt(STDLL_TokData_t * tokdata,
                                 in_data_len, in_data);
     if (result) {
         TRACE_ERROR("Tspi_SetAttribData failed. rc=0x%x\n", result);
-        return CKR_FUNCTION_FAILED;
+        rc = CKR_FUNCTION_FAILED;
+        goto done;
     }
 
     /* unbind the data, receiving the plaintext back */
@@ -2961,13 +3076,15 @@ CK_RV token_specific_rsa_decrypt(STDLL_TokData_t * tokdata,
     result = Tspi_Data_Unbind(hEncData, hKey, &buf_size, &buf);
     if (result) {
         TRACE_ERROR("Tspi_Data_Unbind failed: 0x%x\n", result);
-        return CKR_FUNCTION_FAILED;
+        rc = CKR_FUNCTION_FAILED;
+        goto done;
     }
 
     if (*out_data_len < buf_size) {
         TRACE_ERROR("%s\n", ock_err(ERR_BUFFER_TOO_SMALL));
         Tspi_Context_FreeMemory(tpm_data->tspContext, buf);
-        return CKR_BUFFER_TOO_SMALL;
+        rc = CKR_BUFFER_TOO_SMALL;
+        goto done;
     }
 
     memcpy(out_data, buf, buf_size);
@@ -2975,7 +3092,12 @@ CK_RV token_specific_rsa_decrypt(STDLL_TokData_t * tokdata,
 
     Tspi_Context_FreeMemory(tpm_data->tspContext, buf);
 
-    return CKR_OK;
+    rc = CKR_OK;
+
+done:
+    token_rsa_release_key(tokdata, hKey);
+
+    return rc;
 }
 
 CK_RV token_specific_rsa_verify(STDLL_TokData_t * tokdata,
@@ -3005,14 +3127,16 @@ CK_RV token_specific_rsa_verify(STDLL_TokData_t * tokdata,
                                        TSS_HASH_OTHER, &hHash);
     if (result) {
         TRACE_ERROR("Tspi_Context_CreateObject failed. rc=0x%x\n", result);
-        return CKR_FUNCTION_FAILED;
+        rc = CKR_FUNCTION_FAILED;
+        goto done;
     }
 
     /* Insert the data into the hash object */
     result = Tspi_Hash_SetHashValue(hHash, in_data_len, in_data);
     if (result) {
         TRACE_ERROR("Tspi_Hash_SetHashValue failed. rc=0x%x\n", result);
-        return CKR_FUNCTION_FAILED;
+        rc = CKR_FUNCTION_FAILED;
+        goto done;
     }
 
     /* Verify */
@@ -3027,6 +3151,9 @@ CK_RV token_specific_rsa_verify(STDLL_TokData_t * tokdata,
         rc = CKR_OK;
     }
 
+done:
+    token_rsa_release_key(tokdata, hKey);
+
     return rc;
 }
 
@@ -3059,34 +3186,43 @@ CK_RV token_specific_rsa_sign(STDLL_TokData_t * tokdata,
                                        TSS_HASH_OTHER, &hHash);
     if (result) {
         TRACE_ERROR("Tspi_Context_CreateObject failed. rc=0x%x\n", result);
-        return CKR_FUNCTION_FAILED;
+        rc = CKR_FUNCTION_FAILED;
+        goto done;
     }
 
     /* Insert the data into the hash object */
     result = Tspi_Hash_SetHashValue(hHash, in_data_len, in_data);
     if (result) {
         TRACE_ERROR("Tspi_Hash_SetHashValue failed. rc=0x%x\n", result);
-        return CKR_FUNCTION_FAILED;
+        rc = CKR_FUNCTION_FAILED;
+        goto done;
     }
 
     /* Sign */
     result = Tspi_Hash_Sign(hHash, hKey, &sig_len, &sig);
     if (result) {
         TRACE_ERROR("Tspi_Hash_Sign failed. rc=0x%x\n", result);
-        return CKR_FUNCTION_FAILED;
+        rc = CKR_FUNCTION_FAILED;
+        goto done;
     }
 
     if (sig_len > *out_data_len) {
         TRACE_ERROR("Buffer too small to hold result.\n");
         Tspi_Context_FreeMemory(tpm_data->tspContext, sig);
-        return CKR_BUFFER_TOO_SMALL;
+        rc = CKR_BUFFER_TOO_SMALL;
+        goto done;
     }
 
     memcpy(out_data, sig, sig_len);
     *out_data_len = sig_len;
     Tspi_Context_FreeMemory(tpm_data->tspContext, sig);
 
-    return CKR_OK;
+    rc = CKR_OK;
+
+done:
+    token_rsa_release_key(tokdata, hKey);
+
+    return rc;
 }
 
 
@@ -3115,13 +3251,15 @@ CK_RV token_specific_rsa_encrypt(STDLL_TokData_t * tokdata,
                                        TSS_ENCDATA_BIND, &hEncData);
     if (result) {
         TRACE_ERROR("Tspi_Context_CreateObject failed. rc=0x%x\n", result);
-        return CKR_FUNCTION_FAILED;
+        rc = CKR_FUNCTION_FAILED;
+        goto done;
     }
 
     result = Tspi_Data_Bind(hEncData, hKey, in_data_len, in_data);
     if (result) {
         TRACE_ERROR("Tspi_Data_Bind failed. rc=0x%x\n", result);
-        return CKR_FUNCTION_FAILED;
+        rc = CKR_FUNCTION_FAILED;
+        goto done;
     }
 
     result = Tspi_GetAttribData(hEncData, TSS_TSPATTRIB_ENCDATA_BLOB,
@@ -3129,20 +3267,27 @@ CK_RV token_specific_rsa_encrypt(STDLL_TokData_t * tokdata,
                                 &dataBlobSize, &dataBlob);
     if (result) {
         TRACE_ERROR("Tspi_SetAttribData failed. rc=0x%x\n", result);
-        return CKR_FUNCTION_FAILED;
+        rc = CKR_FUNCTION_FAILED;
+        goto done;
     }
 
     if (dataBlobSize > *out_data_len) {
         TRACE_ERROR("%s\n", ock_err(ERR_DATA_LEN_RANGE));
         Tspi_Context_FreeMemory(tpm_data->tspContext, dataBlob);
-        return CKR_DATA_LEN_RANGE;
+        rc = CKR_DATA_LEN_RANGE;
+        goto done;
     }
 
     memcpy(out_data, dataBlob, dataBlobSize);
     *out_data_len = dataBlobSize;
     Tspi_Context_FreeMemory(tpm_data->tspContext, dataBlob);
 
-    return CKR_OK;
+    rc = CKR_OK;
+
+done:
+    token_rsa_release_key(tokdata, hKey);
+
+    return rc;
 }
 
 CK_RV token_specific_rsa_verify_recover(STDLL_TokData_t * tokdata,
@@ -53,6 +53,11 @@
 #define DEBUG_openssl_print_errors()
 #endif
 
+/* number of cached loaded keys if the TPM's key slots can't be queried, and
+ * the key slots kept free for the root and leaf keys */
+#define TPMTOK_KEY_CACHE_SLOTS      4
+#define TPMTOK_RESERVED_KEY_SLOTS   2
+
 /* retry count for generating software RSA keys */
 #define KEYGEN_RETRY    5
 
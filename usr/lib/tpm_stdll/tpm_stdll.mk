@@ -2,7 +2,7 @@ nobase_lib_LTLIBRARIES += opencryptoki/stdll/libpkcs11_tpm.la
 
 noinst_HEADERS += 							\
 	usr/lib/tpm_stdll/defs.h usr/lib/tpm_stdll/tpm_specific.h	\
-	usr/lib/tpm_stdll/tok_struct.h
+	usr/lib/tpm_stdll/tok_struct.h usr/lib/tpm_stdll/tpm_keycache.h
 
 opencryptoki_stdll_libpkcs11_tpm_la_CFLAGS =				\
 	-DLINUX -DNOCDMF -DNODSA -DNODH	-DMMAP				\
@@ -24,6 +24,7 @@ opencryptoki_stdll_libpkcs11_tpm_la_SOURCES =				\
 	usr/lib/common/dp_obj.c	usr/lib/common/mech_aes.c		\
 	usr/lib/common/mech_rsa.c usr/lib/common/mech_ec.c		\
 	usr/lib/common/obj_mgr.c usr/lib/common/template.c		\
+	usr/lib/common/secure_arena.c usr/lib/common/login_broker.c	\
 	usr/lib/common/p11util.c usr/lib/common/data_obj.c		\
 	usr/lib/common/encr_mgr.c usr/lib/common/key_mgr.c		\
 	usr/lib/common/mech_md2.c usr/lib/common/mech_sha.c		\
@@ -36,6 +37,7 @@ opencryptoki_stdll_libpkcs11_tpm_la_SOURCES =				\
 	usr/lib/common/shared_memory.c usr/lib/common/profile_obj.c	\
 	usr/lib/tpm_stdll/tpm_specific.c usr/lib/common/attributes.c	\
 	usr/lib/tpm_stdll/tpm_openssl.c usr/lib/tpm_stdll/tpm_util.c	\
+	usr/lib/tpm_stdll/tpm_keycache.c				\
 	usr/lib/common/dlist.c usr/lib/common/mech_openssl.c		\
 	usr/lib/common/utility_common.c usr/lib/common/ec_supported.c	\
 	usr/lib/api/policyhelper.c
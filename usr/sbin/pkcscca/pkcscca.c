@@ -44,6 +44,7 @@
 #include "pkcs_utils.h"
 
 #include "pkcscca.h"
+#include "key_migrate.h"
 
 const char manuf[] = "IBM";
 const char model[] = "CCA";
@@ -55,6 +56,13 @@ token_spec_t token_specific;
 
 int v_level = 0;
 void *p11_lib = NULL;
+
+static struct key_migrate_opts migrate_opts = {
+    .num_workers = 4,
+    .dry_run = FALSE,
+    .checkpoint = NULL,
+    .progress_interval = 5,
+};
 void (*CSNDKTC) ();
 void (*CSNBKTC) ();
 void (*CSNBKTC2) ();
@@ -222,7 +230,7 @@ int adjust_key_object_attributes(unsigned char *data, unsigned long data_len,
         goto cleanup;
 
     /* flatten the object */
-    rc = object_flatten(obj, new_data, new_data_len);
+    rc = object_flatten(obj, new_data, new_data_len, FALSE);
     if (rc)
         goto cleanup;
 
@@ -850,28 +858,6 @@ int find_wrapped_keys(CK_FUNCTION_LIST *funcs, CK_SESSION_HANDLE sess,
     return 0;
 }
 
-int replace_keys(CK_FUNCTION_LIST *funcs, CK_SESSION_HANDLE sess,
-                 struct key *keys)
-{
-    CK_RV rv;
-    CK_ATTRIBUTE new_attr[] = { {CKA_IBM_OPAQUE, NULL, 0} };
-    struct key *key;
-
-    for (key = keys; key; key = key->next) {
-        new_attr->pValue = key->opaque_attr;
-        new_attr->ulValueLen = key->attr_len;
-
-        rv = funcs->C_SetAttributeValue(sess, key->handle, new_attr, 1);
-        if (rv != CKR_OK) {
-            p11_error("C_SetAttributeValue", rv);
-            print_error("Error replacing old key with " "migrated key.");
-            return 1;
-        }
-    }
-
-    return 0;
-}
-
 int cca_migrate_asymmetric(struct key *key, char **out, struct algo algo)
 {
     long return_code, reason_code, exit_data_length, key_identifier_length;
@@ -1000,103 +986,147 @@ int cca_migrate_hmac(struct key *key, char **out, struct algo algo)
     return 0;
 }
 
-/* @keys: A linked list of data to migrate and the PKCS#11 handle for the
- * object in the data store.
- * @count: counter for number of keys migrated
- * @count_failed: counter for number of keys that failed to migrate
+/*
+ * Re-enciphers a single key blob, called concurrently by the key migration
+ * workers. Each call works on its own copy of the blob.
  */
-int cca_migrate(struct key *keys, struct key_count *count,
-                struct key_count *count_failed)
+static int cca_migrate_key(void *ctx, struct key_migrate_item *item,
+                           CK_BYTE **new_blob, CK_ULONG *new_blob_len)
 {
-    struct key *key;
-    char *migrated_data;
+    struct key key = {
+        .handle = item->handle,
+        .type = item->key_type,
+        .opaque_attr = item->blob,
+        .attr_len = item->blob_len,
+        .label = (CK_CHAR_PTR)item->label,
+        .next = NULL,
+    };
+    char *migrated_data = NULL;
     int rc;
 
-    for (key = keys; key; key = key->next) {
-        migrated_data = NULL;
+    UNUSED(ctx);
 
-        switch (key->type) {
-        case CKK_AES:
-            rc = cca_migrate_symmetric(key, &migrated_data, aes);
-            if (rc)
-                count_failed->aes++;
-            else
-                count->aes++;
-            break;
-        case CKK_DES:
-        case CKK_DES2:
-        case CKK_DES3:
-            rc = cca_migrate_symmetric(key, &migrated_data, des);
-            if (rc)
-                count_failed->des++;
-            else
-                count->des++;
-            break;
-        case CKK_EC:
-            rc = cca_migrate_asymmetric(key, &migrated_data, ecc);
-            if (rc)
-                count_failed->ecc++;
-            else
-                count->ecc++;
-            break;
-        case CKK_GENERIC_SECRET:
-            rc = cca_migrate_hmac(key, &migrated_data, hmac);
-            if (rc)
-                count_failed->hmac++;
-            else
-                count->hmac++;
-            break;
-        case CKK_RSA:
-            rc = cca_migrate_asymmetric(key, &migrated_data, rsa);
-            if (rc)
-                count_failed->rsa++;
-            else
-                count->rsa++;
-            break;
-        default:
-            rc = 1;
-            break;
-        }
-
-        /* replace the original key with the migrated key */
-        if (!rc && migrated_data) {
-            free(key->opaque_attr);
-            key->opaque_attr = (CK_BYTE *) migrated_data;
-        }
+    switch (key.type) {
+    case CKK_AES:
+        rc = cca_migrate_symmetric(&key, &migrated_data, aes);
+        break;
+    case CKK_DES:
+    case CKK_DES2:
+    case CKK_DES3:
+        rc = cca_migrate_symmetric(&key, &migrated_data, des);
+        break;
+    case CKK_EC:
+        rc = cca_migrate_asymmetric(&key, &migrated_data, ecc);
+        break;
+    case CKK_GENERIC_SECRET:
+        rc = cca_migrate_hmac(&key, &migrated_data, hmac);
+        break;
+    case CKK_RSA:
+        rc = cca_migrate_asymmetric(&key, &migrated_data, rsa);
+        break;
+    default:
+        rc = 1;
+        break;
     }
 
+    if (rc || !migrated_data)
+        return 1;
+
+    *new_blob = (CK_BYTE *)migrated_data;
+    *new_blob_len = key.attr_len;
+
     return 0;
 }
 
-int migrate_keytype(CK_FUNCTION_LIST *funcs, CK_SESSION_HANDLE sess,
-                    CK_KEY_TYPE *k_type, struct key_count *count,
-                    struct key_count *count_failed)
+static void count_key(struct key_count *count, CK_KEY_TYPE key_type)
 {
-    struct key *keys = NULL, *tmp, *to_free;
+    switch (key_type) {
+    case CKK_AES:
+        count->aes++;
+        break;
+    case CKK_DES:
+    case CKK_DES2:
+    case CKK_DES3:
+        count->des++;
+        break;
+    case CKK_EC:
+        count->ecc++;
+        break;
+    case CKK_GENERIC_SECRET:
+        count->hmac++;
+        break;
+    case CKK_RSA:
+        count->rsa++;
+        break;
+    }
+}
+
+/* @keys: A linked list of data to migrate and the PKCS#11 handle for the
+ * object in the data store.
+ * @count: counter for number of keys migrated
+ * @count_failed: counter for number of keys that failed to migrate
+ *
+ * The keys are re-enciphered and written back by migrate_opts.num_workers
+ * parallel sessions.
+ */
+int cca_migrate(CK_FUNCTION_LIST *funcs, CK_SLOT_ID slot_id, struct key *keys,
+                struct key_count *count, struct key_count *count_failed)
+{
+    struct key_migrate_item *items;
+    struct key_migrate_stats stats;
+    unsigned long num_items = 0, i;
+    struct key *key;
     int rc;
 
-    rc = find_wrapped_keys(funcs, sess, k_type, &keys);
-    if (rc) {
-        goto done;
+    for (key = keys; key; key = key->next)
+        num_items++;
+    if (num_items == 0)
+        return 0;
+
+    items = calloc(num_items, sizeof(*items));
+    if (!items) {
+        print_error("Malloc of %zu bytes failed!", num_items * sizeof(*items));
+        return 1;
     }
 
-    rc = cca_migrate(keys, count, count_failed);
-    if (rc) {
-        goto done;
+    for (key = keys, i = 0; key; key = key->next, i++) {
+        items[i].handle = key->handle;
+        items[i].key_type = key->type;
+        items[i].blob = key->opaque_attr;
+        items[i].blob_len = key->attr_len;
+        items[i].label = (char *)key->label;
     }
 
-    rc = replace_keys(funcs, sess, keys);
+    rc = key_migrate_run(funcs, slot_id, items, num_items, cca_migrate_key,
+                         NULL, &migrate_opts, &stats);
     if (rc) {
+        print_error("Key migration could not be started: %s", strerror(-rc));
         goto done;
     }
 
-done:
-    for (to_free = keys; to_free; to_free = tmp) {
-        tmp = to_free->next;
-        free(to_free->opaque_attr);
-        free(to_free);
+    for (i = 0; i < num_items; i++) {
+        if (items[i].status == KEY_MIGRATE_DONE)
+            count_key(count, items[i].key_type);
+        else if (items[i].status == KEY_MIGRATE_FAILED)
+            count_key(count_failed, items[i].key_type);
     }
 
+    printf("%s%lu of %lu keys migrated in %.1f seconds (%.1f keys/s)",
+           migrate_opts.dry_run ? "Dry run: " : "", stats.migrated,
+           stats.total, stats.seconds,
+           stats.seconds > 0 ? stats.migrated / stats.seconds : 0.0);
+    if (stats.skipped)
+        printf(", %lu already migrated", stats.skipped);
+    printf("\n");
+    if (stats.interrupted) {
+        print_error("Key migration interrupted, run again with the same "
+                    "checkpoint file to resume.");
+        rc = 1;
+    }
+
+done:
+    free(items);
+
     return rc;
 }
 
@@ -1147,6 +1177,7 @@ int migrate_wrapped_keys(CK_SLOT_ID slot_id, char *userpin, int masterkey)
     CK_KEY_TYPE key_type = 0;
     CK_SESSION_HANDLE sess;
     CK_RV rv;
+    struct key *keys = NULL, *tmp, *to_free;
     struct key_count count = { 0, 0, 0, 0, 0, 0, 0 };
     struct key_count count_failed = { 0, 0, 0, 0, 0, 0, 0 };
     int exit_code = 0, rc;
@@ -1171,19 +1202,23 @@ int migrate_wrapped_keys(CK_SLOT_ID slot_id, char *userpin, int masterkey)
         goto finalize;
     }
 
+    /*
+     * Collect the keys of all key types wrapped by the master key first,
+     * so that they are all migrated by one pool of workers.
+     */
     switch (masterkey) {
     case MK_AES:
         if (v_level)
             printf("Search for AES keys\n");
         key_type = CKK_AES;
-        rc = migrate_keytype(funcs, sess, &key_type, &count, &count_failed);
+        rc = find_wrapped_keys(funcs, sess, &key_type, &keys);
         if (rc) {
             goto done;
         }
         if (v_level)
             printf("Search for HMAC keys\n");
         key_type = CKK_GENERIC_SECRET;
-        rc = migrate_keytype(funcs, sess, &key_type, &count, &count_failed);
+        rc = find_wrapped_keys(funcs, sess, &key_type, &keys);
         if (rc) {
             goto done;
         }
@@ -1192,7 +1227,7 @@ int migrate_wrapped_keys(CK_SLOT_ID slot_id, char *userpin, int masterkey)
         if (v_level)
             printf("Search for ECC keys\n");
         key_type = CKK_EC;
-        rc = migrate_keytype(funcs, sess, &key_type, &count, &count_failed);
+        rc = find_wrapped_keys(funcs, sess, &key_type, &keys);
         if (rc) {
             goto done;
         }
@@ -1201,7 +1236,7 @@ int migrate_wrapped_keys(CK_SLOT_ID slot_id, char *userpin, int masterkey)
         if (v_level)
             printf("Search for RSA keys\n");
         key_type = CKK_RSA;
-        rc = migrate_keytype(funcs, sess, &key_type, &count, &count_failed);
+        rc = find_wrapped_keys(funcs, sess, &key_type, &keys);
         if (rc) {
             goto done;
         }
@@ -1210,21 +1245,21 @@ int migrate_wrapped_keys(CK_SLOT_ID slot_id, char *userpin, int masterkey)
         if (v_level)
             printf("Search for DES keys\n");
         key_type = CKK_DES;
-        rc = migrate_keytype(funcs, sess, &key_type, &count, &count_failed);
+        rc = find_wrapped_keys(funcs, sess, &key_type, &keys);
         if (rc) {
             goto done;
         }
         if (v_level)
             printf("Search for DES2 keys\n");
         key_type = CKK_DES2;
-        rc = migrate_keytype(funcs, sess, &key_type, &count, &count_failed);
+        rc = find_wrapped_keys(funcs, sess, &key_type, &keys);
         if (rc) {
             goto done;
         }
         if (v_level)
             printf("Search for DES3 keys\n");
         key_type = CKK_DES3;
-        rc = migrate_keytype(funcs, sess, &key_type, &count, &count_failed);
+        rc = find_wrapped_keys(funcs, sess, &key_type, &keys);
         if (rc) {
             goto done;
         }
@@ -1234,9 +1269,19 @@ int migrate_wrapped_keys(CK_SLOT_ID slot_id, char *userpin, int masterkey)
         return -1;
     }
 
+    rc = cca_migrate(funcs, slot_id, keys, &count, &count_failed);
+    if (rc)
+        exit_code = 9;
+
     key_migration_results(count, count_failed);
 
 done:
+    for (to_free = keys; to_free; to_free = tmp) {
+        tmp = to_free->next;
+        free(to_free->opaque_attr);
+        free(to_free->label);
+        free(to_free);
+    }
     funcs->C_CloseSession(sess);
 finalize:
     p11_fini(funcs);
@@ -1341,7 +1386,13 @@ void usage(char *progname)
     printf(" old CCA master\n\t\t\t\tkey and wraps them with the");
     printf(" new CCA master key\n");
     printf(" -s, --slotid SLOTID\t\tPKCS slot number\n");
-    printf(" -k aes|apka|asym|sym\t\tMigrate selected keytype\n\n");
+    printf(" -k aes|apka|asym|sym\t\tMigrate selected keytype\n");
+    printf(" -t, --threads NUM\t\tMigrate keys with NUM parallel sessions"
+           "\n\t\t\t\t(default 4)\n");
+    printf(" -c, --checkpoint FILE\t\tRecord migrated keys in FILE and skip"
+           "\n\t\t\t\tkeys recorded there by an earlier run\n");
+    printf(" -n, --dry-run\t\t\tRe-encipher the keys, but do not store"
+           "\n\t\t\t\tthem\n\n");
     printf(" Options:\n");
     printf(" -d, --datastore DATASTORE\tCCA token datastore location\n");
     printf(" -v, --verbose LEVEL\t\tset verbose level (optional):\n");
@@ -1389,10 +1440,13 @@ int main(int argc, char **argv)
         {"datastore", required_argument, NULL, 'd'},
         {"slotid", required_argument, NULL, 's'},
         {"verbose", no_argument, NULL, 'v'},
+        {"threads", required_argument, NULL, 't'},
+        {"checkpoint", required_argument, NULL, 'c'},
+        {"dry-run", no_argument, NULL, 'n'},
         {0, 0, 0, 0}
     };
 
-    while ((opt = getopt_long(argc, argv, "m:d:s:k:v:h", long_opts, NULL))
+    while ((opt = getopt_long(argc, argv, "m:d:s:k:v:t:c:nh", long_opts, NULL))
            != -1) {
         switch (opt) {
         case 'd':
@@ -1433,6 +1487,21 @@ int main(int argc, char **argv)
             c_flag++;
             slot_id = atoi(optarg);
             break;
+        case 't':
+            migrate_opts.num_workers = atoi(optarg);
+            if (migrate_opts.num_workers < 1) {
+                print_error("Invalid number of threads '%s' specified.\n",
+                            optarg);
+                usage(argv[0]);
+                return -1;
+            }
+            break;
+        case 'c':
+            migrate_opts.checkpoint = optarg;
+            break;
+        case 'n':
+            migrate_opts.dry_run = TRUE;
+            break;
         case 'v':
             v_level = verbose_str2level(optarg);
             if (v_level < 0) {
@@ -6,7 +6,7 @@ noinst_HEADERS += usr/include/local_types.h
 noinst_HEADERS += usr/lib/common/h_extern.h
 noinst_HEADERS += usr/lib/common/pkcs_utils.h
 
-usr_sbin_pkcscca_pkcscca_LDFLAGS = -lcrypto -ldl -lrt
+usr_sbin_pkcscca_pkcscca_LDFLAGS = -lcrypto -ldl -lrt -lpthread
 
 usr_sbin_pkcscca_pkcscca_CFLAGS  =					\
 	-DSTDLL_NAME=\"pkcscca\"					\
@@ -26,6 +26,7 @@ usr_sbin_pkcscca_pkcscca_SOURCES = usr/lib/common/asn1.c		\
 	usr/lib/common/dp_obj.c usr/lib/common/mech_aes.c		\
 	usr/lib/common/mech_rsa.c usr/lib/common/mech_ec.c		\
 	usr/lib/common/obj_mgr.c usr/lib/common/template.c		\
+	usr/lib/common/secure_arena.c usr/lib/common/login_broker.c	\
 	usr/lib/common/data_obj.c usr/lib/common/encr_mgr.c		\
 	usr/lib/common/key_mgr.c usr/lib/common/mech_md2.c		\
 	usr/lib/common/mech_sha.c usr/lib/common/object.c		\
@@ -38,6 +39,7 @@ usr_sbin_pkcscca_pkcscca_SOURCES = usr/lib/common/asn1.c		\
 	usr/lib/common/profile_obj.c usr/lib/common/attributes.c	\
 	usr/lib/common/mech_rng.c usr/lib/common/pkcs_utils.c		\
 	usr/lib/common/dlist.c usr/sbin/pkcscca/pkcscca.c		\
+	usr/lib/common/key_migrate.c					\
 	usr/lib/common/utility_common.c usr/lib/common/ec_supported.c   \
 	usr/lib/api/policyhelper.c
 
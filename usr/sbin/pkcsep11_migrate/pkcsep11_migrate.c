@@ -28,6 +28,7 @@
 #include "../../include/pkcs11types.h"
 #include "../../lib/common/p11util.h"
 #include "../../lib/ep11_stdll/ep11_func.h"
+#include "../../lib/common/key_migrate.h"
 
 #define EP11SHAREDLIB_NAME "OCK_EP11_LIBRARY"
 #define EP11SHAREDLIB_V3 "libep11.so.3"
@@ -42,6 +43,13 @@ CK_LONG adapter = -1;
 CK_LONG domain = -1;
 CK_OBJECT_HANDLE key_store[4096];
 
+static struct key_migrate_opts migrate_opts = {
+    .num_workers = 4,
+    .dry_run = FALSE,
+    .checkpoint = NULL,
+    .progress_interval = 5,
+};
+
 m_get_xcp_info_t _m_get_xcp_info;
 m_admin_t _m_admin;
 xcpa_cmdblock_t _xcpa_cmdblock;
@@ -62,8 +70,13 @@ typedef struct {
 
 
 
-static int reencrypt(CK_SESSION_HANDLE session, CK_ULONG obj, CK_BYTE *old,
-                     CK_ULONG old_len)
+/*
+ * Re-enciphers the blob of a key with the new wrapping key of the adapter.
+ * Called concurrently by the key migration workers, each call uses its own
+ * target.
+ */
+static int reencrypt(void *ctx, struct key_migrate_item *item,
+                     CK_BYTE **new_blob, CK_ULONG *new_blob_len)
 {
     CK_BYTE req[BLOBSIZE];
     CK_BYTE resp[BLOBSIZE];
@@ -75,29 +88,9 @@ static int reencrypt(CK_SESSION_HANDLE session, CK_ULONG obj, CK_BYTE *old,
     struct XCP_Module module;
     target_t target = XCP_TGT_INIT;
     CK_RV rc;
-    CK_BYTE name[256];
-    unsigned char blob[BLOBSIZE];
-    CK_ULONG blob_len;
-
-    CK_ATTRIBUTE opaque_template[] = {
-        { CKA_IBM_OPAQUE, blob, BLOBSIZE }
-    };
-
-    CK_ATTRIBUTE name_template[] = {
-        {CKA_LABEL, NULL_PTR, 0}
-    };
-
-    memset(name, 0, 256);
+    const char *name = item->label ? item->label : "";
 
-    /* print CKA_LABEL if it exists, only informational
-       exist and size query */
-    rc = funcs->C_GetAttributeValue(session, key_store[obj], name_template, 1);
-    if (rc == CKR_OK && name_template[0].ulValueLen < 256) {
-        name_template[0].pValue = name;
-        /* knowing its size, after mem allocation, get the name value */
-        rc = funcs->C_GetAttributeValue(session, key_store[obj], name_template,
-                                        1);
-    }
+    (void)ctx;
 
     memset(&rb, 0, sizeof(rb));
     memset(&lrb, 0, sizeof(lrb));
@@ -124,12 +117,12 @@ static int reencrypt(CK_SESSION_HANDLE session, CK_ULONG obj, CK_BYTE *old,
     rb.domain = domain;
     lrb.domain = domain;
 
-    fprintf(stderr, "going to reencrpyt key %lx with blob len %lx: '%s'\n", obj,
-            old_len, name);
+    fprintf(stderr, "going to reencrpyt key %lx with blob len %lx: '%s'\n",
+            item->handle, item->blob_len, name);
     resp_len = BLOBSIZE;
 
     req_len = _xcpa_cmdblock(req, BLOBSIZE, XCP_ADM_REENCRYPT, &rb,
-                              NULL, old, old_len);
+                              NULL, item->blob, item->blob_len);
 
     if (req_len < 0) {
         fprintf(stderr, "reencrypt cmd block construction failed\n");
@@ -158,29 +151,24 @@ static int reencrypt(CK_SESSION_HANDLE session, CK_ULONG obj, CK_BYTE *old,
         goto out;
     }
 
-    if (old_len != lrb.pllen) {
+    if (item->blob_len != lrb.pllen) {
         fprintf(stderr, "reencryption blob size changed: %lx %lx %lx %lx\n",
-                old_len, lrb.pllen, resp_len, req_len);
+                item->blob_len, lrb.pllen, resp_len, req_len);
         rc = -5;
         goto out;
     }
 
-    memset(blob, 0, sizeof(blob));
-    blob_len = old_len;
-    memcpy(blob, lrb.payload, blob_len);
-    opaque_template[0].ulValueLen = blob_len;
-
-    rc = funcs->C_SetAttributeValue(session, key_store[obj], opaque_template,
-                                    1);
-    if (rc != CKR_OK) {
-        fprintf(stderr,
-                "reencryption C_SetAttributeValue failed: obj %lx '%s' rc: %lx\n",
-                obj, name, rc);
+    *new_blob = malloc(item->blob_len);
+    if (*new_blob == NULL) {
+        fprintf(stderr, "malloc of %lu bytes failed\n", item->blob_len);
         rc = -6;
         goto out;
     }
+    memcpy(*new_blob, lrb.payload, item->blob_len);
+    *new_blob_len = item->blob_len;
 
-    fprintf(stderr, "reencryption success obj: %lx '%s:\n", obj, name);
+    fprintf(stderr, "reencryption success obj: %lx '%s'\n", item->handle,
+            name);
 
 out:
     if (_m_rm_module != NULL)
@@ -188,6 +176,72 @@ out:
     return rc;
 }
 
+/*
+ * Adds a key object with a secure key blob to the list of keys to migrate.
+ * Objects without CKA_KEY_TYPE or CKA_IBM_OPAQUE are ignored.
+ */
+static int add_key(CK_SESSION_HANDLE session, CK_OBJECT_HANDLE handle,
+                   struct key_migrate_item **items, unsigned long *num_items)
+{
+    CK_KEY_TYPE keytype;
+    CK_ATTRIBUTE attrs[] = {
+        {CKA_KEY_TYPE, &keytype, sizeof(CK_KEY_TYPE)},
+        {CKA_IBM_OPAQUE, NULL_PTR, 0},
+        {CKA_LABEL, NULL_PTR, 0}
+    };
+    struct key_migrate_item *item;
+    CK_RV rc;
+
+    /* only for keys */
+    rc = funcs->C_GetAttributeValue(session, handle, attrs, 1);
+    if (rc != CKR_OK)
+        return 0;
+
+    /* exist and size query CKA_IBM_OPAQUE, the label is informational */
+    rc = funcs->C_GetAttributeValue(session, handle, &attrs[1], 2);
+    if (rc != CKR_OK && rc != CKR_ATTRIBUTE_TYPE_INVALID)
+        return 0;
+    if (attrs[1].ulValueLen == CK_UNAVAILABLE_INFORMATION)
+        return 0;
+    if (attrs[2].ulValueLen == CK_UNAVAILABLE_INFORMATION)
+        attrs[2].ulValueLen = 0;
+
+    item = realloc(*items, (*num_items + 1) * sizeof(*item));
+    if (item == NULL)
+        return -1;
+    *items = item;
+    item = &item[*num_items];
+    memset(item, 0, sizeof(*item));
+
+    attrs[1].pValue = malloc(attrs[1].ulValueLen);
+    attrs[2].pValue = calloc(1, attrs[2].ulValueLen + 1);
+    if (attrs[1].pValue == NULL || attrs[2].pValue == NULL) {
+        free(attrs[1].pValue);
+        free(attrs[2].pValue);
+        return -1;
+    }
+
+    /* get the blob after knowing its size */
+    rc = funcs->C_GetAttributeValue(session, handle, &attrs[1],
+                                    attrs[2].ulValueLen > 0 ? 2 : 1);
+    if (rc != CKR_OK) {
+        fprintf(stderr, "second C_GetAttributeValue failed "
+                "rc = 0x%02lx [%s]\n", rc, p11_get_ckr(rc));
+        free(attrs[1].pValue);
+        free(attrs[2].pValue);
+        return -1;
+    }
+
+    item->handle = handle;
+    item->key_type = keytype;
+    item->blob = attrs[1].pValue;
+    item->blob_len = attrs[1].ulValueLen;
+    item->label = attrs[2].pValue;
+    (*num_items)++;
+
+    return 0;
+}
+
 static CK_RV get_ep11_library_version(CK_VERSION *lib_version)
 {
     unsigned int host_version;
@@ -394,7 +448,8 @@ static int do_GetFunctionList(void)
 
 static void usage(char *fct)
 {
-    printf("usage:  %s [-slot <num>] [-adapter <num>] [-domain <num>] [-h]\n\n",
+    printf("usage:  %s [-slot <num>] [-adapter <num>] [-domain <num>]\n"
+           "        [-threads <num>] [-checkpoint <file>] [-dry-run] [-h]\n\n",
            fct);
     return;
 }
@@ -434,6 +489,23 @@ static int do_ParseArgs(int argc, char **argv)
             }
             domain = (int) strtol(argv[i + 1], NULL, 0);
             i++;
+        } else if (strcmp(argv[i], "-threads") == 0) {
+            if (i + 1 >= argc || !isdigit(*argv[i + 1]) ||
+                strtol(argv[i + 1], NULL, 0) < 1) {
+                printf("Threads parameter is not a positive number!\n");
+                return -1;
+            }
+            migrate_opts.num_workers = strtol(argv[i + 1], NULL, 0);
+            i++;
+        } else if (strcmp(argv[i], "-checkpoint") == 0) {
+            if (i + 1 >= argc) {
+                printf("Checkpoint file not specified!\n");
+                return -1;
+            }
+            migrate_opts.checkpoint = argv[i + 1];
+            i++;
+        } else if (strcmp(argv[i], "-dry-run") == 0) {
+            migrate_opts.dry_run = TRUE;
         } else {
             printf("Invalid argument passed as option: %s\n", argv[i]);
             usage(argv[0]);
@@ -523,6 +595,9 @@ int main(int argc, char **argv)
     CK_ULONG obj;
     CK_ULONG user_pin_len;
     CK_ULONG keys_found = 0;
+    struct key_migrate_item *items = NULL;
+    unsigned long num_items = 0;
+    struct key_migrate_stats stats;
 
     rc = do_ParseArgs(argc, argv);
     if (rc != 1) {
@@ -621,7 +696,7 @@ int main(int argc, char **argv)
     if (check_card_status() != 0)
         return 1;
 
-    /* find all objects */
+    /* find all objects and collect the keys with a secure key blob */
     rc = funcs->C_FindObjectsInit(session, NULL, 0);
 
     do {
@@ -634,46 +709,9 @@ int main(int argc, char **argv)
         }
 
         for (obj = 0; obj < keys_found; obj++) {
-            CK_ATTRIBUTE opaque_template[] = {
-                {CKA_IBM_OPAQUE, NULL_PTR, 0}
-            };
-
-            CK_KEY_TYPE keytype;
-            CK_ATTRIBUTE key_type_template[] = {
-                {CKA_KEY_TYPE, &keytype, sizeof(CK_KEY_TYPE)}
-            };
-
-            CK_BYTE *old_blob;
-
-            /* only for keys */
-            rc = funcs->C_GetAttributeValue(session, key_store[obj],
-                                            key_type_template, 1);
-            if (rc != CKR_OK)
-                continue;
-
-            /* exist and size query CKA_IBM_QPAQUE */
-            rc = funcs->C_GetAttributeValue(session, key_store[obj],
-                                            opaque_template, 1);
-            if (rc == CKR_OK) {
-                old_blob = malloc(opaque_template[0].ulValueLen);
-                opaque_template[0].pValue = old_blob;
-                /* get the blob after knowing its size */
-                rc = funcs->C_GetAttributeValue(session, key_store[obj],
-                                                opaque_template, 1);
-
-                if (rc != CKR_OK) {
-                    fprintf(stderr, "second C_GetAttributeValue failed "
-                            "rc = 0x%02x [%s]\n", rc, p11_get_ckr(rc));
-                    return rc;
-                } else {
-                    if (reencrypt(session, obj,
-                                  (CK_BYTE *) opaque_template[0].pValue,
-                                  opaque_template[0].ulValueLen) != 0) {
-                        /* reencrypt failed */
-                        return -1;
-                    }
-                }
-                free(old_blob);
+            if (add_key(session, key_store[obj], &items, &num_items) != 0) {
+                fprintf(stderr, "collecting the keys failed\n");
+                return -1;
             }
         }
     }
@@ -681,10 +719,39 @@ int main(int argc, char **argv)
     while (keys_found != 0);
 
     rc = funcs->C_FindObjectsFinal(session);
-    fprintf(stderr, "all keys successfully reencrypted\n");
+
+    /* reencrypt the keys with parallel sessions */
+    rc = key_migrate_run(funcs, SLOT_ID, items, num_items, reencrypt, NULL,
+                         &migrate_opts, &stats);
+    if (rc != 0) {
+        fprintf(stderr, "key migration could not be started: %s\n",
+                strerror(-rc));
+        return -1;
+    }
+
+    fprintf(stderr, "%s%lu of %lu keys reencrypted in %.1f seconds "
+            "(%.1f keys/s), %lu already reencrypted, %lu failed\n",
+            migrate_opts.dry_run ? "dry run: " : "", stats.migrated,
+            stats.total, stats.seconds,
+            stats.seconds > 0 ? stats.migrated / stats.seconds : 0.0,
+            stats.skipped, stats.failed);
+    if (stats.interrupted)
+        fprintf(stderr, "reencryption interrupted, run again with the same "
+                "checkpoint file to resume\n");
+    else if (stats.failed == 0 && !migrate_opts.dry_run)
+        fprintf(stderr, "all keys successfully reencrypted\n");
+
+    for (obj = 0; obj < num_items; obj++) {
+        free(items[obj].blob);
+        free(items[obj].label);
+    }
+    free(items);
 
     rc = funcs->C_Logout(session);
     rc = funcs->C_CloseAllSessions(SLOT_ID);
 
+    if (stats.failed != 0 || stats.interrupted)
+        return -1;
+
     return rc;
 }
@@ -39,6 +39,8 @@ key_t tok;
 Slot_Info_t_64 sinfo[NUMBER_SLOTS_MANAGED];
 unsigned int NumberSlotsInDB = 0;
 int event_support_disabled = 0;
+int lazy_slot_init = 0;
+int fork_preserve_state = 0;
 
 Slot_Info_t_64 *psinfo;
 
@@ -556,6 +558,16 @@ static int config_parse(const char *config_file)
                 event_support_disabled = 1;
                 continue;
             }
+            if (strcmp(confignode_to_bareconst(c)->base.key,
+                       "lazy-slot-init") == 0) {
+                lazy_slot_init = 1;
+                continue;
+            }
+            if (strcmp(confignode_to_bareconst(c)->base.key,
+                       "fork-preserve-state") == 0) {
+                fork_preserve_state = 1;
+                continue;
+            }
 
             ErrLog("Error parsing config file '%s': unexpected token '%s' "
                    "at line %d: \n", config_file, c->key, c->line);
@@ -705,6 +717,10 @@ int main(int argc, char *argv[], char *envp[])
     }
     if (event_support_disabled)
         socketData.flags |= FLAG_EVENT_SUPPORT_DISABLED;
+    if (lazy_slot_init)
+        socketData.flags |= FLAG_LAZY_SLOT_INIT;
+    if (fork_preserve_state)
+        socketData.flags |= FLAG_FORK_PRESERVE_STATE;
 
     /* Create customized token directories */
     psinfo = &socketData.slot_info[0];
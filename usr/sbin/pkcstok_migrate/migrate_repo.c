@@ -0,0 +1,209 @@
+/*
+ * COPYRIGHT (c) International Business Machines Corp. 2024
+ *
+ * This program is provided under the terms of the Common Public License,
+ * version 1.0 (CPL-1.0). Any use, reproduction or distribution for this
+ * software constitutes recipient's acceptance of CPL-1.0 terms which can be
+ * found in the file LICENSE file or at
+ * https://opensource.org/licenses/cpl1.0.php
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <linux/limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "pkcs11types.h"
+#define OCK_TOOL
+#include "pkcs_utils.h"
+#include "migrate_repo.h"
+
+struct migrate_run {
+    char **names;
+    unsigned int num_names;
+    unsigned int next;          /* next object to migrate, atomic */
+    migrate_object_func_t func;
+    void *ctx;
+};
+
+static void *migrate_thread(void *arg)
+{
+    struct migrate_run *run = arg;
+    unsigned int i;
+
+    while ((i = __sync_fetch_and_add(&run->next, 1)) < run->num_names)
+        run->func(run->ctx, run->names[i]);
+
+    return NULL;
+}
+
+/**
+ * Calls func for every object name, from up to num_threads threads. The
+ * calling thread is one of them. If a thread cannot be created, the objects
+ * are migrated by the threads already running. Returns the number of threads
+ * that were used.
+ */
+unsigned int migrate_repo_objects(char **names, unsigned int num_names,
+                                  unsigned int num_threads,
+                                  migrate_object_func_t func, void *ctx)
+{
+    struct migrate_run run;
+    pthread_t threads[MIGRATE_MAX_THREADS];
+    unsigned int started = 0, i;
+    int rc;
+
+    memset(&run, 0, sizeof(run));
+    run.names = names;
+    run.num_names = num_names;
+    run.func = func;
+    run.ctx = ctx;
+
+    if (num_threads > MIGRATE_MAX_THREADS)
+        num_threads = MIGRATE_MAX_THREADS;
+    if (num_threads > num_names)
+        num_threads = num_names;
+
+    for (i = 1; i < num_threads; i++) {
+        rc = pthread_create(&threads[started], NULL, migrate_thread, &run);
+        if (rc != 0) {
+            TRACE_WARN("Cannot create migration thread: %s.\n",
+                       strerror(rc));
+            break;
+        }
+        started++;
+    }
+    TRACE_INFO("Migrating %u object(s) with %u thread(s) ...\n",
+               num_names, started + 1);
+
+    migrate_thread(&run);
+
+    for (i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+
+    return started + 1;
+}
+
+/**
+ * Sync the file system of the given folder and the folder entry itself.
+ */
+CK_RV migrate_repo_sync(const char *folder)
+{
+    int fd;
+    CK_RV ret = CKR_OK;
+
+    fd = open(folder, O_RDONLY | O_DIRECTORY);
+    if (fd < 0) {
+        TRACE_ERROR("Cannot open %s, errno=%s.\n", folder, strerror(errno));
+        return CKR_FUNCTION_FAILED;
+    }
+
+    if (syncfs(fd) != 0 || fsync(fd) != 0) {
+        TRACE_ERROR("Cannot sync %s, errno=%s.\n", folder, strerror(errno));
+        ret = CKR_FUNCTION_FAILED;
+    }
+
+    close(fd);
+
+    return ret;
+}
+
+/**
+ * Switch to new repository by renaming the old repository to the backup
+ * folder name and the migrated repository to the original data store name.
+ * The new repository is synced to disk first. Both folders are then
+ * exchanged atomically, so that the original data store name always refers
+ * to a complete repository.
+ *
+ * On success, backup holds the folder of the old repository. That is
+ * normally data_store_old with a _BAK suffix, but it stays data_store_new
+ * if the exchanged folder cannot be renamed. On failure, data_store_old is
+ * still the old repository, unless it could not be renamed back, which is
+ * traced.
+ */
+CK_RV migrate_repo_switch(const char *data_store_old,
+                          const char *data_store_new,
+                          char *backup, size_t backup_len)
+{
+    char fname1[PATH_MAX];
+    char parent[PATH_MAX];
+    CK_RV ret;
+    int rc = -1;
+
+    TRACE_INFO("Switching to new repository ...\n");
+
+    /* All migrated files are synced at once */
+    ret = migrate_repo_sync(data_store_new);
+    if (ret != CKR_OK)
+        goto done;
+
+    snprintf(fname1, sizeof(fname1), "%s_BAK", data_store_old);
+
+#ifdef RENAME_EXCHANGE
+    rc = renameat2(AT_FDCWD, data_store_new, AT_FDCWD, data_store_old,
+                   RENAME_EXCHANGE);
+    if (rc == 0) {
+        /*
+         * The switch is done, the temp folder name now refers to the old
+         * repository. Keep it there if it cannot be renamed.
+         */
+        rc = rename(data_store_new, fname1);
+        if (rc) {
+            TRACE_WARN("Cannot rename %s to %s, errno=%s. The old repository "
+                       "is kept at %s.\n", data_store_new, fname1,
+                       strerror(errno), data_store_new);
+            snprintf(backup, backup_len, "%s", data_store_new);
+        } else {
+            snprintf(backup, backup_len, "%s", fname1);
+        }
+        goto sync;
+    }
+    if (errno != ENOSYS && errno != EINVAL) {
+        TRACE_ERROR("Cannot exchange %s and %s, errno=%s.\n", data_store_old,
+                    data_store_new, strerror(errno));
+        ret = CKR_FUNCTION_FAILED;
+        goto done;
+    }
+    TRACE_INFO("Atomic exchange not supported, renaming folders ...\n");
+#endif
+
+    /* Rename original repository folder */
+    rc = rename(data_store_old, fname1);
+    if (rc) {
+        TRACE_ERROR("Cannot rename %s, errno=%s.\n", data_store_old, strerror(errno));
+        ret = CKR_FUNCTION_FAILED;
+        goto done;
+    }
+
+    /* Rename backup folder */
+    rc = rename(data_store_new, data_store_old);
+    if (rc) {
+        TRACE_ERROR("Cannot rename %s, errno=%s.\n", data_store_new, strerror(errno));
+        /* Bring the old repository back to the data store name */
+        if (rename(fname1, data_store_old) != 0)
+            TRACE_ERROR("Cannot rename %s back to %s, errno=%s. The old "
+                        "repository is at %s.\n", fname1, data_store_old,
+                        strerror(errno), fname1);
+        ret = CKR_FUNCTION_FAILED;
+        goto done;
+    }
+    snprintf(backup, backup_len, "%s", fname1);
+
+#ifdef RENAME_EXCHANGE
+sync:
+#endif
+    /* Make the renames durable. The switch itself is done at this point. */
+    snprintf(parent, sizeof(parent), "%s", data_store_old);
+    if (migrate_repo_sync(dirname(parent)) != CKR_OK)
+        TRACE_WARN("The switch to the new repository may not be on disk "
+                   "yet.\n");
+    ret = CKR_OK;
+
+done:
+
+    return ret;
+}
@@ -0,0 +1,39 @@
+/*
+ * COPYRIGHT (c) International Business Machines Corp. 2024
+ *
+ * This program is provided under the terms of the Common Public License,
+ * version 1.0 (CPL-1.0). Any use, reproduction or distribution for this
+ * software constitutes recipient's acceptance of CPL-1.0 terms which can be
+ * found in the file LICENSE file or at
+ * https://opensource.org/licenses/cpl1.0.php
+ */
+
+/*
+ * The parts of the pkcstok_migrate repository migration that do not depend
+ * on the object format: migrating the token objects with a pool of threads,
+ * and switching the data store to the migrated repository.
+ */
+
+#ifndef _MIGRATE_REPO_H_
+#define _MIGRATE_REPO_H_
+
+#include <stddef.h>
+
+#include "pkcs11types.h"
+
+#define MIGRATE_MAX_THREADS     16
+
+/* Migrates one token object. Called concurrently from the threads. */
+typedef void (*migrate_object_func_t)(void *ctx, const char *name);
+
+unsigned int migrate_repo_objects(char **names, unsigned int num_names,
+                                  unsigned int num_threads,
+                                  migrate_object_func_t func, void *ctx);
+
+CK_RV migrate_repo_sync(const char *folder);
+
+CK_RV migrate_repo_switch(const char *data_store_old,
+                          const char *data_store_new,
+                          char *backup, size_t backup_len);
+
+#endif
@@ -31,6 +31,9 @@
 #include <termios.h>
 #include <unistd.h>
 #include <dirent.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <pthread.h>
 #include <sys/mman.h>
 #include <pkcs11types.h>
 #include "cfgparser.h"
@@ -42,6 +45,7 @@
 #include "local_types.h"
 #include "h_extern.h"
 #include "slotmgr.h" // for ock_snprintf
+#include "migrate_repo.h"
 
 #define OCK_TOOL
 #include "pkcs_utils.h"
@@ -93,6 +97,19 @@ static FILE *open_tokenobject(char *buf, size_t buflen,
     return res;
 }
 
+/* Number of threads migrating token objects, 0 = number of online CPUs */
+static unsigned int num_threads;
+
+/* set_perm() uses getgrnam(), which is not thread safe */
+static pthread_mutex_t perm_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void set_object_perm(int fd)
+{
+    pthread_mutex_lock(&perm_mutex);
+    set_perm(fd);
+    pthread_mutex_unlock(&perm_mutex);
+}
+
 struct findstdll {
     char *stdll;
     size_t len;
@@ -199,7 +216,7 @@ static CK_RV migrate_public_token_object(const char *data_store, const char *nam
         ret = CKR_FUNCTION_FAILED;
         goto done;
     }
-    set_perm(fileno(fp));
+    set_object_perm(fileno(fp));
 
     /* Save new object */
     if (fwrite(obj_new, obj_new_len, 1, fp) != 1) {
@@ -462,7 +479,7 @@ static CK_RV migrate_private_token_object(const char *data_store, const char *na
         ret = CKR_FUNCTION_FAILED;
         goto done;
     }
-    set_perm(fileno(fp));
+    set_object_perm(fileno(fp));
 
     /* Save new object */
     if (fwrite(obj_new, obj_new_len, 1, fp) != 1) {
@@ -621,69 +638,89 @@ done:
     return ret;
 }
 
+struct migrate_objects {
+    const char *data_store;
+    const CK_BYTE *masterkey_old;
+    const CK_BYTE *masterkey_new;
+    unsigned int migrated;      /* atomic */
+};
+
 /**
- * Migrate the token objects from old to new format. Some of the token objects
- * may be in old and some may be in new format if a previous migration run
- * was interrupted.
+ * Migrates a single token object. Objects already in the new format, e.g.
+ * from an interrupted previous run, are left as they are.
  */
-static CK_RV migrate_token_objects(const char *data_store, const CK_BYTE *masterkey_old,
-                                   const CK_BYTE *masterkey_new,
-                                   const CK_BYTE *so_wrap_key,
-                                   const CK_BYTE *user_wrap_key)
+static void migrate_token_object(void *ctx, const char *name)
 {
-    const char *tokobj = "TOK_OBJ";
-    const char *objidx = "OBJ.IDX";
-    FILE *fp = NULL;
+    struct migrate_objects *mo = ctx;
     unsigned char *obj = NULL;
     unsigned int obj_len;
-    char tmp[PATH_MAX];
-    char iname[PATH_MAX + 1 + strlen(tokobj) + 1 + strlen(objidx) + 1];
     CK_BBOOL priv;
     CK_ULONG version;
-    int count = 0, scount = 0;
     CK_RV ret;
 
-    /* Check parms */
-    if (!data_store || !masterkey_old || !masterkey_new || !so_wrap_key
-        || !user_wrap_key) {
-        TRACE_ERROR("Invalid parms.\n");
-        ret = CKR_ARGUMENTS_BAD;
+    ret = read_object(mo->data_store, name, &obj, &obj_len, &version, &priv);
+    if (ret != CKR_OK || version != TOKVERSION_00)
         goto done;
+
+    if (priv) {
+        ret = migrate_private_token_object(mo->data_store, name, obj, obj_len,
+                                           mo->masterkey_old,
+                                           mo->masterkey_new);
+        if (ret != CKR_OK)
+            TRACE_ERROR("Cannot migrate private object %s, continuing ... \n", name);
+    } else {
+        ret = migrate_public_token_object(mo->data_store, name, obj, obj_len);
+        if (ret != CKR_OK)
+            TRACE_ERROR("Cannot migrate public object %s, continuing ... \n", name);
     }
+    if (ret == CKR_OK)
+        __sync_fetch_and_add(&mo->migrated, 1);
+
+done:
+    free(obj);
+}
+
+/**
+ * Reads the object names from OBJ.IDX.
+ */
+static CK_RV read_object_index(const char *data_store, char ***names,
+                               unsigned int *num_names)
+{
+    const char *tokobj = "TOK_OBJ";
+    const char *objidx = "OBJ.IDX";
+    char tmp[PATH_MAX];
+    char iname[PATH_MAX + 1 + strlen(tokobj) + 1 + strlen(objidx) + 1];
+    char **list = NULL, **new_list;
+    unsigned int count = 0, alloc = 0;
+    FILE *fp;
+    CK_RV ret = CKR_OK;
+
+    *names = NULL;
+    *num_names = 0;
+    tmp[0] = 0;
 
-    /* Open index file OBJ.IDX */
     fp = open_tokenobject(iname, sizeof(iname),
                           data_store, tokobj, objidx, "r");
-    if (!fp) {
-        ret = CKR_FUNCTION_FAILED;
-        goto done;
-    }
+    if (!fp)
+        return CKR_FUNCTION_FAILED;
 
-    /* Migrate items from OBJ.IDX */
     while (fgets(tmp, PATH_MAX, fp)) {
         tmp[strlen(tmp) - 1] = 0;
-        ret = read_object(data_store, tmp, &obj, &obj_len, &version, &priv);
-        if (ret == 0 && version == TOKVERSION_00) {
-            if (priv) {
-                ret = migrate_private_token_object(data_store, tmp,
-                                   obj, obj_len, masterkey_old, masterkey_new);
-                if (ret != CKR_OK) {
-                    TRACE_ERROR("Cannot migrate private object %s, continuing ... \n", tmp);
-                } else
-                    scount++;
-            } else {
-                ret = migrate_public_token_object(data_store, tmp,
-                                                  obj, obj_len);
-                if (ret != CKR_OK) {
-                    TRACE_ERROR("Cannot migrate public object %s, continuing ... \n", tmp);
-                } else
-                    scount++;
+        if (count == alloc) {
+            alloc = alloc ? alloc * 2 : 64;
+            new_list = realloc(list, alloc * sizeof(char *));
+            if (new_list == NULL) {
+                TRACE_ERROR("cannot realloc %u object names.\n", alloc);
+                ret = CKR_HOST_MEMORY;
+                goto done;
             }
+            list = new_list;
         }
-
-        if (obj) {
-            free(obj);
-            obj = NULL;
+        list[count] = strdup(tmp);
+        if (list[count] == NULL) {
+            TRACE_ERROR("cannot strdup object name %s.\n", tmp);
+            ret = CKR_HOST_MEMORY;
+            goto done;
         }
         count++;
     }
@@ -694,14 +731,76 @@ static CK_RV migrate_token_objects(const char *data_store, const CK_BYTE *master
                    tmp);
     }
 
-    /* Close OBJ.IDX */
+done:
     fclose(fp);
 
+    if (ret != CKR_OK) {
+        while (count > 0)
+            free(list[--count]);
+        free(list);
+        list = NULL;
+    }
+    *names = list;
+    *num_names = count;
+
+    return ret;
+}
+
+/**
+ * Migrate the token objects from old to new format. Some of the token objects
+ * may be in old and some may be in new format if a previous migration run
+ * was interrupted.
+ * The objects are read, converted and written by several threads. The files
+ * are not synced one by one, the whole repository is synced once before it
+ * is switched to (see migrate_repo_switch).
+ */
+static CK_RV migrate_token_objects(const char *data_store, const CK_BYTE *masterkey_old,
+                                   const CK_BYTE *masterkey_new,
+                                   const CK_BYTE *so_wrap_key,
+                                   const CK_BYTE *user_wrap_key)
+{
+    struct migrate_objects mo;
+    char **names = NULL;
+    unsigned int num_names = 0, threads_wanted, i;
+    long cpus;
+    CK_RV ret;
+
+    memset(&mo, 0, sizeof(mo));
+
+    /* Check parms */
+    if (!data_store || !masterkey_old || !masterkey_new || !so_wrap_key
+        || !user_wrap_key) {
+        TRACE_ERROR("Invalid parms.\n");
+        ret = CKR_ARGUMENTS_BAD;
+        goto done;
+    }
+
+    ret = read_object_index(data_store, &names, &num_names);
+    if (ret != CKR_OK)
+        goto done;
+
+    mo.data_store = data_store;
+    mo.masterkey_old = masterkey_old;
+    mo.masterkey_new = masterkey_new;
+
+    threads_wanted = num_threads;
+    if (threads_wanted == 0) {
+        cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads_wanted = cpus > 0 ? cpus : 1;
+    }
+
+    migrate_repo_objects(names, num_names, threads_wanted,
+                         migrate_token_object, &mo);
+
     ret = CKR_OK;
 
-    TRACE_NONE("Migrated %d object(s) out of %d object(s).\n", scount, count);
+    TRACE_NONE("Migrated %d object(s) out of %d object(s).\n", mo.migrated,
+               num_names);
 
 done:
+    for (i = 0; i < num_names; i++)
+        free(names[i]);
+    free(names);
 
     return ret;
 }
@@ -2000,43 +2099,6 @@ done:
     return ret;
 }
 
-/**
- * Switch to new repository by deleting the old repository and renaming
- * the backup folder to the original data store name.
- */
-static CK_RV switch_to_new_repository(const char *data_store_old,
-                                      const char *data_store_new)
-{
-    char fname1[PATH_MAX];
-    CK_RV ret;
-    int rc = -1;
-
-    TRACE_INFO("Switching to new repository ...\n");
-
-    /* Rename original repository folder */
-    snprintf(fname1, sizeof(fname1), "%s_BAK", data_store_old);
-    rc = rename(data_store_old, fname1);
-    if (rc) {
-        TRACE_ERROR("Cannot rename %s, errno=%s.\n", data_store_old, strerror(errno));
-        ret = CKR_FUNCTION_FAILED;
-        goto done;
-    }
-
-    /* Rename backup folder */
-    rc = rename(data_store_new, data_store_old);
-    if (rc) {
-        TRACE_ERROR("Cannot rename %s, errno=%s.\n", data_store_new, strerror(errno));
-        ret = CKR_FUNCTION_FAILED;
-        goto done;
-    }
-
-    ret = CKR_OK;
-
-done:
-
-    return ret;
-}
-
 /**
  * Inserts the new tokversion parm in the token's slot configuration, e.g.
  *
@@ -2551,6 +2613,8 @@ static void usage(char *progname)
     printf(" -c, --confdir CONFDIR\t\tlocation of opencryptoki.conf (required)\n");
     printf(" -u, --userpin USERPIN\t\ttoken user pin (prompted if not specified)\n");
     printf(" -p, --sopin SOPIN\t\ttoken SO pin (prompted if not specified)\n");
+    printf(" -t, --threads NUM\t\tmigrate the token objects with NUM threads\n");
+    printf("\t\t\t\t(optional, default: number of online CPUs)\n");
     printf(" -v, --verbose LEVEL\t\tset verbose level (optional):\n");
     printf("\t\t\t\tnone (default), error, warn, info, devel, debug\n");
     return;
@@ -2569,6 +2633,7 @@ int main(int argc, char **argv)
     char *buff = NULL;
     char dll_name[PATH_MAX];
     char data_store_new[PATH_MAX];
+    char backup[PATH_MAX] = "";
     CK_TOKEN_INFO_32 tokinfo;
     CK_BBOOL new;
 
@@ -2579,11 +2644,12 @@ int main(int argc, char **argv)
         {"userpin", required_argument, NULL, 'u'},
         {"sopin", required_argument, NULL, 'p'},
         {"verbose", required_argument, NULL, 'v'},
+        {"threads", required_argument, NULL, 't'},
         {"help", no_argument, NULL, 'h'},
         {0, 0, 0, 0}
     };
 
-    while ((opt = getopt_long(argc, argv, "d:c:s:u:p:v:h", long_opts, NULL)) != -1) {
+    while ((opt = getopt_long(argc, argv, "d:c:s:u:p:v:t:h", long_opts, NULL)) != -1) {
         switch (opt) {
         case 'd':
             data_store = strdup(optarg);
@@ -2632,6 +2698,14 @@ int main(int argc, char **argv)
                 exit(1);
             }
             break;
+        case 't':
+            if (atoi(optarg) < 1) {
+                warnx("Invalid number of threads '%s' specified.", optarg);
+                usage(argv[0]);
+                exit(1);
+            }
+            num_threads = atoi(optarg);
+            break;
         case 'h':
             usage(argv[0]);
             exit(0);
@@ -2668,6 +2742,8 @@ int main(int argc, char **argv)
         printf("  user PIN specified\n");
     if (sopin)
         printf("  SO PIN specified\n");
+    if (num_threads)
+        printf("  threads = %u\n", num_threads);
     if (vlevel >= 0) {
         trace_level = vlevel;
         printf("  verbose level = %s\n", verbose);
@@ -2835,7 +2911,8 @@ int main(int argc, char **argv)
     }
 
     /* Switch to new repository */
-    ret = switch_to_new_repository(data_store_old, data_store_new);
+    ret = migrate_repo_switch(data_store_old, data_store_new, backup,
+                              sizeof(backup));
     if (ret != CKR_OK) {
         warnx("Switch to new repository failed.");
         goto done;
@@ -2856,8 +2933,8 @@ finalize:
         goto done;
     }
 
-    if (data_store_old != NULL)
-        printf("Pre-migration data backed up at '%s_BAK'\n", data_store_old);
+    if (backup[0] != '\0')
+        printf("Pre-migration data backed up at '%s'\n", backup);
     printf("Config file backed up at '%s/opencryptoki.conf_BAK'\n", conf_dir);
     printf("Remove these backups manually after testing the new repository.\n");
 
@@ -5,8 +5,9 @@ noinst_HEADERS += usr/lib/common/host_defs.h
 noinst_HEADERS += usr/include/local_types.h
 noinst_HEADERS += usr/lib/common/h_extern.h
 noinst_HEADERS += usr/lib/common/pkcs_utils.h
+noinst_HEADERS += usr/sbin/pkcstok_migrate/migrate_repo.h
 
-usr_sbin_pkcstok_migrate_pkcstok_migrate_LDFLAGS = -lcrypto -ldl -lrt
+usr_sbin_pkcstok_migrate_pkcstok_migrate_LDFLAGS = -lcrypto -ldl -lrt -lpthread
 
 usr_sbin_pkcstok_migrate_pkcstok_migrate_CFLAGS  =		\
 	-DSTDLL_NAME=\"pkcstok_migrate\"			\
@@ -24,6 +25,7 @@ usr_sbin_pkcstok_migrate_pkcstok_migrate_SOURCES =		\
 	usr/lib/common/trace.c 					\
 	usr/lib/common/pkcs_utils.c				\
 	usr/sbin/pkcstok_migrate/pkcstok_migrate.c		\
+	usr/sbin/pkcstok_migrate/migrate_repo.c			\
 	usr/lib/config/configuration.c				\
 	usr/lib/config/cfgparse.y 				\
 	usr/lib/config/cfglex.l